@@ -29,6 +29,24 @@
 
 #include "firmware_base.h"
 
+/*
+  帧格式: 0xFF, 序号, 长度(高字节在前), 数据, CRC16(高字节在前), 应答帧格式相同, 序号与请求相同
+  最多 getWindow() 个帧未应答, 应答可以乱序到达, 完成回调按发送顺序调用
+  最早的帧超时后重发所有未应答的帧(go-back-N), 要求对方按序号顺序执行, 重复的序号回复缓存的应答
+  标准 bridge 不缓存应答, begin() 之后窗口为1, 与原来的停等协议相同;
+  对方支持时由应用调用 setWindow() 打开多帧
+  有未完成的帧时 intorobot_loop(TIM1中断) 跳过这次处理, 不会与前台的帧交错
+*/
+
+// 异步传输完成回调, len 为收到的长度, 失败时为 BridgeClass::TRANSFER_TIMEOUT
+typedef void (*BridgeCallback)(void *arg, uint16_t len);
+
+// 用 BridgeClass::resultCallback 保存异步传输的结果
+struct BridgeResult
+{
+    volatile bool done;
+    volatile uint16_t len;
+};
 
 class BridgeClass 
 {
@@ -70,24 +88,102 @@ class BridgeClass
             return transfer(buff1, len1, buff2, len2, NULL, 0, rxbuff, rxlen);
         }
 
+        // 异步传输, 发送后立即返回, 窗口已满返回false
+        // 完成之前发送缓冲和接收缓冲必须保持有效
+        bool send(const uint8_t *buff1, uint16_t len1,
+        const uint8_t *buff2, uint16_t len2,
+        const uint8_t *buff3, uint16_t len3,
+        uint8_t *rxbuff, uint16_t rxlen,
+        BridgeCallback callback, void *arg);
+        // 接收应答, 超时重发, 调用完成回调, 有未完成的帧时需要经常调用
+        void poll(void);
+        // 等待异步传输完成, 返回收到的长度
+        uint16_t wait(BridgeResult &result);
+        static void resultCallback(void *arg, uint16_t len);
+        uint8_t pending(void)
+        {
+            return count;
+        }
+        void setWindow(uint8_t _window);
+        uint8_t getWindow(void)
+        {
+            return window;
+        }
+
         uint16_t getBridgeVersion(void)
         {
             return bridgeVersion;
         }
 
         static const int TRANSFER_TIMEOUT = 0xFFFF;
+        static const uint8_t WINDOW_MAX = 4;
 
     private:
         uint8_t index;
-        int timedRead(unsigned int timeout);
         void dropAll(void);
         uint16_t bridgeVersion;
 
+    private:
+        enum FrameState
+        {
+            FRAME_FREE = 0,
+            FRAME_SENT,         // 等待应答
+            FRAME_DONE          // 已应答, 等待按顺序完成
+        };
+        struct Frame
+        {
+            const uint8_t *buff[3];
+            uint16_t len[3];
+            uint8_t *rxbuff;
+            uint16_t rxlen;
+            uint16_t rxcount;
+            BridgeCallback callback;
+            void *arg;
+            unsigned long time;     // 最后发送时间
+            uint8_t index;
+            uint8_t state;
+        };
+        Frame frames[WINDOW_MAX];
+        uint8_t head;               // 最早的帧
+        volatile uint8_t count;     // 未完成的帧数, intorobot_loop 根据它判断bridge是否空闲
+        uint8_t window;
+        uint8_t retries;            // 最早的帧的重发次数
+
+        enum RxState
+        {
+            RX_HEAD = 0,
+            RX_INDEX,
+            RX_LEN_H,
+            RX_LEN_L,
+            RX_DATA,
+            RX_CRC_H,
+            RX_CRC_L
+        };
+        uint8_t rxState;
+        Frame *rxFrame;             // 正在接收的应答对应的帧, 没有时为NULL
+        uint8_t rxIndex;
+        uint16_t rxLen;
+        uint16_t rxPos;
+        uint16_t rxCRC;
+        uint8_t rxCRCHigh;
+        unsigned long rxTime;       // 最后收到数据的时间
+
+        bool lock(void);
+        void unlock(bool locked);
+        void sendFrame(Frame &frame);
+        void sendBytes(const uint8_t *buff, uint16_t len);
+        void receive(void);
+        void receiveByte(uint8_t c);
+        void receiveFrame(void);
+        void complete(void);
+        void timeout(void);
+        void release(uint16_t len);
+
     private:
         void crcUpdate(uint8_t c);
+        void crcUpdate(const uint8_t *buff, uint16_t len);
         void crcReset(void);
         void crcWrite(void);
-        bool crcCheck(uint16_t _CRC);
         uint16_t CRCSUM;
 
     private:
@@ -70,6 +70,7 @@ class File : public Stream
 
     private:
         void doBuffer(void);
+        uint16_t readBlocks(uint8_t *buff, uint16_t nbyte, bool &end);
         uint8_t buffered;
         uint8_t readPos;
         uint16_t dirPosition;
@@ -1540,6 +1540,10 @@ void intorobot_info_debug(void)
 **********************************************************************************/
 void intorobot_loop(void)
 {
+    if (Bridge.pending())
+    {
+        return;     // 前台正在使用bridge, 下一次定时中断再处理
+    }
     if (System.mode() != MODE_MANUAL)
     {
         IntoRobot.process();
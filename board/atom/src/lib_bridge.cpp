@@ -24,6 +24,7 @@
  */
 
 #include "lib_bridge.h"
+#include "lib_crc.h"
 
 /*********************************************************************************
   *Function          :       BridgeClass::BridgeClass(Stream &_stream)
@@ -38,9 +39,10 @@
   *Others            :
 **********************************************************************************/
 BridgeClass::BridgeClass(Stream &_stream) :
-    index(0), stream(_stream), started(false), max_retries(0)
+    index(0), head(0), count(0), window(1), retries(0), rxState(RX_HEAD), rxFrame(NULL),
+    stream(_stream), started(false), max_retries(0)
 {
-    // Empty
+    memset(frames, 0, sizeof(frames));
 }
 
 /*********************************************************************************
@@ -125,6 +127,9 @@ void BridgeClass::begin(void)
             // Bridge v1.0.0 didn't send any version info
             bridgeVersion = 100;
         }
+        // 标准 bridge 不缓存应答, 重发的帧会被重复执行, 窗口保持为1(停等)
+        // 对方支持按序号执行并缓存应答时, 由应用调用 setWindow() 打开多帧
+        setWindow(1);
 
         max_retries = 50;
         DEBUG("Test bridge");
@@ -174,13 +179,8 @@ unsigned int BridgeClass::get(const char *key, uint8_t *value, unsigned int maxl
     return l;
 }
 
-#if defined(ARDUINO_ARCH_AVR)
-// AVR use an optimized implementation of CRC
-#include <util/crc16.h>
-#else
-// Generic implementation for non-AVR architectures
 /*********************************************************************************
-  *Function          :
+  *Function          :     void BridgeClass::crcUpdate(uint8_t c)
   *Description      :
   *Input              :
   *Output            :
@@ -189,29 +189,25 @@ unsigned int BridgeClass::get(const char *key, uint8_t *value, unsigned int maxl
   *date               :
   *Others            :
 **********************************************************************************/
-uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data)
+void BridgeClass::crcUpdate(uint8_t c)
 {
-    data ^= crc & 0xff;
-    data ^= data << 4;
-    return ((((uint16_t)data << 8) | ((crc >> 8) & 0xff)) ^
-    (uint8_t)(data >> 4) ^
-    ((uint16_t)data << 3));
+    CRCSUM = crc16_ccitt_update(CRCSUM, &c, 1);
 }
-#endif
 
 /*********************************************************************************
-  *Function          :     void BridgeClass::crcUpdate(uint8_t c)
-  *Description      :
-  *Input              :
-  *Output            :
-  *Return            :
-  *author            :
-  *date               :
-  *Others            :
+  *Function     : void BridgeClass::crcUpdate(const uint8_t *buff, uint16_t len)
+  *Description  : 整块数据计算CRC
+  *Input        : buff: 数据
+                  len: 数据长度
+  *Output       : none
+  *Return       : none
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : 查表计算, 与逐字节 crcUpdate 结果相同
 **********************************************************************************/
-void BridgeClass::crcUpdate(uint8_t c)
+void BridgeClass::crcUpdate(const uint8_t *buff, uint16_t len)
 {
-    CRCSUM = _crc_ccitt_update(CRCSUM, c);
+    CRCSUM = crc16_ccitt_update(CRCSUM, buff, len);
 }
 
 /*********************************************************************************
@@ -226,7 +222,7 @@ void BridgeClass::crcUpdate(uint8_t c)
 **********************************************************************************/
 void BridgeClass::crcReset(void)
 {
-    CRCSUM = 0xFFFF;
+    CRCSUM = CRC16_INIT;
 }
 
 /*********************************************************************************
@@ -245,21 +241,6 @@ void BridgeClass::crcWrite(void)
     stream.write((char)(CRCSUM & 0xFF));
 }
 
-/*********************************************************************************
-  *Function          :       bool BridgeClass::crcCheck(uint16_t _CRC)
-  *Description      :
-  *Input              :
-  *Output            :
-  *Return            :
-  *author            :
-  *date               :
-  *Others            :
-**********************************************************************************/
-bool BridgeClass::crcCheck(uint16_t _CRC)
-{
-    return CRCSUM == _CRC;
-}
-
 /*********************************************************************************
   *Function          :      transfer()
   *Description      :      transfer() is used by other functions that communicate between the stm32 microcontroller and the Linux processor.
@@ -273,128 +254,354 @@ bool BridgeClass::crcCheck(uint16_t _CRC)
                                 the function will return rxlen to indicate that the rx buffer is full.
   *author            :
   *date               :
-  *Others            :
+  *Others            :      send() + wait() 的同步封装, 窗口已满时先等待前面的帧
 **********************************************************************************/
 uint16_t BridgeClass::transfer(const uint8_t *buff1, uint16_t len1,
                                const uint8_t *buff2, uint16_t len2,
                                const uint8_t *buff3, uint16_t len3,
                                uint8_t *rxbuff, uint16_t rxlen)
 {
-    uint16_t len = len1 + len2 + len3;
-    uint8_t retries = 0;
+    BridgeResult result = {false, 0};
 
-    NVIC_DisableIRQ(TIM1_UP_IRQn);
-    for ( ; retries < max_retries; retries++, delay(100), dropAll() /* Delay for retransmission */)
+    if (max_retries == 0)
     {
-        // Send packet
-        crcReset();
-        stream.write((char)0xFF);                // Start of packet (0xFF)
-        crcUpdate(0xFF);
-        stream.write((char)index);               // Message index
-        crcUpdate(index);
-        stream.write((char)((len >> 8) & 0xFF)); // Message length (hi)
-        crcUpdate((len >> 8) & 0xFF);
-        stream.write((char)(len & 0xFF));        // Message length (lo)
-        crcUpdate(len & 0xFF);
-        for (uint16_t i = 0; i < len1; i++)
-        { // Payload
-            stream.write((char)buff1[i]);
-            crcUpdate(buff1[i]);
-        }
-        for (uint16_t i = 0; i < len2; i++)
-        { // Payload
-            stream.write((char)buff2[i]);
-            crcUpdate(buff2[i]);
-        }
-        for (uint16_t i = 0; i < len3; i++)
-        { // Payload
-            stream.write((char)buff3[i]);
-            crcUpdate(buff3[i]);
-        }
-        crcWrite();                     // CRC
-
-        // Wait for ACK in 100ms
-        if (timedRead(100) != 0xFF)
-        continue;
-        crcReset();
-        crcUpdate(0xFF);
-
-        // Check packet index
-        if (timedRead(5) != index)
-        continue;
-        crcUpdate(index);
-
-        // Recv len
-        int lh = timedRead(10);
-        if (lh < 0)
-        continue;
-        crcUpdate(lh);
-        int ll = timedRead(10);
-        if (ll < 0)
-        continue;
-        crcUpdate(ll);
-        uint16_t l = lh;
-        l <<= 8;
-        l += ll;
-
-        // Recv data
-        for (uint16_t i = 0; i < l; i++)
-        {
-            int c = timedRead(5);
-            if (c < 0)
-            continue;
-            // Cut received data if rxbuffer is too small
-            if (i < rxlen)
-            rxbuff[i] = c;
-            crcUpdate(c);
-        }
+        return TRANSFER_TIMEOUT;   // begin() 之前
+    }
+    while (!send(buff1, len1, buff2, len2, buff3, len3, rxbuff, rxlen, resultCallback, &result))
+    {
+        poll();
+    }
+    return wait(result);
+}
 
-        // Check CRC
-        int crc_hi = timedRead(5);
-        if (crc_hi < 0)
-        continue;
-        int crc_lo = timedRead(5);
-        if (crc_lo < 0)
-        continue;
-        if (!crcCheck((crc_hi << 8) + crc_lo))
-        continue;
+/*********************************************************************************
+  *Function     : bool BridgeClass::send(...)
+  *Description  : 异步传输一帧
+  *Input        : buff_N/len_N: 最多3段发送数据
+                  rxbuff/rxlen: 应答缓冲, 应答超过rxlen时截断
+                  callback: 完成回调, 可以为NULL
+                  arg: 回调参数
+  *Output       : none
+  *Return       : true: 已发送  false: 窗口已满
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : 完成之前发送缓冲和接收缓冲必须保持有效
+**********************************************************************************/
+bool BridgeClass::send(const uint8_t *buff1, uint16_t len1,
+                       const uint8_t *buff2, uint16_t len2,
+                       const uint8_t *buff3, uint16_t len3,
+                       uint8_t *rxbuff, uint16_t rxlen,
+                       BridgeCallback callback, void *arg)
+{
+    bool locked = lock();
 
-        // Increase index
-        index++;
+    if (count >= window)
+    {
+        unlock(locked);
+        return false;
+    }
+    if (count == 0)
+    {
+        retries = 0;
+    }
+    Frame &frame = frames[(head + count) % WINDOW_MAX];
+    frame.buff[0] = buff1;
+    frame.len[0] = len1;
+    frame.buff[1] = buff2;
+    frame.len[1] = len2;
+    frame.buff[2] = buff3;
+    frame.len[2] = len3;
+    frame.rxbuff = rxbuff;
+    frame.rxlen = rxlen;
+    frame.rxcount = 0;
+    frame.callback = callback;
+    frame.arg = arg;
+    frame.index = index++;
+    frame.state = FRAME_SENT;
+    count++;
+    unlock(locked);
+    // 有未完成的帧时 intorobot_loop 不使用bridge, 发送时不需要屏蔽中断
+    sendFrame(frame);
+    return true;
+}
 
-        NVIC_EnableIRQ(TIM1_UP_IRQn);
-        // Return bytes received
-        if (l > rxlen)
-        {return rxlen;}
-        else
-        {return l;}
+/*********************************************************************************
+  *Function     : void BridgeClass::poll(void)
+  *Description  : 接收应答, 超时重发, 按发送顺序调用完成回调
+  *Input        : none
+  *Output       : none
+  *Return       : none
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : 串口接收缓冲只有SERIAL_BUFFER_SIZE, 有未完成的帧时需要经常调用
+**********************************************************************************/
+void BridgeClass::poll(void)
+{
+    if (count == 0)
+    {
+        return;     // 没有未完成的帧, 此时定时中断中可能正在使用bridge
     }
-    NVIC_EnableIRQ(TIM1_UP_IRQn);
+    receive();
+    timeout();
+    complete();
+}
 
-    // Max retries exceeded
-    return TRANSFER_TIMEOUT;
+/*********************************************************************************
+  *Function     : uint16_t BridgeClass::wait(BridgeResult &result)
+  *Description  : 等待异步传输完成
+  *Input        : result: send 的回调为 resultCallback, 参数为 &result
+  *Output       : none
+  *Return       : 收到的长度, 失败返回 TRANSFER_TIMEOUT
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       :
+**********************************************************************************/
+uint16_t BridgeClass::wait(BridgeResult &result)
+{
+    while (!result.done)
+    {
+        poll();
+    }
+    return result.len;
+}
+
+void BridgeClass::resultCallback(void *arg, uint16_t len)
+{
+    BridgeResult *result = (BridgeResult *)arg;
+
+    result->len = len;
+    result->done = true;
 }
 
 /*********************************************************************************
-  *Function          :       int BridgeClass::timedRead(unsigned int timeout)
-  *Description      :
-  *Input              :
-  *Output            :
-  *Return            :
-  *author            :
-  *date               :
-  *Others            :
+  *Function     : void BridgeClass::setWindow(uint8_t _window)
+  *Description  : 设置最多未应答的帧数
+  *Input        : _window: 1~WINDOW_MAX, 对方bridge必须按序号顺序执行并缓存最近的应答
+  *Output       : none
+  *Return       : none
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : begin() 设为1, 标准bridge只能为1; 在 begin() 之后调用
 **********************************************************************************/
-int BridgeClass::timedRead(unsigned int timeout)
+void BridgeClass::setWindow(uint8_t _window)
+{
+    window = (_window < 1) ? 1 : ((_window > WINDOW_MAX) ? WINDOW_MAX : _window);
+}
+
+// 屏蔽TIM1中断(intorobot_loop 也会调用bridge), 返回之前是否使能
+// 只用于占用和释放帧, intorobot_loop 在 pending() 不为0时不使用bridge, 收发不需要屏蔽
+bool BridgeClass::lock(void)
+{
+    bool enabled = (NVIC->ISER[TIM1_UP_IRQn >> 0x05] & (0x01 << (TIM1_UP_IRQn & 0x1F))) != 0;
+
+    NVIC_DisableIRQ(TIM1_UP_IRQn);
+    return enabled;
+}
+
+void BridgeClass::unlock(bool locked)
+{
+    if (locked)
+    {
+        NVIC_EnableIRQ(TIM1_UP_IRQn);
+    }
+}
+
+// 发送数据, 每发送一段接收一次, 避免应答溢出串口接收缓冲
+void BridgeClass::sendBytes(const uint8_t *buff, uint16_t len)
+{
+    const uint16_t chunk = SERIAL_BUFFER_SIZE / 4;
+
+    crcUpdate(buff, len);
+    while (len)
+    {
+        uint16_t n = (len > chunk) ? chunk : len;
+        stream.write(buff, n);
+        buff += n;
+        len -= n;
+        receive();
+    }
+}
+
+void BridgeClass::sendFrame(Frame &frame)
+{
+    uint16_t len = frame.len[0] + frame.len[1] + frame.len[2];
+    uint8_t packet[4] = {0xFF, frame.index, (uint8_t)((len >> 8) & 0xFF), (uint8_t)(len & 0xFF)}; // Start of packet (0xFF), index, length
+
+    crcReset();
+    sendBytes(packet, sizeof(packet));
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        sendBytes(frame.buff[i], frame.len[i]);   // Payload
+    }
+    crcWrite();                                 // CRC
+    frame.time = millis();
+}
+
+void BridgeClass::receive(void)
 {
     int c;
-    unsigned long _startMillis = millis();
-    do
+
+    while ((c = stream.read()) >= 0)
+    {
+        receiveByte(c);
+    }
+}
+
+void BridgeClass::receiveByte(uint8_t c)
+{
+    rxTime = millis();
+    if (rxState != RX_CRC_H && rxState != RX_CRC_L)
+    {
+        rxCRC = crc16_ccitt_update(rxCRC, &c, 1);
+    }
+    switch (rxState)
+    {
+        case RX_HEAD:
+            if (c == 0xFF)
+            {
+                rxCRC = crc16_ccitt_update(CRC16_INIT, &c, 1);
+                rxState = RX_INDEX;
+            }
+            break;
+
+        case RX_INDEX:
+            // 应答写到对应帧的接收缓冲, CRC错误时等重发的应答覆盖
+            rxIndex = c;
+            rxFrame = NULL;
+            for (uint8_t i = 0; i < count; i++)
+            {
+                Frame &frame = frames[(head + i) % WINDOW_MAX];
+                if (frame.index == c && frame.state == FRAME_SENT)
+                {
+                    rxFrame = &frame;
+                }
+            }
+            rxState = RX_LEN_H;
+            break;
+
+        case RX_LEN_H:
+            rxLen = c << 8;
+            rxState = RX_LEN_L;
+            break;
+
+        case RX_LEN_L:
+            rxLen |= c;
+            rxPos = 0;
+            rxState = rxLen ? RX_DATA : RX_CRC_H;
+            break;
+
+        case RX_DATA:
+            // Cut received data if rxbuffer is too small
+            if (rxFrame != NULL && rxPos < rxFrame->rxlen)
+            {
+                rxFrame->rxbuff[rxPos] = c;
+            }
+            if (++rxPos >= rxLen)
+            {
+                rxState = RX_CRC_H;
+            }
+            break;
+
+        case RX_CRC_H:
+            rxCRCHigh = c;
+            rxState = RX_CRC_L;
+            break;
+
+        case RX_CRC_L:
+            rxState = RX_HEAD;
+            if (rxCRC == (((uint16_t)rxCRCHigh << 8) | c))
+            {
+                receiveFrame();
+            }
+            break;
+    }
+}
+
+// 收到CRC正确的应答
+void BridgeClass::receiveFrame(void)
+{
+    if (rxFrame == NULL || rxFrame->index != rxIndex || rxFrame->state != FRAME_SENT)
+    {
+        return;     // 重复的应答
+    }
+    rxFrame->rxcount = (rxLen > rxFrame->rxlen) ? rxFrame->rxlen : rxLen;
+    rxFrame->state = FRAME_DONE;
+    if (rxFrame == &frames[head])
+    {
+        retries = 0;
+    }
+}
+
+// 按发送顺序完成已应答的帧
+void BridgeClass::complete(void)
+{
+    while (count && frames[head].state == FRAME_DONE)
+    {
+        retries = 0;
+        release(frames[head].rxcount);
+    }
+}
+
+// 最早的帧超时, 重发所有未应答的帧, 超过重发次数时全部失败
+void BridgeClass::timeout(void)
+{
+    unsigned long now = millis();
+
+    if (count == 0 || frames[head].state != FRAME_SENT)
     {
-        c = stream.read();
-    if (c >= 0) return c;
-    } while (millis() - _startMillis < timeout);
-    return -1;     // -1 indicates timeout
+        return;
+    }
+    // Wait for ACK in 100ms, delay 100ms for retransmission
+    if (now - frames[head].time < 200)
+    {
+        return;
+    }
+    // 应答正在接收
+    if (rxState != RX_HEAD && now - rxTime < 10)
+    {
+        return;
+    }
+    rxState = RX_HEAD;
+    dropAll();
+    if (++retries < max_retries)
+    {
+        for (uint8_t i = 0; i < count; i++)
+        {
+            Frame &frame = frames[(head + i) % WINDOW_MAX];
+            if (frame.state == FRAME_SENT)
+            {
+                sendFrame(frame);
+            }
+        }
+        return;
+    }
+
+    // Max retries exceeded, 序号从失败的帧重新开始
+    index = frames[head].index;
+    retries = 0;
+    while (count)
+    {
+        release(TRANSFER_TIMEOUT);
+    }
+}
+
+// 释放最早的帧并调用完成回调
+// 最后一帧释放后定时中断可能立即使用这个帧, 回调参数先取出
+void BridgeClass::release(uint16_t len)
+{
+    Frame &frame = frames[head];
+    BridgeCallback callback = frame.callback;
+    void *arg = frame.arg;
+    bool locked = lock();
+
+    frame.state = FRAME_FREE;
+    head = (head + 1) % WINDOW_MAX;
+    count--;
+    unlock(locked);
+    if (callback != NULL)
+    {
+        callback(arg, len);
+    }
 }
 
 /*********************************************************************************
@@ -277,6 +277,60 @@ void File::flush(void)
 {
 }
 
+/*********************************************************************************
+  *Function          :       uint16_t File::readBlocks(uint8_t *buff, uint16_t nbyte, bool &end)
+  *Description      :       连续发出最多窗口个读请求, 对方按顺序执行, 各块在文件中是连续的
+  *Input              :       buff: 数据缓冲  nbyte: 最多读取的字节数
+  *Output            :       end: 读到文件结束或者通信失败
+  *Return            :       读到的字节数
+  *author            :       robot
+  *date               :       2016-05-20
+  *Others            :       必须等所有请求完成后才能返回, 应答写在栈上的块缓冲中
+**********************************************************************************/
+uint16_t File::readBlocks(uint8_t *buff, uint16_t nbyte, bool &end)
+{
+    uint8_t cmd[BridgeClass::WINDOW_MAX][3];
+    uint8_t block[BridgeClass::WINDOW_MAX][BUFFER_SIZE];
+    BridgeResult result[BridgeClass::WINDOW_MAX];
+    uint8_t count = 0, i;
+    uint16_t n = 0, len;
+
+    while ((count < bridge.getWindow()) && (nbyte > 0))
+    {
+        len = (nbyte > BUFFER_SIZE - 1) ? BUFFER_SIZE - 1 : nbyte;
+        cmd[count][0] = 'G';
+        cmd[count][1] = handle;
+        cmd[count][2] = len;
+        result[count].done = false;
+        result[count].len = 0;
+        while (!bridge.send(cmd[count], 3, NULL, 0, NULL, 0, block[count], BUFFER_SIZE, BridgeClass::resultCallback, &result[count]))
+        {
+            bridge.poll();
+        }
+        nbyte -= len;
+        count++;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        len = bridge.wait(result[i]);
+        if (end)
+        continue;
+        // 第一个字节是错误码, 数据少于请求的长度表示文件结束
+        if (BridgeClass::TRANSFER_TIMEOUT == len || 0 == len)
+        {
+            end = true;
+            continue;
+        }
+        len--;
+        memcpy(buff + n, &block[i][1], len);
+        n += len;
+        if (len < cmd[i][2])
+        end = true;
+    }
+    return n;
+}
+
 /*********************************************************************************
   *Function          :       
   *Description      :
@@ -291,10 +345,21 @@ int File::read(void *buff, uint16_t nbyte)
 {
     uint16_t n = 0;
     uint8_t *p = reinterpret_cast<uint8_t *>(buff);
+    bool end = false;
     while (n < nbyte) 
     {
         if (buffered == 0) 
         {
+            // 剩余较多并且对方支持流水线时, 一次发出多个读请求, 数据直接读到buff
+            if ((bridge.getWindow() > 1) && (nbyte - n >= BUFFER_SIZE - 1))
+            {
+                uint16_t len = readBlocks(p, nbyte - n, end);
+                p += len;
+                n += len;
+                if (end)
+                break;
+                continue;
+            }
             doBuffer();
             if (buffered == 0)
             break;
@@ -0,0 +1,147 @@
+/**
+ ******************************************************************************
+ * @file     : cmsis_os.h
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : CMSIS-RTOS subset used by the firmware, implemented on pthreads
+ *             for the gcc (host) board
+ ******************************************************************************
+ Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+#ifndef _CMSIS_OS_H
+#define _CMSIS_OS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef  __cplusplus
+extern "C"
+{
+#endif
+
+// 与 board/neutron FreeRTOS CMSIS_RTOS 保持一致的枚举/结构, 只实现固件用到的接口
+
+typedef enum  {
+  osPriorityIdle          = -3,          ///< priority: idle (lowest)
+  osPriorityLow           = -2,          ///< priority: low
+  osPriorityBelowNormal   = -1,          ///< priority: below normal
+  osPriorityNormal        =  0,          ///< priority: normal (default)
+  osPriorityAboveNormal   = +1,          ///< priority: above normal
+  osPriorityHigh          = +2,          ///< priority: high
+  osPriorityRealtime      = +3,          ///< priority: realtime (highest)
+  osPriorityError         =  0x84        ///< system cannot determine priority or thread has illegal priority
+} osPriority;
+
+#define osWaitForever     0xFFFFFFFF     ///< wait forever timeout value
+
+typedef enum  {
+  osOK                    =     0,       ///< function completed; no error or event occurred.
+  osEventSignal           =  0x08,       ///< function completed; signal event occurred.
+  osEventMessage          =  0x10,       ///< function completed; message event occurred.
+  osEventMail             =  0x20,       ///< function completed; mail event occurred.
+  osEventTimeout          =  0x40,       ///< function completed; timeout occurred.
+  osErrorParameter        =  0x80,       ///< parameter error: a mandatory parameter was missing or specified an incorrect object.
+  osErrorResource         =  0x81,       ///< resource not available: a specified resource was not available.
+  osErrorTimeoutResource  =  0xC1,       ///< resource not available within given time: a specified resource was not available within the timeout period.
+  osErrorISR              =  0x82,       ///< not allowed in ISR context: the function cannot be called from interrupt service routines.
+  osErrorISRRecursive     =  0x83,       ///< function called multiple times from ISR with same object.
+  osErrorPriority         =  0x84,       ///< system cannot determine priority or thread has illegal priority.
+  osErrorNoMemory         =  0x85,       ///< system is out of memory: it was impossible to allocate or reserve memory for the operation.
+  osErrorValue            =  0x86,       ///< value of a parameter is out of range.
+  osErrorOS               =  0xFF,       ///< unspecified RTOS error: run-time error but no other error message fits.
+  os_status_reserved      =  0x7FFFFFFF  ///< prevent from enum down-size compiler optimization.
+} osStatus;
+
+typedef void (*os_pthread) (void const *argument);
+
+typedef struct os_thread_cb *osThreadId;
+typedef struct os_mutex_cb *osMutexId;
+typedef struct os_semaphore_cb *osSemaphoreId;
+
+typedef struct os_thread_def  {
+  char                   *name;        ///< Thread name
+  os_pthread             pthread;      ///< start address of thread function
+  osPriority             tpriority;    ///< initial thread priority
+  uint32_t               instances;    ///< maximum number of instances of that thread function
+  uint32_t               stacksize;    ///< stack size requirements in bytes; 0 is default stack size
+} osThreadDef_t;
+
+typedef struct os_mutex_def  {
+  uint32_t                   dummy;    ///< dummy value.
+} osMutexDef_t;
+
+typedef struct os_semaphore_def  {
+  uint32_t                   dummy;    ///< dummy value.
+} osSemaphoreDef_t;
+
+#define configMINIMAL_STACK_SIZE    ((uint16_t)128)
+#define configTICK_RATE_HZ          ((uint32_t)1000)
+
+//  ==== Kernel Control Functions ====
+osStatus osKernelStart (void);
+int32_t osKernelRunning(void);
+uint32_t osKernelSysTick (void);
+
+//  ==== Thread Management ====
+#define osThreadDef(name, thread, priority, instances, stacksz)  \
+const osThreadDef_t os_thread_def_##name = \
+{ (char *)#name, (thread), (priority), (instances), (stacksz)  }
+
+#define osThread(name)  \
+&os_thread_def_##name
+
+osThreadId osThreadCreate (const osThreadDef_t *thread_def, void *argument);
+osThreadId osThreadGetId (void);
+osStatus osThreadYield (void);
+
+//  ==== Generic Wait Functions ====
+osStatus osDelay (uint32_t millisec);
+
+//  ==== Mutex Management ====
+#define osMutexDef(name)  \
+const osMutexDef_t os_mutex_def_##name = { 0 }
+
+#define osMutex(name)  \
+&os_mutex_def_##name
+
+osMutexId osMutexCreate (const osMutexDef_t *mutex_def);
+osStatus osMutexWait (osMutexId mutex_id, uint32_t millisec);
+osStatus osMutexRelease (osMutexId mutex_id);
+osStatus osMutexDelete (osMutexId mutex_id);
+
+//  ==== Semaphore Management Functions ====
+#define osSemaphoreDef(name)  \
+const osSemaphoreDef_t os_semaphore_def_##name = { 0 }
+
+#define osSemaphore(name)  \
+&os_semaphore_def_##name
+
+osSemaphoreId osSemaphoreCreate (const osSemaphoreDef_t *semaphore_def, int32_t count);
+int32_t osSemaphoreWait (osSemaphoreId semaphore_id, uint32_t millisec);
+osStatus osSemaphoreRelease (osSemaphoreId semaphore_id);
+osStatus osSemaphoreDelete (osSemaphoreId semaphore_id);
+
+//  ==== FreeRTOS heap ====
+void *pvPortMalloc( size_t xWantedSize );
+void vPortFree( void *pv );
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif  // _CMSIS_OS_H
@@ -0,0 +1,46 @@
+/**
+ ******************************************************************************
+ * @file     : esp8266_sim.h
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : in-process esp8266 AT firmware simulator for the gcc(host) board.
+ *             AT+CIPSTART/CIPSEND/CIPCLOSE are served with real host sockets.
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+**/
+#ifndef __ESP8266_SIM_H
+#define __ESP8266_SIM_H
+
+#include <stdint.h>
+
+/*
+  模块输出(相当于esp8266 TX -> stm32 RX)的回调
+  p_dat 数据  len 长度
+*/
+typedef void (*esp8266_sim_rx_cb)(const uint8_t *p_dat, int len);
+
+//创建模拟器任务  rx_cb: 模块输出的数据
+int esp8266_sim_init(esp8266_sim_rx_cb rx_cb);
+
+//stm32 -> esp8266 串口数据
+int esp8266_sim_write(const uint8_t *p_dat, int len);
+
+//模拟复位脚  关闭所有连接并输出 ready
+void esp8266_sim_reset(void);
+
+#endif /* __ESP8266_SIM_H */
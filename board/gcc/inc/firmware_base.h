@@ -0,0 +1,63 @@
+/**
+ ******************************************************************************
+ * @file     : firmware_base.h
+ * @author   : robin
+ * @version  : V1.0.0
+ * @date     : 6-December-2014
+ * @brief    :   
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+**/
+
+#ifndef   FIRMWARE_BASE_H_
+#define   FIRMWARE_BASE_H_
+
+#include <stdint.h>
+
+#include "wiring_stream.h"
+#include "wiring_printable.h"
+#include "wiring_ipaddress.h"
+#include "wiring_character.h"
+#include "wiring_constants.h"
+#include "wiring_math.h"
+#include "wiring_client.h"
+#include "wiring_server.h"
+#include "wiring_string.h"
+#include "wiring_print.h"
+#include "wiring_interrupts.h"
+
+#include "variant.h"
+#include "wiring.h"
+#include "wiring_analog.h"
+#include "wiring_digital.h"
+#include "wiring_pulse.h"
+#include "wiring_shift.h"
+#include "wiring_usbserial.h"
+// gcc(主机)板: 串口/SPI/I2C/定时器没有主机实现, 不包含
+//#include "wiring_network.h"
+#include "wiring_time.h"
+
+#include "wiring_tone.h"
+#include "wiring_eeprom.h"
+#include "wiring_flash_memory.h"
+#include "ajson.h"
+#include "WiFiUdp.h"
+
+
+#endif /* FIRMWARE_BASE_H_ */
+
+
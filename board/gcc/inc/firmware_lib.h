@@ -0,0 +1,40 @@
+/**
+ ******************************************************************************
+ * @file     : firmware_lib.h
+ * @author   : robin
+ * @version  : V1.0.0
+ * @date     : 6-December-2014
+ * @brief    :     
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+**/
+
+#ifndef   FIRMWARE_LIB_H_
+#define   FIRMWARE_LIB_H_
+
+#include "lib_system_all.h"
+#include "lib_wifi.h"
+#include "lib_tcpclient.h"
+#include "lib_tcpserver.h"
+#include "lib_mqttclient.h"
+#include "intorobot_api.h"
+#include "lib_rgb.h"
+
+
+#endif /* FIRMWARE_LIB_H_ */
+
+
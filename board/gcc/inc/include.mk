@@ -0,0 +1,6 @@
+# the gcc board builds the portable neutron sources on the host.
+# board/gcc/inc comes first so its headers replace the stm32 ones of the same name;
+# -I- stops "xxx.h" includes inside neutron/inc from resolving next to the includer first.
+CINCLUDES += -I-
+INCLUDE_DIRS += $(BOARD_TYPE_PATH)/inc
+INCLUDE_DIRS += $(BOARD_MODULE_PATH)/neutron/inc
@@ -0,0 +1,30 @@
+/**
+ ******************************************************************************
+ * @file     : main.h
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : gcc(host) board main header, no usb device stack on the host
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+**/
+#ifndef __MAIN_H
+#define __MAIN_H
+
+#include "application.h"
+
+#endif /* __MAIN_H */
@@ -0,0 +1,351 @@
+/**
+ ******************************************************************************
+ * @file     : cmsis_os.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : CMSIS-RTOS subset on pthreads for the gcc(host) board
+ ******************************************************************************
+ Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "cmsis_os.h"
+
+/*
+  与 FreeRTOS 版本保持相同的语义:
+  1. osKernelStart 之前创建的任务在调度器启动后才开始运行
+  2. count==1 的信号量为二值信号量, 创建后可直接获取一次 (vSemaphoreCreateBinary)
+  3. osSemaphoreWait 超时返回 osErrorOS
+*/
+
+struct os_thread_cb
+{
+    pthread_t thread;
+    os_pthread pthread;
+    void *argument;
+};
+
+struct os_mutex_cb
+{
+    pthread_mutex_t mutex;
+};
+
+struct os_semaphore_cb
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int32_t count;
+    int32_t max_count;
+};
+
+static pthread_mutex_t kernel_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t kernel_cond = PTHREAD_COND_INITIALIZER;
+static int32_t kernel_running = 0;
+static pthread_key_t thread_key;
+static pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
+
+
+static void thread_key_create(void)
+{
+    pthread_key_create(&thread_key, NULL);
+}
+
+static void timespec_after(struct timespec *ts, uint32_t millisec)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += millisec / 1000;
+    ts->tv_nsec += (long)(millisec % 1000) * 1000000L;
+    if(ts->tv_nsec >= 1000000000L)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void *thread_entry(void *argument)
+{
+    osThreadId thread_id = (osThreadId)argument;
+
+    pthread_setspecific(thread_key, thread_id);
+
+    //等待调度器启动
+    pthread_mutex_lock(&kernel_mutex);
+    while(!kernel_running)
+    {
+        pthread_cond_wait(&kernel_cond, &kernel_mutex);
+    }
+    pthread_mutex_unlock(&kernel_mutex);
+
+    thread_id->pthread(thread_id->argument);
+    return NULL;
+}
+
+//  ==== Kernel Control Functions ====
+osStatus osKernelStart (void)
+{
+    pthread_mutex_lock(&kernel_mutex);
+    kernel_running = 1;
+    pthread_cond_broadcast(&kernel_cond);
+    pthread_mutex_unlock(&kernel_mutex);
+    return osOK;
+}
+
+int32_t osKernelRunning(void)
+{
+    return kernel_running;
+}
+
+uint32_t osKernelSysTick (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+//  ==== Thread Management ====
+osThreadId osThreadCreate (const osThreadDef_t *thread_def, void *argument)
+{
+    osThreadId thread_id;
+
+    pthread_once(&thread_key_once, thread_key_create);
+
+    thread_id = (osThreadId)malloc(sizeof(struct os_thread_cb));
+    if(thread_id == NULL)
+    {
+        return NULL;
+    }
+    thread_id->pthread = thread_def->pthread;
+    thread_id->argument = argument;
+
+    //主机上栈空间不按 stacksize 分配(64位指针占用更多栈), 使用系统默认栈大小
+    if(pthread_create(&thread_id->thread, NULL, thread_entry, thread_id) != 0)
+    {
+        free(thread_id);
+        return NULL;
+    }
+    pthread_detach(thread_id->thread);
+    return thread_id;
+}
+
+osThreadId osThreadGetId (void)
+{
+    pthread_once(&thread_key_once, thread_key_create);
+    return (osThreadId)pthread_getspecific(thread_key);
+}
+
+osStatus osThreadYield (void)
+{
+    sched_yield();
+    return osOK;
+}
+
+//  ==== Generic Wait Functions ====
+osStatus osDelay (uint32_t millisec)
+{
+    struct timespec ts;
+
+    if(millisec == 0)
+    {
+        sched_yield();
+        return osOK;
+    }
+    ts.tv_sec = millisec / 1000;
+    ts.tv_nsec = (long)(millisec % 1000) * 1000000L;
+    while(nanosleep(&ts, &ts) != 0 && errno == EINTR);
+    return osOK;
+}
+
+//  ==== Mutex Management ====
+osMutexId osMutexCreate (const osMutexDef_t *mutex_def)
+{
+    (void) mutex_def;
+    osMutexId mutex_id = (osMutexId)malloc(sizeof(struct os_mutex_cb));
+
+    if(mutex_id != NULL)
+    {
+        pthread_mutex_init(&mutex_id->mutex, NULL);
+    }
+    return mutex_id;
+}
+
+osStatus osMutexWait (osMutexId mutex_id, uint32_t millisec)
+{
+    if(mutex_id == NULL)
+    {
+        return osErrorParameter;
+    }
+
+    if(millisec == osWaitForever)
+    {
+        pthread_mutex_lock(&mutex_id->mutex);
+        return osOK;
+    }
+
+    //pthread_mutex_timedlock 只支持 CLOCK_REALTIME, 这里轮询
+    uint32_t start = osKernelSysTick();
+    while(pthread_mutex_trylock(&mutex_id->mutex) != 0)
+    {
+        if((osKernelSysTick() - start) >= millisec)
+        {
+            return osErrorOS;
+        }
+        osDelay(1);
+    }
+    return osOK;
+}
+
+osStatus osMutexRelease (osMutexId mutex_id)
+{
+    if(mutex_id == NULL)
+    {
+        return osErrorParameter;
+    }
+    if(pthread_mutex_unlock(&mutex_id->mutex) != 0)
+    {
+        return osErrorOS;
+    }
+    return osOK;
+}
+
+osStatus osMutexDelete (osMutexId mutex_id)
+{
+    if(mutex_id == NULL)
+    {
+        return osErrorParameter;
+    }
+    pthread_mutex_destroy(&mutex_id->mutex);
+    free(mutex_id);
+    return osOK;
+}
+
+//  ==== Semaphore Management Functions ====
+osSemaphoreId osSemaphoreCreate (const osSemaphoreDef_t *semaphore_def, int32_t count)
+{
+    (void) semaphore_def;
+    pthread_condattr_t attr;
+    osSemaphoreId semaphore_id;
+
+    if(count <= 0)
+    {
+        return NULL;
+    }
+
+    semaphore_id = (osSemaphoreId)malloc(sizeof(struct os_semaphore_cb));
+    if(semaphore_id == NULL)
+    {
+        return NULL;
+    }
+    pthread_mutex_init(&semaphore_id->mutex, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&semaphore_id->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    //二值信号量创建后可用   计数信号量初始为0
+    semaphore_id->count = (count == 1) ? 1 : 0;
+    semaphore_id->max_count = count;
+    return semaphore_id;
+}
+
+int32_t osSemaphoreWait (osSemaphoreId semaphore_id, uint32_t millisec)
+{
+    struct timespec ts;
+    int ret = 0;
+
+    if(semaphore_id == NULL)
+    {
+        return osErrorParameter;
+    }
+
+    if(millisec != osWaitForever)
+    {
+        timespec_after(&ts, millisec);
+    }
+
+    pthread_mutex_lock(&semaphore_id->mutex);
+    while((semaphore_id->count == 0) && (ret != ETIMEDOUT))
+    {
+        if(millisec == osWaitForever)
+        {
+            ret = pthread_cond_wait(&semaphore_id->cond, &semaphore_id->mutex);
+        }
+        else
+        {
+            ret = pthread_cond_timedwait(&semaphore_id->cond, &semaphore_id->mutex, &ts);
+        }
+    }
+    if(semaphore_id->count == 0)
+    {
+        pthread_mutex_unlock(&semaphore_id->mutex);
+        return osErrorOS;
+    }
+    semaphore_id->count--;
+    pthread_mutex_unlock(&semaphore_id->mutex);
+    return osOK;
+}
+
+osStatus osSemaphoreRelease (osSemaphoreId semaphore_id)
+{
+    osStatus result = osOK;
+
+    if(semaphore_id == NULL)
+    {
+        return osErrorParameter;
+    }
+
+    pthread_mutex_lock(&semaphore_id->mutex);
+    if(semaphore_id->count < semaphore_id->max_count)
+    {
+        semaphore_id->count++;
+        pthread_cond_signal(&semaphore_id->cond);
+    }
+    else
+    {
+        result = osErrorOS;
+    }
+    pthread_mutex_unlock(&semaphore_id->mutex);
+    return result;
+}
+
+osStatus osSemaphoreDelete (osSemaphoreId semaphore_id)
+{
+    if(semaphore_id == NULL)
+    {
+        return osErrorParameter;
+    }
+    pthread_cond_destroy(&semaphore_id->cond);
+    pthread_mutex_destroy(&semaphore_id->mutex);
+    free(semaphore_id);
+    return osOK;
+}
+
+//  ==== FreeRTOS heap ====
+void *pvPortMalloc( size_t xWantedSize )
+{
+    return malloc(xWantedSize);
+}
+
+void vPortFree( void *pv )
+{
+    free(pv);
+}
@@ -0,0 +1,59 @@
+//=================================================================================================================
+//input
+/****************************************************************************
+ *Private Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "lib_system_all.h"
+
+#include "lib_wifi_drv.h"
+#include "device_config_hal.h"
+
+//=================================================================================================================
+//gcc(主机)板不编译 device_config.cpp(串口/按键配置), 这里提供 lib_wifi_drv 需要的标志
+
+volatile uint8_t  smartconfig_over_flag = 0;
+
+/*
+返回;0成功   1失败
+*/
+int mo_DeviceConfig_setWrtTimezone(float time_zone)
+{
+    MO_ERROR(("not support"));
+    return 0;
+}
+
+/*
+返回:0需要配置
+*/
+int mo_DeviceConfig_isNeedDeviceConfig_hal(void)
+{
+    return 1;
+}
+
+/*
+返回:0成功
+*/
+int mo_DeviceConfig_setDeviceConfig_hal(void)
+{
+    MO_ERROR(("not support"));
+    return 0;
+}
+
+/*
+成功
+*/
+int mo_DeviceConfig_clearDeviceConfig_hal(void)
+{
+    MO_ERROR(("not support"));
+    return 0;
+}
+
+void mo_system_reboot_hal()
+{
+    MO_INFO(("reboot======================="));
+    fflush(stdout);
+    exit(0);
+}
@@ -0,0 +1,584 @@
+/**
+ ******************************************************************************
+ * @file     : esp8266_sim.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : in-process esp8266 AT firmware simulator for the gcc(host) board
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+**/
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "esp8266_sim.h"
+
+/*
+  模拟 esp8266 AT 固件 (CIPMUX=1 多连接模式)
+
+  stm32 写入的数据经 pipe 送到模拟器任务, 模拟器任务按行解析AT命令,
+  CIPSTART/CIPSEND/CIPCLOSE 使用主机 socket 完成, socket 收到的数据以
+  "+IPD,<id>,<len>:" 的格式输出, 与真实模块的串口输出一致.
+
+  环境变量:
+  ESP_SIM_REDIRECT=host:port   所有TCP连接都重定向到该地址(例如本地MQTT服务器)
+  ESP_SIM_NOWIFI=1             模拟没有连上路由器(AT+CIPSTATUS 返回 STATUS:5)
+*/
+
+#define SIM_LINK_NUM        5
+#define SIM_LINE_SIZE       256
+#define SIM_IPD_MAX         1460    //esp8266 单个+IPD 最大长度
+#define SIM_SEND_MAX        2048    //AT+CIPSEND 最大长度
+
+typedef struct sim_link_s
+{
+    int fd;                      //socket   -1 未使用
+    int udp;                     //1 UDP  0 TCP
+    char remote_ip[16];
+    int remote_port;
+    int local_port;
+    struct sockaddr_in udp_remote;
+}sim_link_t;
+
+typedef struct sim_ctl_s
+{
+    esp8266_sim_rx_cb rx_cb;     //模块输出
+    int pipe_fd[2];              //stm32 -> 模块
+    pthread_t thread;
+    pthread_mutex_t reset_mutex;
+    int reset_request;
+
+    int echo;                    //ATE1 回显
+    char line[SIM_LINE_SIZE];    //命令行缓冲
+    int line_len;
+
+    int send_link;               //>=0 正在接收 CIPSEND 数据
+    int send_len;
+    int send_index;
+    char send_remote_ip[16];
+    int send_remote_port;
+    uint8_t send_buf[SIM_SEND_MAX];
+
+    sim_link_t link[SIM_LINK_NUM];
+}sim_ctl_t;
+
+static sim_ctl_t sim;
+
+
+static void sim_out(const char *p_str)
+{
+    sim.rx_cb((const uint8_t *)p_str, strlen(p_str));
+}
+
+static void sim_outf(const char *fmt, ...)
+{
+    char buf[SIM_LINE_SIZE];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    sim_out(buf);
+}
+
+static void sim_link_close(int id, int report)
+{
+    if(sim.link[id].fd >= 0)
+    {
+        close(sim.link[id].fd);
+        sim.link[id].fd = -1;
+        if(report)
+        {
+            sim_outf("%d,CLOSED\r\n", id);
+        }
+    }
+}
+
+static void sim_do_reset(void)
+{
+    int i;
+
+    for(i = 0; i < SIM_LINK_NUM; i++)
+    {
+        sim_link_close(i, 0);
+    }
+    sim.echo = 1;
+    sim.line_len = 0;
+    sim.send_link = -1;
+    //上电时的乱码 + ready
+    sim_out("\r\n ets Jan  8 2013,rst cause:2, boot mode:(3,7)\r\n\r\nready\r\n");
+}
+
+static int sim_resolve(const char *host, int port, struct sockaddr_in *p_addr)
+{
+    struct addrinfo hints, *res;
+    char port_str[8];
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    if(getaddrinfo(host, port_str, &hints, &res) != 0)
+    {
+        return -1;
+    }
+    memcpy(p_addr, res->ai_addr, sizeof(struct sockaddr_in));
+    freeaddrinfo(res);
+    return 0;
+}
+
+static void sim_redirect(char *host, int host_size, int *port)
+{
+    const char *p_env = getenv("ESP_SIM_REDIRECT");
+    const char *p_colon;
+
+    if((p_env == NULL) || ((p_colon = strrchr(p_env, ':')) == NULL))
+    {
+        return;
+    }
+    snprintf(host, host_size, "%.*s", (int)(p_colon - p_env), p_env);
+    *port = atoi(p_colon + 1);
+}
+
+/*
+  AT+CIPSTART=<id>,"TCP","<host>",<port>
+  AT+CIPSTART=<id>,"UDP","<host>",<port>,<local port>,<mode>
+*/
+static void sim_cmd_cipstart(const char *p_arg)
+{
+    int id, port, local_port = 0, mode = 0;
+    char type[8], host[128];
+    struct sockaddr_in addr;
+
+    if(sscanf(p_arg, "%d,\"%7[^\"]\",\"%127[^\"]\",%d,%d,%d", &id, type, host, &port, &local_port, &mode) < 4
+            || id < 0 || id >= SIM_LINK_NUM)
+    {
+        sim_out("\r\nERROR\r\n");
+        return;
+    }
+    if(sim.link[id].fd >= 0)
+    {
+        sim_out("ALREAY CONNECT\r\n\r\nERROR\r\n");
+        return;
+    }
+
+    sim_link_t *p_link = &sim.link[id];
+    if(strcmp(type, "TCP") == 0)
+    {
+        sim_redirect(host, sizeof(host), &port);
+        if(sim_resolve(host, port, &addr) < 0)
+        {
+            sim_out("DNS Fail\r\n\r\nERROR\r\n");
+            return;
+        }
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            close(fd);
+            sim_out("\r\nERROR\r\nCLOSED\r\n");
+            return;
+        }
+        int flag = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+        p_link->fd = fd;
+        p_link->udp = 0;
+    }
+    else if(strcmp(type, "UDP") == 0)
+    {
+        if(sim_resolve(host, port, &addr) < 0)
+        {
+            sim_out("DNS Fail\r\n\r\nERROR\r\n");
+            return;
+        }
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        int flag = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+        setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &flag, sizeof(flag));
+        if(local_port > 0)
+        {
+            struct sockaddr_in local;
+            memset(&local, 0, sizeof(local));
+            local.sin_family = AF_INET;
+            local.sin_addr.s_addr = htonl(INADDR_ANY);
+            local.sin_port = htons(local_port);
+            if(bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0)
+            {
+                close(fd);
+                sim_out("\r\nERROR\r\n");
+                return;
+            }
+        }
+        p_link->fd = fd;
+        p_link->udp = 1;
+        p_link->udp_remote = addr;
+    }
+    else
+    {
+        sim_out("\r\nERROR\r\n");
+        return;
+    }
+
+    snprintf(p_link->remote_ip, sizeof(p_link->remote_ip), "%s", inet_ntoa(addr.sin_addr));
+    p_link->remote_port = port;
+    p_link->local_port = local_port;
+    sim_outf("%d,CONNECT\r\n\r\nOK\r\n", id);
+}
+
+/*
+  AT+CIPSEND=<id>,<len>[,"<ip>",<port>]
+*/
+static void sim_cmd_cipsend(const char *p_arg)
+{
+    int id, len;
+
+    sim.send_remote_ip[0] = 0;
+    sim.send_remote_port = 0;
+    if(sscanf(p_arg, "%d,%d,\"%15[^\"]\",%d", &id, &len, sim.send_remote_ip, &sim.send_remote_port) < 2
+            || id < 0 || id >= SIM_LINK_NUM || len <= 0 || len > SIM_SEND_MAX)
+    {
+        sim_out("\r\nERROR\r\n");
+        return;
+    }
+    if(sim.link[id].fd < 0)
+    {
+        sim_out("link is not valid\r\n\r\nERROR\r\n");
+        return;
+    }
+    sim.send_link = id;
+    sim.send_len = len;
+    sim.send_index = 0;
+    sim_out("\r\nOK\r\n> ");
+}
+
+static void sim_send_done(void)
+{
+    sim_link_t *p_link = &sim.link[sim.send_link];
+    int ret;
+
+    if(p_link->udp)
+    {
+        struct sockaddr_in addr = p_link->udp_remote;
+        if(sim.send_remote_ip[0])
+        {
+            sim_resolve(sim.send_remote_ip, sim.send_remote_port, &addr);
+        }
+        ret = sendto(p_link->fd, sim.send_buf, sim.send_len, 0, (struct sockaddr *)&addr, sizeof(addr));
+    }
+    else
+    {
+        ret = send(p_link->fd, sim.send_buf, sim.send_len, MSG_NOSIGNAL);
+    }
+
+    sim_outf("\r\nRecv %d bytes\r\n", sim.send_len);
+    if(ret == sim.send_len)
+    {
+        sim_out("\r\nSEND OK\r\n");
+    }
+    else
+    {
+        sim_out("\r\nSEND FAIL\r\n");
+    }
+    sim.send_link = -1;
+}
+
+static void sim_cmd_cipstatus(void)
+{
+    int i, connected = 0;
+
+    if(getenv("ESP_SIM_NOWIFI") != NULL)
+    {
+        sim_out("STATUS:5\r\n\r\nOK\r\n");
+        return;
+    }
+    for(i = 0; i < SIM_LINK_NUM; i++)
+    {
+        if(sim.link[i].fd >= 0)
+        {
+            connected = 1;
+        }
+    }
+    sim_outf("STATUS:%d\r\n", connected ? 3 : 2);
+    for(i = 0; i < SIM_LINK_NUM; i++)
+    {
+        if(sim.link[i].fd >= 0)
+        {
+            sim_outf("+CIPSTATUS:%d,\"%s\",\"%s\",%d,%d,0\r\n", i, sim.link[i].udp ? "UDP" : "TCP",
+                     sim.link[i].remote_ip, sim.link[i].remote_port, sim.link[i].local_port);
+        }
+    }
+    sim_out("\r\nOK\r\n");
+}
+
+static void sim_exec_line(const char *p_line)
+{
+    if(sim.echo)
+    {
+        sim_outf("%s\r\r\n", p_line);
+    }
+
+    if(strcmp(p_line, "AT") == 0)
+    {
+        sim_out("\r\nOK\r\n");
+    }
+    else if(strcmp(p_line, "ATE0") == 0)
+    {
+        sim.echo = 0;
+        sim_out("\r\nOK\r\n");
+    }
+    else if(strcmp(p_line, "ATE1") == 0)
+    {
+        sim.echo = 1;
+        sim_out("\r\nOK\r\n");
+    }
+    else if(strcmp(p_line, "AT+RST") == 0)
+    {
+        sim_out("\r\nOK\r\n");
+        sim_do_reset();
+    }
+    else if(strncmp(p_line, "AT+CIPSTART=", 12) == 0)
+    {
+        sim_cmd_cipstart(p_line + 12);
+    }
+    else if(strncmp(p_line, "AT+CIPSEND=", 11) == 0)
+    {
+        sim_cmd_cipsend(p_line + 11);
+    }
+    else if(strncmp(p_line, "AT+CIPCLOSE=", 12) == 0)
+    {
+        int id = atoi(p_line + 12);
+        if((id >= 0) && (id < SIM_LINK_NUM) && (sim.link[id].fd >= 0))
+        {
+            sim_link_close(id, 1);
+            sim_out("\r\nOK\r\n");
+        }
+        else
+        {
+            sim_out("\r\nERROR\r\n");
+        }
+    }
+    else if(strcmp(p_line, "AT+CIPSTATUS") == 0)
+    {
+        sim_cmd_cipstatus();
+    }
+    else if(strcmp(p_line, "AT+CWJAP_CUR?") == 0)
+    {
+        sim_out("+CWJAP_CUR:\"intorobot-host\",\"02:00:00:00:00:01\",1,-40\r\n\r\nOK\r\n");
+    }
+    else if(strcmp(p_line, "AT+CIPSTAMAC_DEF?") == 0)
+    {
+        sim_out("+CIPSTAMAC_DEF:\"02:00:00:00:00:02\"\r\n\r\nOK\r\n");
+    }
+    else if(strcmp(p_line, "AT+CIPAPMAC_DEF?") == 0)
+    {
+        sim_out("+CIPAPMAC_DEF:\"02:00:00:00:00:03\"\r\n\r\nOK\r\n");
+    }
+    else if(strcmp(p_line, "AT+CWLAP") == 0)
+    {
+        sim_out("+CWLAP:(3,\"intorobot-host\",-40,\"02:00:00:00:00:01\",1,0)\r\n\r\nOK\r\n");
+    }
+    else if((strncmp(p_line, "AT+DOWNFILE", 11) == 0) || (strncmp(p_line, "AT+MDSET", 8) == 0))
+    {
+        //主机上没有固件下载
+        sim_out("\r\nERROR\r\n");
+    }
+    else if(strncmp(p_line, "AT", 2) == 0)
+    {
+        //其他设置命令直接返回OK
+        sim_out("\r\nOK\r\n");
+    }
+    else if(p_line[0] != 0)
+    {
+        sim_out("\r\nERROR\r\n");
+    }
+}
+
+static void sim_input(const uint8_t *p_dat, int len)
+{
+    int i;
+
+    for(i = 0; i < len; i++)
+    {
+        if(sim.send_link >= 0)
+        {
+            sim.send_buf[sim.send_index++] = p_dat[i];
+            if(sim.send_index == sim.send_len)
+            {
+                sim_send_done();
+            }
+            continue;
+        }
+
+        char c = (char)p_dat[i];
+        if(c == '\n')
+        {
+            if((sim.line_len > 0) && (sim.line[sim.line_len - 1] == '\r'))
+            {
+                sim.line_len--;
+            }
+            sim.line[sim.line_len] = 0;
+            sim_exec_line(sim.line);
+            sim.line_len = 0;
+        }
+        else if(sim.line_len < SIM_LINE_SIZE - 1)
+        {
+            sim.line[sim.line_len++] = c;
+        }
+    }
+}
+
+static void sim_link_recv(int id)
+{
+    uint8_t buf[SIM_IPD_MAX];
+    char head[32];
+    int len;
+
+    len = recv(sim.link[id].fd, buf, sizeof(buf), 0);
+    if(len <= 0)
+    {
+        if(!sim.link[id].udp)
+        {
+            sim_link_close(id, 1);
+        }
+        return;
+    }
+    snprintf(head, sizeof(head), "\r\n+IPD,%d,%d:", id, len);
+    sim_out(head);
+    sim.rx_cb(buf, len);
+}
+
+static void *sim_thread(void *argument)
+{
+    struct pollfd fds[SIM_LINK_NUM + 1];
+    int ids[SIM_LINK_NUM + 1];
+    uint8_t buf[512];
+    int i, n, len;
+
+    while(1)
+    {
+        pthread_mutex_lock(&sim.reset_mutex);
+        if(sim.reset_request)
+        {
+            sim.reset_request = 0;
+            pthread_mutex_unlock(&sim.reset_mutex);
+            sim_do_reset();
+        }
+        else
+        {
+            pthread_mutex_unlock(&sim.reset_mutex);
+        }
+
+        n = 0;
+        fds[n].fd = sim.pipe_fd[0];
+        fds[n].events = POLLIN;
+        ids[n++] = -1;
+        for(i = 0; i < SIM_LINK_NUM; i++)
+        {
+            if(sim.link[i].fd >= 0)
+            {
+                fds[n].fd = sim.link[i].fd;
+                fds[n].events = POLLIN;
+                ids[n++] = i;
+            }
+        }
+
+        if(poll(fds, n, 100) <= 0)
+        {
+            continue;
+        }
+
+        //先处理串口命令  再处理网络数据
+        if(fds[0].revents & POLLIN)
+        {
+            len = read(sim.pipe_fd[0], buf, sizeof(buf));
+            if(len > 0)
+            {
+                sim_input(buf, len);
+            }
+        }
+        for(i = 1; i < n; i++)
+        {
+            if((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && (sim.link[ids[i]].fd == fds[i].fd))
+            {
+                sim_link_recv(ids[i]);
+            }
+        }
+    }
+    return NULL;
+}
+
+int esp8266_sim_init(esp8266_sim_rx_cb rx_cb)
+{
+    int i;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.rx_cb = rx_cb;
+    sim.echo = 1;
+    sim.send_link = -1;
+    for(i = 0; i < SIM_LINK_NUM; i++)
+    {
+        sim.link[i].fd = -1;
+    }
+    pthread_mutex_init(&sim.reset_mutex, NULL);
+    if(pipe(sim.pipe_fd) < 0)
+    {
+        return -1;
+    }
+    return pthread_create(&sim.thread, NULL, sim_thread, NULL) == 0 ? 0 : -1;
+}
+
+int esp8266_sim_write(const uint8_t *p_dat, int len)
+{
+    int ret, index = 0;
+
+    while(index < len)
+    {
+        ret = write(sim.pipe_fd[1], p_dat + index, len - index);
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        index += ret;
+    }
+    return len;
+}
+
+void esp8266_sim_reset(void)
+{
+    if(sim.rx_cb == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&sim.reset_mutex);
+    sim.reset_request = 1;
+    pthread_mutex_unlock(&sim.reset_mutex);
+}
@@ -0,0 +1,53 @@
+//=================================================================================================================
+//input
+/****************************************************************************
+ *Private Included Files
+ ****************************************************************************/
+#include <stdint.h>
+#include "lib_system_all.h"
+#include "lib_rgb_hal.h"
+
+//=================================================================================================================
+//gcc(主机)板没有RGB灯和按键, 只记录当前的灯状态便于调试
+
+/************************************************************************************
+* Private Variables
+************************************************************************************/
+static uint8_t	red;
+static uint8_t	gre;
+static uint8_t	blu;
+static uint16_t per;
+
+//=================================================================================================================
+//output
+void mo_RGBClass_off_hal(void)
+{
+    red=gre=blu=0;
+    per=0;
+    MO_DEBUG(("rgb off"));
+}
+
+void mo_RGBClass_color_hal(uint8_t ared, uint8_t agreen, uint8_t ablue)
+{
+    red=ared;gre=agreen;blu=ablue;
+    per=0;
+    MO_DEBUG(("rgb color %d %d %d",red,gre,blu));
+}
+
+void mo_RGBClass_blink_hal(uint8_t ared, uint8_t agreen, uint8_t ablue, uint16_t period)
+{
+    red=ared;gre=agreen;blu=ablue;
+    per=period;
+    MO_DEBUG(("rgb blink %d %d %d %d",red,gre,blu,per));
+}
+
+void mo_RGBClass_breath_hal(uint8_t ared, uint8_t agreen, uint8_t ablue, uint16_t period)
+{
+    red=ared;gre=agreen;blu=ablue;
+    per=period;
+    MO_DEBUG(("rgb breath %d %d %d %d",red,gre,blu,per));
+}
+
+void mo_RGBClass_hal()
+{
+}
@@ -0,0 +1,175 @@
+/**
+******************************************************************************
+* @file
+* @authors
+* @version V1.0.0
+* @date    2016_05_20
+* @brief   gcc(host) board: esp8266 uart1 backed by the in-process simulator
+******************************************************************************
+*/
+/****************************************************************************
+ *Private Included Files
+ ****************************************************************************/
+#include "main.h"
+#include "cmsis_os.h"
+
+#include "lib_system_all.h"
+#include "lib_fifo.h"
+#include "lib_wifi_drv_hal.h"
+#include "esp8266_sim.h"
+
+
+/************************************************************************************
+ * Private Data
+ ************************************************************************************/
+static fifo_t uart1_rx_fifo;						//串口接收fifo
+static uint32_t uart1_dma_pos;					//模拟DMA写位置
+static osSemaphoreId uart1_rx_sem;			//串口接收fifo  信号量
+static uint32_t uart1_rx_overflow;			//已经报告过的fifo溢出长度
+
+#define UART1_SIM_BYTES_PER_MS 46				//neutron 460800波特率 每毫秒约46字节
+
+
+/************************************************************************************
+ * Private Functions
+ ************************************************************************************/
+
+/*
+  模拟器输出数据  按neutron的循环DMA方式写入: 直接写入fifo缓冲后 fifo__sync 提交写位置
+  按neutron的波特率限速, 解析任务和上层读取的时序与硬件一致
+  与硬件不同  fifo满时等待读取而不是覆盖
+*/
+static void uart1_sim_rx(const uint8_t *p_dat, int len)
+{
+    int free_len,n;
+
+    while(len>0)
+    {
+        free_len=fifo__free(&uart1_rx_fifo);
+        if(free_len==0)
+        {
+            osDelay(1);
+            continue;
+        }
+        if(free_len>len)
+        {
+            free_len=len;
+        }
+        //每毫秒最多提交一次
+        if(free_len>UART1_SIM_BYTES_PER_MS)
+        {
+            free_len=UART1_SIM_BYTES_PER_MS;
+        }
+        //DMA写到缓冲末尾后回到开头
+        n=uart1_rx_fifo.size-uart1_dma_pos;
+        if(n>free_len)
+        {
+            n=free_len;
+        }
+        memcpy(uart1_rx_fifo.buf+uart1_dma_pos,p_dat,n);
+        memcpy(uart1_rx_fifo.buf,p_dat+n,free_len-n);
+        uart1_dma_pos=(uart1_dma_pos+free_len)&uart1_rx_fifo.mask;
+
+        //空闲中断
+        fifo__sync(&uart1_rx_fifo,uart1_dma_pos);
+        osSemaphoreRelease(uart1_rx_sem);
+        p_dat+=free_len;
+        len-=free_len;
+        osDelay(1);
+    }
+}
+
+void mo_drv_wifi_reset_hardware()
+{
+    esp8266_sim_reset();
+}
+
+
+/*=======UART1=====================================================
+  =================================================================*/
+void mo_uart1_init()
+{
+    //创建信号量
+    osSemaphoreDef(UART1_SEM);
+    uart1_rx_sem = osSemaphoreCreate(osSemaphore(UART1_SEM) , 1);
+
+    //创建串口接收fifo
+    fifo__init(&uart1_rx_fifo,1024*4);
+
+    //模拟器任务
+    esp8266_sim_init(uart1_sim_rx);
+}
+
+int mo_uart1_read(char *p_buf,int len,int timeout)
+{
+
+    int ret;
+
+    //如果fifo为空则 阻塞
+    if( fifo__avaliable(&uart1_rx_fifo)==0 )
+    {
+        osSemaphoreWait(uart1_rx_sem,osWaitForever);
+    }
+
+    //读取数据
+    ret=fifo__read(&uart1_rx_fifo,(uint8_t *)p_buf,len);
+
+#ifdef WIFI_DRV_DEBUG
+    MO_PRINT(("r"));
+    MO_PRINTN((p_buf,ret));
+#endif
+
+    return ret;
+
+}
+
+
+/*
+  返回接收fifo中连续的数据长度(回绕处截断), *p_dat 指向fifo内部数据  处理完后调用 mo_uart1_consume
+  neutron 的循环DMA会覆盖处理过慢的数据, 由 mo_uart1_overrun 事后报告; 模拟器满时等待, 不会覆盖
+*/
+int mo_uart1_peek(char **p_dat,int timeout)
+{
+
+    //如果fifo为空则 阻塞
+    if( fifo__avaliable(&uart1_rx_fifo)==0 )
+    {
+        osSemaphoreWait(uart1_rx_sem,osWaitForever);
+    }
+
+    return fifo__peek(&uart1_rx_fifo,(uint8_t **)p_dat);
+
+}
+
+void mo_uart1_consume(int len)
+{
+    fifo__consume(&uart1_rx_fifo,len);
+}
+
+/*
+  返回上次调用之后DMA覆盖的未读数据长度 (fifo 读取时已丢弃全部未读数据)
+*/
+int mo_uart1_overrun(void)
+{
+    uint32_t overflow=fifo__overflow(&uart1_rx_fifo);
+    int len=(int)(overflow-uart1_rx_overflow);
+
+    if(len>0)
+    {
+        MO_ERROR(("uart1 rx overflow %d",len));
+        uart1_rx_overflow=overflow;
+    }
+    return len;
+}
+
+int mo_uart1_write(const char *p_buf,int len)
+{
+
+    //debug
+#ifdef WIFI_DRV_DEBUG
+    MO_PRINT(("w"));
+    MO_PRINTN((p_buf,len));
+#endif
+
+    return esp8266_sim_write((const uint8_t *)p_buf,len);
+}
@@ -0,0 +1,109 @@
+/**
+ ******************************************************************************
+ * @file     : main.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : gcc(host) board entry, same task layout as the neutron board
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+**/
+#include "main.h"
+#include "cmsis_os.h"
+
+#include "lib_wifi_drv.h"
+#include "intorobot_api.h"
+
+
+osThreadId handle_setup_loop;
+
+
+void setup() __attribute__ ((weak));
+void loop() __attribute__ ((weak));
+
+static void task_setup_loop(void const *argument)
+{
+  delay(2000);
+
+  if(NULL != setup)
+  {
+    setup();
+  }
+
+  if(NULL != loop)
+  {
+    for(;;)
+    {
+      loop();
+    }
+  }
+
+
+}
+
+
+void mo_setup_loop_init()
+{
+  //setup_loop_init
+  osThreadDef(SETUP_LOOP, task_setup_loop, osPriorityNormal, 0, 1024);
+  handle_setup_loop = osThreadCreate(osThread(SETUP_LOOP),NULL);
+  MO_ASSERT((handle_setup_loop!=NULL));
+}
+
+
+void mo_display_start()
+{
+
+  MO_INFO(("====================Compile Time:%s===================",__TIME__));
+  MO_INFO(("                        \\\\\\|///                             "));
+  MO_INFO(("                      \\\\  - -  //                           "));
+  MO_INFO(("                       (  @ @  )                            "));
+  MO_INFO((" ____________________oOOo_(.)_oOOo_________________________ "));
+  MO_INFO(("|                                                          |"));
+  MO_INFO(("|             Welcome to IntoRobot  System                 |"));
+  MO_INFO(("|                              Oooo                        |"));
+  MO_INFO(("|______________________ oooO___(   )_______________________|"));
+  MO_INFO(("                       (   )    ) /                         "));
+  MO_INFO(("                        \\ (    (_/                          "));
+  MO_INFO(("                         \\_)                                "));
+
+}
+
+
+void mo_init()
+{
+    DWT_Init();
+    SerialUSB.begin();
+    mo_display_start();
+}
+
+
+int main(void)
+{
+    mo_init();
+    mo_drv_wifi_init();  // Create the task uart0 filter
+    mo_intorobot_init(); // intorobot_setup_loop task
+
+    osKernelStart();
+
+    //主线程不参与调度  任务都在各自的线程中运行
+    for(;;)
+    {
+        osDelay(1000);
+    }
+
+}
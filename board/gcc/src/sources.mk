@@ -0,0 +1,33 @@
+# This file is a makefile included from the top level makefile which
+# defines the sources built for the target.
+
+# Define the prefix to this directory.
+# Note: The name must be unique within this build and should be
+#       based on the root of the project
+
+TARGET_BOARD_SRC_PATH = $(BOARD_TYPE_PATH)/src
+
+# C source files included in this build.
+CSRC += $(call target_files,$(TARGET_BOARD_SRC_PATH)/,*.c)
+
+# enumerate target cpp files
+CPPSRC += $(call target_files,$(TARGET_BOARD_SRC_PATH)/,*.cpp)
+
+# neutron sources that only talk to the esp8266 through AT commands (or are
+# plain c++) are shared with the gcc board; their *_hal counterparts that touch
+# stm32 peripherals are replaced by the files in gcc/src.
+TARGET_BOARD_NEUTRON_SRC_PATH = $(BOARD_MODULE_PATH)/neutron/src
+
+BOARD_NEUTRON_SHARED_CPPSRC = \
+    wiring_string.cpp wiring_print.cpp wiring_stream.cpp wiring_ipaddress.cpp \
+    wiring_math.cpp wiring_time.cpp wiring_usbserial.cpp \
+    lib_fifo.cpp lib_wifi_drv.cpp lib_wifi.cpp lib_wifi_hal.cpp \
+    lib_tcpclient.cpp lib_tcpclient_hal.cpp lib_tcpserver.cpp lib_tcpserver_hal.cpp \
+    WiFiUdp.cpp WiFiUdp_hal.cpp lib_mqttclient.cpp intorobot_api.cpp \
+    ajson.cpp stringbuffer.cpp lib_rgb.cpp firmware_update.cpp firmware_update_hal.cpp \
+    system_params.cpp wiring_eeprom.cpp
+
+CPPSRC += $(patsubst $(SOURCE_PATH)/%,%,$(addprefix $(TARGET_BOARD_NEUTRON_SRC_PATH)/,$(BOARD_NEUTRON_SHARED_CPPSRC)))
+
+# ASM source files included in this build.
+ASRC +=
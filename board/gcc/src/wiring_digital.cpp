@@ -0,0 +1,99 @@
+/**
+ ******************************************************************************
+ @file     : wiring_digital.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : digital pins of the gcc(host) board, kept in memory
+ ******************************************************************************
+ Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "wiring_digital.h"
+
+/*
+  主机上没有GPIO, 引脚模式和电平只保存在内存中, 输出引脚读回最后写入的值
+*/
+static PinMode pin_mode[TOTAL_PINS];
+static uint8_t pin_value[TOTAL_PINS];
+
+/*********************************************************************************
+ *Function      : void pinMode(uint16_t pin, PinMode setMode)
+ *Description   : Set the mode of the pin
+ *Input         : pin: the pin number
+                  setMode: the mode of pin
+ *Output        : none
+ *Return        : none
+ *author        : robot
+ *date          : 2016-05-20
+ *Others        : none
+ **********************************************************************************/
+void pinMode(uint16_t pin, PinMode setMode)
+{
+    if (pin >= TOTAL_PINS)
+    {
+        return;
+    }
+    pin_mode[pin] = setMode;
+    if (setMode == INPUT_PULLUP)
+    {
+        pin_value[pin] = HIGH;
+    }
+    else if (setMode == INPUT_PULLDOWN)
+    {
+        pin_value[pin] = LOW;
+    }
+}
+
+/*********************************************************************************
+ *Function      : void digitalWrite(uint16_t pin, uint8_t value)
+ *Description   : Sets a GPIO pin to HIGH or LOW.
+ *Input         : pin: the pin number
+                  value: HIGH or LOW
+ *Output        : none
+ *Return        : none
+ *author        : robot
+ *date          : 2016-05-20
+ *Others        : none
+ **********************************************************************************/
+void digitalWrite(uint16_t pin, uint8_t value)
+{
+    if (pin >= TOTAL_PINS)
+    {
+        return;
+    }
+    pin_value[pin] = value ? HIGH : LOW;
+}
+
+/*********************************************************************************
+ *Function      : int32_t digitalRead(uint16_t pin)
+ *Description   : Reads the value of a GPIO pin.
+ *Input         : pin: the pin number
+ *Output        : none
+ *Return        : HIGH or LOW
+ *author        : robot
+ *date          : 2016-05-20
+ *Others        : none
+ **********************************************************************************/
+int32_t digitalRead(uint16_t pin)
+{
+    if (pin >= TOTAL_PINS)
+    {
+        return LOW;
+    }
+    return pin_value[pin];
+}
@@ -0,0 +1,126 @@
+//=================================================================================================================
+//input
+/****************************************************************************
+ *Private Included Files
+ ****************************************************************************/
+#include <stdint.h>
+#include <string.h>
+#include "lib_system_all.h"
+#include "wiring_eeprom.h"
+#include "wiring_eeprom_hal.h"
+
+//=================================================================================================================
+//gcc(主机)板: 两个flash页在内存中模拟, 不保存到文件
+//写入按flash规则只能把1写成0, 写入已编程的位返回失败, 便于发现重复写入同一位置
+//EEPROM_FlashPowerLoss 模拟掉电: 再完成 n 次写入/擦除后, 之后的操作全部不生效
+
+/************************************************************************************
+* Private Variables
+************************************************************************************/
+static uint8_t flash_page[2][PAGE_SIZE];
+static uint8_t flash_loaded = 0;
+static uint32_t flash_programs = 0;
+static uint32_t flash_erases = 0;
+static int32_t flash_power = -1;     //<0 不模拟掉电
+
+static void EEPROM_FlashLoad(void)
+{
+    if(!flash_loaded)
+    {
+        flash_loaded = 1;
+        memset(flash_page, 0xFF, sizeof(flash_page));
+    }
+}
+
+//掉电后返回0, 操作丢弃
+static int EEPROM_FlashPowered(void)
+{
+    if(flash_power == 0)
+    {
+        return 0;
+    }
+    if(flash_power > 0)
+    {
+        flash_power--;
+    }
+    return 1;
+}
+
+static int EEPROM_FlashProgram(uint16_t page, uint32_t offset, const uint8_t *data, uint32_t size)
+{
+    EEPROM_FlashLoad();
+    flash_programs++;
+    if((page > PAGE1) || (offset + size > PAGE_SIZE) || (offset % size))
+    {
+        MO_ERROR(("eeprom flash program page %d offset %d", page, offset));
+        return 1;
+    }
+    if(!EEPROM_FlashPowered())
+    {
+        return 0;
+    }
+    for(uint32_t i = 0; i < size; i++)
+    {
+        uint8_t *p = &flash_page[page][offset + i];
+        if((*p & data[i]) != data[i])
+        {
+            MO_ERROR(("eeprom flash program not erased page %d offset %d", page, offset));
+            return 1;
+        }
+        *p &= data[i];
+    }
+    return 0;
+}
+
+//=================================================================================================================
+//output
+void EEPROM_FlashUnlock_hal(void)
+{
+    EEPROM_FlashLoad();
+}
+
+uint32_t EEPROM_FlashRead_hal(uint16_t page, uint32_t offset)
+{
+    uint32_t data;
+
+    EEPROM_FlashLoad();
+    memcpy(&data, &flash_page[page & 1][offset], sizeof(data));
+    return data;
+}
+
+int EEPROM_FlashProgramHalfWord_hal(uint16_t page, uint32_t offset, uint16_t data)
+{
+    return EEPROM_FlashProgram(page, offset, (const uint8_t *)&data, sizeof(data));
+}
+
+int EEPROM_FlashProgramWord_hal(uint16_t page, uint32_t offset, uint32_t data)
+{
+    return EEPROM_FlashProgram(page, offset, (const uint8_t *)&data, sizeof(data));
+}
+
+int EEPROM_FlashErase_hal(uint16_t page)
+{
+    EEPROM_FlashLoad();
+    flash_erases++;
+    if(page > PAGE1)
+    {
+        return 1;
+    }
+    if(EEPROM_FlashPowered())
+    {
+        memset(flash_page[page], 0xFF, PAGE_SIZE);
+    }
+    return 0;
+}
+
+void EEPROM_FlashStatistics_hal(uint32_t *programs, uint32_t *erases)
+{
+    *programs = flash_programs;
+    *erases = flash_erases;
+}
+
+//n<0 恢复供电
+void EEPROM_FlashPowerLoss(int32_t n)
+{
+    flash_power = n;
+}
@@ -0,0 +1,215 @@
+/**
+ ******************************************************************************
+ * @file     : wiring_flash_memory.cpp
+ * @author   : robot
+ * @version	 : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : system argument area of the gcc(host) board, kept in a file
+ ******************************************************************************
+ Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wiring_flash_memory.h"
+#include "lib_system_all.h"
+
+/*
+  参数区为内存中的64K镜像, 启动时从文件加载, 每次写入后整体保存到文件.
+  文件名由环境变量 INTOROBOT_FLASH_FILE 指定, 默认为 intorobot_params.bin
+*/
+#define ARGUMENT_FLASH_FILE_DEFAULT     "intorobot_params.bin"
+// ARGUMENT_PAGE_SIZE 为 uint16_t, 0x10000 截断为0, 这里按地址范围计算
+#define ARGUMENT_FLASH_SIZE             (SYSTEM_ARGUMENT_END_ADDRESS - SYSTEM_ARGUMENT_ADDRESS + 1)
+
+static uint8_t argument_flash[ARGUMENT_FLASH_SIZE];
+static uint8_t argument_flash_loaded = 0;
+static uint32_t argument_programs = 0;
+static uint32_t argument_erases = 0;
+static int32_t argument_power = -1;     //<0 不模拟掉电, 见 SystemArgumentPowerLoss
+
+static const char *FLASH_File_Name(void)
+{
+    const char *name = getenv("INTOROBOT_FLASH_FILE");
+    return (name != NULL) ? name : ARGUMENT_FLASH_FILE_DEFAULT;
+}
+
+static void FLASH_Load(void)
+{
+    FILE *fp;
+
+    if(argument_flash_loaded)
+    {
+        return;
+    }
+    argument_flash_loaded = 1;
+    memset(argument_flash, 0xFF, sizeof(argument_flash));
+    fp = fopen(FLASH_File_Name(), "rb");
+    if(fp != NULL)
+    {
+        fread(argument_flash, 1, sizeof(argument_flash), fp);
+        fclose(fp);
+    }
+}
+
+static int FLASH_Save(void)
+{
+    FILE *fp = fopen(FLASH_File_Name(), "wb");
+    size_t len;
+
+    if(fp == NULL)
+    {
+        return 1;
+    }
+    len = fwrite(argument_flash, 1, sizeof(argument_flash), fp);
+    fclose(fp);
+    return (len == sizeof(argument_flash)) ? 0 : 1;
+}
+
+//掉电后返回0, 操作丢弃
+static int FLASH_Powered(void)
+{
+    if(argument_power == 0)
+    {
+        return 0;
+    }
+    if(argument_power > 0)
+    {
+        argument_power--;
+    }
+    return 1;
+}
+
+//按flash规则逐半字写入(只能把1写成0), 写入未擦除的位置返回失败
+static int FLASH_Program(uint32_t offset, const uint16_t *dataBuffer, uint32_t size)
+{
+    for(uint32_t i = 0; i < size; i++, offset += 2)
+    {
+        uint16_t data;
+
+        argument_programs++;
+        if(!FLASH_Powered())
+        {
+            break;
+        }
+        memcpy(&data, &argument_flash[offset], 2);
+        if((data & dataBuffer[i]) != dataBuffer[i])
+        {
+            MO_ERROR(("argument flash program not erased offset %d", offset));
+            FLASH_Save();
+            return 1;
+        }
+        data &= dataBuffer[i];
+        memcpy(&argument_flash[offset], &data, 2);
+    }
+    return FLASH_Save();
+}
+
+/*********************************************************************************
+ *Function		: void SystemReadArgument(uint32_t readStartAddress, uint16_t *dataBuffer, uint32_t size)
+ *Description	: Read data from the flash
+ *Input              : address data size
+ *Output		: none
+ *Return		: none
+ *author		: robot
+ *date			: 2016-05-20
+ *Others		: none
+ **********************************************************************************/
+void SystemReadArgument(uint32_t readStartAddress, uint16_t *dataBuffer, uint32_t size)
+{
+    uint32_t address = readStartAddress;
+    uint32_t endAddress = readStartAddress + size*2;
+
+    if((address < SYSTEM_ARGUMENT_ADDRESS)
+            || (endAddress > SYSTEM_ARGUMENT_END_ADDRESS
+                || ((address % 2) != 0)))
+    {
+        return;
+    }
+
+    FLASH_Load();
+    memcpy(dataBuffer, &argument_flash[address - SYSTEM_ARGUMENT_ADDRESS], size*2);
+}
+
+/*********************************************************************************
+ *Function		: int SystemWriteArgument(uint32_t writeStartAddress, uint16_t *dataBuffer, uint32_t size)
+ *Description	: For storing data in a flash
+ *Input		      : address data number
+ *Output		: none
+ *Return		: 0 ok  other error
+ *author		: robot
+ *date			: 2016-05-20
+ *Others		: 与 neutron 相同, 写入前擦除整个参数区
+ **********************************************************************************/
+int SystemWriteArgument(uint32_t writeStartAddress, uint16_t *dataBuffer, uint32_t size)
+{
+    uint32_t address = writeStartAddress;
+    uint32_t endAddress = writeStartAddress + size * 2;
+
+    if((address < SYSTEM_ARGUMENT_ADDRESS)
+            || (endAddress > SYSTEM_ARGUMENT_END_ADDRESS
+                || ((address % 2) != 0)))
+    {
+        return 2;//FLASH_ERROR_PG;
+    }
+
+    FLASH_Load();
+    argument_erases++;
+    if(FLASH_Powered())
+    {
+        memset(argument_flash, 0xFF, sizeof(argument_flash));
+    }
+    return FLASH_Program(address - SYSTEM_ARGUMENT_ADDRESS, dataBuffer, size);
+}
+
+/*********************************************************************************
+ *Function		: int SystemProgramArgument(uint32_t writeStartAddress, uint16_t *dataBuffer, uint32_t size)
+ *Description	: program half words into the erased part of the argument area, without erasing
+ *Input		      : address data number
+ *Output		: none
+ *Return		: 0 ok  other error
+ *author		: robot
+ *date			: 2016-05-20
+ *Others		: none
+ **********************************************************************************/
+int SystemProgramArgument(uint32_t writeStartAddress, uint16_t *dataBuffer, uint32_t size)
+{
+    uint32_t address = writeStartAddress;
+    uint32_t endAddress = writeStartAddress + size * 2;
+
+    if((address < SYSTEM_ARGUMENT_ADDRESS)
+            || (endAddress > SYSTEM_ARGUMENT_END_ADDRESS
+                || ((address % 2) != 0)))
+    {
+        return 2;//FLASH_ERROR_PG;
+    }
+
+    FLASH_Load();
+    return FLASH_Program(address - SYSTEM_ARGUMENT_ADDRESS, dataBuffer, size);
+}
+
+void SystemArgumentStatistics(uint32_t *programs, uint32_t *erases)
+{
+    *programs = argument_programs;
+    *erases = argument_erases;
+}
+
+//模拟掉电: 再完成 n 次半字写入/擦除后, 之后的操作全部不生效, n<0 恢复供电
+void SystemArgumentPowerLoss(int32_t n)
+{
+    argument_power = n;
+}
@@ -0,0 +1,23 @@
+//=================================================================================================================
+//input
+/****************************************************************************
+ *Private Included Files
+ ****************************************************************************/
+#include <time.h>
+#include"lib_system_all.h"
+#include "wiring_time_hal.h"
+
+//=================================================================================================================
+//gcc(主机)板: 以主机时间代替RTC, 设置时间只记录与主机时间的偏移
+
+static time_t rtc_offset = 0;
+
+time_t mo_Get_UnixTime_hal(void)
+{
+    return time(NULL) + rtc_offset;
+}
+
+void mo_Set_UnixTime_hal(time_t unix_time)
+{
+    rtc_offset = unix_time - time(NULL);
+}
@@ -0,0 +1,70 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include "lib_system_all.h"
+
+/*
+  gcc(主机)板: SerialUSB 对应进程的 stdin/stdout
+*/
+
+/*******************************************************************************
+ * Function Name  : USB_USART_Init
+ * Description    : Start USB-USART protocol.
+ * Input          : baudRate.
+ * Return         : None.
+ *******************************************************************************/
+void USB_USART_Init(uint32_t baudRate)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+}
+
+/*******************************************************************************
+ * Function Name  : USB_USART_Available_Data.
+ * Description    : Return the length of available data received from USB.
+ * Input          : None.
+ * Return         : Length.
+ *******************************************************************************/
+int32_t USB_USART_Available_Data(void)
+{
+    int len = 0;
+
+    if(ioctl(STDIN_FILENO, FIONREAD, &len) < 0)
+    {
+        return 0;
+    }
+    return len;
+}
+
+/*******************************************************************************
+ * Function Name  : USB_USART_Read_Data.
+ * Description    : Return data sent by USB Host.
+ * Input          : None
+ * Return         : Data.
+ *******************************************************************************/
+int32_t USB_USART_Read_Data(void)
+{
+    uint8_t c;
+
+    if(USB_USART_Available_Data() <= 0)
+    {
+        return -1;
+    }
+    if(read(STDIN_FILENO, &c, 1) != 1)
+    {
+        return -1;
+    }
+    return c;
+}
+
+/*******************************************************************************
+ * Function Name  : USB_USART_Send_Data.
+ * Description    : Send Data from USB_USART to USB Host.
+ * Input          : Data.
+ * Return         : None.
+ *******************************************************************************/
+void USB_USART_Send_Data(uint8_t Data)
+{
+    putchar(Data);
+}
@@ -2,6 +2,8 @@
 #ifndef __AT_EX_COMMAND_H__
 #define __AT_EX_COMMAND_H__
 
+#include "lib_ota_window.h"
+
 
 
 #define CMD_GETVERSION          "+MOLMCGMR"         //获取esp8266版本信息
@@ -9,13 +11,17 @@
 #define CMD_GET_FILE_SIZE       "+GETFILESIZE"      //获取应用程序大小
 #define CMD_GET_FILE_PACKET     "+GETFILEPACKET"    //获取应用程序数据包
 #define CMD_GET_FILE_ALL        "+GETFILEALL"       //获取应用程序整个数据
+#define CMD_FILE_ACK            "+FILEACK"          //确认 GETFILEALL 的数据包
 
-//at get file all
+//at get file all  滑动窗口发送, 见 lib_ota_window.h
 struct loadfile{
-    int file_sec_size;
     int packet_size;
     int file_type;
-    int packet_index;
+    uint32_t file_addr;         //文件在flash中的地址
+    uint8_t *packet_buffer;     //packet_size + OTA_WINDOW_CRC_SIZE
+    ota_sender_t sender;
+    uint32_t time_us;           //system_get_time 转换为ms
+    uint32_t time_ms;
 };
 
 
@@ -24,6 +30,7 @@ void ICACHE_FLASH_ATTR at_setupCmdDownFile(uint8_t id, char *pPara);
 void ICACHE_FLASH_ATTR at_setupCmdGetFileSize(uint8_t id, char *pPara);
 void ICACHE_FLASH_ATTR at_setupCmdGetFilePacket(uint8_t id, char *pPara);
 void ICACHE_FLASH_ATTR at_setupCmdGetFileAll(uint8_t id, char *pPara);
+void ICACHE_FLASH_ATTR at_setupCmdFileAck(uint8_t id, char *pPara);
 
 
 
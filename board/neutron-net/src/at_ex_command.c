@@ -130,6 +130,8 @@ AT+DOWNFILE="http://112.124.117.64/v1/bins/?dwn_token=8b66c607d5516e3b79f56afd37
 返回：
 +DOWNFILE:<status>,<progress>  0:下载成功 1:下载失败 2.正在下载
 OK
+下载的文件也可以是当前下载文件的差分包(build/tools/mkdelta.py 生成), md5 为差分包的md5
+还原出的新固件CRC正确才返回下载成功, 否则旧固件不变, 可以重新下载完整固件
 */
     void ICACHE_FLASH_ATTR
 at_setupCmdDownFile(uint8_t id, char *pPara){
@@ -291,7 +293,8 @@ at_setupCmdGetFilePacket(uint8_t id, char *pPara){
             ets_wdt_disable();
             packet_buffer = (uint8_t *)os_zalloc(packet_size + 2);
             if(file_type == 0){
-                readaddr = UPDATE_CACHE_WIFIAPP_SEC_START * SPI_FLASH_SEC_SIZE + packet_size * packet_index;
+                //差分升级后文件不一定从下载缓冲区开头开始
+                readaddr = file_info.file_start_sec * SPI_FLASH_SEC_SIZE + packet_size * packet_index;
             }
             else{
                 readaddr = DEFAPP_SEC_START * SPI_FLASH_SEC_SIZE + packet_size * packet_index;
@@ -324,68 +327,94 @@ at_setupCmdGetFilePacket(uint8_t id, char *pPara){
     }
 }
 
+//system_get_time 为us, 约71分钟回绕, 累计为ms
+LOCAL uint32_t ICACHE_FLASH_ATTR
+at_getfileall_millis(struct loadfile *ploadfile)
+{
+    uint32_t elapsed = (system_get_time() - ploadfile->time_us) / 1000;
+
+    ploadfile->time_us += elapsed * 1000;
+    ploadfile->time_ms += elapsed;
+    return ploadfile->time_ms;
+}
+
 LOCAL void ICACHE_FLASH_ATTR
-at_getfileall_timer_cb(void *arg)
+at_getfileall_free(void)
 {
-    char buffer[64] = {0};
-    uint8_t *packet_buffer;
-    uint32_t readaddr;
+    os_timer_disarm(&at_get_file_timer);
+    if(ploadfile != NULL)
+    {
+        os_free(ploadfile->packet_buffer);
+        os_free(ploadfile);
+        ploadfile = NULL;
+    }
+}
+
+//发送第index包  帧头+数据+CRC32
+LOCAL void ICACHE_FLASH_ATTR
+at_getfileall_send(struct loadfile *ploadfile, uint32_t index)
+{
+    char buffer[48] = {0};
+    uint8_t *packet_buffer = ploadfile->packet_buffer;
+    uint32_t readaddr = ploadfile->file_addr + ploadfile->packet_size * index;
+    uint32_t crc32;
 
+    if (SPI_FLASH_RESULT_OK != spi_flash_read(readaddr, (uint32 *)packet_buffer, ploadfile->packet_size)) {
+        return; //不发送, 接收方超时后请求重发
+    }
+    crc32 = ota_window_crc(index, packet_buffer, ploadfile->packet_size);
+    packet_buffer[ploadfile->packet_size] = crc32 & 0xFF;
+    packet_buffer[ploadfile->packet_size + 1] = (crc32 >> 8) & 0xFF;
+    packet_buffer[ploadfile->packet_size + 2] = (crc32 >> 16) & 0xFF;
+    packet_buffer[ploadfile->packet_size + 3] = crc32 >> 24;
+
+    uart0_tx_buffer(buffer, ota_window_frame_head(buffer, ploadfile->sender.packet_count, index, ploadfile->packet_size + OTA_WINDOW_CRC_SIZE));
+    uart0_tx_buffer(packet_buffer, ploadfile->packet_size + OTA_WINDOW_CRC_SIZE);
+    uart0_tx_buffer("\r\n", 2);
+}
+
+//每次发送一个包, 窗口已满时等待确认
+LOCAL void ICACHE_FLASH_ATTR
+at_getfileall_timer_cb(void *arg)
+{
     struct loadfile *ploadfile = arg;
-    os_timer_disarm(&at_get_file_timer);
+    uint32_t now;
+    int32_t index;
 
-    if(ploadfile != NULL)
+    os_timer_disarm(&at_get_file_timer);
+    if(ploadfile == NULL)
     {
-        packet_buffer = (uint8_t *)os_zalloc(ploadfile->packet_size + 2);
-        if(ploadfile->file_type == 0){
-            readaddr = UPDATE_CACHE_WIFIAPP_SEC_START * SPI_FLASH_SEC_SIZE + ploadfile->packet_size * ploadfile->packet_index;
-        }
-        else{
-            readaddr = DEFAPP_SEC_START * SPI_FLASH_SEC_SIZE + ploadfile->packet_size * ploadfile->packet_index;
-        }
-        os_memset(packet_buffer, 0, sizeof(packet_buffer));
-        if (SPI_FLASH_RESULT_OK == spi_flash_read(readaddr, (uint32 *)packet_buffer, ploadfile->packet_size)) {
-            os_memset(buffer, 0, sizeof(buffer));
-            os_sprintf(buffer,"%s,%d,%d,%d:",CMD_GET_FILE_ALL, ploadfile->file_sec_size, ploadfile->packet_index, ploadfile->packet_size+2);
-            //at_port_print(buffer);
-            uart0_tx_buffer(buffer,strlen(buffer));
-
-            crc_reset();
-            crc_update_n(packet_buffer,ploadfile->packet_size);
-            uint16_t crc16 = crc_get_reseult();
-            os_memcpy(&packet_buffer[ploadfile->packet_size], (uint8 *)&crc16, 2);
-
-            //发送一个包数据+16bitCRC
-            uart0_tx_buffer(packet_buffer,ploadfile->packet_size+2);
-            uart0_tx_buffer("\r\n",2);
-        }
-        ets_wdt_enable();
-        os_free(packet_buffer);
-        packet_buffer = NULL;
-        ploadfile->packet_index++;
-        if(ploadfile->packet_index < ploadfile->file_sec_size){
-            os_timer_disarm(&at_get_file_timer);
-            os_timer_setfn(&at_get_file_timer, (os_timer_func_t *)at_getfileall_timer_cb, ploadfile);
-            os_timer_arm(&at_get_file_timer, 1, 0);
-        }
+        return;
     }
-    else{
-        at_response_error();
+    now = at_getfileall_millis(ploadfile);
+    if(ota_sender_done(&ploadfile->sender) || ota_sender_expired(&ploadfile->sender, now))
+    {
+        at_getfileall_free();
+        return;
+    }
+    index = ota_sender_next(&ploadfile->sender);
+    if(index >= 0)
+    {
+        at_getfileall_send(ploadfile, index);
+        os_timer_arm(&at_get_file_timer, 1, 0);
+    }
+    else
+    {
+        os_timer_arm(&at_get_file_timer, 5, 0);
     }
 }
 
 
 //获取应用程序数据包
-//cmd:AT+GETFILEALL=16384,1    第1个参数:每个数据段长度   第二个参数：文件类型     0 在线应用文件   1 默认应用文件
+//cmd:AT+GETFILEALL=2048,1,8   第1个参数:每个数据段长度(4的倍数)  第2个参数：文件类型  0 在线应用文件   1 默认应用文件
+//                             第3个参数:窗口, 最多有几个包未确认
 //返回：
-//+GETFILEALL,14,0,16388:数据
+//+GETFILEALL,<包个数>,<包序号>,<长度>:数据+CRC32   长度包含CRC
+//接收方用 AT+FILEACK 确认, 协议见 lib_ota_window.h
     void ICACHE_FLASH_ATTR
 at_setupCmdGetFileAll(uint8_t id, char *pPara){
-    char buffer[64] = {0};
-    uint8 packet_buffer[SPI_FLASH_SEC_SIZE*2 + 4];
-    int packet_size = 0, file_type = 0, err = 0;
+    int packet_size = 0, file_type = 0, window = 0, err = 0;
     struct upgrade_file_info file_info;
-    uint32_t readaddr;
     uint32_t file_sec_size;
 
     if (*pPara++ != '=') // skip '='
@@ -401,10 +430,20 @@ at_setupCmdGetFileAll(uint8_t id, char *pPara){
     }
     //get the second parameter digit
     at_get_next_int_dec(&pPara, &file_type, &err);
+    if (*pPara++ != ',') { // skip ','
+        at_response_error();
+        return;
+    }
+    //get the third parameter digit
+    at_get_next_int_dec(&pPara, &window, &err);
     if (*pPara != '\r') {
         at_response_error();
         return;
     }
+    if ((packet_size <= 0) || (packet_size > SPI_FLASH_SEC_SIZE * 2) || (packet_size % 4) || (window <= 0)) {
+        at_response_error();
+        return;
+    }
 
     switch(file_type)
     {
@@ -420,12 +459,26 @@ at_setupCmdGetFileAll(uint8_t id, char *pPara){
             else{
                 file_sec_size = (UPDATE_CACHE_DEFAPP_SEC_NUM*SPI_FLASH_SEC_SIZE + packet_size -1)/packet_size;
             }
+            at_getfileall_free();
             ploadfile = (struct loadfile *)os_zalloc(sizeof(struct loadfile));
-            ploadfile->file_sec_size = file_sec_size;
+            if(ploadfile != NULL){
+                ploadfile->packet_buffer = (uint8_t *)os_zalloc(packet_size + OTA_WINDOW_CRC_SIZE);
+            }
+            if((ploadfile == NULL) || (ploadfile->packet_buffer == NULL)){
+                at_getfileall_free();
+                at_response_error();
+                break;
+            }
             ploadfile->packet_size = packet_size;
-            ploadfile->packet_index = 0;
-            ploadfile->file_type = file_sec_size;
-            os_timer_disarm(&at_get_file_timer);
+            ploadfile->file_type = file_type;
+            if(file_type == 0){
+                ploadfile->file_addr = file_info.file_start_sec * SPI_FLASH_SEC_SIZE;
+            }
+            else{
+                ploadfile->file_addr = DEFAPP_SEC_START * SPI_FLASH_SEC_SIZE;
+            }
+            ploadfile->time_us = system_get_time();
+            ota_sender_init(&ploadfile->sender, file_sec_size, window, 0);
             os_timer_setfn(&at_get_file_timer, (os_timer_func_t *)at_getfileall_timer_cb, ploadfile);
             os_timer_arm(&at_get_file_timer, 1, 0);
             break;
@@ -435,3 +488,29 @@ at_setupCmdGetFileAll(uint8_t id, char *pPara){
     }
 }
 
+//确认数据包
+//cmd:AT+FILEACK=5,3   第1个参数:之前的包都已收到   第2个参数:需要重发的包, -1 没有
+//不返回, 避免和数据包混在一起
+    void ICACHE_FLASH_ATTR
+at_setupCmdFileAck(uint8_t id, char *pPara){
+    int base = 0, nack = -1, err = 0;
+
+    if ((ploadfile == NULL) || (*pPara++ != '=')) // skip '='
+    {
+        return;
+    }
+    at_get_next_int_dec(&pPara, &base, &err);
+    if (*pPara++ != ',') { // skip ','
+        return;
+    }
+    if (*pPara == '-') {    //-1 没有需要重发的包
+        nack = -1;
+    }
+    else {
+        at_get_next_int_dec(&pPara, &nack, &err);
+    }
+    ota_sender_ack(&ploadfile->sender, base, nack, at_getfileall_millis(ploadfile));
+    //窗口打开, 立即继续发送
+    os_timer_disarm(&at_get_file_timer);
+    os_timer_arm(&at_get_file_timer, 1, 0);
+}
@@ -11,6 +11,7 @@
 #include "at_ex_command.h"
 #include "upgrade.h"
 #include "upgrade_lib.c"
+#include "lib_delta.h"
 
 #define UPGRADE_DEBUG
 #ifdef UPGRADE_DEBUG
@@ -29,6 +30,177 @@ LOCAL os_timer_t upgrade_timer;
 LOCAL uint32 totallength = 0;
 LOCAL uint32 sumlength = 0;
 
+//下载的文件可以是完整固件或者差分包(lib_delta.h), 由开头4字节区分
+LOCAL uint8 upgrade_probe[4];
+LOCAL uint8 upgrade_probe_len = 0;
+LOCAL delta_apply_t *upgrade_delta = NULL;          //差分包还原, 完整固件时为NULL
+LOCAL struct upgrade_file_info upgrade_delta_base;  //旧固件, 即当前的下载文件
+LOCAL uint32 upgrade_delta_sec;                     //新固件起始扇区
+LOCAL uint32 upgrade_delta_erase;                   //下一个要擦除的扇区
+
+
+/******************************************************************************
+ * FunctionName : upgrade_delta_read
+ * Description  : read the old image for the delta patch
+ * Parameters   : offset -- offset in the old image
+ *                buf -- 4 byte aligned buffer
+ *                len -- length to read
+ * Returns      : 0 for success
+*******************************************************************************/
+LOCAL int ICACHE_FLASH_ATTR
+upgrade_delta_read(void *arg, uint32_t offset, uint8_t *buf, uint32_t len)
+{
+    uint32 addr = upgrade_delta_base.file_start_sec * SPI_FLASH_SEC_SIZE + offset;
+
+    return (spi_flash_read(addr, (uint32 *)buf, (len + 3) & ~3) != SPI_FLASH_RESULT_OK);
+}
+
+/******************************************************************************
+ * FunctionName : upgrade_delta_write
+ * Description  : write the new image rebuilt from the delta patch
+ *                新固件放在下载缓冲区中旧固件前面或者后面的空闲扇区, 不覆盖旧固件
+ * Parameters   : offset -- offset in the new image, increasing
+ *                buf -- 4 byte aligned buffer
+ *                len -- length to write
+ * Returns      : 0 for success
+*******************************************************************************/
+LOCAL int ICACHE_FLASH_ATTR
+upgrade_delta_write(void *arg, uint32_t offset, const uint8_t *buf, uint32_t len)
+{
+    uint32 addr, last_sec, new_sec_num;
+
+    if (offset == 0) {
+        new_sec_num = (upgrade_delta->new_size + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE;
+        if (upgrade_delta_base.file_start_sec - UPDATE_CACHE_WIFIAPP_SEC_START >= new_sec_num) {
+            upgrade_delta_sec = UPDATE_CACHE_WIFIAPP_SEC_START;
+        } else {
+            upgrade_delta_sec = UPDATE_CACHE_WIFIAPP_SEC_START + UPDATE_CACHE_WIFIAPP_SEC_NUM - new_sec_num;
+        }
+        upgrade_delta_erase = upgrade_delta_sec;
+    }
+    addr = upgrade_delta_sec * SPI_FLASH_SEC_SIZE + offset;
+    last_sec = (addr + len - 1) / SPI_FLASH_SEC_SIZE;
+    while (upgrade_delta_erase <= last_sec) {
+        if (spi_flash_erase_sector(upgrade_delta_erase++) != SPI_FLASH_RESULT_OK) {
+            return 1;
+        }
+    }
+    return (spi_flash_write(addr, (uint32 *)buf, (len + 3) & ~3) != SPI_FLASH_RESULT_OK);
+}
+
+/******************************************************************************
+ * FunctionName : upgrade_delta_begin
+ * Description  : start applying a delta patch against the current download file
+ * Parameters   : none
+ * Returns      : true for success
+*******************************************************************************/
+LOCAL bool ICACHE_FLASH_ATTR
+upgrade_delta_begin(void)
+{
+    uint32 base_end, head_free, tail_free;
+
+    if (file_info_read(&upgrade_delta_base) || (upgrade_delta_base.file_size == 0)) {
+        UPGRADE_DBG("delta: no old image\n");
+        return false;
+    }
+    base_end = upgrade_delta_base.file_start_sec +
+        (upgrade_delta_base.file_size + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE;
+    if ((upgrade_delta_base.file_start_sec < UPDATE_CACHE_WIFIAPP_SEC_START) ||
+        (base_end > UPDATE_CACHE_WIFIAPP_SEC_START + UPDATE_CACHE_WIFIAPP_SEC_NUM)) {
+        UPGRADE_DBG("delta: old image out of cache\n");
+        return false;
+    }
+    head_free = upgrade_delta_base.file_start_sec - UPDATE_CACHE_WIFIAPP_SEC_START;
+    tail_free = UPDATE_CACHE_WIFIAPP_SEC_START + UPDATE_CACHE_WIFIAPP_SEC_NUM - base_end;
+
+    upgrade_delta = (delta_apply_t *)os_zalloc(sizeof(delta_apply_t));
+    if (upgrade_delta == NULL) {
+        return false;
+    }
+    delta_apply_init(upgrade_delta, upgrade_delta_base.file_size,
+            ((head_free > tail_free) ? head_free : tail_free) * SPI_FLASH_SEC_SIZE,
+            upgrade_delta_read, upgrade_delta_write, NULL);
+    return true;
+}
+
+LOCAL void ICACHE_FLASH_ATTR
+upgrade_delta_free(void)
+{
+    os_free(upgrade_delta);
+    upgrade_delta = NULL;
+    upgrade_probe_len = 0;
+}
+
+/******************************************************************************
+ * FunctionName : upgrade_write
+ * Description  : write the downloaded data
+ *                开头4字节为差分包magic时还原差分包, 否则直接写入下载缓冲区
+ *                差分包不清除文件属性, 失败时旧固件仍然可用
+ * Parameters   : data -- downloaded data
+ *                len -- length of data
+ * Returns      : true for success
+*******************************************************************************/
+LOCAL bool ICACHE_FLASH_ATTR
+upgrade_write(uint8 *data, uint16 len)
+{
+    uint16 n;
+
+    if (upgrade_probe_len < sizeof(upgrade_probe)) {
+        n = sizeof(upgrade_probe) - upgrade_probe_len;
+        if (n > len) {
+            n = len;
+        }
+        os_memcpy(upgrade_probe + upgrade_probe_len, data, n);
+        upgrade_probe_len += n;
+        data += n;
+        len -= n;
+        if (upgrade_probe_len < sizeof(upgrade_probe)) {
+            return true;
+        }
+        if (delta_patch_check(upgrade_probe, sizeof(upgrade_probe))) {
+            UPGRADE_DBG("delta patch\n");
+            if (!upgrade_delta_begin()) {
+                return false;
+            }
+        } else {
+            file_info_clear();
+        }
+        if (!upgrade_write(upgrade_probe, sizeof(upgrade_probe))) {
+            return false;
+        }
+    }
+    if (upgrade_delta == NULL) {
+        return system_upgrade(data, len);
+    }
+    if (delta_apply_input(upgrade_delta, data, len) > DELTA_DONE) {
+        UPGRADE_DBG("delta apply error %d\n", upgrade_delta->status);
+        return false;
+    }
+    return true;
+}
+
+/******************************************************************************
+ * FunctionName : upgrade_file_finish
+ * Description  : save the download file info
+ *                差分包还原出的新固件CRC正确才切换文件属性
+ * Parameters   : none
+ * Returns      : true for success
+*******************************************************************************/
+LOCAL bool ICACHE_FLASH_ATTR
+upgrade_file_finish(void)
+{
+    if (upgrade_delta == NULL) {
+        file_info->file_size = sumlength;
+        file_info->file_start_sec = UPDATE_CACHE_WIFIAPP_SEC_START;
+    } else if (upgrade_delta->status == DELTA_DONE) {
+        file_info->file_size = upgrade_delta->new_size;
+        file_info->file_start_sec = upgrade_delta_sec;
+    } else {
+        UPGRADE_DBG("delta incomplete %d\n", upgrade_delta->status);
+        return false;
+    }
+    return (file_info_write(file_info) == 0);
+}
 
 /******************************************************************************
  * FunctionName : upgrade_disconcb
@@ -120,6 +292,7 @@ upgrade_check(struct upgrade_server_info *server){
         server->upgrade_flag = true;
         os_timer_disarm(&upgrade_timer);
     }
+    upgrade_delta_free();
     upgrade_deinit();
 
     if (server->check_cb != NULL) {
@@ -165,10 +338,13 @@ upgrade_download(void *arg, char *pusrdata, unsigned short length){
         length -= 4;
         totallength += length;
         UPGRADE_DBG("upgrade file download start.\n");
-        file_info_clear();
+        upgrade_delta_free();
         MD5Init(&_ctx);
         MD5Update(&_ctx, ptr + 4, length);
-        system_upgrade(ptr + 4, length);
+        if (!upgrade_write(ptr + 4, length)) {
+            upgrade_check(server);
+            return;
+        }
         ptr = (char *)os_strstr(pusrdata, "Content-Length: ");
 
         if (ptr != NULL) {
@@ -195,7 +371,10 @@ upgrade_download(void *arg, char *pusrdata, unsigned short length){
         totallength += length;
         os_printf("totallen = %d\n",totallength);
         MD5Update(&_ctx, pusrdata, length);
-        system_upgrade(pusrdata, length);
+        if (!upgrade_write(pusrdata, length)) {
+            upgrade_check(server);
+            return;
+        }
     }
 
     progress = totallength*100/sumlength;
@@ -213,13 +392,9 @@ upgrade_download(void *arg, char *pusrdata, unsigned short length){
             os_sprintf(output + (i * 2), "%02x", md5_calc[i]);
         }
         os_printf("md5 = %s\n",output);
-        if(!os_strcmp(server->md5,output)){
+        if(!os_strcmp(server->md5,output) && upgrade_file_finish()){
             UPGRADE_DBG("md5 check ok.\n");
             system_upgrade_flag_set(UPGRADE_FLAG_FINISH);
-            //保存文件
-            file_info->file_size = sumlength;
-            file_info->file_start_sec = UPDATE_CACHE_WIFIAPP_SEC_START;
-            file_info_write(file_info);
 
             totallength = 0;
             sumlength = 0;
@@ -5,6 +5,7 @@
 #include "lwip/mem.h"
 
 #include "upgrade.h"
+#include "lib_crc.h"
 
 
 LOCAL struct upgrade_param *upgrade;
@@ -134,33 +135,10 @@ system_upgrade_deinit(void)
     upgrade = NULL;
 }
 
-uint32_t ICACHE_FLASH_ATTR
-crc32_update(uint32_t crc, const uint8_t *data, size_t length)
-{
-    uint32_t i;
-    bool bit;
-    uint8_t c;
-
-    while (length--) {
-        c = *data++;
-        for (i = 0x80; i > 0; i >>= 1) {
-            bit = crc & 0x80000000;
-            if (c & i) {
-                bit = !bit;
-            }
-            crc <<= 1;
-            if (bit) {
-                crc ^= 0x04c11db7;
-            }
-        }
-    }
-    return crc;
-}
-
 uint32_t ICACHE_FLASH_ATTR
 file_info_calculate_crc32(struct upgrade_file_info *file_info)
 {
-    return crc32_update(0xffffffff, (const uint8_t*)file_info,
+    return crc32_update(CRC32_INIT, file_info,
                       offsetof(struct upgrade_file_info, crc32));
 }
 
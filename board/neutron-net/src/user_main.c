@@ -24,7 +24,8 @@ at_funcationType at_custom_cmd[] = {
     {CMD_DOWN_FILE, 9, NULL, NULL, at_setupCmdDownFile, NULL},
     {CMD_GET_FILE_SIZE, 12, NULL, NULL, at_setupCmdGetFileSize, NULL},
     {CMD_GET_FILE_PACKET, 14, NULL, NULL, at_setupCmdGetFilePacket, NULL},
-    {CMD_GET_FILE_ALL, 11, NULL, NULL, at_setupCmdGetFileAll, NULL}
+    {CMD_GET_FILE_ALL, 11, NULL, NULL, at_setupCmdGetFileAll, NULL},
+    {CMD_FILE_ACK, 8, NULL, NULL, at_setupCmdFileAck, NULL}
 };
 
 void user_init(void)
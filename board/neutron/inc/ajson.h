@@ -25,7 +25,7 @@
 #ifndef   AJSON_H_
 #define   AJSON_H_
 
-#include "wiring_usartserial.h"
+#include "wiring_stream.h"
 #include "wiring_client.h"
 #include "wiring.h"
 
@@ -41,9 +41,13 @@
 #define aJson_String 5
 #define aJson_Array 6
 #define aJson_Object 7
+#define aJson_Long 8    // integer outside the int range
 
 #define aJson_IsReference 128
 
+// parseInSitu/parseDocument/aJsonReader: maximum nesting of arrays/objects
+#define aJson_MaxDepth 16
+
 #ifndef EOF
 #define EOF -1
 #endif
@@ -63,6 +67,7 @@ typedef struct aJsonObject
         char valuebool; //the items value for true & false
         int valueint; // The item's number, if type==aJson_Number
         double valuefloat; // The item's number, if type==aJson_Number
+        long long valuelong; // The item's number, if type==aJson_Long
     };
 } aJsonObject;
 
@@ -73,7 +78,7 @@ typedef struct aJsonObject
 class aJsonStream : public Print 
 {
     public:
-        aJsonStream(Stream *stream_): stream_obj(stream_), bucket(EOF) {}
+        aJsonStream(Stream *stream_): stream_obj(stream_), bucket(EOF), cursor(NULL), cursor_end(NULL) {}
             /* Use this to check if more data is available, as aJsonStream
             * can read some more data than really consumed and automatically
             * skips separating whitespace if you use this method. */
@@ -81,6 +86,7 @@ class aJsonStream : public Print
 
         int parseNumber(aJsonObject *item);
         int printInt(aJsonObject *item);
+        int printLong(aJsonObject *item);
         int printFloat(aJsonObject *item);
 
         int parseString(aJsonObject *item);
@@ -126,6 +132,12 @@ class aJsonStream : public Print
             * to be returned by next getch() - returned by a call
             * to ungetch(). */
         int bucket;
+
+            /* Unread input of a stream backed by a string, NULL otherwise.
+            * The text is terminated at cursor_end; numbers, strings and
+            * whitespace are scanned here directly instead of getch(). */
+        const char *cursor, *cursor_end;
+        int scanString(aJsonObject *item);
 };
 
 /* JSON stream that is bound to input and output string buffer. This is
@@ -137,19 +149,22 @@ class aJsonStringStream : public aJsonStream
         /* Either of inbuf, outbuf can be NULL if you do not care about
         * particular I/O direction. */
         aJsonStringStream(char *inbuf_, char *outbuf_ = NULL, size_t outbuf_len_ = 0)
-        : aJsonStream(NULL), inbuf(inbuf_), outbuf(outbuf_), outbuf_len(outbuf_len_)
+        : aJsonStream(NULL), outbuf(outbuf_), outbuf_len(outbuf_len_)
         {
-            inbuf_len = inbuf ? strlen(inbuf) : 0;
+            cursor = inbuf_;
+            cursor_end = inbuf_ ? inbuf_ + strlen(inbuf_) : NULL;
         }
 
         virtual bool available(void);
 
     private:
         virtual int getch(void);
+        virtual size_t readBytes(uint8_t *buffer, size_t len);
+        virtual void ungetch(char ch);
         virtual size_t write(uint8_t ch);
 
-        char *inbuf, *outbuf;
-        size_t inbuf_len, outbuf_len;
+        char *outbuf;
+        size_t outbuf_len;
 };
 
 
@@ -167,6 +182,15 @@ class aJsonClass
         aJsonObject* parse(aJsonStream* stream); //Reads from a stream
         aJsonObject* parse(aJsonStream* stream,char** filter_values); //Read from a file, but only return values include in the char* array filter_values
         aJsonObject* parse(char *value); //Reads from a string
+        // Parse value in place: strings are unescaped and terminated inside value, nodes are taken from arena.
+        // Nothing is allocated; do not call deleteItem on the result, just drop arena (and value) when finished.
+        // Anything but whitespace after the root value is an error.
+        aJsonObject* parseInSitu(char *value, void *arena, size_t arena_size);
+        // Arena size that parseInSitu needs for value at most.
+        size_t arenaSize(const char *value);
+        // Parse a copy of value into one heap block (nodes + text). Call deleteDocument when finished.
+        aJsonObject* parseDocument(const char *value);
+        void deleteDocument(aJsonObject *root);
         // Render a aJsonObject entity to text for transfer/storage. Free the char* when finished.
         int print(aJsonObject *item, aJsonStream* stream);
         char* print(aJsonObject* item);
@@ -226,6 +250,132 @@ class aJsonClass
         aJsonObject* createReference(aJsonObject *item);
 };
 
+// aJsonReader: filters and sizes
+#define aJson_ReaderMaxFilters  8
+#define aJson_ReaderPathSize    64      // "key.key.0.key" of the current value
+#define aJson_ReaderTokenSize   128     // string value of a filtered path (with the terminator)
+
+// aJsonReader::feed() results
+#define aJson_ReaderMore        0       // the value is not complete yet, feed more
+#define aJson_ReaderDone        1       // the value is complete
+#define aJson_ReaderError       -1      // malformed or too deep
+
+// value->type of a filtered string longer than aJson_ReaderTokenSize-1 bytes:
+// valuestring holds its start, cut at a utf-8 boundary, and the rest of the text is still parsed
+#define aJson_ReaderTruncated   9
+
+// path: the matched filter path   value: a temporary item, valuestring is only valid during the call
+typedef void (*aJsonReaderCallback)(const char *path, aJsonObject *value, void *arg);
+
+/* Event driven reader: the text is fed in pieces of any size (for example
+ * the chunks of a streamed mqtt payload) and the callback of a registered
+ * path is called as soon as its value is complete. No tree is built and
+ * nothing is allocated; unfiltered values are only checked and skipped.
+ * Paths are object keys and array indexes joined by '.', e.g. "md5",
+ * "value.ssid", "list.0". Keys are compared case insensitive as in
+ * getObjectItem. Only strings, numbers, true/false and null are reported;
+ * a string too long for the token is reported cut, as aJson_ReaderTruncated. */
+class aJsonReader
+{
+    public:
+        aJsonReader(void);
+        // Register callback for path, path must outlive the reader. Returns false if the table is full.
+        bool addFilter(const char *path, aJsonReaderCallback callback, void *arg = NULL);
+        // Start a new text, the filters are kept.
+        void reset(void);
+        // Feed the next part of the text. Once Done or Error, further bytes are ignored until reset().
+        int feed(const uint8_t *data, size_t len);
+        // reset() and feed a whole string; anything but whitespace after the end is an error
+        int parse(const char *value);
+
+    private:
+        struct
+        {
+            const char *path;
+            aJsonReaderCallback callback;
+            void *arg;
+        } filters[aJson_ReaderMaxFilters];
+        uint8_t filterCount;
+
+        uint8_t state;
+        uint8_t depth;
+        int8_t match;                               // filter of the current value, -1 none
+        uint8_t escape;                             // string: 1 after '\', 2..5 reading \uXXXX
+        uint16_t code;                              // \uXXXX being read
+        uint8_t pathLen;
+        uint8_t pathOverflow;                       // level whose key/index did not fit in path, 0 none
+        uint8_t tokenLen;
+        uint8_t truncated;                          // the string value did not fit in token
+        uint8_t pathStart[aJson_MaxDepth + 1];      // path length before the key/index of each level
+        uint16_t index[aJson_MaxDepth + 1];         // array: current element
+        uint32_t containers;                        // bit per level: 1 object, 0 array
+        char path[aJson_ReaderPathSize];
+        char token[aJson_ReaderTokenSize];
+
+        int step(uint8_t c);
+        bool pushContainer(bool object);
+        void beginElement(void);
+        void appendPath(char c);
+        void appendChar(char c);
+        void appendCode(void);
+        void trimToken(void);
+        void matchPath(void);
+        void emit(aJsonObject *value);
+        int endValue(void);
+        int endNumber(void);
+        int closeContainer(bool object);
+};
+
+// aJsonWriter::addNumber(name, double): default digits after the point (trailing zeros are dropped)
+#define aJson_WriterDecimals    5
+
+/* Writer of json text straight into a caller buffer, for example the payload
+ * room of a mqtt packet: no tree and no allocation. Commas are inserted
+ * automatically; give a name inside objects and NULL inside arrays. Once the
+ * buffer is full nothing more is written and overflow() turns true, so one
+ * check at the end is enough. The text is not terminated unless c_str() is
+ * called. */
+class aJsonWriter
+{
+    public:
+        aJsonWriter(char *buffer, size_t size);
+        void beginObject(const char *name = NULL);
+        void endObject(void);
+        void beginArray(const char *name = NULL);
+        void endArray(void);
+        void addNull(const char *name);
+        void addBoolean(const char *name, bool b);
+        void addNumber(const char *name, int n);
+        void addNumber(const char *name, unsigned int n);
+        void addNumber(const char *name, long n);
+        void addNumber(const char *name, unsigned long n);
+        void addNumber(const char *name, long long n);
+        void addNumber(const char *name, double n, uint8_t decimals = aJson_WriterDecimals);
+        void addString(const char *name, const char *s);
+        size_t length(void) { return len; }
+        bool overflow(void) { return full; }
+        // Terminate the text, NULL if there is no room for the terminator.
+        const char *c_str(void);
+
+    private:
+        char *buf;
+        size_t size, len;
+        uint32_t first;         // bit per level: nothing written at this level yet
+        uint8_t depth;
+        bool full;
+
+        void put(char c);
+        void put(const char *s, size_t n);
+        void putUnsigned(unsigned long long n, bool negative);
+        void putString(const char *s);
+        void separator(const char *name);
+        void open(const char *name, char c);
+        void close(char c);
+};
+
+// fills writer, see IntorobotClass::publish
+typedef void (*aJsonWriterCallback)(aJsonWriter &writer, void *arg);
+
 bool jsonGetValue(uint8_t *payload, const char *string, bool &ret_bool);
 bool jsonGetValue(uint8_t *payload, const char *string, char &ret_char);
 bool jsonGetValue(uint8_t *payload, const char *string, String &ret_string);
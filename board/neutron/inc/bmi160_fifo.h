@@ -0,0 +1,107 @@
+/**
+ ******************************************************************************
+ * @file     : bmi160_fifo.h
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : BMI160 FIFO 带帧头数据解析和样本环形缓冲
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+#ifndef BMI160_FIFO_H_
+#define BMI160_FIFO_H_
+
+#include <stdint.h>
+
+/*
+  FIFO 帧头模式 (FIFO_CONFIG_1 fifo_header_en=1), 帧头字节:
+      bit7-6  10 数据帧  01 控制帧
+      bit5-2  数据帧: bit4 mag  bit3 gyro  bit2 accel
+      bit1-0  中断标记, 解析时忽略
+  数据帧内顺序为 mag(8字节 x y z rhall) gyro(6字节) accel(6字节), 小端
+  控制帧: 0x40 跳过帧(1字节, FIFO溢出丢掉的帧数)  0x44 sensortime(3字节)  0x48 配置变化(1字节)
+  0x80 表示 FIFO 已读空, 之后的数据无效
+  一次读取末尾不完整的帧不会从 FIFO 中移除, 下次读取时重新读出, 解析时丢掉
+  只在 FIFO 读空时输出 sensortime 帧, 因此读取长度为 FIFO 长度 + BMI160_FIFO_TIME_FRAME_SIZE
+*/
+
+#define BMI160_FIFO_SIZE                1024        // FIFO 字节数
+#define BMI160_FIFO_TIME_FRAME_SIZE     4           // sensortime 帧
+#define BMI160_FIFO_CMD_FLUSH           0xB0        // 命令寄存器 0x7E 清空 FIFO
+
+#define BMI160_FIFO_HEAD_MODE_MASK      0xC0
+#define BMI160_FIFO_HEAD_DATA           0x80
+#define BMI160_FIFO_HEAD_CONTROL        0x40
+#define BMI160_FIFO_HEAD_MAG            0x10
+#define BMI160_FIFO_HEAD_GYRO           0x08
+#define BMI160_FIFO_HEAD_ACCEL          0x04
+#define BMI160_FIFO_HEAD_SKIP           0x40
+#define BMI160_FIFO_HEAD_TIME           0x44
+#define BMI160_FIFO_HEAD_CONFIG         0x48
+#define BMI160_FIFO_HEAD_EMPTY          0x80
+
+#define BMI160_FIFO_SENSORTIME_US       39.0625     // sensortime 每个计数的时间
+
+// 样本中有效的数据
+#define BMI160_FIFO_SAMPLE_ACCEL        0x01
+#define BMI160_FIFO_SAMPLE_GYRO         0x02
+#define BMI160_FIFO_SAMPLE_MAG          0x04
+#define BMI160_FIFO_SAMPLE_TIME         0x08        // time 有效
+
+typedef struct
+{
+    int16_t accel[3];
+    int16_t gyro[3];
+    int16_t mag[3];         // BMM150 原始值, 与 bmi160_read_mag_xyz 相同
+    uint16_t rhall;
+    uint8_t valid;          // BMI160_FIFO_SAMPLE_*
+    uint32_t time;          // sensortime, 24位计数展开为32位
+}bmi160_fifo_sample_t;
+
+typedef struct
+{
+    bmi160_fifo_sample_t *buf;
+    uint16_t size;
+    uint16_t head;          // 下一个写入位置
+    uint16_t count;
+    uint16_t untimed;       // 最后一次 sensortime 之后的样本数
+    uint32_t frame_period;  // 帧间隔(sensortime 计数)
+    uint32_t time;          // 最后一次 sensortime
+    uint8_t time_valid;
+
+    uint32_t frames;        // 统计
+    uint32_t skipped;       // 传感器 FIFO 溢出丢掉的帧
+    uint32_t overruns;      // 样本缓冲满丢掉的样本
+    uint32_t errors;        // 无法解析的帧头
+}bmi160_fifo_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void bmi160_fifo_init(bmi160_fifo_t *fifo, bmi160_fifo_sample_t *buf, uint16_t size, uint32_t frame_period);
+void bmi160_fifo_reset(bmi160_fifo_t *fifo);
+uint16_t bmi160_fifo_frame_size(uint8_t head);
+uint16_t bmi160_fifo_decode(bmi160_fifo_t *fifo, const uint8_t *data, uint16_t len);
+uint16_t bmi160_fifo_available(const bmi160_fifo_t *fifo);
+uint16_t bmi160_fifo_read(bmi160_fifo_t *fifo, bmi160_fifo_sample_t *samples, uint16_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BMI160_FIFO_H_ */
@@ -27,6 +27,7 @@
 
 #include "variant.h"
 #include "lib_mqttclient.h"
+#include "ajson.h"
 #include "system_params.h"
 
 //publish
@@ -89,6 +90,7 @@
 #define INTOROBOT_MQTT_RECDEBUGQOS     0
 
 typedef void (*CB)(uint8_t*, uint32_t);
+typedef void (*CBS)(uint8_t*, uint32_t, uint32_t, uint32_t);    //chunk, length, offset, total
 
 typedef enum
 {
@@ -118,7 +120,7 @@ extern volatile uint8_t intorobot_cloud_connected_flag;
 #define SYSTEM_MODE(mode)  SystemClass SystemMode(mode);
 
 
-#define MAX_CALLBACK_NUM    32
+#define CALLBACK_INIT_NUM    8    //订阅回调表初始容量  满后按2倍扩容
 
 class WidgetBaseClass
 {
@@ -130,25 +132,32 @@ public:
 struct _callbacknode
 {
     void (*callback)(uint8_t*, uint32_t);
+    void (*streamcallback)(uint8_t*, uint32_t, uint32_t, uint32_t);
+    WidgetBaseClass *pWidgetBase;
     uint8_t qos;
+    uint8_t wildcard;           //topic 含 + 或 # 通配符
     const char *topic;
     const char *device_id;
+    char *fulltopic;            //v1/<device_id>/<topic>  订阅时生成
+    uint32_t hash;              //fulltopic 的hash
+    int next;                   //同一hash桶中的下一个节点  -1结束
 };
 
-struct _wcallbacknode
+//一条消息匹配到的订阅回调
+struct _subcallback
 {
+    void (*callback)(uint8_t*, uint32_t);
+    void (*streamcallback)(uint8_t*, uint32_t, uint32_t, uint32_t);
     WidgetBaseClass *pWidgetBase;
-    uint8_t qos;
-    const char *topic;
-    const char *device_id;
 };
 
 struct _callbacklist
 {
-    struct _callbacknode callbacknode[MAX_CALLBACK_NUM];
-    struct _wcallbacknode wcallbacknode[MAX_CALLBACK_NUM];
+    struct _callbacknode *callbacknode;
+    int *bucket;                //hash桶  个数等于capacity
+    int capacity;               //2的幂
     int total_callbacks;
-    int total_wcallbacks;
+    int total_wildcards;
 };
 
 
@@ -182,9 +191,13 @@ class IntorobotClass: public Print
 
         TcpClient mqtttcpclient;
         MqttClientClass ApiMqttClient;
+        char mqtt_topic_prefix[64];     //v1/<device_id>/  连接平台时生成
 
         void sendDebug(void);
+        void fill_mqtt_prefix(void);
         void fill_mqtt_topic(String &fulltopic, const char *topic, const char *device_id);
+        uint8_t publish_integer(const char *topic, unsigned long value, bool negative);
+        uint8_t publish_double(const char *topic, double value);
 
         virtual size_t write(uint8_t byte);
         using Print::write; // pull in write(str) and write(buf, size) from Print
@@ -210,10 +223,15 @@ class IntorobotClass: public Print
         uint8_t publish(const char* topic, uint8_t* payload, unsigned int plength);
         uint8_t publish(const char* topic, uint8_t* payload, unsigned int plength, uint8_t retained);
         uint8_t publish(const char* topic, uint8_t* payload, unsigned int plength, uint8_t qos, uint8_t retained);
+        uint8_t publishStream(const char* topic, uint32_t plength, mqtt_payload_reader_t reader, void *arg, uint8_t retained);
+        uint8_t publish(const char* topic, aJsonWriterCallback writer, void *arg);
+        uint8_t publish(const char* topic, aJsonWriterCallback writer, void *arg, uint8_t qos, uint8_t retained);
         uint8_t subscribe(const char* topic, const char *device_id, void (*callback)(uint8_t*, uint32_t));
         uint8_t subscribe(const char* topic, const char *device_id, void (*callback)(uint8_t*, uint32_t), uint8_t qos);
         uint8_t subscribe(const char* topic, const char *device_id, WidgetBaseClass *pWidgetBase);
         uint8_t subscribe(const char* topic, const char *device_id, WidgetBaseClass *pWidgetBase, uint8_t qos);
+        uint8_t subscribe(const char* topic, const char *device_id, void (*callback)(uint8_t*, uint32_t, uint32_t, uint32_t));
+        uint8_t subscribe(const char* topic, const char *device_id, void (*callback)(uint8_t*, uint32_t, uint32_t, uint32_t), uint8_t qos);
         uint8_t unsubscribe(const char *topic, const char *device_id);
         int deviceInfo(char *product_id, char *device_id, char *access_token, char *device_sn);
         void syncTime(void);
@@ -234,14 +252,15 @@ extern "C" {
 String clientId(void);
 String deviceSn(void);
 //subscribe topic info
-CB getsubcallback(char * fulltopic);
-WidgetBaseClass *getsubwcallback(char * fulltopic);
+int getsubcallback(char * fulltopic, struct _subcallback **ppSubCallBack);
 void addsubcallback(char *topic, char *device_id, void (*callback)(uint8_t*, uint32_t), uint8_t qos);
 void addsubwcallback(char *topic, char *device_id, WidgetBaseClass *pWidgetBase, uint8_t qos);
+void addsubscallback(char *topic, char *device_id, void (*callback)(uint8_t*, uint32_t, uint32_t, uint32_t), uint8_t qos);
 void delsubcallback(char * topic, char *device_id);
 void resubscribe(void);
 
 void apiMqttClientCallBack(char *topic, uint8_t *payload, uint32_t length);
+void apiMqttClientStreamCallBack(char *topic, uint8_t *chunk, uint32_t length, uint32_t offset, uint32_t total);
 void syncTimeCallback(unsigned char * payload, uint32_t len);
 void stm32FwUpdateCallback(unsigned char * payload, uint32_t len);
 void openwrtFwUpdateCallback(unsigned char * payload, uint32_t len);
@@ -3,20 +3,43 @@
 
 #include<stdint.h>
 
-typedef struct 
+/*
+  环形缓冲  大小为2的幂  读写位置为自由增长的计数 (p_w-p_r 即可读长度)
+  单生产者/单消费者无锁: p_w 只由写入方修改, p_r 只由读取方修改
+  可以在串口中断(写)和过滤任务(读)之间直接使用, 多个写入方或读取方时需要调用者加锁
+  满时不再覆盖旧数据, 丢弃的新数据计入 overflow
+  (DMA 直接写入时无法阻止覆盖, 由 fifo__sync 计入 overflow, 读取方丢弃全部未读数据)
+*/
+typedef struct
 {
-  uint8_t *buf; //缓冲地址
-  int p_w;      //写位置
-  int p_r;      //读位置
-  int size;     //缓冲大小
+  uint8_t *buf;               //缓冲地址
+  volatile uint32_t p_w;      //写位置 (写入总长度)
+  volatile uint32_t p_r;      //读位置 (读取总长度)
+  int size;                   //缓冲大小
+  uint32_t mask;              //size-1
+  volatile uint32_t overflow; //满时丢弃的数据长度
 }fifo_t;
 
 int fifo__init(fifo_t *fifo,int size);
-void fifo__write(fifo_t *fifo,const uint8_t *p_dat,int len);
+int fifo__write(fifo_t *fifo,const uint8_t *p_dat,int len);
 int fifo__read(fifo_t *fifo,uint8_t *p_buf,int buf_size);
 int fifo__avaliable(fifo_t *fifo);
+int fifo__free(fifo_t *fifo);
 void fifo__deinit(fifo_t *fifo);
 
-#endif
+//读取方: 不拷贝直接访问可读数据
+int fifo__peek(fifo_t *fifo,uint8_t **p_dat);
+void fifo__consume(fifo_t *fifo,int len);
+void fifo__flush(fifo_t *fifo);
+
+//写入方: 不拷贝直接写入空闲空间
+int fifo__reserve(fifo_t *fifo,uint8_t **p_buf);
+void fifo__commit(fifo_t *fifo,int len);
+
+//外部写入者(DMA)直接写入buf时 由写入方提交到当前写位置
+int fifo__sync(fifo_t *fifo,uint32_t pos);
 
+uint32_t fifo__overflow(fifo_t *fifo);
+
+#endif
 
@@ -1,26 +1,22 @@
 #ifndef __LIB_MIC_HAL_H_
 #define __LIB_MIC_HAL_H_
 #include "stdint.h"
+#include "mic_pcm.h"
 //#include "application.h"
 /* Audio recording frequency in Hz */
-#define REC_FREQ                          8000
+#define REC_FREQ                          MIC_PCM_RATE
 
-/* PDM buffer input size */
-#define INTERNAL_BUFF_SIZE                64
-#define I2S_PDM_BUFF_SIZE                 64
+/* PDM buffer input size, DMA 循环缓冲为两倍, 半传输和传输完成各处理一半 */
+#define INTERNAL_BUFF_SIZE                MIC_PDM_HALF_WORDS
 
 /* PCM buffer output size */
-#define PCM_OUT_SIZE                      16
+#define PCM_OUT_SIZE                      MIC_PCM_BLOCK_SAMPLES
 
+/* PDM 滤波器增益 0-64 */
+#define MIC_GAIN                          64
 
-typedef struct mic_mems_s
-{
-   uint8_t *P_buf;
-   uint8_t status_buf;
-} mic_mems_t;
 
-
-void MicClass_Start_Hal(mic_mems_t *p);
-void MicClass_Stop_Hal();
+void MicClass_Start_Hal(mic_pcm_ring_t *ring);
+void MicClass_Stop_Hal(void);
 
 #endif
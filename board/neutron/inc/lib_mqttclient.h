@@ -55,6 +55,38 @@
 #define MQTTQOS0        (0 << 1)
 #define MQTTQOS1        (1 << 1)
 #define MQTTQOS2        (2 << 1)
+#define MQTTDUP         (1 << 3)
+
+// MQTT_MAX_INFLIGHT : qos1/qos2 publish waiting for acknowledgment
+#define MQTT_MAX_INFLIGHT 4
+
+// MQTT_RETRY_INTERVAL : retransmit interval of an unacknowledged message in milliseconds
+#define MQTT_RETRY_INTERVAL 10000
+
+// MQTT_MAX_RETRIES : retransmit times before the message is dropped
+#define MQTT_MAX_RETRIES 5
+
+// MQTT_PACKET_TIMEOUT : a started inbound packet must complete within this time in milliseconds
+#define MQTT_PACKET_TIMEOUT 5000
+
+// readPacket() parse state
+#define MQTT_RX_HEADER      0
+#define MQTT_RX_LENGTH      1   // remaining length
+#define MQTT_RX_BODY        2
+#define MQTT_RX_STREAM_HEAD 3   // topic and message id of a publish larger than buffer
+#define MQTT_RX_STREAM_DATA 4
+
+// in-flight message state
+#define MQTT_INFLIGHT_FREE          0
+#define MQTT_INFLIGHT_WAIT_PUBACK   1   // qos1 publish sent
+#define MQTT_INFLIGHT_WAIT_PUBREC   2   // qos2 publish sent
+#define MQTT_INFLIGHT_WAIT_PUBCOMP  3   // qos2 pubrel sent
+
+// inbound publish payload larger than the packet buffer, delivered in chunks
+typedef void (*mqtt_stream_callback_t)(char *topic, uint8_t *chunk, uint32_t length, uint32_t offset, uint32_t total);
+
+// payload producer of publishStream(): fill buf with up to size bytes from offset, return the bytes filled
+typedef int (*mqtt_payload_reader_t)(uint8_t *buf, uint16_t size, uint32_t offset, void *arg);
 
 /*
 class Stream
@@ -74,11 +106,53 @@ class Stream
 */
 
 
+typedef struct
+{
+    uint16_t msgId;
+    uint8_t state;                  // MQTT_INFLIGHT_xxx
+    uint8_t retries;
+    uint8_t header;                 // fixed header of the publish (qos/retain)
+    uint16_t length;                // variable header + payload length
+    unsigned long deadline;         // next retransmit time(millis)
+    uint8_t *packet;                // variable header + payload in the retransmit pool
+}mqtt_inflight_t;
+
+typedef struct
+{
+    uint32_t published;             // qos1/qos2 publish accepted
+    uint32_t acked;                 // puback/pubcomp received
+    uint32_t retransmitted;         // publish/pubrel sent again with dup
+    uint32_t dropped;               // given up after MQTT_MAX_RETRIES
+    uint32_t rejected;              // in-flight table full or packet too long
+}mqtt_session_stats_t;
+
 class MqttClientClass
 {
     private:
         uint8_t buffer[MQTT_MAX_PACKET_SIZE];
+        uint8_t rxBuffer[MQTT_MAX_PACKET_SIZE];     // inbound packet, kept across readPacket() calls
+        mqtt_inflight_t inflight[MQTT_MAX_INFLIGHT];
+        uint8_t inflightPool[MQTT_MAX_INFLIGHT][MQTT_MAX_PACKET_SIZE-5];
+        mqtt_session_stats_t stats;
         uint16_t nextMsgId;
+        mqtt_inflight_t *pendingInflight;   // publish started by beginPublish()
+        uint16_t pendingMsgId;
+        uint16_t pendingLength;             // 0: no pending publish
+        uint8_t pendingQos;
+        uint32_t streamRemaining;           // payload bytes left of the publish started by beginPublishStream()
+        mqtt_stream_callback_t streamCallback;
+        uint8_t rxState;                    // MQTT_RX_xxx, kept across readPacket() calls
+        uint8_t rxHeader;
+        uint8_t rxLengthLength;
+        uint16_t rxPos;                     // stream: bytes in the current chunk
+        uint16_t rxTopicLength;
+        uint16_t rxMsgId;
+        uint32_t rxMultiplier;
+        uint32_t rxLength;                  // remaining length
+        uint32_t rxCount;                   // remaining length bytes received
+        uint32_t rxOffset;                  // stream: payload bytes delivered
+        unsigned long rxDeadline;
+        unsigned long packetTimeout;
         unsigned long lastOutActivity;
         unsigned long lastInActivity;
         bool pingOutstanding;
@@ -89,11 +163,18 @@ class MqttClientClass
         TcpClient *_client;
         void (*callback)(char*, uint8_t*, uint32_t);
 
-        uint8_t readByte(void);
         uint16_t readPacket(uint8_t* lengthLength);
+        uint16_t readBody(uint8_t c);
         uint8_t write(uint8_t header, uint8_t* buf, uint16_t length);
+        uint8_t writeHeader(uint8_t header, uint8_t* buf, uint32_t length);
+        void readStreamPublish(uint8_t c);
         uint16_t writeString(const char* string, uint8_t* buf, uint16_t pos);
         uint8_t SendAckBag(uint16_t msgId, unsigned char bagtype);
+        void initInflight(void);
+        uint16_t getNextMsgId(void);
+        mqtt_inflight_t *findInflight(uint16_t msgId, uint8_t state);
+        void resendInflight(mqtt_inflight_t *pinflight);
+        void retryInflight(unsigned long t);
 
     public:
         MqttClientClass(void);
@@ -115,9 +196,21 @@ class MqttClientClass
         uint8_t publish(const char* topic, uint8_t* payload, unsigned int plength);
         uint8_t publish(const char* topic, uint8_t* payload, unsigned int plength, uint8_t retained);
         uint8_t publish(const char* topic, uint8_t* payload, unsigned int plength, uint8_t qos, uint8_t retained);
+        uint8_t *beginPublish(const char* prefix, const char* topic, uint8_t qos, uint16_t *room);
+        uint8_t endPublish(unsigned int plength, uint8_t retained);
+        void cancelPublish(void);
+        uint8_t beginPublishStream(const char* prefix, const char* topic, uint32_t plength, uint8_t retained);
+        size_t writePayload(const uint8_t* payload, size_t plength);
+        uint8_t endPublishStream(void);
+        uint8_t publishStream(const char* prefix, const char* topic, const uint8_t* payload, uint32_t plength, uint8_t retained);
+        uint8_t publishStream(const char* prefix, const char* topic, uint32_t plength, mqtt_payload_reader_t reader, void *arg, uint8_t retained);
+        void setStreamCallback(mqtt_stream_callback_t callback);
+        void setPacketTimeout(unsigned long timeout);
         uint8_t subscribe(const char* topic);
         uint8_t subscribe(const char* topic, uint8_t qos);
         uint8_t unsubscribe(const char* topic);
+        uint8_t inflightCount(void);
+        const mqtt_session_stats_t *sessionStats(void);
 };
 
 
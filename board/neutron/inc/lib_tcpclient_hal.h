@@ -10,6 +10,8 @@ int TcpClient_readn_hal(unsigned char *buff, int size,unsigned char tcp_handle);
 
 int TcpClient_available_hal(unsigned char handle);
 
+int TcpClient_lost_hal(unsigned char handle);
+
 int TcpClient_writen_hal(const unsigned char *p_dat,int len,unsigned char handle);
 
 
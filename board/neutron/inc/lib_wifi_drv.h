@@ -15,12 +15,20 @@ void mo_drv_wifi_set_cond_flag(char dat);
 
 int mo_drv_wifi_available_tcpc_fifo(unsigned char  fifo_num);
 
+int mo_drv_wifi_lost_tcpc_fifo(unsigned char fifo_num);
+
 int mo_drv_wifi_read_tcpc_fifo(char *p_buf,int len,unsigned char fifi_num);
 
 int mo_drv_wifi_set_default_mode();
 
 int mo_drv_wifi_run_cmd(char *cmd,char *ret_cmd,unsigned int time_out);
 
+typedef void (*mo_drv_wifi_tcpc_send_cb_t)(unsigned char fifo_num,int len,int result);
+int mo_drv_wifi_write_tcpc_tx(const char *p_buf,int len,unsigned char fifo_num);
+int mo_drv_wifi_pending_tcpc_tx(unsigned char fifo_num);
+int mo_drv_wifi_flush_tcpc_tx(unsigned char fifo_num,unsigned int timeout);
+void mo_drv_wifi_set_tcpc_send_cb(mo_drv_wifi_tcpc_send_cb_t send_cb);
+
 int mo_uart1_read(char *p_buf,int len,int timeout);
 
 int mo_uart1_write(const char *p_buf,int len);
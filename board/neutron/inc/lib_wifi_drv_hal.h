@@ -0,0 +1,22 @@
+#ifndef __LIB_WIFI_DRV_HAL_H
+#define __LIB_WIFI_DRV_HAL_H
+
+//esp8266 复位 (boot脚拉高后拉低复位脚)
+void mo_drv_wifi_reset_hardware();
+
+//esp8266 串口初始化 (接收fifo 信号量)
+void mo_uart1_init();
+
+int mo_uart1_read(char *p_buf,int len,int timeout);
+
+//不拷贝读取: 返回接收fifo中连续的数据长度, 处理完后调用mo_uart1_consume释放
+int mo_uart1_peek(char **p_dat,int timeout);
+void mo_uart1_consume(int len);
+
+//上次调用之后接收缓冲溢出(DMA覆盖未读数据)的长度  非0时未读数据已被丢弃
+int mo_uart1_overrun(void);
+
+int mo_uart1_write(const char *p_buf,int len);
+
+
+#endif
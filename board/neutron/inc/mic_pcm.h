@@ -0,0 +1,89 @@
+/**
+ ******************************************************************************
+ * @file     : mic_pcm.h
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : 麦克风 PDM->PCM 数据块环形缓冲, 音量和频带能量
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+#ifndef MIC_PCM_H_
+#define MIC_PCM_H_
+
+#include <stdint.h>
+
+/*
+  I2S 以 1.024MHz 采集 PDM 位流, DMA 半传输和传输完成中断各处理 1ms:
+      MIC_PDM_HALF_WORDS 个半字(1024位) -> 抽取64倍 -> MIC_PCM_BLOCK_SAMPLES 个 16kHz PCM 样本
+  单生产者(DMA中断) 单消费者(任务) 无锁环形缓冲:
+      head 只由生产者写, tail 只由消费者写, 满时丢掉新数据块并计数
+  音量每 MIC_PCM_LEVEL_BLOCKS 个数据块统计一次, 用序号发布, 与是否读取数据无关
+*/
+
+#define MIC_PCM_RATE                16000       // PCM 采样率
+#define MIC_PDM_HALF_WORDS          64          // 每个数据块的 PDM 半字数
+#define MIC_PCM_BLOCK_SAMPLES       16          // 每个数据块的 PCM 样本数, 1ms
+#define MIC_PCM_BLOCKS              64          // 环形缓冲数据块数, 2的幂
+#define MIC_PCM_LEVEL_BLOCKS        32          // 音量统计窗口, 32ms
+
+#define MIC_PCM_FFT_SIZE            256         // 频带能量的 FFT 点数, 16ms
+#define MIC_PCM_BANDS               7           // 倍频程频带 62.5Hz-8kHz
+
+// 抽取函数, pdm 为 MIC_PDM_HALF_WORDS 个半字, 输出 MIC_PCM_BLOCK_SAMPLES 个样本
+typedef void (*mic_pcm_decimate_t)(void *arg, uint16_t *pdm, int16_t *pcm);
+
+typedef struct
+{
+    float rms;                  // 满量程为 1.0
+    float peak;                 // 满量程为 1.0
+}mic_pcm_level_t;
+
+typedef struct
+{
+    int16_t blocks[MIC_PCM_BLOCKS][MIC_PCM_BLOCK_SAMPLES];
+    int16_t scratch[MIC_PCM_BLOCK_SAMPLES];     // 缓冲满时抽取到这里, 保持滤波器连续
+    volatile uint32_t head;     // 已写入的数据块数, 生产者
+    volatile uint32_t tail;     // 已读出的数据块数, 消费者
+    uint16_t offset;            // tail 数据块中已读出的样本数, 消费者
+
+    float level_sum;            // 生产者统计中的音量窗口
+    uint16_t level_peak;
+    uint16_t level_count;
+    volatile uint32_t level_seq;    // 奇数表示正在更新
+    volatile mic_pcm_level_t level;
+
+    volatile uint32_t overruns; // 缓冲满丢掉的数据块
+}mic_pcm_ring_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void mic_pcm_init(mic_pcm_ring_t *ring);
+void mic_pcm_input(mic_pcm_ring_t *ring, uint16_t *pdm, mic_pcm_decimate_t decimate, void *arg);
+uint16_t mic_pcm_available(const mic_pcm_ring_t *ring);
+uint16_t mic_pcm_read(mic_pcm_ring_t *ring, int16_t *pcm, uint16_t count);
+void mic_pcm_flush(mic_pcm_ring_t *ring);
+void mic_pcm_get_level(const mic_pcm_ring_t *ring, mic_pcm_level_t *level);
+void mic_pcm_band_energy(const int16_t *pcm, float bands[MIC_PCM_BANDS]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MIC_PCM_H_ */
@@ -31,8 +31,10 @@ extern "C"
 {
 #include "bmi160.h"
 #include "bmi160_support.h"
+#include "bmi160_fifo.h"
 }
 #include "BMP280.h"
+#include "sensor_fusion.h"
 #include "lib_mic_hal.h"
 
 #include "wiring_i2c.h"
@@ -52,15 +54,26 @@ extern struct bmi160_t s_bmi160;
 #define	BMI160_MAG_INTERFACE_ON_PRIMARY_ON		(0x02)
 signed char BMI160_I2C_bus_read(unsigned char device_addr, unsigned char reg_addr,unsigned char *reg_data, unsigned char cnt);
 signed char BMI160_I2C_bus_write(unsigned char device_addr, unsigned char reg_addr,unsigned char *reg_data, unsigned char cnt);
+signed char BMI160_I2C_burst_read(unsigned char device_addr, unsigned char reg_addr, unsigned char *reg_data, uint32_t cnt);
 void BMI160_delay_msec(BMI160_MDELAY_DATA_TYPE msec); //delay in milliseconds
 
 
+#define BMI160_FIFO_SAMPLES         64          // 样本缓冲
+#define BMI160_FIFO_BURST           256         // 一次连续读取的字节数
+#define BMI160_FIFO_WATERMARK       16          // 默认水位(帧)
+
 // BMI160 accelerometer and gyroscope
 class BMI160Sensor
 {
     private:
         bool isEnabledFlag;
 
+        // FIFO 批量采集
+        bool fifoEnabled;
+        bmi160_fifo_t fifo;
+        bmi160_fifo_sample_t fifoSamples[BMI160_FIFO_SAMPLES];
+        uint8_t fifoBuffer[BMI160_FIFO_BURST];
+
     public:
         BMI160Sensor();
         bool isEnabled(void);
@@ -70,6 +83,15 @@ class BMI160Sensor
         void getMagData(int16_t mag[3]);// BMM150 magnetormeter
         void getAccelGyroData(int16_t accel[3], int16_t gyro[3]);
         void getAccelGyroMagData(int16_t accel[3], int16_t gyro[3], int16_t mag[3]);
+
+        // FIFO 批量采集, sensors 为 BMI160_FIFO_SAMPLE_ACCEL/GYRO/MAG 的组合, watermark 单位为帧
+        bool beginFifo(uint16_t rate = 100, uint8_t sensors = BMI160_FIFO_SAMPLE_ACCEL | BMI160_FIFO_SAMPLE_GYRO, uint16_t watermark = BMI160_FIFO_WATERMARK);
+        void endFifo(void);
+        // 到达水位(或 force)时读空传感器 FIFO, 返回新的样本数
+        uint16_t pollFifo(bool force = false);
+        uint16_t availableFifo(void);
+        uint16_t readFifo(bmi160_fifo_sample_t *samples, uint16_t count);
+        const bmi160_fifo_t &getFifoStatus(void);
 };
 
 
@@ -110,24 +132,49 @@ class LightSensor
 class MICSensor
 {
     private:
-        mic_mems_t mic_mems;
+        mic_pcm_ring_t micRing;
         bool isEnabledFlag;
 
     public:
         MICSensor();
         bool isEnabled(void);
         void begin(void);
+        void end(void);
+
+        // 16kHz PCM 数据流, 读出之后从缓冲中移除
+        uint16_t available(void);
+        uint16_t read(int16_t *pcm, uint16_t count);
+        void flush(void);
+        uint32_t getOverruns(void);
+
+        // 最近 MIC_PCM_LEVEL_BLOCKS ms 的音量, 满量程为 1.0, 不影响数据流
+        void getLevel(float& rms, float& peak);
+        // 从数据流中读出 MIC_PCM_FFT_SIZE 个样本计算倍频程频带能量
+        bool getBandEnergy(float bands[MIC_PCM_BANDS]);
+
+        // 兼容之前的接口, 取出缓冲中所有样本, 输出高8位
         void getMICData(char& micData);
         void getMICDataToUSBSerial(USBSerial& serialusb);
         void getMICDataToSerial(USARTSerial& serial);
 };
 
 
+#define BMI160_ACCEL_LSB_PER_G      2048        // 16g 量程
+#define BMI160_ACCEL_RANGE          16.0f
+#define BMI160_GYRO_RANGE           2000.0f     // dps
+
 class NeutronSensors
 {
     private:
         bool isEnabledFlag;
 
+        // 姿态融合
+        fusion_t fusion;
+        bool fusionEnabled;
+        bool fusionUseMag;
+        bool fusionMagValid;
+        int16_t fusionMag[3];
+
 
     public:
         NeutronSensors();
@@ -140,6 +187,21 @@ class NeutronSensors
         void getMagData(int16_t mag[3]);
         void getAccelGyroData(int16_t accel[3], int16_t gyro[3]);
         void getAccelGyroMagData(int16_t accel[3], int16_t gyro[3], int16_t mag[3]);
+        bool beginFifo(uint16_t rate = 100, uint8_t sensors = BMI160_FIFO_SAMPLE_ACCEL | BMI160_FIFO_SAMPLE_GYRO, uint16_t watermark = BMI160_FIFO_WATERMARK);
+        void endFifo(void);
+        uint16_t pollFifo(bool force = false);
+        uint16_t availableFifo(void);
+        uint16_t readFifo(bmi160_fifo_sample_t *samples, uint16_t count);
+
+        // 姿态融合, 由 FIFO 样本驱动, 每个样本更新一次
+        bool beginFusion(uint16_t rate = 100, bool useMag = false, fusion_algorithm_t algorithm = FUSION_MADGWICK);
+        void endFusion(void);
+        uint16_t updateFusion(void);
+        void setFusionCalibration(const fusion_calibration_t &cal);
+        bool calibrateFusion(uint16_t samples = 200);
+        void getQuaternion(float q[4]);
+        void getEulerAngles(float euler[3]);
+        void getLinearAccel(float accel[3]);
 
         // BMP280 sensor
         void getPressureAltitudeData(double& pressure, double& altitude);
@@ -148,6 +210,10 @@ class NeutronSensors
         void getLightData(uint16_t& lightData);
 
         // Mic sensor
+        uint16_t availableMIC(void);
+        uint16_t readMIC(int16_t *pcm, uint16_t count);
+        void getMICLevel(float& rms, float& peak);
+        bool getMICBandEnergy(float bands[MIC_PCM_BANDS]);
         void getMICData(char& micData);
         void getMICDataToUSBSerial(USBSerial& serialusb);
         void getMICDataToSerial(USARTSerial& serial);
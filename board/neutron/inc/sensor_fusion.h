@@ -0,0 +1,90 @@
+/**
+ ******************************************************************************
+ * @file     : sensor_fusion.h
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : 6/9轴姿态融合, Madgwick 和 Mahony 滤波
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+#ifndef SENSOR_FUSION_H_
+#define SENSOR_FUSION_H_
+
+#include <stdint.h>
+
+/*
+  输入为传感器原始值(int16), 先减去校准偏移再换算:
+      加速度 g, 陀螺仪 rad/s, 磁力计只用方向, 单位不影响
+  固定步长, 每个样本更新一次, 步长为 1/ODR
+  四元数 q = w + xi + yj + zk, 表示传感器坐标系相对于地面坐标系(z向上)的姿态
+  磁力计的坐标轴需要与加速度计一致, 不一致时用 mag_scale 的符号调整
+*/
+
+#define FUSION_MADGWICK_BETA        0.1f        // Madgwick 增益
+#define FUSION_MAHONY_KP            1.0f        // Mahony 比例增益
+#define FUSION_MAHONY_KI            0.0f        // Mahony 积分增益, 0 不估计陀螺仪零偏
+
+typedef enum
+{
+    FUSION_MADGWICK = 0,
+    FUSION_MAHONY
+}fusion_algorithm_t;
+
+typedef struct
+{
+    float accel_offset[3];      // 原始值
+    float gyro_offset[3];       // 原始值
+    float mag_offset[3];        // 原始值, 硬磁
+    float mag_scale[3];         // 软磁, 各轴比例
+}fusion_calibration_t;
+
+typedef struct
+{
+    fusion_algorithm_t algorithm;
+    float beta;
+    float kp;
+    float ki;
+    float sample_period;        // s
+    float accel_scale;          // 原始值 -> g
+    float gyro_scale;           // 原始值 -> rad/s
+    fusion_calibration_t cal;
+
+    float q[4];                 // w x y z
+    float integral[3];          // Mahony 积分项
+    float gravity[3];           // 传感器坐标系中的重力方向
+    float linear_accel[3];      // 去掉重力的加速度, g
+    uint32_t updates;
+}fusion_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void fusion_init(fusion_t *fusion, fusion_algorithm_t algorithm, float odr, float accel_range_g, float gyro_range_dps);
+void fusion_reset(fusion_t *fusion);
+void fusion_set_calibration(fusion_t *fusion, const fusion_calibration_t *cal);
+void fusion_update(fusion_t *fusion, const int16_t accel[3], const int16_t gyro[3], const int16_t *mag);
+void fusion_get_quaternion(const fusion_t *fusion, float q[4]);
+void fusion_get_euler(const fusion_t *fusion, float euler[3]);
+void fusion_get_linear_accel(const fusion_t *fusion, float accel[3]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SENSOR_FUSION_H_ */
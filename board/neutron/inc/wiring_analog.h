@@ -28,6 +28,10 @@
 
 #include "variant.h"
 
+#define ADC_SCAN_CHANNEL_MAX    9           // A0-A7 PO188
+#define ADC_SCAN_FRAMES         64          // 扫描缓冲帧数
+#define ADC_SCAN_RATE_MAX       20000       // 每秒最多帧数, 9通道每帧约26us
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,6 +41,14 @@ int32_t analogRead(uint16_t pin);
 void analogWrite(uint16_t pin, uint8_t value);
 void analogWriteAndSetF(uint16_t pin, uint8_t value,uint32_t fre);
 
+bool analogScanBegin(const uint16_t *pins, uint8_t count, uint32_t rate);
+void analogScanEnd(void);
+int32_t analogScanRead(uint16_t pin);
+uint32_t analogScanAvailable(void);
+uint32_t analogScanGetFrames(const volatile uint16_t **frames);
+void analogScanReleaseFrames(uint32_t count);
+uint32_t analogScanOverruns(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -106,6 +106,7 @@ typedef enum
 uint16_t EEPROM_Init(void);
 uint16_t EEPROM_ReadVariable(uint16_t EepromAddress, uint16_t *EepromData);
 uint16_t EEPROM_WriteVariable(uint16_t EepromAddress, uint16_t EepromData);
+uint16_t EEPROM_WriteBlock(uint16_t EepromAddress, const uint8_t *EepromData, uint16_t Length);
 
 /* Arduino Compatibility Class -----------------------------------------------*/
 class EEPROMClass
@@ -113,8 +114,22 @@ class EEPROMClass
     public:
         EEPROMClass();
         uint8_t read(int);
+        int read(int address, uint8_t *buf, int length);
         void write(int, uint8_t);
+        int write(int address, const uint8_t *buf, int length);
         void write_system(int, uint8_t);
+
+        //整个结构体一次读写, 例如 EEPROM.put(0, config); 只写入改变的字节
+        template <typename T> T &get(int address, T &t)
+        {
+            read(address, (uint8_t *)&t, sizeof(T));
+            return t;
+        }
+        template <typename T> const T &put(int address, const T &t)
+        {
+            write(address, (const uint8_t *)&t, sizeof(T));
+            return t;
+        }
 };
 
 extern EEPROMClass EEPROM;
@@ -0,0 +1,25 @@
+#ifndef   WIRING_EEPROM_HAL_H_
+#define   WIRING_EEPROM_HAL_H_
+
+#include <stdint.h>
+
+/*
+  EEPROM 模拟使用的两个flash页(PAGE0/PAGE1)的底层操作, offset 为页内偏移
+  写入只能把1写成0, 擦除后整页为0xFF
+  成功返回0
+*/
+
+void EEPROM_FlashUnlock_hal(void);
+
+uint32_t EEPROM_FlashRead_hal(uint16_t page, uint32_t offset);
+
+int EEPROM_FlashProgramHalfWord_hal(uint16_t page, uint32_t offset, uint16_t data);
+
+int EEPROM_FlashProgramWord_hal(uint16_t page, uint32_t offset, uint32_t data);
+
+int EEPROM_FlashErase_hal(uint16_t page);
+
+//启动以来的写入(半字/字)次数和擦除次数
+void EEPROM_FlashStatistics_hal(uint32_t *programs, uint32_t *erases);
+
+#endif
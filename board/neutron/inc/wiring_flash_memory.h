@@ -46,6 +46,8 @@
 
 void SystemReadArgument(uint32_t readStartAddress, uint16_t *dataBuffer, uint32_t size);
 int SystemWriteArgument(uint32_t writeStartAddress, uint16_t *dataBuffer, uint32_t size);
+int SystemProgramArgument(uint32_t writeStartAddress, uint16_t *dataBuffer, uint32_t size);
+void SystemArgumentStatistics(uint32_t *programs, uint32_t *erases);
 
 
 #ifdef __cplusplus
@@ -36,6 +36,42 @@
 #define CLOCK_SPEED_100KHZ (uint32_t)100000
 #define CLOCK_SPEED_400KHZ (uint32_t)400000
 
+#define I2C_QUEUE_LENGTH        8           // 最多排队的传输
+#define I2C_TIMEOUT_BASE        10          // 传输超时(ms), 另加每8字节1ms
+
+// 传输结果, 与 endTransmission 的返回值相同
+#define I2C_STATUS_OK           0
+#define I2C_STATUS_TOO_LONG     1           // 数据超过缓冲
+#define I2C_STATUS_NACK         2           // 地址或数据没有应答
+#define I2C_STATUS_ERROR        4           // 总线错误/仲裁丢失, 已复位总线
+#define I2C_STATUS_TIMEOUT      5           // 超时, 已复位总线
+#define I2C_STATUS_PENDING      0xFF        // 排队或正在传输
+
+// 传输完成回调, 在中断中调用
+typedef void (*I2CCallback)(void *arg, uint8_t status);
+
+/*
+  一次传输: START 地址+写 [reg] [txData] [重复START 地址+读 rxData] STOP
+  regLength/txLength/rxLength 都可以为0, 只有 rxLength 时直接读
+  完成之前结构体和缓冲必须保持有效, status 为 I2C_STATUS_PENDING
+*/
+struct I2CTransaction
+{
+    uint8_t address;            // 7位地址
+    uint8_t reg;                // 寄存器地址, 在 txData 之前发送
+    uint8_t regLength;          // 0 或 1
+    const uint8_t *txData;
+    uint16_t txLength;
+    uint8_t *rxData;
+    uint16_t rxLength;
+    I2CCallback callback;       // 可以为NULL
+    void *arg;
+
+    volatile uint8_t status;
+    void * volatile task;       // 等待完成的任务
+    uint32_t time;              // 开始时间
+};
+
 /* typedef struct I2C_Ring_Buffer */
 /* { */
 /*         unsigned char buffer[I2C_BUFFER_SIZE]; */
@@ -101,6 +137,37 @@ class TwoWire : public Stream
 
         uint8_t transmitting;
 
+        // endTransmission(false) 的数据, 与下一次 requestFrom 合并为重复起始的一次传输
+        uint8_t pendingAddress;
+        uint8_t pendingBuffer[I2C_BUFFER_LENGTH];
+        uint8_t pendingLength;
+        bool pendingWrite;
+
+        // 传输队列, 由中断推进
+        I2CTransaction *queue[I2C_QUEUE_LENGTH];
+        volatile uint8_t queueHead;
+        volatile uint8_t queueCount;
+        enum
+        {
+            XFER_IDLE = 0,
+            XFER_START_WRITE,       // 等待 SB, 之后发送地址+写
+            XFER_WRITE,             // 发送 reg/txData
+            XFER_START_READ,        // 等待 SB, 之后发送地址+读
+            XFER_READ,              // DMA 或 RXNE 接收
+            XFER_RECOVER            // 超时, 任务中复位总线, 中断不再推进
+        };
+        volatile uint8_t xferState;
+        uint16_t xferIndex;
+        DMA_HandleTypeDef hdmaRx;
+
+        uint8_t flushPending(void);
+        void startNext(void);
+        void complete(uint8_t status);
+        void checkTimeout(void);
+        void recoverBus(void);
+        uint32_t lock(void);
+        void unlock(uint32_t primask);
+
         // Callback user functions
         void (*user_onRequest)(void);
         void (*user_onReceive)(int);
@@ -118,6 +185,8 @@ class TwoWire : public Stream
         void beginTransmission(uint8_t);
         void beginTransmission(int);
         uint8_t endTransmission(void);
+        // sendStop 为 false 时不访问总线, 返回 I2C_STATUS_OK(之前保留的数据发送失败时返回其状态),
+        // 地址没有应答在随后的 requestFrom 返回 0 时才知道
         uint8_t endTransmission(uint8_t);
         uint8_t requestFrom(uint8_t, uint8_t);
         uint8_t requestFrom(uint8_t, uint8_t, uint8_t);
@@ -139,8 +208,32 @@ class TwoWire : public Stream
         using Print::write;
 
         bool isEnabled(void);
+
+        // 异步传输, 队列满返回false
+        bool submit(I2CTransaction &transaction);
+        // 等待传输完成, 任务中阻塞等待通知, 返回 I2C_STATUS_*
+        uint8_t wait(I2CTransaction &transaction);
+        uint8_t transfer(I2CTransaction &transaction);
+        // 寄存器连续读写, 读为 写reg + 重复起始 + 读
+        uint8_t readRegisters(uint8_t address, uint8_t reg, uint8_t *data, uint16_t length);
+        uint8_t writeRegisters(uint8_t address, uint8_t reg, const uint8_t *data, uint16_t length);
+        // 检查超时, 只使用回调时需要定期调用
+        void poll(void);
+
+        void eventInterruptHandler(void);
+        void errorInterruptHandler(void);
+        void dmaInterruptHandler(void);
+        static void dmaRxComplete(DMA_HandleTypeDef *hdma);
 };
 
+extern "C" {
+
+void Wiring_I2C1_EV_Interrupt_Handler(void);
+void Wiring_I2C1_ER_Interrupt_Handler(void);
+void Wiring_I2C1_DMA_RX_Interrupt_Handler(void);
+
+}
+
 /* #if I2C_INTERFACES_COUNT > 0 */
 extern TwoWire Wire;
 /* #endif */
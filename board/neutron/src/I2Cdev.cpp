@@ -138,26 +138,10 @@ int8_t I2Cdev::readWord(uint8_t devAddr, uint8_t regAddr, uint16_t *data, uint16
 int8_t I2Cdev::readBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_t *data, uint16_t timeout)
 {
 
-    uint8_t count = 0;
-
-    Wire.beginTransmission(devAddr); // ID
-
-    Wire.write(regAddr); // 寄存器地址
-
-    Wire.endTransmission(0); // 不发送停止位 但是发送 ID 和寄存器地址
-
-    Wire.beginTransmission(devAddr);
-
-    Wire.requestFrom(devAddr, length);
-
-    if(!Wire.available()) return 0;
-
-    for(count = 0; count < length; count++)
-    {
-        data[count] = Wire.read();
-    }
+    // 发送 ID 和寄存器地址, 重复起始后读取, 不经过 Wire 的接收缓冲
+    if(Wire.readRegisters(devAddr, regAddr, data, length) != I2C_STATUS_OK) return 0;
 
-    return count;
+    return length;
 }
 
 /** Read multiple words from a 16-bit device register.
@@ -322,16 +306,7 @@ bool I2Cdev::writeBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_
 {
     uint8_t error;
 
-    Wire.beginTransmission(devAddr);
-
-    Wire.write((uint8_t) regAddr); // send address
-
-    for (uint8_t i = 0; i < length; i++)
-    {
-        Wire.write((uint8_t) data[i]);
-    }
-
-    error = Wire.endTransmission();
+    error = Wire.writeRegisters(devAddr, regAddr, data, length);
 
     if(error == 0)  return true;
     else  return false;
@@ -27,10 +27,12 @@
  * Includes
  ******************************************************************************/
 
+#include <stdio.h>
 #include <string.h>
 #include <math.h>
 #include <stdlib.h>
 #include <float.h>
+#include <limits.h>
 #include <ctype.h>
 #include "stringbuffer.h"
 #include "ajson.h"
@@ -47,6 +49,257 @@
 //how much digits after . for float
 #define FLOAT_PRECISION 5
 
+//longest number text the generic (non string) stream path collects
+#define NUMBER_BUFFER_SIZE 64
+
+//word at a time string scan: a byte equal to zero / less than n in a 32 bit word
+#define WORD_HAS_ZERO(w) (((w) - 0x01010101UL) & ~(w) & 0x80808080UL)
+#define WORD_HAS_LESS(w, n) (((w) - 0x01010101UL * (n)) & ~(w) & 0x80808080UL)
+
+//1e0 ~ 1e22 are exact doubles
+static const double ajsonPow10[] =
+{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int ajsonHex(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// utf-8 of a \uXXXX code, returns the byte count (1~3)
+static int ajsonUtf8(unsigned int code, char *out)
+{
+    if (code < 0x80)
+    {
+        out[0] = (char)code;
+        return 1;
+    }
+    if (code < 0x800)
+    {
+        out[0] = (char)(0xC0 | (code >> 6));
+        out[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    }
+    out[0] = (char)(0xE0 | (code >> 12));
+    out[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+    out[2] = (char)(0x80 | (code & 0x3F));
+    return 3;
+}
+
+/*********************************************************************************
+  *Function	      :   static const char *ajsonStringRun(const char *p, const char *end)
+  *Description	:   skip the plain characters of a string
+  *Input		      :   p: inside a string   end: end of the text, *end is 0
+  *Output		:
+  *Return		:   the first '\"', '\\' or control character, end if none
+  *author		:   robot
+  *date		      :   2016-05-20
+  *Others		:   tests 4 bytes per loop, words never reach past end
+**********************************************************************************/
+static const char *ajsonStringRun(const char *p, const char *end)
+{
+    while (end - p >= 4)
+    {
+        uint32_t w;
+        memcpy(&w, p, 4);
+        if (WORD_HAS_ZERO(w ^ 0x22222222UL) | WORD_HAS_ZERO(w ^ 0x5C5C5C5CUL) | WORD_HAS_LESS(w, 0x20))
+        {
+            break;
+        }
+        p += 4;
+    }
+    while (p < end && *p != '\"' && *p != '\\' && (unsigned char)*p >= 32)
+    {
+        p++;
+    }
+    return p;
+}
+
+/*********************************************************************************
+  *Function	      :   static char *ajsonUnescape(char *dst, const char *src, const char *end)
+  *Description	:   copy the string body src~end to dst, replacing the escapes
+  *Input		      :   dst may be src (in place): the result never grows, "\uXXXX" becomes at most 3 bytes
+  *Output		:   dst: terminated with 0
+  *Return		:   the terminator in dst, NULL if a \u escape is malformed
+  *author		:   robot
+  *date		      :   2016-05-20
+  *Others		:   unknown escapes are skipped (as aJsonStream::parseString always did)
+**********************************************************************************/
+static char *ajsonUnescape(char *dst, const char *src, const char *end)
+{
+    while (src < end)
+    {
+        if (*src != '\\')
+        {
+            *dst++ = *src++;
+            continue;
+        }
+        src++;
+        if (src >= end)
+        {
+            return NULL;
+        }
+        switch (*src++)
+        {
+            case '\\': *dst++ = '\\'; break;
+            case '\"': *dst++ = '\"'; break;
+            case '/':  *dst++ = '/';  break;
+            case 'b':  *dst++ = '\b'; break;
+            case 'f':  *dst++ = '\f'; break;
+            case 'n':  *dst++ = '\n'; break;
+            case 'r':  *dst++ = '\r'; break;
+            case 't':  *dst++ = '\t'; break;
+            case 'u':
+            {
+                unsigned int code = 0;
+                for (int i = 0; i < 4; i++)
+                {
+                    int h = (src < end) ? ajsonHex(*src) : -1;
+                    if (h < 0)
+                    {
+                        return NULL;
+                    }
+                    code = (code << 4) | h;
+                    src++;
+                }
+                dst += ajsonUtf8(code, dst);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    *dst = 0;
+    return dst;
+}
+
+/*********************************************************************************
+  *Function	      :   static const char *ajsonScanNumber(const char *p, aJsonObject *item)
+  *Description	:   convert the number at p
+  *Input		      :   p: '-' or a digit, the text is terminated with 0
+  *Output		:   item: aJson_Int, aJson_Long if outside the int range, else aJson_Float
+  *Return		:   the character after the number, NULL if malformed
+  *author		:   robot
+  *date		      :   2016-05-20
+  *Others		:   up to 19 significant digits are kept in 64 bits. a mantissa below 2^53 with an
+                          exponent within +-22 is exact with one multiply/divide by ajsonPow10 (the result of
+                          one correctly rounded operation on exact operands); anything else goes to strtod
+**********************************************************************************/
+static const char *ajsonScanNumber(const char *p, aJsonObject *item)
+{
+    const char *start = p;
+    uint64_t mantissa = 0;
+    int digits = 0;             //significant digits in mantissa
+    int scale = 0;              //decimal exponent of mantissa
+    int exponent = 0;
+    bool negative = false, integer = true;
+
+    if (*p == '-')
+    {
+        negative = true;
+        p++;
+    }
+    if (*p < '0' || *p > '9')
+    {
+        return NULL;
+    }
+    while (*p >= '0' && *p <= '9')
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += (mantissa != 0);
+        }
+        else
+        {
+            scale++;
+        }
+        p++;
+    }
+    if (*p == '.')
+    {
+        integer = false;
+        p++;
+        if (*p < '0' || *p > '9')
+        {
+            return NULL;
+        }
+        while (*p >= '0' && *p <= '9')
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += (mantissa != 0);
+                scale--;
+            }
+            p++;
+        }
+    }
+    if (*p == 'e' || *p == 'E')
+    {
+        bool negative_exponent = false;
+        integer = false;
+        p++;
+        if (*p == '+' || *p == '-')
+        {
+            negative_exponent = (*p == '-');
+            p++;
+        }
+        if (*p < '0' || *p > '9')
+        {
+            return NULL;
+        }
+        while (*p >= '0' && *p <= '9')
+        {
+            if (exponent < 100000)
+            {
+                exponent = exponent * 10 + (*p - '0');
+            }
+            p++;
+        }
+        scale += negative_exponent ? -exponent : exponent;
+    }
+
+    if (integer && scale == 0)
+    {
+        if (mantissa <= (negative ? 2147483648ULL : 2147483647ULL))
+        {
+            item->type = aJson_Int;
+            item->valueint = negative ? (int)(0 - (uint32_t)mantissa) : (int)mantissa;
+            return p;
+        }
+        if (mantissa <= (negative ? 9223372036854775808ULL : 9223372036854775807ULL))
+        {
+            item->type = aJson_Long;
+            item->valuelong = negative ? (long long)(0 - mantissa) : (long long)mantissa;
+            return p;
+        }
+    }
+
+    item->type = aJson_Float;
+    if (mantissa == 0)
+    {
+        item->valuefloat = negative ? -0.0 : 0.0;
+    }
+    else if (mantissa <= (1ULL << 53) && scale >= -22 && scale <= 22)
+    {
+        double n = (double)mantissa;
+        n = (scale < 0) ? n / ajsonPow10[-scale] : n * ajsonPow10[scale];
+        item->valuefloat = negative ? -n : n;
+    }
+    else
+    {
+        item->valuefloat = strtod(start, NULL);
+    }
+    return p;
+}
+
+
 
 /*********************************************************************************
   *Function	      :
@@ -60,9 +313,7 @@
 **********************************************************************************/
 bool aJsonStringStream::available(void)
 {
-    if (bucket != EOF)
-    return true;
-    return inbuf_len > 0;
+    return cursor < cursor_end;
 }
 
 /*********************************************************************************
@@ -77,19 +328,53 @@ bool aJsonStringStream::available(void)
 **********************************************************************************/
 int aJsonStringStream::getch(void)
 {
-       if (bucket != EOF)
+    if (cursor >= cursor_end)
     {
-        int ret = bucket;
-        bucket = EOF;
-        return ret;
+        return EOF;
     }
-    if (!inbuf || !inbuf_len)
+    return (unsigned char)*cursor++;
+}
+
+/*********************************************************************************
+  *Function	      :   size_t aJsonStringStream::readBytes(uint8_t *buffer, size_t len)
+  *Description	:   copy up to len bytes of the input
+  *Input		      :
+  *Output		:
+  *Return		:   the bytes copied
+  *author		:   robot
+  *date		      :   2016-05-20
+  *Others		:
+**********************************************************************************/
+size_t aJsonStringStream::readBytes(uint8_t *buffer, size_t len)
+{
+    size_t left = cursor_end - cursor;
+
+    if (len > left)
     {
-        return EOF;
+        len = left;
     }
-    char ch = *inbuf++;
-    inbuf_len--;
-    return ch;
+    memcpy(buffer, cursor, len);
+    cursor += len;
+    return len;
+}
+
+/*********************************************************************************
+  *Function	      :   void aJsonStringStream::ungetch(char ch)
+  *Description	:   step back over ch, the input stays one contiguous text for the scanners
+  *Input		      :   ch: the character getch() returned last
+  *Output		:
+  *Return		:
+  *author		:   robot
+  *date		      :   2016-05-20
+  *Others		:   after EOF there is nothing to step back over
+**********************************************************************************/
+void aJsonStringStream::ungetch(char ch)
+{
+    if (cursor == cursor_end && ch == (char)EOF)
+    {
+        return;
+    }
+    cursor--;
 }
 
 /*********************************************************************************
@@ -223,94 +508,54 @@ size_t aJsonStream::readBytes(uint8_t *buffer, size_t len)
 
 // Parse the input text to generate a number, and populate the result into item.
 /*********************************************************************************
-  *Function	      :
+  *Function	      :   int aJsonStream::parseNumber(aJsonObject *item)
   *Description	:
   *Input		      :
   *Output		:
-  *Return		:
+  *Return		:   0, EOF if malformed
   *author		:
   *date		      :
-  *Others		:
+  *Others		:   a string stream is scanned in place, other streams through a small buffer
 **********************************************************************************/
 int aJsonStream::parseNumber(aJsonObject *item)
 {
-    int i = 0;
-    int sign = 1;
+    char buffer[NUMBER_BUFFER_SIZE];
+    const char *end;
 
-    int in = this->getch();
-    if (in == EOF)
-    {
-        return EOF;
-    }
-    // It is easier to decode ourselves than to use sscnaf,
-    // since so we can easier decide between int & double
-    if (in == '-')
+    if (cursor != NULL)
     {
-        //it is a negative number
-        sign = -1;
-        in = this->getch();
-        if (in == EOF)
+        end = ajsonScanNumber(cursor, item);
+        if (end == NULL)
         {
             return EOF;
         }
+        cursor = end;
+        return 0;
     }
-    if (in >= '0' && in <= '9')
-    do
+
+    //collect the characters of the number, the conversion is the same as above
+    size_t len = 0;
+    int in = this->getch();
+    while ((in >= '0' && in <= '9') || in == '-' || in == '+' || in == '.' || in == 'e' || in == 'E')
     {
-        i = (i * 10) + (in - '0');
+        if (len >= sizeof(buffer) - 1)
+        {
+            return EOF;
+        }
+        buffer[len++] = in;
         in = this->getch();
     }
-    while (in >= '0' && in <= '9'); // Number?
-    //end of integer part � or isn't it?
-    if (!(in == '.' || in == 'e' || in == 'E'))
+    buffer[len] = 0;
+    //preserve the last character for the next routine
+    if (in != EOF)
     {
-        item->valueint = i * (int) sign;
-        item->type = aJson_Int;
+        this->ungetch(in);
     }
-    //ok it seems to be a double
-    else
+    end = ajsonScanNumber(buffer, item);
+    if (end != buffer + len)
     {
-        double n = (double) i;
-        int scale = 0;
-        int subscale = 0;
-        char signsubscale = 1;
-        if (in == '.')
-        {
-            in = this->getch();
-            do
-            {
-                n = (n * 10.0) + (in - '0'), scale--;
-                in = this->getch();
-            }
-            while (in >= '0' && in <= '9');
-        } // Fractional part?
-        if (in == 'e' || in == 'E') // Exponent?
-        {
-            in = this->getch();
-            if (in == '+')
-            {
-                in = this->getch();
-            }
-            else if (in == '-')
-            {
-                signsubscale = -1;
-                in = this->getch();
-            }
-            while (in >= '0' && in <= '9')
-            {
-                subscale = (subscale * 10) + (in - '0'); // Number?
-                in = this->getch();
-            }
-        }
-
-        n = sign * n * pow(10.0, ((double) scale + (double) subscale
-        * (double) signsubscale)); // number = +/- number.fraction * 10^+/- exponent
-
-        item->valuefloat = n;
-        item->type = aJson_Float;
+        return EOF;
     }
-    //preserve the last character for the next routine
-    this->ungetch(in);
     return 0;
 }
 
@@ -335,6 +580,41 @@ int aJsonStream::printInt(aJsonObject *item)
     return 0;
 }
 
+/*********************************************************************************
+  *Function	      :   int aJsonStream::printLong(aJsonObject *item)
+  *Description	:   print a aJson_Long
+  *Input		      :
+  *Output		:
+  *Return		:
+  *author		:   robot
+  *date		      :   2016-05-20
+  *Others		:
+**********************************************************************************/
+int aJsonStream::printLong(aJsonObject *item)
+{
+    if (item != NULL)
+    {
+        char buffer[21];    //"-9223372036854775808"
+        int i = sizeof(buffer) - 1;
+        unsigned long long n = (item->valuelong < 0) ? 0 - (unsigned long long)item->valuelong : item->valuelong;
+
+        buffer[i] = 0;
+        do
+        {
+            buffer[--i] = '0' + (n % 10);
+            n /= 10;
+        }
+        while (n);
+        if (item->valuelong < 0)
+        {
+            buffer[--i] = '-';
+        }
+        return this->print(&buffer[i]);
+    }
+    //printing nothing is ok
+    return 0;
+}
+
 /*********************************************************************************
   *Function	      :
   *Description	:
@@ -395,6 +675,10 @@ int aJsonStream::printFloat(aJsonObject *item)
 **********************************************************************************/
 int aJsonStream::parseString(aJsonObject *item)
 {
+    if (cursor != NULL)
+    {
+        return this->scanString(item);
+    }
     //we do not need to skip here since the first byte should be '\"'
     int in = this->getch();
     if (in != '\"')
@@ -457,6 +741,26 @@ int aJsonStream::parseString(aJsonObject *item)
                     case 't':
                         stringBufferAdd('\t', buffer);
                         break;
+                    case 'u':
+                    {
+                        char utf8[3];
+                        unsigned int code = 0;
+                        for (int i = 0; i < 4; i++)
+                        {
+                            int h = ajsonHex(this->getch());
+                            if (h < 0)
+                            {
+                                stringBufferFree(buffer);
+                                return EOF;
+                            }
+                            code = (code << 4) | h;
+                        }
+                        for (int i = 0, n = ajsonUtf8(code, utf8); i < n; i++)
+                        {
+                            stringBufferAdd(utf8[i], buffer);
+                        }
+                        break;
+                    }
                     default:
                         //we do not understand it so we skip it
                         break;
@@ -471,12 +775,71 @@ int aJsonStream::parseString(aJsonObject *item)
         }
         //the string ends here
         item->valuestring = stringBufferToString(buffer);
-        return 0;
+        return (item->valuestring != NULL) ? 0 : EOF;
     }
     //we should not be here but it is ok
     return 0;
 }
 
+/*********************************************************************************
+  *Function	      :   int aJsonStream::scanString(aJsonObject *item)
+  *Description	:   parseString of a string stream: find the end, then copy once
+  *Input		      :
+  *Output		:
+  *Return		:   0, EOF if malformed or out of memory
+  *author		:   robot
+  *date		      :   2016-05-20
+  *Others		:   no length limit. as the getch() path, a control character also ends the string
+**********************************************************************************/
+int aJsonStream::scanString(aJsonObject *item)
+{
+    if (cursor >= cursor_end || *cursor != '\"')
+    {
+        return EOF; // not a string!
+    }
+    const char *start = cursor + 1, *p = start;
+    bool escaped = false;
+    while (1)
+    {
+        p = ajsonStringRun(p, cursor_end);
+        if (p >= cursor_end)
+        {
+            return EOF;
+        }
+        if (*p != '\\')
+        {
+            break;
+        }
+        if (p + 1 >= cursor_end)
+        {
+            return EOF;
+        }
+        escaped = true;
+        p += 2;
+    }
+
+    char *string = (char *)pvPortMalloc(p - start + 1);
+    MO_ASSERT((string!=NULL));
+    if (string == NULL)
+    {
+        return EOF;
+    }
+    if (!escaped)
+    {
+        memcpy(string, start, p - start);
+        string[p - start] = 0;
+    }
+    else if (ajsonUnescape(string, start, p) == NULL)
+    {
+        vPortFree(string);
+        return EOF;
+    }
+    item->type = aJson_String;
+    item->valuestring = string;
+    cursor = p + 1;
+    return 0;
+}
+
 // Render the cstring provided to an escaped version that can be printed.
 /*********************************************************************************
   *Function	      :
@@ -569,6 +932,14 @@ int aJsonStream::printString(aJsonObject *item)
 // Utility to jump whitespace and cr/lf
 int aJsonStream::skip(void)
 {
+    if (cursor != NULL)
+    {
+        while (cursor < cursor_end && (unsigned char)*cursor <= 32)
+        {
+            cursor++;
+        }
+        return (cursor < cursor_end) ? 0 : EOF;
+    }
     int in = this->getch();
     while (in != EOF && (in <= 32))
     {
@@ -730,6 +1101,9 @@ int aJsonStream::printValue(aJsonObject *item)
         case aJson_Int:
             result = this->printInt(item);
             break;
+        case aJson_Long:
+            result = this->printLong(item);
+            break;
         case aJson_Float:
             result = this->printFloat(item);
             break;
@@ -928,188 +1302,1380 @@ int aJsonStream::parseObject(aJsonObject *item, char** filter)
         {
             return EOF;
         }
-        this->skip();
-        in = this->getch();
+        this->skip();
+        in = this->getch();
+    }
+    if (in == '}')
+    {
+        return 0; // end of array
+    }
+    else
+    {
+        return EOF; // malformed.
+    }
+}
+
+// Render an object to text.
+/*********************************************************************************
+  *Function	      :
+  *Description	:
+  *Input		      :
+  *Output		:
+  *Return		:
+  *author		:
+  *date		      :
+  *Others		:
+**********************************************************************************/
+int aJsonStream::printObject(aJsonObject *item)
+{
+    if (item == NULL)
+    {
+        //nothing to do
+        return 0;
+    }
+    aJsonObject *child = item->child;
+    if (this->print('{') == EOF)
+    {
+        return EOF;
+    }
+    while (child)
+    {
+        if (this->printStringPtr(child->name) == EOF)
+        {
+            return EOF;
+        }
+        if (this->print(':') == EOF)
+        {
+            return EOF;
+        }
+        if (this->printValue(child) == EOF)
+        {
+            return EOF;
+        }
+        child = child->next;
+        if (child)
+        {
+            if (this->print(',') == EOF)
+            {
+                return EOF;
+            }
+        }
+    }
+    if (this->print('}') == EOF)
+    {
+        return EOF;
+    }
+    return 0;
+}
+
+// Internal constructor.
+/*********************************************************************************
+  *Function	      :
+  *Description	:
+  *Input		      :
+  *Output		:
+  *Return		:
+  *author		:
+  *date		      :
+  *Others		:
+**********************************************************************************/
+aJsonObject *aJsonClass::newItem(void)
+{
+    aJsonObject* node = (aJsonObject*)pvPortMalloc(sizeof(aJsonObject));
+    MO_ASSERT((node!=NULL));
+    if (node)
+    {memset(node, 0, sizeof(aJsonObject));}
+    return node;
+}
+
+// Delete a aJsonObject structure.
+/*********************************************************************************
+  *Function	      :
+  *Description	:
+  *Input		      :
+  *Output		:
+  *Return		:
+  *author		:
+  *date		      :
+  *Others		:
+**********************************************************************************/
+void aJsonClass::deleteItem(aJsonObject *c)
+{
+    aJsonObject *next;
+    while (c)
+    {
+        next = c->next;
+        if (!(c->type & aJson_IsReference) && c->child)
+        {
+            deleteItem(c->child);
+        }
+        if ((c->type == aJson_String) && c->valuestring)
+        {
+            vPortFree(c->valuestring);
+        }
+        if (c->name)
+        {
+            vPortFree(c->name);
+        }
+        vPortFree(c);
+        c = next;
+    }
+}
+
+// Parse an object - create a new root, and populate.
+/*********************************************************************************
+  *Function	      :
+  *Description	:
+  *Input		      :
+  *Output		:
+  *Return		:
+  *author		:
+  *date		      :
+  *Others		:
+**********************************************************************************/
+aJsonObject *aJsonClass::parse(char *value)
+{
+    aJsonStringStream stringStream(value, NULL);
+    aJsonObject* result = parse(&stringStream);
+    return result;
+}
+
+// Parse an object - create a new root, and populate.
+/*********************************************************************************
+  *Function	      :
+  *Description	:
+  *Input		      :
+  *Output		:
+  *Return		:
+  *author		:
+  *date		      :
+  *Others		:
+**********************************************************************************/
+aJsonObject *aJsonClass::parse(aJsonStream* stream)
+{
+    return parse(stream, NULL);
+}
+
+// Parse an object - create a new root, and populate.
+/*********************************************************************************
+  *Function	      :
+  *Description	:
+  *Input		      :
+  *Output		:
+  *Return		:
+  *author		:
+  *date		      :
+  *Others		:
+**********************************************************************************/
+aJsonObject *aJsonClass::parse(aJsonStream* stream, char** filter)
+{
+    if (stream == NULL)
+    {
+        return NULL;
+    }
+    aJsonObject *c = newItem();
+    if (!c)
+    {return NULL;} /* memory fail */
+
+    stream->skip();
+    if (stream->parseValue(c, filter) == EOF)
+    {
+        deleteItem(c);
+        return NULL;
+    }
+    return c;
+}
+
+/******************************************************************************
+ * In situ parser: nodes come from one arena, strings stay in the input text
+ ******************************************************************************/
+typedef struct
+{
+    aJsonObject *node;      // next free node
+    aJsonObject *end;
+    const char *text_end;   // the terminator of the text
+    int depth;
+} ajson_insitu_t;
+
+static char *insituParseValue(ajson_insitu_t *ctx, char *p, aJsonObject *item);
+
+static aJsonObject *insituNewItem(ajson_insitu_t *ctx)
+{
+    if (ctx->node >= ctx->end)
+    {
+        return NULL;
+    }
+    aJsonObject *item = ctx->node++;
+    memset(item, 0, sizeof(aJsonObject));
+    return item;
+}
+
+static char *insituSkip(char *p)
+{
+    while (*p && ((unsigned char)*p <= 32))
+    {
+        p++;
+    }
+    return p;
+}
+
+/*********************************************************************************
+  *Function	      :   static char *insituParseString(ajson_insitu_t *ctx, char *p, char **out)
+  *Description	:   unescape the string starting at the quote p in place
+  *Input		      :   p: the opening quote
+  *Output		:   out: the string, terminated inside the input
+  *Return		:   the character after the closing quote, NULL if malformed
+  *author		:   robot
+  *date		      :   2016-05-20
+  *Others		:   control characters are kept, only the end of the text is an error
+**********************************************************************************/
+static char *insituParseString(ajson_insitu_t *ctx, char *p, char **out)
+{
+    if (*p != '\"')
+    {
+        return NULL;
+    }
+    char *start = p + 1;
+    bool escaped = false;
+    p = start;
+    while (1)
+    {
+        p = (char *)ajsonStringRun(p, ctx->text_end);
+        if (p >= ctx->text_end)
+        {
+            return NULL;
+        }
+        if (*p == '\"')
+        {
+            break;
+        }
+        if (*p == '\\')
+        {
+            if (p + 1 >= ctx->text_end)
+            {
+                return NULL;
+            }
+            escaped = true;
+            p++;
+        }
+        p++;
+    }
+    *out = start;
+    if (escaped)
+    {
+        if (ajsonUnescape(start, start, p) == NULL)
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        *p = 0;
+    }
+    return p + 1;
+}
+
+// Array or object: the children are linked as in aJsonStream::parseArray/parseObject.
+static char *insituParseList(ajson_insitu_t *ctx, char *p, aJsonObject *item)
+{
+    char close = (*p == '[') ? ']' : '}';
+    aJsonObject *child = NULL;
+
+    item->type = (close == ']') ? aJson_Array : aJson_Object;
+    if (++ctx->depth > aJson_MaxDepth)
+    {
+        return NULL;
+    }
+    p = insituSkip(p + 1);
+    if (*p == close)
+    {
+        ctx->depth--;
+        return p + 1;
+    }
+    while (1)
+    {
+        aJsonObject *new_item = insituNewItem(ctx);
+        if (new_item == NULL)
+        {
+            return NULL; // arena too small
+        }
+        if (child == NULL)
+        {
+            item->child = new_item;
+        }
+        else
+        {
+            child->next = new_item;
+            new_item->prev = child;
+        }
+        child = new_item;
+        if (close == '}')
+        {
+            p = insituParseString(ctx, insituSkip(p), &child->name);
+            if (p == NULL)
+            {
+                return NULL;
+            }
+            p = insituSkip(p);
+            if (*p != ':')
+            {
+                return NULL;
+            }
+            p++;
+        }
+        p = insituParseValue(ctx, p, child);
+        if (p == NULL)
+        {
+            return NULL;
+        }
+        p = insituSkip(p);
+        if (*p == ',')
+        {
+            p++;
+        }
+        else if (*p == close)
+        {
+            ctx->depth--;
+            return p + 1;
+        }
+        else
+        {
+            return NULL; // malformed.
+        }
+    }
+}
+
+static char *insituParseValue(ajson_insitu_t *ctx, char *p, aJsonObject *item)
+{
+    p = insituSkip(p);
+    switch (*p)
+    {
+        case '\"':
+            item->type = aJson_String;
+            return insituParseString(ctx, p, &item->valuestring);
+        case '[':
+        case '{':
+            return insituParseList(ctx, p, item);
+        case 'n':
+            if (strncmp(p, "null", 4))
+            {
+                return NULL;
+            }
+            item->type = aJson_NULL;
+            return p + 4;
+        case 't':
+            if (strncmp(p, "true", 4))
+            {
+                return NULL;
+            }
+            item->type = aJson_True;
+            item->valuebool = -1;
+            return p + 4;
+        case 'f':
+            if (strncmp(p, "false", 5))
+            {
+                return NULL;
+            }
+            item->type = aJson_False;
+            item->valuebool = 0;
+            return p + 5;
+        default:
+            return (char *)ajsonScanNumber(p, item);
+    }
+}
+
+/*********************************************************************************
+  *Function	      :   aJsonObject *aJsonClass::parseInSitu(char *value, void *arena, size_t arena_size)
+  *Description	:   parse value in place, without any allocation
+  *Input		      :   value: the json text, modified by the parser
+                          arena: memory for the nodes, arenaSize(value) bytes always suffice
+  *Output		:
+  *Return		:   the root, NULL if value is malformed or arena is too small
+  *author		:   robot
+  *date		      :   2016-05-20
+  *Others		:   strings point into value, nodes into arena: both must outlive the result.
+                          never call deleteItem on the result.
+                          only whitespace may follow the root value: {"a":1}x is malformed
+**********************************************************************************/
+aJsonObject *aJsonClass::parseInSitu(char *value, void *arena, size_t arena_size)
+{
+    ajson_insitu_t ctx;
+    uintptr_t start, align = __alignof__(aJsonObject);
+
+    if (value == NULL || arena == NULL)
+    {
+        return NULL;
+    }
+    start = ((uintptr_t)arena + align - 1) & ~(align - 1);
+    if (start - (uintptr_t)arena > arena_size)
+    {
+        return NULL;
+    }
+    ctx.node = (aJsonObject *)start;
+    ctx.end = ctx.node + (arena_size - (start - (uintptr_t)arena)) / sizeof(aJsonObject);
+    ctx.text_end = value + strlen(value);
+    ctx.depth = 0;
+
+    aJsonObject *root = insituNewItem(&ctx);
+    if (root == NULL)
+    {
+        return NULL;
+    }
+    char *end = insituParseValue(&ctx, value, root);
+    if (end == NULL || *insituSkip(end) != 0)
+    {
+        return NULL;
+    }
+    return root;
+}
+
+/*********************************************************************************
+  *Function	      :   size_t aJsonClass::arenaSize(const char *value)
+  *Description	:   upper bound of the arena parseInSitu needs for value
+  *Input		      :
+  *Output		:
+  *Return		:
+  *author		:   robot
+  *date		      :   2016-05-20
+  *Others		:   every value but the root follows one of '[' '{' ','
+**********************************************************************************/
+size_t aJsonClass::arenaSize(const char *value)
+{
+    size_t nodes = 1;
+
+    for (; *value; value++)
+    {
+        if (*value == ',' || *value == '[' || *value == '{')
+        {
+            nodes++;
+        }
+    }
+    return nodes * sizeof(aJsonObject) + __alignof__(aJsonObject) - 1;
+}
+
+/*********************************************************************************
+  *Function	      :   aJsonObject *aJsonClass::parseDocument(const char *value)
+  *Description	:   parse a copy of value, nodes and text share one heap block
+  *Input		      :
+  *Output		:
+  *Return		:   the root, NULL if value is malformed or out of memory
+  *author		:   robot
+  *date		      :   2016-05-20
+  *Others		:   the root is the start of the block; deleteDocument frees it in one call
+**********************************************************************************/
+aJsonObject *aJsonClass::parseDocument(const char *value)
+{
+    if (value == NULL)
+    {
+        return NULL;
+    }
+    size_t nodes_size = arenaSize(value);
+    size_t len = strlen(value);
+    uint8_t *block = (uint8_t *)pvPortMalloc(nodes_size + len + 1);
+    MO_ASSERT((block!=NULL));
+    if (block == NULL)
+    {
+        return NULL;
+    }
+    char *text = (char *)block + nodes_size;
+    memcpy(text, value, len + 1);
+
+    aJsonObject *root = parseInSitu(text, block, nodes_size);
+    if (root == NULL)
+    {
+        vPortFree(block);
+        return NULL;
+    }
+    MO_ASSERT(((uint8_t *)root == block));
+    return root;
+}
+
+void aJsonClass::deleteDocument(aJsonObject *root)
+{
+    vPortFree(root);
+}
+
+/******************************************************************************
+ * aJsonReader: event driven parser, fed in pieces, no tree
+ ******************************************************************************/
+// aJsonReader states
+#define READER_VALUE        0   // a value
+#define READER_FIRST_VALUE  1   // after '[': a value or ']'
+#define READER_FIRST_KEY    2   // after '{': a key or '}'
+#define READER_KEY          3   // after ',' in an object: a key
+#define READER_KEY_STRING   4   // inside a key
+#define READER_COLON        5
+#define READER_STRING       6   // inside a string value
+#define READER_NUMBER       7
+#define READER_LITERAL      8   // true false null
+#define READER_NEXT         9   // after a value: ',' or the end of the array/object
+#define READER_DONE         10
+#define READER_ERROR        11
+
+#define READER_IS_SPACE(c)  ((c) <= 32)
+
+static const char *readerLiteral(char first)
+{
+    switch (first)
+    {
+        case 't': return "true";
+        case 'f': return "false";
+        default:  return "null";
+    }
+}
+
+aJsonReader::aJsonReader(void)
+{
+    filterCount = 0;
+    reset();
+}
+
+/*********************************************************************************
+  *Function	      :   bool aJsonReader::addFilter(const char *path, aJsonReaderCallback callback, void *arg)
+  *Description	:   call callback with the value of path
+  *Input		      :   path: e.g. "md5" "value.ssid" "list.0", not copied
+  *Output		:
+  *Return		:   false if there are aJson_ReaderMaxFilters filters already
+  *author		:   robot
+  *date		      :   2016-05-20
+  *Others		:
+**********************************************************************************/
+bool aJsonReader::addFilter(const char *path, aJsonReaderCallback callback, void *arg)
+{
+    if (filterCount >= aJson_ReaderMaxFilters || path == NULL || callback == NULL)
+    {
+        return false;
+    }
+    filters[filterCount].path = path;
+    filters[filterCount].callback = callback;
+    filters[filterCount].arg = arg;
+    filterCount++;
+    return true;
+}
+
+void aJsonReader::reset(void)
+{
+    state = READER_VALUE;
+    depth = 0;
+    match = -1;
+    escape = 0;
+    code = 0;
+    pathLen = 0;
+    pathOverflow = 0;
+    tokenLen = 0;
+    truncated = 0;
+    containers = 0;
+    pathStart[0] = 0;
+    index[0] = 0;
+    path[0] = 0;
+}
+
+/*********************************************************************************
+  *Function	      :   int aJsonReader::feed(const uint8_t *data, size_t len)
+  *Description	:   parse the next len bytes of the text
+  *Input		      :
+  *Output		:
+  *Return		:   aJson_ReaderMore  aJson_ReaderDone  aJson_ReaderError
+  *author		:   robot
+  *date		      :   2016-05-20
+  *Others		:   a number at the root only completes with the character after it.
+                          the rest of data after the end is not looked at
+**********************************************************************************/
+int aJsonReader::feed(const uint8_t *data, size_t len)
+{
+    for (size_t n = 0; n < len && state < READER_DONE; n++)
+    {
+        step(data[n]);
+    }
+    if (state == READER_DONE)
+    {
+        return aJson_ReaderDone;
+    }
+    return (state == READER_ERROR) ? aJson_ReaderError : aJson_ReaderMore;
+}
+
+int aJsonReader::parse(const char *value)
+{
+    reset();
+    if (value == NULL)
+    {
+        return aJson_ReaderError;
+    }
+    // unlike feed, the whole text is stepped: only whitespace may follow the end
+    for (; *value && state != READER_ERROR; value++)
+    {
+        step((uint8_t)*value);
+    }
+    step(' ');
+    if (state == READER_DONE)
+    {
+        return aJson_ReaderDone;
+    }
+    return (state == READER_ERROR) ? aJson_ReaderError : aJson_ReaderMore;
+}
+
+bool aJsonReader::pushContainer(bool object)
+{
+    if (depth >= aJson_MaxDepth)
+    {
+        return false;
+    }
+    depth++;
+    if (object)
+    {
+        containers |= (1UL << depth);
+    }
+    else
+    {
+        containers &= ~(1UL << depth);
+    }
+    pathStart[depth] = pathLen;
+    index[depth] = 0;
+    return true;
+}
+
+int aJsonReader::closeContainer(bool object)
+{
+    if (depth == 0 || object != ((containers >> depth) & 1))
+    {
+        state = READER_ERROR;
+        return aJson_ReaderError;
+    }
+    depth--;
+    return endValue();
+}
+
+// Replace the last path segment with the key (appended by the caller) or the index of the new element.
+void aJsonReader::beginElement(void)
+{
+    if (pathOverflow >= depth)
+    {
+        pathOverflow = 0;
+    }
+    pathLen = pathStart[depth];
+    if (depth > 1)
+    {
+        appendPath('.');
+    }
+    if (!((containers >> depth) & 1))
+    {
+        char digits[6];
+        int i = 0;
+        uint16_t v = index[depth];
+        do
+        {
+            digits[i++] = '0' + (v % 10);
+            v /= 10;
+        }
+        while (v);
+        while (i)
+        {
+            appendPath(digits[--i]);
+        }
+    }
+}
+
+void aJsonReader::appendPath(char c)
+{
+    if (pathLen + 1 >= aJson_ReaderPathSize)
+    {
+        if (pathOverflow == 0)
+        {
+            pathOverflow = depth;
+        }
+        return;
+    }
+    path[pathLen++] = c;
+}
+
+// One character of a key or of a string value, only kept if the value is filtered.
+// A string value longer than the token is cut, the rest of it is still checked.
+void aJsonReader::appendChar(char c)
+{
+    if (state == READER_KEY_STRING)
+    {
+        appendPath(c);
+        return;
+    }
+    if (match < 0)
+    {
+        return;
+    }
+    if (tokenLen + 1 >= aJson_ReaderTokenSize)
+    {
+        truncated = 1;
+        return;
+    }
+    token[tokenLen++] = c;
+}
+
+void aJsonReader::appendCode(void)
+{
+    char utf8[3];
+    int n = ajsonUtf8(code, utf8);
+
+    for (int i = 0; i < n; i++)
+    {
+        appendChar(utf8[i]);
+    }
+}
+
+// Drop a utf-8 sequence that the cut left incomplete at the end of the token.
+void aJsonReader::trimToken(void)
+{
+    uint8_t start = tokenLen, need;
+
+    while (start > 0 && ((uint8_t)token[start - 1] & 0xC0) == 0x80)
+    {
+        start--;
+    }
+    if (start == 0)
+    {
+        return;
+    }
+    uint8_t lead = (uint8_t)token[start - 1];
+    if (lead < 0xC0)
+    {
+        return;
+    }
+    need = (lead >= 0xF0) ? 4 : (lead >= 0xE0) ? 3 : 2;
+    if (tokenLen - (start - 1) < need)
+    {
+        tokenLen = start - 1;
+    }
+}
+
+void aJsonReader::matchPath(void)
+{
+    match = -1;
+    if (pathOverflow)
+    {
+        return;
+    }
+    path[pathLen] = 0;
+    for (uint8_t i = 0; i < filterCount; i++)
+    {
+        if (strcasecmp(filters[i].path, path) == 0)
+        {
+            match = i;
+            return;
+        }
+    }
+}
+
+void aJsonReader::emit(aJsonObject *value)
+{
+    if (match >= 0)
+    {
+        filters[match].callback(filters[match].path, value, filters[match].arg);
+    }
+}
+
+int aJsonReader::endValue(void)
+{
+    match = -1;
+    if (depth == 0)
+    {
+        state = READER_DONE;
+        return aJson_ReaderDone;
+    }
+    state = READER_NEXT;
+    return aJson_ReaderMore;
+}
+
+int aJsonReader::endNumber(void)
+{
+    aJsonObject item;
+
+    memset(&item, 0, sizeof(item));
+    token[tokenLen] = 0;
+    if (ajsonScanNumber(token, &item) != token + tokenLen)
+    {
+        state = READER_ERROR;
+        return aJson_ReaderError;
+    }
+    emit(&item);
+    return endValue();
+}
+
+/*********************************************************************************
+  *Function	      :   int aJsonReader::step(uint8_t c)
+  *Description	:   advance the state machine by one character
+  *Input		      :
+  *Output		:
+  *Return		:   aJson_ReaderMore  aJson_ReaderDone  aJson_ReaderError
+  *author		:   robot
+  *date		      :   2016-05-20
+  *Others		:   numbers end on the next character, which is then handled again
+**********************************************************************************/
+int aJsonReader::step(uint8_t c)
+{
+    aJsonObject item;
+
+    switch (state)
+    {
+        case READER_FIRST_VALUE:
+            if (READER_IS_SPACE(c))
+            {
+                return aJson_ReaderMore;
+            }
+            if (c == ']')
+            {
+                return closeContainer(false);
+            }
+            beginElement();
+            state = READER_VALUE;
+            //no break: c starts the first element
+        case READER_VALUE:
+            if (READER_IS_SPACE(c))
+            {
+                return aJson_ReaderMore;
+            }
+            if (c == '{' || c == '[')
+            {
+                if (!pushContainer(c == '{'))
+                {
+                    break;
+                }
+                state = (c == '{') ? READER_FIRST_KEY : READER_FIRST_VALUE;
+                return aJson_ReaderMore;
+            }
+            matchPath();
+            tokenLen = 0;
+            if (c == '\"')
+            {
+                escape = 0;
+                truncated = 0;
+                state = READER_STRING;
+                return aJson_ReaderMore;
+            }
+            if (c == '-' || (c >= '0' && c <= '9'))
+            {
+                token[tokenLen++] = c;
+                state = READER_NUMBER;
+                return aJson_ReaderMore;
+            }
+            if (c == 't' || c == 'f' || c == 'n')
+            {
+                token[tokenLen++] = c;
+                state = READER_LITERAL;
+                return aJson_ReaderMore;
+            }
+            break;
+
+        case READER_FIRST_KEY:
+            if (c == '}')
+            {
+                return closeContainer(true);
+            }
+            //no break
+        case READER_KEY:
+            if (READER_IS_SPACE(c))
+            {
+                return aJson_ReaderMore;
+            }
+            if (c != '\"')
+            {
+                break;
+            }
+            beginElement();
+            escape = 0;
+            state = READER_KEY_STRING;
+            return aJson_ReaderMore;
+
+        case READER_COLON:
+            if (READER_IS_SPACE(c))
+            {
+                return aJson_ReaderMore;
+            }
+            if (c != ':')
+            {
+                break;
+            }
+            state = READER_VALUE;
+            return aJson_ReaderMore;
+
+        case READER_KEY_STRING:
+        case READER_STRING:
+            if (escape == 0)
+            {
+                if (c == '\\')
+                {
+                    escape = 1;
+                    return aJson_ReaderMore;
+                }
+                if (c != '\"')
+                {
+                    appendChar(c);
+                    return aJson_ReaderMore;
+                }
+                if (state == READER_KEY_STRING)
+                {
+                    state = READER_COLON;
+                    return aJson_ReaderMore;
+                }
+                memset(&item, 0, sizeof(item));
+                if (truncated)
+                {
+                    trimToken();
+                }
+                token[tokenLen] = 0;
+                item.type = truncated ? aJson_ReaderTruncated : aJson_String;
+                item.valuestring = token;
+                emit(&item);
+                return endValue();
+            }
+            if (escape == 1)
+            {
+                escape = 0;
+                switch (c)
+                {
+                    case 'b': c = '\b'; break;
+                    case 'f': c = '\f'; break;
+                    case 'n': c = '\n'; break;
+                    case 'r': c = '\r'; break;
+                    case 't': c = '\t'; break;
+                    case 'u':
+                        escape = 2;
+                        code = 0;
+                        return aJson_ReaderMore;
+                    case '\\':
+                    case '\"':
+                    case '/':
+                        break;
+                    default:
+                        //we do not understand it so we skip it (as aJsonStream::parseString)
+                        return aJson_ReaderMore;
+                }
+                appendChar(c);
+                return aJson_ReaderMore;
+            }
+            else
+            {
+                int h = ajsonHex(c);
+                if (h < 0)
+                {
+                    break;
+                }
+                code = (code << 4) | h;
+                if (++escape < 6)
+                {
+                    return aJson_ReaderMore;
+                }
+                escape = 0;
+                appendCode();
+                return aJson_ReaderMore;
+            }
+
+        case READER_NUMBER:
+            if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-')
+            {
+                if (tokenLen + 1 >= aJson_ReaderTokenSize)
+                {
+                    break;
+                }
+                token[tokenLen++] = c;
+                return aJson_ReaderMore;
+            }
+            if (endNumber() == aJson_ReaderError)
+            {
+                return aJson_ReaderError;
+            }
+            return step(c);
+
+        case READER_LITERAL:
+        {
+            const char *literal = readerLiteral(token[0]);
+            if (c != (uint8_t)literal[tokenLen])
+            {
+                break;
+            }
+            token[tokenLen++] = c;
+            if (literal[tokenLen] != 0)
+            {
+                return aJson_ReaderMore;
+            }
+            memset(&item, 0, sizeof(item));
+            if (token[0] == 'n')
+            {
+                item.type = aJson_NULL;
+            }
+            else
+            {
+                item.type = (token[0] == 't') ? aJson_True : aJson_False;
+                item.valuebool = (token[0] == 't');
+            }
+            emit(&item);
+            return endValue();
+        }
+
+        case READER_NEXT:
+            if (READER_IS_SPACE(c))
+            {
+                return aJson_ReaderMore;
+            }
+            if (c == ',')
+            {
+                if ((containers >> depth) & 1)
+                {
+                    state = READER_KEY;
+                }
+                else
+                {
+                    index[depth]++;
+                    beginElement();
+                    state = READER_VALUE;
+                }
+                return aJson_ReaderMore;
+            }
+            if (c == '}' || c == ']')
+            {
+                return closeContainer(c == '}');
+            }
+            break;
+
+        case READER_DONE:
+            if (READER_IS_SPACE(c))
+            {
+                return aJson_ReaderDone;
+            }
+            break; // data after the end
+
+        default:
+            break;
     }
-    if (in == '}')
+    state = READER_ERROR;
+    return aJson_ReaderError;
+}
+
+/******************************************************************************
+ * aJsonWriter: json text straight into a caller buffer
+ ******************************************************************************/
+//two digits per division when formatting integers
+static const char ajsonDigits2[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+//integer scale of aJsonWriter::addNumber(double), 10^decimals
+static const uint32_t writerPow10[] =
+{
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+aJsonWriter::aJsonWriter(char *buffer, size_t size)
+{
+    buf = buffer;
+    this->size = (buffer != NULL) ? size : 0;
+    len = 0;
+    first = 1;
+    depth = 0;
+    full = false;
+}
+
+void aJsonWriter::put(char c)
+{
+    if (full)
     {
-        return 0; // end of array
+        return;
     }
-    else
+    if (len >= size)
     {
-        return EOF; // malformed.
+        full = true;
+        return;
     }
+    buf[len++] = c;
+}
+
+void aJsonWriter::put(const char *s, size_t n)
+{
+    if (full)
+    {
+        return;
+    }
+    if (n > size - len)
+    {
+        full = true;
+        return;
+    }
+    memcpy(buf + len, s, n);
+    len += n;
 }
 
-// Render an object to text.
 /*********************************************************************************
-  *Function	      :
-  *Description	:
-  *Input		      :
+  *Function	      :   void aJsonWriter::putUnsigned(unsigned long long n, bool negative)
+  *Description	:   write a decimal integer
+  *Input		      :   negative: prepend '-'
   *Output		:
   *Return		:
-  *author		:
-  *date		      :
-  *Others		:
+  *author		:   robot
+  *date		      :   2016-05-20
+  *Others		:   two digits per division; 64 bit division only above 32 bits
 **********************************************************************************/
-int aJsonStream::printObject(aJsonObject *item)
+void aJsonWriter::putUnsigned(unsigned long long n, bool negative)
 {
-    if (item == NULL)
+    char digits[21];
+    char *p = digits + sizeof(digits);
+
+    while (n > 0xFFFFFFFFULL)
     {
-        //nothing to do
-        return 0;
+        unsigned int r = (unsigned int)(n % 100);
+        n /= 100;
+        p -= 2;
+        memcpy(p, ajsonDigits2 + r * 2, 2);
     }
-    aJsonObject *child = item->child;
-    if (this->print('{') == EOF)
+    uint32_t m = (uint32_t)n;
+    while (m >= 100)
     {
-        return EOF;
+        uint32_t r = m % 100;
+        m /= 100;
+        p -= 2;
+        memcpy(p, ajsonDigits2 + r * 2, 2);
     }
-    while (child)
+    if (m >= 10)
     {
-        if (this->printStringPtr(child->name) == EOF)
-        {
-            return EOF;
-        }
-        if (this->print(':') == EOF)
-        {
-            return EOF;
-        }
-        if (this->printValue(child) == EOF)
-        {
-            return EOF;
-        }
-        child = child->next;
-        if (child)
+        p -= 2;
+        memcpy(p, ajsonDigits2 + m * 2, 2);
+    }
+    else
+    {
+        *--p = '0' + m;
+    }
+    if (negative)
+    {
+        *--p = '-';
+    }
+    put(p, digits + sizeof(digits) - p);
+}
+
+// Escaped as aJsonStream::printStringPtr, other control characters as \u00XX.
+void aJsonWriter::putString(const char *s)
+{
+    put('\"');
+    if (s != NULL)
+    {
+        while (*s)
         {
-            if (this->print(',') == EOF)
+            const char *run = s;
+            while ((unsigned char)*s > 31 && *s != '\"' && *s != '\\')
             {
-                return EOF;
+                s++;
             }
+            put(run, s - run);
+            if (*s == 0)
+            {
+                break;
+            }
+            char e[6] = {'\\', 0, '0', '0', 0, 0};
+            switch (*s)
+            {
+                case '\"': e[1] = '\"'; break;
+                case '\\': e[1] = '\\'; break;
+                case '\b': e[1] = 'b';  break;
+                case '\f': e[1] = 'f';  break;
+                case '\n': e[1] = 'n';  break;
+                case '\r': e[1] = 'r';  break;
+                case '\t': e[1] = 't';  break;
+                default:
+                    e[1] = 'u';
+                    e[4] = "0123456789abcdef"[(*s >> 4) & 0x0F];
+                    e[5] = "0123456789abcdef"[*s & 0x0F];
+                    break;
+            }
+            put(e, (e[1] == 'u') ? 6 : 2);
+            s++;
         }
     }
-    if (this->print('}') == EOF)
+    put('\"');
+}
+
+// The comma before every value but the first of its level, then the name inside objects.
+void aJsonWriter::separator(const char *name)
+{
+    if (first & (1UL << depth))
     {
-        return EOF;
+        first &= ~(1UL << depth);
+    }
+    else
+    {
+        put(',');
+    }
+    if (name != NULL)
+    {
+        putString(name);
+        put(':');
     }
-    return 0;
 }
 
-// Internal constructor.
-/*********************************************************************************
-  *Function	      :
-  *Description	:
-  *Input		      :
-  *Output		:
-  *Return		:
-  *author		:
-  *date		      :
-  *Others		:
-**********************************************************************************/
-aJsonObject *aJsonClass::newItem(void)
+void aJsonWriter::open(const char *name, char c)
 {
-    aJsonObject* node = (aJsonObject*)pvPortMalloc(sizeof(aJsonObject));
-    MO_ASSERT((node!=NULL));
-    if (node)
-    {memset(node, 0, sizeof(aJsonObject));}
-    return node;
+    separator(name);
+    put(c);
+    if (depth >= 31)
+    {
+        full = true;
+        return;
+    }
+    depth++;
+    first |= (1UL << depth);
 }
 
-// Delete a aJsonObject structure.
-/*********************************************************************************
-  *Function	      :
-  *Description	:
-  *Input		      :
-  *Output		:
-  *Return		:
-  *author		:
-  *date		      :
-  *Others		:
-**********************************************************************************/
-void aJsonClass::deleteItem(aJsonObject *c)
+void aJsonWriter::close(char c)
 {
-    aJsonObject *next;
-    while (c)
+    if (depth > 0)
     {
-        next = c->next;
-        if (!(c->type & aJson_IsReference) && c->child)
-        {
-            deleteItem(c->child);
-        }
-        if ((c->type == aJson_String) && c->valuestring)
-        {
-            vPortFree(c->valuestring);
-        }
-        if (c->name)
-        {
-            vPortFree(c->name);
-        }
-        vPortFree(c);
-        c = next;
+        depth--;
     }
+    put(c);
 }
 
-// Parse an object - create a new root, and populate.
-/*********************************************************************************
-  *Function	      :
-  *Description	:
-  *Input		      :
-  *Output		:
-  *Return		:
-  *author		:
-  *date		      :
-  *Others		:
-**********************************************************************************/
-aJsonObject *aJsonClass::parse(char *value)
+void aJsonWriter::beginObject(const char *name)
 {
-    aJsonStringStream stringStream(value, NULL);
-    aJsonObject* result = parse(&stringStream);
-    return result;
+    open(name, '{');
 }
 
-// Parse an object - create a new root, and populate.
-/*********************************************************************************
-  *Function	      :
-  *Description	:
-  *Input		      :
-  *Output		:
-  *Return		:
-  *author		:
-  *date		      :
-  *Others		:
-**********************************************************************************/
-aJsonObject *aJsonClass::parse(aJsonStream* stream)
+void aJsonWriter::endObject(void)
 {
-    return parse(stream, NULL);
+    close('}');
+}
+
+void aJsonWriter::beginArray(const char *name)
+{
+    open(name, '[');
+}
+
+void aJsonWriter::endArray(void)
+{
+    close(']');
+}
+
+void aJsonWriter::addNull(const char *name)
+{
+    separator(name);
+    put("null", 4);
+}
+
+void aJsonWriter::addBoolean(const char *name, bool b)
+{
+    separator(name);
+    if (b)
+    {
+        put("true", 4);
+    }
+    else
+    {
+        put("false", 5);
+    }
+}
+
+void aJsonWriter::addNumber(const char *name, int n)
+{
+    addNumber(name, (long long)n);
+}
+
+void aJsonWriter::addNumber(const char *name, unsigned int n)
+{
+    separator(name);
+    putUnsigned(n, false);
+}
+
+void aJsonWriter::addNumber(const char *name, long n)
+{
+    addNumber(name, (long long)n);
+}
+
+void aJsonWriter::addNumber(const char *name, unsigned long n)
+{
+    separator(name);
+    putUnsigned(n, false);
+}
+
+void aJsonWriter::addNumber(const char *name, long long n)
+{
+    separator(name);
+    if (n < 0)
+    {
+        putUnsigned(0 - (unsigned long long)n, true);
+    }
+    else
+    {
+        putUnsigned(n, false);
+    }
 }
 
-// Parse an object - create a new root, and populate.
 /*********************************************************************************
-  *Function	      :
-  *Description	:
-  *Input		      :
+  *Function	      :   void aJsonWriter::addNumber(const char *name, double n, uint8_t decimals)
+  *Description	:   write n rounded to decimals digits after the point, trailing zeros dropped
+  *Input		      :   decimals: 0~9
   *Output		:
   *Return		:
-  *author		:
-  *date		      :
-  *Others		:
+  *author		:   robot
+  *date		      :   2016-05-20
+  *Others		:   formatted as a scaled 64 bit integer. json has no nan/inf, they are written as null.
+                          only numbers beyond 64 bits after scaling go through snprintf, whose float
+                          formatting uses the heap
 **********************************************************************************/
-aJsonObject *aJsonClass::parse(aJsonStream* stream, char** filter)
+void aJsonWriter::addNumber(const char *name, double n, uint8_t decimals)
 {
-    if (stream == NULL)
+    separator(name);
+    if (!(n >= -DBL_MAX && n <= DBL_MAX))
     {
-        return NULL;
+        put("null", 4);
+        return;
     }
-    aJsonObject *c = newItem();
-    if (!c)
-    {return NULL;} /* memory fail */
+    if (decimals > 9)
+    {
+        decimals = 9;
+    }
+    uint32_t scale = writerPow10[decimals];
+    double a = ((n < 0) ? -n : n) * scale + 0.5;
+    if (a >= 18446744073709551615.0)
+    {
+        char text[32];
+        int l = snprintf(text, sizeof(text), "%.17g", n);
+        put(text, (l > 0 && l < (int)sizeof(text)) ? l : 0);
+        return;
+    }
+    unsigned long long scaled = (unsigned long long)a;
+    uint32_t fraction = (uint32_t)(scaled % scale);
+    putUnsigned(scaled / scale, (n < 0) && (scaled != 0));
+    if (decimals == 0)
+    {
+        return;
+    }
+    //at least one digit after the point, as aJsonStream::printFloat
+    char digits[10];
+    int count = decimals;
+    for (int i = decimals - 1; i >= 0; i--)
+    {
+        digits[i] = '0' + (fraction % 10);
+        fraction /= 10;
+    }
+    while (count > 1 && digits[count - 1] == '0')
+    {
+        count--;
+    }
+    put('.');
+    put(digits, count);
+}
 
-    stream->skip();
-    if (stream->parseValue(c, filter) == EOF)
+void aJsonWriter::addString(const char *name, const char *s)
+{
+    separator(name);
+    putString(s);
+}
+
+const char *aJsonWriter::c_str(void)
+{
+    if (full || len >= size)
     {
-        deleteItem(c);
+        full = true;
         return NULL;
     }
-    return c;
+    buf[len] = 0;
+    return buf;
 }
 
 // Render a aJsonObject item/entity/structure to text.
@@ -1864,7 +3430,7 @@ void aJsonClass::addStringToObject(aJsonObject* object, const char* name, const
 bool jsonGetValue(uint8_t *payload, const char *string, bool &ret_bool)
 {
      aJsonClass aJson;
-     aJsonObject *root = aJson.parse((char *)payload);
+     aJsonObject *root = aJson.parseDocument((char *)payload);
      if (root == NULL)
      {
          return false;
@@ -1888,16 +3454,16 @@ bool jsonGetValue(uint8_t *payload, const char *string, bool &ret_bool)
      }
      else
      {
-         aJson.deleteItem(root);
+         aJson.deleteDocument(root);
          return false;
      }
-     aJson.deleteItem(root);
+     aJson.deleteDocument(root);
      return true;
 }*/
 bool jsonGetValue(uint8_t *payload, const char *string, char &ret_char)
 {
      aJsonClass aJson;
-     aJsonObject *root = aJson.parse((char *)payload);
+     aJsonObject *root = aJson.parseDocument((char *)payload);
      if (root == NULL)
      {
          return false;
@@ -1917,16 +3483,16 @@ bool jsonGetValue(uint8_t *payload, const char *string, char &ret_char)
      }
      else
      {
-         aJson.deleteItem(root);
+         aJson.deleteDocument(root);
          return -1;
      }
-     aJson.deleteItem(root);
+     aJson.deleteDocument(root);
      return true;
 }
 bool jsonGetValue(uint8_t *payload, const char *string, String &ret_string)
 {
      aJsonClass aJson;
-     aJsonObject *root = aJson.parse((char *)payload);
+     aJsonObject *root = aJson.parseDocument((char *)payload);
      if (root == NULL)
      {
          return false;
@@ -1938,16 +3504,16 @@ bool jsonGetValue(uint8_t *payload, const char *string, String &ret_string)
      }
      else
      {
-         aJson.deleteItem(root);
+         aJson.deleteDocument(root);
          return false;
      }
-     aJson.deleteItem(root);
+     aJson.deleteDocument(root);
      return true;
 }
 bool jsonGetValue(uint8_t *payload, const char *string, uint8_t &ret_u8)
 {
      aJsonClass aJson;
-     aJsonObject *root = aJson.parse((char *)payload);
+     aJsonObject *root = aJson.parseDocument((char *)payload);
      if (root == NULL)
      {
          return false;
@@ -1967,16 +3533,16 @@ bool jsonGetValue(uint8_t *payload, const char *string, uint8_t &ret_u8)
      }
      else
      {
-         aJson.deleteItem(root);
+         aJson.deleteDocument(root);
          return false;
      }
-     aJson.deleteItem(root);
+     aJson.deleteDocument(root);
      return true;
 }
 bool jsonGetValue(uint8_t *payload, const char *string, short &ret_short)
 {
      aJsonClass aJson;
-     aJsonObject *root = aJson.parse((char *)payload);
+     aJsonObject *root = aJson.parseDocument((char *)payload);
      if (root == NULL)
      {
          return false;
@@ -1996,16 +3562,16 @@ bool jsonGetValue(uint8_t *payload, const char *string, short &ret_short)
      }
      else
      {
-         aJson.deleteItem(root);
+         aJson.deleteDocument(root);
          return false;
      }
-     aJson.deleteItem(root);
+     aJson.deleteDocument(root);
      return true;
 }
 bool jsonGetValue(uint8_t *payload, const char *string, unsigned short &ret_ushort)
 {
      aJsonClass aJson;
-     aJsonObject *root = aJson.parse((char *)payload);
+     aJsonObject *root = aJson.parseDocument((char *)payload);
      if (root == NULL)
      {
          return false;
@@ -2025,17 +3591,17 @@ bool jsonGetValue(uint8_t *payload, const char *string, unsigned short &ret_usho
      }
      else
      {
-         aJson.deleteItem(root);
+         aJson.deleteDocument(root);
          return false;
      }
-     aJson.deleteItem(root);
+     aJson.deleteDocument(root);
      return true;
 }
 
 bool jsonGetValue(uint8_t *payload, const char *string, int &ret_int)
 {
      aJsonClass aJson;
-     aJsonObject *root = aJson.parse((char *)payload);
+     aJsonObject *root = aJson.parseDocument((char *)payload);
      if (root == NULL)
      {
          return false;
@@ -2055,16 +3621,16 @@ bool jsonGetValue(uint8_t *payload, const char *string, int &ret_int)
      }
      else
      {
-         aJson.deleteItem(root);
+         aJson.deleteDocument(root);
          return false;
      }
-     aJson.deleteItem(root);
+     aJson.deleteDocument(root);
      return true;
 }
 bool jsonGetValue(uint8_t *payload, const char *string, unsigned int &ret_uint)
 {
      aJsonClass aJson;
-     aJsonObject *root = aJson.parse((char *)payload);
+     aJsonObject *root = aJson.parseDocument((char *)payload);
      if (root == NULL)
      {
          return false;
@@ -2074,6 +3640,10 @@ bool jsonGetValue(uint8_t *payload, const char *string, unsigned int &ret_uint)
      {
          ret_uint = typeObject->valueint;
      }
+     else if( (typeObject->type == aJson_Long) && (typeObject->valuelong >= 0) && (typeObject->valuelong <= UINT_MAX) )
+     {
+         ret_uint = (unsigned int)typeObject->valuelong;
+     }
      else if( typeObject->type == aJson_False )
      {
          ret_uint = 0;
@@ -2084,16 +3654,16 @@ bool jsonGetValue(uint8_t *payload, const char *string, unsigned int &ret_uint)
      }
      else
      {
-         aJson.deleteItem(root);
+         aJson.deleteDocument(root);
          return false;
      }
-     aJson.deleteItem(root);
+     aJson.deleteDocument(root);
      return true;
 }
 bool jsonGetValue(uint8_t *payload, const char *string, long &ret_long)
 {
      aJsonClass aJson;
-     aJsonObject *root = aJson.parse((char *)payload);
+     aJsonObject *root = aJson.parseDocument((char *)payload);
      if (root == NULL)
      {
          return false;
@@ -2103,6 +3673,10 @@ bool jsonGetValue(uint8_t *payload, const char *string, long &ret_long)
      {
          ret_long = typeObject->valueint;
      }
+     else if( (typeObject->type == aJson_Long) && (typeObject->valuelong >= LONG_MIN) && (typeObject->valuelong <= LONG_MAX) )
+     {
+         ret_long = (long)typeObject->valuelong;
+     }
      else if( typeObject->type == aJson_False )
      {
          ret_long = 0;
@@ -2113,16 +3687,16 @@ bool jsonGetValue(uint8_t *payload, const char *string, long &ret_long)
      }
      else
      {
-         aJson.deleteItem(root);
+         aJson.deleteDocument(root);
          return false;
      }
-     aJson.deleteItem(root);
+     aJson.deleteDocument(root);
      return true;
 }
 bool jsonGetValue(uint8_t *payload, const char *string, unsigned long &ret_ulong)
 {
      aJsonClass aJson;
-     aJsonObject *root = aJson.parse((char *)payload);
+     aJsonObject *root = aJson.parseDocument((char *)payload);
      if (root == NULL)
      {
          return false;
@@ -2132,6 +3706,10 @@ bool jsonGetValue(uint8_t *payload, const char *string, unsigned long &ret_ulong
      {
          ret_ulong = typeObject->valueint;
      }
+     else if( (typeObject->type == aJson_Long) && (typeObject->valuelong >= 0) && ((unsigned long long)typeObject->valuelong <= ULONG_MAX) )
+     {
+         ret_ulong = (unsigned long)typeObject->valuelong;
+     }
      else if( typeObject->type == aJson_False )
      {
          ret_ulong = 0;
@@ -2142,16 +3720,16 @@ bool jsonGetValue(uint8_t *payload, const char *string, unsigned long &ret_ulong
      }
      else
      {
-         aJson.deleteItem(root);
+         aJson.deleteDocument(root);
          return false;
      }
-     aJson.deleteItem(root);
+     aJson.deleteDocument(root);
      return true;
 }
 bool jsonGetValue(uint8_t *payload, const char *string, float &ret_float)
 {
      aJsonClass aJson;
-     aJsonObject *root = aJson.parse((char *)payload);
+     aJsonObject *root = aJson.parseDocument((char *)payload);
      if (root == NULL)
      {
          return false;
@@ -2167,16 +3745,16 @@ bool jsonGetValue(uint8_t *payload, const char *string, float &ret_float)
      }
      else
      {
-         aJson.deleteItem(root);
+         aJson.deleteDocument(root);
          return false;
      }
-     aJson.deleteItem(root);
+     aJson.deleteDocument(root);
      return true;
 }
 bool jsonGetValue(uint8_t *payload, const char *string, double &ret_double)
 {
      aJsonClass aJson;
-     aJsonObject *root = aJson.parse((char *)payload);
+     aJsonObject *root = aJson.parseDocument((char *)payload);
      if (root == NULL)
      {
          return false;
@@ -2190,6 +3768,10 @@ bool jsonGetValue(uint8_t *payload, const char *string, double &ret_double)
      {
          ret_double = typeObject->valueint;
      }
+     else if( typeObject->type == aJson_Long )
+     {
+         ret_double = (double)typeObject->valuelong;
+     }
      else if (typeObject->type == aJson_False)
      {
          ret_double = 0;
@@ -2200,9 +3782,9 @@ bool jsonGetValue(uint8_t *payload, const char *string, double &ret_double)
      }
      else
      {
-         aJson.deleteItem(root);
+         aJson.deleteDocument(root);
          return false;
      }
-     aJson.deleteItem(root);
+     aJson.deleteDocument(root);
      return true;
 }
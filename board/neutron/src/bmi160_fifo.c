@@ -0,0 +1,266 @@
+/**
+ ******************************************************************************
+ * @file     : bmi160_fifo.c
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : BMI160 FIFO 带帧头数据解析和样本环形缓冲
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+#include <string.h>
+#include "bmi160_fifo.h"
+
+#define FIFO_MAG_SIZE           8
+#define FIFO_GYRO_SIZE          6
+#define FIFO_ACCEL_SIZE         6
+
+void bmi160_fifo_init(bmi160_fifo_t *fifo, bmi160_fifo_sample_t *buf, uint16_t size, uint32_t frame_period)
+{
+    memset(fifo, 0, sizeof(bmi160_fifo_t));
+    fifo->buf = buf;
+    fifo->size = size;
+    fifo->frame_period = frame_period;
+}
+
+/*
+  清空样本, 保留统计
+  传感器 FIFO 清空之后调用, 之前的 sensortime 与新样本没有关系
+*/
+void bmi160_fifo_reset(bmi160_fifo_t *fifo)
+{
+    fifo->head = 0;
+    fifo->count = 0;
+    fifo->untimed = 0;
+    fifo->time_valid = 0;
+}
+
+/*
+  head 开始的一帧的长度(包括帧头), 不认识的帧头返回0
+*/
+uint16_t bmi160_fifo_frame_size(uint8_t head)
+{
+    uint16_t size = 1;
+
+    if((head & BMI160_FIFO_HEAD_MODE_MASK) == BMI160_FIFO_HEAD_DATA)
+    {
+        if(head & BMI160_FIFO_HEAD_MAG)
+        {
+            size += FIFO_MAG_SIZE;
+        }
+        if(head & BMI160_FIFO_HEAD_GYRO)
+        {
+            size += FIFO_GYRO_SIZE;
+        }
+        if(head & BMI160_FIFO_HEAD_ACCEL)
+        {
+            size += FIFO_ACCEL_SIZE;
+        }
+        // bit5 保留, 没有数据的数据帧只有 BMI160_FIFO_HEAD_EMPTY
+        if((head & 0x20) || (size == 1))
+        {
+            return 0;
+        }
+        return size;
+    }
+
+    switch(head)
+    {
+        case BMI160_FIFO_HEAD_SKIP:
+        case BMI160_FIFO_HEAD_CONFIG:
+            return 2;
+        case BMI160_FIFO_HEAD_TIME:
+            return BMI160_FIFO_TIME_FRAME_SIZE;
+        default:
+            return 0;
+    }
+}
+
+static int16_t get_s16(const uint8_t *p)
+{
+    return (int16_t)((uint16_t)p[0] | ((uint16_t)p[1] << 8));
+}
+
+static bmi160_fifo_sample_t *push_sample(bmi160_fifo_t *fifo)
+{
+    bmi160_fifo_sample_t *sample;
+
+    if(fifo->count >= fifo->size)
+    {
+        // 丢掉最旧的样本
+        fifo->count--;
+        fifo->overruns++;
+    }
+    sample = &fifo->buf[fifo->head];
+    fifo->head = (fifo->head + 1) % fifo->size;
+    fifo->count++;
+    if(fifo->untimed < fifo->count)
+    {
+        fifo->untimed++;
+    }
+    memset(sample, 0, sizeof(bmi160_fifo_sample_t));
+    return sample;
+}
+
+static void decode_data_frame(bmi160_fifo_t *fifo, uint8_t head, const uint8_t *p)
+{
+    bmi160_fifo_sample_t *sample = push_sample(fifo);
+
+    fifo->frames++;
+    if(head & BMI160_FIFO_HEAD_MAG)
+    {
+        // BMM150: x/y 13位 z 15位 rhall 14位, 低字节低位为状态
+        sample->mag[0] = (int16_t)(((int8_t)p[1] * 32) | (p[0] >> 3));
+        sample->mag[1] = (int16_t)(((int8_t)p[3] * 32) | (p[2] >> 3));
+        sample->mag[2] = (int16_t)(((int8_t)p[5] * 128) | (p[4] >> 1));
+        sample->rhall = (uint16_t)(((uint16_t)p[7] << 6) | (p[6] >> 2));
+        sample->valid |= BMI160_FIFO_SAMPLE_MAG;
+        p += FIFO_MAG_SIZE;
+    }
+    if(head & BMI160_FIFO_HEAD_GYRO)
+    {
+        sample->gyro[0] = get_s16(p);
+        sample->gyro[1] = get_s16(p + 2);
+        sample->gyro[2] = get_s16(p + 4);
+        sample->valid |= BMI160_FIFO_SAMPLE_GYRO;
+        p += FIFO_GYRO_SIZE;
+    }
+    if(head & BMI160_FIFO_HEAD_ACCEL)
+    {
+        sample->accel[0] = get_s16(p);
+        sample->accel[1] = get_s16(p + 2);
+        sample->accel[2] = get_s16(p + 4);
+        sample->valid |= BMI160_FIFO_SAMPLE_ACCEL;
+    }
+}
+
+/*
+  sensortime 对应最新的一帧, 之前没有时间的样本按帧间隔向前推算
+*/
+static void decode_time_frame(bmi160_fifo_t *fifo, const uint8_t *p)
+{
+    uint32_t time = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+    uint16_t index = fifo->head;
+    uint16_t i;
+
+    if(fifo->time_valid)
+    {
+        uint32_t expand = (fifo->time & 0xFF000000) | time;
+        if(expand < fifo->time)
+        {
+            expand += 0x01000000;
+        }
+        time = expand;
+    }
+    fifo->time = time;
+    fifo->time_valid = 1;
+
+    for(i = 0; i < fifo->untimed; i++)
+    {
+        index = (index + fifo->size - 1) % fifo->size;
+        fifo->buf[index].time = time - i * fifo->frame_period;
+        fifo->buf[index].valid |= BMI160_FIFO_SAMPLE_TIME;
+    }
+    fifo->untimed = 0;
+}
+
+/*********************************************************************************
+ *Function     : uint16_t bmi160_fifo_decode(bmi160_fifo_t *fifo, const uint8_t *data, uint16_t len)
+ *Description  : 解析一次读出的 FIFO 数据, 数据帧放入样本缓冲
+ *Input        : fifo: 样本缓冲  data: 从 FIFO_DATA 连续读出的数据  len: 长度
+ *Output       : none
+ *Return       : 已解析的字节数, 小于 len 时剩余的是不完整的帧
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 遇到读空标记或者不认识的帧头, 丢掉之后的数据并返回 len
+ **********************************************************************************/
+uint16_t bmi160_fifo_decode(bmi160_fifo_t *fifo, const uint8_t *data, uint16_t len)
+{
+    uint16_t pos = 0;
+
+    while(pos < len)
+    {
+        uint8_t head = data[pos];
+        uint16_t size;
+
+        if(head == BMI160_FIFO_HEAD_EMPTY)
+        {
+            return len;
+        }
+        if((head & BMI160_FIFO_HEAD_MODE_MASK) == BMI160_FIFO_HEAD_DATA)
+        {
+            head &= 0xFC;   // 去掉中断标记
+        }
+        size = bmi160_fifo_frame_size(head);
+        if(size == 0)
+        {
+            fifo->errors++;
+            return len;
+        }
+        if(pos + size > len)
+        {
+            break;
+        }
+
+        if((head & BMI160_FIFO_HEAD_MODE_MASK) == BMI160_FIFO_HEAD_DATA)
+        {
+            decode_data_frame(fifo, head, &data[pos + 1]);
+        }
+        else if(head == BMI160_FIFO_HEAD_TIME)
+        {
+            decode_time_frame(fifo, &data[pos + 1]);
+        }
+        else if(head == BMI160_FIFO_HEAD_SKIP)
+        {
+            // 溢出之前的样本与之后的 sensortime 之间隔了未知的帧, 不再推算时间
+            fifo->skipped += data[pos + 1];
+            fifo->untimed = 0;
+        }
+        pos += size;
+    }
+    return pos;
+}
+
+uint16_t bmi160_fifo_available(const bmi160_fifo_t *fifo)
+{
+    return fifo->count;
+}
+
+/*
+  从最旧的开始取出最多 count 个样本, 返回取出的个数
+*/
+uint16_t bmi160_fifo_read(bmi160_fifo_t *fifo, bmi160_fifo_sample_t *samples, uint16_t count)
+{
+    uint16_t tail = (fifo->head + fifo->size - fifo->count) % fifo->size;
+    uint16_t i;
+
+    if(count > fifo->count)
+    {
+        count = fifo->count;
+    }
+    for(i = 0; i < count; i++)
+    {
+        samples[i] = fifo->buf[tail];
+        tail = (tail + 1) % fifo->size;
+    }
+    fifo->count -= count;
+    if(fifo->untimed > fifo->count)
+    {
+        fifo->untimed = fifo->count;
+    }
+    return count;
+}
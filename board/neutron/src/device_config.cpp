@@ -140,9 +140,13 @@ bool DeviceConfig::process( void )
     bool _isConfigSuccessful=false;
     while(available())
     {
+        if(root!=NULL)
+        {
+            aJson.deleteDocument(root);
+        }
         String tmp=readString();
         MO_DEBUG(("config read data:%s\r\n",tmp.c_str()));
-        root = aJson.parse((char *)tmp.c_str());
+        root = aJson.parseDocument(tmp.c_str());
         if (root == NULL)
         {break;}
         aJsonObject* command_Object = aJson.getObjectItem(root, "command");
@@ -247,7 +251,7 @@ bool DeviceConfig::process( void )
     }
     if(root!=NULL)
     {
-        aJson.deleteItem(root);
+        aJson.deleteDocument(root);
     }
 
     if(_isConfigSuccessful)
@@ -271,16 +275,16 @@ bool DeviceConfig::process( void )
  **********************************************************************************/
 void DeviceConfig::sendComfirm(int status)
 {
-    aJsonObject* root = aJson.createObject();
-    if (root == NULL)
-    {return;}
+    char string[32];
+    aJsonWriter json(string, sizeof(string));
 
-    aJson.addNumberToObject(root, "status", status);
-    char* string = aJson.print(root);
-    write((unsigned char *)string, strlen(string));
+    json.beginObject();
+    json.addNumber("status", status);
+    json.endObject();
+    if (json.c_str() == NULL)
+    {return;}
+    write((unsigned char *)string, json.length());
     MO_DEBUG(("sendComfirm: %s\r\n",string));
-    vPortFree(string);
-    aJson.deleteItem(root);
 }
 
 /*********************************************************************************
@@ -295,35 +299,35 @@ void DeviceConfig::sendComfirm(int status)
  **********************************************************************************/
 void DeviceConfig::sendDeviceInfo(void)
 {
-    aJsonObject* root = aJson.createObject();
-    if (root == NULL)
-    {return;}
+    char string[128];
+    aJsonWriter json(string, sizeof(string));
 
-    aJson.addNumberToObject(root, "status", 200);
+    json.beginObject();
+    json.addNumber("status", 200);
     //intorobot atom
     char device_id[25], board[7];
     if ((char)0x1 != intorobot_system_param.at_mode) {
-        aJson.addStringToObject(root, "board", INTOROBOT_BOARD_TYPE2);
-        aJson.addNumberToObject(root, "at_mode", 0);
+        json.addString("board", INTOROBOT_BOARD_TYPE2);
+        json.addNumber("at_mode", 0);
     }
     else {
         memset(board, 0, sizeof(board));
         memcpy(board, intorobot_system_param.device_id, 6);
         if(0 == strcmp(board, INTOROBOT_BOARD_TYPE2)) {
-            aJson.addStringToObject(root, "board", INTOROBOT_BOARD_TYPE2);
+            json.addString("board", INTOROBOT_BOARD_TYPE2);
         } else {
-            aJson.addStringToObject(root, "board", INTOROBOT_BOARD_TYPE1);
+            json.addString("board", INTOROBOT_BOARD_TYPE1);
         }
         memset(device_id, 0, sizeof(device_id));
         memcpy(device_id, intorobot_system_param.device_id, 24);
-        aJson.addStringToObject(root, "device_id", device_id);
-        aJson.addNumberToObject(root, "at_mode", 1);
+        json.addString("device_id", device_id);
+        json.addNumber("at_mode", 1);
     }
-    char* string = aJson.print(root);
-    write((unsigned char *)string, strlen(string));
+    json.endObject();
+    if (json.c_str() == NULL)
+    {return;}
+    write((unsigned char *)string, json.length());
     MO_DEBUG(("send device info: %s\r\n",string));
-    vPortFree(string);
-    aJson.deleteItem(root);
 }
 
 /*********************************************************************************
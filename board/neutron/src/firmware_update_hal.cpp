@@ -46,6 +46,7 @@ extern void mo_system_reboot_hal();
 */
 //cmd:AT+MDSET="md5:32bytes"
 //cmd:AT+DOWNFW="http://www.intorobot.com/v1/bin?dwn_token=32bytes"
+//下载的可以是完整固件或者差分包, 差分包由esp8266还原并校验CRC后才算下载成功
 int mo_FirmwareUpdateClass_st_firmware_down_hal(const char *domain, const char *param, const char * md5)
 {
     String server_down_cmd = "AT+DOWNFILE=";
@@ -158,6 +158,7 @@ IntorobotClass::IntorobotClass(void)
     memset(&Debug_rx_buffer,0,sizeof(Debug_rx_buffer));
 
     ApiMqttClient = MqttClientClass((char *)INTOROBOT_SERVER_DOMAIN, INTOROBOT_SERVER_PORT, apiMqttClientCallBack, mqtttcpclient);
+    ApiMqttClient.setStreamCallback(apiMqttClientStreamCallBack);
 }
 
 /*********************************************************************************
@@ -222,69 +223,49 @@ uint8_t IntorobotClass::publish(const char *topic, char payload)
 
 uint8_t IntorobotClass::publish(const char *topic, uint8_t payload)
 {
-    String tmp;
-    tmp += payload;
-    return publish(topic, (uint8_t *)tmp.c_str(), strlen(tmp.c_str()), 0, true);
+    return publish_integer(topic, payload, false);
 }
 
 uint8_t IntorobotClass::publish(const char *topic, short int payload)
 {
-    String tmp;
-    tmp += payload;
-    return publish(topic, (uint8_t *)tmp.c_str(), strlen(tmp.c_str()), 0, true);
+    return publish(topic, (long)payload);
 }
 
 uint8_t IntorobotClass::publish(const char *topic, unsigned short int payload)
 {
-    String tmp;
-    tmp += payload;
-    return publish(topic, (uint8_t *)tmp.c_str(), strlen(tmp.c_str()), 0, true);
+    return publish_integer(topic, payload, false);
 }
 
 uint8_t IntorobotClass::publish(const char *topic, int payload)
 {
-    String tmp;
-    tmp += payload;
-    return publish(topic, (uint8_t *)tmp.c_str(), strlen(tmp.c_str()), 0, true);
+    return publish(topic, (long)payload);
 }
 
 uint8_t IntorobotClass::publish(const char *topic, unsigned int payload)
 {
-    String tmp;
-    tmp += payload;
-    return publish(topic, (uint8_t *)tmp.c_str(), strlen(tmp.c_str()), 0, true);
+    return publish_integer(topic, payload, false);
 }
 
 uint8_t IntorobotClass::publish(const char *topic, long payload)
 {
-    String tmp;
-    tmp += payload;
-    return publish(topic, (uint8_t *)tmp.c_str(), strlen(tmp.c_str()), 0, true);
+    if(payload < 0)
+    {return publish_integer(topic, 0UL - (unsigned long)payload, true);}
+    return publish_integer(topic, payload, false);
 }
 
 uint8_t IntorobotClass::publish(const char *topic, unsigned long payload)
 {
-    String tmp;
-    tmp += payload;
-    return publish(topic, (uint8_t *)tmp.c_str(), strlen(tmp.c_str()), 0, true);
-
+    return publish_integer(topic, payload, false);
 }
 
 uint8_t IntorobotClass::publish(const char *topic, float payload)
 {
-    char tmp[128];
-    memset(tmp,0,sizeof(tmp));
-    sprintf(tmp, "%.2f", payload);
-    return IntoRobot.publish(topic, tmp);
+    return publish_double(topic, payload);
 }
 
 uint8_t IntorobotClass::publish(const char *topic, double payload)
 {
-    char tmp[128];
-    memset(tmp,0,sizeof(tmp));
-    sprintf(tmp, "%.2f", payload);
-    return IntoRobot.publish(topic, tmp);
-
+    return publish_double(topic, payload);
 }
 
 uint8_t IntorobotClass::publish(const char *topic, String payload)
@@ -349,10 +330,225 @@ uint8_t IntorobotClass::publish(const char* topic, uint8_t* payload, unsigned in
  **********************************************************************************/
 uint8_t IntorobotClass::publish(const char* topic, uint8_t* payload, unsigned int plength, uint8_t qos, uint8_t retained)
 {
-    String fulltopic;
-    fill_mqtt_topic(fulltopic, topic, NULL);
-    MO_DEBUG(("%s",fulltopic.c_str()));
-    return ApiMqttClient.publish(fulltopic.c_str(), payload, plength, qos, retained);
+    uint16_t room;
+    uint8_t *pdata = ApiMqttClient.beginPublish(mqtt_topic_prefix, topic, qos, &room);
+
+    if(pdata == NULL)
+    {
+        return false;
+    }
+    if(plength > room)
+    {
+        ApiMqttClient.cancelPublish();
+        //qos0 大消息直接从用户内存发送
+        if(qos == 0)
+        {return ApiMqttClient.publishStream(mqtt_topic_prefix, topic, payload, plength, retained);}
+        MO_ERROR(("qos%d publish too long %d", qos, plength));
+        return false;
+    }
+    memcpy(pdata, payload, plength);
+    return ApiMqttClient.endPublish(plength, retained);
+}
+
+/*********************************************************************************
+ *Function		:      uint8_t IntorobotClass::publishStream()
+ *Description	:      qos0 publish of a payload of any length produced chunk by chunk
+ *Input              :      plength: total payload length   reader: fills the next chunk   arg: passed to reader
+ *Output		:
+ *Return		:
+ *author		:
+ *date			:
+ *Others		:
+ **********************************************************************************/
+uint8_t IntorobotClass::publishStream(const char* topic, uint32_t plength, mqtt_payload_reader_t reader, void *arg, uint8_t retained)
+{
+    return ApiMqttClient.publishStream(mqtt_topic_prefix, topic, plength, reader, arg, retained);
+}
+
+/*********************************************************************************
+ *Function		:      uint8_t IntorobotClass::publish(const char* topic, aJsonWriterCallback writer, void *arg)
+ *Description	:      publish json written by writer straight into the mqtt packet buffer
+ *Input              :      writer: fills the aJsonWriter, a lambda without captures will do   arg: passed to writer
+ *Output		:
+ *Return		:
+ *author		:      robot
+ *date			:      2016-05-20
+ *Others		:      IntoRobot.publish(topic, [](aJsonWriter &json, void *arg){ json.beginObject(); ... json.endObject(); }, NULL);
+ **********************************************************************************/
+uint8_t IntorobotClass::publish(const char* topic, aJsonWriterCallback writer, void *arg)
+{
+    return publish(topic, writer, arg, 0, true);
+}
+
+/*********************************************************************************
+ *Function		:      uint8_t IntorobotClass::publish(const char* topic, aJsonWriterCallback writer, void *arg, uint8_t qos, uint8_t retained)
+ *Description	:      publish json written by writer straight into the mqtt packet buffer
+ *Input              :
+ *Output		:
+ *Return		:      false if not connected or the json does not fit in the packet
+ *author		:      robot
+ *date			:      2016-05-20
+ *Others		:
+ **********************************************************************************/
+uint8_t IntorobotClass::publish(const char* topic, aJsonWriterCallback writer, void *arg, uint8_t qos, uint8_t retained)
+{
+    uint16_t room;
+    uint8_t *pdata = ApiMqttClient.beginPublish(mqtt_topic_prefix, topic, qos, &room);
+
+    if(pdata == NULL)
+    {
+        return false;
+    }
+    aJsonWriter json((char *)pdata, room);
+    writer(json, arg);
+    if(json.overflow())
+    {
+        ApiMqttClient.cancelPublish();
+        MO_ERROR(("json publish longer than %d", room));
+        return false;
+    }
+    return ApiMqttClient.endPublish(json.length(), retained);
+}
+
+/*********************************************************************************
+ *Function		:      static uint16_t format_unsigned(char *buf, uint16_t room, unsigned long value, bool negative)
+ *Description	:      format a decimal integer in place
+ *Input              :      room: buffer size   negative: prepend '-'
+ *Output		:
+ *Return		:      the length written, 0 if there is no room
+ *author		:
+ *date			:
+ *Others		:
+ **********************************************************************************/
+static uint16_t format_unsigned(char *buf, uint16_t room, unsigned long value, bool negative)
+{
+    char digits[20];
+    uint8_t n = 0;
+    uint16_t len = 0;
+
+    do
+    {
+        digits[n++] = '0' + (value % 10);
+        value /= 10;
+    }while(value);
+
+    if((n + (negative ? 1 : 0)) > room)
+    {
+        return 0;
+    }
+    if(negative)
+    {buf[len++] = '-';}
+    while(n)
+    {buf[len++] = digits[--n];}
+    return len;
+}
+
+/*********************************************************************************
+ *Description	:      format a number with two decimals in place, as "%.2f", large magnitudes as "%e"
+ *Description	:      format a number with two decimals in place, as "%.2f"
+ *Input              :      room: buffer size
+ *Output		:
+ *Return		:      the length written, 0 if there is no room
+ *author		:
+ *date			:
+ *Others		:      printf 的浮点格式化会申请堆内存, 只有 nan/inf 和整数部分超出32位时才使用
+ *                      整数部分超出32位时使用指数格式, 避免 %f 输出几百位数字
+ **********************************************************************************/
+static uint16_t format_double(char *buf, uint16_t room, double value)
+{
+    bool negative = false;
+    uint32_t ipart;
+    uint8_t fpart;
+    uint16_t len;
+    int n;
+
+    if(value != value)
+    {
+        n = snprintf(buf, room, "%.2f", value);
+        return ((n > 0) && (n < room)) ? n : 0;
+    }
+
+    //先取符号, 再按绝对值检查范围
+    if(value < 0)
+    {
+        negative = true;
+        value = -value;
+    }
+    if(value >= 4294967295.0)
+    {
+        n = snprintf(buf, room, negative ? "-%e" : "%e", value);
+        return ((n > 0) && (n < room)) ? n : 0;
+    }
+
+    value += 0.005;
+    ipart = (uint32_t)value;
+    fpart = (uint8_t)((value - ipart) * 100);
+
+    len = format_unsigned(buf, room, ipart, negative);
+    if((len == 0) || ((len + 3) > room))
+    {
+        return 0;
+    }
+    buf[len++] = '.';
+    buf[len++] = '0' + (fpart / 10);
+    buf[len++] = '0' + (fpart % 10);
+    return len;
+}
+
+/*********************************************************************************
+ *Function		:      uint8_t IntorobotClass::publish_integer(const char *topic, unsigned long value, bool negative)
+ *Description	:      publish a decimal integer formatted straight into the mqtt packet buffer
+ *Input              :
+ *Output		:
+ *Return		:
+ *author		:
+ *date			:
+ *Others		:
+ **********************************************************************************/
+uint8_t IntorobotClass::publish_integer(const char *topic, unsigned long value, bool negative)
+{
+    uint16_t room, len;
+    uint8_t *pdata = ApiMqttClient.beginPublish(mqtt_topic_prefix, topic, 0, &room);
+
+    if(pdata == NULL)
+    {
+        return false;
+    }
+    len = format_unsigned((char *)pdata, room, value, negative);
+    if(len == 0)
+    {
+        ApiMqttClient.cancelPublish();
+        return false;
+    }
+    return ApiMqttClient.endPublish(len, true);
+}
+
+/*********************************************************************************
+ *Function		:      uint8_t IntorobotClass::publish_double(const char *topic, double value)
+ *Description	:      publish a number with two decimals formatted straight into the mqtt packet buffer
+ *Input              :
+ *Output		:
+ *Return		:
+ *author		:
+ *date			:
+ *Others		:
+ **********************************************************************************/
+uint8_t IntorobotClass::publish_double(const char *topic, double value)
+{
+    uint16_t room, len;
+    uint8_t *pdata = ApiMqttClient.beginPublish(mqtt_topic_prefix, topic, 0, &room);
+
+    if(pdata == NULL)
+    {
+        return false;
+    }
+    len = format_double((char *)pdata, room, value);
+    if(len == 0)
+    {
+        ApiMqttClient.cancelPublish();
+        return false;
+    }
+    return ApiMqttClient.endPublish(len, true);
 }
 
 
@@ -425,6 +621,39 @@ uint8_t IntorobotClass::subscribe(const char* topic, const char *device_id, void
     return ApiMqttClient.subscribe(fulltopic.c_str(), qos);
 }
 
+/*********************************************************************************
+ *Function		:     uint8_t IntorobotClass::subscribe()
+ *Description	:     subscribe a topic whose payload is delivered in chunks
+ *Input              :
+ *Output		:
+ *Return		:
+ *author		:
+ *date			:
+ *Others		:
+ **********************************************************************************/
+uint8_t IntorobotClass::subscribe(const char* topic, const char *device_id, void (*callback)(uint8_t*, uint32_t, uint32_t, uint32_t))
+{
+    return subscribe(topic, device_id, callback, 0);
+}
+
+/*********************************************************************************
+ *Function		:     uint8_t IntorobotClass::subscribe()
+ *Description	:     subscribe a topic whose payload is delivered in chunks
+ *Input              :     callback: (chunk, length, offset, total)
+ *Output		:
+ *Return		:
+ *author		:
+ *date			:
+ *Others		:     messages larger than MQTT_MAX_PACKET_SIZE are only delivered to such subscriptions
+ **********************************************************************************/
+uint8_t IntorobotClass::subscribe(const char* topic, const char *device_id, void (*callback)(uint8_t*, uint32_t, uint32_t, uint32_t), uint8_t qos)
+{
+    String fulltopic;
+    addsubscallback((char *)topic, (char *)device_id, callback, qos);
+    fill_mqtt_topic(fulltopic, topic, device_id);
+    return ApiMqttClient.subscribe(fulltopic.c_str(), qos);
+}
+
 /*********************************************************************************
  *Function		:       uint8_t IntorobotClass::unsubscribe()
  *Description	:
@@ -614,6 +843,7 @@ void IntorobotClass::process(void)
                 intorobot_info_debug();
 
                 //信息填充
+                fill_mqtt_prefix();
                 fill_mqtt_topic(fulltopic, INTOROBOT_MQTT_WILLTOPIC, NULL);
                 //set intorobot server
                 if ((char)0xff == intorobot_system_param.sv_select)
@@ -734,6 +964,22 @@ void IntorobotClass::receiveDebug(uint8_t *pIn, uint32_t len)
     }
 }
 
+/*********************************************************************************
+ *Function		:   void IntorobotClass::fill_mqtt_prefix(void)
+ *Description	:   cache the topic prefix v1/<device_id>/ used by publish
+ *Input		:
+ *Output		:
+ *Return		:
+ *author		:
+ *date			:
+ *Others		:   called before every connect, the device id may change after activation
+ **********************************************************************************/
+void IntorobotClass::fill_mqtt_prefix(void)
+{
+    memset(mqtt_topic_prefix, 0, sizeof(mqtt_topic_prefix));
+    snprintf(mqtt_topic_prefix, sizeof(mqtt_topic_prefix), "%s/%s/", INTOROBOT_API_VER, intorobot_system_param.device_id);
+}
+
 /*********************************************************************************
  *Function		:   void IntorobotClass::fill_mqtt_topic(String &fulltopic, const char *topic, const char *device_id)
  *Description	:   fill mqtt topic
@@ -898,68 +1144,204 @@ String deviceSn(void)
     return deviceID;
 }
 
+/*
+  订阅回调表:
+  1. 订阅时生成完整topic(v1/<device_id>/<topic>)并计算hash, 收到消息时只需一次hash查找
+  2. 含 + 或 # 通配符的订阅不进hash桶, 精确匹配失败后再逐个按MQTT规则匹配
+  3. 节点数组和hash桶按2倍扩容, 容量始终为2的幂
+  4. 回调表在用户任务中修改, 在intorobot_loop任务中查找, 用mutex_callbacklist保护
+     mutex_callbacklist 在 mo_intorobot_init 中创建任务之前建立
+  5. 内存与负载拷贝一样使用 FreeRTOS 堆(pvPortMalloc/vPortFree)
+*/
+static osMutexId mutex_callbacklist;
+
+static void callbacklist_lock(void)
+{
+    osMutexWait(mutex_callbacklist, osWaitForever);
+}
+
+static void callbacklist_unlock(void)
+{
+    osMutexRelease(mutex_callbacklist);
+}
+
+static uint32_t topic_hash(const char *topic)
+{
+    uint32_t hash = 2166136261UL;   //FNV-1a
+
+    while(*topic)
+    {
+        hash ^= (uint8_t)(*topic++);
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
 /*********************************************************************************
- *Function		:     CB getsubcallback(char * fulltopic)
- *Description	:
+ *Function		:     static bool topic_match(const char *filter, const char *topic)
+ *Description	:     match a topic against a subscription with + and # wildcards
+ *Input              :     filter: the subscribed full topic   topic: the received topic
+ *Output		:
+ *Return		:     true if matched
+ *author		:
+ *date			:
+ *Others		:     '+' matches exactly one level, '#' matches the parent and all sub levels
+ **********************************************************************************/
+static bool topic_match(const char *filter, const char *topic)
+{
+    while(*filter)
+    {
+        if(*filter == '#')
+        {
+            return true;
+        }
+        else if(*filter == '+')
+        {
+            while((*topic != '\0') && (*topic != '/'))
+            {
+                topic++;
+            }
+            filter++;
+        }
+        else if(*topic == '\0')
+        {
+            // "a/#" 同时匹配 "a"
+            return (0 == strcmp(filter, "/#"));
+        }
+        else if(*filter++ != *topic++)
+        {
+            return false;
+        }
+    }
+    return (*topic == '\0');
+}
+
+/*********************************************************************************
+ *Function		:     static char *build_fulltopic(const char *topic, const char *device_id)
+ *Description	:     pvPortMalloc the full topic v1/<device_id>/<topic>
  *Input              :
  *Output		:
- *Return		:
+ *Return		:     the full topic, NULL if out of memory
  *author		:
  *date			:
  *Others		:
  **********************************************************************************/
-CB getsubcallback(char * fulltopic)
+static char *build_fulltopic(const char *topic, const char *device_id)
 {
-    char topictmp[128]={0};
+    char *fulltopic;
+    int len;
 
-    for (int i = 0 ; i < callbacklist.total_callbacks; i++)
+    if(device_id == NULL)
+    {device_id = intorobot_system_param.device_id;}
+    len = strlen(INTOROBOT_API_VER) + strlen(device_id) + strlen(topic) + 3;
+    fulltopic = (char *)pvPortMalloc(len);
+    if(fulltopic != NULL)
     {
-        memset(topictmp, 0, sizeof(topictmp));
-        if(callbacklist.callbacknode[i].device_id == NULL)
-        {sprintf(topictmp,"%s/%s/", INTOROBOT_API_VER, intorobot_system_param.device_id);}
-        else
-        {sprintf(topictmp,"%s/%s/", INTOROBOT_API_VER, callbacklist.callbacknode[i].device_id);}
-        strcat(topictmp,callbacklist.callbacknode[i].topic);
-        if (strcmp(fulltopic, topictmp) == 0)
-        {
-            return callbacklist.callbacknode[i].callback;
-        }
+        sprintf(fulltopic, "%s/%s/%s", INTOROBOT_API_VER, device_id, topic);
     }
-    return NULL;
+    return fulltopic;
 }
 
 /*********************************************************************************
- *Function		:     CB getsubcallback(char * fulltopic)
- *Description	:
- *Input		      :
+ *Function		:     static void callbacklist_rehash(void)
+ *Description	:     rebuild the hash buckets of the exact topics
+ *Input              :
  *Output		:
  *Return		:
  *author		:
  *date			:
- *Others		:
+ *Others		:     called with the list locked after any change of the nodes
  **********************************************************************************/
-WidgetBaseClass *getsubwcallback(char * fulltopic)
+static void callbacklist_rehash(void)
 {
-    char topictmp[128]={0};
+    struct _callbacknode *node;
+    int i, index;
 
-    for (int i = 0 ; i < callbacklist.total_wcallbacks; i++)
+    for (i = 0 ; i < callbacklist.capacity; i++)
     {
-        memset(topictmp, 0, sizeof(topictmp));
-        if(callbacklist.wcallbacknode[i].device_id == NULL)
-        {sprintf(topictmp,"%s/%s/", INTOROBOT_API_VER, intorobot_system_param.device_id);}
-        else
-        {sprintf(topictmp,"%s/%s/", INTOROBOT_API_VER, callbacklist.wcallbacknode[i].device_id);}
-        strcat(topictmp,callbacklist.wcallbacknode[i].topic);
-        if (strcmp(fulltopic, topictmp) == 0)
+        callbacklist.bucket[i] = -1;
+    }
+    callbacklist.total_wildcards = 0;
+    for (i = 0 ; i < callbacklist.total_callbacks; i++)
+    {
+        node = &callbacklist.callbacknode[i];
+        node->next = -1;
+        if(node->wildcard)
         {
-            return callbacklist.wcallbacknode[i].pWidgetBase;
+            callbacklist.total_wildcards++;
+            continue;
         }
+        index = node->hash & (callbacklist.capacity - 1);
+        node->next = callbacklist.bucket[index];
+        callbacklist.bucket[index] = i;
     }
-    return NULL;
 }
+
 /*********************************************************************************
- *Function		:    void addsubcallback()
- *Description	:
+ *Function		:     static bool callbacklist_grow(void)
+ *Description	:     double the capacity of the callback list
+ *Input              :
+ *Output		:
+ *Return		:     false if out of memory, the list is unchanged
+ *author		:
+ *date			:
+ *Others		:
+ **********************************************************************************/
+static bool callbacklist_grow(void)
+{
+    int capacity = callbacklist.capacity ? callbacklist.capacity * 2 : CALLBACK_INIT_NUM;
+    struct _callbacknode *nodes;
+    int *bucket;
+
+    nodes = (struct _callbacknode *)pvPortMalloc(capacity * sizeof(struct _callbacknode));
+    bucket = (int *)pvPortMalloc(capacity * sizeof(int));
+    if((nodes == NULL) || (bucket == NULL))
+    {
+        vPortFree(nodes);
+        vPortFree(bucket);
+        return false;
+    }
+    if(callbacklist.total_callbacks)
+    {
+        memcpy(nodes, callbacklist.callbacknode, callbacklist.total_callbacks * sizeof(struct _callbacknode));
+    }
+    vPortFree(callbacklist.callbacknode);
+    vPortFree(callbacklist.bucket);
+    callbacklist.callbacknode = nodes;
+    callbacklist.bucket = bucket;
+    callbacklist.capacity = capacity;
+    callbacklist_rehash();
+    return true;
+}
+
+/*********************************************************************************
+ *Function		:     static bool callbacklist_set_topic(struct _callbacknode *node)
+ *Description	:     (re)build the full topic of the node
+ *Input              :
+ *Output		:
+ *Return		:     false if out of memory
+ *author		:
+ *date			:
+ *Others		:     the device id may change after activation, so it is rebuilt on every subscribe
+ **********************************************************************************/
+static bool callbacklist_set_topic(struct _callbacknode *node)
+{
+    char *fulltopic = build_fulltopic(node->topic, node->device_id);
+
+    if(fulltopic == NULL)
+    {
+        return false;
+    }
+    vPortFree(node->fulltopic);
+    node->fulltopic = fulltopic;
+    node->hash = topic_hash(fulltopic);
+    node->wildcard = (strpbrk(fulltopic, "+#") != NULL);
+    return true;
+}
+
+/*********************************************************************************
+ *Function		:     static void addsubnode()
+ *Description	:     add or update a callback node keyed on (topic, device_id)
  *Input              :
  *Output		:
  *Return		:
@@ -967,40 +1349,155 @@ WidgetBaseClass *getsubwcallback(char * fulltopic)
  *date			:
  *Others		:
  **********************************************************************************/
-void addsubcallback(char *topic, char *device_id, void (*callback)(uint8_t*, uint32_t), uint8_t qos)
+static void addsubnode(char *topic, char *device_id, void (*callback)(uint8_t*, uint32_t), WidgetBaseClass *pWidgetBase,
+                       void (*streamcallback)(uint8_t*, uint32_t, uint32_t, uint32_t), uint8_t qos)
 {
-    int if_found_topic = 0;
-    int i = 0;
+    struct _callbacknode *node = NULL;
+    int i;
 
+    callbacklist_lock();
     for (i = 0 ; i < callbacklist.total_callbacks; i++)
     {
         if ((topic == callbacklist.callbacknode[i].topic)&&(device_id == callbacklist.callbacknode[i].device_id))
         {
-            if_found_topic = 1;
+            node = &callbacklist.callbacknode[i];
             break;
         }
     }
 
-    if (if_found_topic)
+    if (node == NULL)
     {
-        callbacklist.callbacknode[i].callback = callback;
-        callbacklist.callbacknode[i].qos = qos;
+        if ((callbacklist.total_callbacks == callbacklist.capacity) && !callbacklist_grow())
+        {
+            MO_ERROR(("callback list out of memory"));
+            callbacklist_unlock();
+            return;
+        }
+        node = &callbacklist.callbacknode[callbacklist.total_callbacks];
+        memset(node, 0, sizeof(struct _callbacknode));
+        node->topic = topic;
+        node->device_id = device_id;
+        if(!callbacklist_set_topic(node))
+        {
+            MO_ERROR(("callback list out of memory"));
+            callbacklist_unlock();
+            return;
+        }
+        callbacklist.total_callbacks ++;
     }
     else
     {
-        if (callbacklist.total_callbacks == MAX_CALLBACK_NUM)
+        callbacklist_set_topic(node);
+    }
+
+    if(callback != NULL)
+    {node->callback = callback;}
+    if(pWidgetBase != NULL)
+    {node->pWidgetBase = pWidgetBase;}
+    if(streamcallback != NULL)
+    {node->streamcallback = streamcallback;}
+    node->qos = qos;
+    callbacklist_rehash();
+    callbacklist_unlock();
+}
+
+/*********************************************************************************
+ *Function		:     static bool callbacklist_match(int i, const char *fulltopic, uint32_t hash, struct _subcallback *pSubCallBack)
+ *Description	:     test a node against the received topic and copy its callbacks
+ *Input              :     i: the node index   pSubCallBack: NULL to count only
+ *Output		:
+ *Return		:     true if matched
+ *author		:
+ *date			:
+ *Others		:     called with the list locked
+ **********************************************************************************/
+static bool callbacklist_match(int i, const char *fulltopic, uint32_t hash, struct _subcallback *pSubCallBack)
+{
+    struct _callbacknode *node = &callbacklist.callbacknode[i];
+
+    if(node->wildcard)
+    {
+        if(!topic_match(node->fulltopic, fulltopic))
+        {return false;}
+    }
+    else if((node->hash != hash) || (strcmp(fulltopic, node->fulltopic) != 0))
+    {
+        return false;
+    }
+
+    if(pSubCallBack != NULL)
+    {
+        pSubCallBack->callback = node->callback;
+        pSubCallBack->pWidgetBase = node->pWidgetBase;
+        pSubCallBack->streamcallback = node->streamcallback;
+    }
+    return true;
+}
+
+/*********************************************************************************
+ *Function		:     int getsubcallback(char * fulltopic, struct _subcallback **ppSubCallBack)
+ *Description	:     find the callbacks of every subscription matching the received topic
+ *Input              :     fulltopic: the received topic
+ *Output		:     ppSubCallBack: the matched callbacks, free with vPortFree, NULL if none
+ *Return		:     the number of matched subscriptions
+ *author		:
+ *date			:
+ *Others		:     exact topics are looked up by hash, then all wildcard subscriptions are tried
+ *                      the callbacks are copied so they run unlocked and may (un)subscribe
+ **********************************************************************************/
+int getsubcallback(char * fulltopic, struct _subcallback **ppSubCallBack)
+{
+    struct _subcallback *matched = NULL;
+    uint32_t hash = topic_hash(fulltopic);
+    int i, pass, total = 0;
+
+    callbacklist_lock();
+    //第一遍计数, 第二遍拷贝
+    for(pass = 0; pass < 2; pass++)
+    {
+        total = 0;
+        if(callbacklist.total_callbacks)
         {
-            return;
+            for (i = callbacklist.bucket[hash & (callbacklist.capacity - 1)]; i >= 0; i = callbacklist.callbacknode[i].next)
+            {
+                if(callbacklist_match(i, fulltopic, hash, matched ? &matched[total] : NULL))
+                {total++;}
+            }
         }
-        else
+        for (i = 0 ; (callbacklist.total_wildcards) && (i < callbacklist.total_callbacks); i++)
         {
-            callbacklist.callbacknode[callbacklist.total_callbacks].callback = callback;
-            callbacklist.callbacknode[callbacklist.total_callbacks].qos = qos;
-            callbacklist.callbacknode[callbacklist.total_callbacks].topic = topic;
-            callbacklist.callbacknode[callbacklist.total_callbacks].device_id= device_id;
-            callbacklist.total_callbacks ++;
+            if(callbacklist.callbacknode[i].wildcard && callbacklist_match(i, fulltopic, hash, matched ? &matched[total] : NULL))
+            {total++;}
+        }
+
+        if((total == 0) || (matched != NULL))
+        {break;}
+        matched = (struct _subcallback *)pvPortMalloc(total * sizeof(struct _subcallback));
+        if(matched == NULL)
+        {
+            MO_ERROR(("callback list out of memory"));
+            total = 0;
+            break;
         }
     }
+    callbacklist_unlock();
+    *ppSubCallBack = matched;
+    return total;
+}
+
+/*********************************************************************************
+ *Function		:    void addsubcallback()
+ *Description	:
+ *Input              :
+ *Output		:
+ *Return		:
+ *author		:
+ *date			:
+ *Others		:
+ **********************************************************************************/
+void addsubcallback(char *topic, char *device_id, void (*callback)(uint8_t*, uint32_t), uint8_t qos)
+{
+    addsubnode(topic, device_id, callback, NULL, NULL, qos);
 }
 
 /*********************************************************************************
@@ -1015,38 +1512,22 @@ void addsubcallback(char *topic, char *device_id, void (*callback)(uint8_t*, uin
 **********************************************************************************/
 void addsubwcallback(char *topic, char *device_id, WidgetBaseClass *pWidgetBase, uint8_t qos)
 {
-    int if_found_topic = 0;
-    int i = 0;
-
-    for (i = 0 ; i < callbacklist.total_wcallbacks; i++)
-    {
-        if ((topic == callbacklist.wcallbacknode[i].topic)&&(device_id == callbacklist.wcallbacknode[i].device_id))
-        {
-            if_found_topic = 1;
-            break;
-        }
-    }
+    addsubnode(topic, device_id, NULL, pWidgetBase, NULL, qos);
+}
 
-    if (if_found_topic)
-    {
-        callbacklist.wcallbacknode[i].pWidgetBase = pWidgetBase;
-        callbacklist.wcallbacknode[i].qos = qos;
-    }
-    else
-    {
-        if (callbacklist.total_wcallbacks == MAX_CALLBACK_NUM)
-        {
-            return;
-        }
-        else
-        {
-            callbacklist.wcallbacknode[callbacklist.total_wcallbacks].pWidgetBase = pWidgetBase;
-            callbacklist.wcallbacknode[callbacklist.total_wcallbacks].qos = qos;
-            callbacklist.wcallbacknode[callbacklist.total_wcallbacks].topic = topic;
-            callbacklist.wcallbacknode[callbacklist.total_wcallbacks].device_id= device_id;
-            callbacklist.total_wcallbacks ++;
-        }
-    }
+/*********************************************************************************
+  *Function		:    void addsubscallback()
+  *Description	:
+  *Input		      :
+  *Output		:
+  *Return		:
+  *author		:
+  *date			:
+  *Others		:
+**********************************************************************************/
+void addsubscallback(char *topic, char *device_id, void (*callback)(uint8_t*, uint32_t, uint32_t, uint32_t), uint8_t qos)
+{
+    addsubnode(topic, device_id, NULL, NULL, callback, qos);
 }
 
 /*********************************************************************************
@@ -1061,27 +1542,19 @@ void addsubwcallback(char *topic, char *device_id, WidgetBaseClass *pWidgetBase,
  **********************************************************************************/
 void delsubcallback(char * topic, char *device_id)
 {
+    callbacklist_lock();
     for (int i = 0 ; i < callbacklist.total_callbacks; i++)
     {
         if ((topic == callbacklist.callbacknode[i].topic) && (device_id == callbacklist.callbacknode[i].device_id))
         {
-            memcpy(&callbacklist.callbacknode[i], &callbacklist.callbacknode[i+1], (callbacklist.total_callbacks - 1 - i) * sizeof(struct _callbacknode));
-            memset(&callbacklist.callbacknode[callbacklist.total_callbacks-1], 0, sizeof(struct _callbacknode));
+            vPortFree(callbacklist.callbacknode[i].fulltopic);
+            memmove(&callbacklist.callbacknode[i], &callbacklist.callbacknode[i+1], (callbacklist.total_callbacks - 1 - i) * sizeof(struct _callbacknode));
             callbacklist.total_callbacks--;
-            return;
-        }
-    }
-
-    for (int i = 0 ; i < callbacklist.total_wcallbacks; i++)
-    {
-        if ((topic == callbacklist.wcallbacknode[i].topic) && (device_id == callbacklist.wcallbacknode[i].device_id))
-        {
-            memcpy(&callbacklist.wcallbacknode[i], &callbacklist.wcallbacknode[i+1], (callbacklist.total_wcallbacks - 1 - i) * sizeof(struct _wcallbacknode));
-            memset(&callbacklist.wcallbacknode[callbacklist.total_wcallbacks-1], 0, sizeof(struct _wcallbacknode));
-            callbacklist.total_wcallbacks--;
-            return;
+            callbacklist_rehash();
+            break;
         }
     }
+    callbacklist_unlock();
 }
 
 /*********************************************************************************
@@ -1096,16 +1569,26 @@ void delsubcallback(char * topic, char *device_id)
  **********************************************************************************/
 void resubscribe(void)
 {
-    for (int i = 0 ; i < callbacklist.total_callbacks; i++)
-    {
-        IntoRobot.subscribe(callbacklist.callbacknode[i].topic, callbacklist.callbacknode[i].device_id,
-                            callbacklist.callbacknode[i].callback, callbacklist.callbacknode[i].qos);
-    }
+    struct _callbacknode node;
 
-    for (int i = 0 ; i < callbacklist.total_wcallbacks; i++)
+    for (int i = 0 ; ; i++)
     {
-        IntoRobot.subscribe(callbacklist.wcallbacknode[i].topic, callbacklist.wcallbacknode[i].device_id,
-                            callbacklist.wcallbacknode[i].pWidgetBase, callbacklist.wcallbacknode[i].qos);
+        //subscribe 会修改回调表, 这里拷贝节点后解锁
+        callbacklist_lock();
+        if(i >= callbacklist.total_callbacks)
+        {
+            callbacklist_unlock();
+            break;
+        }
+        node = callbacklist.callbacknode[i];
+        callbacklist_unlock();
+
+        if(node.callback != NULL)
+        {IntoRobot.subscribe(node.topic, node.device_id, node.callback, node.qos);}
+        else if(node.pWidgetBase != NULL)
+        {IntoRobot.subscribe(node.topic, node.device_id, node.pWidgetBase, node.qos);}
+        else
+        {IntoRobot.subscribe(node.topic, node.device_id, node.streamcallback, node.qos);}
     }
 }
 
@@ -1123,26 +1606,65 @@ void apiMqttClientCallBack(char *topic, uint8_t *payload, uint32_t length)
 {
     MO_DEBUG(("apiMqttClientCallBack"));
     uint8_t *pData = NULL;
-    CB CallBack=getsubcallback(topic);
-    if(CallBack!=NULL)
+    struct _subcallback *pSubCallBack;
+    int i, total;
+
+    //消息交给所有匹配的订阅
+    total = getsubcallback(topic, &pSubCallBack);
+    for(i = 0; i < total; i++)
     {
-        pData = (uint8_t *)pvPortMalloc(length+1);
-        memset(pData, 0, length+1);
-        memcpy(pData, payload, length);
-        CallBack(pData,length);
-        vPortFree(pData);
+        if((pSubCallBack[i].callback != NULL) || (pSubCallBack[i].pWidgetBase != NULL))
+        {
+            pData = (uint8_t *)pvPortMalloc(length+1);
+            if(pData == NULL)
+            {
+                MO_ERROR(("callback payload out of memory"));
+                continue;
+            }
+            memset(pData, 0, length+1);
+            memcpy(pData, payload, length);
+            if(pSubCallBack[i].callback != NULL)
+            {pSubCallBack[i].callback(pData,length);}
+            else
+            {pSubCallBack[i].pWidgetBase->widgetBaseCallBack(pData,length);}
+            vPortFree(pData);
+        }
+
+        //小消息作为一个完整的块交给分块回调
+        if(pSubCallBack[i].streamcallback != NULL)
+        {
+            pSubCallBack[i].streamcallback(payload, length, 0, length);
+        }
     }
+    if(pSubCallBack != NULL)
+    {vPortFree(pSubCallBack);}
+}
 
+/*********************************************************************************
+ *Function		:    void apiMqttClientStreamCallBack(char *topic, uint8_t *chunk, uint32_t length, uint32_t offset, uint32_t total)
+ *Description	:    the mqtt client callback of messages larger than the packet buffer
+ *Input              :    chunk: part of the payload at offset   total: the payload length
+ *Output		:
+ *Return		:
+ *author		:
+ *date			:
+ *Others		:    only subscriptions made with a chunk callback receive them
+ **********************************************************************************/
+void apiMqttClientStreamCallBack(char *topic, uint8_t *chunk, uint32_t length, uint32_t offset, uint32_t total)
+{
+    struct _subcallback *pSubCallBack;
+    int i, matched;
 
-    WidgetBaseClass *pWidgetBase=getsubwcallback(topic);
-    if(pWidgetBase!=NULL)
+    matched = getsubcallback(topic, &pSubCallBack);
+    for(i = 0; i < matched; i++)
     {
-        pData = (uint8_t *)malloc(length+1);
-        memset(pData, 0, length+1);
-        memcpy(pData, payload, length);
-        pWidgetBase->widgetBaseCallBack(pData,length);
-        vPortFree(pData);
+        if(pSubCallBack[i].streamcallback != NULL)
+        {
+            pSubCallBack[i].streamcallback(chunk, length, offset, total);
+        }
     }
+    if(pSubCallBack != NULL)
+    {vPortFree(pSubCallBack);}
 }
 
 /*********************************************************************************
@@ -1168,6 +1690,29 @@ void syncTimeCallback(uint8_t *payload, uint32_t len)
 //    IntoRobot.unsubscribe(INTOROBOT_MQTT_TIMETOPIC, "service");
 }
 
+/*********************************************************************************
+ *Function		:   static void jsonStringCallback(const char *path, aJsonObject *value, void *arg)
+ *Description	:   aJsonReader callback, copy a string value to arg
+ *Input              :   arg: buffer of aJson_ReaderTokenSize bytes
+ *Output		:
+ *Return		:
+ *author		:   robot
+ *date			:   2016-05-20
+ *Others		:   a truncated value is not copied, arg stays empty
+ **********************************************************************************/
+static void jsonStringCallback(const char *path, aJsonObject *value, void *arg)
+{
+    if (value->type == aJson_String)
+    {
+        strncpy((char *)arg, value->valuestring, aJson_ReaderTokenSize - 1);
+    }
+    else if (value->type == aJson_ReaderTruncated)
+    {
+        // 截断的值不能使用, 保持为空
+        MO_ERROR(("%s longer than %d bytes", path, aJson_ReaderTokenSize - 1));
+    }
+}
+
 /*********************************************************************************
  *Function		:   void stm32FwUpdateCallback(uint8_t *payload, uint32_t len)
  *Description	:   the callback function of firmware update
@@ -1180,24 +1725,20 @@ void syncTimeCallback(uint8_t *payload, uint32_t len)
  **********************************************************************************/
 void stm32FwUpdateCallback(uint8_t *payload, uint32_t len)
 {
-    uint32_t n;
-    String s_payload="", domain="", param="";
-    aJsonClass aJson;
+    String domain="", param="";
+    char md5[aJson_ReaderTokenSize] = {0}, dtoken[aJson_ReaderTokenSize] = {0};
+    aJsonReader reader;
 
     MO_DEBUG(("default:FirmwareUpdateCallback"));
 
-    for(n=0; n<len; n++)
-    {s_payload+=(char)payload[n];}
-
     IntoRobot.publish(INTOROBOT_MQTT_RESPONSE_TOPIC, (uint8_t *)INTOROBOT_MQTT_RESMES_ST_FWUPREADY, strlen(INTOROBOT_MQTT_RESMES_ST_FWUPREADY),false);
-    aJsonObject *root = aJson.parse((char *)s_payload.c_str());
-    if (root != NULL)
+    reader.addFilter("md5", jsonStringCallback, md5);
+    reader.addFilter("dwn_token", jsonStringCallback, dtoken);
+    if (aJson_ReaderDone == reader.feed(payload, len))
     {
-        aJsonObject* md5_Object = aJson.getObjectItem(root, "md5");
-        if(md5_Object != NULL)
+        if(md5[0] != 0)
         {
-            aJsonObject* dtoken_Object = aJson.getObjectItem(root, "dwn_token");
-            if(dtoken_Object != NULL)
+            if(dtoken[0] != 0)
             {
                 //down the firmware
                 if ((char)0xff == intorobot_system_param.sv_select)
@@ -1210,19 +1751,15 @@ void stm32FwUpdateCallback(uint8_t *payload, uint32_t len)
                 }
                 param+=INTOROBOT_FW_UPDATE_URL;
                 param+="?dwn_token=";
-                param+=dtoken_Object->valuestring;
-                MO_DEBUG(("md5=%s,url=%s\r\n", md5_Object->valuestring,param.c_str()));
-                if(true==firmwareupdate.st_firmware_down(domain.c_str(), param.c_str(),  md5_Object->valuestring))
+                param+=dtoken;
+                MO_DEBUG(("md5=%s,url=%s\r\n", md5,param.c_str()));
+                if(true==firmwareupdate.st_firmware_down(domain.c_str(), param.c_str(),  md5))
                 {
                     IntoRobot.publish(INTOROBOT_MQTT_RESPONSE_TOPIC, (uint8_t *)INTOROBOT_MQTT_RESMES_ST_FWUPSUCC1, strlen(INTOROBOT_MQTT_RESMES_ST_FWUPSUCC1),false);
                     //IntoRobot.publish(INTOROBOT_MQTT_RESPONSE_TOPIC, (uint8_t *)INTOROBOT_MQTT_RESMES_ST_FWDOWNSUCC, strlen(INTOROBOT_MQTT_RESMES_ST_FWDOWNSUCC),false);
                     // Set boot_flag '4' for update the firmware
                     intorobot_system_param.system_flags.boot_flag = 4;
                     saveSystemParams(&intorobot_system_param);
-                    if (root != NULL)
-                    {
-                        aJson.deleteItem(root);
-                    }
                     // restart the stm32
                     mo_system_reboot_hal();
                     //HAL_NVIC_SystemReset();
@@ -1237,8 +1774,6 @@ void stm32FwUpdateCallback(uint8_t *payload, uint32_t len)
             }
         }
     }
-    if (root != NULL)
-    {aJson.deleteItem(root);}
     //download fall
     IntoRobot.publish(INTOROBOT_MQTT_RESPONSE_TOPIC, (uint8_t *)INTOROBOT_MQTT_RESMES_ST_FWDOWNFAIL, strlen(INTOROBOT_MQTT_RESMES_ST_FWDOWNFAIL),false);
     delay(500);
@@ -1587,6 +2122,10 @@ extern void mo_RGBClass_hal();
 
 void mo_intorobot_init()
 {
+    //订阅表的锁在任何任务订阅之前建立
+    osMutexDef(CB_MUT);
+    mutex_callbacklist = osMutexCreate(osMutex(CB_MUT));
+    MO_ASSERT((mutex_callbacklist!=NULL));
 
 #ifdef WIFI_HARDWARE_ENABLE
     osThreadDef(INB_LOOP, task_mo_intorobot_loop, osPriorityNormal, 0, 1024);
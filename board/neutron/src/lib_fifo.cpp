@@ -1,30 +1,45 @@
+
 #include <stdlib.h>
+#include <string.h>
 #include "application.h"
 #include "lib_fifo.h"
 #include "lib_system_all.h"
 #include "cmsis_os.h"
 
 //可读数据长度
-#define FIFO_AVALIABLE(fifo) ( (fifo->p_w >= fifo->p_r)?(fifo->p_w-fifo->p_r):(fifo->p_w + fifo->size - fifo->p_r) );
+#define FIFO_AVALIABLE(fifo) ((int)((fifo)->p_w - (fifo)->p_r))
 
+//DMA 覆盖了未读数据(可读长度超过size) 未读数据已不完整, 全部丢弃
+#define FIFO_RESYNC(fifo) {if(FIFO_AVALIABLE(fifo)>(fifo)->size) (fifo)->p_r=(fifo)->p_w;}
 
-#define FIFO_PW_NEXT(fifo) {fifo->p_w++;if(fifo->p_w == fifo->size) fifo->p_w = 0;}
-#define FIFO_PR_NEXT(fifo) {fifo->p_r++;if(fifo->p_r == fifo->size) fifo->p_r = 0;}
+//数据和位置之间的顺序  写入方先写数据再更新p_w  读取方先读数据再更新p_r
+#define FIFO_BARRIER() __sync_synchronize()
 
 
 
 /*
 成功 0
 失败 -1
+
+size 向上取整为2的幂
 */
 int fifo__init(fifo_t *fifo,int size)
 {
-  fifo->buf=(uint8_t *)pvPortMalloc(size);
+  int real_size=1;
+
+  while(real_size<size)
+  {
+    real_size<<=1;
+  }
+
+  fifo->buf=(uint8_t *)pvPortMalloc(real_size);
 	MO_ASSERT((fifo->buf!=NULL));
 
-  fifo->size=size;
+  fifo->size=real_size;
+  fifo->mask=real_size-1;
   fifo->p_w=0;
   fifo->p_r=0;
+  fifo->overflow=0;
 
 	if(fifo->buf==NULL)
 	{
@@ -44,49 +59,70 @@ void fifo__deinit(fifo_t *fifo)
 
 
 
-/*向FIFO 中写入数据 */
-__inline void fifo_put( fifo_t *fifo,uint8_t data)
+/*
+写入数据 最多写入空闲长度, 其余丢弃并计入overflow
+返回写入长度
+*/
+int fifo__write(fifo_t *fifo,const uint8_t *p_dat,int len)
 {
+  uint32_t p_w=fifo->p_w;
+  int free_len=fifo->size-(int)(p_w-fifo->p_r);
+  int off,first;
 
-  FIFO_PW_NEXT(fifo);
-  if(fifo->p_w == fifo->p_r)
+  if(len>free_len)
   {
-    FIFO_PR_NEXT(fifo);
+    fifo->overflow+=len-free_len;
+    len=free_len;
+  }
+  if(len<=0)
+  {
+    return 0;
   }
 
-  fifo->buf[fifo->p_w] = data;
-
-}
-
-/*从FIFO 中取出一个数据 */
-__inline unsigned char fifo_get(fifo_t *fifo)
-{
-  FIFO_PR_NEXT(fifo);
-  return (uint8_t)(fifo->buf[fifo->p_r]);
-}
-
-void fifo__write(fifo_t *fifo,const uint8_t *p_dat,int len)
-{
-  int i;
-  for(i=0;i<len;i++)
+  //最多分两段拷贝
+  off=p_w&fifo->mask;
+  first=fifo->size-off;
+  if(first>len)
   {
-    fifo_put(fifo,*(p_dat+i));
+    first=len;
   }
+  memcpy(fifo->buf+off,p_dat,first);
+  memcpy(fifo->buf,p_dat+first,len-first);
+
+  FIFO_BARRIER();
+  fifo->p_w=p_w+len;
+  return len;
 }
 
 int fifo__read(fifo_t *fifo,uint8_t *p_buf,int buf_size)
 {
-  int i,read_len,ava_len;
+  FIFO_RESYNC(fifo);
 
-  ava_len=FIFO_AVALIABLE(fifo);
+  uint32_t p_r=fifo->p_r;
+  int read_len=(int)(fifo->p_w-p_r);
+  int off,first;
 
-  read_len= ( buf_size <= ava_len )? buf_size: ava_len;
+  if(read_len>buf_size)
+  {
+    read_len=buf_size;
+  }
+  if(read_len<=0)
+  {
+    return 0;
+  }
 
-  for(i=0;i<read_len;i++)
+  FIFO_BARRIER();
+  off=p_r&fifo->mask;
+  first=fifo->size-off;
+  if(first>read_len)
   {
-    *(p_buf+i)=fifo_get(fifo);
+    first=read_len;
   }
+  memcpy(p_buf,fifo->buf+off,first);
+  memcpy(p_buf+first,fifo->buf,read_len-first);
 
+  FIFO_BARRIER();
+  fifo->p_r=p_r+read_len;
   return read_len;
 
 }
@@ -97,15 +133,92 @@ int fifo__avaliable(fifo_t *fifo)
 	return FIFO_AVALIABLE(fifo);
 }
 
+int fifo__free(fifo_t *fifo)
+{
+	return fifo->size-FIFO_AVALIABLE(fifo);
+}
 
+/*
+返回从读位置开始连续的可读长度(回绕处截断), *p_dat 指向数据
+处理完后调用 fifo__consume 释放
+*/
+int fifo__peek(fifo_t *fifo,uint8_t **p_dat)
+{
+  FIFO_RESYNC(fifo);
 
+  uint32_t p_r=fifo->p_r;
+  int len=(int)(fifo->p_w-p_r);
+  int off=p_r&fifo->mask;
 
+  if(len>fifo->size-off)
+  {
+    len=fifo->size-off;
+  }
+  FIFO_BARRIER();
+  *p_dat=fifo->buf+off;
+  return len;
+}
 
+void fifo__consume(fifo_t *fifo,int len)
+{
+  FIFO_BARRIER();
+  fifo->p_r+=len;
+}
 
+//丢弃全部可读数据 (读取方调用)
+void fifo__flush(fifo_t *fifo)
+{
+  FIFO_BARRIER();
+  fifo->p_r=fifo->p_w;
+}
 
+/*
+返回从写位置开始连续的空闲长度(回绕处截断), *p_buf 指向空闲空间
+写入后调用 fifo__commit 提交
+*/
+int fifo__reserve(fifo_t *fifo,uint8_t **p_buf)
+{
+  uint32_t p_w=fifo->p_w;
+  int len=fifo->size-(int)(p_w-fifo->p_r);
+  int off=p_w&fifo->mask;
 
+  if(len>fifo->size-off)
+  {
+    len=fifo->size-off;
+  }
+  *p_buf=fifo->buf+off;
+  return len;
+}
 
+void fifo__commit(fifo_t *fifo,int len)
+{
+  FIFO_BARRIER();
+  fifo->p_w+=len;
+}
 
+/*
+外部写入者(如循环模式DMA)直接写入buf, pos为其当前写位置(0~size-1)
+提交 p_w 到 pos 之间的新数据, 返回新数据长度
+写入者在两次调用之间写入必须少于size (DMA 用半满/全满中断保证)
+新数据超过空闲空间时未读数据已被覆盖, 计入overflow, 读取方下次读取时全部丢弃
+*/
+int fifo__sync(fifo_t *fifo,uint32_t pos)
+{
+  uint32_t p_w=fifo->p_w;
+  int len=(int)((pos-p_w)&fifo->mask);
+  int free_len=fifo->size-(int)(p_w-fifo->p_r);
 
+  if(len>free_len)
+  {
+    fifo->overflow+=len-free_len;
+  }
+  FIFO_BARRIER();
+  fifo->p_w=p_w+len;
+  return len;
+}
 
+uint32_t fifo__overflow(fifo_t *fifo)
+{
+	return fifo->overflow;
+}
 
@@ -8,15 +8,10 @@ I2S_HandleTypeDef I2sHandle;
 static uint32_t AudioRecInited = 0;
 PDMFilter_InitStruct Filter;
 
-/* Temporary data sample */
-uint16_t InternalBuffer[128];
+/* PDM 数据 DMA 循环缓冲, 2ms */
+uint16_t InternalBuffer[INTERNAL_BUFF_SIZE * 2];
 
-static uint32_t InternalBufferSize = 0;
-
-uint16_t I2SPdmBuf[128];
-uint32_t I2SPdmBufSize = 0;
-
-uint8_t *p_send=(uint8_t *) &I2SPdmBuf[0];
+static mic_pcm_ring_t *p_mic_ring;
 
 static void I2S2_MspInit()
 {
@@ -156,138 +151,59 @@ uint32_t WaveRecorderInit(uint32_t AudioFreq, uint32_t BitRes, uint32_t ChnlNbr)
         /* Set state of the audio recorder to initialized */
         AudioRecInited = 1;
 
-        HAL_I2S_Receive_DMA(&I2sHandle, (uint16_t *)&InternalBuffer[0], INTERNAL_BUFF_SIZE);
+        HAL_I2S_Receive_DMA(&I2sHandle, (uint16_t *)&InternalBuffer[0], INTERNAL_BUFF_SIZE * 2);
         /* Return 0 if all operations are OK */
         return 0;
     }
 }
 
 
-/**
- * @brief  This function handles AUDIO_REC_SPI global interrupt request.
- * @param  None
- * @retval None
- */
-
-uint8_t sd_buf[4096];
-int sd_idx = 0;
-static mic_mems_t *p_mic_mems;
-
-void MicClass_Start_Hal(mic_mems_t *p)
+void MicClass_Start_Hal(mic_pcm_ring_t *ring)
 {
-    p_mic_mems=p;
+    p_mic_ring = ring;
     if(WaveRecorderInit(0,0,0))
     {
         MO_ERROR(("error WaveRecorderInit"));
     }
-
 }
 
-// void MicClass_Stop_Hal()
-// {
-//   if(WaveRecorderStop())
-//   {
-//     MO_ERROR(("WaveRecorderStop"));
-//   }
-// }
-
-void HAL_I2S_RxHalfCpltCallback(I2S_HandleTypeDef *hi2s)
+void MicClass_Stop_Hal(void)
 {
-    // for( int i = 0; i < INTERNAL_BUFF_SIZE; i++)
-    // {
-    //     InternalBuffer[i] = HTONS(InternalBuffer[i]);
-    // }
-    // PDM_Filter_64_LSB((uint8_t *)InternalBuffer, (uint16_t *)I2SPdmBuf, 64, (PDMFilter_InitStruct *)&Filter);
-
-    // for(int i=1; i < 32; i += 4)
-    // {
-    //     sd_buf[sd_idx++] = p_send[i];
-    // }
-
-    // if(sd_idx == 2048)
-    // {
-    //     if(p_mic_mems->status_buf == 0)
-    //     {
-    //         p_mic_mems->status_buf = 1;
-    //         p_mic_mems->P_buf = sd_buf;
-    //     }
-    // }
-    // else if(sd_idx == 4096)
-    // {
-    //     sd_idx = 0;
-    //     if(p_mic_mems->status_buf == 0)
-    //     {
-    //         p_mic_mems->status_buf = 1;
-    //         p_mic_mems->P_buf = sd_buf + sizeof(sd_buf)/2;
-    //     }
-    // }
+    if(AudioRecInited)
+    {
+        HAL_I2S_DMAStop(&I2sHandle);
+        AudioRecInited = 0;
+    }
 }
 
-
-void HAL_I2S_RxCpltCallback(I2S_HandleTypeDef *hi2s)
+/*
+  PDM_Filter_64_LSB 要求字节交换之后的数据, 在已经接收完的半个缓冲上原位交换
+  每次输入 1ms 的 PDM 数据, 输出 PCM_OUT_SIZE 个样本
+*/
+static void MicPdmDecimate(void *arg, uint16_t *pdm, int16_t *pcm)
 {
-    // for( int i = 0; i < INTERNAL_BUFF_SIZE; i++)
-    // {
-    //     InternalBuffer[i + INTERNAL_BUFF_SIZE] = HTONS(InternalBuffer[i + INTERNAL_BUFF_SIZE]);
-    // }
-    // PDM_Filter_64_LSB((uint8_t *)(InternalBuffer + INTERNAL_BUFF_SIZE), (uint16_t *)I2SPdmBuf, 64, (PDMFilter_InitStruct *)&Filter);
-
-    // for(int i=1; i < 32; i += 4)
-    // {
-    //     sd_buf[sd_idx++] = p_send[i];
-    // }
-
-    // if(sd_idx == 2048)
-    // {
-    //     if(p_mic_mems->status_buf == 0)
-    //     {
-    //         p_mic_mems->status_buf = 1;
-    //         p_mic_mems->P_buf = sd_buf;
-    //     }
-    // }
-    // else if(sd_idx == 4096)
-    // {
-    //     sd_idx = 0;
-    //     if(p_mic_mems->status_buf == 0)
-    //     {
-    //         p_mic_mems->status_buf = 1;
-    //         p_mic_mems->P_buf = sd_buf + sizeof(sd_buf)/2;
-    //     }
-    // }
-
-
-
-    for( int i = 0; i < INTERNAL_BUFF_SIZE; i++)
+    for(int i = 0; i < INTERNAL_BUFF_SIZE; i++)
     {
-        InternalBuffer[i] = HTONS(InternalBuffer[i]);
+        pdm[i] = HTONS(pdm[i]);
     }
-    PDM_Filter_64_LSB((uint8_t *)InternalBuffer, (uint16_t *)I2SPdmBuf, 64, (PDMFilter_InitStruct *)&Filter);
+    PDM_Filter_64_LSB((uint8_t *)pdm, (uint16_t *)pcm, MIC_GAIN, (PDMFilter_InitStruct *)arg);
+}
 
-    for(int i = 1; i < 32; i += 4)
+/*
+  DMA 写后一半时处理前一半, 写前一半时处理后一半
+*/
+void HAL_I2S_RxHalfCpltCallback(I2S_HandleTypeDef *hi2s)
+{
+    if(p_mic_ring)
     {
-       sd_buf[sd_idx++] = p_send[i];
-
+        mic_pcm_input(p_mic_ring, &InternalBuffer[0], MicPdmDecimate, &Filter);
     }
-    // for(int i = 0; i < 32; i ++)
-    // {
-    //    sd_buf[sd_idx++] = p_send[i];
-    // }
+}
 
-    if(sd_idx == 2048)
-    {
-        if(p_mic_mems->status_buf == 0)
-        {
-            p_mic_mems->status_buf = 1;
-            p_mic_mems->P_buf = sd_buf;
-        }
-    }
-    else if(sd_idx == 4096)
+void HAL_I2S_RxCpltCallback(I2S_HandleTypeDef *hi2s)
+{
+    if(p_mic_ring)
     {
-        sd_idx = 0;
-        if(p_mic_mems->status_buf == 0)
-        {
-            p_mic_mems->status_buf = 1;
-            p_mic_mems->P_buf = sd_buf + sizeof(sd_buf)/2;
-        }
+        mic_pcm_input(p_mic_ring, &InternalBuffer[INTERNAL_BUFF_SIZE], MicPdmDecimate, &Filter);
     }
 }
@@ -26,6 +26,7 @@
 
 #include "wiring.h"
 #include "stdint.h"
+#include <string.h>
 
 #include "lib_system_all.h"
 
@@ -44,6 +45,11 @@ MqttClientClass::MqttClientClass(void)
 {
     this->_client = NULL;
     this->stream = NULL;
+    initInflight();
+    this->streamCallback = NULL;
+    this->streamRemaining = 0;
+    this->rxState = MQTT_RX_HEADER;
+    this->packetTimeout = MQTT_PACKET_TIMEOUT;
 }
 
 /*********************************************************************************
@@ -64,6 +70,11 @@ MqttClientClass::MqttClientClass(uint8_t *ip, uint16_t port, void (*callback)(ch
     this->port = port;
     this->domain = NULL;
     this->stream = NULL;
+    initInflight();
+    this->streamCallback = NULL;
+    this->streamRemaining = 0;
+    this->rxState = MQTT_RX_HEADER;
+    this->packetTimeout = MQTT_PACKET_TIMEOUT;
 }
 
 /*********************************************************************************
@@ -83,6 +94,11 @@ MqttClientClass::MqttClientClass(char* domain, uint16_t port, void (*callback)(c
     this->domain = domain;
     this->port = port;
     this->stream = NULL;
+    initInflight();
+    this->streamCallback = NULL;
+    this->streamRemaining = 0;
+    this->rxState = MQTT_RX_HEADER;
+    this->packetTimeout = MQTT_PACKET_TIMEOUT;
 }
 
 /*********************************************************************************
@@ -103,6 +119,11 @@ MqttClientClass::MqttClientClass(uint8_t *ip, uint16_t port, void (*callback)(ch
     this->port = port;
     this->domain = NULL;
     this->stream = &stream;
+    initInflight();
+    this->streamCallback = NULL;
+    this->streamRemaining = 0;
+    this->rxState = MQTT_RX_HEADER;
+    this->packetTimeout = MQTT_PACKET_TIMEOUT;
 }
 
 /*********************************************************************************
@@ -122,6 +143,11 @@ MqttClientClass::MqttClientClass(char* domain, uint16_t port, void (*callback)(c
     this->domain = domain;
     this->port = port;
     this->stream = &stream;
+    initInflight();
+    this->streamCallback = NULL;
+    this->streamRemaining = 0;
+    this->rxState = MQTT_RX_HEADER;
+    this->packetTimeout = MQTT_PACKET_TIMEOUT;
 }
 
 /*********************************************************************************
@@ -287,24 +313,33 @@ uint8_t MqttClientClass::connect(const char *id, const char *user, const char *p
             write(MQTTCONNECT,buffer,length-5);
 
             lastInActivity = lastOutActivity = millis();
+            rxState = MQTT_RX_HEADER;
 
-            while (!_client->available())
+            uint8_t llen;
+            uint16_t len;
+            while ((len = readPacket(&llen)) == 0)
             {
                 unsigned long t = millis();
-                if (t-lastInActivity > MQTT_KEEPALIVE*1000UL)
+                // 半包超时时 readPacket 已断开连接, 不再等待
+                if ((t-lastInActivity > MQTT_KEEPALIVE*1000UL) || !_client->connected())
                 {
                     _client->stop();
                     return false;
                 }
+                delay(1);   // 让出cpu给AT解析任务
             }
-            uint8_t llen;
-            uint16_t len = readPacket(&llen);
 
 
-            if (len == 4 && buffer[3] == 0)
+            if (len == 4 && rxBuffer[3] == 0)
             {
                 lastInActivity = millis();
                 pingOutstanding = false;
+                //新会话: 计数清零, 未确认的消息在下一次loop()时带DUP重发
+                memset(&stats, 0, sizeof(stats));
+                for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT; i++)
+                {
+                    inflight[i].deadline = lastInActivity;
+                }
                 return true;
             }
         }
@@ -360,6 +395,11 @@ uint8_t MqttClientClass::connected(void)
     {
         rc = false;
     }
+    else if (rxState != MQTT_RX_HEADER)
+    {
+        // 正在接收的包由 packetTimeout 检查, 不去查询连接状态(查询的返回排在包数据之后)
+        rc = true;
+    }
     else
     {
         rc = (int)_client->connected();
@@ -383,6 +423,7 @@ uint8_t MqttClientClass::loop(void)
     if (connected())
     {
         unsigned long t = millis();
+        retryInflight(t);
         if ((t - lastInActivity > MQTT_KEEPALIVE*1000UL) || (t - lastOutActivity > MQTT_KEEPALIVE*1000UL))
         {
             if (pingOutstanding)
@@ -401,74 +442,100 @@ uint8_t MqttClientClass::loop(void)
             }
         }
 
-        if (_client->available())
+        uint8_t llen;
+        uint16_t len = readPacket(&llen);   // 不阻塞, 半包留到下次loop()继续解析
+        uint16_t msgId = 0;
+        uint8_t *payload;
+        mqtt_inflight_t *pinflight;
+        if (len > 0)
         {
-            uint8_t llen;
-            uint16_t len = readPacket(&llen);
-            uint16_t msgId = 0;
-            uint8_t *payload;
-            if (len > 0)
+            lastInActivity = t;
+            uint8_t type = rxBuffer[0]&0xF0;
+            if (type == MQTTPUBLISH)
             {
-                lastInActivity = t;
-                uint8_t type = buffer[0]&0xF0;
-                if (type == MQTTPUBLISH)
+                if (callback)
                 {
-                    if (callback)
+                    uint16_t tl = (rxBuffer[llen+1]<<8)+rxBuffer[llen+2];
+                    char topic[tl+1];
+                    for (uint16_t i=0;i<tl;i++)
                     {
-                        uint16_t tl = (buffer[llen+1]<<8)+buffer[llen+2];
-                        char topic[tl+1];
-                        for (uint16_t i=0;i<tl;i++)
-                        {
-                            topic[i] = buffer[llen+3+i];
-                        }
-                        topic[tl] = 0;
-                        // msgId only present for QOS>0
-                        if ((buffer[0]&0x06) == MQTTQOS1)
-                        {
-                            msgId = (buffer[llen+3+tl]<<8)+buffer[llen+3+tl+1];
-                            payload = buffer+llen+3+tl+2;
-                            callback(topic, payload, len-llen-3-tl-2);
-                            SendAckBag(msgId, MQTTPUBACK);
-                            lastOutActivity = t;
-                        }
-                        else if ((buffer[0]&0x06) == MQTTQOS2)
-                        {
-                            msgId = (buffer[llen+3+tl]<<8)+buffer[llen+3+tl+1];
-                            payload = buffer+llen+3+tl+2;
-                            callback(topic, payload,len-llen-3-tl-2);
-                            SendAckBag(msgId, MQTTPUBREC);
-                            lastOutActivity = t;
-                        }
-                        else
-                        {
-                            payload = buffer+llen+3+tl;
-                            callback(topic, payload,len-llen-3-tl);
-                        }
+                        topic[i] = rxBuffer[llen+3+i];
                     }
-                }
-                else if (type == MQTTPUBREC)//send mqttpubrel bag
-                {
-                    uint16_t tl = (buffer[llen+1]<<8)+buffer[llen+2];
-                    if ((buffer[0]&0x06) == MQTTQOS2)
+                    topic[tl] = 0;
+                    // msgId only present for QOS>0
+                    if ((rxBuffer[0]&0x06) == MQTTQOS1)
+                    {
+                        msgId = (rxBuffer[llen+3+tl]<<8)+rxBuffer[llen+3+tl+1];
+                        payload = rxBuffer+llen+3+tl+2;
+                        callback(topic, payload, len-llen-3-tl-2);
+                        SendAckBag(msgId, MQTTPUBACK);
+                        lastOutActivity = t;
+                    }
+                    else if ((rxBuffer[0]&0x06) == MQTTQOS2)
                     {
-                        msgId = (buffer[llen+3+tl]<<8)+buffer[llen+3+tl+1];
-                        SendAckBag(msgId, MQTTPUBREL);
+                        msgId = (rxBuffer[llen+3+tl]<<8)+rxBuffer[llen+3+tl+1];
+                        payload = rxBuffer+llen+3+tl+2;
+                        callback(topic, payload,len-llen-3-tl-2);
+                        SendAckBag(msgId, MQTTPUBREC);
+                        lastOutActivity = t;
+                    }
+                    else
+                    {
+                        payload = rxBuffer+llen+3+tl;
+                        callback(topic, payload,len-llen-3-tl);
                     }
                 }
-                else if (type == MQTTPUBCOMP) //qos2
+            }
+            else if (type == MQTTPUBACK) //qos1
+            {
+                msgId = (rxBuffer[llen+1]<<8)+rxBuffer[llen+2];
+                pinflight = findInflight(msgId, MQTT_INFLIGHT_WAIT_PUBACK);
+                if (pinflight)
                 {
+                    pinflight->state = MQTT_INFLIGHT_FREE;
+                    stats.acked++;
                 }
-                else if (type == MQTTPINGREQ)
+            }
+            else if (type == MQTTPUBREC) //qos2 send mqttpubrel bag
+            {
+                msgId = (rxBuffer[llen+1]<<8)+rxBuffer[llen+2];
+                pinflight = findInflight(msgId, MQTT_INFLIGHT_WAIT_PUBREC);
+                if (pinflight)
                 {
-                    buffer[0] = MQTTPINGRESP;
-                    buffer[1] = 0;
-                    _client->write(buffer,2);
+                    pinflight->state = MQTT_INFLIGHT_WAIT_PUBCOMP;
+                    pinflight->retries = 0;
+                    pinflight->deadline = t + MQTT_RETRY_INTERVAL;
                 }
-                else if (type == MQTTPINGRESP)
+                //重复的PUBREC也需要回复
+                SendAckBag(msgId, MQTTPUBREL);
+                lastOutActivity = t;
+            }
+            else if (type == MQTTPUBREL) //qos2 received publish
+            {
+                msgId = (rxBuffer[llen+1]<<8)+rxBuffer[llen+2];
+                SendAckBag(msgId, MQTTPUBCOMP);
+                lastOutActivity = t;
+            }
+            else if (type == MQTTPUBCOMP) //qos2
+            {
+                msgId = (rxBuffer[llen+1]<<8)+rxBuffer[llen+2];
+                pinflight = findInflight(msgId, MQTT_INFLIGHT_WAIT_PUBCOMP);
+                if (pinflight)
                 {
-                    pingOutstanding = false;
+                    pinflight->state = MQTT_INFLIGHT_FREE;
+                    stats.acked++;
                 }
             }
+            else if (type == MQTTPINGREQ)
+            {
+                buffer[0] = MQTTPINGRESP;
+                buffer[1] = 0;
+                _client->write(buffer,2);
+            }
+            else if (type == MQTTPINGRESP)
+            {
+                pingOutstanding = false;
+            }
         }
         return true;
     }
@@ -520,61 +587,324 @@ uint8_t MqttClientClass::publish(const char* topic, uint8_t* payload, unsigned i
 **********************************************************************************/
 uint8_t MqttClientClass::publish(const char* topic, uint8_t* payload, unsigned int plength, uint8_t retained)
 {
-    if (connected())
+    return publish(topic, payload, plength, 0, retained);
+}
+
+/*********************************************************************************
+  *Function		:      uint8_t MqttClientClass::publish()
+  *Description	:     publish the topic
+  *Input		      :
+  *Output		:
+  *Return		:
+  *author		:
+  *date			:
+  *Others		:
+**********************************************************************************/
+uint8_t MqttClientClass::publish(const char* topic, uint8_t* payload, unsigned int plength, uint8_t qos, uint8_t retained)
+{
+    uint16_t room;
+    uint8_t *pdata = beginPublish(NULL, topic, qos, &room);
+
+    if (pdata == NULL)
     {
-        // Leave room in the buffer for header and variable length field
-        uint16_t length = 5;
-        length = writeString(topic,buffer,length);
-        uint16_t i;
-        for (i=0;i<plength;i++)
+        return false;
+    }
+    if (plength > room)
+    {
+        cancelPublish();
+        return false;
+    }
+    memcpy(pdata, payload, plength);
+    return endPublish(plength, retained);
+}
+
+/*********************************************************************************
+  *Function		:      uint8_t *MqttClientClass::beginPublish(const char* prefix, const char* topic, uint8_t qos, uint16_t *room)
+  *Description	:     start a publish in the packet buffer, the caller writes the payload in place
+  *Input		      :     prefix: topic prefix or NULL   topic: topic   qos: 0-2
+  *Output		:     room: bytes left for the payload
+  *Return		:     where to write the payload, NULL if not connected or no room
+  *author		:
+  *date			:
+  *Others		:     must be followed by endPublish() or cancelPublish()
+**********************************************************************************/
+uint8_t *MqttClientClass::beginPublish(const char* prefix, const char* topic, uint8_t qos, uint16_t *room)
+{
+    uint16_t prefixLen = (prefix != NULL) ? strlen(prefix) : 0;
+    uint16_t topicLen = strlen(topic);
+    uint16_t length;
+
+    if ((qos > 2) || !connected())
+    {
+        return NULL;
+    }
+
+    // 固定头 + 主题 + 消息ID 不能超出缓冲区
+    length = 5 + 2 + prefixLen + topicLen + (qos ? 2 : 0);
+    if (length > MQTT_MAX_PACKET_SIZE)
+    {
+        if (qos)
         {
-            buffer[length++] = payload[i];
+            stats.rejected++;
         }
-        uint8_t header = MQTTPUBLISH;
+        return NULL;
+    }
 
-        if (retained)
+    pendingInflight = NULL;
+    pendingMsgId = 0;
+    if (qos)
+    {
+        pendingInflight = findInflight(0, MQTT_INFLIGHT_FREE);
+        if (pendingInflight == NULL)
         {
-            header |= 1;
+            MO_ERROR(("mqtt inflight full"));
+            stats.rejected++;
+            return NULL;
         }
-        return write(header,buffer,length-5);
+        pendingMsgId = getNextMsgId();
     }
-    return false;
+
+    // Leave room in the buffer for header and variable length field
+    buffer[5] = ((prefixLen + topicLen) >> 8);
+    buffer[6] = ((prefixLen + topicLen) & 0xFF);
+    if (prefixLen)
+    {
+        memcpy(buffer+7, prefix, prefixLen);
+    }
+    memcpy(buffer+7+prefixLen, topic, topicLen);
+    length = 7 + prefixLen + topicLen;
+    if (qos)
+    {
+        buffer[length++] = (pendingMsgId >> 8);
+        buffer[length++] = (pendingMsgId & 0xFF);
+    }
+    pendingQos = qos;
+    pendingLength = length;
+    *room = MQTT_MAX_PACKET_SIZE - length;
+    return buffer + length;
 }
 
 /*********************************************************************************
-  *Function		:      uint8_t MqttClientClass::publish()
-  *Description	:     publish the topic
+  *Function		:      uint8_t MqttClientClass::endPublish(unsigned int plength, uint8_t retained)
+  *Description	:     send the publish started by beginPublish()
+  *Input		      :     plength: payload length written   retained: retain flag
+  *Output		:
+  *Return		:     qos0: the packet is sent   qos1/qos2: the packet is queued for retransmit
+  *author		:
+  *date			:
+  *Others		:
+**********************************************************************************/
+uint8_t MqttClientClass::endPublish(unsigned int plength, uint8_t retained)
+{
+    mqtt_inflight_t *pinflight = pendingInflight;
+    uint16_t length = pendingLength + plength;
+    uint8_t header = MQTTPUBLISH | (pendingQos << 1);
+
+    pendingInflight = NULL;
+    if ((pendingLength == 0) || (length > MQTT_MAX_PACKET_SIZE))
+    {
+        pendingLength = 0;
+        return false;
+    }
+    pendingLength = 0;
+
+    if (retained)
+    {
+        header |= 1;
+    }
+
+    if (pinflight)
+    {
+        //先保存到重发池, 发送失败或超时未确认由loop()重发
+        pinflight->msgId = pendingMsgId;
+        pinflight->state = (pendingQos == 1) ? MQTT_INFLIGHT_WAIT_PUBACK : MQTT_INFLIGHT_WAIT_PUBREC;
+        pinflight->retries = 0;
+        pinflight->header = header;
+        pinflight->length = length-5;
+        memcpy(pinflight->packet, buffer+5, length-5);
+        pinflight->deadline = millis() + MQTT_RETRY_INTERVAL;
+        stats.published++;
+        write(header,buffer,length-5);
+        return true;
+    }
+    return write(header,buffer,length-5);
+}
+
+/*********************************************************************************
+  *Function		:      void MqttClientClass::cancelPublish(void)
+  *Description	:     drop the publish started by beginPublish()
   *Input		      :
   *Output		:
   *Return		:
   *author		:
   *date			:
-  *Others		:
+  *Others		:     the reserved message id is not reused
 **********************************************************************************/
-uint8_t MqttClientClass::publish(const char* topic, uint8_t* payload, unsigned int plength, uint8_t qos, uint8_t retained)
+void MqttClientClass::cancelPublish(void)
 {
-    if(qos > 2)
-    {return false;}
+    pendingInflight = NULL;
+    pendingLength = 0;
+}
 
-    if (connected())
+/*********************************************************************************
+  *Function		:      uint8_t MqttClientClass::beginPublishStream(const char* prefix, const char* topic, uint32_t plength, uint8_t retained)
+  *Description	:     send the header and topic of a qos0 publish, the payload follows by writePayload()
+  *Input		      :     prefix: topic prefix or NULL   topic: topic   plength: total payload length
+  *Output		:
+  *Return		:     false if not connected or the topic does not fit in the packet buffer
+  *author		:
+  *date			:
+  *Others		:     payload 不经过 buffer, 长度不受 MQTT_MAX_PACKET_SIZE 限制
+  *                 只支持 qos0, 大消息无法放入重发池
+**********************************************************************************/
+uint8_t MqttClientClass::beginPublishStream(const char* prefix, const char* topic, uint32_t plength, uint8_t retained)
+{
+    uint16_t prefixLen = (prefix != NULL) ? strlen(prefix) : 0;
+    uint16_t topicLen = strlen(topic);
+    uint16_t length;
+    uint8_t hlen;
+
+    if (!connected() || ((5 + 2 + prefixLen + topicLen) > MQTT_MAX_PACKET_SIZE))
     {
-        // Leave room in the buffer for header and variable length field
-        uint16_t length = 5;
-        length = writeString(topic, buffer, length);
-        uint16_t i;
-        for (i=0;i<plength;i++)
-        {
-            buffer[length++] = payload[i];
-        }
-        uint8_t header = MQTTPUBLISH;
+        return false;
+    }
+
+    buffer[5] = ((prefixLen + topicLen) >> 8);
+    buffer[6] = ((prefixLen + topicLen) & 0xFF);
+    if (prefixLen)
+    {
+        memcpy(buffer+7, prefix, prefixLen);
+    }
+    memcpy(buffer+7+prefixLen, topic, topicLen);
+    length = 2 + prefixLen + topicLen;
 
-        if (retained)
+    hlen = writeHeader(MQTTPUBLISH | (retained ? 1 : 0), buffer, length + plength);
+    if (_client->write(buffer+(5-hlen), length+hlen) != (size_t)(length+hlen))
+    {
+        _client->stop();
+        return false;
+    }
+    streamRemaining = plength;
+    lastOutActivity = millis();
+    return true;
+}
+
+/*********************************************************************************
+  *Function		:      size_t MqttClientClass::writePayload(const uint8_t* payload, size_t plength)
+  *Description	:     write part of the payload of the publish started by beginPublishStream()
+  *Input		      :
+  *Output		:
+  *Return		:     the bytes written
+  *author		:
+  *date			:
+  *Others		:     bytes beyond the announced length are not written
+**********************************************************************************/
+size_t MqttClientClass::writePayload(const uint8_t* payload, size_t plength)
+{
+    size_t rc;
+
+    if (plength > streamRemaining)
+    {
+        plength = streamRemaining;
+    }
+    if (plength == 0)
+    {
+        return 0;
+    }
+    rc = _client->write(payload, plength);
+    streamRemaining -= rc;
+    lastOutActivity = millis();
+    return rc;
+}
+
+/*********************************************************************************
+  *Function		:      uint8_t MqttClientClass::endPublishStream(void)
+  *Description	:     finish the publish started by beginPublishStream()
+  *Input		      :
+  *Output		:
+  *Return		:     false if the payload was short, the connection is closed
+  *author		:
+  *date			:
+  *Others		:     剩余长度已经发出, 少发的数据无法补齐, 只能断开重连
+**********************************************************************************/
+uint8_t MqttClientClass::endPublishStream(void)
+{
+    if (streamRemaining)
+    {
+        MO_ERROR(("mqtt stream publish short %d", (int)streamRemaining));
+        streamRemaining = 0;
+        _client->stop();
+        return false;
+    }
+    return true;
+}
+
+/*********************************************************************************
+  *Function		:      uint8_t MqttClientClass::publishStream()
+  *Description	:     qos0 publish of a payload of any length straight from the caller's memory
+  *Input		      :
+  *Output		:
+  *Return		:
+  *author		:
+  *date			:
+  *Others		:
+**********************************************************************************/
+uint8_t MqttClientClass::publishStream(const char* prefix, const char* topic, const uint8_t* payload, uint32_t plength, uint8_t retained)
+{
+    if (!beginPublishStream(prefix, topic, plength, retained))
+    {
+        return false;
+    }
+    writePayload(payload, plength);
+    return endPublishStream();
+}
+
+/*********************************************************************************
+  *Function		:      uint8_t MqttClientClass::publishStream()
+  *Description	:     qos0 publish of a payload of any length produced chunk by chunk
+  *Input		      :     reader: fills the packet buffer with the next chunk   arg: passed to reader
+  *Output		:
+  *Return		:
+  *author		:
+  *date			:
+  *Others		:     the packet buffer is free once the header is sent, so it is reused for the chunks
+**********************************************************************************/
+uint8_t MqttClientClass::publishStream(const char* prefix, const char* topic, uint32_t plength, mqtt_payload_reader_t reader, void *arg, uint8_t retained)
+{
+    uint32_t offset = 0;
+    uint16_t size;
+    int n;
+
+    if (!beginPublishStream(prefix, topic, plength, retained))
+    {
+        return false;
+    }
+    while (offset < plength)
+    {
+        size = ((plength - offset) > MQTT_MAX_PACKET_SIZE) ? MQTT_MAX_PACKET_SIZE : (plength - offset);
+        n = reader(buffer, size, offset, arg);
+        if ((n <= 0) || (writePayload(buffer, n) != (size_t)n))
         {
-            header |= 1;
+            break;
         }
-        return write(header,buffer,length-5);
+        offset += n;
     }
-    return false;
+    return endPublishStream();
+}
+
+/*********************************************************************************
+  *Function		:      void MqttClientClass::setStreamCallback(mqtt_stream_callback_t callback)
+  *Description	:     deliver inbound publishes larger than the packet buffer in chunks
+  *Input		      :     callback: NULL to drop them as before
+  *Output		:
+  *Return		:
+  *author		:
+  *date			:
+  *Others		:
+**********************************************************************************/
+void MqttClientClass::setStreamCallback(mqtt_stream_callback_t callback)
+{
+    this->streamCallback = callback;
 }
 
 /*********************************************************************************
@@ -611,11 +941,7 @@ uint8_t MqttClientClass::subscribe(const char* topic, uint8_t qos)
     {
         // Leave room in the buffer for header and variable length field
         uint16_t length = 5;
-        nextMsgId++;
-        if (nextMsgId == 0)
-        {
-            nextMsgId = 1;
-        }
+        getNextMsgId();
         buffer[length++] = (nextMsgId >> 8);
         buffer[length++] = (nextMsgId & 0xFF);
         length = writeString(topic, buffer,length);
@@ -640,11 +966,7 @@ uint8_t MqttClientClass::unsubscribe(const char* topic)
     if (connected())
     {
         uint16_t length = 5;
-        nextMsgId++;
-        if (nextMsgId == 0)
-        {
-            nextMsgId = 1;
-        }
+        getNextMsgId();
         buffer[length++] = (nextMsgId >> 8);
         buffer[length++] = (nextMsgId & 0xFF);
         length = writeString(topic, buffer,length);
@@ -654,94 +976,272 @@ uint8_t MqttClientClass::unsubscribe(const char* topic)
 }
 
 /*********************************************************************************
-  *Function		:   uint8_t MqttClientClass::readByte(void)
-  *Description	:   Read the next byte received from the mqtt server.
+  *Function		:   uint16_t MqttClientClass::readPacket(uint8_t* lengthLength)
+  *Description	:   parse the bytes available from the client without blocking
   *Input		      :
-  *Output		:
-  *Return		:
+  *Output		:   lengthLength: bytes of the remaining length field
+  *Return		:   the length of a complete packet in buffer, 0 if none is complete yet
   *author		:
   *date			:
-  *Others		:
+  *Others		:   the parse state is kept across calls, a packet must complete within packetTimeout
+  *                 otherwise the connection is closed. publishes larger than buffer go to streamCallback
 **********************************************************************************/
-uint8_t MqttClientClass::readByte(void)
+uint16_t MqttClientClass::readPacket(uint8_t* lengthLength)
 {
-    while(!_client->available())
+    uint16_t len = 0;
+    int c;
+
+    if ((rxState != MQTT_RX_HEADER) && ((long)(millis() - rxDeadline) > 0))
     {
+        //半包超时, 数据流已无法同步, 断开重连
+        MO_ERROR(("mqtt packet timeout %d %d/%d", rxState, (int)rxCount, (int)rxLength));
+        rxState = MQTT_RX_HEADER;
+        _client->stop();
+        return 0;
+    }
 
+    while ((len == 0) && _client->available())
+    {
+        c = _client->read();
+        if (c < 0)
+        {
+            break;
+        }
+
+        switch (rxState)
+        {
+            case MQTT_RX_HEADER:
+                rxBuffer[0] = c;
+                rxLength = 0;
+                rxMultiplier = 1;
+                rxLengthLength = 0;
+                rxCount = 0;
+                rxDeadline = millis() + packetTimeout;
+                rxState = MQTT_RX_LENGTH;
+                break;
+
+            case MQTT_RX_LENGTH:
+                rxBuffer[1 + rxLengthLength++] = c;
+                rxLength += (c & 127) * rxMultiplier;
+                rxMultiplier *= 128;
+                if ((c & 128) && (rxLengthLength < 4))
+                {
+                    break;
+                }
+                *lengthLength = rxLengthLength;
+                if (((rxBuffer[0]&0xF0) == MQTTPUBLISH) && this->streamCallback && ((1 + rxLengthLength + rxLength) > MQTT_MAX_PACKET_SIZE))
+                {
+                    //超出缓冲区的消息分块交给streamCallback
+                    rxHeader = rxBuffer[0];
+                    rxTopicLength = 0;
+                    rxMsgId = 0;
+                    rxState = MQTT_RX_STREAM_HEAD;
+                }
+                else if (rxLength == 0)
+                {
+                    len = 1 + rxLengthLength;
+                }
+                else
+                {
+                    rxMsgId = 0;
+                    rxState = MQTT_RX_BODY;
+                }
+                break;
+
+            case MQTT_RX_BODY:
+                len = readBody(c);
+                *lengthLength = rxLengthLength;
+                break;
+
+            case MQTT_RX_STREAM_HEAD:
+            case MQTT_RX_STREAM_DATA:
+                readStreamPublish(c);
+                break;
+
+            default:
+                rxState = MQTT_RX_HEADER;
+                break;
+        }
+
+        if (len != 0)
+        {
+            rxState = MQTT_RX_HEADER;
+        }
     }
-    int a=_client->read();
-    return a;
-    //return _client->read();
+    return len;
 }
 
 /*********************************************************************************
-  *Function		:   uint16_t MqttClientClass::readPacket(uint8_t* lengthLength)
-  *Description	:   Read the packet received from the mqtt server.
+  *Function		:   uint16_t MqttClientClass::readBody(uint8_t c)
+  *Description	:   take one byte of a packet body
   *Input		      :
   *Output		:
-  *Return		:
+  *Return		:   the packet length when the body is complete, 0 otherwise
   *author		:
   *date			:
-  *Others		:
+  *Others		:   publish payload is also written to stream if there is one,
+  *                 packets larger than buffer are dropped when there is no stream,
+  *                 a dropped qos1/qos2 publish is still acked so the server does not resend it
 **********************************************************************************/
-uint16_t MqttClientClass::readPacket(uint8_t* lengthLength)
+uint16_t MqttClientClass::readBody(uint8_t c)
 {
-    uint16_t len = 0;
-    buffer[len++] = readByte();
-    bool isPublish = (buffer[0]&0xF0) == MQTTPUBLISH;
-    uint32_t multiplier = 1;
-    uint16_t length = 0;
-    uint8_t digit = 0;
-    uint16_t skip = 0;
-    uint8_t start = 0;
+    uint32_t pos = 1 + rxLengthLength + rxCount;
 
-    do
+    if (((rxBuffer[0]&0xF0) == MQTTPUBLISH) && (rxCount >= 2))
     {
-        digit = readByte();
-        buffer[len++] = digit;
-        length += (digit & 127) * multiplier;
-        multiplier *= 128;
-    } while ((digit & 128) != 0);
-    *lengthLength = len-1;
-
-    if (isPublish)
-    {
-        // Read in topic length to calculate bytes to skip over for Stream writing
-        buffer[len++] = readByte();
-        buffer[len++] = readByte();
-        skip = (buffer[*lengthLength+1]<<8)+buffer[*lengthLength+2];
-        start = 2;
-        if (buffer[0]&MQTTQOS1)
+        // skip topic and message id
+        uint32_t skip = (rxBuffer[rxLengthLength+1]<<8)+rxBuffer[rxLengthLength+2];
+        if (rxBuffer[0]&0x06)
         {
-            // skip message id
+            // 消息id可能在缓冲区之外, 单独保存
+            if ((rxCount == 2 + skip) || (rxCount == 3 + skip))
+            {
+                rxMsgId = (rxMsgId << 8) + c;
+            }
             skip += 2;
         }
+        if (this->stream && (rxCount >= 2 + skip))
+        {
+            this->stream->write(c);
+        }
     }
 
-    for (uint16_t i = start;i<length;i++)
+    if (pos < MQTT_MAX_PACKET_SIZE)
     {
-        digit = readByte();
-        if (this->stream)
+        rxBuffer[pos] = c;
+    }
+    rxCount++;
+
+    if (rxCount < rxLength)
+    {
+        return 0;
+    }
+    if (!this->stream && (pos + 1 > MQTT_MAX_PACKET_SIZE))
+    {
+        // This will cause the packet to be ignored.
+        MO_ERROR(("mqtt packet too large %d", (int)(pos + 1)));
+        rxState = MQTT_RX_HEADER;
+        lastInActivity = millis();
+        if ((rxBuffer[0]&0xF0) == MQTTPUBLISH)
         {
-            if (isPublish && len-*lengthLength-2>skip)
+            if ((rxBuffer[0]&0x06) == MQTTQOS1)
             {
-            this->stream->write(digit);
+                SendAckBag(rxMsgId, MQTTPUBACK);
+            }
+            else if ((rxBuffer[0]&0x06) == MQTTQOS2)
+            {
+                SendAckBag(rxMsgId, MQTTPUBREC);
             }
         }
+        return 0;
+    }
+    return ((pos + 1) > 0xFFFF) ? 0xFFFF : (pos + 1);
+}
+
+/*********************************************************************************
+  *Function		:   void MqttClientClass::readStreamPublish(uint8_t c)
+  *Description	:   take one byte of a publish larger than the packet buffer
+  *Input		      :
+  *Output		:
+  *Return		:
+  *author		:
+  *date			:
+  *Others		:   the topic is kept at the start of rxBuffer, the rest of rxBuffer holds one chunk,
+  *                 a chunk is delivered when it is full or the payload ends. qos1/qos2 are acked at the end
+**********************************************************************************/
+void MqttClientClass::readStreamPublish(uint8_t c)
+{
+    uint16_t headLength = 2 + rxTopicLength + ((rxHeader & 0x06) ? 2 : 0);
+    bool drop = ((uint32_t)rxTopicLength + 1 >= MQTT_MAX_PACKET_SIZE);
+    uint8_t *chunk = drop ? rxBuffer : (rxBuffer + rxTopicLength + 1);
+    uint16_t room = drop ? MQTT_MAX_PACKET_SIZE : (MQTT_MAX_PACKET_SIZE - rxTopicLength - 1);
 
-        if (len < MQTT_MAX_PACKET_SIZE)
+    if (rxState == MQTT_RX_STREAM_HEAD)
+    {
+        if (rxCount < 2)
         {
-            buffer[len] = digit;
+            rxTopicLength = (rxTopicLength << 8) + c;
+        }
+        else if (rxCount < 2 + (uint32_t)rxTopicLength)
+        {
+            // 主题放不下时丢弃整个消息
+            if (!drop)
+            {
+                rxBuffer[rxCount - 2] = c;
+            }
+        }
+        else
+        {
+            rxMsgId = (rxMsgId << 8) + c;
+        }
+        rxCount++;
+
+        headLength = 2 + rxTopicLength + ((rxHeader & 0x06) ? 2 : 0);
+        if ((rxCount < 2) || ((rxCount < headLength) && (rxCount < rxLength)))
+        {
+            return;
+        }
+        if (headLength > rxLength)
+        {
+            drop = true;
+        }
+        else if (!drop)
+        {
+            rxBuffer[rxTopicLength] = 0;
+        }
+        rxOffset = 0;
+        rxPos = 0;
+        rxState = MQTT_RX_STREAM_DATA;
+        if (rxCount < rxLength)
+        {
+            return;
         }
-        len++;
+    }
+    else
+    {
+        chunk[rxPos++] = c;
+        rxCount++;
     }
 
-    if (!this->stream && len > MQTT_MAX_PACKET_SIZE)
+    if ((rxPos < room) && (rxCount < rxLength))
     {
-        len = 0; // This will cause the packet to be ignored.
+        return;
     }
+    if (!drop)
+    {
+        streamCallback((char *)rxBuffer, chunk, rxPos, rxOffset, rxLength - headLength);
+    }
+    rxOffset += rxPos;
+    rxPos = 0;
 
-    return len;
+    if (rxCount >= rxLength)
+    {
+        rxState = MQTT_RX_HEADER;
+        lastInActivity = millis();
+        if ((rxHeader & 0x06) == MQTTQOS1)
+        {
+            SendAckBag(rxMsgId, MQTTPUBACK);
+        }
+        else if ((rxHeader & 0x06) == MQTTQOS2)
+        {
+            SendAckBag(rxMsgId, MQTTPUBREC);
+        }
+    }
+}
+
+/*********************************************************************************
+  *Function		:   void MqttClientClass::setPacketTimeout(unsigned long timeout)
+  *Description	:   set the time a started packet has to complete in
+  *Input		      :   timeout: milliseconds
+  *Output		:
+  *Return		:
+  *author		:
+  *date			:
+  *Others		:
+**********************************************************************************/
+void MqttClientClass::setPacketTimeout(unsigned long timeout)
+{
+    packetTimeout = timeout;
 }
 
 /*********************************************************************************
@@ -755,34 +1255,47 @@ uint16_t MqttClientClass::readPacket(uint8_t* lengthLength)
   *Others		:
 **********************************************************************************/
 uint8_t MqttClientClass::write(uint8_t header, uint8_t* buf, uint16_t length)
+{
+    uint8_t hlen = writeHeader(header, buf, length);
+    size_t rc = _client->write(buf+(5-hlen),length+hlen);
+
+    lastOutActivity = millis();
+    return (rc == hlen+length);
+}
+
+/*********************************************************************************
+  *Function		:    uint8_t MqttClientClass::writeHeader(uint8_t header, uint8_t* buf, uint32_t length)
+  *Description	:    fill the fixed header right before buf+5
+  *Input		      :    header: packet type and flags   length: remaining length
+  *Output		:
+  *Return		:    the fixed header length, the packet starts at buf+5-return
+  *author		:
+  *date			:
+  *Others		:
+**********************************************************************************/
+uint8_t MqttClientClass::writeHeader(uint8_t header, uint8_t* buf, uint32_t length)
 {
     uint8_t lenBuf[4];
     uint8_t llen = 0;
     uint8_t digit;
-    uint8_t pos = 0;
-    uint8_t rc;
-    uint8_t len = length;
+
     do
     {
-        digit = len % 128;
-        len = len / 128;
-        if (len > 0)
+        digit = length % 128;
+        length = length / 128;
+        if (length > 0)
         {
             digit |= 0x80;
         }
-        lenBuf[pos++] = digit;
-        llen++;
-    } while(len>0);
+        lenBuf[llen++] = digit;
+    } while((length > 0) && (llen < 4));
 
     buf[4-llen] = header;
     for (int i=0;i<llen;i++)
     {
         buf[5-llen+i] = lenBuf[i];
     }
-    rc = _client->write(buf+(4-llen),length+1+llen);
-
-    lastOutActivity = millis();
-    return (rc == 1+llen+length);
+    return 1+llen;
 }
 
 /*********************************************************************************
@@ -813,7 +1326,7 @@ uint16_t MqttClientClass::writeString(const char* string, uint8_t* buf, uint16_t
 /*********************************************************************************
   *Function		:    uint8_t MqttClientClass::SendAckBag(uint16_t msgId, unsigned char bagtype)
   *Description	:    send the maqtt ack bag
-  *Input		      :
+  *Input		      :    bagtype: MQTTPUBACK MQTTPUBREC MQTTPUBREL MQTTPUBCOMP
   *Output		:
   *Return		:
   *author		:
@@ -822,10 +1335,193 @@ uint16_t MqttClientClass::writeString(const char* string, uint8_t* buf, uint16_t
 **********************************************************************************/
 uint8_t MqttClientClass::SendAckBag(uint16_t msgId, unsigned char bagtype)
 {
-    buffer[0] = MQTTPUBACK;
+    buffer[0] = bagtype;
+    if (bagtype == MQTTPUBREL)
+    {
+        buffer[0] |= MQTTQOS1;
+    }
     buffer[1] = 2;
     buffer[2] = (msgId >> 8);
     buffer[3] = (msgId & 0xFF);
     return _client->write(buffer,4);
 }
 
+/*********************************************************************************
+  *Function		:    void MqttClientClass::initInflight(void)
+  *Description	:    clear the in-flight table and bind each entry to its retransmit pool slot
+  *Input		      :
+  *Output		:
+  *Return		:
+  *author		:
+  *date			:
+  *Others		:    重发池静态分配, publish 路径上不申请内存
+**********************************************************************************/
+void MqttClientClass::initInflight(void)
+{
+    memset(inflight, 0, sizeof(inflight));
+    for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT; i++)
+    {
+        inflight[i].state = MQTT_INFLIGHT_FREE;
+        inflight[i].packet = inflightPool[i];
+    }
+    memset(&stats, 0, sizeof(stats));
+    nextMsgId = 1;
+    pendingInflight = NULL;
+    pendingLength = 0;
+}
+
+/*********************************************************************************
+  *Function		:    uint16_t MqttClientClass::getNextMsgId(void)
+  *Description	:    get the next message id, skip 0 and the ids still in flight
+  *Input		      :
+  *Output		:
+  *Return		:    message id
+  *author		:
+  *date			:
+  *Others		:
+**********************************************************************************/
+uint16_t MqttClientClass::getNextMsgId(void)
+{
+    uint8_t i;
+
+    do
+    {
+        nextMsgId++;
+        if (nextMsgId == 0)
+        {
+            nextMsgId = 1;
+        }
+        for (i = 0; i < MQTT_MAX_INFLIGHT; i++)
+        {
+            if ((inflight[i].state != MQTT_INFLIGHT_FREE) && (inflight[i].msgId == nextMsgId))
+            {
+                break;
+            }
+        }
+    } while (i < MQTT_MAX_INFLIGHT);
+    return nextMsgId;
+}
+
+/*********************************************************************************
+  *Function		:    mqtt_inflight_t *MqttClientClass::findInflight(uint16_t msgId, uint8_t state)
+  *Description	:    find the in-flight entry
+  *Input		      :    msgId: message id (ignored for MQTT_INFLIGHT_FREE)
+                      state: MQTT_INFLIGHT_xxx
+  *Output		:
+  *Return		:    the entry or NULL
+  *author		:
+  *date			:
+  *Others		:
+**********************************************************************************/
+mqtt_inflight_t *MqttClientClass::findInflight(uint16_t msgId, uint8_t state)
+{
+    for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT; i++)
+    {
+        if (inflight[i].state != state)
+        {
+            continue;
+        }
+        if ((state == MQTT_INFLIGHT_FREE) || (inflight[i].msgId == msgId))
+        {
+            return &inflight[i];
+        }
+    }
+    return NULL;
+}
+
+/*********************************************************************************
+  *Function		:    void MqttClientClass::resendInflight(mqtt_inflight_t *pinflight)
+  *Description	:    send the publish again with dup, or the pubrel for qos2
+  *Input		      :
+  *Output		:
+  *Return		:
+  *author		:
+  *date			:
+  *Others		:
+**********************************************************************************/
+void MqttClientClass::resendInflight(mqtt_inflight_t *pinflight)
+{
+    if (pinflight->state == MQTT_INFLIGHT_WAIT_PUBCOMP)
+    {
+        SendAckBag(pinflight->msgId, MQTTPUBREL);
+        lastOutActivity = millis();
+    }
+    else
+    {
+        memcpy(buffer+5, pinflight->packet, pinflight->length);
+        write(pinflight->header|MQTTDUP, buffer, pinflight->length);
+    }
+}
+
+/*********************************************************************************
+  *Function		:    void MqttClientClass::retryInflight(unsigned long t)
+  *Description	:    retransmit the expired in-flight messages
+  *Input		      :    t: now(millis)
+  *Output		:
+  *Return		:
+  *author		:
+  *date			:
+  *Others		:
+**********************************************************************************/
+void MqttClientClass::retryInflight(unsigned long t)
+{
+    for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT; i++)
+    {
+        mqtt_inflight_t *pinflight = &inflight[i];
+
+        if ((pinflight->state == MQTT_INFLIGHT_FREE) || ((long)(t - pinflight->deadline) < 0))
+        {
+            continue;
+        }
+        if (pinflight->retries >= MQTT_MAX_RETRIES)
+        {
+            MO_ERROR(("mqtt msg %d dropped", pinflight->msgId));
+            pinflight->state = MQTT_INFLIGHT_FREE;
+            stats.dropped++;
+            continue;
+        }
+        pinflight->retries++;
+        pinflight->deadline = t + MQTT_RETRY_INTERVAL;
+        stats.retransmitted++;
+        resendInflight(pinflight);
+    }
+}
+
+/*********************************************************************************
+  *Function		:    uint8_t MqttClientClass::inflightCount(void)
+  *Description	:    the number of qos1/qos2 messages not acknowledged
+  *Input		      :
+  *Output		:
+  *Return		:
+  *author		:
+  *date			:
+  *Others		:
+**********************************************************************************/
+uint8_t MqttClientClass::inflightCount(void)
+{
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT; i++)
+    {
+        if (inflight[i].state != MQTT_INFLIGHT_FREE)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+/*********************************************************************************
+  *Function		:    const mqtt_session_stats_t *MqttClientClass::sessionStats(void)
+  *Description	:    the counters of the current session, cleared on connect
+  *Input		      :
+  *Output		:
+  *Return		:
+  *author		:
+  *date			:
+  *Others		:
+**********************************************************************************/
+const mqtt_session_stats_t *MqttClientClass::sessionStats(void)
+{
+    return &stats;
+}
@@ -369,6 +369,7 @@ void TcpClient::flush(void)
   *Function           :  uint8_t TcpClient::connected(void)
   *Description       :  Whether or not the client is connected. Note that a client is considered connected
                               if the connection has been closed but there is still unread data.
+                              A client that lost received data (its receive queue was full) is not connected.
   *Input               :   none
   *Output             :   none
   *Return             :   Returns true if the client is connected, false if not.
@@ -388,6 +389,19 @@ uint8_t TcpClient::connected(void)
 
  // MO_INFO(("time_count=%d now_time:%d",time_count,millis()));
 
+  //接收队列满丢过数据 数据流已不完整 需要断开重连
+  if(TcpClient_lost_hal(handle)>0)
+  {
+    MO_ERROR(("tcp %d lost received data",handle));
+    return false;
+  }
+
+  //还有未读数据时认为连接 不去查询 (查询的返回排在这些数据之后)
+  if(available()>0)
+  {
+    return true;
+  }
+
   if(timerIsEnd(time_count,5*1000))
   {
     time_count=millis();
@@ -468,6 +482,9 @@ int TcpClient::connect(const char *host, uint16_t port)
     if(ret==MO_SUCCESS)
     {
         opened = true;
+        //重连后不沿用上一个连接断开时缓存的状态
+        cache_conect = 1;
+        time_count = millis();
         return true;
     }
     else
@@ -152,6 +152,19 @@ int TcpClient_available_hal(unsigned char handle)
     return mo_drv_wifi_available_tcpc_fifo(handle);
 }
 
+//接收队列满丢弃的字节数  非0时数据流已不完整
+int TcpClient_lost_hal(unsigned char handle)
+{
+    //check pram
+    if(handle>4)
+    {
+         MO_ERROR(("bad pram"));
+         return 0;
+    }
+
+    return mo_drv_wifi_lost_tcpc_fifo(handle);
+}
+
 /*
 
 
@@ -175,52 +188,8 @@ int TcpClient_writen_hal(const unsigned char *p_dat,int len,unsigned char tcp_ha
         return 0;
     }
 
-    //send cmd
-    char temp_w[24];
-    char temp_r[32];
-    memset(temp_w,0x00,sizeof(temp_w));
-    sprintf(temp_w,"AT+CIPSEND=%d,%d",tcp_handle,len);
-
-    if(mo_drv_wifi_cmd_transfer((const char *)temp_w,strlen(temp_w),temp_r,sizeof(temp_r),10,0x01)>0)
-    {
-        if(memcmp(temp_r,">",1)==0)
-        {
-            //   MO_INFO(("GET >"));
-            MO_INFO(("0.5> TcpClient_writen_hal %d",tcp_handle));
-        }
-        else
-        {
-            MO_ERROR(("0.5Failed TcpClient_writen_hal %d",tcp_handle));
-        }
-    }
-    else
-    {
-        MO_ERROR(("0.5Time out TcpClient_writen_hal %d",tcp_handle));
-    }
-
-
-    //send data
-    int ret;
-    if( (ret=mo_drv_wifi_cmd_transfer((const char *)p_dat,len,temp_r,sizeof(temp_r),10,0x02)) >0)
-    {
-        if(memcmp(temp_r,"SEND OK",7)==0)
-        {
-            MO_INFO(("OK TcpClient_writen_hal %d",tcp_handle));
-            //usleep(5000*1000);
-            return ret;
-        }
-        else
-        {
-            MO_ERROR(("Failed TcpClient_writen_hal %d",tcp_handle));
-            return 0;
-        }
-    }
-    else
-    {
-        MO_ERROR(("Time out TcpClient_writen_hal %d",tcp_handle));
-        return 0;
-    }
-
+    //写入发送队列后返回 由wifi发送任务合并发送(AT+CIPSEND)
+    return mo_drv_wifi_write_tcpc_tx((const char *)p_dat,len,tcp_handle);
 }
 
 
@@ -295,6 +264,12 @@ void TcpClient_stop_hal(unsigned char handle)
         return;     //error
     }
 
+    //先发出队列中的数据(如 mqtt disconnect)
+    if(mo_drv_wifi_flush_tcpc_tx(handle,4)!=MO_SUCCESS)
+    {
+        MO_ERROR(("Time out flush TcpClient_stop_hal %d",handle));
+    }
+
     //send close cmd
     char temp_s[16];
     memset(temp_s,0x00,sizeof(temp_s));
@@ -15,6 +15,8 @@
 
 #include "lib_system_all.h"
 #include "lib_fifo.h"
+#include "lib_wifi_drv.h"
+#include "lib_wifi_drv_hal.h"
 
 
 
@@ -22,21 +24,61 @@ extern uint8_t  smartconfig_over_flag;
 /************************************************************************************
  * Private Types
  ************************************************************************************/
-#define SEARCH_SIZE 65                              //必须是奇数
-//#define SEARCH_SIZE 129
-
-typedef struct exceed_buf_s
+#define AT_LINE_SIZE 128                            //整行返回结果缓冲(+CWLAP等)  包含\r\n
+#define AT_RECV_SIZE 128                            //串口单次解析长度
+
+//返回结果类型
+#define AT_TOKEN_FIXED 0                            //匹配完成即处理   OK > SEND OK ...
+#define AT_TOKEN_LINE  1                            //收到行尾后处理   +CWJAP_CUR: ...
+#define AT_TOKEN_IPD   2                            //+IPD,<ch>,<len>: 之后为数据
+
+//解析状态
+#define AT_STATE_MATCH     0                        //行首  匹配返回结果
+#define AT_STATE_SKIP      1                        //不需要的行  跳到行尾
+#define AT_STATE_LINE      2                        //接收整行返回结果
+#define AT_STATE_IPD_HEAD  3                        //接收 <ch>,<len>:
+#define AT_STATE_IPD_DATA  4                        //数据直接写入tcp fifo
+
+typedef struct at_token_s
+{
+    const char *str;           //返回结果(行首)
+    unsigned char len;         //strlen(str)
+    unsigned char type;        //AT_TOKEN_xxx
+    unsigned char mask_num;    //filter_mask 掩码编号  31永远上报
+    char en_send_signal;       //写入cmd fifo后是否发送信号
+}at_token_t;
+
+typedef struct at_parser_s
 {
-    int available;             //可读的数据个数   0无
-    char buf[SEARCH_SIZE/2];   //缓冲
-}exceed_buf_t;
+    unsigned char state;       //AT_STATE_xxx
+    uint32_t cand;             //仍可能匹配的返回结果  at_tokens下标位图
+    int line_len;              //当前行已接收长度
+    char line[AT_LINE_SIZE];   //当前行
+    const at_token_t *token;   //已匹配的整行返回结果
+    unsigned char ipd_field;   //+IPD 0:通道 1:长度
+    int ipd_channel;           //+IPD 通道
+    int ipd_len;               //+IPD 剩余数据长度
+}at_parser_t;
 
 typedef struct tcpc_fifo_ctl_s
 {
     fifo_t handle[5];             //open的句柄
     char init_flag[5];         //初始化标志  未初始化 0  已经初始化    1
+    int lost[5];               //接收队列满丢弃的字节数
 }tcpc_fifo_ctl_t;
 
+#define TCPC_TX_SIZE 512                            //每个连接的发送队列大小  可以合并两个完整的mqtt报文(MQTT_MAX_PACKET_SIZE) 更长的数据分段写入
+#define TCPC_TX_TIMEOUT 10                          //等待发送队列空间超时 单位秒
+#define TCPC_RX_SIZE 2048                           //每个连接的接收队列大小  可以放下一个完整的+IPD(1460)
+
+typedef struct tcpc_tx_ctl_s
+{
+    fifo_t handle[5];             //待发送数据
+    char init_flag[5];            //初始化标志  未初始化 0  已经初始化    1
+    int pending[5];               //已排队 未返回SEND OK的字节数
+    mo_drv_wifi_tcpc_send_cb_t send_cb;    //发送完成回调
+}tcpc_tx_ctl_t;
+
 
 // define flag to deal with smartconfig specially
 volatile bool smartconfigStartFlag = false;
@@ -75,25 +117,29 @@ typedef struct mo_cmd_ctl_s
 #define RET_MD5SET "MD5 SET OK"             // 9
 #define RET_DOWNFW "+DOWNFILE:0"            //9
 
+//整行上报
+#define HEAD_CWJAP "+CWJAP_CUR:"
+#define HEAD_STAMAC "+CIPSTAMAC_DEF:"
+#define HEAD_APMAC "+CIPAPMAC_DEF:"
+
 
 /************************************************************************************
  * Private Data
  ************************************************************************************/
 static osThreadId handle_wifi_drv;			//wifi主任务句柄
+static osThreadId handle_wifi_tx;			//tcp发送任务句柄
 
-static UART_HandleTypeDef UartHandle;		//STM32串口句柄
-static fifo_t uart1_rx_fifo;						//串口接收fifo
-static osSemaphoreId uart1_rx_sem;			//串口接收fifo  信号量
 
-char seach_buf[SEARCH_SIZE];						//检索缓冲
-char recv_buf[SEARCH_SIZE/2];						//检索缓冲
-int recv_size;													//读取个数
-
-static exceed_buf_t exceed_buf;					//剩余数据缓冲
+static at_parser_t at_parser;					//返回结果解析
+static volatile char at_parser_clear_flag;		//请求解析任务清除当前状态
 static tcpc_fifo_ctl_t tcpc_ctl;				//tcp 返回上层句柄
+static tcpc_tx_ctl_t tcpc_tx_ctl;				//tcp 发送队列
+static char tcpc_tx_buf[TCPC_TX_SIZE];			//合并后一次CIPSEND的数据
 
 static osMutexId mutex_transfer_all;	//transfer all mutex
 static osSemaphoreId cond;						//transfer  信号量(事件)
+static osMutexId mutex_tx;						//tcp 发送队列 mutex
+static osSemaphoreId tx_sem;					//tcp 发送队列有数据 信号量(事件)
 
 
 static mo_cmd_ctl_t cmd_ctl;		//cmd fifo句柄	用于返回给上层cmd执行的结果
@@ -110,8 +156,8 @@ static mo_cmd_ctl_t cmd_ctl;		//cmd fifo句柄	用于返回给上层cmd执行的
   示例:
   添加一条返回结果
   1.定义返回结果的宏 并按顺序 增加掩码编号
-  2.在get_cmd_num中增加 返回掩码编号
-  3.在pthread_mo_uart_filter中增加filter_stream过滤
+  2.在at_tokens中增加返回结果 类型和掩码编号
+  3.需要特殊处理的 在at_parser_token/at_parser_line中增加
   4.在set_filter_en中增加使用命令的屏蔽或者不屏蔽掩码
 
 
@@ -129,170 +175,6 @@ static unsigned int filter_mask=0;
  ************************************************************************************/
 
 
-int read_exceed_buf(char *p_read)
-{
-
-#ifdef WIFI_DRV_DEBUG      //print  seach_buf
-    MO_PRINT(("rr"));
-    MO_PRINTN((exceed_buf.buf,exceed_buf.available));
-
-#endif
-
-
-    int temp_available;
-    temp_available=exceed_buf.available;
-
-    memcpy(p_read,exceed_buf.buf,exceed_buf.available);
-    exceed_buf.available=0;
-
-    return temp_available;
-}
-
-void write_exceed_buf(char *p_dat,int len)
-{
-//	printf("exceed w:%d ",len);
-    memcpy(exceed_buf.buf,p_dat,len);
-    exceed_buf.available=len;
-}
-
-int available_exceed_buf()
-{
-    return exceed_buf.available;
-}
-
-static void delay_ms_cnt(uint32_t n)
-{
-    volatile uint32_t per;
-
-    while(n--)
-    {
-        for(per=0;per<8650;per++);
-    }
-}
-
-
-static void mo_drv_wifi_reset_hardware()
-{
-    //esp8266 boot 1
-    pinMode(ESP_BOOT,OUTPUT);
-    digitalWrite(ESP_BOOT,HIGH);
-
-    //esp8266 reset
-    pinMode(ESP_RST,OUTPUT);
-    digitalWrite(ESP_RST,LOW);
-    delay_ms_cnt(200);
-    digitalWrite(ESP_RST,HIGH);
-}
-
-
-
-
-
-
-/*=======UART1=====================================================
-  =================================================================*/
-void uart1_hardware_init()
-{
-
-    __HAL_RCC_GPIOA_CLK_ENABLE();
-    __HAL_RCC_USART1_CLK_ENABLE();
-    GPIO_InitTypeDef  GPIO_InitStruct;
-    /* UART TX GPIO pin configuration  */
-    GPIO_InitStruct.Pin       = GPIO_PIN_9;
-    GPIO_InitStruct.Mode      = GPIO_MODE_AF_PP;
-    GPIO_InitStruct.Pull      = GPIO_NOPULL;
-    GPIO_InitStruct.Speed     = GPIO_SPEED_FAST;
-    GPIO_InitStruct.Alternate = GPIO_AF7_USART1;
-    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-    /* UART RX GPIO pin configuration  */
-    GPIO_InitStruct.Pin = GPIO_PIN_10;
-    GPIO_InitStruct.Alternate = GPIO_AF7_USART1;
-    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-
-    UartHandle.Instance          = USART1;
-    //UartHandle.Init.BaudRate     = 115200;
-    UartHandle.Init.BaudRate     = 460800;
-    UartHandle.Init.WordLength   = UART_WORDLENGTH_8B;
-    UartHandle.Init.StopBits     = UART_STOPBITS_1;
-    UartHandle.Init.Parity       = UART_PARITY_NONE;
-    UartHandle.Init.HwFlowCtl    = UART_HWCONTROL_NONE;
-    UartHandle.Init.Mode         = UART_MODE_TX_RX;
-    UartHandle.Init.OverSampling = UART_OVERSAMPLING_16;
-    HAL_UART_Init(&UartHandle);
-
-    //Configure the NVIC for UART
-    // HAL_NVIC_SetPriority(USART1_IRQn, 0x0f, 0);
-    HAL_NVIC_SetPriority(USART1_IRQn, 0x05, 0);
-    HAL_NVIC_EnableIRQ(USART1_IRQn);
-    __HAL_UART_ENABLE_IT(&UartHandle, UART_IT_RXNE);
-
-}
-
-
-void mo_uart1_init()
-{
-    //串口硬件初始化
-    uart1_hardware_init();
-
-    //创建信号量
-    osSemaphoreDef(UART1_SEM);
-    uart1_rx_sem = osSemaphoreCreate(osSemaphore(UART1_SEM) , 1);
-
-    //创建串口接收fifo
-    fifo__init(&uart1_rx_fifo,1024*4);
-
-}
-
-int mo_uart1_read(char *p_buf,int len,int timeout)
-{
-
-    int ret,status;
-
-    //如果fifo为空则 阻塞
-    if( fifo__avaliable(&uart1_rx_fifo)==0 )
-    {
-        status=osSemaphoreWait(uart1_rx_sem,osWaitForever);
-        MO_ASSERT((status==osOK));
-    }
-
-    //读取数据
-    ret=fifo__read(&uart1_rx_fifo,(uint8_t *)p_buf,len);
-
-#ifdef WIFI_DRV_DEBUG
-    MO_PRINT(("r"));
-    MO_PRINTN((p_buf,ret));
-#endif
-
-    return ret;
-
-}
-
-int mo_uart1_write(const char *p_buf,int len)
-{
-
-    //debug
-#ifdef WIFI_DRV_DEBUG
-    MO_PRINT(("w"));
-    MO_PRINTN((p_buf,len));
-#endif
-
-    HAL_StatusTypeDef ret;
-
-    ret=HAL_UART_Transmit(&UartHandle,(uint8_t *)p_buf,(uint16_t)len,5);//5ms
-
-    if(ret!=HAL_OK)
-    {
-        // MO_ERROR(("write error"));
-        return -1;
-    }
-    else
-    {
-        return len;
-    }
-
-}
-
-
 /*=======CMD=====================================================
   =================================================================*/
 int mo_cmd_init()
@@ -357,10 +239,10 @@ int mo_cmd_fifo_write(const char *p_buf,int len)
 
 static void mo_cmd_clear_fifo()
 {
-    uint8_t temp[32];
-    while(fifo__read( &(cmd_ctl.handle),temp,sizeof(temp))>0)
+    if(fifo__avaliable(&(cmd_ctl.handle))>0)
     {
         MO_INFO(("mo_cmd_clear_fifo"));
+        fifo__flush(&(cmd_ctl.handle));
     }
 }
 
@@ -420,9 +302,8 @@ void clear_filter_en()
 
 void clear_buf_sf()
 {
-    memset(seach_buf,'$',SEARCH_SIZE-1);     //clear buf
-    seach_buf[SEARCH_SIZE-1]=0x00;            //max  index  SEARCH_SIZE-1
-    memset(recv_buf,0x00,sizeof(recv_buf));
+    //由解析任务在下一次读取前清除
+    at_parser_clear_flag=1;
 }
 
 
@@ -471,7 +352,8 @@ int mo_drv_wifi_cmd_transfer(const char *p_cmd,int len_cmd,char *p_get,int len,u
     //set
     set_filter_en(p_cmd);
 
-    MO_INFO(("uart1 write cmd %s\r\n", p_cmd));
+    //发送数据时p_cmd不以0结尾且可能超出打印缓冲区, 只打印开头部分
+    MO_INFO(("uart1 write cmd %.*s\r\n", (len_cmd > 64) ? 64 : len_cmd, p_cmd));
 
     //write cmd
     if(mo_uart1_write(p_cmd,len_cmd)<0)
@@ -618,81 +500,6 @@ ret_ok:
 
 
 
-/*
-  功能:
-  过滤TCP回传的数据用
-  在缓冲区中搜索TCP回传数据头"+IPD,0,32:",并返回数据通道和数据长度以数据的多一个地址
-
-  参数:
-  缓冲区起始地址(0x00结尾)
-  返回的通道
-  返回的数据长度
-
-  返回:
-  跳过头  纯数据的第一个地址
-  未发现头 NULL
-
-  示例:
-  接收到的数据 +IPD,0,32:http://www.cmsoft.cn QQ:1086
-
-*/
-char *strstr_tcp(char *p_dat,unsigned char *channel,int *len)
-{
-    char *p_index1,*p_index2,*p_index3;
-
-#if 0
-    MO_PRINT(("strstr_tcp:"));
-    MO_PRINTN((p_dat,SEARCH_SIZE-1));
-#endif
-
-    //搜索到 +IPD,
-    if((p_index1=strstr(p_dat,HEAD_TCPC))!=NULL)
-    {
-        // MO_PRINT(("GET:%s\n",p_index1));
-
-
-        //搜索第二个到 ,
-        if((p_index2=strstr(p_index1+sizeof(HEAD_TCPC)-1,","))!=NULL)
-        {
-            // MO_PRINT(("GET:%s\n",p_index2));
-
-            //搜索到:
-            if((p_index3=strstr(p_index2+sizeof(",")-1,":"))!=NULL)
-            {
-                // MO_PRINT(("GET:%s\n",p_index3));
-
-                //获取通道
-                *channel=*(p_index1+5)-'0';
-                //获取数据长度
-                char temp[8];
-                memset(temp,0x00,sizeof(temp));
-                memcpy(temp,p_index2+1,p_index3-p_index2);
-                *len=atoi(temp);
-
-                //清除s缓冲区
-                memset(p_index1,'$',p_index3-p_index1+1);
-
-
-                // MO_PRINT(("channel=%d len=%d\n",*channel,*len));
-
-                //判断结果
-                if( (0<=(*channel)) && ((*channel)<=5) && (0<(*len)) && ((*len)<4096) )
-                {
-                    return p_index3+1;
-                }
-                else
-                {
-                    MO_ERROR(("over flow"));
-                }
-            }
-        }
-    }
-
-    //  printf("null\n");
-    return NULL;
-
-
-}
 
 
 
@@ -708,7 +515,24 @@ int mo_drv_wifi_creat_tcpc_fifo(unsigned char fifo_num)
         return MO_FAILED;
     }
 
-    return fifo__init( &(tcpc_ctl.handle[fifo_num]),1024 );
+    if(fifo__init( &(tcpc_ctl.handle[fifo_num]),TCPC_RX_SIZE )!=0)
+    {
+        return MO_FAILED;
+    }
+    tcpc_ctl.lost[fifo_num]=0;
+
+    //发送队列
+    osMutexWait(mutex_tx, osWaitForever);
+    if(fifo__init( &(tcpc_tx_ctl.handle[fifo_num]),TCPC_TX_SIZE )!=0)
+    {
+        osMutexRelease(mutex_tx);
+        fifo__deinit(&(tcpc_ctl.handle[fifo_num]));
+        return MO_FAILED;
+    }
+    tcpc_tx_ctl.pending[fifo_num]=0;
+    tcpc_tx_ctl.init_flag[fifo_num]=1;
+    osMutexRelease(mutex_tx);
+    return MO_SUCCESS;
 
 }
 
@@ -724,6 +548,27 @@ int mo_drv_wifi_destroy_tcpc_fifo(unsigned char fifo_num)
 
     fifo__deinit(&(tcpc_ctl.handle[fifo_num]));
 
+    //未发送的数据直接丢弃
+    int discard=0;
+    osMutexWait(mutex_tx, osWaitForever);
+    if(tcpc_tx_ctl.init_flag[fifo_num])
+    {
+        discard=fifo__avaliable(&(tcpc_tx_ctl.handle[fifo_num]));
+        tcpc_tx_ctl.init_flag[fifo_num]=0;
+        tcpc_tx_ctl.pending[fifo_num]=0;
+        fifo__deinit(&(tcpc_tx_ctl.handle[fifo_num]));
+    }
+    osMutexRelease(mutex_tx);
+
+    if(discard>0)
+    {
+        MO_ERROR(("tcpc %d discard %d bytes",fifo_num,discard));
+        if(tcpc_tx_ctl.send_cb!=NULL)
+        {
+            tcpc_tx_ctl.send_cb(fifo_num,discard,MO_FAILED);
+        }
+    }
+
     return 0;
 
 }
@@ -794,66 +639,42 @@ int mo_drv_wifi_write_tcpc_fifo(const char *p_buf,int len,unsigned char fifo_num
     MO_PRINTN((p_buf,len));
 #endif
 
-    //write
-    fifo__write( &(tcpc_ctl.handle[fifo_num]),(const uint8_t *)p_buf,len);
+    //在AT解析任务中调用, 不能阻塞等待(会卡住所有连接并使串口接收缓冲溢出)
+    //接收队列满时丢弃剩余数据并计数, 数据流已不完整, 上层查询到丢失后断开重连
+    int n=fifo__write( &(tcpc_ctl.handle[fifo_num]),(const uint8_t *)p_buf,len);
+    if(n<len)
+    {
+        if(tcpc_ctl.lost[fifo_num]==0)
+        {
+            MO_ERROR(("tcpc %d rx overflow %d",fifo_num,len-n));
+        }
+        tcpc_ctl.lost[fifo_num]+=len-n;
+    }
 
-    return len;
+    return n;
 
 }
 
-
-
-
-
-
 /*
   功能:
-  获取一条	返回结果的 掩码位置
+  查询接收队列满丢弃的字节数, 非0时该连接的数据流已不完整
 
+  参数:
+  tcp连接号码
+
+  返回:
+  丢弃的字节数
 */
-unsigned char get_cmd_mask_num(const char *p_cmd)
+int mo_drv_wifi_lost_tcpc_fifo(unsigned char fifo_num)
 {
-
-    if(strcmp(p_cmd,SEND_OK_TCPC)==0)
-    {
-        return 0;		//bit 0   0x01
-    }
-    else if(strcmp(p_cmd,RET_REST)==0)
-    {
-        return 1;		//bit 1   0x02
-    }
-    else if(strcmp(p_cmd,SEND_ACK_TCPC)==0)
-    {
-        return 2;		//bit 2   0x04
-    }
-    else if(strcmp(p_cmd,RET_STATUS_2)==0)
-    {
-        return 3;		//bit 4   0x08
-    }
-    else if(strcmp(p_cmd,RET_OK)==0)
-    {
-        return 4;		//bit 5   0x10
-    }
-    else if(strcmp(p_cmd,ALREADY_CONNECT)==0)
-    {
-        return 5;
-    }
-    else if(strcmp(p_cmd,RET_STATUS_5)==0)
-    {
-        return 6;
-    }
-    else if(strcmp(p_cmd,HEAD_IPSTATUS)==0)
-    {
-        return 7;
-    }
-    else
+    //check pram
+    if(fifo_num>4)
     {
-        // MO_ERROR(("Failed get_cmd_mask_num %s",p_cmd));
-        MO_INFO(("No cmd mask num %s",p_cmd));
-        //return 30;	//上抛结果
-        return 31;	//上抛结果
+        MO_ERROR(("bad pram"));
+        return 0;
     }
 
+    return tcpc_ctl.lost[fifo_num];
 }
 
 
@@ -861,531 +682,642 @@ unsigned char get_cmd_mask_num(const char *p_cmd)
 
 
 
+/*========TCP_TX=========================================================
+  ==========================================================================*/
+
 /*
   功能:
-  过滤TCP状态用
-  在缓冲区中搜索TCP状态头,并获取通道、类型 (以获取当前网络状态)
+  数据写入tcp发送队列, 写入后立即返回, 由发送任务合并成一次CIPSEND发出
 
   参数:
-  缓冲区起始地址(0x00结尾)
-  获取的通道
-  获取的类型 Type:'1' tcp  '2' udp
+  数据
+  数据长度
+  tcp连接号码
 
   返回:
-  发现:头的首地址
-  未发现头: NULL
-
-  示例:
-  接收到的数据 +CIPSTATUS:0,"TCP","192.168.0.124",2345,0
+  n  写入长度
+  0  失败(连接未打开 或者 等待队列空间超时)
 
+  说明:
+  不超过TCPC_TX_SIZE的数据整体写入, 不会和其他任务写入的数据交错
 */
-
-char *strstr_ipstaus(char *p_dat,unsigned char *channel, unsigned char *type)
+int mo_drv_wifi_write_tcpc_tx(const char *p_buf,int len,unsigned char fifo_num)
 {
-    char *p_index1,*p_index2,*p_index3;
-
-#if 0
-    MO_PRINT(("strstr_tcp:"));
-    MO_PRINTN((p_dat,SEARCH_SIZE-1));
-#endif
+    //check pram
+    if((p_buf==NULL) ||(len<=0) ||(fifo_num>4) )
+    {
+        MO_ERROR(("bad pram"));
+        return 0;
+    }
 
-    //搜索到+CIPSTATUS:
-    if((p_index1=strstr(p_dat,HEAD_IPSTATUS))!=NULL)
+    int written=0;
+    uint32_t start=millis();
+    while(written<len)
     {
-        //   MO_PRINT(("GET:%s\n",p_index1));
-        //搜索到第一个,
-        if((p_index2=strstr(p_index1+strlen(HEAD_IPSTATUS),","))!=NULL)
+        int n=len-written;
+        if(n>TCPC_TX_SIZE)
         {
-            // MO_PRINT(("GET:%s\n",p_index2));
-            //搜索到第二个,
-            if((p_index3=strstr(p_index2+strlen(","),","))!=NULL)
-            {
-                //  MO_PRINT(("GET:%s\n",p_index3));
-                //获取通道
-                *channel=*(p_index1+11);
-                //获取数据长度
-
-                *type=0;
-                if(memcmp( (p_index1+14),"TCP",3)==0 )
-                {
-                    *type='1';
-                }
-                else if(memcmp( (p_index1+14),"UDP",3)==0 )
-                {
-                    *type='2';
-                }
-
-                // MO_DEBUG(("ip_channel=%c ip_type=%c",*channel,*type));
-                memset(p_index1,'$',strlen(HEAD_IPSTATUS));  //清除s缓冲区
+            n=TCPC_TX_SIZE;
+        }
 
+        osMutexWait(mutex_tx, osWaitForever);
+        if(!tcpc_tx_ctl.init_flag[fifo_num])
+        {
+            osMutexRelease(mutex_tx);
+            MO_ERROR(("tcpc %d not open",fifo_num));
+            return written;
+        }
+        if( (TCPC_TX_SIZE-fifo__avaliable(&(tcpc_tx_ctl.handle[fifo_num]))) >= n )
+        {
+            fifo__write(&(tcpc_tx_ctl.handle[fifo_num]),(const uint8_t *)p_buf+written,n);
+            tcpc_tx_ctl.pending[fifo_num]+=n;
+            written+=n;
+            osMutexRelease(mutex_tx);
+            osSemaphoreRelease(tx_sem);
+            continue;
+        }
+        osMutexRelease(mutex_tx);
 
-                //判断结果
-                if( ('0'<=(*channel))&& ((*channel)<'5') && ('0'<(*type)) && ((*type)<'3')  )
-                {
-                    return p_index1;
-                }
-            }
+        //队列满 等待发送任务发出
+        osSemaphoreRelease(tx_sem);
+        if((millis()-start) > TCPC_TX_TIMEOUT*1000)
+        {
+            MO_ERROR(("Time out mo_drv_wifi_write_tcpc_tx %d",fifo_num));
+            return written;
         }
+        osDelay(5);
     }
-
-    //  printf("null\n");
-    return NULL;
-
-
+    return written;
 }
 
+/*
+  功能:
+  查看tcp发送队列中 未发送完成的字节数
 
+  返回:
+  字节数
+*/
+int mo_drv_wifi_pending_tcpc_tx(unsigned char fifo_num)
+{
+    if(fifo_num>4)
+    {
+        MO_ERROR(("bad pram"));
+        return 0;
+    }
 
-// void print(char* p)
-// {
-//     Serial.write("*");
-//     while(p)
-//     {
-//         Serial.write(*p++);
-//     }
-//     Serial.write("*");
-// }
-
-// void printn(char* p, uint8_t n)
-// {
-//     Serial.write("#");
-//     while(n--)
-//     {
-//         Serial.write(*p++);
-//     }
-//     Serial.write("#");
-// }
-
-
+    int pending;
+    osMutexWait(mutex_tx, osWaitForever);
+    pending=tcpc_tx_ctl.init_flag[fifo_num] ? tcpc_tx_ctl.pending[fifo_num] : 0;
+    osMutexRelease(mutex_tx);
+    return pending;
+}
 
 /*
   功能:
-  从缓冲区过滤出需要的数据并从缓冲区删除，
-  并写入cmdfifo，并发送条件信号到上层(根据信号掩码)
+  等待tcp发送队列发送完成
 
   参数:
-  缓冲区起始地址(0x00结尾)
-  需要过滤的字符串(有结束符)
-  是否在写入数据之后向上发送send_signal 1发送 0不发 如果接收到的字符后面需要使用OK发送信号触发，此次传输结束则设置为0
+  tcp连接号码
+  超时时间 单位秒
 
   返回:
-  MO_FAILED   失败
-  MO_SUCCESS  成功
-
-
+  MO_SUCCESS 发送完成
+  MO_FAILED 超时
 */
-static int filter_stream(char *seach_buf,const char *p_filter,char en_send_signal)
+int mo_drv_wifi_flush_tcpc_tx(unsigned char fifo_num,unsigned int timeout)
 {
-
-    char *p_index;
-
-    // deal with smartconfig specially
-    if (0 == strcmp(p_filter, RET_SMARTCONFIG))
+    uint32_t start=millis();
+    while(mo_drv_wifi_pending_tcpc_tx(fifo_num)>0)
     {
-        if ((p_index=strstr(seach_buf,p_filter))!=NULL)
+        if((millis()-start) > timeout*1000)
         {
-            memset(p_index,'$',strlen(p_filter));  //clear data
-            smartconfigStrFoundFlag = true;
-            return MO_SUCCESS;
+            return MO_FAILED;
         }
-
+        osSemaphoreRelease(tx_sem);
+        osDelay(5);
     }
+    return MO_SUCCESS;
+}
 
+/*
+  功能:
+  设置发送完成回调  在发送任务中调用, 回调中不能写tcp
+  result: MO_SUCCESS 收到SEND OK  MO_FAILED 发送失败或连接关闭时丢弃
+*/
+void mo_drv_wifi_set_tcpc_send_cb(mo_drv_wifi_tcpc_send_cb_t send_cb)
+{
+    tcpc_tx_ctl.send_cb=send_cb;
+}
 
-    if((p_index=strstr(seach_buf,p_filter))!=NULL)
-    {
-        memset(p_index,'$',strlen(p_filter));  //clear data
-        unsigned char cmd_num=get_cmd_mask_num(p_filter);
+/*
+  功能:
+  一次 AT+CIPSEND 发送数据  (> 和 SEND OK 两次应答)
 
-        // if( (signal) ||(mo_drv_wifi_get_cond_flag()) )
-        if (filter_mask & (0x01<<cmd_num))
-        {
-            //write in
-            if(mo_cmd_fifo_write(p_filter,strlen(p_filter)+1)<0)
-            {
-                MO_ERROR(("mo_cmd_fifo_write failed"));
-                return MO_FAILED;
-            }
+  返回:
+  MO_SUCCESS 成功
+  MO_FAILED 失败
+*/
+static int mo_drv_wifi_cipsend(const char *p_dat,int len,unsigned char tcp_handle)
+{
+    char temp_w[24];
+    char temp_r[32];
+    memset(temp_w,0x00,sizeof(temp_w));
+    memset(temp_r,0x00,sizeof(temp_r));
+    sprintf(temp_w,"AT+CIPSEND=%d,%d",tcp_handle,len);
+
+    if( (mo_drv_wifi_cmd_transfer((const char *)temp_w,strlen(temp_w),temp_r,sizeof(temp_r),10,0x01)<=0)
+        || (memcmp(temp_r,">",1)!=0) )
+    {
+        MO_ERROR(("0.5Failed mo_drv_wifi_cipsend %d",tcp_handle));
+        //0x01 加锁后没有发送数据 这里释放
+        osMutexRelease(mutex_transfer_all);
+        return MO_FAILED;
+    }
 
-            if(en_send_signal)
-            {
-                osSemaphoreRelease(cond);
-            }
-        }
-        else
-        {
-            // MO_INFO(("NO need send"));
-        }
+    memset(temp_r,0x00,sizeof(temp_r));
+    if( (mo_drv_wifi_cmd_transfer(p_dat,len,temp_r,sizeof(temp_r),10,0x02)>0)
+        && (memcmp(temp_r,"SEND OK",7)==0) )
+    {
+        MO_INFO(("OK mo_drv_wifi_cipsend %d %d",tcp_handle,len));
         return MO_SUCCESS;
     }
+
+    MO_ERROR(("Failed mo_drv_wifi_cipsend %d",tcp_handle));
     return MO_FAILED;
 }
 
-
-void task_mo_uart_filter(void const *argument)
+/*
+  功能:
+  发送一个连接队列中的全部数据(最多TCPC_TX_SIZE) 发送失败时丢弃该连接剩余数据
+*/
+static void mo_drv_wifi_send_tcpc_tx(unsigned char fifo_num)
 {
+    int len,discard=0;
 
-    mo_cmd_init();
-    mo_uart1_init();
+    osMutexWait(mutex_tx, osWaitForever);
+    if(!tcpc_tx_ctl.init_flag[fifo_num])
+    {
+        osMutexRelease(mutex_tx);
+        return;
+    }
+    len=fifo__read(&(tcpc_tx_ctl.handle[fifo_num]),(uint8_t *)tcpc_tx_buf,TCPC_TX_SIZE);
+    osMutexRelease(mutex_tx);
 
-    memset(seach_buf,'$',SEARCH_SIZE-1);     //clear buf
-    seach_buf[SEARCH_SIZE-1]=0x00;            //max  index  SEARCH_SIZE-1
+    if(len<=0)
+    {
+        return;
+    }
 
-    char *p_index;
-    memset(recv_buf,0x00,sizeof(recv_buf));
+    int ret=mo_drv_wifi_cipsend(tcpc_tx_buf,len,fifo_num);
 
-    while(1)
+    osMutexWait(mutex_tx, osWaitForever);
+    if(tcpc_tx_ctl.init_flag[fifo_num])
     {
-        //读取数据
-        if( available_exceed_buf() )
+        tcpc_tx_ctl.pending[fifo_num]-=len;
+        if(ret!=MO_SUCCESS)
         {
-            recv_size=read_exceed_buf(recv_buf);	//tcp 接收完数据 剩余的数据
+            //数据流已经不完整 后面排队的数据也不再发送
+            discard=fifo__avaliable(&(tcpc_tx_ctl.handle[fifo_num]));
+            fifo__flush(&(tcpc_tx_ctl.handle[fifo_num]));
+            tcpc_tx_ctl.pending[fifo_num]-=discard;
         }
-        else
+    }
+    osMutexRelease(mutex_tx);
+
+    if(tcpc_tx_ctl.send_cb!=NULL)
+    {
+        tcpc_tx_ctl.send_cb(fifo_num,len,ret);
+        if(discard>0)
         {
-            recv_size=mo_uart1_read(recv_buf,sizeof(recv_buf),100*1000);		//串口读取
+            tcpc_tx_ctl.send_cb(fifo_num,discard,MO_FAILED);
         }
+    }
+}
 
-        //过滤数据
-        if(recv_size>0)
-        {
-        recv_head:
+/*
+  功能:
+  tcp发送任务  等待发送队列有数据 依次发送各个连接的数据
+*/
+void task_mo_wifi_tx(void const *argument)
+{
+    unsigned char i;
 
-            //debug
-#if 0
-            MO_PRINT(("recv:"));
-            MO_PRINTN((recv_buf,recv_size));
-#endif
+    for(;;)
+    {
+        //写入 flush 时释放信号量唤醒  空闲时不轮询
+        osSemaphoreWait(tx_sem, osWaitForever);
+        for(i=0;i<5;i++)
+        {
+            mo_drv_wifi_send_tcpc_tx(i);
+        }
+    }
+}
 
-            memmove(seach_buf,seach_buf+recv_size,SEARCH_SIZE-1-recv_size);
-            memcpy(seach_buf+SEARCH_SIZE-1-recv_size, recv_buf, recv_size);
 
-            memset(recv_buf,0x00,sizeof(recv_buf));     //clear buf
 
-        prase_head:
 
-#ifdef WIFI_DRV_DEBUG_S      //print  seach_buf
+/*========AT 返回结果解析===================================================
+  单遍流式解析: 在行首逐字节同时匹配所有返回结果(at_tokens),
+  +IPD 的数据直接写入tcp fifo, 不经过检索缓冲
+  ==========================================================================*/
 
-            MO_PRINT(("s"));
-            MO_PRINTN((seach_buf,SEARCH_SIZE-1));
+#define AT_TOKEN(str,type,mask_num,en_send_signal) {str,sizeof(str)-1,type,mask_num,en_send_signal}
 
-#endif
-            unsigned char tcpc_channel;   //接收到的数据通道
-            int tcpc_len,tcpc_w_index;    //接收到的数据长度  已经写入数据长度
+static const at_token_t at_tokens[]=
+{
+    AT_TOKEN(SEND_OK_TCPC,    AT_TOKEN_FIXED, 0,  1),
+    AT_TOKEN(RET_REST,        AT_TOKEN_FIXED, 1,  1),
+    AT_TOKEN(SEND_ACK_TCPC,   AT_TOKEN_FIXED, 2,  1),
+    AT_TOKEN(RET_STATUS_2,    AT_TOKEN_FIXED, 3,  0),
+    AT_TOKEN(RET_OK,          AT_TOKEN_FIXED, 4,  1),
+    AT_TOKEN(ALREADY_CONNECT, AT_TOKEN_FIXED, 5,  1),
+    AT_TOKEN(RET_STATUS_5,    AT_TOKEN_FIXED, 6,  0),
+    AT_TOKEN(HEAD_IPSTATUS,   AT_TOKEN_LINE,  7,  0),
+    AT_TOKEN(RET_SMARTCONFIG, AT_TOKEN_FIXED, 31, 0),
+    AT_TOKEN(RET_MD5SET,      AT_TOKEN_FIXED, 31, 1),
+    AT_TOKEN(RET_DOWNFW,      AT_TOKEN_FIXED, 31, 1),
+    AT_TOKEN(HEAD_CWJAP,      AT_TOKEN_LINE,  31, 1),
+    AT_TOKEN(HEAD_STAMAC,     AT_TOKEN_LINE,  31, 1),
+    AT_TOKEN(HEAD_APMAC,      AT_TOKEN_LINE,  31, 1),
+    AT_TOKEN(HEAD_WIFI_LIST,  AT_TOKEN_LINE,  31, 0),   //OK 发送信号
+    AT_TOKEN(HEAD_TCPC,       AT_TOKEN_IPD,   31, 0),
+};
+
+#define AT_TOKEN_NUM (sizeof(at_tokens)/sizeof(at_tokens[0]))
+#define AT_TOKEN_ALL ((uint32_t)((1UL<<AT_TOKEN_NUM)-1))
 
-            if((p_index=strstr_tcp(seach_buf,&tcpc_channel,&tcpc_len))!=NULL)        //TCPC  filter
-            {
-                //   printf("Get +%s\n",HEAD_TCPC);
 
-                tcpc_w_index=0;
-                //seach_buf   tcp head+dat+other head2
-                if( p_index != (seach_buf+SEARCH_SIZE-1) )	//seach_buf缓冲区中还包含有数据 则需要写入
-                {
-                    //seach_buf  data
-                    if( ((seach_buf+SEARCH_SIZE-1)-p_index) < tcpc_len )//seach_buf缓冲区 只是部分数据
-                    {
+/*
+  功能:
+  解析器回到行首
+*/
+static void at_parser_line_start(at_parser_t *parser)
+{
+    parser->state=AT_STATE_MATCH;
+    parser->cand=AT_TOKEN_ALL;
+    parser->line_len=0;
+    parser->token=NULL;
+}
 
-                        if( mo_drv_wifi_write_tcpc_fifo(p_index,(seach_buf+SEARCH_SIZE-1)-p_index,tcpc_channel) <0 )
-                        {
-                            MO_ERROR(("mo_cmd_fifo_write failed"));
-                        }
+static void at_parser_init(at_parser_t *parser)
+{
+    memset(parser,0,sizeof(at_parser_t));
+    at_parser_line_start(parser);
+}
 
-                        tcpc_w_index+=( (seach_buf+SEARCH_SIZE-1)-p_index );
-                        memset(p_index,'$',(seach_buf+SEARCH_SIZE-1)-p_index); //清除s缓冲区
-                    }
-                    else    //seach_buf   tcp head+dat+other head2  //seach_buf缓冲区 包含此次所有数据
-                    {
-                        //write in
-                        if(mo_drv_wifi_write_tcpc_fifo(p_index,tcpc_len,tcpc_channel) <0 )
-                        {
-                            MO_ERROR(("mo_cmd_fifo_write failed"));
-                        }
+/*
+  功能:
+  串口接收缓冲溢出(DMA覆盖了未读数据) 当前位置已不在原来的数据流中
+  正在接收的+IPD 剩余数据计入该连接的丢失数据, 丢掉的数据中还可能有其他连接的+IPD,
+  所有连接都记为丢失(至少1字节), 上层断开重连; 解析器跳到下一个行首重新同步
+*/
+static void at_parser_overrun(at_parser_t *parser)
+{
+    int i;
 
-                        //清空此次数据
-                        memset(p_index,'$',tcpc_len);  //清除s缓冲区
+    for(i=0;i<5;i++)
+    {
+        tcpc_ctl.lost[i]++;
+    }
+    if((parser->state==AT_STATE_IPD_DATA)&&(parser->ipd_len>0))
+    {
+        MO_ERROR(("tcpc %d lost %d bytes",parser->ipd_channel,parser->ipd_len));
+        tcpc_ctl.lost[parser->ipd_channel]+=parser->ipd_len-1;
+    }
+    at_parser_line_start(parser);
+    parser->state=AT_STATE_SKIP;
+}
 
-                        //跳转到数据解析(有可能出现多个IP包)
-                        MO_INFO(("goto prase_head"));
-                        goto prase_head;
+/*
+  功能:
+  返回结果写入cmd fifo, 并发送条件信号到上层(根据信号掩码)
+*/
+static void at_parser_report(const at_token_t *token,const char *p_dat,int len,char en_send_signal)
+{
+    if(filter_mask & (0x01<<token->mask_num))
+    {
+        //write in
+        if(mo_cmd_fifo_write(p_dat,len)<0)
+        {
+            MO_ERROR(("mo_cmd_fifo_write failed"));
+            return;
+        }
 
-                    }
-                }
+        if(en_send_signal)
+        {
+            osSemaphoreRelease(cond);
+        }
+    }
+}
 
-                //clear buf
-                //memset(seach_buf,'$',SEARCH_SIZE-1);  //clear buf
+/*
+  功能:
+  匹配到 AT_TOKEN_FIXED 返回结果
+*/
+static void at_parser_token(const at_token_t *token)
+{
+    if(strcmp(token->str,RET_SMARTCONFIG)==0)
+    {
+        smartconfigStrFoundFlag = true;
+        smartconfig_over_flag = 1;
+        MO_INFO(("GET %s",RET_SMARTCONFIG));
+        return;
+    }
 
+    //上报带结束符的字符串
+    at_parser_report(token,token->str,token->len+1,token->en_send_signal);
+}
 
-                while(1)   //seach_buf缓冲区 只是部分数据  接收剩余数据
-                {
-                    recv_size=mo_uart1_read(recv_buf,sizeof(recv_buf),100*1000);
-                    if(recv_size>0)
-                    {
-                        //debug
-                        /* MO_PRINT(("recv_buf"));
-                           MO_PRINTN((recv_buf,recv_size));*/
-
-                        tcpc_w_index+=recv_size;
-
-                        //only  dat  数据未完
-                        if(tcpc_w_index<tcpc_len)
-                        {
-                            if(mo_drv_wifi_write_tcpc_fifo(recv_buf,recv_size,tcpc_channel)<0)
-                            {
-                                MO_ERROR(("mo_cmd_fifo_write failed"));
-                            }
-                        }//dat+other head   遇到数据结尾
-                        else if(tcpc_w_index>=tcpc_len)
-                        {
-                            int available_len;
-                            available_len=recv_size-(tcpc_w_index-tcpc_len);
-                            if(mo_drv_wifi_write_tcpc_fifo(recv_buf, available_len,tcpc_channel)<0)
-                            {
-                                MO_ERROR(("mo_cmd_fifo_write failed"));
-                            }
-
-
-
-                            // memset(recv_buf,'$',available_len);
-
-                            write_exceed_buf(recv_buf+available_len,recv_size-available_len);
-                            break;
-                            //memset(seach_buf,'$',sizeof(seach_buf)-1);  //clear buf
-                            // MO_INFO(("TCPC END go  recv_head"));
-                            //goto recv_head;
-                        }
-                    }
-                }
-            }
+/*
+  功能:
+  接收到 AT_TOKEN_LINE 返回结果的整行
 
+  示例:
+  +CIPSTATUS:0,"TCP","192.168.0.124",2345,0
+  +CWJAP_CUR:"ssid","bssid",1,-50
+*/
+static void at_parser_line(at_parser_t *parser)
+{
+    const at_token_t *token=parser->token;
+    char *p_line=parser->line;
 
-            if(filter_stream(seach_buf,SEND_OK_TCPC,1)==MO_SUCCESS)            //filter tcp  send ok
-            {
-                //  MO_INFO(("GET %s",SEND_OK_TCPC));
-            }
+    if(strcmp(token->str,HEAD_IPSTATUS)==0)
+    {
+        //channel  type('1' tcp  '2' udp)  separator('$')
+        unsigned char ret_ipstatus[3]={0,0,'$'};
 
-            if(filter_stream(seach_buf,RET_REST,1)==MO_SUCCESS)           //filter ret reset
-            {
-                //   MO_INFO(("GET %s",RET_REST));
-            }
-            if(filter_stream(seach_buf,RET_STATUS_2,0)==MO_SUCCESS)           //filter STATUS:2
-            {
-                //    MO_INFO(("GET %s",RET_STATUS_2));
-            }
-            if(filter_stream(seach_buf,RET_STATUS_5,0)==MO_SUCCESS)           //filter STATUS:5
-            {
-                //    MO_INFO(("GET %s",RET_STATUS_2));
-            }
+        if(parser->line_len<17)
+        {
+            return;
+        }
+        ret_ipstatus[0]=p_line[11];
+        if(memcmp(p_line+14,"TCP",3)==0)
+        {
+            ret_ipstatus[1]='1';
+        }
+        else if(memcmp(p_line+14,"UDP",3)==0)
+        {
+            ret_ipstatus[1]='2';
+        }
 
-            unsigned char ret_ipstatus[3]={0,0,'$'};  //channel  type  separator('$')
-            if((p_index=strstr_ipstaus(seach_buf,&ret_ipstatus[0],&ret_ipstatus[1]))!=NULL)     // TCPC  connected
-            {
-                //     MO_INFO(("GET ipstaus"));
-                //    memset(seach_buf,'$',sizeof(seach_buf)-1);  //clear dat
+        if( ('0'<=ret_ipstatus[0]) && (ret_ipstatus[0]<'5') && (ret_ipstatus[1]!=0) )
+        {
+            at_parser_report(token,(const char *)ret_ipstatus,3,token->en_send_signal);
+        }
+        return;
+    }
 
-                unsigned char cmd_num=get_cmd_mask_num(HEAD_IPSTATUS);
+    //整行(包含\r\n)上报  不受掩码限制
+    int len=parser->line_len;
+    if(len>AT_LINE_SIZE-2)
+    {
+        len=AT_LINE_SIZE-2;
+    }
+    p_line[len++]='\r';
+    p_line[len++]='\n';
+    MO_DEBUG(("foundstr: %.*s",len-2,p_line));
+    if(mo_cmd_fifo_write(p_line,len)<0)
+    {
+        MO_ERROR(("mo_cmd_fifo_write failed"));
+        return;
+    }
+    if(token->en_send_signal)
+    {
+        osSemaphoreRelease(cond);
+    }
+}
 
-                //  if(mo_drv_wifi_get_cond_flag())
-                if(filter_mask&(0x01<<cmd_num))
-                {
-                    //write in
-                    if(mo_cmd_fifo_write((const char *)ret_ipstatus,3)<0)
-                    {
-                        MO_ERROR(("mo_cmd_fifo_write failed"));
-                    }
+/*
+  功能:
+  +IPD,<ch>,<len>: 头接收完成  检查通道和长度
+*/
+static void at_parser_ipd_head(at_parser_t *parser)
+{
+    if( (0<=parser->ipd_channel) && (parser->ipd_channel<=4) && (0<parser->ipd_len) && (parser->ipd_len<4096) )
+    {
+        parser->state=AT_STATE_IPD_DATA;
+    }
+    else
+    {
+        MO_ERROR(("over flow"));
+        parser->state=AT_STATE_SKIP;
+    }
+}
 
-#if 0
-                    //send  signal
-                    int status;
-                    status = pthread_mutex_lock(&mutex);
-                    MO_ASSERT((status==0));
+/*
+  功能:
+  解析串口数据  可以任意分段输入
 
-                    status = pthread_cond_signal(&cond);
-                    MO_ASSERT((status==0));
+  参数:
+  数据
+  数据长度
+*/
+static void at_parser_input(at_parser_t *parser,const char *p_dat,int len)
+{
+    int i=0;
 
-                    status = pthread_mutex_unlock(&mutex);
-                    MO_ASSERT((status==0));
+#ifdef WIFI_DRV_DEBUG
+    MO_PRINT(("recv:"));
+    MO_PRINTN((p_dat,len));
 #endif
+
+    while(i<len)
+    {
+        char c=p_dat[i];
+
+        switch(parser->state)
+        {
+            case AT_STATE_IPD_DATA:
+            {
+                int n=len-i;
+                if(n>parser->ipd_len)
+                {
+                    n=parser->ipd_len;
                 }
-                else
+                if(mo_drv_wifi_write_tcpc_fifo(p_dat+i,n,parser->ipd_channel)<0)
                 {
-                    //MO_INFO(("NO need send"));
+                    MO_ERROR(("mo_drv_wifi_write_tcpc_fifo failed"));
                 }
-
+                parser->ipd_len-=n;
+                i+=n;
+                if(parser->ipd_len==0)
+                {
+                    at_parser_line_start(parser);
+                }
+                continue;
             }
 
-            // search the comeback data for the commands
-            // "AT+CWJAP_CUR?"; "AT+CIPSTAMAC_DEF?"; "AT+CIPAPMAC_DEF?"
-            // TODO: add mux lock
-            char p_filter[20] = "+CWJAP_CUR:";
-            char *ptr1 = NULL;
-            char foundstr[64] = {0};
-            if((p_index = strstr(seach_buf, p_filter)) != NULL)
-            {
-                if ( (ptr1 = strstr(p_index, "\r\n")) != NULL )
+            case AT_STATE_SKIP:
+                if((c=='\r')||(c=='\n'))
                 {
-                    MO_DEBUG(("Found \\r\\n"));
-                    memcpy(foundstr, p_index, ptr1 - p_index + 2);
-                    MO_DEBUG(("foundstr: %s", foundstr));
-                    if(mo_cmd_fifo_write(p_index, ptr1 - p_index + 2) < 0) // +2 for \r\n
-                    {
-                        MO_ERROR(("mo_cmd_fifo_write failed"));
-                    }
-                    memset(p_index,'$',strlen(p_filter));  //clear data
-                    osSemaphoreRelease(cond);
+                    at_parser_line_start(parser);
+                }
+                break;
+
+            case AT_STATE_LINE:
+                if((c=='\r')||(c=='\n'))
+                {
+                    at_parser_line(parser);
+                    at_parser_line_start(parser);
                 }
                 else
                 {
-                    continue;
+                    if(parser->line_len<AT_LINE_SIZE-2)
+                    {
+                        parser->line[parser->line_len]=c;
+                    }
+                    parser->line_len++;
                 }
-            }
+                break;
 
-            // station mac
-
-            memset(p_filter, 0, sizeof(p_filter));
-            memcpy(p_filter, "+CIPSTAMAC_DEF:", strlen("+CIPSTAMAC_DEF:"));
-            if((p_index = strstr(seach_buf, p_filter)) != NULL)
-            {
-                if ( (ptr1 = strstr(p_index, "\r\n")) != NULL )
+            case AT_STATE_IPD_HEAD:
+                if((c>='0')&&(c<='9'))
                 {
-                    MO_DEBUG(("Found \\r\\n"));
-                    memcpy(foundstr, p_index, ptr1 - p_index + 2);
-                    MO_DEBUG(("foundstr: %s", foundstr));
-                    if(mo_cmd_fifo_write(p_index, ptr1 - p_index + 2) < 0) // +2 for \r\n
+                    if(parser->ipd_field==0)
+                    {
+                        parser->ipd_channel=parser->ipd_channel*10+(c-'0');
+                    }
+                    else
                     {
-                        MO_ERROR(("mo_cmd_fifo_write failed"));
+                        parser->ipd_len=parser->ipd_len*10+(c-'0');
                     }
-                    memset(p_index,'$',strlen(p_filter));  //clear data
-                    osSemaphoreRelease(cond);
+                    if((parser->ipd_channel>4)||(parser->ipd_len>=4096))
+                    {
+                        at_parser_ipd_head(parser);
+                    }
+                }
+                else if((c==',')&&(parser->ipd_field==0))
+                {
+                    parser->ipd_field=1;
+                }
+                else if((c==':')&&(parser->ipd_field==1))
+                {
+                    at_parser_ipd_head(parser);
                 }
                 else
                 {
-                    continue;
+                    MO_ERROR(("bad +IPD head"));
+                    parser->state=AT_STATE_SKIP;
+                    continue;   //重新处理(可能是行尾)
                 }
-            }
+                break;
 
-            // apmac
-            memset(p_filter, 0, sizeof(p_filter));
-            memcpy(p_filter, "+CIPAPMAC_DEF:", strlen("+CIPAPMAC_DEF:"));
-            if((p_index = strstr(seach_buf, p_filter)) != NULL)
+            case AT_STATE_MATCH:
+            default:
             {
-                if ( (ptr1 = strstr(p_index, "\r\n")) != NULL )
+                if((c=='\r')||(c=='\n'))
                 {
-                    MO_DEBUG(("Found \\r\\n"));
-                    memcpy(foundstr, p_index, ptr1 - p_index + 2);
-                    MO_DEBUG(("foundstr: %s", foundstr));
-                    if(mo_cmd_fifo_write(p_index, ptr1 - p_index + 2) < 0) // +2 for \r\n
+                    at_parser_line_start(parser);
+                    break;
+                }
+
+                //同时匹配所有仍可能的返回结果
+                uint32_t cand=parser->cand;
+                const at_token_t *done=NULL;
+                unsigned char k;
+                for(k=0;cand>>k;k++)
+                {
+                    if( !(cand&(1UL<<k)) )
+                    {
+                        continue;
+                    }
+                    if(at_tokens[k].str[parser->line_len]!=c)
+                    {
+                        cand&=~(1UL<<k);
+                    }
+                    else if(at_tokens[k].len==parser->line_len+1)
                     {
-                        MO_ERROR(("mo_cmd_fifo_write failed"));
+                        done=&at_tokens[k];
                     }
-                    memset(p_index,'$',strlen(p_filter));  //clear data
-                    osSemaphoreRelease(cond);
                 }
-                else
+                if(parser->line_len<AT_LINE_SIZE-2)
                 {
-                    continue;
+                    parser->line[parser->line_len]=c;
                 }
-            }
+                parser->line_len++;
+                parser->cand=cand;
 
-
-            // wifi list
-            memset(p_filter, 0, sizeof(p_filter));
-            memcpy(p_filter, "+CWLAP:", strlen("+CWLAP:"));
-            //MO_DEBUG(("+CWLAP filter stream"));
-            static int filterNum = 0;
-            if((p_index = strstr(seach_buf, p_filter)) != NULL)
-            {
-                if ( (ptr1 = strstr(p_index, "\r\n")) != NULL )
+                if(done!=NULL)
                 {
-                    memcpy(foundstr, p_index, ptr1 - p_index + 2);
-                    MO_DEBUG(("foundstr: %s", foundstr));
-                    if(mo_cmd_fifo_write(p_index, ptr1 - p_index + 2) < 0) // +2 for \r\n
+                    parser->token=done;
+                    if(done->type==AT_TOKEN_FIXED)
                     {
-                        MO_ERROR(("mo_cmd_fifo_write failed"));
+                        at_parser_token(done);
+                        parser->state=AT_STATE_SKIP;
                     }
-                    memset(p_index,'$',strlen(p_filter));  //clear data
-                    filterNum++;
-                    if (filterNum > 10)
+                    else if(done->type==AT_TOKEN_LINE)
                     {
-                        osSemaphoreRelease(cond);
-                        filterNum = 0;
+                        parser->state=AT_STATE_LINE;
                     }
                     else
                     {
-                        MO_DEBUG(("continue"));
-                        continue;
+                        parser->state=AT_STATE_IPD_HEAD;
+                        parser->ipd_field=0;
+                        parser->ipd_channel=0;
+                        parser->ipd_len=0;
                     }
                 }
-                else
+                else if(cand==0)
                 {
-                    MO_DEBUG(("continue"));
-                    continue;
+                    parser->state=AT_STATE_SKIP;
                 }
-            }
-
-            // continue for the up part
-            if (filterNum > 0) // if the wifi num is less than 10
-            {
-                MO_DEBUG(("+CWLAP release semaphore"));
-                osSemaphoreRelease(cond);
-                filterNum = 0;
-            }
-
-
-            if(filter_stream(seach_buf,RET_SMARTCONFIG,1)==MO_SUCCESS)           //filter smartconfig ed
-            {
-                smartconfig_over_flag = 1;
-                MO_INFO(("GET %s",RET_SMARTCONFIG));
-            }
-
-            if(filter_stream(seach_buf,RET_MD5SET,1)==MO_SUCCESS)           //filter MD5SET ed
-            {
-                MO_INFO(("GET %s",RET_MD5SET));
-            }
-            if(filter_stream(seach_buf,RET_DOWNFW,1)==MO_SUCCESS)           //filter RET_DOWNFW ed
-            {
-                MO_INFO(("GET %s",RET_DOWNFW));
-            }
-            if(filter_stream(seach_buf,RET_OK,1)==MO_SUCCESS)                //filter OK
-            {
-                //    MO_INFO(("GET %s","OK"));
-            }
-            if(filter_stream(seach_buf,SEND_ACK_TCPC,1)==MO_SUCCESS)           //filter >
-            {
-                //   MO_INFO(("GET %s",RET_REST));
-            }
-            if(filter_stream(seach_buf,ALREADY_CONNECT,1)==MO_SUCCESS)      //filter tcp already
-            {
-                //   MO_INFO(("GET %s",ALREADY_CONNECT));
+                break;
             }
         }
-
+        i++;
     }
 }
 
 
-
-/************************************************************************************
- *  Public Functions
- ************************************************************************************/
-extern "C"
+void task_mo_uart_filter(void const *argument)
 {
+    char *recv_buf;
+    int recv_size;
 
-    void WifiDrv_USART1_Interrupt_Handler(void)
+    mo_cmd_init();
+    mo_uart1_init();
+    at_parser_init(&at_parser);
+
+    while(1)
     {
+        recv_size=mo_uart1_peek(&recv_buf,100*1000);		//串口数据直接在接收fifo中解析
+        if(recv_size>AT_RECV_SIZE)
+        {
+            recv_size=AT_RECV_SIZE;
+        }
 
-        if(__HAL_UART_GET_FLAG(&UartHandle, UART_FLAG_RXNE ) != RESET)
+        //读取之前DMA覆盖了未读数据(已全部丢弃)
+        if(mo_uart1_overrun()>0)
         {
-            // Read byte from the receive data register
-            unsigned char c = (uint16_t)(USART1->DR & (uint16_t)0x00FF);
-            //MO_INFO(("%c",c));
-            fifo__write(&uart1_rx_fifo,&c,1);
-            osSemaphoreRelease(uart1_rx_sem);
+            at_parser_overrun(&at_parser);
         }
-    }
 
+        if(at_parser_clear_flag)
+        {
+            at_parser_clear_flag=0;
+            //+IPD 数据不属于命令返回, 不能在中途丢弃 (数据结束后自然回到行首)
+            if((at_parser.state!=AT_STATE_IPD_HEAD)&&(at_parser.state!=AT_STATE_IPD_DATA))
+            {
+                at_parser_init(&at_parser);
+            }
+        }
 
+        //过滤数据
+        if(recv_size>0)
+        {
+            at_parser_input(&at_parser,recv_buf,recv_size);
+            //解析过程中DMA覆盖了正在解析的数据  已解析的结果不可靠
+            if(mo_uart1_overrun()>0)
+            {
+                at_parser_overrun(&at_parser);
+            }
+            mo_uart1_consume(recv_size);
+        }
+    }
 }
 
+
+
 int mo_drv_wifi_set_default_mode()
 {
 #if 1
@@ -1416,6 +1348,17 @@ int mo_drv_wifi_set_default_mode()
 void mo_drv_wifi_init()
 {
 #ifdef WIFI_HARDWARE_ENABLE
+    //创建 tcp发送队列 mutex 信号量
+    osMutexDef(TX_MUT);
+    mutex_tx = osMutexCreate(osMutex(TX_MUT));
+    osSemaphoreDef(TX_SEM);
+    tx_sem = osSemaphoreCreate(osSemaphore(TX_SEM) , 1);
+
+    //creat tcp tx task
+    osThreadDef(WIFI_TX, task_mo_wifi_tx, osPriorityNormal,0,512);
+    handle_wifi_tx = osThreadCreate(osThread(WIFI_TX),NULL);
+    MO_ASSERT((handle_wifi_tx!=NULL));
+
     //creat wifi uart filter task
     osThreadDef(WIFI_DRV, task_mo_uart_filter, osPriorityNormal,0,1024);
     handle_wifi_drv = osThreadCreate(osThread(WIFI_DRV),NULL);
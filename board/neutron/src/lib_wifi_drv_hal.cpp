@@ -0,0 +1,289 @@
+/**
+******************************************************************************
+* @file
+* @authors
+* @version V1.0.0
+* @date    2014_11_13
+* @brief   esp8266 uart1 and reset lines (board part of lib_wifi_drv)
+******************************************************************************
+*/
+/****************************************************************************
+ *Private Included Files
+ ****************************************************************************/
+#include "main.h"
+#include "cmsis_os.h"
+
+#include "lib_system_all.h"
+#include "lib_fifo.h"
+#include "lib_wifi_drv_hal.h"
+
+
+/************************************************************************************
+ * Private Data
+ ************************************************************************************/
+static UART_HandleTypeDef UartHandle;		//STM32串口句柄
+static DMA_HandleTypeDef hdma_uart1_rx;		//串口接收DMA  循环模式直接写入接收fifo
+static fifo_t uart1_rx_fifo;						//串口接收fifo
+static osSemaphoreId uart1_rx_sem;			//串口接收fifo  信号量
+static uint32_t uart1_rx_overflow;			//已经报告过的fifo溢出长度
+
+
+/************************************************************************************
+ * Private Functions
+ ************************************************************************************/
+static void delay_ms_cnt(uint32_t n)
+{
+    volatile uint32_t per;
+
+    while(n--)
+    {
+        for(per=0;per<8650;per++);
+    }
+}
+
+
+void mo_drv_wifi_reset_hardware()
+{
+    //esp8266 boot 1
+    pinMode(ESP_BOOT,OUTPUT);
+    digitalWrite(ESP_BOOT,HIGH);
+
+    //esp8266 reset
+    pinMode(ESP_RST,OUTPUT);
+    digitalWrite(ESP_RST,LOW);
+    delay_ms_cnt(200);
+    digitalWrite(ESP_RST,HIGH);
+}
+
+
+
+
+
+
+/*=======UART1=====================================================
+  =================================================================*/
+void uart1_hardware_init()
+{
+
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    __HAL_RCC_USART1_CLK_ENABLE();
+    GPIO_InitTypeDef  GPIO_InitStruct;
+    /* UART TX GPIO pin configuration  */
+    GPIO_InitStruct.Pin       = GPIO_PIN_9;
+    GPIO_InitStruct.Mode      = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull      = GPIO_NOPULL;
+    GPIO_InitStruct.Speed     = GPIO_SPEED_FAST;
+    GPIO_InitStruct.Alternate = GPIO_AF7_USART1;
+    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+    /* UART RX GPIO pin configuration  */
+    GPIO_InitStruct.Pin = GPIO_PIN_10;
+    GPIO_InitStruct.Alternate = GPIO_AF7_USART1;
+    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+    UartHandle.Instance          = USART1;
+    //UartHandle.Init.BaudRate     = 115200;
+    UartHandle.Init.BaudRate     = 460800;
+    UartHandle.Init.WordLength   = UART_WORDLENGTH_8B;
+    UartHandle.Init.StopBits     = UART_STOPBITS_1;
+    UartHandle.Init.Parity       = UART_PARITY_NONE;
+    UartHandle.Init.HwFlowCtl    = UART_HWCONTROL_NONE;
+    UartHandle.Init.Mode         = UART_MODE_TX_RX;
+    UartHandle.Init.OverSampling = UART_OVERSAMPLING_16;
+    HAL_UART_Init(&UartHandle);
+
+    /* USART1_RX: DMA2 Stream2 Channel4  循环模式, 接收fifo的缓冲即为DMA缓冲 */
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    hdma_uart1_rx.Instance                 = DMA2_Stream2;
+    hdma_uart1_rx.Init.Channel             = DMA_CHANNEL_4;
+    hdma_uart1_rx.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+    hdma_uart1_rx.Init.PeriphInc           = DMA_PINC_DISABLE;
+    hdma_uart1_rx.Init.MemInc              = DMA_MINC_ENABLE;
+    hdma_uart1_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_uart1_rx.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+    hdma_uart1_rx.Init.Mode                = DMA_CIRCULAR;
+    hdma_uart1_rx.Init.Priority            = DMA_PRIORITY_HIGH;
+    hdma_uart1_rx.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
+    hdma_uart1_rx.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
+    hdma_uart1_rx.Init.MemBurst            = DMA_MBURST_SINGLE;
+    hdma_uart1_rx.Init.PeriphBurst         = DMA_PBURST_SINGLE;
+    HAL_DMA_DeInit(&hdma_uart1_rx);
+    HAL_DMA_Init(&hdma_uart1_rx);
+    __HAL_LINKDMA(&UartHandle, hdmarx, hdma_uart1_rx);
+
+    //半满 全满中断保证两次提交之间DMA写入不超过缓冲大小
+    HAL_DMA_Start(&hdma_uart1_rx, (uint32_t)&USART1->DR, (uint32_t)uart1_rx_fifo.buf, uart1_rx_fifo.size);
+    __HAL_DMA_ENABLE_IT(&hdma_uart1_rx, DMA_IT_HT);
+    __HAL_DMA_ENABLE_IT(&hdma_uart1_rx, DMA_IT_TC);
+    HAL_NVIC_SetPriority(DMA2_Stream2_IRQn, 0x05, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream2_IRQn);
+    SET_BIT(USART1->CR3, USART_CR3_DMAR);
+
+    //Configure the NVIC for UART
+    // HAL_NVIC_SetPriority(USART1_IRQn, 0x0f, 0);
+    HAL_NVIC_SetPriority(USART1_IRQn, 0x05, 0);
+    HAL_NVIC_EnableIRQ(USART1_IRQn);
+    //空闲中断: 一段数据接收完成
+    __HAL_UART_ENABLE_IT(&UartHandle, UART_IT_IDLE);
+
+}
+
+/*
+  DMA写位置之前的新数据提交到接收fifo  并唤醒过滤任务
+  空闲 半满 全满中断中调用
+*/
+static void uart1_dma_rx_update(void)
+{
+    uint32_t pos=uart1_rx_fifo.size-__HAL_DMA_GET_COUNTER(&hdma_uart1_rx);
+
+    if(fifo__sync(&uart1_rx_fifo,pos)>0)
+    {
+        osSemaphoreRelease(uart1_rx_sem);
+    }
+}
+
+
+void mo_uart1_init()
+{
+    //创建信号量
+    osSemaphoreDef(UART1_SEM);
+    uart1_rx_sem = osSemaphoreCreate(osSemaphore(UART1_SEM) , 1);
+
+    //创建串口接收fifo (DMA缓冲)
+    fifo__init(&uart1_rx_fifo,1024*4);
+
+    //串口硬件初始化
+    uart1_hardware_init();
+
+}
+
+int mo_uart1_read(char *p_buf,int len,int timeout)
+{
+
+    int ret,status;
+
+    //如果fifo为空则 阻塞
+    if( fifo__avaliable(&uart1_rx_fifo)==0 )
+    {
+        status=osSemaphoreWait(uart1_rx_sem,osWaitForever);
+        MO_ASSERT((status==osOK));
+    }
+
+    //读取数据
+    ret=fifo__read(&uart1_rx_fifo,(uint8_t *)p_buf,len);
+
+#ifdef WIFI_DRV_DEBUG
+    MO_PRINT(("r"));
+    MO_PRINTN((p_buf,ret));
+#endif
+
+    return ret;
+
+}
+
+
+/*
+  返回接收fifo中连续的数据长度(回绕处截断), *p_dat 指向fifo内部数据  处理完后调用 mo_uart1_consume
+  循环DMA不会等待读取: 处理过慢(460800波特率下约90ms读不完4K)时DMA会绕一圈覆盖这些数据,
+  覆盖只能事后由 mo_uart1_overrun 发现, 调用者在处理前后各检查一次
+*/
+int mo_uart1_peek(char **p_dat,int timeout)
+{
+
+    int status;
+
+    //如果fifo为空则 阻塞
+    if( fifo__avaliable(&uart1_rx_fifo)==0 )
+    {
+        status=osSemaphoreWait(uart1_rx_sem,osWaitForever);
+        MO_ASSERT((status==osOK));
+    }
+
+    return fifo__peek(&uart1_rx_fifo,(uint8_t **)p_dat);
+
+}
+
+/*
+  返回上次调用之后DMA覆盖的未读数据长度 (fifo 读取时已丢弃全部未读数据)
+*/
+int mo_uart1_overrun(void)
+{
+    uint32_t overflow=fifo__overflow(&uart1_rx_fifo);
+    int len=(int)(overflow-uart1_rx_overflow);
+
+    if(len>0)
+    {
+        MO_ERROR(("uart1 rx overflow %d",len));
+        uart1_rx_overflow=overflow;
+    }
+    return len;
+}
+
+void mo_uart1_consume(int len)
+{
+    fifo__consume(&uart1_rx_fifo,len);
+}
+
+int mo_uart1_write(const char *p_buf,int len)
+{
+
+    //debug
+#ifdef WIFI_DRV_DEBUG
+    MO_PRINT(("w"));
+    MO_PRINTN((p_buf,len));
+#endif
+
+    HAL_StatusTypeDef ret;
+
+    ret=HAL_UART_Transmit(&UartHandle,(uint8_t *)p_buf,(uint16_t)len,5);//5ms
+
+    if(ret!=HAL_OK)
+    {
+        // MO_ERROR(("write error"));
+        return -1;
+    }
+    else
+    {
+        return len;
+    }
+
+}
+
+
+/************************************************************************************
+ *  Public Functions
+ ************************************************************************************/
+extern "C"
+{
+
+    void WifiDrv_USART1_Interrupt_Handler(void)
+    {
+
+        if(__HAL_UART_GET_FLAG(&UartHandle, UART_FLAG_IDLE ) != RESET)
+        {
+            //读SR和DR清除空闲标志
+            __HAL_UART_CLEAR_IDLEFLAG(&UartHandle);
+            uart1_dma_rx_update();
+        }
+        else if(__HAL_UART_GET_FLAG(&UartHandle, UART_FLAG_ORE ) != RESET)
+        {
+            //DMA来不及读取 清除后继续接收
+            __HAL_UART_CLEAR_OREFLAG(&UartHandle);
+        }
+    }
+
+    void WifiDrv_USART1_DMA_Interrupt_Handler(void)
+    {
+        if(__HAL_DMA_GET_FLAG(&hdma_uart1_rx, __HAL_DMA_GET_HT_FLAG_INDEX(&hdma_uart1_rx)) != RESET)
+        {
+            __HAL_DMA_CLEAR_FLAG(&hdma_uart1_rx, __HAL_DMA_GET_HT_FLAG_INDEX(&hdma_uart1_rx));
+            uart1_dma_rx_update();
+        }
+        if(__HAL_DMA_GET_FLAG(&hdma_uart1_rx, __HAL_DMA_GET_TC_FLAG_INDEX(&hdma_uart1_rx)) != RESET)
+        {
+            __HAL_DMA_CLEAR_FLAG(&hdma_uart1_rx, __HAL_DMA_GET_TC_FLAG_INDEX(&hdma_uart1_rx));
+            uart1_dma_rx_update();
+        }
+    }
+
+
+}
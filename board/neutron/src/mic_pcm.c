@@ -0,0 +1,292 @@
+/**
+ ******************************************************************************
+ * @file     : mic_pcm.c
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : 麦克风 PDM->PCM 数据块环形缓冲, 音量和频带能量
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+#include <string.h>
+#include <math.h>
+#include "mic_pcm.h"
+
+#if defined(__arm__)
+#define ARM_MATH_CM4
+#include "stm32f4xx.h"
+#include "arm_math.h"
+#endif
+
+#define MIC_PCM_FULL_SCALE      32768.0f
+#define MIC_PCM_PI              3.14159265f
+
+// 生产者在中断中, 数据块和序号的写入顺序不能被重排 (Cortex-M4 上为 DMB)
+#define mic_pcm_barrier()       __sync_synchronize()
+
+static float mic_pcm_sqrt(float x)
+{
+#if defined(__arm__)
+    float32_t out;
+
+    arm_sqrt_f32(x, &out);
+    return out;
+#else
+    return sqrtf(x);
+#endif
+}
+
+void mic_pcm_init(mic_pcm_ring_t *ring)
+{
+    memset(ring, 0, sizeof(mic_pcm_ring_t));
+}
+
+static void update_level(mic_pcm_ring_t *ring, const int16_t *pcm)
+{
+    uint16_t i;
+
+    for(i = 0; i < MIC_PCM_BLOCK_SAMPLES; i++)
+    {
+        int32_t s = pcm[i];
+        uint16_t a = (uint16_t)(s < 0 ? -s : s);
+
+        ring->level_sum += (float)(s * s);
+        if(a > ring->level_peak)
+        {
+            ring->level_peak = a;
+        }
+    }
+
+    if(++ring->level_count < MIC_PCM_LEVEL_BLOCKS)
+    {
+        return;
+    }
+
+    ring->level_seq++;
+    mic_pcm_barrier();
+    ring->level.rms = mic_pcm_sqrt(ring->level_sum / (MIC_PCM_LEVEL_BLOCKS * MIC_PCM_BLOCK_SAMPLES)) / MIC_PCM_FULL_SCALE;
+    ring->level.peak = ring->level_peak / MIC_PCM_FULL_SCALE;
+    mic_pcm_barrier();
+    ring->level_seq++;
+
+    ring->level_sum = 0;
+    ring->level_peak = 0;
+    ring->level_count = 0;
+}
+
+/*********************************************************************************
+ *Function     : void mic_pcm_input(mic_pcm_ring_t *ring, uint16_t *pdm, mic_pcm_decimate_t decimate, void *arg)
+ *Description  : 抽取一个数据块的 PDM 数据放入环形缓冲, 并统计音量
+ *Input        : ring: 环形缓冲  pdm: MIC_PDM_HALF_WORDS 个半字  decimate: 抽取函数  arg: 抽取函数参数
+ *Output       : none
+ *Return       : none
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 只能由生产者(DMA中断)调用, 抽取函数可以修改 pdm 中的数据
+ **********************************************************************************/
+void mic_pcm_input(mic_pcm_ring_t *ring, uint16_t *pdm, mic_pcm_decimate_t decimate, void *arg)
+{
+    uint32_t head = ring->head;
+    int16_t *pcm;
+    uint8_t full = (head - ring->tail) >= MIC_PCM_BLOCKS;
+
+    // 缓冲满时仍然抽取, 滤波器状态与音量统计不中断
+    pcm = full ? ring->scratch : ring->blocks[head & (MIC_PCM_BLOCKS - 1)];
+    decimate(arg, pdm, pcm);
+    update_level(ring, pcm);
+
+    if(full)
+    {
+        ring->overruns++;
+        return;
+    }
+    mic_pcm_barrier();
+    ring->head = head + 1;
+}
+
+uint16_t mic_pcm_available(const mic_pcm_ring_t *ring)
+{
+    uint32_t blocks = ring->head - ring->tail;
+
+    return (uint16_t)(blocks * MIC_PCM_BLOCK_SAMPLES - ring->offset);
+}
+
+/*
+  从最旧的开始取出最多 count 个样本, 返回取出的个数, 只能由消费者调用
+*/
+uint16_t mic_pcm_read(mic_pcm_ring_t *ring, int16_t *pcm, uint16_t count)
+{
+    uint16_t n = 0;
+
+    while(n < count)
+    {
+        uint32_t tail = ring->tail;
+        const int16_t *block;
+        uint16_t len;
+
+        if(tail == ring->head)
+        {
+            break;
+        }
+        mic_pcm_barrier();
+
+        block = ring->blocks[tail & (MIC_PCM_BLOCKS - 1)];
+        len = MIC_PCM_BLOCK_SAMPLES - ring->offset;
+        if(len > count - n)
+        {
+            len = count - n;
+        }
+        memcpy(&pcm[n], &block[ring->offset], len * sizeof(int16_t));
+        n += len;
+        ring->offset += len;
+        if(ring->offset == MIC_PCM_BLOCK_SAMPLES)
+        {
+            // 复制完成之后才能把数据块还给生产者
+            ring->offset = 0;
+            mic_pcm_barrier();
+            ring->tail = tail + 1;
+        }
+    }
+    return n;
+}
+
+/*
+  丢掉所有未读的样本, 只能由消费者调用
+*/
+void mic_pcm_flush(mic_pcm_ring_t *ring)
+{
+    ring->offset = 0;
+    mic_pcm_barrier();
+    ring->tail = ring->head;
+}
+
+/*
+  最近一个完整窗口的音量, 读取过程中生产者更新了则重新读
+*/
+void mic_pcm_get_level(const mic_pcm_ring_t *ring, mic_pcm_level_t *level)
+{
+    uint32_t seq;
+
+    do
+    {
+        seq = ring->level_seq;
+        mic_pcm_barrier();
+        level->rms = ring->level.rms;
+        level->peak = ring->level.peak;
+        mic_pcm_barrier();
+    }while((seq & 1) || (seq != ring->level_seq));
+}
+
+/*
+  基2 原位复数 FFT, n 为2的幂
+*/
+static void fft_radix2(float *re, float *im, const float *cos_table, const float *sin_table, uint16_t n)
+{
+    uint16_t i, j, k, len;
+
+    for(i = 1, j = 0; i < n; i++)
+    {
+        uint16_t bit = n >> 1;
+
+        for(; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if(i < j)
+        {
+            float t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+
+    for(len = 2; len <= n; len <<= 1)
+    {
+        uint16_t half = len >> 1;
+        uint16_t step = n / len;
+
+        for(i = 0; i < n; i += len)
+        {
+            for(k = 0; k < half; k++)
+            {
+                float wr = cos_table[k * step];
+                float wi = -sin_table[k * step];
+                float xr = re[i + k + half] * wr - im[i + k + half] * wi;
+                float xi = re[i + k + half] * wi + im[i + k + half] * wr;
+
+                re[i + k + half] = re[i + k] - xr;
+                im[i + k + half] = im[i + k] - xi;
+                re[i + k] += xr;
+                im[i + k] += xi;
+            }
+        }
+    }
+}
+
+/*********************************************************************************
+ *Function     : void mic_pcm_band_energy(const int16_t *pcm, float bands[MIC_PCM_BANDS])
+ *Description  : 计算 MIC_PCM_FFT_SIZE 个样本的倍频程频带能量
+ *Input        : pcm: MIC_PCM_FFT_SIZE 个 16kHz 样本
+ *Output       : bands: 频带 b 为 62.5*2^b Hz 到 62.5*2^(b+1) Hz, 不含直流
+ *Return       : none
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 单位与 rms 的平方相同, 满量程正弦波约为 0.5, 各频带之和约为去掉直流后的 rms^2
+ *               使用静态缓冲, 只能在一个任务中调用
+ **********************************************************************************/
+void mic_pcm_band_energy(const int16_t *pcm, float bands[MIC_PCM_BANDS])
+{
+    static float re[MIC_PCM_FFT_SIZE], im[MIC_PCM_FFT_SIZE];
+    static float window[MIC_PCM_FFT_SIZE];
+    static float cos_table[MIC_PCM_FFT_SIZE / 2], sin_table[MIC_PCM_FFT_SIZE / 2];
+    static float window_power = 0;
+    uint16_t i, b;
+
+    if(window_power == 0)
+    {
+        for(i = 0; i < MIC_PCM_FFT_SIZE; i++)
+        {
+            // Hann 窗
+            window[i] = 0.5f - 0.5f * cosf(2 * MIC_PCM_PI * i / MIC_PCM_FFT_SIZE);
+            window_power += window[i] * window[i];
+        }
+        for(i = 0; i < MIC_PCM_FFT_SIZE / 2; i++)
+        {
+            cos_table[i] = cosf(2 * MIC_PCM_PI * i / MIC_PCM_FFT_SIZE);
+            sin_table[i] = sinf(2 * MIC_PCM_PI * i / MIC_PCM_FFT_SIZE);
+        }
+    }
+
+    for(i = 0; i < MIC_PCM_FFT_SIZE; i++)
+    {
+        re[i] = pcm[i] / MIC_PCM_FULL_SCALE * window[i];
+        im[i] = 0;
+    }
+    fft_radix2(re, im, cos_table, sin_table, MIC_PCM_FFT_SIZE);
+
+    // 单边谱, 频带 b 为 [2^b, 2^(b+1)) 个频点
+    for(b = 0; b < MIC_PCM_BANDS; b++)
+    {
+        float sum = 0;
+
+        for(i = 1 << b; i < (2 << b); i++)
+        {
+            sum += re[i] * re[i] + im[i] * im[i];
+        }
+        bands[b] = 2 * sum / (MIC_PCM_FFT_SIZE * window_power);
+    }
+}
@@ -32,34 +32,28 @@ extern struct bmi160_t s_bmi160;
 
 signed char BMI160_I2C_bus_read(unsigned char device_addr, unsigned char reg_addr,unsigned char *reg_data, unsigned char cnt)
 {
-    Wire.beginTransmission(device_addr);
-    Wire.write(reg_addr);
-    Wire.endTransmission(0);
-    Wire.beginTransmission(device_addr);
-    Wire.requestFrom(device_addr, cnt);
-    if(!Wire.available())
+    // 写寄存器地址 + 重复起始读, 一次传输, 等待时让出CPU
+    if(Wire.readRegisters(device_addr, reg_addr, reg_data, cnt) != I2C_STATUS_OK)
     {
         return -1;
     }
-    for(uint8_t i = 0; i < cnt; i++)
-    {
-        *(reg_data + i) = Wire.read();
-    }
     return 0;
 }
 
 
 signed char BMI160_I2C_bus_write(unsigned char device_addr, unsigned char reg_addr,unsigned char *reg_data, unsigned char cnt)
 {
-    int iError = 0;
-    Wire.beginTransmission(device_addr);
-    Wire.write(reg_addr);
-    for(uint8_t i = 0; i < cnt; i++)
+    return Wire.writeRegisters(device_addr, reg_addr, reg_data, cnt);
+}
+
+signed char BMI160_I2C_burst_read(unsigned char device_addr, unsigned char reg_addr, unsigned char *reg_data, uint32_t cnt)
+{
+    // FIFO_DATA 连续读取不会自动增加地址, 大块数据由 DMA 接收
+    if(Wire.readRegisters(device_addr, reg_addr, reg_data, cnt) != I2C_STATUS_OK)
     {
-        Wire.write(*(reg_data + i));
+        return -1;
     }
-    iError = Wire.endTransmission();
-    return iError;
+    return 0;
 }
 
 void BMI160_delay_msec(BMI160_MDELAY_DATA_TYPE msec) //delay in milliseconds
@@ -72,6 +66,8 @@ void BMI160_delay_msec(BMI160_MDELAY_DATA_TYPE msec) //delay in milliseconds
 BMI160Sensor::BMI160Sensor()
 {
     isEnabledFlag = false;
+    fifoEnabled = false;
+    bmi160_fifo_init(&fifo, fifoSamples, BMI160_FIFO_SAMPLES, 256);
 }
 
 bool BMI160Sensor::isEnabled(void)
@@ -86,6 +82,7 @@ void BMI160Sensor::begin(void)
     Wire.begin();
     s_bmi160.bus_read = BMI160_I2C_bus_read;
     s_bmi160.bus_write = BMI160_I2C_bus_write;
+    s_bmi160.burst_read = BMI160_I2C_burst_read;
     s_bmi160.delay_msec = BMI160_delay_msec;
     s_bmi160.dev_addr = BMI160_I2C_ADDR1;
 
@@ -134,6 +131,172 @@ void BMI160Sensor::getAccelGyroMagData(int16_t accel[3], int16_t gyro[3], int16_
     getMagData(mag);
 }
 
+/*********************************************************************************
+ *Function     : bool BMI160Sensor::beginFifo(uint16_t rate, uint8_t sensors, uint16_t watermark)
+ *Description  : 打开 FIFO 帧头模式批量采集
+ *Input        : rate: 加速度和陀螺仪输出频率 25~1600Hz, 按2的倍数取最接近的
+ *               sensors: BMI160_FIFO_SAMPLE_ACCEL/GYRO/MAG  watermark: 水位(帧)
+ *Output       : none
+ *Return       : 成功返回true
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 同一帧中的各传感器数据同时采样, 每次读空时附带 sensortime
+ *               板上 INT1/INT2 没有接到MCU, 打开水位中断后由 pollFifo 查询中断状态
+ **********************************************************************************/
+bool BMI160Sensor::beginFifo(uint16_t rate, uint8_t sensors, uint16_t watermark)
+{
+    BMI160_RETURN_FUNCTION_TYPE com_rslt;
+    uint8_t odr = BMI160_ACCEL_OUTPUT_DATA_RATE_100HZ;
+    uint16_t odrRate = 100;
+    uint8_t head = BMI160_FIFO_HEAD_DATA;
+    uint32_t wmBytes;
+
+    begin();
+    endFifo();
+
+    while((odrRate < rate) && (odr < BMI160_ACCEL_OUTPUT_DATA_RATE_1600HZ))
+    {
+        odrRate *= 2;
+        odr++;
+    }
+    while((odrRate > rate) && (odr > BMI160_ACCEL_OUTPUT_DATA_RATE_25HZ))
+    {
+        odrRate /= 2;
+        odr--;
+    }
+    com_rslt = bmi160_set_accel_output_data_rate(odr, BMI160_ACCEL_OSR4_AVG1);
+    s_bmi160.delay_msec(BMI160_GEN_READ_WRITE_DELAY);
+    com_rslt += bmi160_set_gyro_output_data_rate(odr);
+    s_bmi160.delay_msec(BMI160_GEN_READ_WRITE_DELAY);
+
+    if(sensors & BMI160_FIFO_SAMPLE_MAG)
+    {
+        head |= BMI160_FIFO_HEAD_MAG;
+    }
+    if(sensors & BMI160_FIFO_SAMPLE_GYRO)
+    {
+        head |= BMI160_FIFO_HEAD_GYRO;
+    }
+    if(sensors & BMI160_FIFO_SAMPLE_ACCEL)
+    {
+        head |= BMI160_FIFO_HEAD_ACCEL;
+    }
+    if(bmi160_fifo_frame_size(head) == 0)
+    {
+        return false;
+    }
+
+    com_rslt += bmi160_set_fifo_header_enable(FIFO_HEADER_ENABLE);
+    com_rslt += bmi160_set_fifo_time_enable(FIFO_TIME_ENABLE);
+    com_rslt += bmi160_set_fifo_mag_enable((sensors & BMI160_FIFO_SAMPLE_MAG) ? FIFO_MAG_ENABLE : 0);
+    com_rslt += bmi160_set_fifo_gyro_enable((sensors & BMI160_FIFO_SAMPLE_GYRO) ? FIFO_GYRO_ENABLE : 0);
+    com_rslt += bmi160_set_fifo_accel_enable((sensors & BMI160_FIFO_SAMPLE_ACCEL) ? FIFO_ACCEL_ENABLE : 0);
+
+    // 水位寄存器单位为4字节
+    wmBytes = (uint32_t)watermark * bmi160_fifo_frame_size(head);
+    if(wmBytes > BMI160_FIFO_SIZE - BMI160_FIFO_BURST)
+    {
+        wmBytes = BMI160_FIFO_SIZE - BMI160_FIFO_BURST;
+    }
+    com_rslt += bmi160_set_fifo_wm((uint8_t)((wmBytes + 3) / 4));
+    com_rslt += bmi160_set_intr_enable_1(BMI160_FIFO_WM_ENABLE, BMI160_ENABLE);
+    s_bmi160.delay_msec(BMI160_GEN_READ_WRITE_DELAY);
+    com_rslt += bmi160_set_command_register(BMI160_FIFO_CMD_FLUSH);
+    s_bmi160.delay_msec(BMI160_GEN_READ_WRITE_DELAY);
+
+    // sensortime 每个计数 39.0625us, 100Hz 为256
+    bmi160_fifo_init(&fifo, fifoSamples, BMI160_FIFO_SAMPLES, 25600 / odrRate);
+    fifoEnabled = (com_rslt == 0);
+    return fifoEnabled;
+}
+
+void BMI160Sensor::endFifo(void)
+{
+    if(!fifoEnabled)
+        return;
+    bmi160_set_intr_enable_1(BMI160_FIFO_WM_ENABLE, 0);
+    bmi160_set_fifo_mag_enable(0);
+    bmi160_set_fifo_gyro_enable(0);
+    bmi160_set_fifo_accel_enable(0);
+    bmi160_set_command_register(BMI160_FIFO_CMD_FLUSH);
+    s_bmi160.delay_msec(BMI160_GEN_READ_WRITE_DELAY);
+    bmi160_fifo_reset(&fifo);
+    fifoEnabled = false;
+}
+
+/*********************************************************************************
+ *Function     : uint16_t BMI160Sensor::pollFifo(bool force)
+ *Description  : 到达水位时读空传感器 FIFO 并解析到样本缓冲
+ *Input        : force: 不检查水位
+ *Output       : none
+ *Return       : 新的样本数
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 每次连续读取 BMI160_FIFO_BURST 字节, 末尾不完整的帧下次重新读出
+ **********************************************************************************/
+uint16_t BMI160Sensor::pollFifo(bool force)
+{
+    uint8_t wm = 0;
+    uint32_t length = 0;
+    uint32_t frames;
+
+    if(!fifoEnabled)
+        return 0;
+
+    if(!force)
+    {
+        if((bmi160_get_stat1_fifo_wm_intr(&wm) != 0) || !wm)
+            return 0;
+    }
+    if(bmi160_fifo_length(&length) != 0)
+        return 0;
+
+    frames = fifo.frames;
+    length += BMI160_FIFO_TIME_FRAME_SIZE;
+    while(length > 0)
+    {
+        uint16_t chunk = (length > BMI160_FIFO_BURST) ? BMI160_FIFO_BURST : length;
+        uint16_t used;
+
+        if(bmi160_fifo_data(fifoBuffer, chunk) != 0)
+            break;
+        used = bmi160_fifo_decode(&fifo, fifoBuffer, chunk);
+        if(used == 0)
+            break;
+        length -= used;
+    }
+    return fifo.frames - frames;
+}
+
+uint16_t BMI160Sensor::availableFifo(void)
+{
+    return bmi160_fifo_available(&fifo);
+}
+
+/*********************************************************************************
+ *Function     : uint16_t BMI160Sensor::readFifo(bmi160_fifo_sample_t *samples, uint16_t count)
+ *Description  : 读取样本, 从最旧的开始
+ *Input        : samples: 样本缓冲  count: 最多读取的个数
+ *Output       : none
+ *Return       : 读取的个数
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 缓冲中的样本不够时先读空传感器 FIFO
+ **********************************************************************************/
+uint16_t BMI160Sensor::readFifo(bmi160_fifo_sample_t *samples, uint16_t count)
+{
+    if(bmi160_fifo_available(&fifo) < count)
+    {
+        pollFifo(true);
+    }
+    return bmi160_fifo_read(&fifo, samples, count);
+}
+
+const bmi160_fifo_t &BMI160Sensor::getFifoStatus(void)
+{
+    return fifo;
+}
+
 
 #define I2C_ADDR_BMP280	0x76
 #define I2C_CHANNEL_BMP280	1
@@ -143,34 +306,18 @@ void BMI160Sensor::getAccelGyroMagData(int16_t accel[3], int16_t gyro[3], int16_
 
 char BMP280_I2C_bus_read(unsigned char device_addr, unsigned char reg_addr,unsigned char *reg_data, unsigned char cnt)
 {
-    Wire.beginTransmission(device_addr);
-    Wire.write(reg_addr);
-    Wire.endTransmission(0);
-    Wire.beginTransmission(device_addr);
-    Wire.requestFrom(device_addr, cnt);
-    if(!Wire.available())
+    // 写寄存器地址 + 重复起始读, 一次传输, 等待时让出CPU
+    if(Wire.readRegisters(device_addr, reg_addr, reg_data, cnt) != I2C_STATUS_OK)
     {
         return -1;
     }
-    for(uint8_t i = 0; i < cnt; i++)
-    {
-        *(reg_data + i) = Wire.read();
-    }
     return 0;
 }
 
 
 char BMP280_I2C_bus_write(unsigned char device_addr, unsigned char reg_addr,unsigned char *reg_data, unsigned char cnt)
 {
-    int iError = 0;
-    Wire.beginTransmission(device_addr);
-    Wire.write(reg_addr);
-    for(uint8_t i = 0; i < cnt; i++)
-    {
-        Wire.write(*(reg_data + i));
-    }
-    iError = Wire.endTransmission();
-    return iError;
+    return Wire.writeRegisters(device_addr, reg_addr, reg_data, cnt);
 }
 
 
@@ -265,44 +412,102 @@ void MICSensor::begin()
 {
     if (isEnabledFlag)
         return;
-    MicClass_Start_Hal(&mic_mems);
+    mic_pcm_init(&micRing);
+    MicClass_Start_Hal(&micRing);
     isEnabledFlag = true;
 }
 
+void MICSensor::end()
+{
+    if (!isEnabledFlag)
+        return;
+    MicClass_Stop_Hal();
+    isEnabledFlag = false;
+}
+
+uint16_t MICSensor::available(void)
+{
+    return mic_pcm_available(&micRing);
+}
+
+uint16_t MICSensor::read(int16_t *pcm, uint16_t count)
+{
+    return mic_pcm_read(&micRing, pcm, count);
+}
+
+void MICSensor::flush(void)
+{
+    mic_pcm_flush(&micRing);
+}
+
+uint32_t MICSensor::getOverruns(void)
+{
+    return micRing.overruns;
+}
+
+void MICSensor::getLevel(float& rms, float& peak)
+{
+    mic_pcm_level_t level;
+
+    mic_pcm_get_level(&micRing, &level);
+    rms = level.rms;
+    peak = level.peak;
+}
+
+bool MICSensor::getBandEnergy(float bands[MIC_PCM_BANDS])
+{
+    static int16_t pcm[MIC_PCM_FFT_SIZE];
+
+    if(mic_pcm_available(&micRing) < MIC_PCM_FFT_SIZE)
+    {
+        return false;
+    }
+    mic_pcm_read(&micRing, pcm, MIC_PCM_FFT_SIZE);
+    mic_pcm_band_energy(pcm, bands);
+    return true;
+}
+
 void MICSensor::getMICData(char& micData)
 {
-    if(mic_mems.status_buf)
+    int16_t pcm[MIC_PCM_BLOCK_SAMPLES];
+    uint16_t n, last = 0;
+
+    while((n = mic_pcm_read(&micRing, pcm, MIC_PCM_BLOCK_SAMPLES)) > 0)
     {
-        // for(int i = 0; i < 2048; i++)
-        // {
-        //     micData = mic_mems.P_buf[i];
-        // }
-        micData = mic_mems.P_buf[1024];
-        mic_mems.status_buf = 0;
+        last = n;
+    }
+    if(last)
+    {
+        micData = (char)(pcm[last - 1] >> 8);
     }
 }
 
+/*
+  与之前的输出格式相同: 8kHz 8位, 每两个样本输出一个的高8位
+*/
 void MICSensor::getMICDataToSerial(USARTSerial& serial)
 {
-    if(mic_mems.status_buf)
+    int16_t pcm[MIC_PCM_BLOCK_SAMPLES];
+
+    while(mic_pcm_read(&micRing, pcm, MIC_PCM_BLOCK_SAMPLES) == MIC_PCM_BLOCK_SAMPLES)
     {
-        for(int i = 0; i < 2048; i++)
+        for(int i = 0; i < MIC_PCM_BLOCK_SAMPLES; i += 2)
         {
-            serial.write(mic_mems.P_buf[i]);
+            serial.write((uint8_t)(pcm[i] >> 8));
         }
-        mic_mems.status_buf = 0;
     }
 }
 
 void MICSensor::getMICDataToUSBSerial(USBSerial& serialusb)
 {
-    if(mic_mems.status_buf)
+    int16_t pcm[MIC_PCM_BLOCK_SAMPLES];
+
+    while(mic_pcm_read(&micRing, pcm, MIC_PCM_BLOCK_SAMPLES) == MIC_PCM_BLOCK_SAMPLES)
     {
-        for(int i = 0; i < 2048; i++)
+        for(int i = 0; i < MIC_PCM_BLOCK_SAMPLES; i += 2)
         {
-            serialusb.write(mic_mems.P_buf[i]);
+            serialusb.write((uint8_t)(pcm[i] >> 8));
         }
-        mic_mems.status_buf = 0;
     }
 }
 
@@ -315,6 +520,11 @@ MICSensor    micSensor;
 NeutronSensors::NeutronSensors()
 {
     isEnabledFlag = false;
+    fusionEnabled = false;
+    fusionUseMag = false;
+    fusionMagValid = false;
+    memset(fusionMag, 0, sizeof(fusionMag));
+    fusion_init(&fusion, FUSION_MADGWICK, 100.0f, BMI160_ACCEL_RANGE, BMI160_GYRO_RANGE);
 }
 
 bool NeutronSensors::isEnabled(void)
@@ -361,6 +571,193 @@ void NeutronSensors::getAccelGyroMagData(int16_t accel[3], int16_t gyro[3], int1
     BMI160.getAccelGyroMagData(accel, gyro, mag);
 }
 
+bool NeutronSensors::beginFifo(uint16_t rate, uint8_t sensors, uint16_t watermark)
+{
+    return BMI160.beginFifo(rate, sensors, watermark);
+}
+
+void NeutronSensors::endFifo(void)
+{
+    BMI160.endFifo();
+}
+
+uint16_t NeutronSensors::pollFifo(bool force)
+{
+    return BMI160.pollFifo(force);
+}
+
+uint16_t NeutronSensors::availableFifo(void)
+{
+    return BMI160.availableFifo();
+}
+
+uint16_t NeutronSensors::readFifo(bmi160_fifo_sample_t *samples, uint16_t count)
+{
+    return BMI160.readFifo(samples, count);
+}
+
+/*********************************************************************************
+ *Function     : bool NeutronSensors::beginFusion(uint16_t rate, bool useMag, fusion_algorithm_t algorithm)
+ *Description  : 打开 FIFO 并开始姿态融合
+ *Input        : rate: 输出频率  useMag: 9轴融合  algorithm: FUSION_MADGWICK 或 FUSION_MAHONY
+ *Output       : none
+ *Return       : 成功返回true
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 之后在 loop 中调用 updateFusion, 步长为实际的 ODR
+ **********************************************************************************/
+bool NeutronSensors::beginFusion(uint16_t rate, bool useMag, fusion_algorithm_t algorithm)
+{
+    fusion_calibration_t cal = fusion.cal;
+    uint8_t sensors = BMI160_FIFO_SAMPLE_ACCEL | BMI160_FIFO_SAMPLE_GYRO;
+
+    if(useMag)
+    {
+        sensors |= BMI160_FIFO_SAMPLE_MAG;
+    }
+    fusionEnabled = BMI160.beginFifo(rate, sensors);
+    if(!fusionEnabled)
+    {
+        return false;
+    }
+
+    // sensortime 计数 39.0625us
+    fusion_init(&fusion, algorithm, 25600.0f / BMI160.getFifoStatus().frame_period, BMI160_ACCEL_RANGE, BMI160_GYRO_RANGE);
+    fusion_set_calibration(&fusion, &cal);
+    fusionUseMag = useMag;
+    fusionMagValid = false;
+    return true;
+}
+
+void NeutronSensors::endFusion(void)
+{
+    if(!fusionEnabled)
+        return;
+    BMI160.endFifo();
+    fusionEnabled = false;
+}
+
+/*********************************************************************************
+ *Function     : uint16_t NeutronSensors::updateFusion(void)
+ *Description  : 取出 FIFO 中的样本, 逐个更新姿态
+ *Input        : none
+ *Output       : none
+ *Return       : 更新的次数
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 磁力计帧率低于加速度时使用最近一次的磁场
+ **********************************************************************************/
+uint16_t NeutronSensors::updateFusion(void)
+{
+    bmi160_fifo_sample_t samples[8];
+    uint16_t updates = 0;
+    uint16_t count;
+
+    if(!fusionEnabled)
+        return 0;
+
+    BMI160.pollFifo(true);
+    while((count = BMI160.availableFifo()) > 0)
+    {
+        if(count > sizeof(samples) / sizeof(samples[0]))
+        {
+            count = sizeof(samples) / sizeof(samples[0]);
+        }
+        // 样本足够, 不会再读传感器
+        count = BMI160.readFifo(samples, count);
+        for(uint16_t i = 0; i < count; i++)
+        {
+            if(samples[i].valid & BMI160_FIFO_SAMPLE_MAG)
+            {
+                memcpy(fusionMag, samples[i].mag, sizeof(fusionMag));
+                fusionMagValid = true;
+            }
+            if((samples[i].valid & (BMI160_FIFO_SAMPLE_ACCEL | BMI160_FIFO_SAMPLE_GYRO)) == (BMI160_FIFO_SAMPLE_ACCEL | BMI160_FIFO_SAMPLE_GYRO))
+            {
+                fusion_update(&fusion, samples[i].accel, samples[i].gyro, (fusionUseMag && fusionMagValid) ? fusionMag : NULL);
+                updates++;
+            }
+        }
+    }
+    return updates;
+}
+
+void NeutronSensors::setFusionCalibration(const fusion_calibration_t &cal)
+{
+    fusion_set_calibration(&fusion, &cal);
+    fusion_reset(&fusion);
+}
+
+/*********************************************************************************
+ *Function     : bool NeutronSensors::calibrateFusion(uint16_t samples)
+ *Description  : 估计陀螺仪零偏和加速度计偏移
+ *Input        : samples: 平均的样本数
+ *Output       : none
+ *Return       : 成功返回true
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 需要水平静止放置(z轴向上), 磁力计的校准不变
+ **********************************************************************************/
+bool NeutronSensors::calibrateFusion(uint16_t samples)
+{
+    bmi160_fifo_sample_t sample;
+    fusion_calibration_t cal = fusion.cal;
+    float accel[3] = {0, 0, 0};
+    float gyro[3] = {0, 0, 0};
+    uint16_t count = 0;
+    uint32_t start = millis();
+
+    if(!fusionEnabled || (samples == 0))
+        return false;
+
+    while(count < samples)
+    {
+        if(millis() - start > (uint32_t)samples * 50 + 1000)
+        {
+            return false;
+        }
+        if(BMI160.readFifo(&sample, 1) == 0)
+        {
+            delay(5);
+            continue;
+        }
+        if((sample.valid & (BMI160_FIFO_SAMPLE_ACCEL | BMI160_FIFO_SAMPLE_GYRO)) != (BMI160_FIFO_SAMPLE_ACCEL | BMI160_FIFO_SAMPLE_GYRO))
+        {
+            continue;
+        }
+        for(int i = 0; i < 3; i++)
+        {
+            accel[i] += sample.accel[i];
+            gyro[i] += sample.gyro[i];
+        }
+        count++;
+    }
+
+    for(int i = 0; i < 3; i++)
+    {
+        cal.accel_offset[i] = accel[i] / count;
+        cal.gyro_offset[i] = gyro[i] / count;
+    }
+    cal.accel_offset[2] -= BMI160_ACCEL_LSB_PER_G;
+    setFusionCalibration(cal);
+    return true;
+}
+
+void NeutronSensors::getQuaternion(float q[4])
+{
+    fusion_get_quaternion(&fusion, q);
+}
+
+void NeutronSensors::getEulerAngles(float euler[3])
+{
+    fusion_get_euler(&fusion, euler);
+}
+
+void NeutronSensors::getLinearAccel(float accel[3])
+{
+    fusion_get_linear_accel(&fusion, accel);
+}
+
 // BMP280 sensor
 void NeutronSensors::getPressureAltitudeData(double& pressure, double& altitude)
 {
@@ -376,6 +773,26 @@ void NeutronSensors::getLightData(uint16_t& lightData)
 }
 
 // Mic sensor
+uint16_t NeutronSensors::availableMIC(void)
+{
+    return micSensor.available();
+}
+
+uint16_t NeutronSensors::readMIC(int16_t *pcm, uint16_t count)
+{
+    return micSensor.read(pcm, count);
+}
+
+void NeutronSensors::getMICLevel(float& rms, float& peak)
+{
+    micSensor.getLevel(rms, peak);
+}
+
+bool NeutronSensors::getMICBandEnergy(float bands[MIC_PCM_BANDS])
+{
+    return micSensor.getBandEnergy(bands);
+}
+
 void NeutronSensors::getMICData(char& micData)
 {
     micSensor.getMICData(micData);
@@ -0,0 +1,409 @@
+/**
+ ******************************************************************************
+ * @file     : sensor_fusion.c
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : 6/9轴姿态融合, Madgwick 和 Mahony 滤波
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+#include <string.h>
+#include <math.h>
+#include "sensor_fusion.h"
+
+#if defined(__arm__)
+#define ARM_MATH_CM4
+#include "stm32f4xx.h"
+#include "arm_math.h"
+#endif
+
+#define FUSION_PI               3.14159265f
+#define FUSION_RAD_TO_DEG       (180.0f / FUSION_PI)
+
+/*
+  Cortex-M4F 上 arm_sqrt_f32 为一条 VSQRT 指令, 比查表的快速倒数平方根准确
+*/
+static float fusion_sqrt(float x)
+{
+#if defined(__arm__)
+    float32_t out;
+
+    arm_sqrt_f32(x, &out);
+    return out;
+#else
+    return sqrtf(x);
+#endif
+}
+
+static float inv_sqrt(float x)
+{
+    return 1.0f / fusion_sqrt(x);
+}
+
+static void normalize_quaternion(float q[4])
+{
+    float recipNorm = inv_sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+
+    q[0] *= recipNorm;
+    q[1] *= recipNorm;
+    q[2] *= recipNorm;
+    q[3] *= recipNorm;
+}
+
+void fusion_init(fusion_t *fusion, fusion_algorithm_t algorithm, float odr, float accel_range_g, float gyro_range_dps)
+{
+    memset(fusion, 0, sizeof(fusion_t));
+    fusion->algorithm = algorithm;
+    fusion->beta = FUSION_MADGWICK_BETA;
+    fusion->kp = FUSION_MAHONY_KP;
+    fusion->ki = FUSION_MAHONY_KI;
+    fusion->sample_period = 1.0f / odr;
+    fusion->accel_scale = accel_range_g / 32768.0f;
+    fusion->gyro_scale = gyro_range_dps / 32768.0f / FUSION_RAD_TO_DEG;
+    fusion->cal.mag_scale[0] = 1.0f;
+    fusion->cal.mag_scale[1] = 1.0f;
+    fusion->cal.mag_scale[2] = 1.0f;
+    fusion_reset(fusion);
+}
+
+/*
+  回到初始状态, 下一个样本用加速度(和磁力计)直接算出初始姿态
+*/
+void fusion_reset(fusion_t *fusion)
+{
+    fusion->q[0] = 1.0f;
+    fusion->q[1] = 0.0f;
+    fusion->q[2] = 0.0f;
+    fusion->q[3] = 0.0f;
+    memset(fusion->integral, 0, sizeof(fusion->integral));
+    memset(fusion->gravity, 0, sizeof(fusion->gravity));
+    memset(fusion->linear_accel, 0, sizeof(fusion->linear_accel));
+    fusion->updates = 0;
+}
+
+void fusion_set_calibration(fusion_t *fusion, const fusion_calibration_t *cal)
+{
+    fusion->cal = *cal;
+}
+
+/*
+  由第一个样本得到初始姿态, 避免滤波从单位四元数慢慢收敛
+*/
+static void fusion_initial_attitude(fusion_t *fusion, const float a[3], const float *m)
+{
+    float roll = atan2f(a[1], a[2]);
+    float pitch = atan2f(-a[0], fusion_sqrt(a[1] * a[1] + a[2] * a[2]));
+    float yaw = 0.0f;
+    float cr, sr, cp, sp, cy, sy;
+
+    if(m != NULL)
+    {
+        // 磁场投影到水平面
+        float bx = m[0] * cosf(pitch) + m[1] * sinf(roll) * sinf(pitch) + m[2] * cosf(roll) * sinf(pitch);
+        float by = m[1] * cosf(roll) - m[2] * sinf(roll);
+        yaw = atan2f(-by, bx);
+    }
+
+    cr = cosf(roll * 0.5f);
+    sr = sinf(roll * 0.5f);
+    cp = cosf(pitch * 0.5f);
+    sp = sinf(pitch * 0.5f);
+    cy = cosf(yaw * 0.5f);
+    sy = sinf(yaw * 0.5f);
+    fusion->q[0] = cr * cp * cy + sr * sp * sy;
+    fusion->q[1] = sr * cp * cy - cr * sp * sy;
+    fusion->q[2] = cr * sp * cy + sr * cp * sy;
+    fusion->q[3] = cr * cp * sy - sr * sp * cy;
+    normalize_quaternion(fusion->q);
+}
+
+/*
+  Madgwick 梯度下降, a/m 已归一化, m 为 NULL 时为6轴
+*/
+static void madgwick_update(fusion_t *fusion, const float g[3], const float a[3], const float *m)
+{
+    float *q = fusion->q;
+    float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+    float ax = a[0], ay = a[1], az = a[2];
+    float gx = g[0], gy = g[1], gz = g[2];
+    float s0, s1, s2, s3;
+    float recipNorm;
+    float qDot[4];
+
+    qDot[0] = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    qDot[1] = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+    qDot[2] = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+    qDot[3] = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+    if(m == NULL)
+    {
+        float _2q0 = 2.0f * q0, _2q1 = 2.0f * q1, _2q2 = 2.0f * q2, _2q3 = 2.0f * q3;
+        float _4q0 = 4.0f * q0, _4q1 = 4.0f * q1, _4q2 = 4.0f * q2;
+        float _8q1 = 8.0f * q1, _8q2 = 8.0f * q2;
+        float q0q0 = q0 * q0, q1q1 = q1 * q1, q2q2 = q2 * q2, q3q3 = q3 * q3;
+
+        s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+        s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+        s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+        s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
+    }
+    else
+    {
+        float mx = m[0], my = m[1], mz = m[2];
+        float hx, hy, _2bx, _2bz, _4bx, _4bz;
+        float _2q0mx = 2.0f * q0 * mx, _2q0my = 2.0f * q0 * my, _2q0mz = 2.0f * q0 * mz, _2q1mx = 2.0f * q1 * mx;
+        float _2q0 = 2.0f * q0, _2q1 = 2.0f * q1, _2q2 = 2.0f * q2, _2q3 = 2.0f * q3;
+        float _2q0q2 = 2.0f * q0 * q2, _2q2q3 = 2.0f * q2 * q3;
+        float q0q0 = q0 * q0, q0q1 = q0 * q1, q0q2 = q0 * q2, q0q3 = q0 * q3;
+        float q1q1 = q1 * q1, q1q2 = q1 * q2, q1q3 = q1 * q3;
+        float q2q2 = q2 * q2, q2q3 = q2 * q3, q3q3 = q3 * q3;
+        float ex, ey, ez;
+
+        // 地磁场在地面坐标系中的方向 (bx, 0, bz)
+        hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+        hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+        _2bx = fusion_sqrt(hx * hx + hy * hy);
+        _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+        _4bx = 2.0f * _2bx;
+        _4bz = 2.0f * _2bz;
+
+        // 磁场的误差项
+        ex = _2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+        ey = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+        ez = _2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz;
+
+        s0 = -_2q2 * (2.0f * q1q3 - _2q0q2 - ax) + _2q1 * (2.0f * q0q1 + _2q2q3 - ay)
+             - _2bz * q2 * ex + (-_2bx * q3 + _2bz * q1) * ey + _2bx * q2 * ez;
+        s1 = _2q3 * (2.0f * q1q3 - _2q0q2 - ax) + _2q0 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q1 * (1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az)
+             + _2bz * q3 * ex + (_2bx * q2 + _2bz * q0) * ey + (_2bx * q3 - _4bz * q1) * ez;
+        s2 = -_2q0 * (2.0f * q1q3 - _2q0q2 - ax) + _2q3 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q2 * (1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az)
+             + (-_4bx * q2 - _2bz * q0) * ex + (_2bx * q1 + _2bz * q3) * ey + (_2bx * q0 - _4bz * q2) * ez;
+        s3 = _2q1 * (2.0f * q1q3 - _2q0q2 - ax) + _2q2 * (2.0f * q0q1 + _2q2q3 - ay)
+             + (-_4bx * q3 + _2bz * q1) * ex + (-_2bx * q0 + _2bz * q2) * ey + _2bx * q1 * ez;
+    }
+
+    recipNorm = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+    if(recipNorm > 0.0f)
+    {
+        recipNorm = inv_sqrt(recipNorm);
+        qDot[0] -= fusion->beta * s0 * recipNorm;
+        qDot[1] -= fusion->beta * s1 * recipNorm;
+        qDot[2] -= fusion->beta * s2 * recipNorm;
+        qDot[3] -= fusion->beta * s3 * recipNorm;
+    }
+
+    q[0] += qDot[0] * fusion->sample_period;
+    q[1] += qDot[1] * fusion->sample_period;
+    q[2] += qDot[2] * fusion->sample_period;
+    q[3] += qDot[3] * fusion->sample_period;
+    normalize_quaternion(q);
+}
+
+/*
+  Mahony 互补滤波, 误差为测量方向与估计方向的叉积, PI 修正陀螺仪
+*/
+static void mahony_update(fusion_t *fusion, const float g[3], const float a[3], const float *m)
+{
+    float *q = fusion->q;
+    float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+    float q0q0 = q0 * q0, q0q1 = q0 * q1, q0q2 = q0 * q2, q0q3 = q0 * q3;
+    float q1q1 = q1 * q1, q1q2 = q1 * q2, q1q3 = q1 * q3;
+    float q2q2 = q2 * q2, q2q3 = q2 * q3, q3q3 = q3 * q3;
+    float gx = g[0], gy = g[1], gz = g[2];
+    float halfvx, halfvy, halfvz;
+    float halfex, halfey, halfez;
+    float dt = fusion->sample_period;
+    float qa, qb, qc;
+
+    // 估计的重力方向
+    halfvx = q1q3 - q0q2;
+    halfvy = q0q1 + q2q3;
+    halfvz = q0q0 - 0.5f + q3q3;
+    halfex = a[1] * halfvz - a[2] * halfvy;
+    halfey = a[2] * halfvx - a[0] * halfvz;
+    halfez = a[0] * halfvy - a[1] * halfvx;
+
+    if(m != NULL)
+    {
+        float mx = m[0], my = m[1], mz = m[2];
+        float hx, hy, bx, bz, halfwx, halfwy, halfwz;
+
+        hx = 2.0f * (mx * (0.5f - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2));
+        hy = 2.0f * (mx * (q1q2 + q0q3) + my * (0.5f - q1q1 - q3q3) + mz * (q2q3 - q0q1));
+        bx = fusion_sqrt(hx * hx + hy * hy);
+        bz = 2.0f * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (0.5f - q1q1 - q2q2));
+
+        // 估计的磁场方向
+        halfwx = bx * (0.5f - q2q2 - q3q3) + bz * (q1q3 - q0q2);
+        halfwy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
+        halfwz = bx * (q0q2 + q1q3) + bz * (0.5f - q1q1 - q2q2);
+        halfex += my * halfwz - mz * halfwy;
+        halfey += mz * halfwx - mx * halfwz;
+        halfez += mx * halfwy - my * halfwx;
+    }
+
+    if(fusion->ki > 0.0f)
+    {
+        fusion->integral[0] += 2.0f * fusion->ki * halfex * dt;
+        fusion->integral[1] += 2.0f * fusion->ki * halfey * dt;
+        fusion->integral[2] += 2.0f * fusion->ki * halfez * dt;
+        gx += fusion->integral[0];
+        gy += fusion->integral[1];
+        gz += fusion->integral[2];
+    }
+    gx += 2.0f * fusion->kp * halfex;
+    gy += 2.0f * fusion->kp * halfey;
+    gz += 2.0f * fusion->kp * halfez;
+
+    gx *= 0.5f * dt;
+    gy *= 0.5f * dt;
+    gz *= 0.5f * dt;
+    qa = q0;
+    qb = q1;
+    qc = q2;
+    q[0] += -qb * gx - qc * gy - q3 * gz;
+    q[1] += qa * gx + qc * gz - q3 * gy;
+    q[2] += qa * gy - qb * gz + q3 * gx;
+    q[3] += qa * gz + qb * gy - qc * gx;
+    normalize_quaternion(q);
+}
+
+/*********************************************************************************
+ *Function     : void fusion_update(fusion_t *fusion, const int16_t accel[3], const int16_t gyro[3], const int16_t *mag)
+ *Description  : 输入一个样本, 更新姿态和去掉重力的加速度
+ *Input        : accel/gyro: 原始值  mag: 原始值, NULL 时为6轴融合
+ *Output       : none
+ *Return       : none
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 加速度为0(自由落体)时只积分陀螺仪, 磁场为0时按6轴处理
+ **********************************************************************************/
+void fusion_update(fusion_t *fusion, const int16_t accel[3], const int16_t gyro[3], const int16_t *mag)
+{
+    const fusion_calibration_t *cal = &fusion->cal;
+    const float *q = fusion->q;
+    float a[3], g[3], m[3];
+    float norm;
+    int accelValid;
+    int magValid = 0;
+    int i;
+
+    for(i = 0; i < 3; i++)
+    {
+        a[i] = ((float)accel[i] - cal->accel_offset[i]) * fusion->accel_scale;
+        g[i] = ((float)gyro[i] - cal->gyro_offset[i]) * fusion->gyro_scale;
+    }
+
+    norm = a[0] * a[0] + a[1] * a[1] + a[2] * a[2];
+    accelValid = (norm > 0.0f);
+    if(mag != NULL)
+    {
+        for(i = 0; i < 3; i++)
+        {
+            m[i] = ((float)mag[i] - cal->mag_offset[i]) * cal->mag_scale[i];
+        }
+        norm = m[0] * m[0] + m[1] * m[1] + m[2] * m[2];
+        if(norm > 0.0f)
+        {
+            norm = inv_sqrt(norm);
+            m[0] *= norm;
+            m[1] *= norm;
+            m[2] *= norm;
+            magValid = 1;
+        }
+    }
+
+    if(accelValid)
+    {
+        float an[3];
+
+        norm = inv_sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+        an[0] = a[0] * norm;
+        an[1] = a[1] * norm;
+        an[2] = a[2] * norm;
+        if(fusion->updates == 0)
+        {
+            fusion_initial_attitude(fusion, an, magValid ? m : NULL);
+        }
+        else if(fusion->algorithm == FUSION_MAHONY)
+        {
+            mahony_update(fusion, g, an, magValid ? m : NULL);
+        }
+        else
+        {
+            madgwick_update(fusion, g, an, magValid ? m : NULL);
+        }
+    }
+    else
+    {
+        // 没有重力参考, 只积分陀螺仪
+        float qDot[4];
+        float *qw = fusion->q;
+
+        qDot[0] = 0.5f * (-qw[1] * g[0] - qw[2] * g[1] - qw[3] * g[2]);
+        qDot[1] = 0.5f * (qw[0] * g[0] + qw[2] * g[2] - qw[3] * g[1]);
+        qDot[2] = 0.5f * (qw[0] * g[1] - qw[1] * g[2] + qw[3] * g[0]);
+        qDot[3] = 0.5f * (qw[0] * g[2] + qw[1] * g[1] - qw[2] * g[0]);
+        for(i = 0; i < 4; i++)
+        {
+            qw[i] += qDot[i] * fusion->sample_period;
+        }
+        normalize_quaternion(qw);
+    }
+
+    // 传感器坐标系中的重力
+    fusion->gravity[0] = 2.0f * (q[1] * q[3] - q[0] * q[2]);
+    fusion->gravity[1] = 2.0f * (q[0] * q[1] + q[2] * q[3]);
+    fusion->gravity[2] = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+    for(i = 0; i < 3; i++)
+    {
+        fusion->linear_accel[i] = a[i] - fusion->gravity[i];
+    }
+    fusion->updates++;
+}
+
+void fusion_get_quaternion(const fusion_t *fusion, float q[4])
+{
+    memcpy(q, fusion->q, sizeof(fusion->q));
+}
+
+/*
+  欧拉角(度) roll pitch yaw, Z-Y-X 顺序
+*/
+void fusion_get_euler(const fusion_t *fusion, float euler[3])
+{
+    const float *q = fusion->q;
+    float sinp = 2.0f * (q[0] * q[2] - q[3] * q[1]);
+
+    if(sinp > 1.0f)
+    {
+        sinp = 1.0f;
+    }
+    else if(sinp < -1.0f)
+    {
+        sinp = -1.0f;
+    }
+    euler[0] = atan2f(2.0f * (q[0] * q[1] + q[2] * q[3]), 1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2])) * FUSION_RAD_TO_DEG;
+    euler[1] = asinf(sinp) * FUSION_RAD_TO_DEG;
+    euler[2] = atan2f(2.0f * (q[0] * q[3] + q[1] * q[2]), 1.0f - 2.0f * (q[2] * q[2] + q[3] * q[3])) * FUSION_RAD_TO_DEG;
+}
+
+void fusion_get_linear_accel(const fusion_t *fusion, float accel[3])
+{
+    memcpy(accel, fusion->linear_accel, sizeof(fusion->linear_accel));
+}
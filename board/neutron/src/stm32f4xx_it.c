@@ -36,6 +36,8 @@
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 extern I2S_HandleTypeDef I2sHandle;
+extern ADC_HandleTypeDef AdcHandle;
+extern DMA_HandleTypeDef AdcDmaHandle;
 
 extern PCD_HandleTypeDef hpcd;
 
@@ -51,7 +53,11 @@ extern TIM_HandleTypeDef TimHandle;
 void Wiring_USART1_Interrupt_Handler(void) __attribute__ ((weak));
 void Wiring_USART2_Interrupt_Handler(void) __attribute__ ((weak));
 void WifiDrv_USART1_Interrupt_Handler(void);
+void WifiDrv_USART1_DMA_Interrupt_Handler(void);
 void Wiring_EXTI_Interrupt_Handler(uint8_t EXTI_Line_Number) __attribute__ ((weak));
+void Wiring_I2C1_EV_Interrupt_Handler(void) __attribute__ ((weak));
+void Wiring_I2C1_ER_Interrupt_Handler(void) __attribute__ ((weak));
+void Wiring_I2C1_DMA_RX_Interrupt_Handler(void) __attribute__ ((weak));
 
 /******************************************************************************/
 /*            Cortex-M4 Processor Exceptions Handlers                         */
@@ -186,6 +192,36 @@ void USART1_IRQHandler(void)
     //HAL_UART_IRQHandler(&UartHandle);
 }
 
+/**
+ * @brief  This function handles USART1 RX DMA interrupt request.
+ * @param  None
+ * @retval None
+ */
+void DMA2_Stream2_IRQHandler(void)
+{
+    WifiDrv_USART1_DMA_Interrupt_Handler();
+}
+
+/**
+ * @brief  This function handles ADC1 scan DMA interrupt request.
+ * @param  None
+ * @retval None
+ */
+void DMA2_Stream0_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&AdcDmaHandle);
+}
+
+/**
+ * @brief  This function handles ADC1 overrun interrupt request.
+ * @param  None
+ * @retval None
+ */
+void ADC_IRQHandler(void)
+{
+    HAL_ADC_IRQHandler(&AdcHandle);
+}
+
 /**
  * @brief  This function handles USARTx interrupt request.
  * @param  None
@@ -197,6 +233,36 @@ void USART2_IRQHandler(void)
     //HAL_UART_IRQHandler(&UartHandle);
 }
 
+/**
+ * @brief  This function handles I2C1 event interrupt request.
+ * @param  None
+ * @retval None
+ */
+void I2C1_EV_IRQHandler(void)
+{
+    Wiring_I2C1_EV_Interrupt_Handler();
+}
+
+/**
+ * @brief  This function handles I2C1 error interrupt request.
+ * @param  None
+ * @retval None
+ */
+void I2C1_ER_IRQHandler(void)
+{
+    Wiring_I2C1_ER_Interrupt_Handler();
+}
+
+/**
+ * @brief  This function handles I2C1 RX DMA interrupt request.
+ * @param  None
+ * @retval None
+ */
+void DMA1_Stream5_IRQHandler(void)
+{
+    Wiring_I2C1_DMA_RX_Interrupt_Handler();
+}
+
 /*******************************************************************************
  * Function Name  : EXTI0_IRQHandler
  * Description    : This function handles EXTI0 interrupt request.
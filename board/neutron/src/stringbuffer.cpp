@@ -117,6 +117,11 @@ char* stringBufferToString(string_buffer* buffer)
     //ensure that the string ends with 0
     if (buffer->string_length == 0 || buffer->string[(buffer->string_length - 1)] != 0)
     {
+        if (buffer->string_length >= buffer->memory)
+        {
+            //full: drop the last character, the terminator must fit
+            buffer->string_length = buffer->memory - 1;
+        }
         stringBufferAdd(0, buffer);
     }
     /*  char* string = realloc(result, buffer->string_length);
@@ -129,9 +134,11 @@ char* stringBufferToString(string_buffer* buffer)
     char* result = (char *)pvPortMalloc(buffer->string_length * sizeof(char));
     if (result == NULL)
     {
+        buffer->string = NULL;
+        vPortFree(buffer);
         return NULL;
     }
-    strcpy(result, global_buffer);
+    memcpy(result, global_buffer, buffer->string_length);
     buffer->string = NULL;
     vPortFree(buffer);
     return result;
@@ -1,5 +1,7 @@
 #include "system_params.h"
 #include "wiring_flash_memory.h"
+#include "wiring_eeprom.h"
+#include "lib_crc.h"
 #include <string.h>
 #include <stdio.h>
 #include "lib_system_all.h"
@@ -16,6 +18,142 @@ uint8_t crcSum( const uint8_t *data, uint32_t len)
     return sum;
 }
 
+static bool checkSystemParams(system_params_t *psystem_params)
+{
+    return ( 0x5aa5f66f == psystem_params->system_flags.header )
+            &&(psystem_params->system_flags.crc == crcSum((const uint8_t *)&psystem_params->system_flags, sizeof(system_flags_t)-1))
+            &&(psystem_params->crc == crcSum((const uint8_t *)&psystem_params->version, sizeof(system_params_t)-sizeof(system_flags_t)-1));
+}
+
+//基础记录的 crcSum, 以及有封记时的 CRC16
+static bool checkSystemParamsBase(system_params_t *psystem_params)
+{
+    uint16_t seal[2];
+
+    if(!checkSystemParams(psystem_params))
+    {
+        return false;
+    }
+    SystemReadArgument(SYSTEM_ARGUMENT_ADDRESS + PARAMS_SEAL_OFFSET, seal, 2);
+    if((0xFFFF == seal[0]) && (0xFFFF == seal[1]))
+    {
+        return true;
+    }
+    return (PARAMS_JOURNAL_COMMIT == seal[1])
+            && (seal[0] == crc16_ccitt_update(CRC16_INIT, psystem_params, sizeof(system_params_t)));
+}
+
+//读取EEPROM中的参数副本, 副本无效时返回false
+static bool loadSystemParamsBackup(system_params_t *psystem_params)
+{
+    uint16_t crc;
+
+    EEPROM.read(PARAMS_BACKUP_ADDRESS, (uint8_t *)psystem_params, sizeof(system_params_t));
+    EEPROM.read(PARAMS_BACKUP_ADDRESS + sizeof(system_params_t), (uint8_t *)&crc, 2);
+    return checkSystemParams(psystem_params)
+            && (crc == crc16_ccitt_update(CRC16_INIT, psystem_params, sizeof(system_params_t)));
+}
+
+//写入参数副本, 最后写校验, 写入中途掉电时副本无效
+static bool saveSystemParamsBackup(system_params_t *psystem_params)
+{
+    uint16_t crc = crc16_ccitt_update(CRC16_INIT, psystem_params, sizeof(system_params_t));
+
+    return (FLASH_COMPLETE == EEPROM_WriteBlock(PARAMS_BACKUP_ADDRESS, (const uint8_t *)psystem_params, sizeof(system_params_t)))
+            && (FLASH_COMPLETE == EEPROM_WriteBlock(PARAMS_BACKUP_ADDRESS + sizeof(system_params_t), (const uint8_t *)&crc, 2));
+}
+
+//先写参数副本, 再擦除参数区, 先写封记再写基础记录. 擦除之后封好之前掉电, 加载时使用副本
+static void writeSystemParamsBase(system_params_t *psystem_params)
+{
+    uint16_t seal[2];
+
+    if(!saveSystemParamsBackup(psystem_params))
+    {
+        MO_ERROR(("system params backup failed"));
+    }
+    seal[0] = crc16_ccitt_update(CRC16_INIT, psystem_params, sizeof(system_params_t));
+    seal[1] = PARAMS_JOURNAL_COMMIT;
+    SystemWriteArgument(SYSTEM_ARGUMENT_ADDRESS + PARAMS_SEAL_OFFSET, seal, 2);
+    SystemProgramArgument(SYSTEM_ARGUMENT_ADDRESS, (uint16_t *)psystem_params, sizeof(system_params_t)/2);
+}
+
+//日志各段: 检查(apply=false)或写入 psystem_params. 段越界时返回false
+static bool applySystemParamsJournal(system_params_t *psystem_params, const uint8_t *runs, uint16_t length, bool apply)
+{
+    uint16_t pos = 0, offset, size;
+
+    while(pos < length)
+    {
+        if(length - pos < 4)
+        {
+            return false;
+        }
+        memcpy(&offset, runs + pos, 2);
+        memcpy(&size, runs + pos + 2, 2);
+        pos += 4;
+        if((size == 0) || (size > length - pos) || (offset + size > sizeof(system_params_t)))
+        {
+            return false;
+        }
+        if(apply)
+        {
+            memcpy((uint8_t *)psystem_params + offset, runs + pos, size);
+        }
+        pos += (size + 1) & ~1;
+    }
+    return true;
+}
+
+/*********************************************************************************
+  *Function		:   static uint32_t replaySystemParamsJournal(system_params_t *psystem_params, uint16_t *psequence)
+  *Description	:   apply the committed journal entries after the base record, in order
+  *Input		      :   psystem_params: the base record
+  *Output		:   psequence: sequence of the last applied entry
+  *Return		:   offset to append the next entry, PARAMS_JOURNAL_END if the journal is full or damaged
+  *author		:   robot
+  *date			:   2016-05-20
+  *Others		:   an entry cut by a power loss (no commit, bad crc) is skipped
+**********************************************************************************/
+static uint32_t replaySystemParamsJournal(system_params_t *psystem_params, uint16_t *psequence)
+{
+    uint16_t entry[(PARAMS_JOURNAL_HEAD_SIZE + PARAMS_JOURNAL_MAX + 2) / 2];
+    uint32_t pos = PARAMS_JOURNAL_START;
+    uint16_t sequence = 0;
+    bool first = true;
+
+    while(pos + PARAMS_JOURNAL_HEAD_SIZE + 2 <= PARAMS_JOURNAL_END)
+    {
+        SystemReadArgument(SYSTEM_ARGUMENT_ADDRESS + pos, entry, PARAMS_JOURNAL_HEAD_SIZE/2);
+        uint16_t length = entry[0];
+        if(0xFFFF == length)
+        {
+            break;
+        }
+        uint32_t size = PARAMS_JOURNAL_HEAD_SIZE + length + 2;
+        if((length > PARAMS_JOURNAL_MAX) || (length & 1) || (pos + size > PARAMS_JOURNAL_END))
+        {
+            //长度损坏, 无法找到下一条日志
+            pos = PARAMS_JOURNAL_END;
+            break;
+        }
+        SystemReadArgument(SYSTEM_ARGUMENT_ADDRESS + pos, entry, size/2);
+        const uint8_t *runs = (const uint8_t *)entry + PARAMS_JOURNAL_HEAD_SIZE;
+        if((PARAMS_JOURNAL_COMMIT == entry[size/2 - 1])
+                && (entry[2] == crc16_ccitt_update(crc16_ccitt_update(CRC16_INIT, entry, 4), runs, length))
+                && (first || (entry[1] == (uint16_t)(sequence + 1)))
+                && applySystemParamsJournal(psystem_params, runs, length, false))
+        {
+            applySystemParamsJournal(psystem_params, runs, length, true);
+            sequence = entry[1];
+            first = false;
+        }
+        pos += size;
+    }
+    *psequence = sequence;
+    return pos;
+}
+
 /*初始化系统参数区*/
 void initSystemParams(system_params_t *psystem_params)
 {
@@ -45,26 +183,140 @@ void initFacSystemParams(system_params_t *psystem_params)
     saveSystemParams(psystem_params);
 }
 
+/*参数区当前内容(基础记录+日志), 保存时与之比较只写入改变的字节*/
+static system_params_t params_flash;
+static uint32_t params_journal_end = 0;         // 下一条日志的偏移, 0:未加载
+static uint16_t params_journal_sequence = 0;    // 最后一条日志的序号
+
+//读取参数区到 params_flash, 基础记录无效时从参数副本重写参数区, 都无效时返回false
+static bool loadSystemParamsFlash(void)
+{
+    SystemReadArgument(SYSTEM_ARGUMENT_ADDRESS, (uint16_t *)&params_flash, sizeof(system_params_t)/2);
+    if(!checkSystemParamsBase(&params_flash))
+    {
+        if(!loadSystemParamsBackup(&params_flash))
+        {
+            params_journal_end = PARAMS_JOURNAL_END;
+            return false;
+        }
+        //重写参数区时掉电, 副本不变, 下次加载再次恢复
+        MO_INFO(("system params restored from backup"));
+        writeSystemParamsBase(&params_flash);
+        params_journal_end = PARAMS_JOURNAL_START;
+        params_journal_sequence = 0;
+        return true;
+    }
+    params_journal_end = replaySystemParamsJournal(&params_flash, &params_journal_sequence);
+    if(!checkSystemParams(&params_flash))
+    {
+        //日志与基础记录不一致, 只使用基础记录, 下次保存时重写
+        MO_ERROR(("system params journal invalid"));
+        SystemReadArgument(SYSTEM_ARGUMENT_ADDRESS, (uint16_t *)&params_flash, sizeof(system_params_t)/2);
+        params_journal_end = PARAMS_JOURNAL_END;
+    }
+    return true;
+}
+
+/*********************************************************************************
+  *Function		:   static bool appendSystemParamsJournal(system_params_t *psystem_params)
+  *Description	:   append the bytes that differ from params_flash as one journal entry
+  *Input		      :   psystem_params: parameters to save, system_flags equal to params_flash
+  *Output		:
+  *Return		:   false if the entry does not fit, then the area has to be rewritten
+  *author		:   robot
+  *date			:   2016-05-20
+  *Others		:   changes closer than a run header are merged into one run
+**********************************************************************************/
+static bool appendSystemParamsJournal(system_params_t *psystem_params)
+{
+    uint16_t entry[(PARAMS_JOURNAL_HEAD_SIZE + PARAMS_JOURNAL_MAX + 2) / 2];
+    uint8_t *runs = (uint8_t *)entry + PARAMS_JOURNAL_HEAD_SIZE;
+    const uint8_t *now = (const uint8_t *)psystem_params, *old = (const uint8_t *)&params_flash;
+    uint16_t length = 0, offset = 0, end, size;
+
+    while(offset < sizeof(system_params_t))
+    {
+        if(now[offset] == old[offset])
+        {
+            offset++;
+            continue;
+        }
+        //到下一处改变的距离不超过段头长度时合并
+        end = offset + 1;
+        for(uint16_t i = end; (i < sizeof(system_params_t)) && (i <= end + 4); i++)
+        {
+            if(now[i] != old[i])
+            {
+                end = i + 1;
+            }
+        }
+        size = end - offset;
+        if(length + 4 + ((size + 1) & ~1) > PARAMS_JOURNAL_MAX)
+        {
+            return false;
+        }
+        memcpy(runs + length, &offset, 2);
+        memcpy(runs + length + 2, &size, 2);
+        memcpy(runs + length + 4, now + offset, size);
+        if(size & 1)
+        {
+            runs[length + 4 + size] = 0xFF;
+        }
+        length += 4 + ((size + 1) & ~1);
+        offset = end;
+    }
+    if(0 == length)
+    {
+        return true;
+    }
+
+    uint32_t total = PARAMS_JOURNAL_HEAD_SIZE + length + 2;
+    if(params_journal_end + total > PARAMS_JOURNAL_END)
+    {
+        return false;
+    }
+    entry[0] = length;
+    entry[1] = params_journal_sequence + 1;
+    entry[2] = crc16_ccitt_update(crc16_ccitt_update(CRC16_INIT, entry, 4), runs, length);
+    entry[total/2 - 1] = PARAMS_JOURNAL_COMMIT;
+    if(SystemProgramArgument(SYSTEM_ARGUMENT_ADDRESS + params_journal_end, entry, total/2))
+    {
+        return false;
+    }
+    params_journal_end += total;
+    params_journal_sequence++;
+    memcpy(&params_flash, psystem_params, sizeof(system_params_t));
+    return true;
+}
+
 /*加载系统参数区*/
 void loadSystemParams(system_params_t *psystem_params)
 {
-    memset(psystem_params, 0, sizeof(system_params_t));
-    SystemReadArgument(SYSTEM_ARGUMENT_ADDRESS, (uint16_t *)psystem_params, sizeof(system_params_t)/2);
-    if(( 0x5aa5f66f != psystem_params->system_flags.header )
-            ||(psystem_params->system_flags.crc != crcSum((const uint8_t *)&psystem_params->system_flags, sizeof(system_flags_t)-1))
-            ||(psystem_params->crc != crcSum((const uint8_t *)&psystem_params->version, sizeof(system_params_t)-sizeof(system_flags_t)-1)))
+    if(!loadSystemParamsFlash())
     {
         initSystemParams(psystem_params);
+        return;
     }
+    memcpy(psystem_params, &params_flash, sizeof(system_params_t));
 }
 
-/*保存系统参数区*/
+/*保存系统参数区
+  只追加改变的字节到日志, 日志区满或 system_flags 改变时先写参数副本, 再擦除参数区重写
+*/
 void saveSystemParams(system_params_t *psystem_params)
 {
     psystem_params->system_flags.crc = crcSum((const uint8_t *)&psystem_params->system_flags, sizeof(system_flags_t)-1);
     psystem_params->crc = crcSum((const uint8_t *)&psystem_params->version, sizeof(system_params_t)-sizeof(system_flags_t)-1);
-    SystemWriteArgument(SYSTEM_ARGUMENT_ADDRESS, (uint16_t *)psystem_params, sizeof(system_params_t)/2);
+    if(0 == params_journal_end)
+    {
+        loadSystemParamsFlash();
+    }
+    if((0 == memcmp(&psystem_params->system_flags, &params_flash.system_flags, sizeof(system_flags_t)))
+            && appendSystemParamsJournal(psystem_params))
+    {
+        return;
+    }
+    writeSystemParamsBase(psystem_params);
+    memcpy(&params_flash, psystem_params, sizeof(system_params_t));
+    params_journal_end = PARAMS_JOURNAL_START;
 }
-
-
-
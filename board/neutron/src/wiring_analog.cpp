@@ -28,26 +28,73 @@ License along with this library; if not, see <http://www.gnu.org/licenses/>.
 #include "wiring_usartserial.h"
 #include "application.h"
 
+#include "lib_adc_ring.h"
+
 uint8_t adcInitFirstTime = true;
 __IO uint32_t uhADCxConvertedValue;
 
-#define useAdcDMA 0
+ADC_HandleTypeDef AdcHandle;
+DMA_HandleTypeDef AdcDmaHandle;
+
+/* 扫描引擎: TIM1 CC1 触发 ADC1 扫描一帧, DMA2 Stream0 循环写入 AdcScanBuffer */
+static TIM_HandleTypeDef AdcScanTimHandle;
+static volatile uint16_t AdcScanBuffer[ADC_SCAN_CHANNEL_MAX * ADC_SCAN_FRAMES];
+static uint16_t AdcScanPins[ADC_SCAN_CHANNEL_MAX];
+static adc_ring_t AdcScanRing;
+static volatile bool adcScanRunning = false;
+
 /*********************************************************************************
- *Function     : int32_t analogRead(uint16_t pin)
- *Description  : Read the analog value of a pin.
+ *Function     : static bool analogPinInit(uint16_t pin)
+ *Description  : 检查引脚并配置为模拟输入
  *Input        : pin:port number
  *Output       : none
- *Return       : Should return a 16-bit value, 0-65536 (0 = LOW, 65536 = HIGH)
- *author       : lz
- *date         : 6-December-2014
- *Others       : ADC is 12-bit. Currently it returns 0-4095
+ *Return       : false: 不是模拟引脚或者被SPI/串口占用
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       :
  **********************************************************************************/
+static bool analogPinInit(uint16_t pin)
+{
+    if(  !((pin >= A0)&&(pin <= A7)) && (pin!=PO188) )
+    {
+        return false;
+    }
 
+    if( (SPI.isEnabled() == true ) && ((pin == PIN_SPI_SS) ||  (pin == PIN_SPI_SCK) || (pin == PIN_SPI_MISO) || (pin == PIN_SPI_MOSI) ))
+    {
+        return false;
+    }
+
+    if( (Serial.isEnabled() == true) && ( (pin == RX) || (pin == TX) ))
+    {
+        return false;
+    }
+    /* A0 - A7: ADC1_IN0 - ADC_IN7, DMA2 Stream0 Channel0 */
+    GPIO_InitTypeDef          GPIO_InitStruct;
+
+    /*##-1- Enable peripherals and GPIO Clocks #################################*/
+    /* ADC1 Periph clock enable */
+    __HAL_RCC_ADC1_CLK_ENABLE();
+    /* Enable GPIO clock ****************************************/
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+
+    if(pin==PO188)
+    {
+        __HAL_RCC_GPIOB_CLK_ENABLE();
+    }
+
+    /*##-2- Configure peripheral GPIO ##########################################*/
+    /* ADC Channel GPIO pin configuration */
+    GPIO_InitStruct.Pin = PIN_MAP[pin].gpio_pin;
+    GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    HAL_GPIO_Init(PIN_MAP[pin].gpio_peripheral, &GPIO_InitStruct);
+    return true;
+}
 
 void ADC_DMA_Init( ADC_HandleTypeDef *hadc)
 {
     /* A0 - A7: ADC1_IN0 - ADC_IN7, DMA2 Stream0 Channel0 */
-    DMA_HandleTypeDef  hdma_adc;
 
     /*##-1- Enable peripherals and GPIO Clocks #################################*/
     /* Enable DMA2 clock */
@@ -55,112 +102,122 @@ void ADC_DMA_Init( ADC_HandleTypeDef *hadc)
 
     /*##-3- Configure the DMA streams ##########################################*/
     /* Set the parameters to be configured */
-    hdma_adc.Instance = DMA2_Stream0;
-
-    hdma_adc.Init.Channel  = DMA_CHANNEL_0;
-    hdma_adc.Init.Direction = DMA_PERIPH_TO_MEMORY;
-    hdma_adc.Init.PeriphInc = DMA_PINC_DISABLE;
-    hdma_adc.Init.MemInc = DMA_MINC_ENABLE;
-    hdma_adc.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
-    hdma_adc.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
-    hdma_adc.Init.Mode = DMA_CIRCULAR;
-    hdma_adc.Init.Priority = DMA_PRIORITY_HIGH;
-    hdma_adc.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
-    hdma_adc.Init.FIFOThreshold = DMA_FIFO_THRESHOLD_HALFFULL;
-    hdma_adc.Init.MemBurst = DMA_MBURST_SINGLE;
-    hdma_adc.Init.PeriphBurst = DMA_PBURST_SINGLE;
-
-    HAL_DMA_Init(&hdma_adc);
+    AdcDmaHandle.Instance = DMA2_Stream0;
+
+    AdcDmaHandle.Init.Channel  = DMA_CHANNEL_0;
+    AdcDmaHandle.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    AdcDmaHandle.Init.PeriphInc = DMA_PINC_DISABLE;
+    AdcDmaHandle.Init.MemInc = DMA_MINC_ENABLE;
+    AdcDmaHandle.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    AdcDmaHandle.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+    AdcDmaHandle.Init.Mode = DMA_CIRCULAR;
+    AdcDmaHandle.Init.Priority = DMA_PRIORITY_HIGH;
+    AdcDmaHandle.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    AdcDmaHandle.Init.FIFOThreshold = DMA_FIFO_THRESHOLD_HALFFULL;
+    AdcDmaHandle.Init.MemBurst = DMA_MBURST_SINGLE;
+    AdcDmaHandle.Init.PeriphBurst = DMA_PBURST_SINGLE;
+
+    HAL_DMA_DeInit(&AdcDmaHandle);
+    HAL_DMA_Init(&AdcDmaHandle);
 
     /* Associate the initialized DMA handle to the ADC handle */
-    __HAL_LINKDMA(hadc, DMA_Handle, hdma_adc);
-
-    // /*##-4- Configure the NVIC for DMA #########################################*/
-    // /* NVIC configuration for DMA transfer complete interrupt */
-    // HAL_NVIC_SetPriority(ADCx_DMA_IRQn, 0, 0);
-    // HAL_NVIC_EnableIRQ(ADCx_DMA_IRQn);
-}
+    __HAL_LINKDMA(hadc, DMA_Handle, AdcDmaHandle);
 
+    /*##-4- Configure the NVIC for DMA #########################################*/
+    /* 半满/全满中断更新帧索引 */
+    HAL_NVIC_SetPriority(DMA2_Stream0_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
 
+    /* HAL_ADC_Start_DMA 打开了溢出(OVR)中断, 在 HAL_ADC_ErrorCallback 中恢复 */
+    HAL_NVIC_SetPriority(ADC_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(ADC_IRQn);
+}
 
+/*********************************************************************************
+ *Function     : int32_t analogRead(uint16_t pin)
+ *Description  : Read the analog value of a pin.
+ *Input        : pin:port number
+ *Output       : none
+ *Return       : Should return a 16-bit value, 0-65536 (0 = LOW, 65536 = HIGH)
+ *author       : lz
+ *date         : 6-December-2014
+ *Others       : ADC is 12-bit. Currently it returns 0-4095
+                 ADC 只在第一次调用时初始化, 之后每次只配置通道
+                 扫描引擎运行时, 扫描的引脚返回最新的采样, 其它引脚用注入通道转换一次
+ **********************************************************************************/
 int32_t analogRead(uint16_t pin)
 {
     if(  ((pin >= A0)&&(pin <= A7)) || (pin==PO188) )
     {
-        if( (SPI.isEnabled() == true ) && ((pin == PIN_SPI_SS) ||  (pin == PIN_SPI_SCK) || (pin == PIN_SPI_MISO) || (pin == PIN_SPI_MOSI) ))
+        if(adcScanRunning)
         {
-            return LOW;
+            for(uint8_t i = 0; i < AdcScanRing.channels; i++)
+            {
+                if(AdcScanPins[i] == pin)
+                {
+                    return analogScanRead(pin);
+                }
+            }
+            if(!analogPinInit(pin))
+            {
+                return LOW;
+            }
+            ADC_InjectionConfTypeDef sConfigInjected;
+
+            sConfigInjected.InjectedChannel               = PIN_MAP[pin].adc_channel;
+            sConfigInjected.InjectedRank                  = ADC_INJECTED_RANK_1;
+            sConfigInjected.InjectedSamplingTime          = ADC_SAMPLETIME_56CYCLES;
+            sConfigInjected.InjectedOffset                = 0;
+            sConfigInjected.InjectedNbrOfConversion       = 1;
+            sConfigInjected.AutoInjectedConv              = DISABLE;
+            sConfigInjected.InjectedDiscontinuousConvMode = DISABLE;
+            sConfigInjected.ExternalTrigInjecConvEdge     = ADC_EXTERNALTRIGINJECCONVEDGE_NONE;
+            sConfigInjected.ExternalTrigInjecConv         = ADC_EXTERNALTRIGINJECCONV_T1_CC4;
+            if((HAL_ADCEx_InjectedConfigChannel(&AdcHandle, &sConfigInjected) != HAL_OK)
+                || (HAL_ADCEx_InjectedStart(&AdcHandle) != HAL_OK)
+                || (HAL_ADCEx_InjectedPollForConversion(&AdcHandle, 10) != HAL_OK))
+            {
+                return LOW;
+            }
+            return HAL_ADCEx_InjectedGetValue(&AdcHandle, ADC_INJECTED_RANK_1);
         }
 
-        if( (Serial.isEnabled() == true) && ( (pin == RX) || (pin == TX) ))
+        // initial the pin
+        if(!analogPinInit(pin))
         {
             return LOW;
         }
-        // initial the pin
-        /* A0 - A7: ADC1_IN0 - ADC_IN7, DMA2 Stream0 Channel0 */
-        GPIO_InitTypeDef          GPIO_InitStruct;
 
-        /*##-1- Enable peripherals and GPIO Clocks #################################*/
-        /* ADC1 Periph clock enable */
-        __HAL_RCC_ADC1_CLK_ENABLE();
-        /* Enable GPIO clock ****************************************/
-        __HAL_RCC_GPIOA_CLK_ENABLE();
-
-        if(pin==PO188)
+        if (adcInitFirstTime == true)
         {
-        	__HAL_RCC_GPIOB_CLK_ENABLE();
+            AdcHandle.Instance = ADC1;
+
+            AdcHandle.Init.ClockPrescaler        = ADC_CLOCKPRESCALER_PCLK_DIV4;   // F411 the maximum ADCCLK = 36M, typical ADCCLK = 30M, the ADCCLK set to 24M
+            AdcHandle.Init.Resolution            = ADC_RESOLUTION_12B;
+            AdcHandle.Init.ScanConvMode          = DISABLE;                       /* Sequencer disabled (ADC conversion on only 1 channel: channel set on rank 1) */
+            AdcHandle.Init.ContinuousConvMode    = DISABLE;
+            AdcHandle.Init.DiscontinuousConvMode = DISABLE;                       /* Parameter discarded because sequencer is disabled */
+            AdcHandle.Init.NbrOfDiscConversion   = 0;
+            AdcHandle.Init.ExternalTrigConvEdge  = ADC_EXTERNALTRIGCONVEDGE_NONE;        /* Conversion start trigged at each external event */
+            AdcHandle.Init.ExternalTrigConv      = ADC_EXTERNALTRIGCONV_T1_CC1;
+            AdcHandle.Init.DataAlign             = ADC_DATAALIGN_RIGHT;
+            AdcHandle.Init.NbrOfConversion       = 1;
+            AdcHandle.Init.DMAContinuousRequests = DISABLE;
+            AdcHandle.Init.EOCSelection          = DISABLE;
+
+            if (HAL_ADC_Init(&AdcHandle) != HAL_OK)
+            {
+                /* ADC initialization Error */
+                // Error_Handler();
+                while(1)
+                {}
+            }
+            adcInitFirstTime = false;
         }
 
-        /*##-2- Configure peripheral GPIO ##########################################*/
-        /* ADC Channel GPIO pin configuration */
-        GPIO_InitStruct.Pin = PIN_MAP[pin].gpio_pin;
-        GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
-        GPIO_InitStruct.Pull = GPIO_NOPULL;
-        HAL_GPIO_Init(PIN_MAP[pin].gpio_peripheral, &GPIO_InitStruct);
-        // if (adcInitFirstTime == true)
-        // {
-        ADC_HandleTypeDef AdcHandle;
-#if(useAdcDMA)
-        ADC_DMA_Init(&AdcHandle);
-#endif
+        /*##-2- Configure ADC regular channel ######################################*/
         ADC_ChannelConfTypeDef sConfig;
 
-        AdcHandle.Instance = ADC1;
-
-        AdcHandle.Init.ClockPrescaler        = ADC_CLOCKPRESCALER_PCLK_DIV4;   // F411 the maximum ADCCLK = 36M, typical ADCCLK = 30M, the ADCCLK set to 24M
-        AdcHandle.Init.Resolution            = ADC_RESOLUTION_12B;
-        AdcHandle.Init.ScanConvMode          = DISABLE;                       /* Sequencer disabled (ADC conversion on only 1 channel: channel set on rank 1) */
-#if(useAdcDMA)
-        AdcHandle.Init.ContinuousConvMode    = ENABLE;                        /* Continuous mode disabled to have only 1 conversion at each conversion trig */
-#endif
-#if(~useAdcDMA)
-        AdcHandle.Init.ContinuousConvMode    = DISABLE;
-#endif
-        AdcHandle.Init.DiscontinuousConvMode = DISABLE;                       /* Parameter discarded because sequencer is disabled */
-        AdcHandle.Init.NbrOfDiscConversion   = 0;
-        AdcHandle.Init.ExternalTrigConvEdge  = ADC_EXTERNALTRIGCONVEDGE_NONE;        /* Conversion start trigged at each external event */
-        AdcHandle.Init.ExternalTrigConv      = ADC_EXTERNALTRIGCONV_T1_CC1;
-        AdcHandle.Init.DataAlign             = ADC_DATAALIGN_RIGHT;
-
-#if(useAdcDMA)
-        AdcHandle.Init.NbrOfConversion       = 1;
-        AdcHandle.Init.DMAContinuousRequests = ENABLE;
-#endif
-#if(~useAdcDMA)
-        AdcHandle.Init.NbrOfConversion       = 0;
-        AdcHandle.Init.DMAContinuousRequests = DISABLE;
-#endif
-        AdcHandle.Init.EOCSelection          = DISABLE;
-
-        if (HAL_ADC_Init(&AdcHandle) != HAL_OK)
-        {
-            /* ADC initialization Error */
-            // Error_Handler();
-            while(1)
-            {}
-        }
-
-        /*##-2- Configure ADC regular channel ######################################*/
         sConfig.Channel      = PIN_MAP[pin].adc_channel;
         sConfig.Rank         = 1;
         sConfig.SamplingTime = ADC_SAMPLETIME_3CYCLES;
@@ -174,47 +231,6 @@ int32_t analogRead(uint16_t pin)
             {}
         }
 
-#if(useAdcDMA)
-        /*##-3- Start the conversion process #######################################*/
-        /* Note: Considering IT occurring after each number of ADC conversions      */
-        /*       (IT by DMA end of transfer), select sampling time and ADC clock    */
-        /*       with sufficient duration to not create an overhead situation in    */
-        /*        IRQHandler. */
-        if(HAL_ADC_Start_DMA(&AdcHandle, (uint32_t*)&uhADCxConvertedValue, 1) != HAL_OK)
-        {
-            /* Start Conversation Error */
-            // Error_Handler();
-            while(1)
-            {}
-        }
-
-        /*##-3- Start the conversion process #######################################*/
-        if (HAL_ADC_Start(&AdcHandle) != HAL_OK)
-        {
-            /* Start Conversation Error */
-            Error_Handler();
-        }
-        /*##-4- Wait for the end of conversion #####################################*/
-        /*  Before starting a new conversion, you need to check the current state of
-            the peripheral; if it聮s busy you need to wait for the end of current
-            conversion before starting a new one.
-            For simplicity reasons, this example is just waiting till the end of the
-            conversion, but application may perform other tasks while conversion
-            operation is ongoing. */
-        if (HAL_ADC_PollForConversion(&AdcHandle, 10) != HAL_OK)
-        {
-            /* End Of Conversion flag not set on time */
-            Error_Handler();
-        }
-/* Check if the continuous conversion of regular channel is finished */
-        if ((HAL_ADC_GetState(&AdcHandle) & HAL_ADC_STATE_EOC_REG) == HAL_ADC_STATE_EOC_REG)
-        {
-            /*##-5- Get the converted value of regular channel  ########################*/
-            uhADCxConvertedValue = HAL_ADC_GetValue(&AdcHandle);
-        }
-#endif
-
-#if(~useAdcDMA)
         /*##-3- Start the conversion process #######################################*/
         if (HAL_ADC_Start(&AdcHandle) != HAL_OK)
         {
@@ -225,12 +241,6 @@ int32_t analogRead(uint16_t pin)
         }
 
         /*##-4- Wait for the end of conversion #####################################*/
-        /*  Before starting a new conversion, you need to check the current state of
-            the peripheral; if it聮s busy you need to wait for the end of current
-            conversion before starting a new one.
-            For simplicity reasons, this example is just waiting till the end of the
-            conversion, but application may perform other tasks while conversion
-            operation is ongoing. */
         if (HAL_ADC_PollForConversion(&AdcHandle, 10) != HAL_OK)
         {
             /* End Of Conversion flag not set on time */
@@ -245,8 +255,6 @@ int32_t analogRead(uint16_t pin)
             /*##-5- Get the converted value of regular channel  ########################*/
             uhADCxConvertedValue = HAL_ADC_GetValue(&AdcHandle);
         }
-#endif
-        // adcTinitFirstTime = false;
         return uhADCxConvertedValue;
 
     }
@@ -258,6 +266,286 @@ int32_t analogRead(uint16_t pin)
     }
 }
 
+/*********************************************************************************
+ *Function     : bool analogScanBegin(const uint16_t *pins, uint8_t count, uint32_t rate)
+ *Description  : 启动扫描引擎, 以 rate 帧/秒连续采样, 每帧依次转换 pins 中的引脚
+ *Input        : pins: 模拟引脚 A0-A7/PO188
+                 count: 引脚个数 1~ADC_SCAN_CHANNEL_MAX
+                 rate: 每秒帧数 1~ADC_SCAN_RATE_MAX
+ *Output       : none
+ *Return       : true: 成功  false: 参数错误或者引脚被占用
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : ADC1 只配置一次, TIM1 CC1 触发扫描, DMA2 Stream0 循环写入 ADC_SCAN_FRAMES 帧的缓冲
+                 已经运行时先停止再按新参数启动
+ **********************************************************************************/
+bool analogScanBegin(const uint16_t *pins, uint8_t count, uint32_t rate)
+{
+    if((count == 0) || (count > ADC_SCAN_CHANNEL_MAX) || (rate == 0) || (rate > ADC_SCAN_RATE_MAX))
+    {
+        return false;
+    }
+    analogScanEnd();
+    for(uint8_t i = 0; i < count; i++)
+    {
+        if(!analogPinInit(pins[i]))
+        {
+            return false;
+        }
+        AdcScanPins[i] = pins[i];
+    }
+
+    /*##-1- ADC1 扫描模式, TIM1 CC1 上升沿触发一帧 ###############################*/
+    AdcHandle.Instance = ADC1;
+
+    AdcHandle.Init.ClockPrescaler        = ADC_CLOCKPRESCALER_PCLK_DIV4;
+    AdcHandle.Init.Resolution            = ADC_RESOLUTION_12B;
+    AdcHandle.Init.ScanConvMode          = ENABLE;
+    AdcHandle.Init.ContinuousConvMode    = DISABLE;
+    AdcHandle.Init.DiscontinuousConvMode = DISABLE;
+    AdcHandle.Init.NbrOfDiscConversion   = 0;
+    AdcHandle.Init.ExternalTrigConvEdge  = ADC_EXTERNALTRIGCONVEDGE_RISING;
+    AdcHandle.Init.ExternalTrigConv      = ADC_EXTERNALTRIGCONV_T1_CC1;
+    AdcHandle.Init.DataAlign             = ADC_DATAALIGN_RIGHT;
+    AdcHandle.Init.NbrOfConversion       = count;
+    AdcHandle.Init.DMAContinuousRequests = ENABLE;
+    AdcHandle.Init.EOCSelection          = DISABLE;
+
+    ADC_DMA_Init(&AdcHandle);
+    if (HAL_ADC_Init(&AdcHandle) != HAL_OK)
+    {
+        return false;
+    }
+    adcInitFirstTime = true;    // analogRead 需要重新配置为单次转换
+
+    ADC_ChannelConfTypeDef sConfig;
+    for(uint8_t i = 0; i < count; i++)
+    {
+        sConfig.Channel      = PIN_MAP[pins[i]].adc_channel;
+        sConfig.Rank         = i + 1;
+        sConfig.SamplingTime = ADC_SAMPLETIME_56CYCLES;
+        sConfig.Offset       = 0;
+        if (HAL_ADC_ConfigChannel(&AdcHandle, &sConfig) != HAL_OK)
+        {
+            return false;
+        }
+    }
+
+    /*##-2- TIM1 以 rate 产生 CC1 事件 ###########################################*/
+    // APB2 分频时定时器时钟为 PCLK2 的2倍
+    uint32_t TIM_Clock = HAL_RCC_GetPCLK2Freq();
+    if((RCC->CFGR & RCC_CFGR_PPRE2) != 0)
+    {
+        TIM_Clock *= 2;
+    }
+    uint32_t TIM_Ticks = TIM_Clock / rate;
+    uint32_t TIM_Prescaler = TIM_Ticks / 0x10000;
+    uint32_t TIM_ARR = TIM_Ticks / (TIM_Prescaler + 1) - 1;
+
+    __HAL_RCC_TIM1_CLK_ENABLE();
+    AdcScanTimHandle.Instance               = TIM1;
+    AdcScanTimHandle.Init.Prescaler         = TIM_Prescaler;
+    AdcScanTimHandle.Init.Period            = TIM_ARR;
+    AdcScanTimHandle.Init.ClockDivision     = 0;
+    AdcScanTimHandle.Init.CounterMode       = TIM_COUNTERMODE_UP;
+    AdcScanTimHandle.Init.RepetitionCounter = 0;
+    if (HAL_TIM_PWM_Init(&AdcScanTimHandle) != HAL_OK)
+    {
+        return false;
+    }
+
+    // PA8 不配置为复用功能, CC1 只作为 ADC 触发
+    TIM_OC_InitTypeDef sConfigOC;
+    sConfigOC.OCMode       = TIM_OCMODE_PWM1;
+    sConfigOC.OCPolarity   = TIM_OCPOLARITY_HIGH;
+    sConfigOC.OCFastMode   = TIM_OCFAST_DISABLE;
+    sConfigOC.OCNPolarity  = TIM_OCNPOLARITY_HIGH;
+    sConfigOC.OCIdleState  = TIM_OCIDLESTATE_RESET;
+    sConfigOC.OCNIdleState = TIM_OCNIDLESTATE_RESET;
+    sConfigOC.Pulse        = (TIM_ARR + 1) / 2;
+    if (HAL_TIM_PWM_ConfigChannel(&AdcScanTimHandle, &sConfigOC, TIM_CHANNEL_1) != HAL_OK)
+    {
+        return false;
+    }
+
+    /*##-3- 启动 DMA 和定时器 #################################################*/
+    adc_ring_init(&AdcScanRing, AdcScanBuffer, count, ADC_SCAN_FRAMES);
+    if (HAL_ADC_Start_DMA(&AdcHandle, (uint32_t *)AdcScanBuffer, count * ADC_SCAN_FRAMES) != HAL_OK)
+    {
+        return false;
+    }
+    adcScanRunning = true;
+    if (HAL_TIM_PWM_Start(&AdcScanTimHandle, TIM_CHANNEL_1) != HAL_OK)
+    {
+        analogScanEnd();
+        return false;
+    }
+    return true;
+}
+
+/*********************************************************************************
+ *Function     : void analogScanEnd(void)
+ *Description  : 停止扫描引擎
+ *Input        : none
+ *Output       : none
+ *Return       : none
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 之后 analogRead 重新按单次转换初始化 ADC
+ **********************************************************************************/
+void analogScanEnd(void)
+{
+    if(!adcScanRunning)
+    {
+        return;
+    }
+    HAL_TIM_PWM_Stop(&AdcScanTimHandle, TIM_CHANNEL_1);
+    HAL_ADC_Stop_DMA(&AdcHandle);
+    HAL_NVIC_DisableIRQ(DMA2_Stream0_IRQn);
+    HAL_NVIC_DisableIRQ(ADC_IRQn);
+    adcScanRunning = false;
+    adcInitFirstTime = true;
+}
+
+// 任务中更新帧索引, 与 DMA 中断和溢出恢复互斥
+static void analogScanUpdate(void)
+{
+    HAL_NVIC_DisableIRQ(DMA2_Stream0_IRQn);
+    HAL_NVIC_DisableIRQ(ADC_IRQn);
+    adc_ring_update(&AdcScanRing, __HAL_DMA_GET_COUNTER(&AdcDmaHandle));
+    HAL_NVIC_EnableIRQ(ADC_IRQn);
+    HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+}
+
+/*********************************************************************************
+ *Function     : int32_t analogScanRead(uint16_t pin)
+ *Description  : 扫描引脚的最新采样, 不等待转换
+ *Input        : pin: analogScanBegin 中的引脚
+ *Output       : none
+ *Return       : 0-4095, 没有运行或者不是扫描的引脚返回 -1
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       :
+ **********************************************************************************/
+int32_t analogScanRead(uint16_t pin)
+{
+    if(!adcScanRunning)
+    {
+        return -1;
+    }
+    for(uint8_t i = 0; i < AdcScanRing.channels; i++)
+    {
+        if(AdcScanPins[i] == pin)
+        {
+            analogScanUpdate();
+            return adc_ring_latest(&AdcScanRing, i);
+        }
+    }
+    return -1;
+}
+
+/*********************************************************************************
+ *Function     : uint32_t analogScanAvailable(void)
+ *Description  : 还没有读取的帧数
+ *Input        : none
+ *Output       : none
+ *Return       : 帧数, 最多 ADC_SCAN_FRAMES - 1
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       :
+ **********************************************************************************/
+uint32_t analogScanAvailable(void)
+{
+    if(!adcScanRunning)
+    {
+        return 0;
+    }
+    analogScanUpdate();
+    return adc_ring_available(&AdcScanRing);
+}
+
+/*********************************************************************************
+ *Function     : uint32_t analogScanGetFrames(const volatile uint16_t **frames)
+ *Description  : 取连续的未读帧, 每帧按 analogScanBegin 的引脚顺序排列
+ *Input        : none
+ *Output       : frames: 第一帧
+ *Return       : 帧数, 0 表示没有新的帧
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 数据不复制, 处理完调用 analogScanReleaseFrames, 处理要在 DMA 写满缓冲之前完成
+ **********************************************************************************/
+uint32_t analogScanGetFrames(const volatile uint16_t **frames)
+{
+    if(!adcScanRunning)
+    {
+        return 0;
+    }
+    analogScanUpdate();
+    return adc_ring_peek(&AdcScanRing, frames);
+}
+
+void analogScanReleaseFrames(uint32_t count)
+{
+    if(adcScanRunning)
+    {
+        adc_ring_release(&AdcScanRing, count);
+    }
+}
+
+/*********************************************************************************
+ *Function     : uint32_t analogScanOverruns(void)
+ *Description  : 读取太慢被覆盖的帧数
+ *Input        : none
+ *Output       : none
+ *Return       : 帧数
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       :
+ **********************************************************************************/
+uint32_t analogScanOverruns(void)
+{
+    return AdcScanRing.overruns;
+}
+
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc)
+{
+    adc_ring_update(&AdcScanRing, __HAL_DMA_GET_COUNTER(hadc->DMA_Handle));
+}
+
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc)
+{
+    adc_ring_update(&AdcScanRing, __HAL_DMA_GET_COUNTER(hadc->DMA_Handle));
+}
+
+/*
+ * 溢出(OVR)或者 DMA 错误: ADC 停止发出 DMA 请求, 扫描不会自己恢复.
+ * HAL_ADC_IRQHandler 已清除 OVR, 这里按参考手册重新设置 DMA 并重新启动,
+ * 下一次 TIM1 触发从第 0 帧开始. 没有读取的帧丢弃, 计入 overruns.
+ * 不调用 HAL_ADC_Stop_DMA, 它在中断中等待 HAL_GetTick 超时.
+ */
+void HAL_ADC_ErrorCallback(ADC_HandleTypeDef* hadc)
+{
+    if(!adcScanRunning)
+    {
+        return;
+    }
+    adc_ring_update(&AdcScanRing, __HAL_DMA_GET_COUNTER(hadc->DMA_Handle));
+    uint32_t lost = AdcScanRing.overruns + adc_ring_available(&AdcScanRing);
+
+    hadc->Instance->CR2 &= ~ADC_CR2_DMA;
+    __HAL_ADC_CLEAR_FLAG(hadc, ADC_FLAG_OVR);
+    __HAL_DMA_DISABLE(hadc->DMA_Handle);
+    while(hadc->DMA_Handle->Instance->CR & DMA_SxCR_EN)
+    {}
+    /* 循环模式下 HAL_DMA_Start_IT 的锁不会释放 */
+    __HAL_UNLOCK(hadc->DMA_Handle);
+    hadc->ErrorCode = HAL_ADC_ERROR_NONE;
+
+    adc_ring_init(&AdcScanRing, AdcScanBuffer, AdcScanRing.channels, ADC_SCAN_FRAMES);
+    AdcScanRing.overruns = lost;
+    HAL_ADC_Start_DMA(hadc, (uint32_t *)AdcScanBuffer, AdcScanRing.size);
+}
+
 /*********************************************************************************
  *Function     : void analogWrite(uint16_t pin, uint8_t value)
  *Description  : Should take an integer 0-255 and create a PWM signal with a duty cycle from 0-100%.
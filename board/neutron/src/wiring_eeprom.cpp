@@ -24,59 +24,241 @@
  */
 
 /* Includes ------------------------------------------------------------------*/
+#include <string.h>
 #include "wiring_eeprom.h"
+#include "wiring_eeprom_hal.h"
 
-uint32_t SECTORError = 0;
 /*
-   TypeErase
-   Banks
-   Sector
-   NbSectors
-   VoltageRange
-   */
-static FLASH_EraseInitTypeDef EraseInit={FLASH_TYPEERASE_SECTORS,0,ID_ErasePAGE0,1,FLASH_VOLTAGE_RANGE_3};
+  页首半字为页状态, 之后每4字节一条记录: 低半字为数据, 高半字为虚拟地址
+  - 虚拟地址 < EEPROM_SIZE: 单字节记录, 数据低8位为该地址的值 (旧版本写入的格式, 只读)
+  - 虚拟地址 EEPROM_PAIR_FLAG|偶地址: 双字节记录, 数据低/高8位为 地址/地址+1 的值, 一次按字写入
+  同一地址以页中靠后的记录为准, 没有记录的地址读出0xFF.
+  启动时按顺序回放有效页, 建立内存镜像 EepromShadow 和下一条空记录的位置,
+  之后读取直接取镜像, 写入跳过未改变的字节, 只在空记录处追加, 不再扫描整页.
+  页满时把镜像中不为0xFF的字节整体搬到另一页 (最多 EEPROM_SIZE/2 条记录, 不超过半页)
+*/
+#define EEPROM_PAIR_FLAG        ((uint16_t)0x8000)
+#define EEPROM_RECORD_START     ((uint32_t)4)        /* 第一条记录的页内偏移, 之前为页状态 */
+#define EEPROM_RECORD_SIZE      ((uint32_t)4)
+#define EEPROM_RECORD_ERASED    ((uint32_t)0xFFFFFFFF)
 
+static uint8_t EepromShadow[EEPROM_SIZE];
+static uint16_t EepromValidPage = NO_VALID_PAGE;    /* 读写使用的页 */
+static uint32_t EepromWriteOffset = 0;              /* 有效页中下一条空记录的偏移 */
 
+static uint16_t EEPROM_Format(void);
+static uint16_t EEPROM_PageTransfer(void);
 
-/* Global variable used to store variable value in read sequence */
-uint16_t EepromDataVar = 0;
+static uint16_t EEPROM_PageStatus(uint16_t Page)
+{
+    return (uint16_t)EEPROM_FlashRead_hal(Page, 0);
+}
 
-/* Virtual address defined by the user: 0xFFFF value is prohibited */
-static uint16_t EepromAddressTab[EEPROM_SIZE];
+static uint16_t EEPROM_OtherPage(uint16_t Page)
+{
+    return (Page == PAGE0) ? PAGE1 : PAGE0;
+}
 
-static FLASH_Status EEPROM_Format(void);
-static uint16_t EEPROM_FindValidPage(uint8_t Operation);
-static uint16_t EEPROM_VerifyPageFullWriteVariable(uint16_t EepromAddress, uint16_t EepromData);
-static uint16_t EEPROM_PageTransfer(uint16_t EepromAddress, uint16_t EepromData);
+static uint16_t EEPROM_SetPageStatus(uint16_t Page, uint16_t Status)
+{
+    return EEPROM_FlashProgramHalfWord_hal(Page, 0, Status) ? FLASH_ERROR_PROGRAM_ : FLASH_COMPLETE;
+}
 
+/*********************************************************************************
+ *Function		: static uint16_t EEPROM_ErasePage(uint16_t Page)
+ *Description	: erase Page unless it is blank already
+ *Input		: Page: PAGE0 or PAGE1
+ *Output		: none
+ *Return		: FLASH_COMPLETE or a flash error code
+ *author		: robot
+ *date			: 2016-05-20
+ *Others		: a sector erase takes hundreds of ms and wears the flash, the spare page is normally blank at boot
+ **********************************************************************************/
+static uint16_t EEPROM_ErasePage(uint16_t Page)
+{
+    for (uint32_t Offset = 0; Offset < PAGE_SIZE; Offset += EEPROM_RECORD_SIZE)
+    {
+        if (EEPROM_FlashRead_hal(Page, Offset) != EEPROM_RECORD_ERASED)
+        {
+            return EEPROM_FlashErase_hal(Page) ? FLASH_ERROR_OPERATION_ : FLASH_COMPLETE;
+        }
+    }
+    return FLASH_COMPLETE;
+}
+
+/*********************************************************************************
+ *Function		: static uint32_t EEPROM_ReplayPage(uint16_t Page)
+ *Description	: apply the records of Page to EepromShadow in the order they were written
+ *Input		: Page: PAGE0 or PAGE1
+ *Output		: none
+ *Return		: offset of the first blank record (PAGE_SIZE if the page is full)
+ *author		: robot
+ *date			: 2016-05-20
+ *Others		: records are appended, so the first blank word ends the page. a half written
+ *                  record of the old format (address still 0xFFFF) is skipped.
+ **********************************************************************************/
+static uint32_t EEPROM_ReplayPage(uint16_t Page)
+{
+    uint32_t Offset;
+
+    for (Offset = EEPROM_RECORD_START; Offset < PAGE_SIZE; Offset += EEPROM_RECORD_SIZE)
+    {
+        uint32_t Record = EEPROM_FlashRead_hal(Page, Offset);
+        if (Record == EEPROM_RECORD_ERASED)
+        {
+            break;
+        }
+        uint16_t EepromAddress = (uint16_t)(Record >> 16), EepromData = (uint16_t)Record;
+        if (EepromAddress & EEPROM_PAIR_FLAG)
+        {
+            EepromAddress &= ~EEPROM_PAIR_FLAG;
+            if (!(EepromAddress & 1) && (EepromAddress < EEPROM_SIZE))
+            {
+                EepromShadow[EepromAddress] = (uint8_t)EepromData;
+                EepromShadow[EepromAddress + 1] = (uint8_t)(EepromData >> 8);
+            }
+        }
+        else if (EepromAddress < EEPROM_SIZE)
+        {
+            EepromShadow[EepromAddress] = (uint8_t)EepromData;
+        }
+    }
+    return Offset;
+}
+
+/*********************************************************************************
+ *Function		: static uint16_t EEPROM_WritePair(uint16_t Page, uint32_t *Offset, uint16_t EepromAddress)
+ *Description	: append the shadow bytes EepromAddress/EepromAddress+1 as one record
+ *Input		: Offset: blank record to use, advanced on success   EepromAddress: even address
+ *Output		: none
+ *Return		: FLASH_COMPLETE, PAGE_FULL or a flash error code
+ *author		: robot
+ *date			: 2016-05-20
+ *Others		: none
+ **********************************************************************************/
+static uint16_t EEPROM_WritePair(uint16_t Page, uint32_t *Offset, uint16_t EepromAddress)
+{
+    if (*Offset > PAGE_SIZE - EEPROM_RECORD_SIZE)
+    {
+        return PAGE_FULL;
+    }
+    uint32_t Record = ((uint32_t)(EEPROM_PAIR_FLAG | EepromAddress) << 16)
+                      | ((uint32_t)EepromShadow[EepromAddress + 1] << 8) | EepromShadow[EepromAddress];
+    if (EEPROM_FlashProgramWord_hal(Page, *Offset, Record))
+    {
+        return FLASH_ERROR_PROGRAM_;
+    }
+    *Offset += EEPROM_RECORD_SIZE;
+    return FLASH_COMPLETE;
+}
+
+//镜像中不全为0xFF的地址对个数, 即搬页需要的记录数
+static uint32_t EEPROM_ShadowRecords(void)
+{
+    uint32_t Records = 0;
+
+    for (uint16_t EepromAddress = 0; EepromAddress < EEPROM_SIZE; EepromAddress += 2)
+    {
+        if ((EepromShadow[EepromAddress] & EepromShadow[EepromAddress + 1]) != 0xFF)
+        {
+            Records++;
+        }
+    }
+    return Records;
+}
+
+//把镜像写入 Page 从 *Offset 开始的空记录
+static uint16_t EEPROM_WriteShadow(uint16_t Page, uint32_t *Offset)
+{
+    uint16_t Status;
+
+    for (uint16_t EepromAddress = 0; EepromAddress < EEPROM_SIZE; EepromAddress += 2)
+    {
+        if ((EepromShadow[EepromAddress] & EepromShadow[EepromAddress + 1]) != 0xFF)
+        {
+            Status = EEPROM_WritePair(Page, Offset, EepromAddress);
+            if (Status != FLASH_COMPLETE)
+            {
+                return Status;
+            }
+        }
+    }
+    return FLASH_COMPLETE;
+}
+
+/*********************************************************************************
+ *Function		: static uint16_t EEPROM_FinishTransfer(uint16_t OldPage, uint16_t NewPage, uint32_t Offset)
+ *Description	: copy the shadow into NewPage (marked RECEIVE_DATA), erase OldPage, then mark NewPage valid
+ *Input		: Offset: first blank record of NewPage
+ *Output		: none
+ *Return		: FLASH_COMPLETE or a flash error code
+ *author		: robot
+ *date			: 2016-05-20
+ *Others		: a power loss at any step leaves either OldPage valid or NewPage receiving with
+ *                  every value, EEPROM_Init finishes the transfer
+ **********************************************************************************/
+static uint16_t EEPROM_FinishTransfer(uint16_t OldPage, uint16_t NewPage, uint32_t Offset)
+{
+    uint16_t Status;
+
+    //未完成的搬页又被打断时, 接收页剩余空间可能不够再写一遍
+    if ((PAGE_SIZE - Offset) / EEPROM_RECORD_SIZE < EEPROM_ShadowRecords())
+    {
+        if (EEPROM_FlashErase_hal(NewPage))
+        {
+            return FLASH_ERROR_OPERATION_;
+        }
+        Status = EEPROM_SetPageStatus(NewPage, RECEIVE_DATA);
+        if (Status != FLASH_COMPLETE)
+        {
+            return Status;
+        }
+        Offset = EEPROM_RECORD_START;
+    }
+    Status = EEPROM_WriteShadow(NewPage, &Offset);
+    if (Status != FLASH_COMPLETE)
+    {
+        return Status;
+    }
+    if (EEPROM_FlashErase_hal(OldPage))
+    {
+        return FLASH_ERROR_OPERATION_;
+    }
+    Status = EEPROM_SetPageStatus(NewPage, VALID_PAGE);
+    if (Status != FLASH_COMPLETE)
+    {
+        return Status;
+    }
+    EepromValidPage = NewPage;
+    EepromWriteOffset = Offset;
+    return FLASH_COMPLETE;
+}
 
 /*********************************************************************************
  *Function		: uint16_t EEPROM_Init(void)
- *Description	: Restore the pages to a known good state in case of page's status corruption after a power loss.
+ *Description	: Restore the pages to a known good state in case of page's status corruption after a power loss,
+ *                  then load the valid page into the RAM shadow.
  *Input		: none
  *Output		: none
- *Return		: none
+ *Return		: FLASH_COMPLETE or a flash error code
  *author		: lz
  *date			: 2015-2-1
  *Others		: none
  **********************************************************************************/
 uint16_t EEPROM_Init(void)
 {
-    uint16_t PageStatus0 = 6, PageStatus1 = 6;
-    uint16_t EepromAddressIdx = 0;
-    uint16_t EepromStatus = 0, ReadStatus = 0;
-    int16_t x = -1;
-    uint16_t  FlashStatus;
+    uint16_t PageStatus0, PageStatus1;
+    uint16_t FlashStatus = FLASH_COMPLETE;
 
     /* Unlock the Flash Program Erase controller */
-    HAL_FLASH_Unlock();
-    //FLASH_Unlock();
-
+    EEPROM_FlashUnlock_hal();
+    EepromValidPage = NO_VALID_PAGE;
+    memset(EepromShadow, 0xFF, sizeof(EepromShadow));
 
     /* Get Page0 status */
-    PageStatus0 = (*(__IO uint16_t*)PAGE0_BASE_ADDRESS);
+    PageStatus0 = EEPROM_PageStatus(PAGE0);
     /* Get Page1 status */
-    PageStatus1 = (*(__IO uint16_t*)PAGE1_BASE_ADDRESS);
+    PageStatus1 = EEPROM_PageStatus(PAGE1);
 
     /* Check for invalid header states and repair if necessary */
     switch (PageStatus0)
@@ -84,325 +266,169 @@ uint16_t EEPROM_Init(void)
         case ERASED:
             if (PageStatus1 == VALID_PAGE) /* Page0 erased, Page1 valid */
             {
-                /* Erase Page0 */
-                EraseInit.Sector=ID_ErasePAGE0;
-                EraseInit.VoltageRange=FLASH_VOLTAGE_RANGE_3;
-
-                HAL_FLASHEx_Erase(&EraseInit,&SECTORError);
-                FlashStatus=FLASH_COMPLETE;
-#if 0
-                FlashStatus = FLASH_EraseSector(ID_ErasePAGE0,VoltageRange_3);
-                /* If erase operation was failed, a Flash error code is returned */
-                if (FlashStatus != FLASH_COMPLETE)
-                {
-                    return FlashStatus;
-                }
-#endif
+                FlashStatus = EEPROM_ErasePage(PAGE0);
+                EepromValidPage = PAGE1;
             }
-            else if (PageStatus1 == RECEIVE_DATA) /* Page0 erased, Page1 receive */
+            else if (PageStatus1 == RECEIVE_DATA) /* Page0 erased, Page1 receive: transfer done, mark Page1 as valid */
             {
-                /* Erase Page0 */
-                EraseInit.Sector=ID_ErasePAGE0;
-                EraseInit.VoltageRange=FLASH_VOLTAGE_RANGE_3;
-                HAL_FLASHEx_Erase(&EraseInit,&SECTORError);
-
-                FlashStatus=FLASH_COMPLETE;
-#if 0
-                FlashStatus = FLASH_EraseSector(ID_ErasePAGE0,VoltageRange_3);
-                /* If erase operation was failed, a Flash error code is returned */
-                if (FlashStatus != FLASH_COMPLETE)
+                FlashStatus = EEPROM_ErasePage(PAGE0);
+                if (FlashStatus == FLASH_COMPLETE)
                 {
-                    return FlashStatus;
+                    FlashStatus = EEPROM_SetPageStatus(PAGE1, VALID_PAGE);
                 }
-#endif
-
-                /* Mark Page1 as valid */
-
-                HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD,PAGE1_BASE_ADDRESS,VALID_PAGE);
-                FlashStatus=FLASH_COMPLETE;
-#if 0
-                FlashStatus = FLASH_ProgramHalfWord(PAGE1_BASE_ADDRESS, VALID_PAGE);
-                /* If program operation was failed, a Flash error code is returned */
-                if (FlashStatus != FLASH_COMPLETE)
-                {
-                    return FlashStatus;
-                }
-#endif
+                EepromValidPage = PAGE1;
             }
             else /* First EEPROM access (Page0&1 are erased) or invalid state -> format EEPROM */
             {
-                /* Erase both Page0 and Page1 and set Page0 as valid page */
                 FlashStatus = EEPROM_Format();
-                /* If erase/program operation was failed, a Flash error code is returned */
-                if (FlashStatus != FLASH_COMPLETE)
-                {
-                    return FlashStatus;
-                }
             }
             break;
 
         case RECEIVE_DATA:
-            if (PageStatus1 == VALID_PAGE) /* Page0 receive, Page1 valid */
+            if (PageStatus1 == VALID_PAGE) /* Page0 receive, Page1 valid: finish the transfer from Page1 to Page0 */
             {
-                /* Transfer data from Page1 to Page0 */
-                for (EepromAddressIdx = 0; EepromAddressIdx < EEPROM_SIZE; EepromAddressIdx++)
-                {
-                    if (( *(__IO uint16_t*)(PAGE0_BASE_ADDRESS + 6)) == EepromAddressTab[EepromAddressIdx])
-                    {
-                        x = EepromAddressIdx;
-                    }
-                    if (EepromAddressIdx != x)
-                    {
-                        /* Read the last variables' updates */
-                        ReadStatus = EEPROM_ReadVariable(EepromAddressTab[EepromAddressIdx], &EepromDataVar);
-                        /* In case variable corresponding to the virtual address was found */
-                        if (ReadStatus != 0x1)
-                        {
-                            /* Transfer the variable to the Page0 */
-                            EepromStatus = EEPROM_VerifyPageFullWriteVariable(EepromAddressTab[EepromAddressIdx], EepromDataVar);
-                            /* If program operation was failed, a Flash error code is returned */
-                            if (EepromStatus != FLASH_COMPLETE)
-                            {
-                                return EepromStatus;
-                            }
-                        }
-                    }
-                }
-                /* Mark Page0 as valid */
-                HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD,PAGE0_BASE_ADDRESS,VALID_PAGE);
-                FlashStatus=FLASH_COMPLETE;
-
-#if 0
-                FlashStatus = FLASH_ProgramHalfWord(PAGE0_BASE_ADDRESS, VALID_PAGE);
-                /* If program operation was failed, a Flash error code is returned */
-                if (FlashStatus != FLASH_COMPLETE)
-                {
-                    return FlashStatus;
-                }
-#endif
-
-                FLASH_Erase_Sector(ID_ErasePAGE1,FLASH_VOLTAGE_RANGE_3);
-                FlashStatus=FLASH_COMPLETE;
-#if 0
-                /* Erase Page1 */
-                FlashStatus = FLASH_EraseSector(ID_ErasePAGE1,VoltageRange_3);
-                /* If erase operation was failed, a Flash error code is returned */
-                if (FlashStatus != FLASH_COMPLETE)
-                {
-                    return FlashStatus;
-                }
-#endif
-
+                EEPROM_ReplayPage(PAGE1);
+                FlashStatus = EEPROM_FinishTransfer(PAGE1, PAGE0, EEPROM_ReplayPage(PAGE0));
             }
-            else if (PageStatus1 == ERASED) /* Page0 receive, Page1 erased */
+            else if (PageStatus1 == ERASED) /* Page0 receive, Page1 erased: transfer done, mark Page0 as valid */
             {
-                /* Erase Page1 */
-                EraseInit.Sector=ID_ErasePAGE1;
-                EraseInit.VoltageRange=FLASH_VOLTAGE_RANGE_3;
-                HAL_FLASHEx_Erase(&EraseInit,&SECTORError);
-
-                FlashStatus=FLASH_COMPLETE;
-#if 0
-                FlashStatus =FLASH_EraseSector(ID_ErasePAGE1,VoltageRange_3);
-                /* If erase operation was failed, a Flash error code is returned */
-                if (FlashStatus != FLASH_COMPLETE)
-                {
-                    return FlashStatus;
-                }
-#endif
-
-                /* Mark Page0 as valid */
-                HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD,PAGE0_BASE_ADDRESS,VALID_PAGE);
-                FlashStatus=FLASH_COMPLETE;
-
-#if 0
-                FlashStatus = FLASH_ProgramHalfWord(PAGE0_BASE_ADDRESS, VALID_PAGE);
-                /* If program operation was failed, a Flash error code is returned */
-                if (FlashStatus != FLASH_COMPLETE)
+                FlashStatus = EEPROM_ErasePage(PAGE1);
+                if (FlashStatus == FLASH_COMPLETE)
                 {
-                    return FlashStatus;
+                    FlashStatus = EEPROM_SetPageStatus(PAGE0, VALID_PAGE);
                 }
-#endif
-
+                EepromValidPage = PAGE0;
             }
             else /* Invalid state -> format eeprom */
             {
-                /* Erase both Page0 and Page1 and set Page0 as valid page */
                 FlashStatus = EEPROM_Format();
-                /* If erase/program operation was failed, a Flash error code is returned */
-                if (FlashStatus != FLASH_COMPLETE)
-                {
-                    return FlashStatus;
-                }
             }
             break;
+
         case VALID_PAGE:
             if (PageStatus1 == VALID_PAGE) /* Invalid state -> format eeprom */
             {
-                /* Erase both Page0 and Page1 and set Page0 as valid page */
                 FlashStatus = EEPROM_Format();
-                /* If erase/program operation was failed, a Flash error code is returned */
-                if (FlashStatus != FLASH_COMPLETE)
-                {
-                    return FlashStatus;
-                }
             }
             else if (PageStatus1 == ERASED) /* Page0 valid, Page1 erased */
             {
-                /* Erase Page1 */
-                EraseInit.Sector=ID_ErasePAGE1;
-                EraseInit.VoltageRange=FLASH_VOLTAGE_RANGE_3;
-                HAL_FLASHEx_Erase(&EraseInit,&SECTORError);
-
-                FlashStatus=FLASH_COMPLETE;
-#if 0
-                FlashStatus =FLASH_EraseSector(ID_ErasePAGE1,VoltageRange_3);
-                /* If erase operation was failed, a Flash error code is returned */
-                if (FlashStatus != FLASH_COMPLETE)
-                {
-                    return FlashStatus;
-                }
-#endif
+                FlashStatus = EEPROM_ErasePage(PAGE1);
+                EepromValidPage = PAGE0;
             }
-            else /* Page0 valid, Page1 receive */
+            else /* Page0 valid, Page1 receive: finish the transfer from Page0 to Page1 */
             {
-                /* Transfer data from Page0 to Page1 */
-                for (EepromAddressIdx = 0; EepromAddressIdx < EEPROM_SIZE; EepromAddressIdx++)
-                {
-                    if ((*(__IO uint16_t*)(PAGE1_BASE_ADDRESS + 6)) == EepromAddressTab[EepromAddressIdx])
-                    {
-                        x = EepromAddressIdx;
-                    }
-                    if (EepromAddressIdx != x)
-                    {
-                        /* Read the last variables' updates */
-                        ReadStatus = EEPROM_ReadVariable(EepromAddressTab[EepromAddressIdx], &EepromDataVar);
-                        /* In case variable corresponding to the virtual address was found */
-                        if (ReadStatus != 0x1)
-                        {
-                            /* Transfer the variable to the Page1 */
-                            EepromStatus = EEPROM_VerifyPageFullWriteVariable(EepromAddressTab[EepromAddressIdx], EepromDataVar);
-                            /* If program operation was failed, a Flash error code is returned */
-                            if (EepromStatus != FLASH_COMPLETE)
-                            {
-                                return EepromStatus;
-                            }
-                        }
-                    }
-                }
-
-
-                HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD,PAGE1_BASE_ADDRESS,VALID_PAGE);
-                FlashStatus=FLASH_COMPLETE;
-
-
-#if 0
-                /* Mark Page1 as valid */
-                FlashStatus = FLASH_ProgramHalfWord(PAGE1_BASE_ADDRESS, VALID_PAGE);
-                /* If program operation was failed, a Flash error code is returned */
-                if (FlashStatus != FLASH_COMPLETE)
-                {
-                    return FlashStatus;
-                }
-#endif
-
-                /* Erase Page0 */
-                EraseInit.Sector=ID_ErasePAGE0;
-                EraseInit.VoltageRange=FLASH_VOLTAGE_RANGE_3;
-                HAL_FLASHEx_Erase(&EraseInit,&SECTORError);
-
-                FlashStatus=FLASH_COMPLETE;
-#if 0
-                FlashStatus =FLASH_EraseSector(ID_ErasePAGE0,VoltageRange_3);
-                /* If erase operation was failed, a Flash error code is returned */
-                if (FlashStatus != FLASH_COMPLETE)
-                {
-                    return FlashStatus;
-                }
-#endif
+                EEPROM_ReplayPage(PAGE0);
+                FlashStatus = EEPROM_FinishTransfer(PAGE0, PAGE1, EEPROM_ReplayPage(PAGE1));
             }
             break;
+
         default:  /* Any other state -> format eeprom */
-            /* Erase both Page0 and Page1 and set Page0 as valid page */
             FlashStatus = EEPROM_Format();
-            /* If erase/program operation was failed, a Flash error code is returned */
-            if (FlashStatus != FLASH_COMPLETE)
-            {
-                return FlashStatus;
-            }
             break;
     }
+
+    if (FlashStatus != FLASH_COMPLETE)
+    {
+        EepromValidPage = NO_VALID_PAGE;
+        return FlashStatus;
+    }
+    memset(EepromShadow, 0xFF, sizeof(EepromShadow));
+    EepromWriteOffset = EEPROM_ReplayPage(EepromValidPage);
     return FLASH_COMPLETE;
 }
 
 /*********************************************************************************
  *Function		: uint16_t EEPROM_ReadVariable(uint16_t EepromAddress, uint16_t *EepromData)
- *Description	: Returns the last stored variable data, if found, which correspond to the passed virtual address
+ *Description	: Returns the last stored value of the byte at the passed virtual address
  *Input		: EepromAddress: Variable virtual address
 EepromData: Global variable contains the read variable value
  *Output		: none
  *Return		:  Success or error status:
  - 0: if variable was found
- - 1: if the variable was not found
+ - 1: if the variable was not found (reads as 0xFF)
  - NO_VALID_PAGE: if no valid page was found.
  *author		: lz
  *date			: 2015-2-1
- *Others		: none
+ *Others		: served from the RAM shadow
  **********************************************************************************/
 uint16_t EEPROM_ReadVariable(uint16_t EepromAddress, uint16_t *EepromData)
 {
-    uint16_t ValidPage = PAGE0;
-    uint16_t AddressValue = 0, ReadStatus = 1;
-    uint32_t Address = PAGE0_BASE_ADDRESS, PageStartAddress = PAGE0_BASE_ADDRESS;
+    if (EepromValidPage == NO_VALID_PAGE)
+    {
+        return  NO_VALID_PAGE;
+    }
+    if (EepromAddress >= EEPROM_SIZE)
+    {
+        return 1;
+    }
+    *EepromData = EepromShadow[EepromAddress];
+    return (*EepromData == 0xFF) ? 1 : 0;
+}
 
-    /* Get active Page for read operation */
-    ValidPage = EEPROM_FindValidPage(READ_FROM_VALID_PAGE);
+/*********************************************************************************
+ *Function		: uint16_t EEPROM_WriteBlock(uint16_t EepromAddress, const uint8_t *EepromData, uint16_t Length)
+ *Description	: Writes/upadtes Length bytes in EEPROM.
+ *Input		: EepromAddress: virtual address of the first byte
+EepromData: bytes to be written
+ *Output		: none
+ *Return		: Success or error status:
+ *                 - FLASH_COMPLETE: on success
+ *                 - NO_VALID_PAGE: if no valid page was found
+ *                 - Flash error code: on write Flash error
+ *author		: robot
+ *date			: 2016-05-20
+ *Others		: unchanged bytes are skipped, changed ones are programmed two per record (one word)
+ **********************************************************************************/
+uint16_t EEPROM_WriteBlock(uint16_t EepromAddress, const uint8_t *EepromData, uint16_t Length)
+{
+    uint16_t Status = FLASH_COMPLETE;
+    uint32_t End = (uint32_t)EepromAddress + Length;
 
-    /* Check if there is no valid page */
-    if (ValidPage == NO_VALID_PAGE)
+    if (EepromValidPage == NO_VALID_PAGE)
     {
         return  NO_VALID_PAGE;
     }
+    if (End > EEPROM_SIZE)
+    {
+        End = EEPROM_SIZE;
+    }
 
-    /* Get the valid Page start Address */
-    PageStartAddress = (uint32_t)(EEPROM_START_ADDRESS + (uint32_t)(ValidPage * PAGE_SIZE));
-
-    /* Get the valid Page end Address */
-    Address = (uint32_t)((EEPROM_START_ADDRESS - 2) + (uint32_t)((1 + ValidPage) * PAGE_SIZE));
+    /* Unlock the Flash Program Erase controller */
+    EEPROM_FlashUnlock_hal();
 
-    /* Check each active page address starting from end */
-    while (Address > (PageStartAddress + 2))
+    for (uint32_t Address = EepromAddress & ~1; Address < End; Address += 2)
     {
-        /* Get the current location content to be compared with virtual address */
-        AddressValue = (*(__IO uint16_t*)Address);
-        /* Compare the read address with the virtual address */
-        if (AddressValue == EepromAddress)
+        uint8_t Low = (Address >= EepromAddress) ? EepromData[Address - EepromAddress] : EepromShadow[Address];
+        uint8_t High = (Address + 1 < End) ? EepromData[Address + 1 - EepromAddress] : EepromShadow[Address + 1];
+
+        if ((Low == EepromShadow[Address]) && (High == EepromShadow[Address + 1]))
         {
-            /* Get content of Address-2 which is variable value */
-            *EepromData = (*(__IO uint16_t*)(Address - 2));
-            /* In case variable value is read, reset ReadStatus flag */
-            ReadStatus = 0;
-            break;
+            continue;
         }
-        else
+        EepromShadow[Address] = Low;
+        EepromShadow[Address + 1] = High;
+        Status = EEPROM_WritePair(EepromValidPage, &EepromWriteOffset, Address);
+        /* In case the EEPROM active page is full, the transfer copies the shadow with this pair */
+        if (Status == PAGE_FULL)
         {
-            /* Next address location */
-            Address = Address - 4;
+            Status = EEPROM_PageTransfer();
+        }
+        if (Status != FLASH_COMPLETE)
+        {
+            return Status;
         }
     }
-    /* Return ReadStatus value: (0: variable exist, 1: variable doesn't exist) */
-    return ReadStatus;
+    return Status;
 }
 
 /*********************************************************************************
  *Function		: uint16_t EEPROM_WriteVariable(uint16_t EepromAddress, uint16_t EepromData)
  *Description	: Writes/upadtes variable data in EEPROM.
  *Input		: EepromAddress: Variable virtual address
-EepromData: 16 bit data to be written
+EepromData: the low 8 bits are written
  *Output		: none
  *Return		: Success or error status:
  *                 - FLASH_COMPLETE: on success
- *                 - PAGE_FULL: if valid page is full
  *                 - NO_VALID_PAGE: if no valid page was found
  *                 - Flash error code: on write Flash error
  *author		: lz
@@ -411,28 +437,13 @@ EepromData: 16 bit data to be written
  **********************************************************************************/
 uint16_t EEPROM_WriteVariable(uint16_t EepromAddress, uint16_t EepromData)
 {
-    uint16_t Status = 0;
+    uint8_t Data = (uint8_t)EepromData;
 
-    /* Unlock the Flash Program Erase controller */
-    //FLASH_Unlock();
-    HAL_FLASH_Unlock();
-
-    /* Write the variable virtual address and value in the EEPROM */
-    Status = EEPROM_VerifyPageFullWriteVariable(EepromAddress, EepromData);
-
-    /* In case the EEPROM active page is full */
-    if (Status == PAGE_FULL)
-    {
-        /* Perform Page transfer */
-        Status = EEPROM_PageTransfer(EepromAddress, EepromData);
-    }
-
-    /* Return last operation status */
-    return Status;
+    return EEPROM_WriteBlock(EepromAddress, &Data, 1);
 }
 
 /*********************************************************************************
- *Function		: static FLASH_Status EEPROM_Format(void)
+ *Function		: static uint16_t EEPROM_Format(void)
  *Description	: Erases PAGE0 and PAGE1 and writes VALID_PAGE header to PAGE0
  *Input		: none
  *Output		: none
@@ -442,351 +453,67 @@ uint16_t EEPROM_WriteVariable(uint16_t EepromAddress, uint16_t EepromData)
  *date			: 2015-2-1
  *Others		: none
  **********************************************************************************/
-static FLASH_Status EEPROM_Format(void)
+static uint16_t EEPROM_Format(void)
 {
-    FLASH_Status FlashStatus = FLASH_COMPLETE;
+    uint16_t FlashStatus;
 
     /* Erase Page0 */
-    EraseInit.Sector=ID_ErasePAGE0;
-    EraseInit.VoltageRange=FLASH_VOLTAGE_RANGE_3;
-    HAL_FLASHEx_Erase(&EraseInit,&SECTORError);
-
-    FlashStatus=FLASH_COMPLETE;
-#if 0
-    FlashStatus = FLASH_EraseSector(ID_ErasePAGE0,VoltageRange_3);
-
-    /* If erase operation was failed, a Flash error code is returned */
+    FlashStatus = EEPROM_ErasePage(PAGE0);
     if (FlashStatus != FLASH_COMPLETE)
     {
         return FlashStatus;
     }
-#endif
-
-
 
     /* Set Page0 as valid page: Write VALID_PAGE at Page0 base address */
-
-    HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD,PAGE0_BASE_ADDRESS,VALID_PAGE);
-    FlashStatus=FLASH_COMPLETE;
-
-#if 0
-    FlashStatus = FLASH_ProgramHalfWord(PAGE0_BASE_ADDRESS, VALID_PAGE);
-
-    /* If program operation was failed, a Flash error code is returned */
+    FlashStatus = EEPROM_SetPageStatus(PAGE0, VALID_PAGE);
     if (FlashStatus != FLASH_COMPLETE)
     {
         return FlashStatus;
     }
-#endif
 
     /* Erase Page1 */
-
-    EraseInit.Sector=ID_ErasePAGE1;
-    EraseInit.VoltageRange=FLASH_VOLTAGE_RANGE_3;
-    HAL_FLASHEx_Erase(&EraseInit,&SECTORError);
-
-    FlashStatus=FLASH_COMPLETE;
-#if 0
-    FlashStatus =FLASH_EraseSector(ID_ErasePAGE1,VoltageRange_3);
-#endif
+    FlashStatus = EEPROM_ErasePage(PAGE1);
+    EepromValidPage = PAGE0;
 
     /* Return Page1 erase operation status */
     return FlashStatus;
-
 }
 
-
 /*********************************************************************************
- *Function		: static uint16_t EEPROM_FindValidPage(uint8_t Operation)
- *Description	: Find valid Page for write or read operation
- *Input		: Operation: operation to achieve on the valid page.
- *Output		: none
- *Return		: This parameter can be one of the following values:
- *               @arg READ_FROM_VALID_PAGE: read operation from valid page
- *               @arg WRITE_IN_VALID_PAGE: write operation from valid page
- *               @retval Valid page number (PAGE0 or PAGE1) or NO_VALID_PAGE in case
- *                 of no valid page was found
- *author		: lz
- *date			: 2015-2-1
- *Others		: none
- **********************************************************************************/
-static uint16_t EEPROM_FindValidPage(uint8_t Operation)
-{
-    uint16_t PageStatus0 = 6, PageStatus1 = 6;
-
-    /* Get Page0 actual status */
-    PageStatus0 = (*(__IO uint16_t*)PAGE0_BASE_ADDRESS);
-
-    /* Get Page1 actual status */
-    PageStatus1 = (*(__IO uint16_t*)PAGE1_BASE_ADDRESS);
-
-    /* Write or read operation */
-    switch (Operation)
-    {
-        case WRITE_IN_VALID_PAGE:   /* ---- Write operation ---- */
-            if (PageStatus1 == VALID_PAGE)
-            {
-                /* Page0 receiving data */
-                if (PageStatus0 == RECEIVE_DATA)
-                {
-                    return PAGE0;         /* Page0 valid */
-                }
-                else
-                {
-                    return PAGE1;         /* Page1 valid */
-                }
-            }
-            else if (PageStatus0 == VALID_PAGE)
-            {
-                /* Page1 receiving data */
-                if (PageStatus1 == RECEIVE_DATA)
-                {
-                    return PAGE1;         /* Page1 valid */
-                }
-                else
-                {
-                    return PAGE0;         /* Page0 valid */
-                }
-            }
-            else
-            {
-                return NO_VALID_PAGE;   /* No valid Page */
-            }
-
-        case READ_FROM_VALID_PAGE:  /* ---- Read operation ---- */
-            if (PageStatus0 == VALID_PAGE)
-            {
-                return PAGE0;           /* Page0 valid */
-            }
-            else if (PageStatus1 == VALID_PAGE)
-            {
-                return PAGE1;           /* Page1 valid */
-            }
-            else
-            {
-                return NO_VALID_PAGE ;  /* No valid Page */
-            }
-
-        default:
-            return PAGE0;             /* Page0 valid */
-    }
-}
-
-
-/*********************************************************************************
- *Function		: static uint16_t EEPROM_VerifyPageFullWriteVariable(uint16_t EepromAddress, uint16_t EepromData)
- *Description	: Verify if active page is full and Writes variable in EEPROM.
- *Input		: EepromAddress: 16 bit virtual address of the variable
-EepromData: 16 bit data to be written as variable value
- *Output		: none
- *Return		:   * @retval Success or error status:
- *                 - FLASH_COMPLETE: on success
- *                 - PAGE_FULL: if valid page is full
- *                 - NO_VALID_PAGE: if no valid page was found
- *                 - Flash error code: on write Flash error
- *author		: lz
- *date			: 2015-2-1
- *Others		: none
- **********************************************************************************/
-static uint16_t EEPROM_VerifyPageFullWriteVariable(uint16_t EepromAddress, uint16_t EepromData)
-{
-    FLASH_Status FlashStatus = FLASH_COMPLETE;
-    uint16_t ValidPage = PAGE0;
-    uint32_t Address = PAGE0_BASE_ADDRESS, PageEndAddress = PAGE1_END_ADDRESS;
-
-    /* Get valid Page for write operation */
-    ValidPage = EEPROM_FindValidPage(WRITE_IN_VALID_PAGE);
-
-    /* Check if there is no valid page */
-    if (ValidPage == NO_VALID_PAGE)
-    {
-        return  NO_VALID_PAGE;
-    }
-
-    /* Get the valid Page start Address */
-    Address = (uint32_t)(EEPROM_START_ADDRESS + (uint32_t)(ValidPage * PAGE_SIZE));
-
-    /* Get the valid Page end Address */
-    PageEndAddress = (uint32_t)((EEPROM_START_ADDRESS - 2) + (uint32_t)((1 + ValidPage) * PAGE_SIZE));
-
-    /* Check each active page address starting from begining */
-    while (Address < PageEndAddress)
-    {
-        /* Verify if Address and Address+2 contents are 0xFFFFFFFF */
-        if ((*(__IO uint32_t*)Address) == 0xFFFFFFFF)
-        {
-            /* Set variable data */
-            HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD,Address,EepromData);
-            FlashStatus=FLASH_COMPLETE;
-
-
-#if 0
-            FlashStatus = FLASH_ProgramHalfWord(Address, EepromData);
-            /* If program operation was failed, a Flash error code is returned */
-            if (FlashStatus != FLASH_COMPLETE)
-            {
-                return FlashStatus;
-            }
-#endif
-            /* Set variable virtual address */
-
-            HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD,Address + 2,EepromAddress);
-            FlashStatus=FLASH_COMPLETE;
-
-
-
-            // FlashStatus = FLASH_ProgramHalfWord(Address + 2, EepromAddress);
-
-
-
-            /* Return program operation status */
-            return FlashStatus;
-        }
-        else
-        {
-            /* Next address location */
-            Address = Address + 4;
-        }
-    }
-    /* Return PAGE_FULL in case the valid page is full */
-    return PAGE_FULL;
-}
-
-/*********************************************************************************
- *Function		: static uint16_t EEPROM_PageTransfer(uint16_t EepromAddress, uint16_t EepromData)
- *Description	: Transfers last updated variables data from the full Page to an empty one.
- *Input		: EepromAddress: 16 bit virtual address of the variable
-EepromData: 16 bit data to be written as variable value
+ *Function		: static uint16_t EEPROM_PageTransfer(void)
+ *Description	: Transfers the RAM shadow from the full Page to the empty one.
+ *Input		: none
  *Output		: none
  *Return		:   Success or error status:
  *                 - FLASH_COMPLETE: on success
- *                 - PAGE_FULL: if valid page is full
  *                 - NO_VALID_PAGE: if no valid page was found
  *                 - Flash error code: on write Flash error
  *author		: lz
  *date			: 2015-2-1
- *Others		: none
+ *Others		: the shadow already holds the value that did not fit
  **********************************************************************************/
-static uint16_t EEPROM_PageTransfer(uint16_t EepromAddress, uint16_t EepromData)
+static uint16_t EEPROM_PageTransfer(void)
 {
-    FLASH_Status FlashStatus = FLASH_COMPLETE;
-    uint32_t OldPageAddress = PAGE0_BASE_ADDRESS, NewPageAddress = PAGE1_BASE_ADDRESS;
-    uint16_t ValidPage = PAGE0, EepromAddressIdx = 0;
-    uint16_t EepromStatus = 0, ReadStatus = 0;
-
-    /* Get active Page for read operation */
-    ValidPage = EEPROM_FindValidPage(READ_FROM_VALID_PAGE);
-
-    if (ValidPage == PAGE1)       /* Page1 valid */
-    {
-        /* New page address where variable will be moved to */
-        NewPageAddress = PAGE0_BASE_ADDRESS;
+    uint16_t OldPage = EepromValidPage, NewPage, Status;
 
-        /* Old page address where variable will be taken from */
-        OldPageAddress = PAGE1_BASE_ADDRESS;
-    }
-    else if (ValidPage == PAGE0)  /* Page0 valid */
-    {
-        /* New page address where variable will be moved to */
-        NewPageAddress = PAGE1_BASE_ADDRESS;
-
-        /* Old page address where variable will be taken from */
-        OldPageAddress = PAGE0_BASE_ADDRESS;
-    }
-    else
+    if (OldPage == NO_VALID_PAGE)
     {
         return NO_VALID_PAGE;       /* No valid Page */
     }
+    NewPage = EEPROM_OtherPage(OldPage);
 
     /* Set the new Page status to RECEIVE_DATA status */
-
-    HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD,NewPageAddress,RECEIVE_DATA);
-    FlashStatus=FLASH_COMPLETE;
-
-#if 0
-    FlashStatus = FLASH_ProgramHalfWord(NewPageAddress, RECEIVE_DATA);
-    /* If program operation was failed, a Flash error code is returned */
-    if (FlashStatus != FLASH_COMPLETE)
-    {
-        return FlashStatus;
-    }
-#endif
-
-    /* Write the variable passed as parameter in the new active page */
-    EepromStatus = EEPROM_VerifyPageFullWriteVariable(EepromAddress, EepromData);
-    /* If program operation was failed, a Flash error code is returned */
-    if (EepromStatus != FLASH_COMPLETE)
-    {
-        return EepromStatus;
-    }
-
-    /* Transfer process: transfer variables from old to the new active page */
-    for (EepromAddressIdx = 0; EepromAddressIdx < EEPROM_SIZE; EepromAddressIdx++)
-    {
-        if (EepromAddressTab[EepromAddressIdx] != EepromAddress)  /* Check each variable except the one passed as parameter */
-        {
-            /* Read the other last variable updates */
-            ReadStatus = EEPROM_ReadVariable(EepromAddressTab[EepromAddressIdx], &EepromDataVar);
-            /* In case variable corresponding to the virtual address was found */
-            if (ReadStatus != 0x1)
-            {
-                /* Transfer the variable to the new active page */
-                EepromStatus = EEPROM_VerifyPageFullWriteVariable(EepromAddressTab[EepromAddressIdx], EepromDataVar);
-                /* If program operation was failed, a Flash error code is returned */
-                if (EepromStatus != FLASH_COMPLETE)
-                {
-                    return EepromStatus;
-                }
-            }
-        }
-    }
-
-    /* Erase the old Page: Set old Page status to ERASED status */
-
-    //aad
-    uint16_t temp_erase_sector;
-    if(OldPageAddress==PAGE0_BASE_ADDRESS)
-    {
-        temp_erase_sector=ID_ErasePAGE0;
-    }
-    else if(OldPageAddress==PAGE1_BASE_ADDRESS)
-    {
-        temp_erase_sector=ID_ErasePAGE1;
-    }
-    else
-    {
-        return NO_VALID_PAGE;       /* No valid Page */
-    }
-
-    EraseInit.Sector=temp_erase_sector;
-    EraseInit.VoltageRange=FLASH_VOLTAGE_RANGE_3;
-    HAL_FLASHEx_Erase(&EraseInit,&SECTORError);
-
-    FlashStatus=FLASH_COMPLETE;
-#if 0
-    FlashStatus = FLASH_EraseSector(temp_erase_sector,VoltageRange_3);
-    /* If erase operation was failed, a Flash error code is returned */
-    if (FlashStatus != FLASH_COMPLETE)
+    Status = EEPROM_ErasePage(NewPage);
+    if (Status != FLASH_COMPLETE)
     {
-        return FlashStatus;
+        return Status;
     }
-#endif
-
-    /* Set new Page status to VALID_PAGE status */
-    HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD,NewPageAddress,VALID_PAGE);
-    FlashStatus=FLASH_COMPLETE;
-
-#if 0
-    FlashStatus = FLASH_ProgramHalfWord(NewPageAddress, VALID_PAGE);
-    /* If program operation was failed, a Flash error code is returned */
-    if (FlashStatus != FLASH_COMPLETE)
+    Status = EEPROM_SetPageStatus(NewPage, RECEIVE_DATA);
+    if (Status != FLASH_COMPLETE)
     {
-        return FlashStatus;
+        return Status;
     }
-#endif
-
-    /* Return last operation flash status */
-    return FlashStatus;
+    return EEPROM_FinishTransfer(OldPage, NewPage, EEPROM_RECORD_START);
 }
 
 /*********************************************************************************
@@ -802,35 +529,72 @@ static uint16_t EEPROM_PageTransfer(uint16_t EepromAddress, uint16_t EepromData)
 EEPROMClass::EEPROMClass()
 {
     EEPROM_Init();
-	for (uint16_t i = 0 ; i < EEPROM_SIZE ; i++)
-	{
-		EepromAddressTab[i] = i;
-	}
 }
 
 uint8_t EEPROMClass::read(int address)
 {
-    uint16_t data;
-
-    if ((address < EEPROM_SIZE) && (EEPROM_ReadVariable(EepromAddressTab[address], &data) == 0))
+    if ((address >= 0) && (address < EEPROM_SIZE) && (EepromValidPage != NO_VALID_PAGE))
     {
-        return data;
+        return EepromShadow[address];
     }
     return 0xFF;
 }
 
 /*
 
+说明:
+	读取 address 开始的 length 字节, 返回读取的长度 (超出 EEPROM_SIZE 的部分不读)
+
+*/
+int EEPROMClass::read(int address, uint8_t *buf, int length)
+{
+    if ((address < 0) || (length <= 0) || (address >= EEPROM_SIZE))
+    {
+        return 0;
+    }
+    if (length > EEPROM_SIZE - address)
+    {
+        length = EEPROM_SIZE - address;
+    }
+    for (int i = 0; i < length; i++)
+    {
+        buf[i] = read(address + i);
+    }
+    return length;
+}
+
+/*
+
 说明:
 	用户使用0--Param_Eeprom_ADDR 地址
 
 */
 void EEPROMClass::write(int address, uint8_t value)
 {
-    if (address < Param_Eeprom_ADDR)
+    if ((address >= 0) && (address < Param_Eeprom_ADDR))
+    {
+        EEPROM_WriteBlock(address, &value, 1);
+    }
+}
+
+/*
+
+说明:
+	写入 address 开始的 length 字节(用户地址), 返回写入的长度, 失败返回0
+	相邻字节合并为一条记录写入, 与已保存内容相同的部分不写flash
+
+*/
+int EEPROMClass::write(int address, const uint8_t *buf, int length)
+{
+    if ((address < 0) || (length <= 0) || (address >= Param_Eeprom_ADDR))
     {
-        EEPROM_WriteVariable(EepromAddressTab[address], value);
+        return 0;
     }
+    if (length > Param_Eeprom_ADDR - address)
+    {
+        length = Param_Eeprom_ADDR - address;
+    }
+    return (EEPROM_WriteBlock(address, buf, length) == FLASH_COMPLETE) ? length : 0;
 }
 
 /*
@@ -842,12 +606,11 @@ void EEPROMClass::write(int address, uint8_t value)
 
 void EEPROMClass::write_system(int address, uint8_t value)
 {
-    if (address < EEPROM_SIZE)
+    if ((address >= 0) && (address < EEPROM_SIZE))
     {
-        EEPROM_WriteVariable(EepromAddressTab[address], value);
+        EEPROM_WriteBlock(address, &value, 1);
     }
 }
 
 
 EEPROMClass EEPROM;
-
@@ -0,0 +1,69 @@
+//=================================================================================================================
+//input
+/****************************************************************************
+ *Private Included Files
+ ****************************************************************************/
+#include "main.h"
+#include "wiring_eeprom.h"
+#include "wiring_eeprom_hal.h"
+
+//=================================================================================================================
+//come true hidden
+/************************************************************************************
+* Private Variables
+************************************************************************************/
+static uint32_t SECTORError = 0;
+/*
+   TypeErase
+   Banks
+   Sector
+   NbSectors
+   VoltageRange
+   */
+static FLASH_EraseInitTypeDef EraseInit={FLASH_TYPEERASE_SECTORS,0,ID_ErasePAGE0,1,FLASH_VOLTAGE_RANGE_3};
+
+static uint32_t flash_programs = 0;
+static uint32_t flash_erases = 0;
+
+static uint32_t EEPROM_PageBase(uint16_t page)
+{
+    return (page == PAGE1) ? PAGE1_BASE_ADDRESS : PAGE0_BASE_ADDRESS;
+}
+
+//=================================================================================================================
+//output
+void EEPROM_FlashUnlock_hal(void)
+{
+    HAL_FLASH_Unlock();
+}
+
+uint32_t EEPROM_FlashRead_hal(uint16_t page, uint32_t offset)
+{
+    return (*(__IO uint32_t*)(EEPROM_PageBase(page) + offset));
+}
+
+int EEPROM_FlashProgramHalfWord_hal(uint16_t page, uint32_t offset, uint16_t data)
+{
+    flash_programs++;
+    return (HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, EEPROM_PageBase(page) + offset, data) == HAL_OK) ? 0 : 1;
+}
+
+int EEPROM_FlashProgramWord_hal(uint16_t page, uint32_t offset, uint32_t data)
+{
+    flash_programs++;
+    return (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, EEPROM_PageBase(page) + offset, data) == HAL_OK) ? 0 : 1;
+}
+
+int EEPROM_FlashErase_hal(uint16_t page)
+{
+    flash_erases++;
+    EraseInit.Sector=(page == PAGE1) ? ID_ErasePAGE1 : ID_ErasePAGE0;
+    EraseInit.VoltageRange=FLASH_VOLTAGE_RANGE_3;
+    return (HAL_FLASHEx_Erase(&EraseInit,&SECTORError) == HAL_OK) ? 0 : 1;
+}
+
+void EEPROM_FlashStatistics_hal(uint32_t *programs, uint32_t *erases)
+{
+    *programs = flash_programs;
+    *erases = flash_erases;
+}
@@ -70,6 +70,9 @@ static uint32_t GetSector(uint32_t Address)
     return sector;
 }
 
+static uint32_t argument_programs = 0;
+static uint32_t argument_erases = 0;
+
 static void FLASH_Erase_Impl(uint32_t address, uint32_t length)
 {
     FLASH_EraseInitTypeDef EraseInitStruct;
@@ -145,10 +148,48 @@ int SystemWriteArgument(uint32_t writeStartAddress, uint16_t *dataBuffer, uint32
 
 
     HAL_StatusTypeDef flashStatus = HAL_OK;
+    argument_erases++;
     FLASH_Erase_Impl(ARGUMENT_PAGE0_BASE_ADDRESS, ARGUMENT_PAGE_SIZE);
     HAL_FLASH_Unlock();
     while((address < endAddress) && (flashStatus == HAL_OK))
     {
+        argument_programs++;
+        flashStatus = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, address, dataBuffer[i++]);
+        address = address + 2;
+    }
+    /* Locks the FLASH Program Erase Controller */
+    HAL_FLASH_Lock();
+    return flashStatus;
+}
+
+/*********************************************************************************
+ *Function		: int SystemProgramArgument(uint32_t writeStartAddress, uint16_t *dataBuffer, uint32_t size)
+ *Description	: program half words into the erased part of the argument area, without erasing
+ *Input		      : address data number
+ *Output		: none
+ *Return		: 0 ok  other error
+ *author		: robot
+ *date			: 2016-05-20
+ *Others		: written in address order, the caller relies on the last half word being written last
+ **********************************************************************************/
+int SystemProgramArgument(uint32_t writeStartAddress, uint16_t *dataBuffer, uint32_t size)
+{
+    uint32_t address = writeStartAddress;
+    uint32_t endAddress = writeStartAddress + size * 2;
+    uint16_t i = 0;
+
+    if((address < SYSTEM_ARGUMENT_ADDRESS)
+            || (endAddress > SYSTEM_ARGUMENT_END_ADDRESS
+                || ((address % 2) != 0)))
+    {
+        return 2;//FLASH_ERROR_PG;
+    }
+
+    HAL_StatusTypeDef flashStatus = HAL_OK;
+    HAL_FLASH_Unlock();
+    while((address < endAddress) && (flashStatus == HAL_OK))
+    {
+        argument_programs++;
         flashStatus = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, address, dataBuffer[i++]);
         address = address + 2;
     }
@@ -157,3 +198,10 @@ int SystemWriteArgument(uint32_t writeStartAddress, uint16_t *dataBuffer, uint32
     return flashStatus;
 }
 
+//启动以来参数区的半字写入次数和擦除次数
+void SystemArgumentStatistics(uint32_t *programs, uint32_t *erases)
+{
+    *programs = argument_programs;
+    *erases = argument_erases;
+}
+
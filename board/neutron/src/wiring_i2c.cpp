@@ -25,11 +25,11 @@
 
 #include "wiring_i2c.h"
 #include "wiring_usartserial.h"
+#include "cmsis_os.h"
 
 #define TRANSMITTER             0x00
 #define RECEIVER                0x01
 
-#define useDMA 0
 /*
  * I2C mapping
  */
@@ -50,184 +50,10 @@
 // };
 
 
-/* I2C3 DMA1 I2C3_RX: stream2 channel3;    I2C3_TX: stream4 channel3 */
-/* I2C1 DMA1 I2C1_RX: stream5 channel5;    I2C1_TX: stream6 channel1 */
+/* I2C1 DMA1 I2C1_RX: stream5 channel1 */
 /* I2C1: SCL PB8, SDA PB9 */
 /* I2C3: SCL PA8, SDA PB4 */
-static void I2C_DMA_Init(I2C_HandleTypeDef *hi2c)
-{
-  if(hi2c->Instance == I2C1)
-  {
-      static DMA_HandleTypeDef hdma_tx1;
-      static DMA_HandleTypeDef hdma_rx1;
-
-      GPIO_InitTypeDef  GPIO_InitStruct;
-
-      /*##-1- Enable GPIO Clocks #################################################*/
-      /* Enable GPIO Tx/Rx clock */
-      __HAL_RCC_GPIOB_CLK_ENABLE(); // I2C PB8, PB9
-
-      /*##-2- Configure peripheral GPIO ##########################################*/
-      /* I2C TX GPIO pin configuration  */
-      GPIO_InitStruct.Pin       = GPIO_PIN_8;
-      GPIO_InitStruct.Mode      = GPIO_MODE_AF_OD;
-      GPIO_InitStruct.Pull      = GPIO_PULLUP;
-      GPIO_InitStruct.Speed     = GPIO_SPEED_FAST;
-      GPIO_InitStruct.Alternate = GPIO_AF4_I2C1;
-      HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
-
-      /* I2C RX GPIO pin configuration  */
-      GPIO_InitStruct.Pin = GPIO_PIN_9;
-      GPIO_InitStruct.Alternate = GPIO_AF4_I2C1;
-      HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
-
-      /*##-3- Enable DMA peripheral Clock ########################################*/
-      /* Enable DMA1 clock */
-      __HAL_RCC_DMA1_CLK_ENABLE();
-
-      /*##-4- Configure the DMA streams ##########################################*/
-      /* Configure the DMA handler for Transmission process */
-      hdma_tx1.Instance                 = DMA1_Stream6;
-
-      hdma_tx1.Init.Channel             = DMA_CHANNEL_1;
-      hdma_tx1.Init.Direction           = DMA_MEMORY_TO_PERIPH;
-      hdma_tx1.Init.PeriphInc           = DMA_PINC_DISABLE;
-      hdma_tx1.Init.MemInc              = DMA_MINC_ENABLE;
-      hdma_tx1.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
-      hdma_tx1.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
-      hdma_tx1.Init.Mode                = DMA_NORMAL;
-      hdma_tx1.Init.Priority            = DMA_PRIORITY_LOW;
-      hdma_tx1.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
-      hdma_tx1.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
-      hdma_tx1.Init.MemBurst            = DMA_MBURST_INC4;
-      hdma_tx1.Init.PeriphBurst         = DMA_PBURST_INC4;
-
-      HAL_DMA_Init(&hdma_tx1);
-
-      /* Associate the initialized DMA handle to the the I2C handle */
-      __HAL_LINKDMA(hi2c, hdmatx, hdma_tx1);
-
-      /* Configure the DMA handler for Transmission process */
-      hdma_rx1.Instance                 = DMA1_Stream5;
-
-      hdma_rx1.Init.Channel             = DMA_CHANNEL_1;
-      hdma_rx1.Init.Direction           = DMA_PERIPH_TO_MEMORY;
-      hdma_rx1.Init.PeriphInc           = DMA_PINC_DISABLE;
-      hdma_rx1.Init.MemInc              = DMA_MINC_ENABLE;
-      hdma_rx1.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
-      hdma_rx1.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
-      hdma_rx1.Init.Mode                = DMA_NORMAL;
-      hdma_rx1.Init.Priority            = DMA_PRIORITY_HIGH;
-      hdma_rx1.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
-      hdma_rx1.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
-      hdma_rx1.Init.MemBurst            = DMA_MBURST_INC4;
-      hdma_rx1.Init.PeriphBurst         = DMA_PBURST_INC4;
-
-      HAL_DMA_Init(&hdma_rx1);
-
-      /* Associate the initialized DMA handle to the the I2C handle */
-      __HAL_LINKDMA(hi2c, hdmarx, hdma_rx1);
-
-      /*##-5- Enable peripheral Clock ############################################*/
-      /* Enable I2C1 clock */
-      __HAL_RCC_I2C1_CLK_ENABLE();
-
-      // /*##-6- Configure the NVIC for DMA #########################################*/
-      // /* NVIC configuration for DMA transfer complete interrupt (I2C1_TX) */
-      // HAL_NVIC_SetPriority(DMA1_Stream6_IRQn, 1, 0);
-      // HAL_NVIC_EnableIRQ(DMA1_Stream6_IRQn);
-
-      // /* NVIC configuration for DMA transfer complete interrupt (I2C1_RX) */
-      // HAL_NVIC_SetPriority(DMA1_Stream5_IRQn, 0, 0);
-      // HAL_NVIC_EnableIRQ(DMA1_Stream5_IRQn);
-  }
-  else if(hi2c->Instance == I2C3)
-  {
-      static DMA_HandleTypeDef hdma_tx3;
-      static DMA_HandleTypeDef hdma_rx3;
-
-      GPIO_InitTypeDef  GPIO_InitStruct;
-
-      /*##-1- Enable GPIO Clocks #################################################*/
-      /* Enable GPIO Tx/Rx clock */
-      __HAL_RCC_GPIOA_CLK_ENABLE(); // I2C3 SCL PA8
-      __HAL_RCC_GPIOB_CLK_ENABLE(); // I2C3 SDA PB4
-      /*##-2- Configure peripheral GPIO ##########################################*/
-      /* I2C TX GPIO pin configuration  */
-      GPIO_InitStruct.Pin       = GPIO_PIN_8;
-      GPIO_InitStruct.Mode      = GPIO_MODE_AF_OD;
-      GPIO_InitStruct.Pull      = GPIO_PULLUP;
-      GPIO_InitStruct.Speed     = GPIO_SPEED_FAST;
-      GPIO_InitStruct.Alternate = GPIO_AF4_I2C3;
-      HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-
-      /* I2C RX GPIO pin configuration  */
-      GPIO_InitStruct.Pin = GPIO_PIN_4;
-      GPIO_InitStruct.Alternate = GPIO_AF9_I2C3;
-      HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
-
-      /*##-3- Enable DMA peripheral Clock ########################################*/
-      /* Enable DMA1 clock */
-      __HAL_RCC_DMA1_CLK_ENABLE();
-
-      /*##-4- Configure the DMA streams ##########################################*/
-      /* Configure the DMA handler for Transmission process */
-      hdma_tx3.Instance                 = DMA1_Stream4;
-
-      hdma_tx3.Init.Channel             = DMA_CHANNEL_3;
-      hdma_tx3.Init.Direction           = DMA_MEMORY_TO_PERIPH;
-      hdma_tx3.Init.PeriphInc           = DMA_PINC_DISABLE;
-      hdma_tx3.Init.MemInc              = DMA_MINC_ENABLE;
-      hdma_tx3.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
-      hdma_tx3.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
-      hdma_tx3.Init.Mode                = DMA_NORMAL;
-      hdma_tx3.Init.Priority            = DMA_PRIORITY_MEDIUM;
-      hdma_tx3.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
-      hdma_tx3.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
-      hdma_tx3.Init.MemBurst            = DMA_MBURST_INC4;
-      hdma_tx3.Init.PeriphBurst         = DMA_PBURST_INC4;
-
-      HAL_DMA_Init(&hdma_tx3);
-
-      /* Associate the initialized DMA handle to the the I2C handle */
-      __HAL_LINKDMA(hi2c, hdmatx, hdma_tx3);
-
-      /* Configure the DMA handler for Transmission process */
-      hdma_rx3.Instance                 = DMA1_Stream2;
-
-      hdma_rx3.Init.Channel             = DMA_CHANNEL_3;
-      hdma_rx3.Init.Direction           = DMA_PERIPH_TO_MEMORY;
-      hdma_rx3.Init.PeriphInc           = DMA_PINC_DISABLE;
-      hdma_rx3.Init.MemInc              = DMA_MINC_ENABLE;
-      hdma_rx3.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
-      hdma_rx3.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
-      hdma_rx3.Init.Mode                = DMA_NORMAL;
-      hdma_rx3.Init.Priority            = DMA_PRIORITY_HIGH;  //DMA_PRIORITY_MEDIUM; //DMA_PRIORITY_HIGH;
-      hdma_rx3.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
-      hdma_rx3.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
-      hdma_rx3.Init.MemBurst            = DMA_MBURST_INC4;
-      hdma_rx3.Init.PeriphBurst         = DMA_PBURST_INC4;
-
-      HAL_DMA_Init(&hdma_rx3);
-
-      /* Associate the initialized DMA handle to the the I2C handle */
-      __HAL_LINKDMA(hi2c, hdmarx, hdma_rx3);
-
-      /*##-5- Enable peripheral Clock ############################################*/
-      /* Enable I2C1 clock */
-      __HAL_RCC_I2C3_CLK_ENABLE();
-
-      // /*##-6- Configure the NVIC for DMA #########################################*/
-      // /* NVIC configuration for DMA transfer complete interrupt (I2C1_TX) */
-      // HAL_NVIC_SetPriority(DMA1_Stream4_IRQn, 1, 0);
-      // HAL_NVIC_EnableIRQ(DMA1_Stream4_IRQn);
-
-      // /* NVIC configuration for DMA transfer complete interrupt (I2C1_RX) */
-      // HAL_NVIC_SetPriority(DMA1_Stream2_IRQn, 0, 0);
-      // HAL_NVIC_EnableIRQ(DMA1_Stream2_IRQn);
-  }
-}
-
+#define I2C_IRQ_PRIORITY        6       // 不高于 configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, 中断中可以通知任务
 
 TwoWire::TwoWire(I2C_TypeDef *I2Cx):I2C_Type(I2Cx)
 {
@@ -245,6 +71,15 @@ TwoWire::TwoWire(I2C_TypeDef *I2Cx):I2C_Type(I2Cx)
     txBufferLength = 0;
 
     transmitting = 0;
+
+    pendingAddress = 0;
+    pendingLength = 0;
+    pendingWrite = false;
+
+    queueHead = 0;
+    queueCount = 0;
+    xferState = XFER_IDLE;
+    xferIndex = 0;
  }
 
 void TwoWire::setSpeed(uint32_t clockSpeed)
@@ -321,9 +156,7 @@ void TwoWire::begin(void)
   /*##-1- Enable GPIO Clocks #################################################*/
   /* Enable GPIO TX/RX clock */
   __HAL_RCC_GPIOB_CLK_ENABLE(); // I2C PB8, PB9
-#if(~useDMA)
   __HAL_RCC_I2C1_CLK_ENABLE();
-#endif
 
   /*##-2- Configure peripheral GPIO ##########################################*/
   /* I2C TX GPIO pin configuration  */
@@ -339,64 +172,35 @@ void TwoWire::begin(void)
   GPIO_InitStruct.Alternate = GPIO_AF4_I2C1;
   HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
 
-  #if(useDMA)
-  {
-  static DMA_HandleTypeDef hdma_tx;
-  static DMA_HandleTypeDef hdma_rx;
-  /*##-3- Enable DMA peripheral Clock ########################################*/
-  /* Enable DMA1 clock */
+  /*##-3- 接收DMA, 发送用TXE中断 ##############################################*/
   __HAL_RCC_DMA1_CLK_ENABLE();
 
-  /*##-4- Configure the DMA streams ##########################################*/
-  /* Configure the DMA handler for Transmission process */
-  hdma_tx.Instance                 = DMA1_Stream6;
-
-  hdma_tx.Init.Channel             = DMA_CHANNEL_1;
-  hdma_tx.Init.Direction           = DMA_MEMORY_TO_PERIPH;
-  hdma_tx.Init.PeriphInc           = DMA_PINC_DISABLE;
-  hdma_tx.Init.MemInc              = DMA_MINC_ENABLE;
-  hdma_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
-  hdma_tx.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
-  hdma_tx.Init.Mode                = DMA_NORMAL;
-  hdma_tx.Init.Priority            = DMA_PRIORITY_LOW;
-  hdma_tx.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
-  hdma_tx.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
-  hdma_tx.Init.MemBurst            = DMA_MBURST_INC4;
-  hdma_tx.Init.PeriphBurst         = DMA_PBURST_INC4;
-
-  HAL_DMA_Init(&hdma_tx);
-
-  /* Associate the initialized DMA handle to the the I2C handle */
-  __HAL_LINKDMA(&I2CHandle, hdmatx, hdma_tx);
-
-  /* Configure the DMA handler for Transmission process */
-  hdma_rx.Instance                 = DMA1_Stream5;
-
-  hdma_rx.Init.Channel             = DMA_CHANNEL_1;
-  hdma_rx.Init.Direction           = DMA_PERIPH_TO_MEMORY;
-  hdma_rx.Init.PeriphInc           = DMA_PINC_DISABLE;
-  hdma_rx.Init.MemInc              = DMA_MINC_ENABLE;
-  hdma_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
-  hdma_rx.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
-  hdma_rx.Init.Mode                = DMA_NORMAL;
-  hdma_rx.Init.Priority            = DMA_PRIORITY_HIGH;
-  hdma_rx.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
-  hdma_rx.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
-  hdma_rx.Init.MemBurst            = DMA_MBURST_INC4;
-  hdma_rx.Init.PeriphBurst         = DMA_PBURST_INC4;
-
-  HAL_DMA_Init(&hdma_rx);
-
-  /* Associate the initialized DMA handle to the the I2C handle */
-  __HAL_LINKDMA(&I2CHandle, hdmarx, hdma_rx);
-
-  /*##-5- Enable peripheral Clock ############################################*/
-  /* Enable I2C1 clock */
-  __HAL_RCC_I2C1_CLK_ENABLE();
-
-
-  }
-  #endif
+  hdmaRx.Instance                 = DMA1_Stream5;
+
+  hdmaRx.Init.Channel             = DMA_CHANNEL_1;
+  hdmaRx.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+  hdmaRx.Init.PeriphInc           = DMA_PINC_DISABLE;
+  hdmaRx.Init.MemInc              = DMA_MINC_ENABLE;
+  hdmaRx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdmaRx.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+  hdmaRx.Init.Mode                = DMA_NORMAL;
+  hdmaRx.Init.Priority            = DMA_PRIORITY_HIGH;
+  hdmaRx.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
+  hdmaRx.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
+  hdmaRx.Init.MemBurst            = DMA_MBURST_SINGLE;
+  hdmaRx.Init.PeriphBurst         = DMA_PBURST_SINGLE;
+
+  HAL_DMA_Init(&hdmaRx);
+  hdmaRx.Parent = this;
+  hdmaRx.XferCpltCallback = dmaRxComplete;
+
+  /*##-4- 中断 ################################################################*/
+  HAL_NVIC_SetPriority(I2C1_EV_IRQn, I2C_IRQ_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(I2C1_EV_IRQn);
+  HAL_NVIC_SetPriority(I2C1_ER_IRQn, I2C_IRQ_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(I2C1_ER_IRQn);
+  HAL_NVIC_SetPriority(DMA1_Stream5_IRQn, I2C_IRQ_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Stream5_IRQn);
 
 
   if(HAL_I2C_Init(&I2CHandle) != HAL_OK)
@@ -489,46 +293,46 @@ void TwoWire::begin(int address)
     begin((uint8_t)address);
 }
 
+/*********************************************************************************
+ *Function     : uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop)
+ *Description  : 从设备读取 quantity 字节到接收缓冲
+ *Input        : address: 7位地址  quantity: 字节数  sendStop: 未使用, 总是发送STOP
+ *Output       : none
+ *Return       : 读到的字节数, 失败返回0
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 之前 endTransmission(false) 的数据与读合并为一次传输, 中间为重复起始
+ **********************************************************************************/
 uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop)
 {
+    I2CTransaction transaction;
+
     if(quantity > I2C_BUFFER_LENGTH)
     {
         quantity = I2C_BUFFER_LENGTH;
     }
 
-    // for ( int i=0; i < 10; ++i )
-    // {
-    //   Serial.printf("\r\nbegin requestFrom!\r\n");
-    // }
-    address = address << 1;
-    // address |= 0x01;
-    #if(useDMA)
-    HAL_StatusTypeDef requestStatus = HAL_I2C_Master_Receive_DMA(&I2CHandle, address, rxBuffer, quantity);
-    for ( int i=0; i < 10; ++i )
+    memset(&transaction, 0, sizeof(transaction));
+    transaction.address = address;
+    transaction.rxData = rxBuffer;
+    transaction.rxLength = quantity;
+    if(pendingWrite && (pendingAddress == address))
     {
-      Serial.printf("\r\nrequestStatus %d!\r\n", requestStatus);
+        transaction.txData = pendingBuffer;
+        transaction.txLength = pendingLength;
     }
-    while( requestStatus != HAL_OK);
-    #else
-        while(HAL_I2C_Master_Receive(&I2CHandle, address, rxBuffer, quantity, 100) != HAL_OK)
-    #endif
+    else if(pendingWrite)
     {
-        /* Error_handler() function is called when Timeout error occurs. */
-        if(HAL_I2C_GetError(&I2CHandle) != HAL_I2C_ERROR_AF)
-        {
-           // Error_Handler();
-           while(1)
-           {}
-        }
+        flushPending();
     }
+    pendingWrite = false;
 
     rxBufferIndex = 0;
-    rxBufferLength = quantity;
-
-    // for ( int i=0; i < 10; ++i )
-    // {
-    //   Serial.printf("\r\nrequestFrom!\r\n");
-    // }
+    rxBufferLength = 0;
+    if(transfer(transaction) == I2C_STATUS_OK)
+    {
+        rxBufferLength = quantity;
+    }
     return rxBufferLength;
 }
 
@@ -552,7 +356,7 @@ void TwoWire::beginTransmission(uint8_t address)
     // indicate that we are transmitting
     transmitting = 1;
     // set address of targeted slave
-    txAddress = address << 1;
+    txAddress = address;
 
     // for ( int i=0; i < 10; ++i )
     // {
@@ -581,28 +385,42 @@ void TwoWire::beginTransmission(int address)
     beginTransmission((uint8_t)address);
 }
 
+/*********************************************************************************
+ *Function     : uint8_t TwoWire::endTransmission(uint8_t sendStop)
+ *Description  : 发送 beginTransmission 之后写入的数据
+ *Input        : sendStop: false 时数据保留到下一次 requestFrom, 以重复起始读取
+ *Output       : none
+ *Return       : I2C_STATUS_OK/NACK/ERROR/TIMEOUT, sendStop 为 false 时不发送地址, 不反映地址是否应答
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 任务中等待时让出CPU
+ **********************************************************************************/
 uint8_t TwoWire::endTransmission(uint8_t sendStop)
 {
-  #if(useDMA)
-  HAL_StatusTypeDef status = HAL_I2C_Master_Transmit_DMA( &I2CHandle, (uint16_t) txAddress, (uint8_t*)txBuffer, txBufferLength);
-  while( status != HAL_OK);
-  #else
-      while(HAL_I2C_Master_Transmit( &I2CHandle, (uint16_t)txAddress, &txBuffer[0], txBufferLength, 1000) != HAL_OK)
-  #endif
-  {
-    if( HAL_I2C_GetError(&I2CHandle) != HAL_I2C_ERROR_AF)
+    uint8_t status = I2C_STATUS_OK;
+
+    if(pendingWrite)
     {
-      Serial.printf("\r\n12345nendTransmission!\r\n");
+        status = flushPending();
+    }
 
-      while(1)
-      {}
-      // Error_Handler();
+    if(!sendStop)
+    {
+        memcpy(pendingBuffer, txBuffer, txBufferLength);
+        pendingLength = txBufferLength;
+        pendingAddress = txAddress;
+        pendingWrite = true;
     }
-    for ( int i=0; i < 10; ++i )
+    else if(status == I2C_STATUS_OK)
     {
-      Serial.printf("\r\nabcdefghidkalldjflaj!\r\n");
+        I2CTransaction transaction;
+
+        memset(&transaction, 0, sizeof(transaction));
+        transaction.address = txAddress;
+        transaction.txData = txBuffer;
+        transaction.txLength = txBufferLength;
+        status = transfer(transaction);
     }
-  }
 
     // reset tx buffer iterator vars
     txBufferIndex = 0;
@@ -610,28 +428,7 @@ uint8_t TwoWire::endTransmission(uint8_t sendStop)
 
     // indicate that we are done transmitting
     transmitting = 0;
-    // if(Serial.isEnabled() == false)
-    // {
-    //   Serial.begin();
-    // }
-    // for ( int i=0; i < 10; ++i )
-    // {
-    //   Serial.printf("\r\nstatus %d\r\n", status);
-    // }
-
-
-    while (HAL_I2C_GetState(&I2CHandle) != HAL_I2C_STATE_READY)
-    {
-      HAL_I2C_StateTypeDef a = HAL_I2C_GetState(&I2CHandle);
-
-      Serial.printf("\r\n%d\r\n",a);
-    }
-    // for ( int i=0; i < 10; ++i )
-    // {
-    //   Serial.printf("\r\nendTransmission!\r\n");
-    // }
-
-    return 0;
+    return status;
 }
 
 //	This provides backwards compatibility with the original
@@ -658,10 +455,6 @@ size_t TwoWire::write(uint8_t data)
         // update amount in buffer
         txBufferLength = txBufferIndex;
     }
-    if(Serial.isEnabled() == false)
-    {
-      Serial.begin();
-    }
     // for ( int i=0; i < 10; ++i )
     // {
     //   Serial.printf("\r\nwriten!\r\n");
@@ -725,10 +518,523 @@ bool TwoWire::isEnabled()
     return I2C_Enabled;
 }
 
+/*********************************************************************************
+ *Function     : bool TwoWire::submit(I2CTransaction &transaction)
+ *Description  : 传输加入队列, 总线空闲时立即开始
+ *Input        : transaction: 传输, 完成前必须保持有效
+ *Output       : none
+ *Return       : 成功返回true, 队列满或者没有初始化返回false
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 立即返回, 完成后 status 不为 I2C_STATUS_PENDING, 并调用 callback
+ **********************************************************************************/
+bool TwoWire::submit(I2CTransaction &transaction)
+{
+    uint32_t primask;
+
+    if(!I2C_Enabled)
+    {
+        return false;
+    }
+
+    if(transaction.regLength > 1)
+    {
+        transaction.regLength = 1;
+    }
+    transaction.status = I2C_STATUS_PENDING;
+    transaction.task = NULL;
+
+    checkTimeout();
+
+    primask = lock();
+    if(queueCount >= I2C_QUEUE_LENGTH)
+    {
+        unlock(primask);
+        return false;
+    }
+    queue[(queueHead + queueCount) % I2C_QUEUE_LENGTH] = &transaction;
+    queueCount++;
+    if(queueCount == 1)
+    {
+        startNext();
+    }
+    unlock(primask);
+    return true;
+}
+
+/*********************************************************************************
+ *Function     : uint8_t TwoWire::wait(I2CTransaction &transaction)
+ *Description  : 等待传输完成
+ *Input        : transaction: 已经 submit 的传输
+ *Output       : none
+ *Return       : I2C_STATUS_*
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 任务中阻塞等待中断的通知, 调度器启动前忙等
+ **********************************************************************************/
+uint8_t TwoWire::wait(I2CTransaction &transaction)
+{
+    if(osKernelRunning() && !__get_IPSR())
+    {
+        transaction.task = osThreadGetId();
+        while(transaction.status == I2C_STATUS_PENDING)
+        {
+            ulTaskNotifyTake(pdTRUE, 2);
+            checkTimeout();
+        }
+        transaction.task = NULL;
+    }
+    else
+    {
+        while(transaction.status == I2C_STATUS_PENDING)
+        {
+            checkTimeout();
+        }
+    }
+    return transaction.status;
+}
+
+uint8_t TwoWire::transfer(I2CTransaction &transaction)
+{
+    if(!I2C_Enabled)
+    {
+        return I2C_STATUS_ERROR;
+    }
+    while(!submit(transaction))
+    {
+        checkTimeout();
+    }
+    return wait(transaction);
+}
+
+uint8_t TwoWire::readRegisters(uint8_t address, uint8_t reg, uint8_t *data, uint16_t length)
+{
+    I2CTransaction transaction;
+
+    memset(&transaction, 0, sizeof(transaction));
+    transaction.address = address;
+    transaction.reg = reg;
+    transaction.regLength = 1;
+    transaction.rxData = data;
+    transaction.rxLength = length;
+    return transfer(transaction);
+}
+
+uint8_t TwoWire::writeRegisters(uint8_t address, uint8_t reg, const uint8_t *data, uint16_t length)
+{
+    I2CTransaction transaction;
+
+    memset(&transaction, 0, sizeof(transaction));
+    transaction.address = address;
+    transaction.reg = reg;
+    transaction.regLength = 1;
+    transaction.txData = data;
+    transaction.txLength = length;
+    return transfer(transaction);
+}
+
+void TwoWire::poll(void)
+{
+    checkTimeout();
+}
+
+uint8_t TwoWire::flushPending(void)
+{
+    I2CTransaction transaction;
+
+    memset(&transaction, 0, sizeof(transaction));
+    transaction.address = pendingAddress;
+    transaction.txData = pendingBuffer;
+    transaction.txLength = pendingLength;
+    pendingWrite = false;
+    return transfer(transaction);
+}
+
+uint32_t TwoWire::lock(void)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    return primask;
+}
+
+void TwoWire::unlock(uint32_t primask)
+{
+    __set_PRIMASK(primask);
+}
+
+/*********************************************************************************
+ *Function     : void TwoWire::startNext(void)
+ *Description  : 开始队首的传输
+ *Input        : none
+ *Output       : none
+ *Return       : none
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 关中断或者在I2C/DMA中断中调用, 之后由中断推进
+ **********************************************************************************/
+void TwoWire::startNext(void)
+{
+    I2CTransaction *transaction;
+    uint32_t count = 10000;
+
+    if(queueCount == 0)
+    {
+        xferState = XFER_IDLE;
+        return;
+    }
+
+    transaction = queue[queueHead];
+    transaction->time = millis();
+    xferIndex = 0;
+    if(transaction->regLength || transaction->txLength || !transaction->rxLength)
+    {
+        xferState = XFER_START_WRITE;
+    }
+    else
+    {
+        xferState = XFER_START_READ;
+    }
+
+    // 上一次的STOP还没有发出
+    while((I2C_Type->CR1 & I2C_CR1_STOP) && --count);
+
+    I2C_Type->CR1 &= ~I2C_CR1_POS;
+    I2C_Type->CR2 |= I2C_CR2_ITEVTEN | I2C_CR2_ITERREN;
+    I2C_Type->CR1 |= I2C_CR1_START;
+}
+
+/*********************************************************************************
+ *Function     : void TwoWire::complete(uint8_t status)
+ *Description  : 结束队首的传输, 通知等待的任务并开始下一个
+ *Input        : status: I2C_STATUS_*
+ *Output       : none
+ *Return       : none
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : status 写入之后传输结构体可能已经释放, 之前先取出需要的成员
+ **********************************************************************************/
+void TwoWire::complete(uint8_t status)
+{
+    I2CTransaction *transaction = queue[queueHead];
+    I2CCallback callback = transaction->callback;
+    void *arg = transaction->arg;
+    TaskHandle_t task = (TaskHandle_t)transaction->task;
+
+    I2C_Type->CR2 &= ~(I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN | I2C_CR2_DMAEN | I2C_CR2_LAST);
+    if(status != I2C_STATUS_OK)
+    {
+        HAL_DMA_Abort(&hdmaRx);
+    }
+
+    queueHead = (queueHead + 1) % I2C_QUEUE_LENGTH;
+    queueCount--;
+    xferState = XFER_IDLE;
+
+    transaction->status = status;
+    if(callback != NULL)
+    {
+        callback(arg, status);
+    }
+    if(task != NULL)
+    {
+        if(__get_IPSR())
+        {
+            BaseType_t woken = pdFALSE;
+            vTaskNotifyGiveFromISR(task, &woken);
+            portYIELD_FROM_ISR(woken);
+        }
+        else
+        {
+            xTaskNotifyGive(task);
+        }
+    }
+
+    startNext();
+}
+
+/*********************************************************************************
+ *Function     : void TwoWire::checkTimeout(void)
+ *Description  : 队首传输超时时复位总线并结束传输
+ *Input        : none
+ *Output       : none
+ *Return       : none
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 关中断只用于检查和取得传输(XFER_RECOVER), 复位总线时打开中断
+ **********************************************************************************/
+void TwoWire::checkTimeout(void)
+{
+    uint32_t primask = lock();
+    bool expired = false;
+
+    if(queueCount && (xferState != XFER_IDLE) && (xferState != XFER_RECOVER))
+    {
+        I2CTransaction *transaction = queue[queueHead];
+        uint32_t timeout = I2C_TIMEOUT_BASE + (transaction->regLength + transaction->txLength + transaction->rxLength) / 8;
+
+        if(millis() - transaction->time > timeout)
+        {
+            // 之后 I2C/DMA 中断不再推进这个传输, 其它调用者也不会重复复位
+            I2C_Type->CR2 &= ~(I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN);
+            xferState = XFER_RECOVER;
+            expired = true;
+        }
+    }
+    unlock(primask);
+
+    if(expired)
+    {
+        recoverBus();
+        primask = lock();
+        complete(I2C_STATUS_TIMEOUT);
+        unlock(primask);
+    }
+}
+
+/*********************************************************************************
+ *Function     : void TwoWire::recoverBus(void)
+ *Description  : 从机拉住SDA或者I2C状态错误时复位总线
+ *Input        : none
+ *Output       : none
+ *Return       : none
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : SCL 输出最多9个时钟直到SDA释放, 再产生STOP, 最后复位I2C
+ **********************************************************************************/
+void TwoWire::recoverBus(void)
+{
+    GPIO_InitTypeDef  GPIO_InitStruct;
+
+    I2C_Type->CR2 &= ~(I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN | I2C_CR2_DMAEN | I2C_CR2_LAST);
+    HAL_DMA_Abort(&hdmaRx);
+    __HAL_I2C_DISABLE(&I2CHandle);
+
+    HAL_GPIO_WritePin(GPIOB, GPIO_PIN_8 | GPIO_PIN_9, GPIO_PIN_SET);
+    GPIO_InitStruct.Pin       = GPIO_PIN_8 | GPIO_PIN_9;
+    GPIO_InitStruct.Mode      = GPIO_MODE_OUTPUT_OD;
+    GPIO_InitStruct.Pull      = GPIO_PULLUP;
+    GPIO_InitStruct.Speed     = GPIO_SPEED_FAST;
+    GPIO_InitStruct.Alternate = 0;
+    HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+    for(int i = 0; (i < 9) && (HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_9) == GPIO_PIN_RESET); i++)
+    {
+        HAL_GPIO_WritePin(GPIOB, GPIO_PIN_8, GPIO_PIN_RESET);
+        delayMicroseconds(5);
+        HAL_GPIO_WritePin(GPIOB, GPIO_PIN_8, GPIO_PIN_SET);
+        delayMicroseconds(5);
+    }
+    // STOP: SCL 高时 SDA 由低变高
+    HAL_GPIO_WritePin(GPIOB, GPIO_PIN_8, GPIO_PIN_RESET);
+    delayMicroseconds(5);
+    HAL_GPIO_WritePin(GPIOB, GPIO_PIN_9, GPIO_PIN_RESET);
+    delayMicroseconds(5);
+    HAL_GPIO_WritePin(GPIOB, GPIO_PIN_8, GPIO_PIN_SET);
+    delayMicroseconds(5);
+    HAL_GPIO_WritePin(GPIOB, GPIO_PIN_9, GPIO_PIN_SET);
+    delayMicroseconds(5);
+
+    GPIO_InitStruct.Mode      = GPIO_MODE_AF_OD;
+    GPIO_InitStruct.Alternate = GPIO_AF4_I2C1;
+    HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+    I2C_Type->CR1 |= I2C_CR1_SWRST;
+    I2C_Type->CR1 &= ~I2C_CR1_SWRST;
+    HAL_I2C_Init(&I2CHandle);
+}
+
+/*********************************************************************************
+ *Function     : void TwoWire::eventInterruptHandler(void)
+ *Description  : I2C 事件中断, 推进队首的传输
+ *Input        : none
+ *Output       : none
+ *Return       : none
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 写用TXE中断逐字节发送, 读1字节用RXNE, 读2字节以上用DMA并置LAST自动NACK
+ **********************************************************************************/
+void TwoWire::eventInterruptHandler(void)
+{
+    I2CTransaction *transaction;
+    uint32_t sr1 = I2C_Type->SR1;
+
+    if((queueCount == 0) || (xferState == XFER_IDLE) || (xferState == XFER_RECOVER))
+    {
+        I2C_Type->CR2 &= ~(I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN);
+        return;
+    }
+    transaction = queue[queueHead];
+
+    if(sr1 & I2C_SR1_SB)
+    {
+        if(xferState == XFER_START_WRITE)
+        {
+            I2C_Type->DR = transaction->address << 1;
+        }
+        else
+        {
+            if(transaction->rxLength == 1)
+            {
+                I2C_Type->CR1 &= ~I2C_CR1_ACK;
+            }
+            else
+            {
+                I2C_Type->CR1 |= I2C_CR1_ACK;
+            }
+            I2C_Type->DR = (transaction->address << 1) | RECEIVER;
+        }
+        return;
+    }
+
+    if(sr1 & I2C_SR1_ADDR)
+    {
+        if(xferState == XFER_START_WRITE)
+        {
+            (void)I2C_Type->SR2;
+            xferState = XFER_WRITE;
+            if(transaction->regLength + transaction->txLength == 0)
+            {
+                // 只发送地址, 用于检测设备
+                I2C_Type->CR1 |= I2C_CR1_STOP;
+                complete(I2C_STATUS_OK);
+            }
+            else
+            {
+                I2C_Type->CR2 |= I2C_CR2_ITBUFEN;
+            }
+            return;
+        }
+
+        xferState = XFER_READ;
+        if(transaction->rxLength == 1)
+        {
+            (void)I2C_Type->SR2;
+            I2C_Type->CR1 |= I2C_CR1_STOP;
+            I2C_Type->CR2 |= I2C_CR2_ITBUFEN;
+        }
+        else
+        {
+            HAL_DMA_Start_IT(&hdmaRx, (uint32_t)&I2C_Type->DR, (uint32_t)transaction->rxData, transaction->rxLength);
+            I2C_Type->CR2 |= I2C_CR2_DMAEN | I2C_CR2_LAST;
+            (void)I2C_Type->SR2;
+        }
+        return;
+    }
+
+    if(xferState == XFER_WRITE)
+    {
+        uint16_t total = transaction->regLength + transaction->txLength;
+
+        if((sr1 & I2C_SR1_TXE) && (xferIndex < total))
+        {
+            if(xferIndex < transaction->regLength)
+            {
+                I2C_Type->DR = transaction->reg;
+            }
+            else
+            {
+                I2C_Type->DR = transaction->txData[xferIndex - transaction->regLength];
+            }
+            if(++xferIndex >= total)
+            {
+                // 等待 BTF
+                I2C_Type->CR2 &= ~I2C_CR2_ITBUFEN;
+            }
+        }
+        else if(sr1 & I2C_SR1_BTF)
+        {
+            if(transaction->rxLength)
+            {
+                xferState = XFER_START_READ;
+                I2C_Type->CR1 |= I2C_CR1_START;
+            }
+            else
+            {
+                I2C_Type->CR1 |= I2C_CR1_STOP;
+                complete(I2C_STATUS_OK);
+            }
+        }
+        return;
+    }
+
+    if((xferState == XFER_READ) && (sr1 & I2C_SR1_RXNE))
+    {
+        transaction->rxData[0] = I2C_Type->DR;
+        complete(I2C_STATUS_OK);
+    }
+}
+
+/*********************************************************************************
+ *Function     : void TwoWire::errorInterruptHandler(void)
+ *Description  : I2C 错误中断
+ *Input        : none
+ *Output       : none
+ *Return       : none
+ *author       : robot
+ *date         : 2016-05-20
+ *Others       : 没有应答结束传输, 总线错误/仲裁丢失/溢出复位总线
+ **********************************************************************************/
+void TwoWire::errorInterruptHandler(void)
+{
+    uint32_t sr1 = I2C_Type->SR1;
+
+    I2C_Type->SR1 = ~(sr1 & (I2C_SR1_AF | I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_OVR)) & 0xFFFF;
+    if((queueCount == 0) || (xferState == XFER_IDLE) || (xferState == XFER_RECOVER))
+    {
+        return;
+    }
+
+    if(sr1 & (I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_OVR))
+    {
+        recoverBus();
+        complete(I2C_STATUS_ERROR);
+    }
+    else if(sr1 & I2C_SR1_AF)
+    {
+        I2C_Type->CR1 |= I2C_CR1_STOP;
+        complete(I2C_STATUS_NACK);
+    }
+}
+
+void TwoWire::dmaInterruptHandler(void)
+{
+    HAL_DMA_IRQHandler(&hdmaRx);
+}
+
+void TwoWire::dmaRxComplete(DMA_HandleTypeDef *hdma)
+{
+    TwoWire *wire = (TwoWire *)hdma->Parent;
+
+    // 超时后 recoverBus 停止 DMA 之前完成的接收, 由 checkTimeout 结束
+    if(wire->xferState != XFER_READ)
+    {
+        return;
+    }
+    wire->I2C_Type->CR1 |= I2C_CR1_STOP;
+    wire->I2C_Type->CR2 &= ~(I2C_CR2_DMAEN | I2C_CR2_LAST);
+    wire->complete(I2C_STATUS_OK);
+}
+
 // #if I2C_INTERFACES_COUNT > 0
 TwoWire Wire = TwoWire(I2C1);
 // #endif
 
+void Wiring_I2C1_EV_Interrupt_Handler(void)
+{
+    Wire.eventInterruptHandler();
+}
+
+void Wiring_I2C1_ER_Interrupt_Handler(void)
+{
+    Wire.errorInterruptHandler();
+}
+
+void Wiring_I2C1_DMA_RX_Interrupt_Handler(void)
+{
+    Wire.dmaInterruptHandler();
+}
+
 #if I2C_INTERFACES_COUNT > 1
 TwoWire Wire1 = TwoWire(I2C3);
 #endif
@@ -71,6 +71,7 @@ Distributed as-is; no warranty is given.
 #define ESP8266_FW_FWDOWN            "+DOWNFILE"  //
 #define ESP8266_FW_FWSIZE            "+GETFILESIZE"
 #define ESP8266_FW_FWPACKET          "+GETFILEPACKET"//
+#define ESP8266_FW_FWALL             "+GETFILEALL"   //滑动窗口传输, 见 lib_ota_window.h
 
 // Command Response Timeouts //
 #define COMMAND_RESPONSE_TIMEOUT    1000
@@ -106,6 +107,7 @@ void ESP8266_Wait_Ready(void);
 void ESP8266_Init();
 int16_t ESP8266_Firmware_Size(Firmware_TypeDef FmType, uint32_t PacketSize);
 int16_t ESP8266_Firware_Packet(Firmware_TypeDef FmType, uint32_t PacketSize, uint32_t PacketIndex, uint32_t timeout);
+int16_t ESP8266_Firmware_Window(Firmware_TypeDef FmType, uint32_t PacketSize, uint32_t PacketNum, uint32_t Window);
 
 void sendCommand(const char * cmd, Esp8266_Cmd_TypeDef type, const char * params);
 int16_t readForResponses(const char * pass, const char * fail, unsigned int timeout);
@@ -64,6 +64,29 @@ typedef struct __attribute__((packed)) system_params
     uint8_t  crc;                  // 系统应用参数区校验字节
 } system_params_t;
 
+/*
+  参数区(64K 扇区, 与bootloader共用)布局:
+  0                     system_params_t 基础记录, 格式与旧版本相同
+  PARAMS_SEAL_OFFSET    [CRC16(基础记录)][0x0000], 擦除后先于基础记录写入, 写基础记录时掉电加载时可以发现
+                        (旧版本写入的参数区此处为0xFFFF, 只检查 crcSum)
+  PARAMS_JOURNAL_START  日志, 每次保存追加一条, 只记录改变的字节:
+                        [长度][序号][CRC16] { [偏移][长度][数据, 补齐到2字节] } ... [提交标志]
+                        长度为各段总字节数, CRC16 覆盖长度 序号和各段, 序号逐条加1
+                        按地址顺序逐半字写入, 提交标志(0x0000)最后写入, 未提交或校验错误的日志加载时跳过
+  日志区写满, 一次改变过多, 或 system_flags 改变(旧bootloader只读基础记录)时, 擦除扇区重写基础记录.
+  参数区只有一个擦除单元, 擦除前先把新参数写入 EEPROM 系统区(Param_Eeprom_ADDR, 扇区2,3)的副本:
+  PARAMS_BACKUP_ADDRESS  [system_params_t][CRC16], 校验最后写入
+  加载时基础记录无效(擦除后封好之前掉电)则使用副本并重写参数区, 副本在下次重写之前不变
+  CRC16 为 lib_crc.h 的 crc16_ccitt_update, 初值 CRC16_INIT
+*/
+#define PARAMS_SEAL_OFFSET          1024
+#define PARAMS_JOURNAL_START        1028
+#define PARAMS_JOURNAL_END          0xFFFE      // SystemReadArgument 不能读到扇区最后一个半字
+#define PARAMS_JOURNAL_HEAD_SIZE    6
+#define PARAMS_JOURNAL_MAX          256         // 一条日志各段的最大总长度
+#define PARAMS_JOURNAL_COMMIT       0x0000
+#define PARAMS_BACKUP_ADDRESS       2048        // EEPROM 虚拟地址, 即 wiring_eeprom.h 的 Param_Eeprom_ADDR
+
 
 #ifdef __cplusplus
  extern "C" {
@@ -40,12 +40,20 @@
 #define ARGUMENT_PAGE0_BASE_ADDRESS      ((uint32_t)SYSTEM_ARGUMENT_ADDRESS)
 #define ARGUMENT_PAGE0_END_ADDRESS       ((uint32_t)(SYSTEM_ARGUMENT_ADDRESS + (ARGUMENT_PAGE_SIZE - 1)))
 
+/* EEPROM 模拟区(扇区2,3), 格式见 board/neutron/src/wiring_eeprom.cpp. bootloader 只追加记录, 不搬页 */
+#define EEPROM_START_ADDRESS    ((uint32_t)0x08008000)
+#define EEPROM_PAGE_SIZE        ((uint32_t)0x4000)
+#define EEPROM_SIZE             ((uint16_t)1024*4)
+
 #ifdef __cplusplus
  extern "C" {
 #endif
 
 void SystemReadArgument(uint32_t readStartAddress, uint16_t *dataBuffer, uint32_t size);
 int SystemWriteArgument(uint32_t writeStartAddress, uint16_t *dataBuffer, uint32_t size);
+int SystemProgramArgument(uint32_t writeStartAddress, uint16_t *dataBuffer, uint32_t size);
+int SystemReadEeprom(uint16_t eepromAddress, uint8_t *dataBuffer, uint16_t length);
+int SystemProgramEeprom(uint16_t eepromAddress, const uint8_t *dataBuffer, const uint8_t *oldBuffer, uint16_t length);
 
 
 #ifdef __cplusplus
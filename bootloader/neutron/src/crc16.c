@@ -12,41 +12,27 @@
  ****************************************************************************/
 
 #include "variant.h"
+#include "lib_crc.h"
 
 
 static uint16_t CRCSUM;
 
-/************************************************************************************
- * Private Functions
- ************************************************************************************/
-uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data)
-{
-    data ^= crc & 0xff;
-    data ^= data << 4;
-    return ((((uint16_t)data << 8) | ((crc >> 8) & 0xff)) ^
-            (uint8_t)(data >> 4) ^
-            ((uint16_t)data << 3));
-}
-
 /************************************************************************************
  *  Public Functions
  ************************************************************************************/
 void crc_reset()
 {
-    CRCSUM = 0xFFFF;
+    CRCSUM = CRC16_INIT;
 }
 
 void crc_update(uint8_t c)
 {
-    CRCSUM = _crc_ccitt_update(CRCSUM,c);
+    CRCSUM = crc16_ccitt_update(CRCSUM, &c, 1);
 }
 
 void crc_update_n(uint8_t *p_dat,int len)
 {
-    while(len--)
-    {
-        crc_update( *(p_dat++) );
-    }
+    CRCSUM = crc16_ccitt_update(CRCSUM, p_dat, len);
 }
 
 uint16_t crc_get_reseult()
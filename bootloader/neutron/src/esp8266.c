@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include "hw_config.h"
 #include "crc16.h"
+#include "lib_ota_window.h"
 
 extern UART_HandleTypeDef UartHandleA;
 extern UART_HandleTypeDef UartHandle;
@@ -14,29 +15,6 @@ extern uint8_t UsartRxByte; // Buffer Definitions //
 char esp8266RxBuffer[ESP8266_RX_BUFFER_LEN];
 unsigned int bufferHead; // Holds position of latest byte placed in buffer.
 
-/*
-uint32_t crc_update(uint32_t crc, const uint8_t *data, size_t length)
-{
-    uint32_t i;
-    bool bit;
-    uint8_t c;
-
-    while (length--) {
-        c = *data++;
-        for (i = 0x80; i > 0; i >>= 1) {
-            bit = crc & 0x80000000;
-            if (c & i) {
-                bit = !bit;
-            }
-            crc <<= 1;
-            if (bit) {
-                crc ^= 0x04c11db7;
-            }
-        }
-    }
-    return crc;
-}
-*/
 void print(char *p)
 {
     while(*p)
@@ -188,7 +166,7 @@ int16_t ESP8266_Firware_Packet(Firmware_TypeDef FmType, uint32_t PacketSize, uin
                             count += 4;
                         }
                         print("crc32 success flash end\r\n");
-                        return ESP8266_RSP_SUCCESS;
+                        return (status == HAL_OK) ? ESP8266_RSP_SUCCESS : ESP8266_RSP_MEMORY_ERR;
                     }
                     else
                     {
@@ -206,6 +184,81 @@ int16_t ESP8266_Firware_Packet(Firmware_TypeDef FmType, uint32_t PacketSize, uin
     return ESP8266_RSP_TIMEOUT; // Return the timeout error code
 }
 
+//滑动窗口传输 写入一个包
+static int ESP8266_Firmware_Write(void *arg, uint32_t index, const uint8_t *data, uint32_t len)
+{
+    ota_receiver_t *receiver = (ota_receiver_t *)arg;
+    uint32_t Internal_Flash_Address = CORE_FW_ADDRESS + index * receiver->packet_size;
+    uint32_t Internal_Flash_Data, count;
+
+    for(count = 0; (count < len) && (Internal_Flash_Address < INTERNAL_FLASH_END_ADDRESS); count += 4, Internal_Flash_Address += 4)
+    {
+        memcpy(&Internal_Flash_Data, &data[count], 4);
+        if(HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, Internal_Flash_Address, Internal_Flash_Data) != HAL_OK)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//滑动窗口传输 发送确认
+static void ESP8266_Firmware_Ack(void *arg, const char *data, uint32_t len)
+{
+    HAL_UART_Transmit(&UartHandle, (uint8_t *)data, len, 100);
+}
+
+/*
+滑动窗口接收固件 (AT+GETFILEALL)
+PacketNum 为 AT+GETFILESIZE 以 PacketSize 查询的包个数, flash 需要先擦除并解锁
+写flash时串口中断继续把数据放入队列, 写入与接收重叠
+返回 ESP8266_RSP_SUCCESS 成功  ESP8266_RSP_FAIL esp8266固件不支持  其他失败
+*/
+int16_t ESP8266_Firmware_Window(Firmware_TypeDef FmType, uint32_t PacketSize, uint32_t PacketNum, uint32_t Window)
+{
+    ota_receiver_t receiver;
+    ota_rx_status_t status;
+    char params[32];
+    uint8_t chunk[64];
+    uint32_t len;
+
+    if(PacketSize + OTA_WINDOW_CRC_SIZE > ESP8266_RX_BUFFER_LEN)
+    {
+        return ESP8266_CMD_BAD;
+    }
+    memset(params, 0, sizeof(params));
+    sprintf(params, "%d,%d,%d", (int)PacketSize, (FmType == DEFAULT_FIRWARE) ? 1 : 0, (int)Window);
+
+    //丢弃之前的数据
+    while(sdkGetQueueData(&USART_Rx_Queue, chunk));
+    ota_receiver_init(&receiver, (uint8_t *)esp8266RxBuffer, PacketSize, PacketNum, Window,
+            ESP8266_Firmware_Write, ESP8266_Firmware_Ack, &receiver, millis());
+    sendCommand(ESP8266_FW_FWALL, ESP8266_CMD_SETUP, params);
+    do
+    {
+        for(len = 0; (len < sizeof(chunk)) && sdkGetQueueData(&USART_Rx_Queue, &chunk[len]); len++);
+        status = ota_receiver_input(&receiver, chunk, len, millis());
+        if(OTA_RX_RUNNING == status)
+        {
+            status = ota_receiver_poll(&receiver, millis());
+        }
+    }while(OTA_RX_RUNNING == status);
+
+    switch(status)
+    {
+        case OTA_RX_DONE:
+            return ESP8266_RSP_SUCCESS;
+        case OTA_RX_REJECTED:
+            return ESP8266_RSP_FAIL;
+        case OTA_RX_TIMEOUT:
+            return ESP8266_RSP_TIMEOUT;
+        case OTA_RX_WRITE_ERROR:
+            return ESP8266_RSP_MEMORY_ERR;
+        default:
+            return ESP8266_RSP_UNKNOWN;
+    }
+}
+
 void sendCommand(const char * cmd, Esp8266_Cmd_TypeDef CmdType, const char * params)
 {
     char temp[64];
@@ -433,43 +433,55 @@ void FLASH_Erase()
     FLASH_Erase_Impl(CORE_FW_ADDRESS, (INTERNAL_FLASH_END_ADDRESS - CORE_FW_ADDRESS));
 }
 
-void FLASH_Restore(Firmware_TypeDef FmType)
+/*
+从esp8266取回固件写入应用区, 全部包都写入成功时返回true
+擦除之后失败时应用区不完整, 调用者不能启动应用程序
+*/
+bool FLASH_Restore(Firmware_TypeDef FmType)
 {
     #define PACKAGE_UNIT 16384  //16k
+    #define WINDOW_PACKAGE_UNIT 2048    //滑动窗口传输的包大小
+    #define WINDOW_PACKAGE_NUM  4       //滑动窗口最多未确认的包
     int PacketNum,Count;
+    int16_t rsp;
 
-    PacketNum=ESP8266_Firmware_Size(FmType, PACKAGE_UNIT);
-    if(PacketNum)
+    PacketNum=ESP8266_Firmware_Size(FmType, WINDOW_PACKAGE_UNIT);
+    if(PacketNum <= 0)
     {
-        print("erase begin\r\n");
-        FLASH_Erase_Impl(CORE_FW_ADDRESS, PacketNum * PACKAGE_UNIT) ;
-        //FLASH_Erase();
-        print("erase over\r\n");
-        HAL_FLASH_Unlock();
-        for(Count = 0; Count < PacketNum; Count++)
+        return false;
+    }
+    print("erase begin\r\n");
+    FLASH_Erase_Impl(CORE_FW_ADDRESS, PacketNum * WINDOW_PACKAGE_UNIT) ;
+    //FLASH_Erase();
+    print("erase over\r\n");
+    HAL_FLASH_Unlock();
+    //旧的esp8266固件不支持滑动窗口, 逐包传输
+    rsp = ESP8266_Firmware_Window(FmType, WINDOW_PACKAGE_UNIT, PacketNum, WINDOW_PACKAGE_NUM);
+    if(rsp == ESP8266_RSP_FAIL)
+    {
+        PacketNum = (PacketNum * WINDOW_PACKAGE_UNIT + PACKAGE_UNIT - 1) / PACKAGE_UNIT;
+        for(Count = 0, rsp = ESP8266_RSP_SUCCESS; (Count < PacketNum) && (rsp == ESP8266_RSP_SUCCESS); Count++)
         {
-            ESP8266_Firware_Packet(FmType, PACKAGE_UNIT, Count, 1000);
+            rsp = ESP8266_Firware_Packet(FmType, PACKAGE_UNIT, Count, 1000);
         }
-        HAL_FLASH_Lock();
     }
+    HAL_FLASH_Lock();
+    return rsp == ESP8266_RSP_SUCCESS;
 }
 
 bool FACTORY_Flash_Reset(void)
 {
-    FLASH_Restore(DEFAULT_FIRWARE);
-    return true;
+    return FLASH_Restore(DEFAULT_FIRWARE);
 }
 
 bool DEFAULT_Flash_Reset(void)
 {
-    FLASH_Restore(DEFAULT_FIRWARE);
-    return true;
+    return FLASH_Restore(DEFAULT_FIRWARE);
 }
 
 bool OTA_Flash_Reset(void)
 {
-    FLASH_Restore(OTA_FIRWARE);
-    return true;
+    return FLASH_Restore(OTA_FIRWARE);
 }
 
 system_tick_t millis(void)
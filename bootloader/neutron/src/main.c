@@ -60,6 +60,7 @@ void Enter_Default_Firmware_Update_Mode();
 void Enter_ESP8266_Com_Mode(void);
 void Enter_Factory_Update_Mode(char type);
 void Enter_OTA_Firmware_Update_Mode(void);
+void Flash_Reset_Failed(void);
 
 
 extern void usartA2A3begin(uint32_t baud);
@@ -272,6 +273,19 @@ void Enter_ESP8266_Com_Mode(void)
     }
 }
 
+/*
+固件没有完整写入: 应用区可能已经擦除或者只写了一部分, 不能启动.
+boot_flag 保持不变, 复位后重新下载 (按键仍然可以进入DFU等模式)
+*/
+void Flash_Reset_Failed(void)
+{
+    print("firmware restore failed\r\n");
+    LED_Signaling_Stop();
+    Set_RGB_LED_Color(RGB_COLOR_RED);
+    delay(1000);
+    HAL_NVIC_SystemReset();
+}
+
 void Enter_Default_Firmware_Update_Mode(void)
 {
     LED_SetSignalingColor(RGB_COLOR_YELLOW);
@@ -284,7 +298,10 @@ void Enter_Default_Firmware_Update_Mode(void)
 
     intorobot_system_params.system_flags.boot_flag = 1;
     Save_SystemFlags();
-    DEFAULT_Flash_Reset();
+    if(!DEFAULT_Flash_Reset())
+    {
+        Flash_Reset_Failed();
+    }
     intorobot_system_params.system_flags.boot_flag = 0;
     Save_SystemFlags();
     LED_Signaling_Stop();
@@ -309,7 +326,10 @@ void Enter_Factory_Update_Mode(char type)
         intorobot_system_params.system_flags.boot_flag = 5;
     }
     Save_SystemFlags();
-    FACTORY_Flash_Reset();
+    if(!FACTORY_Flash_Reset())
+    {
+        Flash_Reset_Failed();
+    }
     intorobot_system_params.system_flags.boot_flag = 0;
     if(type==0)
     {
@@ -334,7 +354,10 @@ void Enter_OTA_Firmware_Update_Mode(void)
 
     intorobot_system_params.system_flags.boot_flag = 4;
     Save_SystemFlags();
-    OTA_Flash_Reset();
+    if(!OTA_Flash_Reset())
+    {
+        Flash_Reset_Failed();
+    }
     intorobot_system_params.system_flags.boot_flag = 0;
     Save_SystemFlags();
 
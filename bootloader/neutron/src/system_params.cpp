@@ -1,5 +1,6 @@
 #include "system_params.h"
 #include "wiring_flash_memory.h"
+#include "lib_crc.h"
 
  extern "C" {
 
@@ -19,6 +20,153 @@ uint8_t crcSum( const uint8_t *data, uint32_t len)
     return sum;
 }
 
+static bool checkSystemParams(system_params_t *psystem_params)
+{
+    return ( 0x5aa5f66f == psystem_params->system_flags.header )
+            &&(psystem_params->system_flags.crc == crcSum((const uint8_t *)&psystem_params->system_flags, sizeof(system_flags_t)-1))
+            &&(psystem_params->crc == crcSum((const uint8_t *)&psystem_params->version, sizeof(system_params_t)-sizeof(system_flags_t)-1));
+}
+
+//基础记录的 crcSum, 以及有封记时的 CRC16
+static bool checkSystemParamsBase(system_params_t *psystem_params)
+{
+    uint16_t seal[2];
+
+    if(!checkSystemParams(psystem_params))
+    {
+        return false;
+    }
+    SystemReadArgument(SYSTEM_ARGUMENT_ADDRESS + PARAMS_SEAL_OFFSET, seal, 2);
+    if((0xFFFF == seal[0]) && (0xFFFF == seal[1]))
+    {
+        return true;
+    }
+    return (PARAMS_JOURNAL_COMMIT == seal[1])
+            && (seal[0] == crc16_ccitt_update(CRC16_INIT, psystem_params, sizeof(system_params_t)));
+}
+
+//EEPROM 中的参数副本 [system_params_t][CRC16], 与应用程序相同
+static uint8_t params_backup[sizeof(system_params_t) + 2];
+static uint8_t params_backup_new[sizeof(system_params_t) + 2];
+
+//读取参数副本, 副本无效时返回false
+static bool loadSystemParamsBackup(system_params_t *psystem_params)
+{
+    uint16_t crc;
+
+    if(SystemReadEeprom(PARAMS_BACKUP_ADDRESS, params_backup, sizeof(params_backup)))
+    {
+        return false;
+    }
+    memcpy(psystem_params, params_backup, sizeof(system_params_t));
+    memcpy(&crc, params_backup + sizeof(system_params_t), 2);
+    return checkSystemParams(psystem_params)
+            && (crc == crc16_ccitt_update(CRC16_INIT, psystem_params, sizeof(system_params_t)));
+}
+
+//写入参数副本, 校验在最后
+static int saveSystemParamsBackup(system_params_t *psystem_params)
+{
+    uint16_t crc = crc16_ccitt_update(CRC16_INIT, psystem_params, sizeof(system_params_t));
+
+    if(SystemReadEeprom(PARAMS_BACKUP_ADDRESS, params_backup, sizeof(params_backup)))
+    {
+        return 1;
+    }
+    memcpy(params_backup_new, psystem_params, sizeof(system_params_t));
+    memcpy(params_backup_new + sizeof(system_params_t), &crc, 2);
+    return SystemProgramEeprom(PARAMS_BACKUP_ADDRESS, params_backup_new, params_backup, sizeof(params_backup));
+}
+
+//先写参数副本, 再擦除参数区, 先写封记再写基础记录. 擦除之后封好之前掉电, 加载时使用副本
+static void writeSystemParamsBase(system_params_t *psystem_params)
+{
+    uint16_t seal[2];
+
+    //副本写不下(EEPROM 页满, 由应用程序搬页)时仍然重写
+    saveSystemParamsBackup(psystem_params);
+    seal[0] = crc16_ccitt_update(CRC16_INIT, psystem_params, sizeof(system_params_t));
+    seal[1] = PARAMS_JOURNAL_COMMIT;
+    SystemWriteArgument(SYSTEM_ARGUMENT_ADDRESS + PARAMS_SEAL_OFFSET, seal, 2);
+    SystemProgramArgument(SYSTEM_ARGUMENT_ADDRESS, (uint16_t *)psystem_params, sizeof(system_params_t)/2);
+}
+
+//日志各段: 检查(apply=false)或写入 psystem_params. 段越界时返回false
+static bool applySystemParamsJournal(system_params_t *psystem_params, const uint8_t *runs, uint16_t length, bool apply)
+{
+    uint16_t pos = 0, offset, size;
+
+    while(pos < length)
+    {
+        if(length - pos < 4)
+        {
+            return false;
+        }
+        memcpy(&offset, runs + pos, 2);
+        memcpy(&size, runs + pos + 2, 2);
+        pos += 4;
+        if((size == 0) || (size > length - pos) || (offset + size > sizeof(system_params_t)))
+        {
+            return false;
+        }
+        if(apply)
+        {
+            memcpy((uint8_t *)psystem_params + offset, runs + pos, size);
+        }
+        pos += (size + 1) & ~1;
+    }
+    return true;
+}
+
+/*********************************************************************************
+  *Function		:   static uint32_t replaySystemParamsJournal(system_params_t *psystem_params, uint16_t *psequence)
+  *Description	:   apply the committed journal entries after the base record, in order
+  *Input		      :   psystem_params: the base record
+  *Output		:   psequence: sequence of the last applied entry
+  *Return		:   offset to append the next entry, PARAMS_JOURNAL_END if the journal is full or damaged
+  *author		:   robot
+  *date			:   2016-05-20
+  *Others		:   an entry cut by a power loss (no commit, bad crc) is skipped
+**********************************************************************************/
+static uint32_t replaySystemParamsJournal(system_params_t *psystem_params, uint16_t *psequence)
+{
+    uint16_t entry[(PARAMS_JOURNAL_HEAD_SIZE + PARAMS_JOURNAL_MAX + 2) / 2];
+    uint32_t pos = PARAMS_JOURNAL_START;
+    uint16_t sequence = 0;
+    bool first = true;
+
+    while(pos + PARAMS_JOURNAL_HEAD_SIZE + 2 <= PARAMS_JOURNAL_END)
+    {
+        SystemReadArgument(SYSTEM_ARGUMENT_ADDRESS + pos, entry, PARAMS_JOURNAL_HEAD_SIZE/2);
+        uint16_t length = entry[0];
+        if(0xFFFF == length)
+        {
+            break;
+        }
+        uint32_t size = PARAMS_JOURNAL_HEAD_SIZE + length + 2;
+        if((length > PARAMS_JOURNAL_MAX) || (length & 1) || (pos + size > PARAMS_JOURNAL_END))
+        {
+            //长度损坏, 无法找到下一条日志
+            pos = PARAMS_JOURNAL_END;
+            break;
+        }
+        SystemReadArgument(SYSTEM_ARGUMENT_ADDRESS + pos, entry, size/2);
+        const uint8_t *runs = (const uint8_t *)entry + PARAMS_JOURNAL_HEAD_SIZE;
+        if((PARAMS_JOURNAL_COMMIT == entry[size/2 - 1])
+                && (entry[2] == crc16_ccitt_update(crc16_ccitt_update(CRC16_INIT, entry, 4), runs, length))
+                && (first || (entry[1] == (uint16_t)(sequence + 1)))
+                && applySystemParamsJournal(psystem_params, runs, length, false))
+        {
+            applySystemParamsJournal(psystem_params, runs, length, true);
+            sequence = entry[1];
+            first = false;
+        }
+        pos += size;
+    }
+    *psequence = sequence;
+    return pos;
+}
+
 /*初始化系统参数区*/
 void initSystemParams(system_params_t *psystem_params)
 {
@@ -52,13 +200,28 @@ void initFacSystemParams(system_params_t *psystem_params)
 /*加载系统参数区*/
 void loadSystemParams(system_params_t *psystem_params)
 {
+    uint16_t sequence;
+
     memset(psystem_params, 0, sizeof(system_params_t));
     SystemReadArgument(SYSTEM_ARGUMENT_ADDRESS, (uint16_t *)psystem_params, sizeof(system_params_t)/2);
-    if(( 0x5aa5f66f != psystem_params->system_flags.header )
-            ||(psystem_params->system_flags.crc != crcSum((const uint8_t *)&psystem_params->system_flags, sizeof(system_flags_t)-1))
-            ||(psystem_params->crc != crcSum((const uint8_t *)&psystem_params->version, sizeof(system_params_t)-sizeof(system_flags_t)-1)))
+    if(!checkSystemParamsBase(psystem_params))
+    {
+        //擦除重写时掉电, 从参数副本恢复. 副本也无效时才初始化
+        if(loadSystemParamsBackup(psystem_params))
+        {
+            writeSystemParamsBase(psystem_params);
+        }
+        else
+        {
+            initSystemParams(psystem_params);
+        }
+        return;
+    }
+    //应用程序保存的日志, 保存时整体重写参数区(日志合并到基础记录)
+    replaySystemParamsJournal(psystem_params, &sequence);
+    if(!checkSystemParams(psystem_params))
     {
-        initSystemParams(psystem_params);
+        SystemReadArgument(SYSTEM_ARGUMENT_ADDRESS, (uint16_t *)psystem_params, sizeof(system_params_t)/2);
     }
 }
 
@@ -67,6 +230,6 @@ void saveSystemParams(system_params_t *psystem_params)
 {
     psystem_params->system_flags.crc = crcSum((const uint8_t *)&psystem_params->system_flags, sizeof(system_flags_t)-1);
     psystem_params->crc = crcSum((const uint8_t *)&psystem_params->version, sizeof(system_params_t)-sizeof(system_flags_t)-1);
-    SystemWriteArgument(SYSTEM_ARGUMENT_ADDRESS, (uint16_t *)psystem_params, sizeof(system_params_t)/2);
+    writeSystemParamsBase(psystem_params);
 }
 
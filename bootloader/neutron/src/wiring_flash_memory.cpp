@@ -22,6 +22,7 @@
  License along with this library; if not, see <http://www.gnu.org/licenses/>.
  ******************************************************************************
  */
+#include <string.h>
 #include "wiring_flash_memory.h"
 #include "usbd_dfu_if.h"
 
@@ -157,3 +158,180 @@ int SystemWriteArgument(uint32_t writeStartAddress, uint16_t *dataBuffer, uint32
     return flashStatus;
 }
 
+/*********************************************************************************
+ *Function		: int SystemProgramArgument(uint32_t writeStartAddress, uint16_t *dataBuffer, uint32_t size)
+ *Description	: program half words into the erased part of the argument area, without erasing
+ *Input		      : address data number
+ *Output		: none
+ *Return		: 0 ok  other error
+ *author		: robot
+ *date			: 2016-05-20
+ *Others		: none
+ **********************************************************************************/
+int SystemProgramArgument(uint32_t writeStartAddress, uint16_t *dataBuffer, uint32_t size)
+{
+    uint32_t address = writeStartAddress;
+    uint32_t endAddress = writeStartAddress + size * 2;
+    uint16_t i = 0;
+
+    if((address < SYSTEM_ARGUMENT_ADDRESS)
+            || (endAddress > SYSTEM_ARGUMENT_END_ADDRESS
+                || ((address % 2) != 0)))
+    {
+        return 2;//FLASH_ERROR_PG;
+    }
+
+    HAL_StatusTypeDef flashStatus = HAL_OK;
+    HAL_FLASH_Unlock();
+    while((address < endAddress) && (flashStatus == HAL_OK))
+    {
+        flashStatus = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, address, dataBuffer[i++]);
+        address = address + 2;
+    }
+    /* Locks the FLASH Program Erase Controller */
+    HAL_FLASH_Lock();
+    return flashStatus;
+}
+
+#define EEPROM_PAGE_ERASED          ((uint16_t)0xFFFF)
+#define EEPROM_PAGE_RECEIVE_DATA    ((uint16_t)0xEEEE)
+#define EEPROM_PAGE_VALID           ((uint16_t)0x0000)
+#define EEPROM_PAIR_FLAG            ((uint16_t)0x8000)
+#define EEPROM_RECORD_START         ((uint32_t)4)
+#define EEPROM_RECORD_SIZE          ((uint32_t)4)
+#define EEPROM_RECORD_ERASED        ((uint32_t)0xFFFFFFFF)
+
+/*********************************************************************************
+ *Function		: static uint32_t EEPROM_ValidPage(bool append)
+ *Description	: find the EEPROM page that holds the current values
+ *Input		      : append: the page is also written, the other page has to be erased
+ *Output		: none
+ *Return		: base address of the page, 0 if there is none
+ *author		: robot
+ *date			: 2016-05-20
+ *Others		: a transfer cut by a power loss is finished by the application, until then
+ *                  the valid page (or the receiving page once the old one is erased) is read only
+ **********************************************************************************/
+static uint32_t EEPROM_ValidPage(bool append)
+{
+    uint16_t status0 = *(uint16_t *)EEPROM_START_ADDRESS;
+    uint16_t status1 = *(uint16_t *)(EEPROM_START_ADDRESS + EEPROM_PAGE_SIZE);
+
+    if((EEPROM_PAGE_VALID == status0) && (EEPROM_PAGE_VALID != status1))
+    {
+        return (!append || (EEPROM_PAGE_ERASED == status1)) ? EEPROM_START_ADDRESS : 0;
+    }
+    if((EEPROM_PAGE_VALID == status1) && (EEPROM_PAGE_VALID != status0))
+    {
+        return (!append || (EEPROM_PAGE_ERASED == status0)) ? EEPROM_START_ADDRESS + EEPROM_PAGE_SIZE : 0;
+    }
+    if(!append && (EEPROM_PAGE_RECEIVE_DATA == status0) && (EEPROM_PAGE_ERASED == status1))
+    {
+        return EEPROM_START_ADDRESS;
+    }
+    if(!append && (EEPROM_PAGE_RECEIVE_DATA == status1) && (EEPROM_PAGE_ERASED == status0))
+    {
+        return EEPROM_START_ADDRESS + EEPROM_PAGE_SIZE;
+    }
+    return 0;
+}
+
+//按顺序回放 page 中地址在 [eepromAddress, eepromAddress+length) 的记录, 返回第一条空记录的偏移
+static uint32_t EEPROM_ReplayPage(uint32_t page, uint16_t eepromAddress, uint8_t *dataBuffer, uint16_t length)
+{
+    uint32_t offset;
+
+    for(offset = EEPROM_RECORD_START; offset < EEPROM_PAGE_SIZE; offset += EEPROM_RECORD_SIZE)
+    {
+        uint32_t record = *(uint32_t *)(page + offset);
+        if(EEPROM_RECORD_ERASED == record)
+        {
+            break;
+        }
+        uint16_t address = (uint16_t)(record >> 16), data = (uint16_t)record;
+        uint16_t count = 1;
+        if(address & EEPROM_PAIR_FLAG)
+        {
+            address &= ~EEPROM_PAIR_FLAG;
+            count = (address & 1) ? 0 : 2;
+        }
+        for(uint16_t i = 0; (i < count) && (address + i < EEPROM_SIZE); i++, data >>= 8)
+        {
+            if((address + i >= eepromAddress) && (address + i < eepromAddress + length))
+            {
+                dataBuffer[address + i - eepromAddress] = (uint8_t)data;
+            }
+        }
+    }
+    return offset;
+}
+
+/*********************************************************************************
+ *Function		: int SystemReadEeprom(uint16_t eepromAddress, uint8_t *dataBuffer, uint16_t length)
+ *Description	: read length bytes of the EEPROM emulated by the application
+ *Input		      : eepromAddress: virtual address  length: number of bytes
+ *Output		: dataBuffer: the bytes, 0xFF where nothing was written
+ *Return		: 0 ok  other: no valid page
+ *author		: robot
+ *date			: 2016-05-20
+ *Others		: none
+ **********************************************************************************/
+int SystemReadEeprom(uint16_t eepromAddress, uint8_t *dataBuffer, uint16_t length)
+{
+    uint32_t page = EEPROM_ValidPage(false);
+
+    memset(dataBuffer, 0xFF, length);
+    if(0 == page)
+    {
+        return 1;
+    }
+    EEPROM_ReplayPage(page, eepromAddress, dataBuffer, length);
+    return 0;
+}
+
+/*********************************************************************************
+ *Function		: int SystemProgramEeprom(uint16_t eepromAddress, const uint8_t *dataBuffer, const uint8_t *oldBuffer, uint16_t length)
+ *Description	: append the byte pairs that differ from oldBuffer to the valid EEPROM page
+ *Input		      : eepromAddress, length: even  oldBuffer: current bytes, read with SystemReadEeprom
+ *Output		: none
+ *Return		: 0 ok  other: no valid page, page full or flash error
+ *author		: robot
+ *date			: 2016-05-20
+ *Others		: pairs are written in address order. the page transfer is left to the application,
+ *                  if the page is full nothing is written
+ **********************************************************************************/
+int SystemProgramEeprom(uint16_t eepromAddress, const uint8_t *dataBuffer, const uint8_t *oldBuffer, uint16_t length)
+{
+    uint32_t page = EEPROM_ValidPage(true), offset, records = 0;
+    uint16_t i;
+
+    if((0 == page) || ((eepromAddress | length) & 1) || (eepromAddress + length > EEPROM_SIZE))
+    {
+        return 1;
+    }
+    offset = EEPROM_ReplayPage(page, 0, NULL, 0);
+    for(i = 0; i < length; i += 2)
+    {
+        records += (dataBuffer[i] != oldBuffer[i]) || (dataBuffer[i + 1] != oldBuffer[i + 1]);
+    }
+    if(records > (EEPROM_PAGE_SIZE - offset) / EEPROM_RECORD_SIZE)
+    {
+        return 2;
+    }
+
+    HAL_StatusTypeDef flashStatus = HAL_OK;
+    HAL_FLASH_Unlock();
+    for(i = 0; (i < length) && (flashStatus == HAL_OK); i += 2)
+    {
+        if((dataBuffer[i] == oldBuffer[i]) && (dataBuffer[i + 1] == oldBuffer[i + 1]))
+        {
+            continue;
+        }
+        uint32_t record = ((uint32_t)(EEPROM_PAIR_FLAG | (eepromAddress + i)) << 16)
+                          | ((uint32_t)dataBuffer[i + 1] << 8) | dataBuffer[i];
+        flashStatus = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, page + offset, record);
+        offset += EEPROM_RECORD_SIZE;
+    }
+    HAL_FLASH_Lock();
+    return flashStatus;
+}
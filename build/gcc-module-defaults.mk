@@ -25,10 +25,12 @@ CFLAGS += -Werror
 endif
 
 # add include directories
-CFLAGS += $(patsubst %,-I%,$(INCLUDE_DIRS)) -I/usr/local/include -I.
+CINCLUDES += $(patsubst %,-I%,$(INCLUDE_DIRS)) -I/usr/local/include -I.
 # Generate dependency files automatically.
 CFLAGS += -MD -MP -MF $@.d
 
+CONLYFLAGS += -Wno-pointer-sign -std=gnu99
+
 LDFLAGS += $(LIBS_EXT)
 LDFLAGS += $(patsubst %,-L%,$(LIB_DIRS))
 
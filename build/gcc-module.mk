@@ -29,7 +29,7 @@ endif
 TARGET_FILE_NAME ?= $(MODULE)
 
 ifneq (,$(GLOBAL_DEFINES))
-CFLAGS += $(addprefix -D,$(GLOBAL_DEFINES))
+CDEFINES += $(addprefix -D,$(GLOBAL_DEFINES))
 export GLOBAL_DEFINES
 endif
 
@@ -147,7 +147,7 @@ $(BUILD_PATH)/%.o : $(SOURCE_PATH)/%.c
 	$(call echo,'Building file: $<')
 	$(call echo,'Invoking: ARM GCC C Compiler')
 	$(VERBOSE)$(MKDIR) $(dir $@)
-	$(VERBOSE)$(CC) $(CFLAGS) $(CONLYFLAGS) -c -o $@ $<
+	$(VERBOSE)$(CC) $(CFLAGS) $(CDEFINES) $(CINCLUDES) $(CONLYFLAGS) -c -o $@ $<
 	$(call echo,)
 
 # Assember to build .o from .S in $(BUILD_DIR)
@@ -164,7 +164,7 @@ $(BUILD_PATH)/%.o : $(SOURCE_PATH)/%.cpp
 	$(call echo,'Building file: $<')
 	$(call echo,'Invoking: ARM GCC CPP Compiler')
 	$(VERBOSE)$(MKDIR) $(dir $@)
-	$(VERBOSE)$(CC) $(CFLAGS) $(CPPFLAGS) -c -o $@ $<
+	$(VERBOSE)$(CPP) $(CDEFINES) $(CFLAGS) $(CPPFLAGS) $(CINCLUDES) -c -o $@ $<
 	$(call echo,)
 
 # Other Targets
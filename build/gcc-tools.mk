@@ -4,7 +4,7 @@ GCC_PREFIX=
 include $(COMMON_BUILD)/common-tools.mk
 
 #
-# default flags for targeting ARM
+# default flags for building the host (x-compile) executable
 #
 
 GCC_OPTIMIZE=3
@@ -14,8 +14,10 @@ endif
 
 # C compiler flags
 CFLAGS +=  -g3 -m64 -O$(GCC_OPTIMIZE) -gdwarf-2
+CFLAGS += -fno-strict-aliasing -w -fno-common -ffunction-sections -fdata-sections
 CFLAGS += -Wno-unused-local-typedefs -Wno-return-type-c-linkage
 CPPFLAGS += -Wno-unused-private-field
+CPPFLAGS += -fno-exceptions -fno-rtti -std=gnu++11 -fcheck-new
 ASFLAGS +=  -g3
 
 
@@ -166,6 +166,10 @@ CDEFINES += -DUSBD_PID_DFU=$(USBD_PID_DFU)
 CDEFINES += -DUSBD_PID_CDC=$(USBD_PID_CDC)
 endif
 
+ifeq ("$(ARCH)","gcc")
+CDEFINES += -DPLATFORM_ID=$(PLATFORM_ID) -DPLATFORM_NAME=$(PLATFORM_NAME)
+endif
+
 MODULE_FUNCTION_NONE            :=0
 MODULE_FUNCTION_RESOURCE        :=1
 MODULE_FUNCTION_BOOTLOADER      :=2
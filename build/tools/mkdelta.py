@@ -0,0 +1,346 @@
+#!/usr/bin/env python3
+#
+# 生成 neutron 应用程序的差分升级包, 格式见 platform/MCU/shared/delta/inc/lib_delta.h
+#
+#   mkdelta.py old.bin new.bin patch.bin        生成差分包, 并用旧固件还原一次检查
+#   mkdelta.py -a old.bin patch.bin out.bin     用差分包还原新固件
+#
+# 差分算法与 bsdiff 相同(近似匹配 + 差值), 匹配查找用哈希索引代替后缀数组
+# 压缩为 heatshrink 的 LZSS 位流, 设备端只需要 2^W 字节的窗口
+
+import argparse
+import struct
+import sys
+import zlib
+
+DELTA_MAGIC = 0x31445249
+DELTA_HEAD_SIZE = 28
+DELTA_WINDOW_BITS_MAX = 10
+
+HASH_LEN = 8            # 最短匹配
+HASH_CANDIDATES = 32    # 每次最多比较的位置
+LZ_MIN_MATCH = 3
+LZ_CANDIDATES = 16
+
+
+def crc32(data, crc=0xFFFFFFFF):
+    # CRC-32/MPEG-2: 多项式0x04C11DB7 高位先行 不反射 不取反, 与STM32的CRC单元相同
+    # zlib 的是反射的CRC, 这里把输入和结果按位翻转后借用
+    rev = bytes(REVERSE_BITS[b] for b in data)
+    return reverse32(zlib.crc32(rev, reverse32(crc) ^ 0xFFFFFFFF) ^ 0xFFFFFFFF)
+
+
+def reverse32(v):
+    return int('{:032b}'.format(v)[::-1], 2)
+
+
+REVERSE_BITS = bytes(int('{:08b}'.format(i)[::-1], 2) for i in range(256))
+
+
+def match_len(a, ai, b, bi, limit):
+    n = 0
+    step = 64
+    while n < limit:
+        s = min(step, limit - n)
+        if a[ai + n:ai + n + s] == b[bi + n:bi + n + s]:
+            n += s
+            continue
+        if s == 1:
+            break
+        step = max(1, s // 8)
+    return n
+
+
+class Matcher(object):
+    def __init__(self, old):
+        self.old = old
+        self.index = {}
+        for i in range(len(old) - HASH_LEN + 1):
+            self.index.setdefault(old[i:i + HASH_LEN], []).append(i)
+
+    def search(self, new, scan):
+        key = new[scan:scan + HASH_LEN]
+        best_len, best_pos = 0, 0
+        if len(key) < HASH_LEN:
+            return best_len, best_pos
+        cands = self.index.get(key, ())
+        if len(cands) > HASH_CANDIDATES:
+            cands = cands[:HASH_CANDIDATES // 2] + cands[-HASH_CANDIDATES // 2:]
+        limit_new = len(new) - scan
+        for pos in cands:
+            n = match_len(self.old, pos, new, scan, min(limit_new, len(self.old) - pos))
+            if n > best_len:
+                best_len, best_pos = n, pos
+        return best_len, best_pos
+
+
+def bsdiff(old, new):
+    # 返回 (diff_len, extra_len, seek, diff, extra) 序列
+    matcher = Matcher(old)
+    oldsize, newsize = len(old), len(new)
+    records = []
+    scan = length = pos = 0
+    lastscan = lastpos = lastoffset = 0
+
+    while scan < newsize:
+        oldscore = 0
+        scan += length
+        scsc = scan
+        while scan < newsize:
+            length, pos = matcher.search(new, scan)
+            while scsc < scan + length:
+                if scsc + lastoffset < oldsize and old[scsc + lastoffset] == new[scsc]:
+                    oldscore += 1
+                scsc += 1
+            if (length == oldscore and length != 0) or length > oldscore + 8:
+                break
+            if scan + lastoffset < oldsize and old[scan + lastoffset] == new[scan]:
+                oldscore -= 1
+            scan += 1
+
+        if length != oldscore or scan == newsize:
+            s = sf = lenf = 0
+            i = 0
+            while lastscan + i < scan and lastpos + i < oldsize:
+                if old[lastpos + i] == new[lastscan + i]:
+                    s += 1
+                i += 1
+                if s * 2 - i > sf * 2 - lenf:
+                    sf, lenf = s, i
+
+            lenb = 0
+            if scan < newsize:
+                s = sb = 0
+                i = 1
+                while scan >= lastscan + i and pos >= i:
+                    if old[pos - i] == new[scan - i]:
+                        s += 1
+                    if s * 2 - i > sb * 2 - lenb:
+                        sb, lenb = s, i
+                    i += 1
+
+            if lastscan + lenf > scan - lenb:
+                overlap = (lastscan + lenf) - (scan - lenb)
+                s = ss = lens = 0
+                for i in range(overlap):
+                    if new[lastscan + lenf - overlap + i] == old[lastpos + lenf - overlap + i]:
+                        s += 1
+                    if new[scan - lenb + i] == old[pos - lenb + i]:
+                        s -= 1
+                    if s > ss:
+                        ss, lens = s, i + 1
+                lenf += lens - overlap
+                lenb -= lens
+
+            diff = bytes((new[lastscan + i] - old[lastpos + i]) & 0xFF for i in range(lenf))
+            extra = new[lastscan + lenf:scan - lenb]
+            seek = (pos - lenb) - (lastpos + lenf)
+            records.append((lenf, len(extra), seek, diff, extra))
+
+            lastscan = scan - lenb
+            lastpos = pos - lenb
+            lastoffset = pos - scan
+    return records
+
+
+def varint(v):
+    out = bytearray()
+    while True:
+        b = v & 0x7F
+        v >>= 7
+        if v:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return bytes(out)
+
+
+def zigzag(v):
+    return (v << 1) if v >= 0 else ((-v << 1) - 1)
+
+
+def serialize(records):
+    out = bytearray()
+    for diff_len, extra_len, seek, diff, extra in records:
+        out += varint(diff_len) + varint(extra_len) + varint(zigzag(seek))
+        out += diff + extra
+    return bytes(out)
+
+
+class BitWriter(object):
+    def __init__(self):
+        self.out = bytearray()
+        self.value = 0
+        self.bits = 0
+
+    def put(self, value, bits):
+        for b in range(bits - 1, -1, -1):
+            self.value = (self.value << 1) | ((value >> b) & 1)
+            self.bits += 1
+            if self.bits == 8:
+                self.out.append(self.value)
+                self.value = self.bits = 0
+
+    def finish(self):
+        if self.bits:
+            self.out.append(self.value << (8 - self.bits))
+            self.value = self.bits = 0
+        return bytes(self.out)
+
+
+def lzss_compress(data, window_bits, count_bits):
+    window = 1 << window_bits
+    max_count = 1 << count_bits
+    chains = {}
+    bw = BitWriter()
+    i = 0
+    n = len(data)
+    next_prune = 4 * window
+
+    def insert(pos):
+        key = data[pos:pos + LZ_MIN_MATCH]
+        if len(key) == LZ_MIN_MATCH:
+            chains.setdefault(key, []).append(pos)
+
+    while i < n:
+        best_len, best_dist = 0, 0
+        key = data[i:i + LZ_MIN_MATCH]
+        cands = chains.get(key, ())
+        limit = min(max_count, n - i)
+        checked = 0
+        for pos in reversed(cands):
+            dist = i - pos
+            if dist > window:
+                break
+            # 距离为1时 data[pos:] 与 data[i:] 重叠, 解码时逐字节复制, 结果相同
+            m = match_len(data, pos, data, i, limit)
+            if m > best_len:
+                best_len, best_dist = m, dist
+                if m == limit:
+                    break
+            checked += 1
+            if checked >= LZ_CANDIDATES:
+                break
+        if best_len >= LZ_MIN_MATCH:
+            bw.put(0, 1)
+            bw.put(best_dist - 1, window_bits)
+            bw.put(best_len - 1, count_bits)
+            for k in range(best_len):
+                insert(i + k)
+            i += best_len
+        else:
+            bw.put(1, 1)
+            bw.put(data[i], 8)
+            insert(i)
+            i += 1
+        # 丢掉窗口外的位置, 控制内存
+        if i >= next_prune:
+            next_prune = i + 4 * window
+            chains = dict((k, [p for p in v if i - p <= window]) for k, v in chains.items())
+            chains = dict((k, v) for k, v in chains.items() if v)
+    return bw.finish()
+
+
+def make_patch(old, new, window_bits, count_bits):
+    body = lzss_compress(serialize(bsdiff(old, new)), window_bits, count_bits)
+    head = struct.pack('<IBBHIIII', DELTA_MAGIC, window_bits, count_bits, 0,
+                       len(old), crc32(old), len(new), crc32(new))
+    return head + struct.pack('<I', crc32(head)) + body
+
+
+def apply_patch(old, patch):
+    if len(patch) < DELTA_HEAD_SIZE:
+        raise ValueError('patch too short')
+    magic, window_bits, count_bits, reserved, old_size, old_crc, new_size, new_crc, head_crc = \
+        struct.unpack('<IBBHIIIII', patch[:DELTA_HEAD_SIZE])
+    if magic != DELTA_MAGIC or head_crc != crc32(patch[:24]) or reserved:
+        raise ValueError('bad patch head')
+    if old_size != len(old) or old_crc != crc32(old):
+        raise ValueError('patch does not match old image')
+
+    # 解压
+    data = bytearray()
+    bits = ''.join('{:08b}'.format(b) for b in patch[DELTA_HEAD_SIZE:])
+    i = 0
+    while i < len(bits):
+        if bits[i] == '1':
+            if i + 9 > len(bits):
+                break
+            data.append(int(bits[i + 1:i + 9], 2))
+            i += 9
+        else:
+            if i + 1 + window_bits + count_bits > len(bits):
+                break
+            dist = int(bits[i + 1:i + 1 + window_bits], 2) + 1
+            count = int(bits[i + 1 + window_bits:i + 1 + window_bits + count_bits], 2) + 1
+            for _ in range(count):
+                data.append(data[-dist])
+            i += 1 + window_bits + count_bits
+
+    # 控制块
+    new = bytearray()
+    p = oldpos = 0
+
+    def get_varint():
+        nonlocal p
+        v = shift = 0
+        while True:
+            b = data[p]
+            p += 1
+            v |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return v
+
+    while len(new) < new_size:
+        diff_len = get_varint()
+        extra_len = get_varint()
+        seek = get_varint()
+        seek = (seek >> 1) ^ -(seek & 1)
+        for k in range(diff_len):
+            new.append((old[oldpos + k] + data[p + k]) & 0xFF)
+        p += diff_len
+        oldpos += diff_len
+        new += data[p:p + extra_len]
+        p += extra_len
+        oldpos += seek
+    if len(new) != new_size or crc32(bytes(new)) != new_crc:
+        raise ValueError('new image crc error')
+    return bytes(new)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='IntoRobot delta OTA patch tool')
+    parser.add_argument('-a', '--apply', action='store_true', help='apply patch: old patch out')
+    parser.add_argument('-w', '--window-bits', type=int, default=DELTA_WINDOW_BITS_MAX)
+    parser.add_argument('-l', '--count-bits', type=int, default=8)
+    parser.add_argument('files', nargs=3)
+    args = parser.parse_args()
+
+    with open(args.files[0], 'rb') as f:
+        old = f.read()
+    with open(args.files[1], 'rb') as f:
+        second = f.read()
+
+    if args.apply:
+        new = apply_patch(old, second)
+        with open(args.files[2], 'wb') as f:
+            f.write(new)
+        print('%s: %d bytes' % (args.files[2], len(new)))
+        return 0
+
+    if not 4 <= args.window_bits <= DELTA_WINDOW_BITS_MAX or not 1 <= args.count_bits < args.window_bits:
+        parser.error('bad window/count bits')
+    patch = make_patch(old, second, args.window_bits, args.count_bits)
+    if apply_patch(old, patch) != second:
+        print('patch verify failed', file=sys.stderr)
+        return 1
+    with open(args.files[2], 'wb') as f:
+        f.write(patch)
+    print('%s: %d -> %d bytes, patch %d bytes (%.1f%%)' %
+          (args.files[2], len(old), len(second), len(patch), 100.0 * len(patch) / max(1, len(second))))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
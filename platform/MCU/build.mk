@@ -5,3 +5,6 @@
 
 PLATFORM_MCU_PATH = $(PLATFORM_MODULE_PATH)/MCU/$(PLATFORM_MCU)
 include $(call rwildcard,$(PLATFORM_MCU_PATH)/,sources.mk)
+
+# sources shared by all MCUs
+include $(call rwildcard,$(PLATFORM_MODULE_PATH)/MCU/shared/,sources.mk)
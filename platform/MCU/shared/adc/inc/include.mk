@@ -0,0 +1,2 @@
+TARGET_ADC_PATH = $(PLATFORM_MODULE_PATH)/MCU/shared/adc
+INCLUDE_DIRS += $(TARGET_ADC_PATH)/inc
@@ -0,0 +1,71 @@
+/**
+ ******************************************************************************
+ * @file     : lib_adc_ring.h
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : ADC DMA循环缓冲的帧索引
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  */
+#ifndef LIB_ADC_RING_H_
+#define LIB_ADC_RING_H_
+
+#include <stdint.h>
+
+/*
+  ADC 扫描模式下 DMA 循环写入 buf, 每帧 channels 个采样(扫描顺序), 共 frames 帧
+  写位置由 DMA 剩余计数(NDTR)换算, 不需要在每帧中断, head 为已写完的总帧数(32位递增)
+  DMA 半满/全满中断和读取时都调用 adc_ring_update, 只要每圈至少调用一次 head 就不会少算
+  中断和任务中都调用 adc_ring_update 时, 任务中调用前要屏蔽 DMA 中断
+
+  读取:
+      adc_ring_latest      最新一帧的某个通道
+      adc_ring_peek        连续可读的帧(不跨过缓冲末尾), 处理完调用 adc_ring_release
+  读得比 DMA 写得慢时, 最旧的帧被覆盖, 丢掉的帧数计入 overruns
+  adc_ring_peek 返回的帧在 DMA 写满一圈之前有效, 处理时间要小于 (frames - count) 帧
+*/
+
+typedef struct
+{
+    volatile uint16_t *buf;
+    uint16_t channels;
+    uint32_t frames;
+    uint32_t size;              //channels * frames, DMA 传输个数
+
+    volatile uint32_t head;     //已写完的帧数
+    volatile uint32_t head_pos; //head 在缓冲中的帧位置
+    uint32_t tail;              //已读完的帧数
+    uint32_t tail_pos;
+    uint32_t overruns;          //被覆盖的帧数
+}adc_ring_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void adc_ring_init(adc_ring_t *ring, volatile uint16_t *buf, uint16_t channels, uint32_t frames);
+void adc_ring_update(adc_ring_t *ring, uint32_t ndtr);
+uint16_t adc_ring_latest(const adc_ring_t *ring, uint16_t channel);
+uint32_t adc_ring_available(adc_ring_t *ring);
+uint32_t adc_ring_peek(adc_ring_t *ring, const volatile uint16_t **frame);
+void adc_ring_release(adc_ring_t *ring, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIB_ADC_RING_H_ */
@@ -0,0 +1,166 @@
+/**
+ ******************************************************************************
+ * @file     : lib_adc_ring.c
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : ADC DMA循环缓冲的帧索引
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  */
+#include "lib_adc_ring.h"
+
+/*********************************************************************************
+  *Function     : adc_ring_init
+  *Description  : 初始化帧索引
+  *Input        : buf: DMA 缓冲, channels * frames 个采样
+                  channels: 每帧的通道数
+                  frames: 帧数, 至少2帧
+  *Output       : none
+  *Return       : none
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : 在启动 DMA 之前调用
+**********************************************************************************/
+void adc_ring_init(adc_ring_t *ring, volatile uint16_t *buf, uint16_t channels, uint32_t frames)
+{
+    ring->buf = buf;
+    ring->channels = channels;
+    ring->frames = frames;
+    ring->size = channels * frames;
+    ring->head = 0;
+    ring->head_pos = 0;
+    ring->tail = 0;
+    ring->tail_pos = 0;
+    ring->overruns = 0;
+}
+
+/*********************************************************************************
+  *Function     : adc_ring_update
+  *Description  : 根据 DMA 剩余计数更新已写完的帧数
+  *Input        : ndtr: DMA 剩余传输个数, 1~size
+  *Output       : none
+  *Return       : none
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : 两次调用之间 DMA 不能写满一圈, 否则少算一圈
+**********************************************************************************/
+void adc_ring_update(adc_ring_t *ring, uint32_t ndtr)
+{
+    uint32_t pos, delta;
+
+    if (ndtr == 0 || ndtr > ring->size)
+    {
+        ndtr = ring->size;      //循环模式重新装载的瞬间
+    }
+    // 正在写的帧之前都已写完
+    pos = ((ring->size - ndtr) / ring->channels) % ring->frames;
+    delta = (pos + ring->frames - ring->head_pos) % ring->frames;
+    ring->head_pos = pos;
+    ring->head += delta;
+}
+
+/*********************************************************************************
+  *Function     : adc_ring_latest
+  *Description  : 最新一帧的某个通道
+  *Input        : channel: 扫描顺序中的序号
+  *Output       : none
+  *Return       : 采样值, 还没有完整的帧时返回0
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       :
+**********************************************************************************/
+uint16_t adc_ring_latest(const adc_ring_t *ring, uint16_t channel)
+{
+    uint32_t pos;
+
+    if (ring->head == 0 || channel >= ring->channels)
+    {
+        return 0;
+    }
+    pos = (ring->head_pos + ring->frames - 1) % ring->frames;
+    return ring->buf[pos * ring->channels + channel];
+}
+
+/*********************************************************************************
+  *Function     : adc_ring_available
+  *Description  : 可读的帧数
+  *Input        : none
+  *Output       : none
+  *Return       : 帧数, 最多 frames - 1
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : 读得太慢时丢掉已被覆盖的帧
+**********************************************************************************/
+uint32_t adc_ring_available(adc_ring_t *ring)
+{
+    uint32_t head = ring->head;
+    uint32_t head_pos = ring->head_pos;
+    uint32_t count = head - ring->tail;
+
+    // DMA 正在写 head_pos 帧, 之前 frames - 1 帧有效
+    if (count > ring->frames - 1)
+    {
+        ring->overruns += count - (ring->frames - 1);
+        count = ring->frames - 1;
+        ring->tail = head - count;
+        ring->tail_pos = (head_pos + 1) % ring->frames;
+    }
+    return count;
+}
+
+/*********************************************************************************
+  *Function     : adc_ring_peek
+  *Description  : 取连续可读的帧
+  *Input        : none
+  *Output       : frame: 第一帧的采样, 每帧 channels 个
+  *Return       : 帧数, 不跨过缓冲末尾, 剩下的帧 release 后再取
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : 不复制数据, 处理完调用 adc_ring_release
+**********************************************************************************/
+uint32_t adc_ring_peek(adc_ring_t *ring, const volatile uint16_t **frame)
+{
+    uint32_t count = adc_ring_available(ring);
+
+    if (count > ring->frames - ring->tail_pos)
+    {
+        count = ring->frames - ring->tail_pos;
+    }
+    *frame = ring->buf + ring->tail_pos * ring->channels;
+    return count;
+}
+
+/*********************************************************************************
+  *Function     : adc_ring_release
+  *Description  : 释放已处理的帧
+  *Input        : count: 帧数
+  *Output       : none
+  *Return       : none
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       :
+**********************************************************************************/
+void adc_ring_release(adc_ring_t *ring, uint32_t count)
+{
+    // 处理期间被覆盖的帧由下次 adc_ring_available 丢掉
+    if (count > ring->head - ring->tail)
+    {
+        count = ring->head - ring->tail;
+    }
+    ring->tail += count;
+    ring->tail_pos = (ring->tail_pos + count) % ring->frames;
+}
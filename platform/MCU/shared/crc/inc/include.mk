@@ -0,0 +1,2 @@
+TARGET_CRC_PATH = $(PLATFORM_MODULE_PATH)/MCU/shared/crc
+INCLUDE_DIRS += $(TARGET_CRC_PATH)/inc
@@ -0,0 +1,84 @@
+/**
+ ******************************************************************************
+ * @file     : lib_crc.h
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : 查表CRC, 应用/bootloader/esp8266 共用
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  */
+#ifndef LIB_CRC_H_
+#define LIB_CRC_H_
+
+#include <stdint.h>
+
+/*
+  CRC-16/CCITT: 多项式0x1021 低位先行(0x8408), 与avr的_crc_ccitt_update相同, 初值CRC16_INIT
+  CRC-32: 多项式0x04C11DB7 高位先行 不反射 不取反, 与STM32的CRC单元相同, 初值CRC32_INIT
+  传入上次的结果可以分段计算, 结果与一次计算相同
+
+  查表: 每张表256项, 一次处理 TABLE_SLICES(1/4/8) 个字节
+  表大小 CRC-16 512字节/张  CRC-32 1K字节/张
+  esp8266 的常量表放在DRAM中, 默认只用一张表
+  STM32F4 的CRC-32 默认用硬件CRC单元计算(CRC32_HARDWARE), 只保留一张表处理尾部字节
+  硬件CRC单元不可重入, 不要在中断和任务中同时调用crc32_update
+*/
+#ifndef CRC_TABLE_SLICES
+#if defined(ICACHE_FLASH)
+#define CRC_TABLE_SLICES        1
+#elif defined(STM32F411xE) || defined(STM32F10X_MD)
+#define CRC_TABLE_SLICES        4     //bootloader 只有32K
+#else
+#define CRC_TABLE_SLICES        8
+#endif
+#endif
+
+#ifndef CRC32_HARDWARE
+#if defined(STM32F411xE)
+#define CRC32_HARDWARE          1
+#else
+#define CRC32_HARDWARE          0
+#endif
+#endif
+
+#ifndef CRC16_TABLE_SLICES
+#define CRC16_TABLE_SLICES      CRC_TABLE_SLICES
+#endif
+
+#ifndef CRC32_TABLE_SLICES
+#if CRC32_HARDWARE
+#define CRC32_TABLE_SLICES      1
+#else
+#define CRC32_TABLE_SLICES      CRC_TABLE_SLICES
+#endif
+#endif
+
+#define CRC16_INIT              0xFFFF
+#define CRC32_INIT              0xFFFFFFFF
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint16_t crc16_ccitt_update(uint16_t crc, const void *data, uint32_t len);
+uint32_t crc32_update(uint32_t crc, const void *data, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIB_CRC_H_ */
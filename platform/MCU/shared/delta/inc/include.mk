@@ -0,0 +1,2 @@
+TARGET_DELTA_PATH = $(PLATFORM_MODULE_PATH)/MCU/shared/delta
+INCLUDE_DIRS += $(TARGET_DELTA_PATH)/inc
@@ -0,0 +1,137 @@
+/**
+ ******************************************************************************
+ * @file     : lib_delta.h
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : 差分升级包流式还原
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  */
+#ifndef LIB_DELTA_H_
+#define LIB_DELTA_H_
+
+#include <stdint.h>
+
+/*
+  差分包由 build/tools/mkdelta.py 生成, 格式(小端):
+  包头 DELTA_HEAD_SIZE 字节
+      0  magic        DELTA_MAGIC "IRD1"
+      4  参数          字节0 窗口位数W  字节1 长度位数L  其余为0
+      8  old_size     旧固件长度
+      12 old_crc32    旧固件CRC-32
+      16 new_size     新固件长度
+      20 new_crc32    新固件CRC-32
+      24 head_crc32   前24字节的CRC-32
+  包体 LZSS 压缩(与heatshrink相同的位流, 高位先行):
+      1 + 8位字节                       字面值
+      0 + W位(距离-1) + L位(长度-1)     从已解压数据的窗口中复制
+  解压后为 bsdiff 的控制块序列:
+      varint diff_len, varint extra_len, zigzag varint seek
+      diff_len 字节差值    new = old[oldpos++] + diff
+      extra_len 字节新数据  new = extra
+      oldpos += seek
+
+  还原时边接收边写入, 内存只有窗口和两个小缓冲, 不需要保存整个差分包
+  开始前校验旧固件的长度和CRC, 结束时校验新固件的CRC, 只有返回 DELTA_DONE 才可以切换到新固件
+  CRC 为 lib_crc.h 的 crc32_update(CRC32_INIT, ...)
+*/
+
+#define DELTA_MAGIC                 0x31445249      //"IRD1"
+#define DELTA_HEAD_SIZE             28
+#define DELTA_WINDOW_BITS_MAX       10              //窗口最大1K
+#define DELTA_OLD_BUF_SIZE          64              //旧固件读缓冲
+#define DELTA_OUT_BUF_SIZE          256             //新固件写缓冲
+
+typedef enum
+{
+    DELTA_RUNNING = 0,      //正在还原
+    DELTA_DONE,             //还原完成, 新固件CRC正确
+    DELTA_ERR_HEAD,         //不是差分包或者参数不支持
+    DELTA_ERR_BASE,         //旧固件与差分包不匹配
+    DELTA_ERR_SIZE,         //新固件太大
+    DELTA_ERR_FORMAT,       //包体错误
+    DELTA_ERR_READ,         //读旧固件失败
+    DELTA_ERR_WRITE,        //写新固件失败
+    DELTA_ERR_CRC           //新固件CRC错误
+}delta_status_t;
+
+/*
+  读旧固件 offset 开始 len 字节, 成功返回0
+  写新固件 offset 开始 len 字节, 成功返回0, offset 依次递增, 最后一次之前 len 都为 DELTA_OUT_BUF_SIZE
+  buf 4字节对齐, 长度向上取整到4的倍数后仍在缓冲内
+*/
+typedef int (*delta_read_cb_t)(void *arg, uint32_t offset, uint8_t *buf, uint32_t len);
+typedef int (*delta_write_cb_t)(void *arg, uint32_t offset, const uint8_t *buf, uint32_t len);
+
+typedef struct
+{
+    delta_read_cb_t read;
+    delta_write_cb_t write;
+    void *arg;
+    uint32_t base_size;         //旧固件长度
+    uint32_t new_size_max;      //新固件最大长度
+
+    uint32_t old_size;          //包头
+    uint32_t old_crc;
+    uint32_t new_size;
+    uint32_t new_crc;
+    uint8_t window_bits;
+    uint8_t count_bits;
+    delta_status_t status;
+
+    uint8_t head_len;           //包头解析
+    uint8_t head[DELTA_HEAD_SIZE];
+
+    uint8_t lz_state;           //解压
+    uint8_t lz_bits;
+    uint16_t lz_value;
+    uint16_t lz_index;
+    uint32_t lz_pos;
+    uint8_t window[1 << DELTA_WINDOW_BITS_MAX];
+
+    uint8_t op_state;           //控制块
+    uint8_t op_shift;
+    uint32_t op_value;
+    uint32_t diff_len;
+    uint32_t extra_len;
+    int32_t seek;
+    int32_t old_pos;
+
+    uint32_t old_buf_pos;       //old_buf 对应旧固件的位置
+    uint32_t old_buf_len;
+    uint32_t old_buf[DELTA_OLD_BUF_SIZE / 4];
+
+    uint32_t new_pos;           //已还原长度
+    uint32_t new_crc_calc;
+    uint32_t out_len;
+    uint32_t out_buf[DELTA_OUT_BUF_SIZE / 4];
+}delta_apply_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int delta_patch_check(const uint8_t *data, uint32_t len);
+void delta_apply_init(delta_apply_t *delta, uint32_t base_size, uint32_t new_size_max,
+        delta_read_cb_t read, delta_write_cb_t write, void *arg);
+delta_status_t delta_apply_input(delta_apply_t *delta, const uint8_t *data, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIB_DELTA_H_ */
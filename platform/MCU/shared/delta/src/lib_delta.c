@@ -0,0 +1,445 @@
+/**
+ ******************************************************************************
+ * @file     : lib_delta.c
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : 差分升级包流式还原
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  */
+#include "lib_delta.h"
+#include "lib_crc.h"
+
+//esp8266 代码放到flash中执行
+#if defined(ICACHE_FLASH)
+#define DELTA_ATTR __attribute__((section(".irom0.text")))
+#else
+#define DELTA_ATTR
+#endif
+
+//解压状态
+#define LZ_STATE_TAG            0   //标志位
+#define LZ_STATE_LITERAL        1   //字面值
+#define LZ_STATE_INDEX          2   //距离
+#define LZ_STATE_COUNT          3   //长度
+
+//控制块状态
+#define OP_STATE_DIFF_LEN       0
+#define OP_STATE_EXTRA_LEN      1
+#define OP_STATE_SEEK           2
+#define OP_STATE_DIFF           3
+#define OP_STATE_EXTRA          4
+
+#define DELTA_VARINT_SHIFT_MAX  28
+
+static uint32_t DELTA_ATTR deltaGet32(const uint8_t *p)
+{
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*********************************************************************************
+  *Function     : delta_patch_check
+  *Description  : 检查数据是否为差分包
+  *Input        : data: 文件开头
+                  len: 数据长度
+  *Output       : none
+  *Return       : 1: 差分包  0: 不是
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : 只检查magic, 固件开头是栈顶地址, 不会与magic相同
+**********************************************************************************/
+int DELTA_ATTR delta_patch_check(const uint8_t *data, uint32_t len)
+{
+    return (len >= 4) && (deltaGet32(data) == DELTA_MAGIC);
+}
+
+/*********************************************************************************
+  *Function     : delta_apply_init
+  *Description  : 初始化还原
+  *Input        : base_size: 旧固件长度
+                  new_size_max: 新固件最大长度
+                  read: 读旧固件
+                  write: 写新固件
+                  arg: 回调参数
+  *Output       : none
+  *Return       : none
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       :
+**********************************************************************************/
+void DELTA_ATTR delta_apply_init(delta_apply_t *delta, uint32_t base_size, uint32_t new_size_max,
+        delta_read_cb_t read, delta_write_cb_t write, void *arg)
+{
+    uint8_t *p = (uint8_t *)delta;
+    uint32_t n;
+
+    for(n = 0; n < sizeof(delta_apply_t); n++)
+    {
+        p[n] = 0;
+    }
+    delta->read = read;
+    delta->write = write;
+    delta->arg = arg;
+    delta->base_size = base_size;
+    delta->new_size_max = new_size_max;
+    delta->new_crc_calc = CRC32_INIT;
+    delta->status = DELTA_RUNNING;
+}
+
+//校验旧固件
+static delta_status_t DELTA_ATTR deltaCheckBase(delta_apply_t *delta)
+{
+    uint8_t *buf = (uint8_t *)delta->out_buf;
+    uint32_t crc = CRC32_INIT;
+    uint32_t pos, len;
+
+    if(delta->old_size != delta->base_size)
+    {
+        return DELTA_ERR_BASE;
+    }
+    for(pos = 0; pos < delta->old_size; pos += len)
+    {
+        len = delta->old_size - pos;
+        if(len > DELTA_OUT_BUF_SIZE)
+        {
+            len = DELTA_OUT_BUF_SIZE;
+        }
+        if(delta->read(delta->arg, pos, buf, len))
+        {
+            return DELTA_ERR_READ;
+        }
+        crc = crc32_update(crc, buf, len);
+    }
+    return (crc == delta->old_crc) ? DELTA_RUNNING : DELTA_ERR_BASE;
+}
+
+static delta_status_t DELTA_ATTR deltaHead(delta_apply_t *delta)
+{
+    const uint8_t *head = delta->head;
+
+    if((deltaGet32(head) != DELTA_MAGIC) ||
+       (deltaGet32(head + 24) != crc32_update(CRC32_INIT, head, 24)))
+    {
+        return DELTA_ERR_HEAD;
+    }
+    delta->window_bits = head[4];
+    delta->count_bits = head[5];
+    delta->old_size = deltaGet32(head + 8);
+    delta->old_crc = deltaGet32(head + 12);
+    delta->new_size = deltaGet32(head + 16);
+    delta->new_crc = deltaGet32(head + 20);
+    if((delta->window_bits < 4) || (delta->window_bits > DELTA_WINDOW_BITS_MAX) ||
+       (delta->count_bits < 1) || (delta->count_bits >= delta->window_bits) ||
+       head[6] || head[7])
+    {
+        return DELTA_ERR_HEAD;
+    }
+    if((delta->new_size == 0) || (delta->new_size > delta->new_size_max))
+    {
+        return DELTA_ERR_SIZE;
+    }
+    return deltaCheckBase(delta);
+}
+
+static delta_status_t DELTA_ATTR deltaFlush(delta_apply_t *delta)
+{
+    uint8_t *buf = (uint8_t *)delta->out_buf;
+
+    if(delta->out_len)
+    {
+        if(delta->write(delta->arg, delta->new_pos - delta->out_len, buf, delta->out_len))
+        {
+            return DELTA_ERR_WRITE;
+        }
+        delta->new_crc_calc = crc32_update(delta->new_crc_calc, buf, delta->out_len);
+        delta->out_len = 0;
+    }
+    return DELTA_RUNNING;
+}
+
+static delta_status_t DELTA_ATTR deltaOutput(delta_apply_t *delta, uint8_t value)
+{
+    ((uint8_t *)delta->out_buf)[delta->out_len++] = value;
+    delta->new_pos++;
+    if(delta->out_len == DELTA_OUT_BUF_SIZE)
+    {
+        return deltaFlush(delta);
+    }
+    return DELTA_RUNNING;
+}
+
+//读取旧固件一个字节, 不在缓冲中时从4字节对齐处开始读
+static delta_status_t DELTA_ATTR deltaOldByte(delta_apply_t *delta, uint32_t pos, uint8_t *value)
+{
+    uint32_t start, len;
+
+    if((pos < delta->old_buf_pos) || (pos >= delta->old_buf_pos + delta->old_buf_len))
+    {
+        start = pos & ~3UL;
+        len = delta->old_size - start;
+        if(len > DELTA_OLD_BUF_SIZE)
+        {
+            len = DELTA_OLD_BUF_SIZE;
+        }
+        if(delta->read(delta->arg, start, (uint8_t *)delta->old_buf, len))
+        {
+            return DELTA_ERR_READ;
+        }
+        delta->old_buf_pos = start;
+        delta->old_buf_len = len;
+    }
+    *value = ((uint8_t *)delta->old_buf)[pos - delta->old_buf_pos];
+    return DELTA_RUNNING;
+}
+
+//控制块结束, 已还原全部数据时校验CRC
+static delta_status_t DELTA_ATTR deltaRecordEnd(delta_apply_t *delta)
+{
+    delta_status_t status;
+
+    delta->old_pos += delta->seek;
+    delta->op_state = OP_STATE_DIFF_LEN;
+    if(delta->new_pos < delta->new_size)
+    {
+        return DELTA_RUNNING;
+    }
+    status = deltaFlush(delta);
+    if(status != DELTA_RUNNING)
+    {
+        return status;
+    }
+    return (delta->new_crc_calc == delta->new_crc) ? DELTA_DONE : DELTA_ERR_CRC;
+}
+
+//控制块读完, 检查范围
+static delta_status_t DELTA_ATTR deltaRecordStart(delta_apply_t *delta)
+{
+    uint32_t left = delta->new_size - delta->new_pos;
+
+    if((delta->diff_len > left) || (delta->extra_len > left - delta->diff_len))
+    {
+        return DELTA_ERR_FORMAT;
+    }
+    if(delta->diff_len)
+    {
+        if((delta->old_pos < 0) || ((uint32_t)delta->old_pos > delta->old_size) ||
+           (delta->diff_len > delta->old_size - (uint32_t)delta->old_pos))
+        {
+            return DELTA_ERR_FORMAT;
+        }
+        delta->op_state = OP_STATE_DIFF;
+        return DELTA_RUNNING;
+    }
+    if(delta->extra_len)
+    {
+        delta->op_state = OP_STATE_EXTRA;
+        return DELTA_RUNNING;
+    }
+    return deltaRecordEnd(delta);
+}
+
+//处理解压后的一个字节
+static delta_status_t DELTA_ATTR deltaOpByte(delta_apply_t *delta, uint8_t value)
+{
+    delta_status_t status;
+    uint8_t old;
+
+    switch(delta->op_state)
+    {
+        case OP_STATE_DIFF_LEN:
+        case OP_STATE_EXTRA_LEN:
+        case OP_STATE_SEEK:
+            if(delta->op_shift > DELTA_VARINT_SHIFT_MAX)
+            {
+                return DELTA_ERR_FORMAT;
+            }
+            delta->op_value |= (uint32_t)(value & 0x7F) << delta->op_shift;
+            delta->op_shift += 7;
+            if(value & 0x80)
+            {
+                return DELTA_RUNNING;
+            }
+            if(delta->op_state == OP_STATE_DIFF_LEN)
+            {
+                delta->diff_len = delta->op_value;
+            }
+            else if(delta->op_state == OP_STATE_EXTRA_LEN)
+            {
+                delta->extra_len = delta->op_value;
+            }
+            else
+            {
+                delta->seek = (int32_t)(delta->op_value >> 1) ^ -(int32_t)(delta->op_value & 1);
+            }
+            delta->op_value = 0;
+            delta->op_shift = 0;
+            if(delta->op_state != OP_STATE_SEEK)
+            {
+                delta->op_state++;
+                return DELTA_RUNNING;
+            }
+            return deltaRecordStart(delta);
+
+        case OP_STATE_DIFF:
+            status = deltaOldByte(delta, delta->old_pos, &old);
+            if(status != DELTA_RUNNING)
+            {
+                return status;
+            }
+            status = deltaOutput(delta, old + value);
+            if(status != DELTA_RUNNING)
+            {
+                return status;
+            }
+            delta->old_pos++;
+            if(--delta->diff_len)
+            {
+                return DELTA_RUNNING;
+            }
+            if(delta->extra_len)
+            {
+                delta->op_state = OP_STATE_EXTRA;
+                return DELTA_RUNNING;
+            }
+            return deltaRecordEnd(delta);
+
+        case OP_STATE_EXTRA:
+            status = deltaOutput(delta, value);
+            if(status != DELTA_RUNNING)
+            {
+                return status;
+            }
+            if(--delta->extra_len)
+            {
+                return DELTA_RUNNING;
+            }
+            return deltaRecordEnd(delta);
+
+        default:
+            return DELTA_ERR_FORMAT;
+    }
+}
+
+//解压出一个字节, 放入窗口
+static delta_status_t DELTA_ATTR deltaEmit(delta_apply_t *delta, uint8_t value)
+{
+    delta->window[delta->lz_pos & ((1UL << delta->window_bits) - 1)] = value;
+    delta->lz_pos++;
+    return deltaOpByte(delta, value);
+}
+
+//从窗口复制
+static delta_status_t DELTA_ATTR deltaBackref(delta_apply_t *delta, uint32_t distance, uint32_t count)
+{
+    uint32_t mask = (1UL << delta->window_bits) - 1;
+    delta_status_t status = DELTA_RUNNING;
+
+    if(distance > delta->lz_pos)
+    {
+        return DELTA_ERR_FORMAT;
+    }
+    while(count-- && (status == DELTA_RUNNING))
+    {
+        status = deltaEmit(delta, delta->window[(delta->lz_pos - distance) & mask]);
+    }
+    return status;
+}
+
+//处理压缩数据的一位
+static delta_status_t DELTA_ATTR deltaBit(delta_apply_t *delta, uint8_t bit)
+{
+    uint16_t value;
+
+    delta->lz_value = (delta->lz_value << 1) | bit;
+    delta->lz_bits++;
+    switch(delta->lz_state)
+    {
+        case LZ_STATE_TAG:
+            delta->lz_state = delta->lz_value ? LZ_STATE_LITERAL : LZ_STATE_INDEX;
+            break;
+
+        case LZ_STATE_LITERAL:
+            if(delta->lz_bits < 8)
+            {
+                return DELTA_RUNNING;
+            }
+            value = delta->lz_value & 0xFF;
+            delta->lz_state = LZ_STATE_TAG;
+            delta->lz_bits = 0;
+            delta->lz_value = 0;
+            return deltaEmit(delta, value);
+
+        case LZ_STATE_INDEX:
+            if(delta->lz_bits < delta->window_bits)
+            {
+                return DELTA_RUNNING;
+            }
+            delta->lz_index = delta->lz_value;
+            delta->lz_state = LZ_STATE_COUNT;
+            break;
+
+        case LZ_STATE_COUNT:
+            if(delta->lz_bits < delta->count_bits)
+            {
+                return DELTA_RUNNING;
+            }
+            value = delta->lz_value & ((1U << delta->count_bits) - 1);
+            delta->lz_state = LZ_STATE_TAG;
+            delta->lz_bits = 0;
+            delta->lz_value = 0;
+            return deltaBackref(delta, delta->lz_index + 1UL, value + 1UL);
+    }
+    delta->lz_bits = 0;
+    delta->lz_value = 0;
+    return DELTA_RUNNING;
+}
+
+/*********************************************************************************
+  *Function     : delta_apply_input
+  *Description  : 输入差分包数据
+  *Input        : data: 差分包数据, 可以任意分段
+                  len: 数据长度
+  *Output       : none
+  *Return       : DELTA_RUNNING: 继续输入  DELTA_DONE: 完成  其他: 失败
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : 包头收完时读取整个旧固件校验CRC
+                  完成或失败后再输入直接返回结果
+**********************************************************************************/
+delta_status_t DELTA_ATTR delta_apply_input(delta_apply_t *delta, const uint8_t *data, uint32_t len)
+{
+    uint32_t n;
+    int8_t b;
+
+    for(n = 0; (n < len) && (delta->status == DELTA_RUNNING); n++)
+    {
+        if(delta->head_len < DELTA_HEAD_SIZE)
+        {
+            delta->head[delta->head_len++] = data[n];
+            if(delta->head_len == DELTA_HEAD_SIZE)
+            {
+                delta->status = deltaHead(delta);
+            }
+            continue;
+        }
+        for(b = 7; (b >= 0) && (delta->status == DELTA_RUNNING); b--)
+        {
+            delta->status = deltaBit(delta, (data[n] >> b) & 1);
+        }
+    }
+    return delta->status;
+}
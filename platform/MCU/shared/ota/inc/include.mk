@@ -0,0 +1,2 @@
+TARGET_OTA_PATH = $(PLATFORM_MODULE_PATH)/MCU/shared/ota
+INCLUDE_DIRS += $(TARGET_OTA_PATH)/inc
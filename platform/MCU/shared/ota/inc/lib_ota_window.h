@@ -0,0 +1,129 @@
+/**
+ ******************************************************************************
+ * @file     : lib_ota_window.h
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : esp8266 与 bootloader 之间的滑动窗口固件传输
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  */
+#ifndef LIB_OTA_WINDOW_H_
+#define LIB_OTA_WINDOW_H_
+
+#include <stdint.h>
+
+/*
+  协议:
+  bootloader -> esp8266   AT+GETFILEALL=<包大小>,<文件类型>,<窗口>\r\n
+  esp8266 -> bootloader   +GETFILEALL,<包个数>,<包序号>,<长度>:<数据><CRC32, 低字节在前>\r\n
+                          长度包含4字节CRC, CRC 为 ota_window_crc, 覆盖数据和包序号, 包头出错时不会写到别的包
+  bootloader -> esp8266   AT+FILEACK=<base>,<nack>\r\n
+                          base 之前的包都已收到(累计确认), nack 为需要重发的包序号, -1 表示没有
+
+  发送方最多有 窗口 个包未确认, 收到 nack 先重发该包, 再发送新的包
+  接收方的包按序号直接写入 (包之间没有顺序要求), 收到有缺口时 nack 最低的缺包, CRC错误时 nack 该包
+  接收方一段时间没有收到数据时 nack base, 发送方不需要重发定时器
+  接收方连续超时或者CRC错误 OTA_WINDOW_RETRIES 次放弃
+  接收方数据由串口中断放入队列, 写flash时继续接收, 写包k与接收包k+1重叠
+*/
+
+#define OTA_WINDOW_MAX                  32          //最大窗口(包)
+#define OTA_WINDOW_TIMEOUT              300         //接收方多久没有收到数据请求重发(ms)
+#define OTA_WINDOW_RETRIES              32          //接收方连续超时或者CRC错误次数
+#define OTA_WINDOW_CRC_SIZE             4
+#define OTA_WINDOW_SENDER_TIMEOUT       5000        //发送方多久没有收到确认放弃(ms)
+
+#define OTA_WINDOW_FRAME_HEAD           "+GETFILEALL,"
+#define OTA_WINDOW_ACK                  "AT+FILEACK="
+
+typedef enum
+{
+    OTA_RX_RUNNING = 0,     //正在接收
+    OTA_RX_DONE,            //全部接收
+    OTA_RX_REJECTED,        //发送方不支持(回复ERROR)
+    OTA_RX_TIMEOUT,         //多次超时
+    OTA_RX_WRITE_ERROR      //写入失败
+}ota_rx_status_t;
+
+//写入第index包, 成功返回0
+typedef int (*ota_write_cb_t)(void *arg, uint32_t index, const uint8_t *data, uint32_t len);
+//发送确认
+typedef void (*ota_send_cb_t)(void *arg, const char *data, uint32_t len);
+
+typedef struct
+{
+    uint8_t *packet;            //包缓冲 packet_size+OTA_WINDOW_CRC_SIZE
+    uint32_t packet_size;
+    uint32_t packet_count;
+    uint32_t window;
+    ota_write_cb_t write;
+    ota_send_cb_t send;
+    void *arg;
+
+    uint32_t base;              //之前的包都已写入
+    uint32_t received;          //base 开始的已写入位图
+    uint32_t nacked;            //base 开始的已请求重发位图
+    uint32_t last_time;         //最后收到数据的时间
+    uint32_t retries;           //连续超时或者CRC错误次数
+    ota_rx_status_t status;
+
+    uint8_t state;              //帧解析
+    uint8_t match;
+    uint8_t error_match;
+    uint8_t field_index;
+    uint32_t field[3];
+    uint32_t pos;
+
+    uint32_t frames;            //统计
+    uint32_t crc_errors;
+    uint32_t duplicates;
+    uint32_t nacks;
+    uint32_t timeouts;
+}ota_receiver_t;
+
+typedef struct
+{
+    uint32_t packet_count;
+    uint32_t window;
+    uint32_t base;              //之前的包都已确认
+    uint32_t next;              //下一个新包
+    uint32_t resend;            //base 开始的待重发位图
+    uint32_t last_time;         //最后收到确认的时间
+}ota_sender_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void ota_receiver_init(ota_receiver_t *rx, uint8_t *packet, uint32_t packet_size, uint32_t packet_count, uint32_t window,
+        ota_write_cb_t write, ota_send_cb_t send, void *arg, uint32_t now);
+ota_rx_status_t ota_receiver_input(ota_receiver_t *rx, const uint8_t *data, uint32_t len, uint32_t now);
+ota_rx_status_t ota_receiver_poll(ota_receiver_t *rx, uint32_t now);
+
+void ota_sender_init(ota_sender_t *tx, uint32_t packet_count, uint32_t window, uint32_t now);
+int32_t ota_sender_next(ota_sender_t *tx);
+void ota_sender_ack(ota_sender_t *tx, int32_t base, int32_t nack, uint32_t now);
+int ota_sender_done(ota_sender_t *tx);
+int ota_sender_expired(ota_sender_t *tx, uint32_t now);
+uint32_t ota_window_frame_head(char *buf, uint32_t packet_count, uint32_t index, uint32_t len);
+uint32_t ota_window_crc(uint32_t index, const uint8_t *data, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIB_OTA_WINDOW_H_ */
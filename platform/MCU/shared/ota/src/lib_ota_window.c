@@ -0,0 +1,468 @@
+/**
+ ******************************************************************************
+ * @file     : lib_ota_window.c
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : esp8266 与 bootloader 之间的滑动窗口固件传输
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  */
+#include "lib_ota_window.h"
+#include "lib_crc.h"
+
+//esp8266 代码放到flash中执行
+#if defined(ICACHE_FLASH)
+#define OTA_ATTR __attribute__((section(".irom0.text")))
+#else
+#define OTA_ATTR
+#endif
+
+#define OTA_ERROR_RESPONSE      "ERROR\r\n"
+
+//帧解析状态
+#define OTA_STATE_SEARCH        0   //查找帧头
+#define OTA_STATE_FIELD         1   //包个数,包序号,长度
+#define OTA_STATE_DATA          2   //数据和CRC
+
+#define OTA_FIELD_MAX           0x00FFFFFF
+
+static uint32_t OTA_ATTR otaPutNumber(char *buf, int32_t value)
+{
+    char temp[12];
+    uint32_t n = 0, len = 0;
+    uint32_t v = (value < 0) ? -value : value;
+
+    if(value < 0)
+    {
+        buf[len++] = '-';
+    }
+    do
+    {
+        temp[n++] = '0' + v % 10;
+        v /= 10;
+    }while(v);
+    while(n)
+    {
+        buf[len++] = temp[--n];
+    }
+    return len;
+}
+
+static uint32_t OTA_ATTR otaPutString(char *buf, const char *s)
+{
+    uint32_t len = 0;
+
+    while(s[len])
+    {
+        buf[len] = s[len];
+        len++;
+    }
+    return len;
+}
+
+/*********************************************************************************
+  *Function     : ota_window_frame_head
+  *Description  : 生成帧头 +GETFILEALL,<包个数>,<包序号>,<长度>:
+  *Input        : buf: 至少48字节
+                  packet_count: 包个数
+                  index: 包序号
+                  len: 数据长度+OTA_WINDOW_CRC_SIZE
+  *Output       : none
+  *Return       : 帧头长度
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : 不依赖sprintf, esp8266和bootloader共用
+**********************************************************************************/
+uint32_t OTA_ATTR ota_window_frame_head(char *buf, uint32_t packet_count, uint32_t index, uint32_t len)
+{
+    uint32_t n = otaPutString(buf, OTA_WINDOW_FRAME_HEAD);
+
+    n += otaPutNumber(buf + n, packet_count);
+    buf[n++] = ',';
+    n += otaPutNumber(buf + n, index);
+    buf[n++] = ',';
+    n += otaPutNumber(buf + n, len);
+    buf[n++] = ':';
+    return n;
+}
+
+/*********************************************************************************
+  *Function     : ota_window_crc
+  *Description  : 数据包的CRC
+  *Input        : index: 包序号
+                  data: 数据
+                  len: 数据长度
+  *Output       : none
+  *Return       : CRC-32
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : 先算数据再算包序号, STM32F4 上数据部分可以用硬件CRC
+**********************************************************************************/
+uint32_t OTA_ATTR ota_window_crc(uint32_t index, const uint8_t *data, uint32_t len)
+{
+    uint8_t temp[4];
+
+    temp[0] = index & 0xFF;
+    temp[1] = (index >> 8) & 0xFF;
+    temp[2] = (index >> 16) & 0xFF;
+    temp[3] = index >> 24;
+    return crc32_update(crc32_update(CRC32_INIT, data, len), temp, sizeof(temp));
+}
+
+static void OTA_ATTR otaReceiverAck(ota_receiver_t *rx, int32_t nack)
+{
+    char buf[48];
+    uint32_t n = otaPutString(buf, OTA_WINDOW_ACK);
+
+    n += otaPutNumber(buf + n, rx->base);
+    buf[n++] = ',';
+    n += otaPutNumber(buf + n, nack);
+    buf[n++] = '\r';
+    buf[n++] = '\n';
+    if(nack >= 0)
+    {
+        rx->nacks++;
+    }
+    rx->send(rx->arg, buf, n);
+}
+
+//窗口中有缺包时, 返回最低的还没有请求重发的缺包
+static int32_t OTA_ATTR otaReceiverGap(ota_receiver_t *rx)
+{
+    uint32_t b;
+
+    for(b = 0; (b < rx->window) && (rx->received >> b); b++)
+    {
+        if(!(rx->received & (1UL << b)) && !(rx->nacked & (1UL << b)))
+        {
+            rx->nacked |= 1UL << b;
+            return rx->base + b;
+        }
+    }
+    return -1;
+}
+
+//收到一个完整帧
+static void OTA_ATTR otaReceiverFrame(ota_receiver_t *rx)
+{
+    uint32_t index = rx->field[1];
+    uint32_t len = rx->field[2] - OTA_WINDOW_CRC_SIZE;
+    const uint8_t *p = rx->packet + len;
+    uint32_t crc = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    int inWindow = (index >= rx->base) && (index < rx->base + rx->window) && (index < rx->packet_count);
+    uint32_t bit = inWindow ? (1UL << (index - rx->base)) : 0;
+    int32_t nack;
+
+    if(ota_window_crc(index, rx->packet, len) != crc)
+    {
+        rx->crc_errors++;
+        if(++rx->retries > OTA_WINDOW_RETRIES)
+        {
+            rx->status = OTA_RX_TIMEOUT;
+            return;
+        }
+        if(!inWindow || (rx->received & bit))
+        {
+            return;
+        }
+        //包头有效, 立即请求重发该包
+        rx->nacked |= bit;
+        otaReceiverAck(rx, index);
+        return;
+    }
+
+    rx->frames++;
+    rx->retries = 0;
+    if(!inWindow || (rx->received & bit))
+    {
+        rx->duplicates++;
+    }
+    else
+    {
+        if(rx->write(rx->arg, index, rx->packet, len))
+        {
+            rx->status = OTA_RX_WRITE_ERROR;
+            return;
+        }
+        rx->received |= bit;
+        rx->nacked &= ~bit;
+        while(rx->received & 1)
+        {
+            rx->received >>= 1;
+            rx->nacked >>= 1;
+            rx->base++;
+        }
+    }
+    if(rx->base >= rx->packet_count)
+    {
+        rx->status = OTA_RX_DONE;
+        nack = -1;
+    }
+    else
+    {
+        nack = otaReceiverGap(rx);
+    }
+    otaReceiverAck(rx, nack);
+}
+
+/*********************************************************************************
+  *Function     : ota_receiver_init
+  *Description  : 初始化接收方
+  *Input        : rx: 接收方
+                  packet: 包缓冲, 至少 packet_size+OTA_WINDOW_CRC_SIZE 字节
+                  packet_size: 包大小
+                  packet_count: 包个数
+                  window: 窗口, 不超过 OTA_WINDOW_MAX
+                  write: 写入回调
+                  send: 发送确认回调
+                  arg: 回调参数
+                  now: 当前时间(ms)
+  *Output       : none
+  *Return       : none
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : 调用前发送 AT+GETFILEALL
+**********************************************************************************/
+void OTA_ATTR ota_receiver_init(ota_receiver_t *rx, uint8_t *packet, uint32_t packet_size, uint32_t packet_count, uint32_t window,
+        ota_write_cb_t write, ota_send_cb_t send, void *arg, uint32_t now)
+{
+    uint8_t *p = (uint8_t *)rx;
+    uint32_t n;
+
+    for(n = 0; n < sizeof(ota_receiver_t); n++)
+    {
+        p[n] = 0;
+    }
+    rx->packet = packet;
+    rx->packet_size = packet_size;
+    rx->packet_count = packet_count;
+    rx->window = (window > OTA_WINDOW_MAX) ? OTA_WINDOW_MAX : ((window == 0) ? 1 : window);
+    rx->write = write;
+    rx->send = send;
+    rx->arg = arg;
+    rx->last_time = now;
+    rx->status = (packet_count == 0) ? OTA_RX_DONE : OTA_RX_RUNNING;
+}
+
+/*********************************************************************************
+  *Function     : ota_receiver_input
+  *Description  : 处理收到的串口数据
+  *Input        : rx: 接收方
+                  data: 数据
+                  len: 数据长度
+                  now: 当前时间(ms)
+  *Output       : none
+  *Return       : 接收状态
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : 数据可以任意分段, 完整的包在本函数中写入
+**********************************************************************************/
+ota_rx_status_t OTA_ATTR ota_receiver_input(ota_receiver_t *rx, const uint8_t *data, uint32_t len, uint32_t now)
+{
+    static const char head[] = OTA_WINDOW_FRAME_HEAD;
+    static const char error[] = OTA_ERROR_RESPONSE;
+    uint8_t c;
+
+    if(len)
+    {
+        rx->last_time = now;
+    }
+    while(len && (OTA_RX_RUNNING == rx->status))
+    {
+        if(OTA_STATE_DATA == rx->state)
+        {
+            //整块拷贝
+            while(len && (rx->pos < rx->field[2]))
+            {
+                rx->packet[rx->pos++] = *data++;
+                len--;
+            }
+            if(rx->pos == rx->field[2])
+            {
+                rx->state = OTA_STATE_SEARCH;
+                otaReceiverFrame(rx);
+            }
+            continue;
+        }
+
+        c = *data++;
+        len--;
+        if(OTA_STATE_SEARCH == rx->state)
+        {
+            rx->match = (c == head[rx->match]) ? rx->match + 1 : (c == head[0]);
+            rx->error_match = (c == error[rx->error_match]) ? rx->error_match + 1 : (c == error[0]);
+            if(rx->match == sizeof(head) - 1)
+            {
+                rx->match = 0;
+                rx->field_index = 0;
+                rx->field[0] = rx->field[1] = rx->field[2] = 0;
+                rx->state = OTA_STATE_FIELD;
+            }
+            else if(rx->error_match == sizeof(error) - 1)
+            {
+                rx->status = OTA_RX_REJECTED;
+            }
+        }
+        else
+        {
+            if((c >= '0') && (c <= '9') && (rx->field[rx->field_index] < OTA_FIELD_MAX))
+            {
+                rx->field[rx->field_index] = rx->field[rx->field_index] * 10 + (c - '0');
+            }
+            else if((',' == c) && (rx->field_index < 2))
+            {
+                rx->field_index++;
+            }
+            else if((':' == c) && (2 == rx->field_index) && (rx->field[0] == rx->packet_count)
+                    && (rx->field[2] > OTA_WINDOW_CRC_SIZE) && (rx->field[2] <= rx->packet_size + OTA_WINDOW_CRC_SIZE))
+            {
+                rx->pos = 0;
+                rx->state = OTA_STATE_DATA;
+            }
+            else
+            {
+                //包头错误, 重新查找帧头, 缺的包由缺口或者超时请求重发
+                rx->state = OTA_STATE_SEARCH;
+                rx->match = (c == head[0]);
+                rx->error_match = (c == error[0]);
+            }
+        }
+    }
+    return rx->status;
+}
+
+/*********************************************************************************
+  *Function     : ota_receiver_poll
+  *Description  : 超时处理
+  *Input        : rx: 接收方
+                  now: 当前时间(ms)
+  *Output       : none
+  *Return       : 接收状态
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : OTA_WINDOW_TIMEOUT 内没有收到数据时请求重发 base
+**********************************************************************************/
+ota_rx_status_t OTA_ATTR ota_receiver_poll(ota_receiver_t *rx, uint32_t now)
+{
+    if((OTA_RX_RUNNING == rx->status) && (now - rx->last_time >= OTA_WINDOW_TIMEOUT))
+    {
+        rx->timeouts++;
+        if(++rx->retries > OTA_WINDOW_RETRIES)
+        {
+            rx->status = OTA_RX_TIMEOUT;
+        }
+        else
+        {
+            rx->last_time = now;
+            rx->nacked = 1;
+            otaReceiverAck(rx, rx->base);
+        }
+    }
+    return rx->status;
+}
+
+/*********************************************************************************
+  *Function     : ota_sender_init
+  *Description  : 初始化发送方
+  *Input        : tx: 发送方
+                  packet_count: 包个数
+                  window: 窗口, 不超过 OTA_WINDOW_MAX
+                  now: 当前时间(ms)
+  *Output       : none
+  *Return       : none
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : none
+**********************************************************************************/
+void OTA_ATTR ota_sender_init(ota_sender_t *tx, uint32_t packet_count, uint32_t window, uint32_t now)
+{
+    tx->packet_count = packet_count;
+    tx->window = (window > OTA_WINDOW_MAX) ? OTA_WINDOW_MAX : ((window == 0) ? 1 : window);
+    tx->base = 0;
+    tx->next = 0;
+    tx->resend = 0;
+    tx->last_time = now;
+}
+
+/*********************************************************************************
+  *Function     : ota_sender_next
+  *Description  : 下一个要发送的包
+  *Input        : tx: 发送方
+  *Output       : none
+  *Return       : 包序号  -1: 窗口已满或者已全部发送
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : 先重发被nack的包
+**********************************************************************************/
+int32_t OTA_ATTR ota_sender_next(ota_sender_t *tx)
+{
+    uint32_t b;
+
+    if(tx->resend)
+    {
+        for(b = 0; !(tx->resend & (1UL << b)); b++)
+        {
+        }
+        tx->resend &= ~(1UL << b);
+        return tx->base + b;
+    }
+    if((tx->next < tx->base + tx->window) && (tx->next < tx->packet_count))
+    {
+        return tx->next++;
+    }
+    return -1;
+}
+
+/*********************************************************************************
+  *Function     : ota_sender_ack
+  *Description  : 处理 AT+FILEACK
+  *Input        : tx: 发送方
+                  base: 接收方已收到base之前的包
+                  nack: 需要重发的包, -1 没有
+                  now: 当前时间(ms)
+  *Output       : none
+  *Return       : none
+  *author       : robot
+  *date         : 2016-05-20
+  *Others       : 确认丢失不影响, 后面的确认包含之前的确认
+**********************************************************************************/
+void OTA_ATTR ota_sender_ack(ota_sender_t *tx, int32_t base, int32_t nack, uint32_t now)
+{
+    uint32_t shift;
+
+    tx->last_time = now;
+    if((base > (int32_t)tx->base) && (base <= (int32_t)tx->next))
+    {
+        shift = base - tx->base;
+        tx->resend = (shift >= 32) ? 0 : (tx->resend >> shift);
+        tx->base = base;
+    }
+    if((nack >= (int32_t)tx->base) && (nack < (int32_t)tx->next))
+    {
+        tx->resend |= 1UL << (nack - tx->base);
+    }
+}
+
+int OTA_ATTR ota_sender_done(ota_sender_t *tx)
+{
+    return tx->base >= tx->packet_count;
+}
+
+int OTA_ATTR ota_sender_expired(ota_sender_t *tx, uint32_t now)
+{
+    return (now - tx->last_time) >= OTA_WINDOW_SENDER_TIMEOUT;
+}
@@ -33,3 +33,4 @@ endif
 # 包含本模块头文件
 PLATFORM_MCU_PATH=$(PLATFORM_MODULE_PATH)/MCU/$(PLATFORM_MCU)
 include $(call rwildcard,$(PLATFORM_MCU_PATH)/,include.mk)
+include $(call rwildcard,$(PLATFORM_MODULE_PATH)/MCU/shared/,include.mk)
@@ -0,0 +1,712 @@
+/**
+ ******************************************************************************
+ * @file     : ajson_test.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : aJson 解析器测试和模糊测试
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+/*
+  parseDocument/parseInSitu 与字符串流解析器 aJson.parse(char *) 的结果比较,
+  aJsonReader 的分段输入和过长的值, 数字和转义字符串在各解析路径上的一致性,
+  以及随机变形输入的模糊测试 (配合 SANITIZE=y 检查越界)
+  参数: 随机数字, 字符串和模糊测试的次数
+*/
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "application.h"
+#include "ajson.h"
+#include "host_test.h"
+
+static const char *seeds[] =
+{
+    "{\"ssid\":\"intorobot\",\"passwd\":\"12345678\",\"channel\":6,\"dhcp\":true,\"ip\":null}",
+    "{\"md5\":\"0123456789abcdef0123456789abcdef\",\"dwn_token\":\"tok\",\"size\":123456}",
+    "[1,-2,3.5,-0.25e-3,1e10,2147483648,-9223372036854775808,[],{},[[[1]]]]",
+    "{\"a\":{\"b\":{\"c\":[true,false,null,\"x\\ny\\t\\\"z\\\\\"]}}, \"k\" : [ 1 , 2 ] }",
+    "  \"plain string\"  ",
+    "-12.5",
+    "{\"list\":[{\"id\":1,\"v\":\"one\"},{\"id\":2,\"v\":\"two\"},{\"id\":3,\"v\":\"three\"}]}",
+};
+
+static aJsonClass aJson;
+
+// aJsonStream::getch 的超时: 每次调用前进 1ms, 流结束时很快超时
+system_tick_t millis(void)
+{
+    static system_tick_t ms;
+
+    return ms++;
+}
+
+/*
+  只能逐字节读取的流, 走 aJsonStream 的 getch 路径
+*/
+class StringSource : public Stream
+{
+    public:
+        StringSource(const char *text) : p(text) {}
+        virtual int available(void) { return *p != 0; }
+        virtual int read(void) { return *p ? (uint8_t)*p++ : -1; }
+        virtual int peek(void) { return *p ? (uint8_t)*p : -1; }
+        virtual void flush(void) {}
+        virtual size_t write(uint8_t c) { return 0; }
+
+    private:
+        const char *p;
+};
+
+static aJsonObject *getch_parse(const char *text)
+{
+    StringSource source(text);
+    aJsonStream stream(&source);
+
+    return aJson.parse(&stream);
+}
+
+/*
+  两棵树相同: 类型, 名字, 数值和字符串
+*/
+static bool same_tree(aJsonObject *a, aJsonObject *b)
+{
+    while(a != NULL && b != NULL)
+    {
+        if((a->type & ~aJson_IsReference) != (b->type & ~aJson_IsReference))
+        {
+            return false;
+        }
+        if((a->name == NULL) != (b->name == NULL) || (a->name != NULL && strcmp(a->name, b->name)))
+        {
+            return false;
+        }
+        switch(a->type)
+        {
+            case aJson_Int:
+                if(a->valueint != b->valueint) return false;
+                break;
+            case aJson_Long:
+                if(a->valuelong != b->valuelong) return false;
+                break;
+            case aJson_Float:
+                if(memcmp(&a->valuefloat, &b->valuefloat, sizeof(a->valuefloat))) return false;
+                break;
+            case aJson_String:
+                if(strcmp(a->valuestring, b->valuestring)) return false;
+                break;
+            case aJson_Array:
+            case aJson_Object:
+                if(!same_tree(a->child, b->child)) return false;
+                break;
+        }
+        a = a->next;
+        b = b->next;
+    }
+    return (a == NULL) && (b == NULL);
+}
+
+/*
+  流解析器不接受字符串中的控制字符, 在位解析器保留它们: 这样的输入不比较
+*/
+static bool has_control(const char *text)
+{
+    for(; *text; text++)
+    {
+        if((unsigned char)*text < ' ')
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int reader_parse(const char *text)
+{
+    aJsonReader reader;
+
+    return reader.parse(text);
+}
+
+/*=======测试===============================================================*/
+static void test_seeds(void)
+{
+    for(unsigned i = 0; i < sizeof(seeds) / sizeof(seeds[0]); i++)
+    {
+        char text[256];
+        aJsonObject *doc = aJson.parseDocument(seeds[i]);
+
+        strcpy(text, seeds[i]);
+        aJsonObject *tree = aJson.parse(text);
+
+        TEST_CHECK(doc != NULL);
+        TEST_CHECK(tree != NULL);
+        TEST_CHECK(same_tree(doc, tree));
+        TEST_CHECK_EQ(reader_parse(seeds[i]), aJson_ReaderDone);
+        aJson.deleteDocument(doc);
+        aJson.deleteItem(tree);
+    }
+}
+
+static void test_trailing(void)
+{
+    // 根之后只能有空白
+    static const struct
+    {
+        const char *text;
+        bool ok;
+    } cases[] =
+    {
+        {"{\"a\":1}", true},
+        {"{\"a\":1} \r\n\t", true},
+        {" [1] ", true},
+        {"12 ", true},
+        {"{\"a\":1}garbage", false},
+        {"{\"a\":1}}", false},
+        {"[1]]", false},
+        {"[1],", false},
+        {"\"x\"y", false},
+        {"1 2", false},
+        {"12x", false},
+        {"true false", false},
+        {"null,", false},
+        {"", false},
+        {"   ", false},
+    };
+
+    for(unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        aJsonObject *doc = aJson.parseDocument(cases[i].text);
+
+        TEST_CHECK_EQ((doc != NULL), cases[i].ok);
+        TEST_CHECK_EQ((reader_parse(cases[i].text) == aJson_ReaderDone), cases[i].ok);
+        if(doc != NULL)
+        {
+            aJson.deleteDocument(doc);
+        }
+    }
+}
+
+static void test_arena(void)
+{
+    // arenaSize 足够; 任何更小的 arena 都返回 NULL 而不越界
+    const char *seed = seeds[6];
+    size_t need = aJson.arenaSize(seed);
+    char text[256];
+
+    for(size_t size = 0; size <= need; size++)
+    {
+        void *arena = malloc(size ? size : 1);
+
+        strcpy(text, seed);
+        aJsonObject *root = aJson.parseInSitu(text, arena, size);
+        if(size == need)
+        {
+            TEST_CHECK(root != NULL);
+        }
+        else if(root != NULL)
+        {
+            // 对齐之后余量够用也可以成功, 但节点必须都在 arena 内
+            TEST_CHECK((uint8_t *)root >= (uint8_t *)arena);
+        }
+        free(arena);
+    }
+}
+
+/*
+  aJsonReader 过滤的值
+*/
+typedef struct
+{
+    int count;
+    char type;
+    char value[aJson_ReaderTokenSize];
+} reader_value_t;
+
+static void reader_callback(const char *path, aJsonObject *value, void *arg)
+{
+    reader_value_t *v = (reader_value_t *)arg;
+
+    v->count++;
+    v->type = value->type;
+    if(value->type == aJson_String || value->type == aJson_ReaderTruncated)
+    {
+        strcpy(v->value, value->valuestring);
+    }
+    else if(value->type == aJson_Int)
+    {
+        sprintf(v->value, "%d", value->valueint);
+    }
+}
+
+static void test_reader_long(void)
+{
+    // 过长的过滤值被截断并标记, 不影响同一文本中的其它值
+    static char text[1024], url[400];
+    reader_value_t md5, link, token;
+    aJsonReader reader;
+    size_t i;
+
+    for(i = 0; i < 300; i++)
+    {
+        url[i] = 'a' + i % 26;
+    }
+    url[i] = 0;
+    sprintf(text, "{\"md5\":\"0123456789abcdef\",\"url\":\"%s\",\"dwn_token\":\"tok\"}", url);
+    reader.addFilter("md5", reader_callback, &md5);
+    reader.addFilter("url", reader_callback, &link);
+    reader.addFilter("dwn_token", reader_callback, &token);
+
+    // 整个文本和逐字节输入结果相同
+    for(int chunked = 0; chunked < 2; chunked++)
+    {
+        int ret = aJson_ReaderMore;
+
+        memset(&md5, 0, sizeof(md5));
+        memset(&link, 0, sizeof(link));
+        memset(&token, 0, sizeof(token));
+        if(chunked)
+        {
+            reader.reset();
+            for(i = 0; i < strlen(text) && ret == aJson_ReaderMore; i++)
+            {
+                ret = reader.feed((const uint8_t *)&text[i], 1);
+            }
+        }
+        else
+        {
+            ret = reader.parse(text);
+        }
+        TEST_CHECK_EQ(ret, aJson_ReaderDone);
+        TEST_CHECK_EQ(md5.type, aJson_String);
+        TEST_CHECK(strcmp(md5.value, "0123456789abcdef") == 0);
+        TEST_CHECK_EQ(token.type, aJson_String);
+        TEST_CHECK(strcmp(token.value, "tok") == 0);
+        TEST_CHECK_EQ(link.count, 1);
+        TEST_CHECK_EQ(link.type, aJson_ReaderTruncated);
+        TEST_CHECK_EQ(strlen(link.value), aJson_ReaderTokenSize - 1);
+        TEST_CHECK(strncmp(link.value, url, aJson_ReaderTokenSize - 1) == 0);
+    }
+
+    // 刚好放得下和多一个字节
+    url[aJson_ReaderTokenSize - 1] = 0;
+    sprintf(text, "{\"url\":\"%s\"}", url);
+    TEST_CHECK_EQ(reader.parse(text), aJson_ReaderDone);
+    TEST_CHECK_EQ(link.type, aJson_String);
+    TEST_CHECK(strcmp(link.value, url) == 0);
+    sprintf(text, "{\"url\":\"%sz\"}", url);
+    TEST_CHECK_EQ(reader.parse(text), aJson_ReaderDone);
+    TEST_CHECK_EQ(link.type, aJson_ReaderTruncated);
+    TEST_CHECK(strcmp(link.value, url) == 0);
+
+    // 截断不拆开 utf-8 字符: 126 个字节之后的 \u00e9 和 \u4e2d 放不下
+    url[aJson_ReaderTokenSize - 2] = 0;
+    sprintf(text, "{\"url\":\"%s\\u00e9\"}", url);
+    TEST_CHECK_EQ(reader.parse(text), aJson_ReaderDone);
+    TEST_CHECK_EQ(link.type, aJson_ReaderTruncated);
+    TEST_CHECK(strcmp(link.value, url) == 0);
+    url[aJson_ReaderTokenSize - 3] = 0;
+    sprintf(text, "{\"url\":\"%s\\u4e2d\"}", url);
+    TEST_CHECK_EQ(reader.parse(text), aJson_ReaderDone);
+    TEST_CHECK_EQ(link.type, aJson_ReaderTruncated);
+    TEST_CHECK(strcmp(link.value, url) == 0);
+    // 完整的多字节字符保留
+    url[aJson_ReaderTokenSize - 4] = 0;
+    sprintf(text, "{\"url\":\"%s\\u4e2dzz\"}", url);
+    TEST_CHECK_EQ(reader.parse(text), aJson_ReaderDone);
+    TEST_CHECK_EQ(link.type, aJson_ReaderTruncated);
+    TEST_CHECK_EQ(strlen(link.value), aJson_ReaderTokenSize - 1);
+    TEST_CHECK(strcmp(link.value + aJson_ReaderTokenSize - 4, "\xe4\xb8\xad") == 0);
+
+    // 截断之后字符串的其余部分仍然检查
+    url[10] = 0;
+    sprintf(text, "{\"url\":\"%s%s%s\\q\\u12\"}", url, url, url);
+    TEST_CHECK_EQ(reader.parse(text), aJson_ReaderError);
+}
+
+static void test_reader_chunks(void)
+{
+    // 随机分段输入与 parseDocument 得到同样的值
+    aJsonObject *doc = aJson.parseDocument(seeds[1]);
+    reader_value_t md5, token, size;
+    aJsonReader reader;
+    size_t len = strlen(seeds[1]);
+
+    reader.addFilter("md5", reader_callback, &md5);
+    reader.addFilter("DWN_TOKEN", reader_callback, &token);
+    reader.addFilter("size", reader_callback, &size);
+    test_srand(12);
+    for(int i = 0; i < 500; i++)
+    {
+        size_t pos = 0;
+        int ret = aJson_ReaderMore;
+
+        memset(&md5, 0, sizeof(md5));
+        memset(&token, 0, sizeof(token));
+        memset(&size, 0, sizeof(size));
+        reader.reset();
+        while(pos < len)
+        {
+            size_t n = 1 + test_rand() % 8;
+
+            if(n > len - pos)
+            {
+                n = len - pos;
+            }
+            ret = reader.feed((const uint8_t *)seeds[1] + pos, n);
+            pos += n;
+        }
+        TEST_CHECK_EQ(ret, aJson_ReaderDone);
+        TEST_CHECK(strcmp(md5.value, aJson.getObjectItem(doc, "md5")->valuestring) == 0);
+        TEST_CHECK(strcmp(token.value, aJson.getObjectItem(doc, "dwn_token")->valuestring) == 0);
+        TEST_CHECK_EQ(atoi(size.value), aJson.getObjectItem(doc, "size")->valueint);
+    }
+    aJson.deleteDocument(doc);
+}
+
+/*
+  数字: 四个解析路径的结果相同, 并且与 strtoll/strtod 完全一致
+*/
+static void random_number(char *text)
+{
+    static const char *fixed[] =
+    {
+        "0", "-0", "-0.0", "2147483647", "-2147483648", "2147483648", "-2147483649",
+        "9223372036854775807", "-9223372036854775808", "9223372036854775808",
+        "12345678901234567890123", "9007199254740993", "9007199254740993.0",
+        "0.1", "1e22", "1e23", "1.7976931348623157e308", "2e308", "4.9e-324", "2e-400",
+        "123456789012345678901234567890e-10", "0.000000000000000000000000000001",
+    };
+    uint32_t r = test_rand();
+    char *p = text;
+    int n;
+
+    if(r % 8 == 0)
+    {
+        strcpy(text, fixed[(r >> 3) % (sizeof(fixed) / sizeof(fixed[0]))]);
+        return;
+    }
+    if(r & 8)
+    {
+        *p++ = '-';
+    }
+    n = 1 + (r >> 4) % 24;
+    *p++ = '1' + test_rand() % 9;
+    while(--n)
+    {
+        *p++ = '0' + test_rand() % 10;
+    }
+    if(r & 16)
+    {
+        *p++ = '.';
+        n = 1 + (r >> 12) % 20;
+        while(n--)
+        {
+            *p++ = '0' + test_rand() % 10;
+        }
+    }
+    if(r & 32)
+    {
+        p += sprintf(p, "%s%d", (r & 64) ? "e-" : ((r & 128) ? "E+" : "e"), (int)((r >> 20) % 330));
+    }
+    *p = 0;
+}
+
+static bool number_ok(aJsonObject *item, const char *text)
+{
+    bool integer = (strpbrk(text, ".eE") == NULL);
+    long long ll;
+    double d;
+
+    if(item == NULL)
+    {
+        return false;
+    }
+    errno = 0;
+    ll = strtoll(text, NULL, 10);
+    if(integer && errno == 0 && ll >= INT_MIN && ll <= INT_MAX)
+    {
+        return (item->type == aJson_Int) && (item->valueint == ll);
+    }
+    if(integer && errno == 0)
+    {
+        return (item->type == aJson_Long) && (item->valuelong == ll);
+    }
+    d = strtod(text, NULL);
+    return (item->type == aJson_Float) && !memcmp(&d, &item->valuefloat, sizeof(d));
+}
+
+static void number_reader_callback(const char *path, aJsonObject *value, void *arg)
+{
+    memcpy(arg, value, sizeof(aJsonObject));
+}
+
+static void test_numbers(int count)
+{
+    int bad[4] = {0, 0, 0, 0};
+
+    test_srand(13);
+    for(int i = 0; i < count; i++)
+    {
+        char number[80], text[100];
+        aJsonObject *item, read;
+        aJsonReader reader;
+
+        random_number(number);
+        sprintf(text, "[%s]", number);
+
+        item = aJson.parse(text);
+        bad[0] += !number_ok(item ? item->child : NULL, number);
+        aJson.deleteItem(item);
+
+        item = getch_parse(text);
+        bad[1] += !number_ok(item ? item->child : NULL, number);
+        aJson.deleteItem(item);
+
+        item = aJson.parseDocument(text);
+        bad[2] += !number_ok(item ? item->child : NULL, number);
+        aJson.deleteDocument(item);
+
+        memset(&read, 0, sizeof(read));
+        reader.addFilter("0", number_reader_callback, &read);
+        bad[3] += (reader.parse(text) != aJson_ReaderDone) || !number_ok(&read, number);
+    }
+    TEST_CHECK_EQ(bad[0], 0);
+    TEST_CHECK_EQ(bad[1], 0);
+    TEST_CHECK_EQ(bad[2], 0);
+    TEST_CHECK_EQ(bad[3], 0);
+
+    // 不完整的数字
+    static const char *malformed[] = {"[-]", "[1.]", "[1e]", "[1e+]", "[.5]", "[-.5]"};
+    for(unsigned k = 0; k < sizeof(malformed) / sizeof(malformed[0]); k++)
+    {
+        char text[16];
+
+        strcpy(text, malformed[k]);
+        TEST_CHECK(aJson.parse(text) == NULL);
+        TEST_CHECK(getch_parse(malformed[k]) == NULL);
+        TEST_CHECK(aJson.parseDocument(malformed[k]) == NULL);
+        TEST_CHECK_EQ(reader_parse(malformed[k]), aJson_ReaderError);
+    }
+}
+
+/*
+  字符串: 随机转义, 四个解析路径得到同样的内容
+*/
+static void string_reader_callback(const char *path, aJsonObject *value, void *arg)
+{
+    strcpy((char *)arg, value->valuestring);
+}
+
+static void test_strings(int count)
+{
+    static const char *pieces[] =
+    {
+        "a", "Z", " ", "0", "\\n", "\\t", "\\\"", "\\\\", "\\/", "\\b", "\\f", "\\r",
+        "\\u0041", "\\u00e9", "\\u4e2d", "\\u20AC", "\xc3\xa9", "\xe4\xb8\xad", "abcd", "{}[],:",
+    };
+    int bad = 0;
+
+    test_srand(17);
+    for(int i = 0; i < count; i++)
+    {
+        char text[400], copy[400], got[aJson_ReaderTokenSize];
+        char *p = text;
+        int n = test_rand() % 30;
+        aJsonObject *a, *b, *c;
+        aJsonReader reader;
+
+        p += sprintf(p, "{\"s\":\"");
+        while(n--)
+        {
+            p += sprintf(p, "%s", pieces[test_rand() % (sizeof(pieces) / sizeof(pieces[0]))]);
+        }
+        sprintf(p, "\"}");
+
+        strcpy(copy, text);
+        a = aJson.parse(copy);
+        b = getch_parse(text);
+        c = aJson.parseDocument(text);
+        got[0] = 0;
+        reader.addFilter("s", string_reader_callback, got);
+        if(a == NULL || b == NULL || c == NULL || reader.parse(text) != aJson_ReaderDone
+            || strcmp(a->child->valuestring, b->child->valuestring)
+            || strcmp(a->child->valuestring, c->child->valuestring)
+            || strcmp(a->child->valuestring, got))
+        {
+            bad++;
+        }
+        aJson.deleteItem(a);
+        aJson.deleteItem(b);
+        aJson.deleteDocument(c);
+    }
+    TEST_CHECK_EQ(bad, 0);
+
+    // 转义的解码
+    char text[] = "[\"\\u0041\\u00e9\\u4e2d\\n\\\"\\\\\\/\"]";
+    aJsonObject *item = aJson.parse(text);
+    TEST_CHECK(item != NULL && strcmp(item->child->valuestring, "A\xc3\xa9\xe4\xb8\xad\n\"\\/") == 0);
+    aJson.deleteItem(item);
+}
+
+static void test_long_string(void)
+{
+    // 字符串流中的长字符串完整保留; 逐字节的流截断在 stringbuffer 的长度, 不越界
+    static char text[2100];
+    size_t i;
+
+    text[0] = '[';
+    text[1] = '\"';
+    for(i = 2; i < 2002; i++)
+    {
+        text[i] = 'a' + i % 26;
+    }
+    strcpy(&text[i], "\"]");
+
+    aJsonObject *item = getch_parse(text);
+    TEST_CHECK(item != NULL && strlen(item->child->valuestring) == 255);
+    TEST_CHECK(item != NULL && strncmp(item->child->valuestring, &text[2], 255) == 0);
+    aJson.deleteItem(item);
+
+    item = aJson.parse(text);
+    TEST_CHECK(item != NULL && strlen(item->child->valuestring) == 2000);
+    TEST_CHECK(item != NULL && strncmp(item->child->valuestring, &text[2], 2000) == 0);
+    aJson.deleteItem(item);
+}
+
+/*
+  随机变形: 改写, 插入, 删除字节, 截断, 在末尾追加
+*/
+static void mutate(char *text, size_t cap)
+{
+    static const char alphabet[] = "{}[]\":,\\/ntfrue0123456789.eE+-x \t\n\x01\x7f\xc3";
+    size_t len = strlen(text);
+    int n = 1 + test_rand() % 4;
+
+    while(n--)
+    {
+        uint32_t r = test_rand();
+        size_t at = len ? (r >> 8) % (len + 1) : 0;
+        char c = alphabet[(r >> 20) % (sizeof(alphabet) - 1)];
+
+        switch(r % 5)
+        {
+            case 0:
+                if(at < len) text[at] = c;
+                break;
+            case 1:
+                if(len + 1 < cap)
+                {
+                    memmove(text + at + 1, text + at, len - at + 1);
+                    text[at] = c;
+                    len++;
+                }
+                break;
+            case 2:
+                if(at < len)
+                {
+                    memmove(text + at, text + at + 1, len - at);
+                    len--;
+                }
+                break;
+            case 3:
+                text[at] = 0;
+                len = at;
+                break;
+            default:
+                if(len + 1 < cap)
+                {
+                    text[len++] = c;
+                    text[len] = 0;
+                }
+                break;
+        }
+    }
+}
+
+static void fuzz(int count)
+{
+    int accepted = 0, mismatch = 0, reader_mismatch = 0;
+
+    test_srand(2016);
+    for(int i = 0; i < count; i++)
+    {
+        char text[300], copy[300];
+
+        strcpy(text, seeds[test_rand() % (sizeof(seeds) / sizeof(seeds[0]))]);
+        mutate(text, sizeof(text));
+
+        // 输入放在刚好大小的堆块中, 越界读写由 AddressSanitizer 发现
+        size_t len = strlen(text);
+        char *exact = (char *)malloc(len + 1);
+        memcpy(exact, text, len + 1);
+        size_t arena_size = aJson.arenaSize(exact);
+        void *arena = malloc(arena_size);
+        aJsonObject *root = aJson.parseInSitu(exact, arena, arena_size);
+
+        aJsonObject *doc = aJson.parseDocument(text);
+        if((root != NULL) != (doc != NULL))
+        {
+            mismatch++;
+        }
+        if(doc != NULL && !has_control(text))
+        {
+            // 接受的文本: 字符串流解析器得到同样的树, 事件解析器也接受
+            accepted++;
+            strcpy(copy, text);
+            aJsonObject *tree = aJson.parse(copy);
+            if(tree == NULL || !same_tree(doc, tree))
+            {
+                mismatch++;
+            }
+            if(reader_parse(text) != aJson_ReaderDone)
+            {
+                reader_mismatch++;
+            }
+            aJson.deleteItem(tree);
+        }
+        if(doc != NULL)
+        {
+            aJson.deleteDocument(doc);
+        }
+        free(arena);
+        free(exact);
+    }
+    printf("fuzz: %d inputs, %d accepted\n", count, accepted);
+    TEST_CHECK(accepted > count / 50);
+    TEST_CHECK_EQ(mismatch, 0);
+    TEST_CHECK_EQ(reader_mismatch, 0);
+}
+
+int main(int argc, char *argv[])
+{
+    int count = (argc > 1) ? atoi(argv[1]) : 20000;
+
+    test_seeds();
+    test_trailing();
+    test_arena();
+    test_reader_long();
+    test_reader_chunks();
+    test_numbers(count);
+    test_strings(count);
+    test_long_string();
+    fuzz(count);
+
+    return TEST_DONE();
+}
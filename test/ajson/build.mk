@@ -0,0 +1,8 @@
+# aJson: parseDocument/parseInSitu 与流解析器比较, 根之后的多余数据, aJsonReader 分段和截断,
+#        数字/字符串在四个解析路径上与 strtod/strtoll 一致, 随机变形输入
+TESTS += ajson
+ajson_SRC = test/ajson/ajson_test.cpp board/neutron/src/ajson.cpp board/neutron/src/stringbuffer.cpp \
+    board/gcc/src/cmsis_os.cpp board/neutron/src/wiring_print.cpp board/neutron/src/wiring_stream.cpp \
+    board/neutron/src/wiring_ipaddress.cpp board/neutron/src/wiring_string.cpp \
+    board/neutron/src/wiring_usbserial.cpp board/gcc/src/wiring_usbserial_hal.cpp
+ajson_ARGS = 20000
@@ -0,0 +1,516 @@
+/**
+ ******************************************************************************
+ * @file     : at_parser_test.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : esp8266 AT 返回结果解析回放测试和性能对比
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+/*
+  生成一段 esp8266 串口数据(命令返回, 无关的行, 带任意二进制数据的 +IPD),
+  同时记录解析后应该写入 cmd fifo 和各个连接 tcp fifo 的数据
+  按不同的分段方式回放, 结果必须与分段无关且与预期完全一致
+  最后分别用当前解析器和之前的检索窗口(strstr)实现回放同一段数据并计时
+*/
+#include <stdlib.h>
+#include <string>
+
+// 直接包含驱动源文件, 测试其中的静态解析函数
+#include "../../board/neutron/src/lib_wifi_drv.cpp"
+#include "host_test.h"
+
+/*=======驱动依赖的板级接口=================================================*/
+uint8_t smartconfig_over_flag;
+
+void mo_drv_wifi_reset_hardware() {}
+void mo_uart1_init() {}
+int mo_uart1_read(char *p_buf,int len,int timeout) { return 0; }
+int mo_uart1_peek(char **p_dat,int timeout) { return 0; }
+void mo_uart1_consume(int len) {}
+int mo_uart1_overrun(void) { return 0; }
+int mo_uart1_write(const char *p_buf,int len) { return len; }
+
+system_tick_t millis(void)
+{
+    return (system_tick_t)(test_now() * 1000);
+}
+
+void delay(unsigned long ms) {}
+
+/*=======回放数据===========================================================*/
+#define LINK_NUM    3
+
+static std::string trace;                   // 串口数据
+static std::string expect_cmd;              // cmd fifo 中应有的数据
+static std::string expect_link[LINK_NUM];   // 各个连接应收到的数据
+
+static std::string got_cmd;
+static std::string got_link[LINK_NUM];
+
+static void add_fixed(const char *line, const char *result)
+{
+    trace += "\r\n";
+    trace += line;
+    trace += "\r\n";
+    if(result != NULL)
+    {
+        expect_cmd.append(result, strlen(result) + 1);
+    }
+}
+
+static void add_ipd(int ch, int len)
+{
+    char head[24];
+    static const char *traps[] = {"\r\nOK\r\n", "+IPD,0,5:", "\r\nSEND OK\r\n", "STATUS:2", ">", "\n+CIPSTATUS:0,\"TCP\""};
+    std::string payload;
+
+    while((int)payload.size() < len)
+    {
+        // 数据中混入返回结果, 不能被当作命令返回
+        if((test_rand() % 8) == 0)
+        {
+            payload += traps[test_rand() % (sizeof(traps) / sizeof(traps[0]))];
+        }
+        else
+        {
+            payload += (char)(test_rand() & 0xFF);
+        }
+    }
+    payload.resize(len);
+
+    sprintf(head, "\r\n+IPD,%d,%d:", ch, len);
+    trace += head;
+    trace += payload;
+    expect_link[ch] += payload;
+}
+
+static void build_trace(uint32_t seed, int events)
+{
+    int i;
+
+    test_srand(seed);
+    trace.clear();
+    expect_cmd.clear();
+    for(i = 0; i < LINK_NUM; i++)
+    {
+        expect_link[i].clear();
+    }
+
+    for(i = 0; i < events; i++)
+    {
+        switch(test_rand() % 10)
+        {
+            case 0:
+                add_fixed("OK", "OK");
+                break;
+            case 1:
+                // > 之后没有行尾, 下一个返回以 \r\n 开始
+                trace += "\r\n> ";
+                expect_cmd.append(">", 2);
+                add_fixed("Recv 12 bytes", NULL);
+                add_fixed("SEND OK", "SEND OK");
+                break;
+            case 2:
+                add_fixed("+CIPSTATUS:1,\"TCP\",\"192.168.0.124\",1883,0", NULL);
+                expect_cmd.append("11$", 3);
+                add_fixed("+CIPSTATUS:2,\"UDP\",\"10.0.0.1\",5683,0", NULL);
+                expect_cmd.append("22$", 3);
+                add_fixed("STATUS:2", "STATUS:2");
+                break;
+            case 3:
+                add_fixed("+CWJAP_CUR:\"intorobot\",\"5c:63:bf:00:11:22\",6,-50", NULL);
+                expect_cmd += "+CWJAP_CUR:\"intorobot\",\"5c:63:bf:00:11:22\",6,-50\r\n";
+                break;
+            case 4:
+                add_fixed("WIFI GOT IP", NULL);
+                add_fixed("busy p...", NULL);
+                break;
+            case 5:
+                add_fixed("ALREAY CONNECT", "ALREAY CONNECT");
+                break;
+            default:
+                add_ipd(test_rand() % LINK_NUM, 1 + test_rand() % 1460);
+                break;
+        }
+    }
+}
+
+static void drain(void)
+{
+    char buf[256];
+    int n, i;
+
+    while((n = fifo__read(&cmd_ctl.handle, (uint8_t *)buf, sizeof(buf))) > 0)
+    {
+        got_cmd.append(buf, n);
+    }
+    for(i = 0; i < LINK_NUM; i++)
+    {
+        while((n = mo_drv_wifi_read_tcpc_fifo(buf, sizeof(buf), i)) > 0)
+        {
+            got_link[i].append(buf, n);
+        }
+    }
+}
+
+static void reset_output(void)
+{
+    int i;
+
+    drain();
+    got_cmd.clear();
+    for(i = 0; i < LINK_NUM; i++)
+    {
+        got_link[i].clear();
+    }
+}
+
+/*
+  chunk 为 0 时随机分段
+*/
+static void replay(int chunk)
+{
+    int pos = 0;
+
+    reset_output();
+    at_parser_init(&at_parser);
+    while(pos < (int)trace.size())
+    {
+        int n = chunk ? chunk : 1 + test_rand() % AT_RECV_SIZE;
+
+        if(n > (int)trace.size() - pos)
+        {
+            n = trace.size() - pos;
+        }
+        at_parser_input(&at_parser, trace.data() + pos, n);
+        drain();
+        pos += n;
+    }
+}
+
+static void check_output(const char *name)
+{
+    int i;
+    bool ok = (got_cmd == expect_cmd);
+
+    TEST_CHECK(got_cmd == expect_cmd);
+    for(i = 0; i < LINK_NUM; i++)
+    {
+        TEST_CHECK(got_link[i] == expect_link[i]);
+        ok = ok && (got_link[i] == expect_link[i]);
+    }
+    if(!ok)
+    {
+        printf("  replay %s: cmd %d/%d bytes\n", name, (int)got_cmd.size(), (int)expect_cmd.size());
+    }
+}
+
+/*=======之前的实现: 检索窗口 + strstr (对比用)==============================*/
+#define LEGACY_SEARCH_SIZE 65
+
+static char legacy_buf[LEGACY_SEARCH_SIZE];
+static int legacy_pos;
+
+static int legacy_read(char *p_buf, int len)
+{
+    int n = trace.size() - legacy_pos;
+
+    drain();
+    if(n > len)
+    {
+        n = len;
+    }
+    memcpy(p_buf, trace.data() + legacy_pos, n);
+    legacy_pos += n;
+    return n;
+}
+
+static int legacy_filter(const char *p_filter)
+{
+    char *p_index = strstr(legacy_buf, p_filter);
+
+    if(p_index == NULL)
+    {
+        return 0;
+    }
+    memset(p_index, '$', strlen(p_filter));
+    if(filter_mask & 0x80000000)
+    {
+        mo_cmd_fifo_write(p_filter, strlen(p_filter) + 1);
+    }
+    return 1;
+}
+
+static char *legacy_strstr_tcp(char *p_dat, unsigned char *channel, int *len)
+{
+    char *p1, *p2, *p3;
+
+    if(((p1 = strstr(p_dat, HEAD_TCPC)) != NULL) && ((p2 = strstr(p1 + 5, ",")) != NULL) && ((p3 = strstr(p2 + 1, ":")) != NULL))
+    {
+        char temp[8];
+
+        memset(temp, 0, sizeof(temp));
+        memcpy(temp, p2 + 1, (p3 - p2) < 7 ? (p3 - p2) : 7);
+        *channel = p1[5] - '0';
+        *len = atoi(temp);
+        memset(p1, '$', p3 - p1 + 1);
+        if((*channel < LINK_NUM) && (0 < *len) && (*len < 4096))
+        {
+            return p3 + 1;
+        }
+    }
+    return NULL;
+}
+
+/*
+  与之前 task_mo_uart_filter 的处理过程相同: 每次读入半个窗口, 移动窗口, 对每个返回结果执行 strstr
+*/
+static void legacy_replay(void)
+{
+    char recv_buf[LEGACY_SEARCH_SIZE / 2];
+    char exceed[LEGACY_SEARCH_SIZE / 2];
+    int exceed_len = 0;
+    char *end = legacy_buf + LEGACY_SEARCH_SIZE - 1;
+    int recv_size;
+
+    memset(legacy_buf, '$', LEGACY_SEARCH_SIZE - 1);
+    legacy_buf[LEGACY_SEARCH_SIZE - 1] = 0;
+    legacy_pos = 0;
+    reset_output();
+
+    for(;;)
+    {
+        if(exceed_len)
+        {
+            memcpy(recv_buf, exceed, exceed_len);
+            recv_size = exceed_len;
+            exceed_len = 0;
+        }
+        else if((recv_size = legacy_read(recv_buf, sizeof(recv_buf))) <= 0)
+        {
+            break;
+        }
+
+        memmove(legacy_buf, legacy_buf + recv_size, LEGACY_SEARCH_SIZE - 1 - recv_size);
+        memcpy(end - recv_size, recv_buf, recv_size);
+
+        unsigned char ch;
+        int len, written;
+        char *p;
+        while((p = legacy_strstr_tcp(legacy_buf, &ch, &len)) != NULL)
+        {
+            if(end - p >= len)
+            {
+                mo_drv_wifi_write_tcpc_fifo(p, len, ch);
+                memset(p, '$', len);
+                continue;
+            }
+            written = end - p;
+            mo_drv_wifi_write_tcpc_fifo(p, written, ch);
+            memset(p, '$', written);
+            while((recv_size = legacy_read(recv_buf, sizeof(recv_buf))) > 0)
+            {
+                if(written + recv_size < len)
+                {
+                    mo_drv_wifi_write_tcpc_fifo(recv_buf, recv_size, ch);
+                    written += recv_size;
+                    continue;
+                }
+                mo_drv_wifi_write_tcpc_fifo(recv_buf, len - written, ch);
+                exceed_len = recv_size - (len - written);
+                memcpy(exceed, recv_buf + (len - written), exceed_len);
+                break;
+            }
+            break;
+        }
+
+        legacy_filter(SEND_OK_TCPC);
+        legacy_filter(RET_REST);
+        legacy_filter(RET_STATUS_2);
+        legacy_filter(RET_STATUS_5);
+        legacy_filter(HEAD_IPSTATUS);
+        legacy_filter(HEAD_CWJAP);
+        legacy_filter(SEND_ACK_TCPC);
+        legacy_filter(RET_OK);
+        legacy_filter(ALREADY_CONNECT);
+    }
+    drain();
+}
+
+/*=======测试===============================================================*/
+static void test_chunking(void)
+{
+    static const int chunks[] = {1, 2, 7, 64, AT_RECV_SIZE, 0, 0};
+    char name[16];
+    unsigned int i;
+
+    build_trace(1, 400);
+    for(i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+    {
+        sprintf(name, "chunk %d", chunks[i]);
+        replay(chunks[i]);
+        check_output(name);
+    }
+}
+
+static void test_filter_mask(void)
+{
+    // AT+CIPSEND 屏蔽 OK, 其他结果照常上报
+    set_filter_en("AT+CIPSEND=0,12");
+    trace = "\r\nOK\r\n\r\n> ";
+    replay(0);
+    TEST_CHECK(got_cmd == std::string(">", 2));
+    set_filter_en("AT");
+}
+
+static void test_bad_ipd(void)
+{
+    // 通道或长度不合法的 +IPD 头跳到行尾, 后面的返回结果不受影响
+    trace = "\r\n+IPD,9,10:0123456789\r\nOK\r\n+IPD,0,x\r\nSEND OK\r\n+IPD,1,3:abc";
+    replay(1);
+    TEST_CHECK(got_cmd == std::string("OK\0SEND OK\0", 11));
+    TEST_CHECK(got_link[0].empty());
+    TEST_CHECK(got_link[1] == "abc");
+}
+
+static void test_line_overflow(void)
+{
+    // 超过行缓冲的整行返回被截断, 但仍以 \r\n 结束, 不影响下一行
+    std::string line = "+CWJAP_CUR:\"" + std::string(300, 's') + "\"";
+
+    trace = "\r\n" + line + "\r\nOK\r\n";
+    replay(5);
+    TEST_CHECK_EQ(got_cmd.size(), AT_LINE_SIZE + 3);
+    TEST_CHECK(got_cmd.compare(0, AT_LINE_SIZE - 2, line, 0, AT_LINE_SIZE - 2) == 0);
+    TEST_CHECK(got_cmd.compare(AT_LINE_SIZE - 2, 5, std::string("\r\nOK\0", 5)) == 0);
+}
+
+static void test_link_full(void)
+{
+    // 连接的接收队列满时不等待读取: 多余数据丢弃并计数, 其他连接和返回结果照常解析
+    std::string big(TCPC_RX_SIZE + 100, 'x');
+    char head[32];
+    double t0;
+
+    sprintf(head, "\r\n+IPD,0,%d:", (int)big.size());
+    trace = head + big + "\r\nOK\r\n+IPD,1,3:abc";
+    reset_output();
+    at_parser_init(&at_parser);
+    t0 = test_now();
+    at_parser_input(&at_parser, trace.data(), trace.size());
+    TEST_CHECK(test_now() - t0 < 0.1);
+    TEST_CHECK_EQ(mo_drv_wifi_lost_tcpc_fifo(0), 100);
+    TEST_CHECK_EQ(mo_drv_wifi_lost_tcpc_fifo(1), 0);
+    drain();
+    TEST_CHECK_EQ(got_link[0].size(), TCPC_RX_SIZE);
+    TEST_CHECK(got_link[1] == "abc");
+    TEST_CHECK(got_cmd == std::string("OK", 3));
+
+    // 重新建立连接时清零
+    mo_drv_wifi_destroy_tcpc_fifo(0);
+    mo_drv_wifi_creat_tcpc_fifo(0);
+    TEST_CHECK_EQ(mo_drv_wifi_lost_tcpc_fifo(0), 0);
+}
+
+static void test_overrun(void)
+{
+    // +IPD 数据中途串口溢出: 剩余数据计入该连接的丢失, 其他连接也记为丢失,
+    // 解析器跳过溢出后的半行, 从下一行重新开始
+    int i;
+
+    for(i = 0; i < LINK_NUM; i++)
+    {
+        mo_drv_wifi_destroy_tcpc_fifo(i);
+        mo_drv_wifi_creat_tcpc_fifo(i);
+    }
+    reset_output();
+    at_parser_init(&at_parser);
+    trace = "\r\n+IPD,1,100:0123456789";
+    at_parser_input(&at_parser, trace.data(), trace.size());
+    at_parser_overrun(&at_parser);
+    TEST_CHECK_EQ(mo_drv_wifi_lost_tcpc_fifo(1), 90);
+    TEST_CHECK_EQ(mo_drv_wifi_lost_tcpc_fifo(0), 1);
+    TEST_CHECK_EQ(at_parser.state, AT_STATE_SKIP);
+
+    // 溢出后的数据从某个 +IPD 的中间开始, 里面的 "OK" 不能当作返回结果
+    trace = "ta OK\r\nSEND OK\r\n+IPD,2,3:xyz";
+    at_parser_input(&at_parser, trace.data(), trace.size());
+    drain();
+    TEST_CHECK(got_cmd == std::string("SEND OK", 8));
+    TEST_CHECK(got_link[1] == "0123456789");
+    TEST_CHECK(got_link[2] == "xyz");
+
+    for(i = 0; i < LINK_NUM; i++)
+    {
+        mo_drv_wifi_destroy_tcpc_fifo(i);
+        mo_drv_wifi_creat_tcpc_fifo(i);
+    }
+}
+
+static void bench(void)
+{
+    const int rounds = 20;
+    double t0, t_new, t_old;
+    int i;
+
+    build_trace(7, 2000);
+
+    t0 = test_now();
+    for(i = 0; i < rounds; i++)
+    {
+        replay(AT_RECV_SIZE);
+    }
+    t_new = test_now() - t0;
+    check_output("bench");
+
+    t0 = test_now();
+    for(i = 0; i < rounds; i++)
+    {
+        legacy_replay();
+    }
+    t_old = test_now() - t0;
+
+    printf("replay %d bytes x %d: tokenizer %.1f MB/s, strstr window %.1f MB/s\n",
+           (int)trace.size(), rounds,
+           trace.size() * rounds / t_new / 1e6, trace.size() * rounds / t_old / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+    int i;
+
+    mo_cmd_init();
+    osMutexDef(TX_MUT);
+    mutex_tx = osMutexCreate(osMutex(TX_MUT));
+    for(i = 0; i < LINK_NUM; i++)
+    {
+        mo_drv_wifi_creat_tcpc_fifo(i);
+    }
+    set_filter_en("AT");
+
+    test_chunking();
+    test_filter_mask();
+    test_bad_ipd();
+    test_line_overflow();
+    test_link_full();
+    test_overrun();
+    bench();
+
+    return TEST_DONE();
+}
@@ -0,0 +1,7 @@
+# AT 返回结果解析: 分段回放 + 与之前 strstr 检索窗口的性能对比
+TESTS += at_parser
+at_parser_SRC = test/at_parser/at_parser_test.cpp \
+    board/neutron/src/lib_fifo.cpp board/gcc/src/cmsis_os.cpp \
+    board/neutron/src/wiring_print.cpp board/neutron/src/wiring_ipaddress.cpp \
+    board/neutron/src/wiring_string.cpp board/neutron/src/wiring_usbserial.cpp \
+    board/gcc/src/wiring_usbserial_hal.cpp
@@ -0,0 +1,450 @@
+/**
+ ******************************************************************************
+ * @file     : bmi160_fifo_test.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : BMI160 FIFO 帧解析测试
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+/*
+  手工构造的 FIFO 数据: 中断标记, 不完整的帧, sensortime 24位回绕, 跳过帧, 样本缓冲溢出,
+  BMM150 磁力计打包, 配置帧, 错误帧头
+  模拟的传感器 FIFO 按 BMI160Sensor::pollFifo 的方式分段读空, 检查每个样本的数据和时间
+  参数: 模拟读取的次数
+*/
+#include <stdlib.h>
+
+#include "bmi160_fifo.h"
+#include "host_test.h"
+
+#define TIME_PERIOD     256         // 100Hz 的帧间隔
+#define RING_SIZE       64          // 与 BMI160_FIFO_SAMPLES 相同
+#define BURST_SIZE      256         // 与 BMI160_FIFO_BURST 相同
+
+typedef struct
+{
+    uint8_t data[2048];
+    uint16_t len;
+} dump_t;
+
+static void put_u8(dump_t *d, uint8_t v)
+{
+    d->data[d->len++] = v;
+}
+
+static void put_s16(dump_t *d, int16_t v)
+{
+    put_u8(d, (uint16_t)v & 0xFF);
+    put_u8(d, (uint16_t)v >> 8);
+}
+
+static int16_t gyro_value(uint32_t n, int axis)
+{
+    return (int16_t)(n * 100 + axis);
+}
+
+static int16_t accel_value(uint32_t n, int axis)
+{
+    return (int16_t)(-(int32_t)n * 100 - axis);
+}
+
+static int16_t mag_value(uint32_t n, int axis)
+{
+    // x/y 13位, z 15位
+    return (int16_t)((axis == 2) ? (int32_t)(n * 37 % 32768) - 16384 : (int32_t)(n * 13 % 8192) - 4096);
+}
+
+static uint16_t rhall_value(uint32_t n)
+{
+    return (uint16_t)(n * 7 % 16384);
+}
+
+// 第 n 帧数据帧, head 为不含中断标记的帧头
+static void put_frame(dump_t *d, uint8_t head, uint32_t n, uint8_t tag)
+{
+    put_u8(d, head | tag);
+    if(head & BMI160_FIFO_HEAD_MAG)
+    {
+        uint16_t x = (uint16_t)mag_value(n, 0), y = (uint16_t)mag_value(n, 1), z = (uint16_t)mag_value(n, 2);
+        uint16_t r = rhall_value(n);
+
+        put_u8(d, (x << 3) & 0xF8);
+        put_u8(d, (x >> 5) & 0xFF);
+        put_u8(d, (y << 3) & 0xF8);
+        put_u8(d, (y >> 5) & 0xFF);
+        put_u8(d, (z << 1) & 0xFE);
+        put_u8(d, (z >> 7) & 0xFF);
+        put_u8(d, (r << 2) & 0xFC);
+        put_u8(d, r >> 6);
+    }
+    if(head & BMI160_FIFO_HEAD_GYRO)
+    {
+        for(int k = 0; k < 3; k++)
+        {
+            put_s16(d, gyro_value(n, k));
+        }
+    }
+    if(head & BMI160_FIFO_HEAD_ACCEL)
+    {
+        for(int k = 0; k < 3; k++)
+        {
+            put_s16(d, accel_value(n, k));
+        }
+    }
+}
+
+static void put_time(dump_t *d, uint32_t time)
+{
+    put_u8(d, BMI160_FIFO_HEAD_TIME);
+    put_u8(d, time);
+    put_u8(d, time >> 8);
+    put_u8(d, time >> 16);
+}
+
+// 样本是否为第 n 帧
+static bool sample_is(const bmi160_fifo_sample_t *s, uint8_t head, uint32_t n)
+{
+    bool ok = true;
+
+    for(int k = 0; k < 3; k++)
+    {
+        if(head & BMI160_FIFO_HEAD_MAG)
+        {
+            ok = ok && (s->mag[k] == mag_value(n, k));
+        }
+        if(head & BMI160_FIFO_HEAD_GYRO)
+        {
+            ok = ok && (s->gyro[k] == gyro_value(n, k));
+        }
+        if(head & BMI160_FIFO_HEAD_ACCEL)
+        {
+            ok = ok && (s->accel[k] == accel_value(n, k));
+        }
+    }
+    if(head & BMI160_FIFO_HEAD_MAG)
+    {
+        ok = ok && (s->rhall == rhall_value(n));
+    }
+    return ok;
+}
+
+static const uint8_t HEAD_AG = BMI160_FIFO_HEAD_DATA | BMI160_FIFO_HEAD_GYRO | BMI160_FIFO_HEAD_ACCEL;
+static const uint8_t SAMPLE_AG = BMI160_FIFO_SAMPLE_ACCEL | BMI160_FIFO_SAMPLE_GYRO;
+
+static bmi160_fifo_sample_t ring[RING_SIZE], out[RING_SIZE * 2];
+static bmi160_fifo_t fifo;
+static dump_t dump;
+
+static void test_frame_size(void)
+{
+    TEST_CHECK_EQ(bmi160_fifo_frame_size(HEAD_AG), 13);
+    TEST_CHECK_EQ(bmi160_fifo_frame_size(0x9C), 21);
+    TEST_CHECK_EQ(bmi160_fifo_frame_size(0x84), 7);
+    TEST_CHECK_EQ(bmi160_fifo_frame_size(0x90), 9);
+    TEST_CHECK_EQ(bmi160_fifo_frame_size(BMI160_FIFO_HEAD_SKIP), 2);
+    TEST_CHECK_EQ(bmi160_fifo_frame_size(BMI160_FIFO_HEAD_CONFIG), 2);
+    TEST_CHECK_EQ(bmi160_fifo_frame_size(BMI160_FIFO_HEAD_TIME), 4);
+    TEST_CHECK_EQ(bmi160_fifo_frame_size(BMI160_FIFO_HEAD_EMPTY), 0);
+    TEST_CHECK_EQ(bmi160_fifo_frame_size(0xA4), 0);     // 保留位
+    TEST_CHECK_EQ(bmi160_fifo_frame_size(0x00), 0);
+    TEST_CHECK_EQ(bmi160_fifo_frame_size(0xC0), 0);
+}
+
+static void test_frames(void)
+{
+    // 带中断标记的 A+G 帧, sensortime 对应最后一帧, 读空标记之后的数据不解析
+    bmi160_fifo_init(&fifo, ring, 8, TIME_PERIOD);
+    dump.len = 0;
+    for(int i = 0; i < 5; i++)
+    {
+        put_frame(&dump, HEAD_AG, i, i & 3);
+    }
+    put_time(&dump, 0x1000);
+    put_u8(&dump, BMI160_FIFO_HEAD_EMPTY);
+    put_u8(&dump, 0x84);
+    TEST_CHECK_EQ(bmi160_fifo_decode(&fifo, dump.data, dump.len), dump.len);
+    TEST_CHECK_EQ(bmi160_fifo_available(&fifo), 5);
+    TEST_CHECK_EQ(bmi160_fifo_read(&fifo, out, 16), 5);
+    int bad = 0;
+    for(int i = 0; i < 5; i++)
+    {
+        bad += !sample_is(&out[i], HEAD_AG, i) || (out[i].valid != (SAMPLE_AG | BMI160_FIFO_SAMPLE_TIME))
+               || (out[i].time != 0x1000 - (4 - i) * TIME_PERIOD);
+    }
+    TEST_CHECK_EQ(bad, 0);
+    TEST_CHECK_EQ(fifo.frames, 5);
+    TEST_CHECK_EQ(fifo.errors, 0);
+
+    // 末尾不完整的帧不解析, 返回已解析的长度
+    dump.len = 0;
+    put_frame(&dump, HEAD_AG, 1, 0);
+    put_frame(&dump, HEAD_AG, 2, 0);
+    uint16_t full = dump.len;
+    put_frame(&dump, HEAD_AG, 3, 0);
+    TEST_CHECK_EQ(bmi160_fifo_decode(&fifo, dump.data, dump.len - 4), full);
+    TEST_CHECK_EQ(bmi160_fifo_available(&fifo), 2);
+    TEST_CHECK_EQ(bmi160_fifo_decode(&fifo, dump.data + full, 2), 0);
+
+    // 没有 sensortime 的样本没有时间
+    bmi160_fifo_read(&fifo, out, 16);
+    TEST_CHECK_EQ(out[0].valid, SAMPLE_AG);
+}
+
+static void test_time_wrap(void)
+{
+    // sensortime 24位回绕后展开为32位
+    bmi160_fifo_init(&fifo, ring, 8, TIME_PERIOD);
+    dump.len = 0;
+    put_frame(&dump, HEAD_AG, 0, 0);
+    put_time(&dump, 0xFFFF00);
+    put_frame(&dump, HEAD_AG, 1, 0);
+    put_frame(&dump, HEAD_AG, 2, 0);
+    put_time(&dump, 0x000100);
+    bmi160_fifo_decode(&fifo, dump.data, dump.len);
+    TEST_CHECK_EQ(bmi160_fifo_read(&fifo, out, 16), 3);
+    TEST_CHECK_EQ(out[0].time, 0xFFFF00);
+    TEST_CHECK_EQ(out[1].time, 0x1000000);
+    TEST_CHECK_EQ(out[2].time, 0x1000100);
+}
+
+static void test_overrun_skip(void)
+{
+    // 样本缓冲满时丢掉最旧的
+    bmi160_fifo_init(&fifo, ring, 8, TIME_PERIOD);
+    dump.len = 0;
+    for(int i = 0; i < 10; i++)
+    {
+        put_frame(&dump, HEAD_AG, i, 0);
+    }
+    put_time(&dump, 0x2000);
+    bmi160_fifo_decode(&fifo, dump.data, dump.len);
+    TEST_CHECK_EQ(bmi160_fifo_available(&fifo), 8);
+    TEST_CHECK_EQ(fifo.overruns, 2);
+    bmi160_fifo_read(&fifo, out, 16);
+    TEST_CHECK(sample_is(&out[0], HEAD_AG, 2));
+    TEST_CHECK_EQ(out[0].time, 0x2000 - 7 * TIME_PERIOD);
+    TEST_CHECK_EQ(out[7].time, 0x2000);
+
+    // 跳过帧之前的样本与之后的 sensortime 隔了未知的帧, 没有时间
+    dump.len = 0;
+    put_frame(&dump, HEAD_AG, 1, 0);
+    put_u8(&dump, BMI160_FIFO_HEAD_SKIP);
+    put_u8(&dump, 3);
+    put_frame(&dump, HEAD_AG, 2, 0);
+    put_time(&dump, 0x3000);
+    bmi160_fifo_decode(&fifo, dump.data, dump.len);
+    TEST_CHECK_EQ(fifo.skipped, 3);
+    bmi160_fifo_read(&fifo, out, 16);
+    TEST_CHECK(!(out[0].valid & BMI160_FIFO_SAMPLE_TIME));
+    TEST_CHECK_EQ(out[1].time, 0x3000);
+
+    // 部分读取之后, 只给缓冲中剩下的样本补时间
+    dump.len = 0;
+    put_frame(&dump, HEAD_AG, 1, 0);
+    put_frame(&dump, HEAD_AG, 2, 0);
+    put_frame(&dump, HEAD_AG, 3, 0);
+    bmi160_fifo_decode(&fifo, dump.data, dump.len);
+    TEST_CHECK_EQ(bmi160_fifo_read(&fifo, out, 2), 2);
+    dump.len = 0;
+    put_time(&dump, 0x4000);
+    bmi160_fifo_decode(&fifo, dump.data, dump.len);
+    TEST_CHECK_EQ(bmi160_fifo_read(&fifo, out, 16), 1);
+    TEST_CHECK(sample_is(&out[0], HEAD_AG, 3));
+    TEST_CHECK_EQ(out[0].time, 0x4000);
+}
+
+static void test_mag(void)
+{
+    // 配置帧, M+G+A 帧的 BMM150 打包
+    bmi160_fifo_init(&fifo, ring, 8, TIME_PERIOD);
+    dump.len = 0;
+    put_u8(&dump, BMI160_FIFO_HEAD_CONFIG);
+    put_u8(&dump, 0);
+    put_frame(&dump, 0x9C, 1234, 2);
+    put_frame(&dump, 0x90, 99, 0);
+    TEST_CHECK_EQ(bmi160_fifo_decode(&fifo, dump.data, dump.len), dump.len);
+    TEST_CHECK_EQ(bmi160_fifo_read(&fifo, out, 16), 2);
+    TEST_CHECK(sample_is(&out[0], 0x9C, 1234));
+    TEST_CHECK_EQ(out[0].valid, SAMPLE_AG | BMI160_FIFO_SAMPLE_MAG);
+    TEST_CHECK(sample_is(&out[1], 0x90, 99));
+    TEST_CHECK_EQ(out[1].valid, BMI160_FIFO_SAMPLE_MAG);
+
+    // 负的边界值
+    dump.len = 0;
+    put_u8(&dump, 0x90);
+    put_u8(&dump, 0x00);        // x = -4096
+    put_u8(&dump, 0x80);
+    put_u8(&dump, 0xF8);        // y = -1
+    put_u8(&dump, 0xFF);
+    put_u8(&dump, 0x00);        // z = -16384
+    put_u8(&dump, 0x80);
+    put_u8(&dump, 0xFC);        // rhall = 16383
+    put_u8(&dump, 0xFF);
+    bmi160_fifo_decode(&fifo, dump.data, dump.len);
+    bmi160_fifo_read(&fifo, out, 1);
+    TEST_CHECK_EQ(out[0].mag[0], -4096);
+    TEST_CHECK_EQ(out[0].mag[1], -1);
+    TEST_CHECK_EQ(out[0].mag[2], -16384);
+    TEST_CHECK_EQ(out[0].rhall, 16383);
+}
+
+static void test_bad_header(void)
+{
+    // 不认识的帧头: 丢掉之后的数据
+    bmi160_fifo_init(&fifo, ring, 8, TIME_PERIOD);
+    dump.len = 0;
+    put_frame(&dump, HEAD_AG, 1, 0);
+    put_u8(&dump, 0xA0);
+    put_frame(&dump, HEAD_AG, 2, 0);
+    TEST_CHECK_EQ(bmi160_fifo_decode(&fifo, dump.data, dump.len), dump.len);
+    TEST_CHECK_EQ(fifo.errors, 1);
+    TEST_CHECK_EQ(bmi160_fifo_available(&fifo), 1);
+}
+
+/*=======模拟的传感器 FIFO=================================================*/
+typedef struct
+{
+    dump_t frames;              // FIFO 中的帧
+    uint16_t sizes[RING_SIZE];  // 每帧长度
+    uint16_t count;
+    uint32_t time;              // 最后一帧的 sensortime (24位)
+} sensor_t;
+
+static sensor_t sensor;
+
+// 从 FIFO_DATA 连续读取 len 字节: 读完所有帧之后是 sensortime 帧, 再之后是读空标记
+// 完整读出的帧从 FIFO 中移除, 末尾不完整的帧保留
+static void sensor_read(uint8_t *buf, uint16_t len)
+{
+    dump_t tail;
+    uint16_t pos = 0, removed = 0, n = 0;
+
+    tail.len = 0;
+    put_time(&tail, sensor.time);
+    for(uint16_t i = 0; i < len; i++)
+    {
+        if(i < sensor.frames.len)
+        {
+            buf[i] = sensor.frames.data[i];
+        }
+        else if(i < sensor.frames.len + tail.len)
+        {
+            buf[i] = tail.data[i - sensor.frames.len];
+        }
+        else
+        {
+            buf[i] = BMI160_FIFO_HEAD_EMPTY;
+        }
+    }
+    while(n < sensor.count && pos + sensor.sizes[n] <= len)
+    {
+        pos += sensor.sizes[n++];
+    }
+    removed = pos;
+    memmove(sensor.frames.data, sensor.frames.data + removed, sensor.frames.len - removed);
+    sensor.frames.len -= removed;
+    memmove(sensor.sizes, sensor.sizes + n, (sensor.count - n) * sizeof(uint16_t));
+    sensor.count -= n;
+}
+
+static void test_stream(int polls)
+{
+    // 与 BMI160Sensor::pollFifo 相同的分段读取, 检查每个样本和时间
+    static const uint8_t heads[] = {HEAD_AG, 0x9C, 0x84, 0x88};
+    static uint8_t burst[BURST_SIZE];
+    int bad_sample = 0, bad_time = 0, bad_count = 0;
+    uint32_t produced = 0, consumed = 0;
+
+    test_srand(23);
+    for(unsigned h = 0; h < sizeof(heads); h++)
+    {
+        uint8_t head = heads[h];
+        uint16_t size = bmi160_fifo_frame_size(head);
+        uint32_t start = 0xFFFFFF - 1000 * TIME_PERIOD;     // 运行中 sensortime 回绕
+        uint32_t n = 0, read = 0;
+
+        memset(&sensor, 0, sizeof(sensor));
+        bmi160_fifo_init(&fifo, ring, RING_SIZE, TIME_PERIOD);
+        for(int p = 0; p < polls; p++)
+        {
+            // 传感器产生新的帧, 不超过 FIFO 和样本缓冲
+            uint16_t k = test_rand() % 40;
+
+            while(k-- && sensor.count < RING_SIZE - 1
+                  && sensor.frames.len + size + BMI160_FIFO_TIME_FRAME_SIZE <= BMI160_FIFO_SIZE)
+            {
+                uint16_t before = sensor.frames.len;
+
+                put_frame(&sensor.frames, head, n, test_rand() & 3);
+                sensor.sizes[sensor.count++] = sensor.frames.len - before;
+                sensor.time = (start + n * TIME_PERIOD) & 0xFFFFFF;
+                n++;
+            }
+
+            uint32_t length = sensor.frames.len + BMI160_FIFO_TIME_FRAME_SIZE;
+            while(length > 0)
+            {
+                uint16_t chunk = (length > BURST_SIZE) ? BURST_SIZE : length;
+                uint16_t used;
+
+                sensor_read(burst, chunk);
+                used = bmi160_fifo_decode(&fifo, burst, chunk);
+                if(used == 0)
+                {
+                    break;
+                }
+                length -= used;
+            }
+            bad_count += (sensor.count != 0);
+
+            // 分批读出
+            while(bmi160_fifo_available(&fifo))
+            {
+                uint16_t got = bmi160_fifo_read(&fifo, out, 1 + test_rand() % 20);
+
+                for(uint16_t i = 0; i < got; i++, read++)
+                {
+                    bad_sample += !sample_is(&out[i], head, read);
+                    bad_time += !(out[i].valid & BMI160_FIFO_SAMPLE_TIME) || (out[i].time != start + read * TIME_PERIOD);
+                }
+            }
+        }
+        bad_count += (read != n) || (fifo.frames != n) || fifo.errors || fifo.overruns;
+        produced += n;
+        consumed += read;
+    }
+    printf("%u frames produced, %u samples read\n", (unsigned)produced, (unsigned)consumed);
+    TEST_CHECK_EQ(bad_sample, 0);
+    TEST_CHECK_EQ(bad_time, 0);
+    TEST_CHECK_EQ(bad_count, 0);
+    TEST_CHECK_EQ(produced, consumed);
+}
+
+int main(int argc, char *argv[])
+{
+    test_frame_size();
+    test_frames();
+    test_time_wrap();
+    test_overrun_skip();
+    test_mag();
+    test_bad_header();
+    test_stream((argc > 1) ? atoi(argv[1]) : 5000);
+
+    return TEST_DONE();
+}
@@ -0,0 +1,4 @@
+# BMI160 FIFO 帧解析: 各种帧头, 不完整的帧, sensortime 回绕和推算, 跳过帧, 溢出, 磁力计打包, 分段读空
+TESTS += bmi160_fifo
+bmi160_fifo_SRC = test/bmi160_fifo/bmi160_fifo_test.cpp board/neutron/src/bmi160_fifo.c
+bmi160_fifo_ARGS = 5000
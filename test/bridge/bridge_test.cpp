@@ -0,0 +1,432 @@
+/**
+ ******************************************************************************
+ * @file     : bridge_test.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : Bridge 帧协议回环测试
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+/*
+  lib_bridge.cpp 与模拟的 OpenWrt 端通过内存串口相连, 串口每个字节按概率出错,
+  MCU 接收缓冲只有 SERIAL_BUFFER_SIZE, 满了丢字节
+  对方有两种: 标准 bridge 只记住最后一个应答; 支持多帧的对方按序号执行并缓存最近 WINDOW_MAX 个应答
+  串口写入时和完成回调中模拟 TIM1 中断(intorobot_loop), 前台有未完成的帧时必须跳过
+  参数: 每种情况的传输次数
+*/
+#include <stdlib.h>
+#include <deque>
+#include <vector>
+
+#include "lib_bridge.h"
+#include "lib_crc.h"
+#include "host_test.h"
+
+NVIC_Type test_nvic;
+static system_tick_t now;
+
+system_tick_t millis(void)
+{
+    return now++;
+}
+
+void delay(unsigned long ms)
+{
+    now += ms;
+}
+
+typedef std::vector<uint8_t> bytes_t;
+
+static void timer_interrupt(void);
+
+/*=======模拟的 OpenWrt 端=================================================*/
+class Peer : public USARTSerial
+{
+    public:
+        int error_rate;             // 每个字节出错的概率(千分之)
+        int cache_depth;            // 1: 标准 bridge
+        int irq_rate;               // 每次写入时发生定时中断的概率(千分之)
+        unsigned long overflows;
+        unsigned long masked_writes;    // 写串口时 TIM1 被屏蔽
+        std::vector<uint32_t> executed; // 执行过的请求号
+
+        Peer() : error_rate(0), cache_depth(1), irq_rate(0), overflows(0), masked_writes(0), synced(false), expect(0) {}
+
+        int available(void) { return rx.size(); }
+        int peek(void) { return rx.empty() ? -1 : rx.front(); }
+        void flush(void) {}
+        int read(void)
+        {
+            if(rx.empty())
+            {
+                return -1;
+            }
+            int c = rx.front();
+            rx.pop_front();
+            return c;
+        }
+        size_t write(uint8_t c) { return write(&c, 1); }
+        size_t write(const uint8_t *buf, size_t len)
+        {
+            if(!(NVIC->ISER[TIM1_UP_IRQn >> 5] & (1UL << (TIM1_UP_IRQn & 0x1F))))
+            {
+                masked_writes++;
+            }
+            for(size_t i = 0; i < len; i++)
+            {
+                in.push_back(noise(buf[i]));
+                parse();
+            }
+            if((int)(test_rand() % 1000) < irq_rate)
+            {
+                timer_interrupt();
+            }
+            return len;
+        }
+        // 有未收完的帧
+        bool receiving(void)
+        {
+            return !in.empty();
+        }
+
+    private:
+        std::deque<uint8_t> rx;     // 到 MCU
+        bytes_t in;                 // 来自 MCU
+        bool synced;
+        uint8_t expect;             // 下一个要执行的序号
+        bytes_t cache[256];
+
+        uint8_t noise(uint8_t c)
+        {
+            return ((int)(test_rand() % 1000) < error_rate) ? c ^ (1 << (test_rand() % 8)) : c;
+        }
+
+        void emit(const bytes_t &frame)
+        {
+            for(size_t i = 0; i < frame.size(); i++)
+            {
+                if(rx.size() >= SERIAL_BUFFER_SIZE)
+                {
+                    overflows++;
+                    continue;
+                }
+                rx.push_back(noise(frame[i]));
+            }
+        }
+
+        // 请求: 'M'/'I', 请求号(4字节), 数据; 应答: 0, 请求的逆序; 复位命令应答版本号
+        bytes_t execute(const bytes_t &payload)
+        {
+            bytes_t reply(1, 0);
+
+            if(payload.size() == 5 && payload[0] == 'X' && payload[1] == 'X')
+            {
+                const char version[] = "160";
+                reply.insert(reply.end(), version, version + 3);
+                return reply;
+            }
+            if(payload.size() >= 5)
+            {
+                executed.push_back(((uint32_t)payload[0] << 24) | (payload[1] << 16) | (payload[2] << 8) | payload[3]);
+            }
+            reply.insert(reply.end(), payload.rbegin(), payload.rend());
+            return reply;
+        }
+
+        void parse(void)
+        {
+            while(true)
+            {
+                while(!in.empty() && in[0] != 0xFF)
+                {
+                    in.erase(in.begin());
+                }
+                if(in.size() < 6)
+                {
+                    return;
+                }
+                uint16_t len = (in[2] << 8) | in[3];
+                if(len > 256)
+                {
+                    in.erase(in.begin());
+                    continue;
+                }
+                if(in.size() < 6u + len)
+                {
+                    return;
+                }
+                if(crc16_ccitt_update(CRC16_INIT, &in[0], 4 + len) != ((in[4 + len] << 8) | in[5 + len]))
+                {
+                    in.erase(in.begin());
+                    continue;
+                }
+                uint8_t index = in[1];
+                bytes_t payload(in.begin() + 4, in.begin() + 4 + len);
+                in.erase(in.begin(), in.begin() + 6 + len);
+
+                uint8_t back = expect - 1 - index;
+                if(cache_depth == 1 ? (!synced || index != (uint8_t)(expect - 1)) : (!synced || index == expect))
+                {
+                    bytes_t reply = execute(payload);
+                    bytes_t frame;
+
+                    frame.push_back(0xFF);
+                    frame.push_back(index);
+                    frame.push_back(reply.size() >> 8);
+                    frame.push_back(reply.size() & 0xFF);
+                    frame.insert(frame.end(), reply.begin(), reply.end());
+                    uint16_t crc = crc16_ccitt_update(CRC16_INIT, &frame[0], frame.size());
+                    frame.push_back(crc >> 8);
+                    frame.push_back(crc & 0xFF);
+                    cache[index] = frame;
+                    synced = true;
+                    expect = index + 1;
+                    emit(frame);
+                }
+                else if(back < cache_depth)
+                {
+                    emit(cache[index]);     // 重复的序号
+                }
+                // 其它: 前面有帧丢失, 等 go-back-N 重发
+            }
+        }
+};
+
+static Peer peer;
+USARTSerial &SerialBridge = peer;
+
+/*=======模拟的 TIM1 中断=================================================*/
+static int in_interrupt;
+static uint32_t irq_id = 0x49000000;    // 'I'
+static unsigned long irq_runs, irq_skips, irq_fails, irq_bad, irq_interleaved;
+
+// 与 intorobot_loop 相同: 前台有未完成的帧时跳过, 否则做一次完整的传输
+static void timer_interrupt(void)
+{
+    if(in_interrupt)
+    {
+        return;
+    }
+    if(Bridge.pending())
+    {
+        irq_skips++;
+        return;
+    }
+    in_interrupt = 1;
+    irq_interleaved += peer.receiving();
+    uint8_t tx[6] = {(uint8_t)(irq_id >> 24), (uint8_t)(irq_id >> 16), (uint8_t)(irq_id >> 8), (uint8_t)irq_id, 'x', 'y'};
+    uint8_t rx[8];
+    uint16_t len = Bridge.transfer(tx, sizeof(tx), rx, sizeof(rx));
+    irq_id++;
+    irq_runs++;
+    if(len == BridgeClass::TRANSFER_TIMEOUT)
+    {
+        irq_fails++;
+    }
+    else
+    {
+        irq_bad += (len != 7) || (rx[0] != 0) || (rx[1] != 'y') || (rx[6] != tx[0]);
+    }
+    in_interrupt = 0;
+}
+
+/*=======前台传输=========================================================*/
+typedef struct
+{
+    BridgeResult result;
+    bool interrupt;             // 回调中模拟定时中断
+} job_result_t;
+
+static void job_callback(void *arg, uint16_t len)
+{
+    job_result_t *job = (job_result_t *)arg;
+
+    // 最后一帧释放后定时中断可能立即占用同一个帧
+    if(job->interrupt)
+    {
+        timer_interrupt();
+    }
+    BridgeClass::resultCallback(&job->result, len);
+}
+
+typedef struct
+{
+    unsigned long ok, fails, bad, duplicates, lost;
+} run_result_t;
+
+static void make_request(uint32_t id, uint8_t *tx, uint16_t *len)
+{
+    *len = 5 + id % 40;
+    tx[0] = 'M';
+    tx[1] = id >> 16;
+    tx[2] = id >> 8;
+    tx[3] = id;
+    for(uint16_t i = 4; i < *len; i++)
+    {
+        tx[i] = id * 7 + i;
+    }
+}
+
+static run_result_t run(int window, int cache_depth, int error_rate, int count)
+{
+    static uint8_t tx[BridgeClass::WINDOW_MAX][48], rx[BridgeClass::WINDOW_MAX][64];
+    static job_result_t jobs[BridgeClass::WINDOW_MAX];
+    uint16_t txlen[BridgeClass::WINDOW_MAX];
+    std::deque<uint32_t> queue;
+    std::vector<int> executions(count, 0);
+    run_result_t r = {0, 0, 0, 0, 0};
+    uint32_t issued = 0;
+
+    peer.error_rate = error_rate;
+    peer.cache_depth = cache_depth;
+    peer.irq_rate = 20;
+    peer.overflows = 0;
+    peer.executed.clear();
+    Bridge.setWindow(window);
+    while(queue.size() || issued < (uint32_t)count)
+    {
+        while(issued < (uint32_t)count && queue.size() < (size_t)window)
+        {
+            int s = issued % BridgeClass::WINDOW_MAX;
+
+            make_request(issued, tx[s], &txlen[s]);
+            jobs[s].result.done = false;
+            jobs[s].interrupt = (test_rand() % 4) == 0;
+            if(!Bridge.send(tx[s], txlen[s], NULL, 0, NULL, 0, rx[s], sizeof(rx[s]), job_callback, &jobs[s]))
+            {
+                break;
+            }
+            queue.push_back(issued++);
+        }
+        uint32_t id = queue.front();
+        int s = id % BridgeClass::WINDOW_MAX;
+        uint16_t len = Bridge.wait(jobs[s].result);
+
+        queue.pop_front();
+        if(len == BridgeClass::TRANSFER_TIMEOUT)
+        {
+            r.fails++;
+        }
+        else
+        {
+            bool good = (len == txlen[s] + 1) && (rx[s][0] == 0);
+
+            for(uint16_t i = 0; good && i < txlen[s]; i++)
+            {
+                good = (rx[s][1 + i] == tx[s][txlen[s] - 1 - i]);
+            }
+            r.ok += good;
+            r.bad += !good;
+        }
+        // 空闲时的定时中断
+        if((test_rand() % 8) == 0)
+        {
+            timer_interrupt();
+        }
+    }
+    for(size_t i = 0; i < peer.executed.size(); i++)
+    {
+        uint32_t e = peer.executed[i];
+
+        if((e >> 24) == 'M')
+        {
+            executions[e & 0xFFFFFF]++;
+        }
+    }
+    for(int i = 0; i < count; i++)
+    {
+        r.duplicates += (executions[i] > 1);
+        r.lost += (executions[i] == 0);
+    }
+    printf("window %d, peer cache %d, errors %d/1000: %lu ok, %lu failed, %lu executed twice, rx overflow %lu\n",
+           window, cache_depth, error_rate, r.ok, r.fails, r.duplicates, peer.overflows);
+    return r;
+}
+
+/*=======测试=============================================================*/
+static void test_begin(void)
+{
+    // 标准 bridge 版本 1.6.0, 窗口保持为1
+    Bridge.begin();
+    TEST_CHECK_EQ(Bridge.getBridgeVersion(), 160);
+    TEST_CHECK_EQ(Bridge.getWindow(), 1);
+    TEST_CHECK_EQ(Bridge.pending(), 0);
+}
+
+static void test_clean_link(int count)
+{
+    // 没有误码: 全部成功, 每个请求只执行一次, 中断中的传输也成功且不会插在前台的帧中间
+    for(int window = 1; window <= BridgeClass::WINDOW_MAX; window *= 2)
+    {
+        run_result_t r = run(window, (window == 1) ? 1 : BridgeClass::WINDOW_MAX, 0, count);
+
+        TEST_CHECK_EQ(r.ok, count);
+        TEST_CHECK_EQ(r.duplicates + r.lost, 0);
+    }
+    TEST_CHECK(irq_runs > 0);
+    TEST_CHECK_EQ(irq_fails + irq_bad + irq_interleaved, 0);
+}
+
+static void test_noisy_link(int count)
+{
+    // 有误码: 应答都正确或者超时; 停等对标准 bridge, 多帧对支持的对方, 都不会重复执行
+    for(int error_rate = 1; error_rate <= 5; error_rate += 4)
+    {
+        run_result_t r = run(1, 1, error_rate, count);
+
+        TEST_CHECK_EQ(r.bad, 0);
+        TEST_CHECK_EQ(r.duplicates, 0);
+        TEST_CHECK(r.ok > (unsigned long)count * 9 / 10);
+
+        r = run(BridgeClass::WINDOW_MAX, BridgeClass::WINDOW_MAX, error_rate, count);
+        TEST_CHECK_EQ(r.bad, 0);
+        TEST_CHECK_EQ(r.duplicates, 0);
+        TEST_CHECK(r.ok > (unsigned long)count * 9 / 10);
+    }
+    TEST_CHECK_EQ(irq_bad, 0);
+}
+
+static void test_standard_peer_window(int count)
+{
+    // 标准 bridge 上打开多帧: go-back-N 重发时重复执行, 所以 begin() 不自动打开
+    run_result_t r = run(BridgeClass::WINDOW_MAX, 1, 5, count);
+
+    TEST_CHECK_EQ(r.bad, 0);
+    TEST_CHECK(r.duplicates > 0);
+    Bridge.setWindow(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int count = (argc > 1) ? atoi(argv[1]) : 2000;
+
+    test_srand(20);
+    NVIC_EnableIRQ(TIM1_UP_IRQn);
+    test_begin();
+    test_clean_link(count);
+    test_noisy_link(count);
+    test_standard_peer_window(count);
+
+    // 中断既有跳过的也有执行的, 串口写入时 TIM1 从未被屏蔽
+    printf("timer interrupts: %lu run, %lu skipped, %lu failed\n", irq_runs, irq_skips, irq_fails);
+    TEST_CHECK(irq_skips > 0);
+    TEST_CHECK_EQ(peer.masked_writes, 0);
+    TEST_CHECK(NVIC->ISER[TIM1_UP_IRQn >> 5] & (1UL << (TIM1_UP_IRQn & 0x1F)));
+
+    return TEST_DONE();
+}
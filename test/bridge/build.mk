@@ -0,0 +1,7 @@
+# Bridge 回环: 停等和多帧窗口, 串口误码和接收溢出, 收发时不屏蔽TIM1, 定时中断与前台不交错
+TESTS += bridge
+bridge_SRC = test/bridge/bridge_test.cpp board/atom/src/lib_bridge.cpp platform/MCU/shared/crc/src/lib_crc.c \
+    board/gcc/src/cmsis_os.cpp board/neutron/src/wiring_print.cpp board/neutron/src/wiring_stream.cpp \
+    board/neutron/src/wiring_ipaddress.cpp board/neutron/src/wiring_string.cpp
+bridge_CFLAGS = -iquote $(PROJECT_ROOT)/test/bridge
+bridge_ARGS = 2000
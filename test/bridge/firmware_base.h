@@ -0,0 +1,67 @@
+/**
+ ******************************************************************************
+ * @file     : firmware_base.h
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : bridge 主机测试用的 atom 板级替身
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+/*
+  只提供 lib_bridge.cpp 用到的部分: 串口, TIM1 的 NVIC 使能位, 时间
+  测试程序提供 millis/delay 和 SerialBridge
+*/
+#ifndef   FIRMWARE_BASE_H_
+#define   FIRMWARE_BASE_H_
+
+#include <stdint.h>
+#include "wiring_stream.h"
+#include "wiring_string.h"
+#include "wiring.h"
+
+#define SERIAL_BUFFER_SIZE      64
+#define DEBUG(...)
+
+typedef struct
+{
+    uint32_t ISER[8];
+} NVIC_Type;
+
+extern NVIC_Type test_nvic;
+#define NVIC                    (&test_nvic)
+#define TIM1_UP_IRQn            25
+
+static inline void NVIC_DisableIRQ(int irq)
+{
+    test_nvic.ISER[irq >> 5] &= ~(1UL << (irq & 0x1F));
+}
+
+static inline void NVIC_EnableIRQ(int irq)
+{
+    test_nvic.ISER[irq >> 5] |= (1UL << (irq & 0x1F));
+}
+
+class USARTSerial : public Stream
+{
+    public:
+        void begin(unsigned long baudrate) {}
+};
+
+extern USARTSerial &SerialBridge;
+
+#endif /* FIRMWARE_BASE_H_ */
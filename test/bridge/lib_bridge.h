@@ -0,0 +1,3 @@
+// 测试时 firmware_base.h 由本目录的替身提供, 先包含它, atom/inc 中的同名文件因包含保护而不再展开
+#include "firmware_base.h"
+#include "../../board/atom/inc/lib_bridge.h"
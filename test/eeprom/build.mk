@@ -0,0 +1,8 @@
+# EEPROM 模拟: 随机读写与模型一致, 记录合并, 任意时刻掉电, 旧格式的页
+TESTS += eeprom
+eeprom_SRC = test/eeprom/eeprom_test.cpp board/neutron/src/wiring_eeprom.cpp \
+    board/gcc/src/wiring_eeprom_hal.cpp \
+    board/gcc/src/cmsis_os.cpp board/neutron/src/wiring_print.cpp \
+    board/neutron/src/wiring_ipaddress.cpp board/neutron/src/wiring_string.cpp \
+    board/neutron/src/wiring_usbserial.cpp board/gcc/src/wiring_usbserial_hal.cpp
+eeprom_ARGS = 3000
@@ -0,0 +1,265 @@
+/**
+ ******************************************************************************
+ * @file     : eeprom_test.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : EEPROM 模拟(RAM 镜像, 记录合并)测试和掉电测试
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+/*
+  使用 gcc 板的 flash 模拟 (wiring_eeprom_hal.cpp): 只能把1写成0, 统计写入/擦除次数, 可以模拟掉电
+  重启 = 重新调用 EEPROM_Init, 从 flash 重建 RAM 镜像
+  参数: 掉电测试的次数
+*/
+#include <stdlib.h>
+
+#include "application.h"
+#include "wiring_eeprom.h"
+#include "wiring_eeprom_hal.h"
+#include "host_test.h"
+
+void EEPROM_FlashPowerLoss(int32_t n);
+
+static uint8_t model[EEPROM_SIZE];
+
+static void reboot(void)
+{
+    TEST_CHECK_EQ(EEPROM_Init(), FLASH_COMPLETE);
+}
+
+static int compare_model(void)
+{
+    int bad = 0;
+
+    for(int i = 0; i < EEPROM_SIZE; i++)
+    {
+        bad += (EEPROM.read(i) != model[i]);
+    }
+    return bad;
+}
+
+static uint32_t programs(void)
+{
+    uint32_t p, e;
+
+    EEPROM_FlashStatistics_hal(&p, &e);
+    return p;
+}
+
+static uint32_t erases(void)
+{
+    uint32_t p, e;
+
+    EEPROM_FlashStatistics_hal(&p, &e);
+    return e;
+}
+
+static void random_block(uint16_t *address, uint8_t *data, uint16_t *length)
+{
+    uint32_t r = test_rand();
+
+    if(r % 16 == 0)
+    {
+        // 整块改变, 很快写满一页触发搬页
+        *length = 512 + (r >> 4) % 512;
+    }
+    else
+    {
+        *length = 1 + (r >> 4) % 40;
+    }
+    *address = (r >> 16) % (EEPROM_SIZE - *length + 1);
+    for(int i = 0; i < *length; i++)
+    {
+        // 一部分字节不变, 一部分写回 0xFF
+        uint32_t k = test_rand() % 8;
+
+        data[i] = (k == 0) ? model[*address + i] : ((k == 1) ? 0xFF : (uint8_t)test_rand());
+    }
+}
+
+/*=======测试===============================================================*/
+static void test_format(void)
+{
+    // 空 flash 上初始化, 全部读出 0xFF
+    reboot();
+    memset(model, 0xFF, sizeof(model));
+    TEST_CHECK_EQ(compare_model(), 0);
+    uint16_t data;
+    TEST_CHECK_EQ(EEPROM_ReadVariable(10, &data), 1);
+}
+
+static void test_model(void)
+{
+    // 随机块写入和重启, 与内存模型一致, 中间发生多次搬页
+    static uint8_t data[1024];
+    uint32_t erase_start = erases();
+    int bad = 0;
+
+    test_srand(15);
+    for(int i = 0; i < 20000; i++)
+    {
+        uint16_t address, length;
+
+        random_block(&address, data, &length);
+        TEST_CHECK_EQ(EEPROM_WriteBlock(address, data, length), FLASH_COMPLETE);
+        memcpy(&model[address], data, length);
+        if(i % 500 == 0)
+        {
+            reboot();
+            bad += compare_model();
+        }
+    }
+    bad += compare_model();
+    reboot();
+    bad += compare_model();
+    TEST_CHECK_EQ(bad, 0);
+    TEST_CHECK(erases() - erase_start > 20);
+}
+
+static void test_coalesce(void)
+{
+    // 不变的写入不写 flash; 改变的相邻字节两个一条记录
+    uint8_t block[64];
+    uint32_t before;
+
+    memcpy(block, &model[100], sizeof(block));
+    before = programs();
+    TEST_CHECK_EQ(EEPROM_WriteBlock(100, block, sizeof(block)), FLASH_COMPLETE);
+    TEST_CHECK_EQ(programs() - before, 0);
+
+    for(int i = 0; i < (int)sizeof(block); i++)
+    {
+        block[i] = model[100 + i] ^ 0x5A;
+    }
+    before = programs();
+    TEST_CHECK_EQ(EEPROM_WriteBlock(100, block, sizeof(block)), FLASH_COMPLETE);
+    memcpy(&model[100], block, sizeof(block));
+    // 32 条记录, 如果正好写满一页还有搬页
+    TEST_CHECK((programs() - before == 32) || (erases() > 0));
+
+    // 奇数地址和单字节写入
+    EEPROM.write_system(201, 0x12);
+    model[201] = 0x12;
+    EEPROM.write(3, 0x34);
+    model[3] = 0x34;
+    TEST_CHECK_EQ(EEPROM.read(201), 0x12);
+    reboot();
+    TEST_CHECK_EQ(compare_model(), 0);
+
+    // 用户接口不能写入系统参数区
+    uint8_t old = EEPROM.read(Param_Eeprom_ADDR);
+    EEPROM.write(Param_Eeprom_ADDR, old ^ 1);
+    TEST_CHECK_EQ(EEPROM.read(Param_Eeprom_ADDR), old);
+    TEST_CHECK_EQ(EEPROM.write(Param_Eeprom_ADDR - 2, block, 8), 2);
+    memcpy(&model[Param_Eeprom_ADDR - 2], block, 2);
+
+    // get/put
+    struct { uint32_t a; uint16_t b; char c[10]; } in = {0x12345678, 0xBEEF, "config"}, out;
+    EEPROM.put(400, in);
+    memcpy(&model[400], &in, sizeof(in));
+    reboot();
+    EEPROM.get(400, out);
+    TEST_CHECK(memcmp(&in, &out, sizeof(in)) == 0);
+    TEST_CHECK_EQ(compare_model(), 0);
+}
+
+static void test_power_cut(int count)
+{
+    // 写入过程中任意时刻掉电(包括重启时完成搬页的过程中再次掉电): 每个字节都是旧值或新值
+    static uint8_t data[1024], before[EEPROM_SIZE];
+    int torn = 0, lost = 0, cut_init = 0;
+
+    test_srand(16);
+    for(int i = 0; i < count; i++)
+    {
+        uint16_t address, length;
+
+        random_block(&address, data, &length);
+        memcpy(before, model, sizeof(model));
+        memcpy(&model[address], data, length);
+
+        EEPROM_FlashPowerLoss(test_rand() % (2 * length + 600));
+        EEPROM_WriteBlock(address, data, length);
+        if(test_rand() % 4 == 0)
+        {
+            EEPROM_FlashPowerLoss(test_rand() % 300);
+            EEPROM_Init();
+            cut_init++;
+        }
+        EEPROM_FlashPowerLoss(-1);
+        reboot();
+
+        for(int k = 0; k < EEPROM_SIZE; k++)
+        {
+            uint8_t v = EEPROM.read(k);
+
+            if(v != before[k] && v != model[k])
+            {
+                torn++;
+            }
+            lost += (v != model[k]);
+            model[k] = v;
+        }
+    }
+    TEST_CHECK_EQ(torn, 0);
+    TEST_CHECK(lost > 0);
+    TEST_CHECK(cut_init > 0);
+
+    // 掉电之后继续正常使用
+    memset(data, 0xA5, 64);
+    TEST_CHECK_EQ(EEPROM_WriteBlock(0, data, 64), FLASH_COMPLETE);
+    memcpy(model, data, 64);
+    reboot();
+    TEST_CHECK_EQ(compare_model(), 0);
+}
+
+static void test_old_format(void)
+{
+    // 旧格式的单字节记录 (地址在高半字), 以及只写了数据的半条记录
+    EEPROM_FlashErase_hal(PAGE0);
+    EEPROM_FlashErase_hal(PAGE1);
+    EEPROM_FlashProgramHalfWord_hal(PAGE1, 0, VALID_PAGE);
+    EEPROM_FlashProgramWord_hal(PAGE1, 4, (10 << 16) | 0x11);
+    EEPROM_FlashProgramWord_hal(PAGE1, 8, (11 << 16) | 0x22);
+    EEPROM_FlashProgramWord_hal(PAGE1, 12, (10 << 16) | 0x33);
+    EEPROM_FlashProgramHalfWord_hal(PAGE1, 16, 0x44);
+    reboot();
+    TEST_CHECK_EQ(EEPROM.read(10), 0x33);
+    TEST_CHECK_EQ(EEPROM.read(11), 0x22);
+    TEST_CHECK_EQ(EEPROM.read(12), 0xFF);
+
+    // 新的记录写在半条记录之后
+    uint8_t pair[2] = {0x55, 0x66};
+    TEST_CHECK_EQ(EEPROM_WriteBlock(12, pair, 2), FLASH_COMPLETE);
+    reboot();
+    TEST_CHECK_EQ(EEPROM.read(10), 0x33);
+    TEST_CHECK_EQ(EEPROM.read(12), 0x55);
+    TEST_CHECK_EQ(EEPROM.read(13), 0x66);
+}
+
+int main(int argc, char *argv[])
+{
+    test_format();
+    test_model();
+    test_coalesce();
+    test_power_cut((argc > 1) ? atoi(argv[1]) : 3000);
+    test_old_format();
+
+    return TEST_DONE();
+}
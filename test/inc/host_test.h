@@ -0,0 +1,92 @@
+/**
+ ******************************************************************************
+ * @file     : host_test.h
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : 主机测试断言和计时
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+#ifndef HOST_TEST_H_
+#define HOST_TEST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/*
+  每个测试程序只有一个测试源文件, 计数放在头文件中
+  TEST_CHECK 失败时打印位置并继续, main 最后 return TEST_DONE();
+*/
+static int test_checks;
+static int test_failures;
+
+#define TEST_CHECK(cond) \
+    do{ \
+        test_checks++; \
+        if(!(cond)) \
+        { \
+            test_failures++; \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        } \
+    }while(0)
+
+#define TEST_CHECK_EQ(a, b) \
+    do{ \
+        long long test_a_ = (long long)(a), test_b_ = (long long)(b); \
+        test_checks++; \
+        if(test_a_ != test_b_) \
+        { \
+            test_failures++; \
+            printf("FAIL %s:%d: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, test_a_, test_b_); \
+        } \
+    }while(0)
+
+#define TEST_DONE() \
+    (printf("%s: %d checks, %d failed\n", test_failures ? "FAILED" : "OK", test_checks, test_failures), test_failures ? 1 : 0)
+
+// 可重复的伪随机数 (xorshift32)
+static uint32_t test_rand_state = 2463534242u;
+
+static inline void test_srand(uint32_t seed)
+{
+    test_rand_state = seed ? seed : 2463534242u;
+}
+
+static inline uint32_t test_rand(void)
+{
+    uint32_t x = test_rand_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    test_rand_state = x;
+    return x;
+}
+
+// 单调时钟, 秒
+static inline double test_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#endif /* HOST_TEST_H_ */
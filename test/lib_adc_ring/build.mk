@@ -0,0 +1,4 @@
+# ADC 扫描 DMA 帧索引: NDTR 换算帧数, 最新值, 取帧不跨缓冲末尾, 读得慢时丢帧计数
+TESTS += lib_adc_ring
+lib_adc_ring_SRC = test/lib_adc_ring/lib_adc_ring_test.cpp platform/MCU/shared/adc/src/lib_adc_ring.c
+lib_adc_ring_ARGS = 200000
@@ -0,0 +1,246 @@
+/**
+ ******************************************************************************
+ * @file     : lib_adc_ring_test.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : ADC 扫描 DMA 帧索引测试
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+/*
+  用软件模拟 DMA 循环写入: 第 n 个采样写入 buf[n % size], 值由帧号和通道号算出,
+  NDTR 为本圈剩余的个数; 检查已写完的帧数, 最新值, 取帧的内容和丢帧计数
+  参数: 随机测试的步数
+*/
+#include <stdlib.h>
+
+#include "lib_adc_ring.h"
+#include "host_test.h"
+
+#define CHANNELS_MAX    9
+#define FRAMES_MAX      64
+
+typedef struct
+{
+    volatile uint16_t buf[CHANNELS_MAX * FRAMES_MAX];
+    adc_ring_t ring;
+    uint32_t written;           // DMA 已写的采样总数
+} adc_model_t;
+
+static uint16_t sample_value(uint32_t frame, uint16_t channel)
+{
+    return (uint16_t)((frame << 4) | channel);
+}
+
+static void model_init(adc_model_t *m, uint16_t channels, uint32_t frames)
+{
+    memset((void *)m->buf, 0, sizeof(m->buf));
+    m->written = 0;
+    adc_ring_init(&m->ring, m->buf, channels, frames);
+}
+
+static void dma_write(adc_model_t *m, uint32_t n)
+{
+    while(n--)
+    {
+        m->buf[m->written % m->ring.size] = sample_value(m->written / m->ring.channels, m->written % m->ring.channels);
+        m->written++;
+    }
+}
+
+static uint32_t dma_ndtr(const adc_model_t *m)
+{
+    return m->ring.size - m->written % m->ring.size;
+}
+
+static adc_model_t model;
+
+static void test_update(void)
+{
+    adc_model_t *m = &model;
+    const volatile uint16_t *frame;
+
+    model_init(m, 3, 8);
+    // 还没有完整的帧
+    TEST_CHECK_EQ(adc_ring_latest(&m->ring, 0), 0);
+    TEST_CHECK_EQ(adc_ring_peek(&m->ring, &frame), 0);
+    dma_write(m, 2);
+    adc_ring_update(&m->ring, dma_ndtr(m));
+    TEST_CHECK_EQ(m->ring.head, 0);
+    TEST_CHECK_EQ(adc_ring_latest(&m->ring, 0), 0);
+
+    // 帧写完才计入, 最新值来自最后一个完整的帧
+    dma_write(m, 1);
+    adc_ring_update(&m->ring, dma_ndtr(m));
+    TEST_CHECK_EQ(m->ring.head, 1);
+    TEST_CHECK_EQ(adc_ring_latest(&m->ring, 2), sample_value(0, 2));
+    dma_write(m, 5);
+    adc_ring_update(&m->ring, dma_ndtr(m));
+    TEST_CHECK_EQ(m->ring.head, 2);
+    TEST_CHECK_EQ(adc_ring_latest(&m->ring, 1), sample_value(1, 1));
+    TEST_CHECK_EQ(adc_ring_latest(&m->ring, 3), 0);     // 不在扫描中的序号
+
+    // 写到缓冲末尾时 NDTR 重新装载为 size, 读到 0 也按 size 处理
+    dma_write(m, m->ring.size - m->written);
+    adc_ring_update(&m->ring, 0);
+    TEST_CHECK_EQ(m->ring.head, 8);
+    TEST_CHECK_EQ(adc_ring_latest(&m->ring, 0), sample_value(7, 0));
+    adc_ring_update(&m->ring, m->ring.size);
+    TEST_CHECK_EQ(m->ring.head, 8);
+
+    // 每圈更新两次, 跑很多圈
+    for(int i = 0; i < 1000; i++)
+    {
+        dma_write(m, m->ring.size / 2);
+        adc_ring_update(&m->ring, dma_ndtr(m));
+    }
+    TEST_CHECK_EQ(m->ring.head, m->written / m->ring.channels);
+}
+
+static void test_peek_wrap(void)
+{
+    // 取帧不跨过缓冲末尾, 释放后再取剩下的
+    adc_model_t *m = &model;
+    const volatile uint16_t *frame;
+    uint32_t n;
+
+    model_init(m, 2, 8);
+    dma_write(m, 2 * 6);
+    adc_ring_update(&m->ring, dma_ndtr(m));
+    adc_ring_release(&m->ring, adc_ring_peek(&m->ring, &frame));
+    TEST_CHECK_EQ(m->ring.tail, 6);
+
+    dma_write(m, 2 * 5);
+    adc_ring_update(&m->ring, dma_ndtr(m));
+    TEST_CHECK_EQ(adc_ring_available(&m->ring), 5);
+    n = adc_ring_peek(&m->ring, &frame);
+    TEST_CHECK_EQ(n, 2);
+    TEST_CHECK(frame == m->buf + 6 * 2);
+    TEST_CHECK_EQ(frame[0], sample_value(6, 0));
+    TEST_CHECK_EQ(frame[3], sample_value(7, 1));
+    adc_ring_release(&m->ring, n);
+    n = adc_ring_peek(&m->ring, &frame);
+    TEST_CHECK_EQ(n, 3);
+    TEST_CHECK(frame == m->buf);
+    TEST_CHECK_EQ(frame[0], sample_value(8, 0));
+
+    // 释放超过可读的帧数时只释放可读的
+    adc_ring_release(&m->ring, 100);
+    TEST_CHECK_EQ(m->ring.tail, m->ring.head);
+    TEST_CHECK_EQ(adc_ring_available(&m->ring), 0);
+    TEST_CHECK_EQ(m->ring.overruns, 0);
+}
+
+static void test_overrun(void)
+{
+    // 读得太慢: 只保留最近 frames - 1 帧, 丢掉的计入 overruns
+    adc_model_t *m = &model;
+    const volatile uint16_t *frame;
+    uint32_t n;
+
+    model_init(m, 4, 8);
+    for(int i = 0; i < 5; i++)
+    {
+        dma_write(m, 4 * 4);
+        adc_ring_update(&m->ring, dma_ndtr(m));
+    }
+    TEST_CHECK_EQ(m->ring.head, 20);
+    TEST_CHECK_EQ(adc_ring_available(&m->ring), 7);
+    TEST_CHECK_EQ(m->ring.overruns, 13);
+    TEST_CHECK_EQ(m->ring.tail, 13);
+    n = adc_ring_peek(&m->ring, &frame);
+    TEST_CHECK_EQ(n, 3);
+    TEST_CHECK_EQ(frame[0], sample_value(13, 0));
+
+    // 处理期间被覆盖的帧在下次取帧时丢掉
+    dma_write(m, 4 * 6);
+    adc_ring_update(&m->ring, dma_ndtr(m));
+    adc_ring_release(&m->ring, n);
+    n = adc_ring_peek(&m->ring, &frame);
+    TEST_CHECK_EQ(m->ring.tail, 19);
+    TEST_CHECK_EQ(m->ring.overruns, 16);
+    TEST_CHECK_EQ(frame[0], sample_value(19, 0));
+}
+
+static void test_random(int steps)
+{
+    // 随机的通道数/帧数/写入量/读取量, 每半圈至少更新一次
+    adc_model_t *m = &model;
+    int bad_head = 0, bad_latest = 0, bad_data = 0, bad_count = 0, bad_lost = 0;
+    uint32_t delivered = 0;
+
+    test_srand(21);
+    for(int round = 0; round < 20; round++)
+    {
+        uint16_t channels = 1 + test_rand() % CHANNELS_MAX;
+        uint32_t frames = 2 + test_rand() % (FRAMES_MAX - 1);
+        uint32_t expect = 0, lost = 0;     // 下一个应该取到的帧, 跳过的帧数
+
+        model_init(m, channels, frames);
+        for(int step = 0; step < steps / 20; step++)
+        {
+            const volatile uint16_t *frame;
+            uint32_t n, first, k;
+
+            dma_write(m, test_rand() % (m->ring.size / 2 + 1));
+            adc_ring_update(&m->ring, dma_ndtr(m));
+            bad_head += (m->ring.head != m->written / channels);
+            if(m->ring.head)
+            {
+                bad_latest += (adc_ring_latest(&m->ring, channels - 1) != sample_value(m->ring.head - 1, channels - 1));
+            }
+            if(test_rand() % 3 == 0)
+            {
+                continue;       // 这次不读
+            }
+
+            n = adc_ring_peek(&m->ring, &frame);
+            first = m->ring.tail;
+            bad_count += (n > frames - 1) || (first < expect) || (m->ring.head - first > frames - 1);
+            lost += first - expect;
+            for(uint32_t i = 0; i < n; i++)
+            {
+                for(uint16_t c = 0; c < channels; c++)
+                {
+                    bad_data += (frame[i * channels + c] != sample_value(first + i, c));
+                }
+            }
+            k = n ? test_rand() % (n + 1) : 0;
+            adc_ring_release(&m->ring, k);
+            delivered += k;
+            expect = first + k;
+        }
+        bad_lost += (lost != m->ring.overruns);
+    }
+    printf("%u frames delivered\n", (unsigned)delivered);
+    TEST_CHECK_EQ(bad_head, 0);
+    TEST_CHECK_EQ(bad_latest, 0);
+    TEST_CHECK_EQ(bad_data, 0);
+    TEST_CHECK_EQ(bad_count, 0);
+    TEST_CHECK_EQ(bad_lost, 0);
+}
+
+int main(int argc, char *argv[])
+{
+    test_update();
+    test_peek_wrap();
+    test_overrun();
+    test_random((argc > 1) ? atoi(argv[1]) : 200000);
+
+    return TEST_DONE();
+}
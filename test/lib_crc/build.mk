@@ -0,0 +1,8 @@
+# CRC 库: 标准向量, 与逐位计算比较(任意起始值/偏移/分段), 速度; 每种查表方式各编译一次
+TESTS += lib_crc lib_crc_4 lib_crc_1
+lib_crc_SRC = test/lib_crc/lib_crc_test.cpp platform/MCU/shared/crc/src/lib_crc.c
+lib_crc_CFLAGS = -DCRC_TABLE_SLICES=8
+lib_crc_4_SRC = $(lib_crc_SRC)
+lib_crc_4_CFLAGS = -DCRC_TABLE_SLICES=4
+lib_crc_1_SRC = $(lib_crc_SRC)
+lib_crc_1_CFLAGS = -DCRC_TABLE_SLICES=1
@@ -0,0 +1,178 @@
+/**
+ ******************************************************************************
+ * @file     : lib_crc_test.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : 查表 CRC 的标准向量, 分段计算和速度测试
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+/*
+  同一个测试按 CRC_TABLE_SLICES=1/4/8 编译三次, 见 build.mk
+  参考实现为逐位计算, 与查表的结果在任意起始值, 偏移(不对齐)和分段下比较
+  STM32 硬件 CRC 单元的路径不能在主机上测试
+*/
+#include <stdlib.h>
+
+#include "lib_crc.h"
+#include "host_test.h"
+
+// 逐位计算: CRC-16/CCITT 低位先行, 与 avr _crc_ccitt_update 相同
+static uint16_t ref16(uint16_t crc, const uint8_t *p, uint32_t len)
+{
+    while(len--)
+    {
+        crc ^= *p++;
+        for(int i = 0; i < 8; i++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+// 逐位计算: CRC-32 高位先行, 与 STM32 CRC 单元相同
+static uint32_t ref32(uint32_t crc, const uint8_t *p, uint32_t len)
+{
+    while(len--)
+    {
+        crc ^= (uint32_t)*p++ << 24;
+        for(int i = 0; i < 8; i++)
+        {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+/*=======测试===============================================================*/
+static void test_vectors(void)
+{
+    // CRC-16/MCRF4XX 与 CRC-32/MPEG-2 的标准校验值, 其余由独立的逐位实现算出
+    static const struct
+    {
+        const char *data;
+        uint32_t len;
+        uint16_t crc16;
+        uint32_t crc32;
+    } vectors[] =
+    {
+        {"123456789", 9, 0x6F91, 0x0376E6E7},
+        {"", 0, 0xFFFF, 0xFFFFFFFF},
+        {"a", 1, 0x7D08, 0xE66C6494},
+        {"The quick brown fox jumps over the lazy dog", 43, 0x6CA7, 0xBA62119E},
+    };
+    uint8_t zeros[32], ones[32], bytes[256];
+
+    for(unsigned i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++)
+    {
+        TEST_CHECK_EQ(crc16_ccitt_update(CRC16_INIT, vectors[i].data, vectors[i].len), vectors[i].crc16);
+        TEST_CHECK_EQ(crc32_update(CRC32_INIT, vectors[i].data, vectors[i].len), vectors[i].crc32);
+    }
+    memset(zeros, 0, sizeof(zeros));
+    memset(ones, 0xFF, sizeof(ones));
+    for(int i = 0; i < 256; i++)
+    {
+        bytes[i] = i;
+    }
+    TEST_CHECK_EQ(crc16_ccitt_update(CRC16_INIT, zeros, sizeof(zeros)), 0x328F);
+    TEST_CHECK_EQ(crc32_update(CRC32_INIT, zeros, sizeof(zeros)), 0x4A55AF67);
+    TEST_CHECK_EQ(crc16_ccitt_update(CRC16_INIT, ones, sizeof(ones)), 0x1FAE);
+    TEST_CHECK_EQ(crc32_update(CRC32_INIT, ones, sizeof(ones)), 0x2F2AC900);
+    TEST_CHECK_EQ(crc16_ccitt_update(CRC16_INIT, bytes, sizeof(bytes)), 0xCFC3);
+    TEST_CHECK_EQ(crc32_update(CRC32_INIT, bytes, sizeof(bytes)), 0x494A116A);
+}
+
+static void test_random(uint8_t *buf, uint32_t size)
+{
+    // 任意起始值, 偏移和长度, 分两段计算与一次计算相同
+    int bad16 = 0, bad32 = 0;
+
+    test_srand(17);
+    for(int i = 0; i < 100000; i++)
+    {
+        uint32_t off = test_rand() % 4096, len = test_rand() % 300;
+        uint32_t split = len ? test_rand() % len : 0;
+        uint16_t s16 = test_rand();
+        uint32_t s32 = test_rand();
+
+        bad16 += crc16_ccitt_update(crc16_ccitt_update(s16, buf + off, split), buf + off + split, len - split)
+                 != ref16(s16, buf + off, len);
+        bad32 += crc32_update(crc32_update(s32, buf + off, split), buf + off + split, len - split)
+                 != ref32(s32, buf + off, len);
+    }
+    TEST_CHECK_EQ(bad16, 0);
+    TEST_CHECK_EQ(bad32, 0);
+
+    // 长数据
+    TEST_CHECK_EQ(crc16_ccitt_update(CRC16_INIT, buf, size), ref16(CRC16_INIT, buf, size));
+    TEST_CHECK_EQ(crc32_update(CRC32_INIT, buf, size), ref32(CRC32_INIT, buf, size));
+}
+
+static void bench(uint8_t *buf, uint32_t size)
+{
+    volatile uint32_t sink = 0;
+    int rounds = 20;
+    double t;
+
+    t = test_now();
+    for(int r = 0; r < rounds; r++)
+    {
+        sink += ref16(CRC16_INIT, buf, size);
+    }
+    double bit16 = rounds * (size / 1e6) / (test_now() - t);
+    t = test_now();
+    for(int r = 0; r < rounds; r++)
+    {
+        sink += crc16_ccitt_update(CRC16_INIT, buf, size);
+    }
+    double table16 = rounds * (size / 1e6) / (test_now() - t);
+    t = test_now();
+    for(int r = 0; r < rounds; r++)
+    {
+        sink += ref32(CRC32_INIT, buf, size);
+    }
+    double bit32 = rounds * (size / 1e6) / (test_now() - t);
+    t = test_now();
+    for(int r = 0; r < rounds; r++)
+    {
+        sink += crc32_update(CRC32_INIT, buf, size);
+    }
+    double table32 = rounds * (size / 1e6) / (test_now() - t);
+
+    printf("%d slices: crc16 %.0f MB/s (bitwise %.0f), crc32 %.0f MB/s (bitwise %.0f)\n",
+           CRC_TABLE_SLICES, table16, bit16, table32, bit32);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t size = 1 << 20;
+    uint8_t *buf = (uint8_t *)malloc(size);
+
+    test_srand(1);
+    for(uint32_t i = 0; i < size; i++)
+    {
+        buf[i] = (uint8_t)test_rand();
+    }
+    test_vectors();
+    test_random(buf, size);
+    bench(buf, size);
+    free(buf);
+
+    return TEST_DONE();
+}
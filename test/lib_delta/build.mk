@@ -0,0 +1,5 @@
+# 差分包还原: 任意分段, 各种压缩参数, 包头/旧固件/空间错误, 包体位错误, mkdelta.py 生成的包
+TESTS += lib_delta
+lib_delta_SRC = test/lib_delta/lib_delta_test.cpp platform/MCU/shared/delta/src/lib_delta.c \
+    platform/MCU/shared/crc/src/lib_crc.c
+lib_delta_ARGS = 3000
@@ -0,0 +1,482 @@
+/**
+ ******************************************************************************
+ * @file     : lib_delta_test.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : 差分包还原测试
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+/*
+  测试中生成差分包: 随机的 bsdiff 控制块序列(差值, 新数据, 旧固件跳转),
+  再按 heatshrink 的位流做 LZSS 压缩; 还原结果与生成时得到的新固件比较
+  有 python3 时再用 build/tools/mkdelta.py 生成的差分包还原, 检查工具与还原代码一致
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "lib_delta.h"
+#include "lib_crc.h"
+#include "host_test.h"
+
+typedef std::vector<uint8_t> bytes_t;
+
+/*=======生成差分包=========================================================*/
+static void put_varint(bytes_t &out, uint32_t v)
+{
+    while(v >= 0x80)
+    {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+/*
+  从 old 生成随机的新固件和控制块序列
+*/
+static void make_records(const bytes_t &old, uint32_t new_size, bytes_t &fresh, bytes_t &records)
+{
+    int32_t old_pos = 0;
+
+    fresh.clear();
+    records.clear();
+    while(fresh.size() < new_size)
+    {
+        uint32_t left = new_size - fresh.size();
+        uint32_t diff_len = test_rand() % 2000, extra_len = (test_rand() % 4) ? test_rand() % 40 : 0;
+        int32_t seek, target;
+
+        if(diff_len > old.size() - old_pos)
+        {
+            diff_len = old.size() - old_pos;
+        }
+        if(diff_len > left)
+        {
+            diff_len = left;
+        }
+        if(extra_len > left - diff_len)
+        {
+            extra_len = left - diff_len;
+        }
+        // 旧固件跳转: 多数向前跳过一点, 少数跳回前面
+        target = old_pos + diff_len + ((test_rand() % 5) ? test_rand() % 64 : -(int32_t)(test_rand() % 4096));
+        if(target < 0)
+        {
+            target = 0;
+        }
+        if(target > (int32_t)old.size())
+        {
+            target = old.size();
+        }
+        seek = target - (int32_t)(old_pos + diff_len);
+
+        put_varint(records, diff_len);
+        put_varint(records, extra_len);
+        put_varint(records, ((uint32_t)seek << 1) ^ (uint32_t)(seek >> 31));
+        for(uint32_t i = 0; i < diff_len; i++)
+        {
+            // 大部分字节不变(差值为0), 少数改变
+            uint8_t diff = (test_rand() % 16) ? 0 : (uint8_t)test_rand();
+
+            fresh.push_back(old[old_pos + i] + diff);
+            records.push_back(diff);
+        }
+        for(uint32_t i = 0; i < extra_len; i++)
+        {
+            uint8_t b = (uint8_t)test_rand();
+
+            fresh.push_back(b);
+            records.push_back(b);
+        }
+        old_pos = target;
+    }
+}
+
+typedef struct
+{
+    bytes_t *out;
+    uint32_t value;
+    int bits;
+} bit_writer_t;
+
+static void put_bits(bit_writer_t *w, uint32_t value, int bits)
+{
+    while(bits--)
+    {
+        w->value = (w->value << 1) | ((value >> bits) & 1);
+        if(++w->bits == 8)
+        {
+            w->out->push_back((uint8_t)w->value);
+            w->value = 0;
+            w->bits = 0;
+        }
+    }
+}
+
+/*
+  LZSS 压缩: 在窗口中找最长的匹配, 比字面值短时输出距离和长度
+*/
+static void compress(const bytes_t &in, int window_bits, int count_bits, bytes_t &out)
+{
+    bit_writer_t w = {&out, 0, 0};
+    uint32_t window = 1 << window_bits, count_max = 1 << count_bits;
+    uint32_t i = 0;
+
+    while(i < in.size())
+    {
+        uint32_t best_len = 0, best_dist = 0;
+
+        for(uint32_t dist = 1; dist <= window && dist <= i; dist++)
+        {
+            uint32_t len = 0;
+
+            while(len < count_max && i + len < in.size() && in[i + len - dist] == in[i + len])
+            {
+                len++;
+            }
+            if(len > best_len)
+            {
+                best_len = len;
+                best_dist = dist;
+                if(len == count_max)
+                {
+                    break;
+                }
+            }
+        }
+        if(best_len * 9 > 1u + window_bits + count_bits)
+        {
+            put_bits(&w, 0, 1);
+            put_bits(&w, best_dist - 1, window_bits);
+            put_bits(&w, best_len - 1, count_bits);
+            i += best_len;
+        }
+        else
+        {
+            put_bits(&w, 1, 1);
+            put_bits(&w, in[i], 8);
+            i++;
+        }
+    }
+    if(w.bits)
+    {
+        put_bits(&w, 0, 8 - w.bits);
+    }
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void make_patch(const bytes_t &old, const bytes_t &fresh, const bytes_t &records,
+                       int window_bits, int count_bits, bytes_t &patch)
+{
+    uint8_t head[DELTA_HEAD_SIZE];
+
+    memset(head, 0, sizeof(head));
+    put32(head, DELTA_MAGIC);
+    head[4] = window_bits;
+    head[5] = count_bits;
+    put32(head + 8, old.size());
+    put32(head + 12, crc32_update(CRC32_INIT, &old[0], old.size()));
+    put32(head + 16, fresh.size());
+    put32(head + 20, crc32_update(CRC32_INIT, &fresh[0], fresh.size()));
+    put32(head + 24, crc32_update(CRC32_INIT, head, 24));
+    patch.assign(head, head + DELTA_HEAD_SIZE);
+    compress(records, window_bits, count_bits, patch);
+}
+
+/*=======还原===============================================================*/
+typedef struct
+{
+    const bytes_t *old;
+    bytes_t out;
+    uint32_t next;          // 下一次写入的位置
+    int bad_write;          // 写入不连续, 或者不是最后一次却不足 DELTA_OUT_BUF_SIZE
+    int bad_read;
+    int short_writes;
+} target_t;
+
+static int old_read(void *arg, uint32_t offset, uint8_t *buf, uint32_t len)
+{
+    target_t *t = (target_t *)arg;
+
+    if(offset + len > t->old->size() || ((uintptr_t)buf & 3))
+    {
+        t->bad_read++;
+        return 1;
+    }
+    memcpy(buf, &(*t->old)[offset], len);
+    return 0;
+}
+
+static int new_write(void *arg, uint32_t offset, const uint8_t *buf, uint32_t len)
+{
+    target_t *t = (target_t *)arg;
+
+    if(offset != t->next || ((uintptr_t)buf & 3))
+    {
+        t->bad_write++;
+    }
+    t->short_writes += (len != DELTA_OUT_BUF_SIZE);
+    t->out.insert(t->out.end(), buf, buf + len);
+    t->next = offset + len;
+    return 0;
+}
+
+static delta_status_t apply(const bytes_t &old, const bytes_t &patch, uint32_t chunk, target_t *t,
+                            uint32_t new_size_max = 1 << 20)
+{
+    static delta_apply_t delta;
+    delta_status_t status = DELTA_RUNNING;
+
+    t->old = &old;
+    t->out.clear();
+    t->next = 0;
+    t->bad_write = t->bad_read = t->short_writes = 0;
+    delta_apply_init(&delta, old.size(), new_size_max, old_read, new_write, t);
+    for(uint32_t i = 0; i < patch.size(); i += chunk)
+    {
+        uint32_t len = (patch.size() - i < chunk) ? patch.size() - i : chunk;
+
+        status = delta_apply_input(&delta, &patch[i], len);
+    }
+    return status;
+}
+
+static void random_image(bytes_t &image, uint32_t size)
+{
+    // 类似固件: 重复的指令模式和零
+    image.resize(size);
+    for(uint32_t i = 0; i < size; i++)
+    {
+        image[i] = (test_rand() % 3) ? (uint8_t)(i * 7 + (i >> 5)) : (uint8_t)test_rand();
+    }
+}
+
+/*=======测试===============================================================*/
+static void test_chunking(void)
+{
+    // 任意分段输入还原出同样的新固件; 写入连续, 只有最后一次不足一个缓冲
+    bytes_t old, fresh, records, patch;
+    target_t t;
+    int bad = 0;
+
+    test_srand(19);
+    random_image(old, 30000);
+    make_records(old, 32000, fresh, records);
+    make_patch(old, fresh, records, 10, 8, patch);
+    TEST_CHECK(delta_patch_check(&patch[0], patch.size()));
+    TEST_CHECK(patch.size() < fresh.size() / 2);
+
+    for(uint32_t chunk = 1; chunk <= 1500; chunk = chunk * 3 / 2 + 1)
+    {
+        bad += (apply(old, patch, chunk, &t) != DELTA_DONE) || (t.out != fresh)
+               || t.bad_write || t.bad_read || (t.short_writes > 1);
+    }
+    TEST_CHECK_EQ(bad, 0);
+}
+
+static void test_parameters(void)
+{
+    // 各种窗口和长度位数, 以及很小的固件
+    int bad = 0;
+
+    test_srand(20);
+    for(int window_bits = 4; window_bits <= DELTA_WINDOW_BITS_MAX; window_bits++)
+    {
+        for(int count_bits = 1; count_bits < window_bits; count_bits += 2)
+        {
+            bytes_t old, fresh, records, patch;
+            target_t t;
+
+            random_image(old, 1 + test_rand() % 5000);
+            make_records(old, 1 + test_rand() % 5000, fresh, records);
+            make_patch(old, fresh, records, window_bits, count_bits, patch);
+            bad += (apply(old, patch, 1 + test_rand() % 100, &t) != DELTA_DONE) || (t.out != fresh);
+        }
+    }
+    TEST_CHECK_EQ(bad, 0);
+}
+
+static void test_errors(void)
+{
+    bytes_t old, fresh, records, patch, bad;
+    target_t t;
+
+    test_srand(21);
+    random_image(old, 8000);
+    make_records(old, 9000, fresh, records);
+    make_patch(old, fresh, records, 10, 8, patch);
+
+    // 不是差分包, 包头校验错误, 参数不支持
+    TEST_CHECK(!delta_patch_check(&old[0], old.size()));
+    bad = patch;
+    bad[0] ^= 1;
+    TEST_CHECK_EQ(apply(old, bad, 100, &t), DELTA_ERR_HEAD);
+    bad = patch;
+    bad[9] ^= 1;
+    TEST_CHECK_EQ(apply(old, bad, 100, &t), DELTA_ERR_HEAD);
+    bad = patch;
+    bad[4] = DELTA_WINDOW_BITS_MAX + 1;
+    put32(&bad[24], crc32_update(CRC32_INIT, &bad[0], 24));
+    TEST_CHECK_EQ(apply(old, bad, 100, &t), DELTA_ERR_HEAD);
+
+    // 旧固件不对: 长度不同或内容不同, 不写入任何数据
+    bytes_t other = old;
+    other.pop_back();
+    TEST_CHECK_EQ(apply(other, patch, 100, &t), DELTA_ERR_BASE);
+    TEST_CHECK(t.out.empty());
+    other = old;
+    other[4000] ^= 0x80;
+    TEST_CHECK_EQ(apply(other, patch, 100, &t), DELTA_ERR_BASE);
+    TEST_CHECK(t.out.empty());
+
+    // 新固件超过空间
+    TEST_CHECK_EQ(apply(old, patch, 100, &t, fresh.size() - 1), DELTA_ERR_SIZE);
+    TEST_CHECK_EQ(apply(old, patch, 100, &t, fresh.size()), DELTA_DONE);
+
+    // 不完整的差分包不会完成
+    bad.assign(patch.begin(), patch.end() - 1);
+    TEST_CHECK_EQ(apply(old, bad, 100, &t), DELTA_RUNNING);
+
+    // 完成之后再输入, 结果不变
+    static delta_apply_t delta;
+    delta_apply_init(&delta, old.size(), 1 << 20, old_read, new_write, &t);
+    t.out.clear();
+    t.next = 0;
+    TEST_CHECK_EQ(delta_apply_input(&delta, &patch[0], patch.size()), DELTA_DONE);
+    TEST_CHECK_EQ(delta_apply_input(&delta, &patch[0], 10), DELTA_DONE);
+    TEST_CHECK(t.out == fresh);
+}
+
+static void test_corruption(int count)
+{
+    // 包体中任意一位出错: 要么报错, 要么(只改了末尾的填充位)还原出正确的固件
+    bytes_t old, fresh, records, patch;
+    target_t t;
+    int wrong = 0, done = 0;
+
+    test_srand(22);
+    random_image(old, 6000);
+    make_records(old, 6000, fresh, records);
+    make_patch(old, fresh, records, 10, 8, patch);
+    for(int i = 0; i < count; i++)
+    {
+        bytes_t bad = patch;
+        uint32_t bit = DELTA_HEAD_SIZE * 8 + test_rand() % ((patch.size() - DELTA_HEAD_SIZE) * 8);
+
+        bad[bit / 8] ^= 0x80 >> (bit % 8);
+        if(apply(old, bad, 1 + test_rand() % 300, &t) == DELTA_DONE)
+        {
+            done++;
+            wrong += (t.out != fresh);
+        }
+        TEST_CHECK(t.out.size() <= fresh.size());
+        TEST_CHECK_EQ(t.bad_read, 0);
+    }
+    printf("%d corrupted patches: %d still done\n", count, done);
+    TEST_CHECK_EQ(wrong, 0);
+}
+
+static bool write_file(const char *name, const bytes_t &data)
+{
+    FILE *fp = fopen(name, "wb");
+
+    if(fp == NULL)
+    {
+        return false;
+    }
+    fwrite(&data[0], 1, data.size(), fp);
+    fclose(fp);
+    return true;
+}
+
+static bool read_file(const char *name, bytes_t &data)
+{
+    FILE *fp = fopen(name, "rb");
+    uint8_t buf[4096];
+    size_t len;
+
+    if(fp == NULL)
+    {
+        return false;
+    }
+    data.clear();
+    while((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        data.insert(data.end(), buf, buf + len);
+    }
+    fclose(fp);
+    return true;
+}
+
+static void test_mkdelta(void)
+{
+    // build/tools/mkdelta.py 生成的差分包
+    char old_name[64], new_name[64], patch_name[64], cmd[256];
+    bytes_t old, fresh, records, patch;
+    target_t t;
+
+    if(system("python3 -c 'import zlib' >/dev/null 2>&1") != 0)
+    {
+        printf("mkdelta.py: no python3, skipped\n");
+        return;
+    }
+    snprintf(old_name, sizeof(old_name), "/tmp/lib_delta_old_%d.bin", (int)getpid());
+    snprintf(new_name, sizeof(new_name), "/tmp/lib_delta_new_%d.bin", (int)getpid());
+    snprintf(patch_name, sizeof(patch_name), "/tmp/lib_delta_patch_%d.bin", (int)getpid());
+
+    test_srand(23);
+    random_image(old, 40000);
+    make_records(old, 41000, fresh, records);
+    TEST_CHECK(write_file(old_name, old));
+    TEST_CHECK(write_file(new_name, fresh));
+    snprintf(cmd, sizeof(cmd), "python3 build/tools/mkdelta.py %s %s %s >/dev/null", old_name, new_name, patch_name);
+    TEST_CHECK_EQ(system(cmd), 0);
+    TEST_CHECK(read_file(patch_name, patch));
+    TEST_CHECK(delta_patch_check(&patch[0], patch.size()));
+    for(uint32_t chunk = 1; chunk <= 1460; chunk = chunk * 4 + 3)
+    {
+        TEST_CHECK_EQ(apply(old, patch, chunk, &t), DELTA_DONE);
+        TEST_CHECK(t.out == fresh);
+    }
+    printf("mkdelta.py: %u byte patch for a %u byte image\n", (unsigned)patch.size(), (unsigned)fresh.size());
+    unlink(old_name);
+    unlink(new_name);
+    unlink(patch_name);
+}
+
+int main(int argc, char *argv[])
+{
+    test_chunking();
+    test_parameters();
+    test_errors();
+    test_corruption((argc > 1) ? atoi(argv[1]) : 3000);
+    test_mkdelta();
+
+    return TEST_DONE();
+}
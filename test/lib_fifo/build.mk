@@ -0,0 +1,6 @@
+# 环形缓冲: 回绕, 溢出计数, 连续区间, DMA 同步, 两个线程同时读写, 性能对比
+TESTS += lib_fifo
+lib_fifo_SRC = test/lib_fifo/lib_fifo_test.cpp board/neutron/src/lib_fifo.cpp \
+    board/gcc/src/cmsis_os.cpp board/neutron/src/wiring_print.cpp \
+    board/neutron/src/wiring_ipaddress.cpp board/neutron/src/wiring_string.cpp \
+    board/neutron/src/wiring_usbserial.cpp board/gcc/src/wiring_usbserial_hal.cpp
@@ -0,0 +1,355 @@
+/**
+ ******************************************************************************
+ * @file     : lib_fifo_test.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : 环形缓冲测试和与逐字节实现的性能对比
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+/*
+  检查回绕, 计数溢出(32位自由增长的读写位置), 满时丢弃计数, peek/reserve 的连续区间,
+  fifo__sync 模拟 DMA 写入和覆盖后的丢弃, 以及单生产者/单消费者两个线程同时读写
+  最后与之前逐字节搬运(满时覆盖)的实现对比读写速度
+*/
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "application.h"
+#include "lib_fifo.h"
+#include "host_test.h"
+
+static uint8_t pattern(uint32_t i)
+{
+    return (uint8_t)(i * 131 + (i >> 8));
+}
+
+static void test_init(void)
+{
+    fifo_t f;
+
+    TEST_CHECK_EQ(fifo__init(&f, 1000), 0);
+    TEST_CHECK_EQ(f.size, 1024);
+    TEST_CHECK_EQ(f.mask, 1023);
+    TEST_CHECK_EQ(fifo__avaliable(&f), 0);
+    TEST_CHECK_EQ(fifo__free(&f), 1024);
+    fifo__deinit(&f);
+}
+
+static void test_wrap(void)
+{
+    // 读写位置从接近 2^32 开始, 随机长度写入读出, 数据和长度必须一致
+    uint8_t in[300], out[300];
+    uint32_t wr = 0, rd = 0;
+    fifo_t f;
+    int i, k, n, len;
+    bool ok = true;
+
+    fifo__init(&f, 256);
+    f.p_w = f.p_r = 0xFFFFFF00u;
+    test_srand(9);
+    for(i = 0; i < 20000; i++)
+    {
+        len = test_rand() % 300;
+        for(k = 0; k < len; k++)
+        {
+            in[k] = pattern(wr + k);
+        }
+        n = fifo__write(&f, in, len);
+        ok = ok && (n == (len < 256 - (int)(wr - rd) ? len : 256 - (int)(wr - rd)));
+        wr += n;
+
+        len = test_rand() % 300;
+        n = fifo__read(&f, out, len);
+        for(k = 0; k < n; k++)
+        {
+            ok = ok && (out[k] == pattern(rd + k));
+        }
+        rd += n;
+        ok = ok && (fifo__avaliable(&f) == (int)(wr - rd));
+    }
+    TEST_CHECK(ok);
+    TEST_CHECK(f.p_w < 0xFFFFFF00u);     // 位置已经越过 2^32
+    fifo__deinit(&f);
+}
+
+static void test_full(void)
+{
+    // 满时不覆盖旧数据, 多余的新数据计入 overflow
+    uint8_t in[100], out[100];
+    fifo_t f;
+    int k;
+
+    fifo__init(&f, 64);
+    for(k = 0; k < 100; k++)
+    {
+        in[k] = k;
+    }
+    TEST_CHECK_EQ(fifo__write(&f, in, 50), 50);
+    TEST_CHECK_EQ(fifo__write(&f, in + 50, 50), 14);
+    TEST_CHECK_EQ(fifo__overflow(&f), 36);
+    TEST_CHECK_EQ(fifo__write(&f, in, 1), 0);
+    TEST_CHECK_EQ(fifo__overflow(&f), 37);
+    TEST_CHECK_EQ(fifo__read(&f, out, 100), 64);
+    TEST_CHECK(memcmp(out, in, 64) == 0);
+    fifo__deinit(&f);
+}
+
+static void test_spans(void)
+{
+    // peek/reserve 返回到回绕处为止的连续区间
+    uint8_t in[64], *p;
+    fifo_t f;
+    int k;
+
+    fifo__init(&f, 64);
+    for(k = 0; k < 64; k++)
+    {
+        in[k] = k;
+    }
+    f.p_w = f.p_r = 40;
+    TEST_CHECK_EQ(fifo__reserve(&f, &p), 24);
+    TEST_CHECK(p == f.buf + 40);
+    memcpy(p, in, 24);
+    fifo__commit(&f, 24);
+    TEST_CHECK_EQ(fifo__reserve(&f, &p), 40);
+    TEST_CHECK(p == f.buf);
+    memcpy(p, in + 24, 10);
+    fifo__commit(&f, 10);
+
+    TEST_CHECK_EQ(fifo__peek(&f, &p), 24);
+    TEST_CHECK(memcmp(p, in, 24) == 0);
+    fifo__consume(&f, 20);
+    TEST_CHECK_EQ(fifo__peek(&f, &p), 4);
+    fifo__consume(&f, 4);
+    TEST_CHECK_EQ(fifo__peek(&f, &p), 10);
+    TEST_CHECK(memcmp(p, in + 24, 10) == 0);
+    fifo__flush(&f);
+    TEST_CHECK_EQ(fifo__avaliable(&f), 0);
+    TEST_CHECK_EQ(fifo__peek(&f, &p), 0);
+    fifo__deinit(&f);
+}
+
+static void test_sync(void)
+{
+    // 外部写入者直接写 buf, fifo__sync 提交到其写位置
+    uint8_t out[64];
+    fifo_t f;
+    uint32_t pos = 0;
+    int k;
+
+    fifo__init(&f, 64);
+    for(k = 0; k < 40; k++)
+    {
+        f.buf[(pos + k) & f.mask] = pattern(k);
+    }
+    pos = (pos + 40) & f.mask;
+    TEST_CHECK_EQ(fifo__sync(&f, pos), 40);
+    TEST_CHECK_EQ(fifo__read(&f, out, 30), 30);
+    TEST_CHECK_EQ(out[29], pattern(29));
+
+    // 再写入 60 字节, 覆盖了还没读的 10 字节中的 6 个
+    for(k = 0; k < 60; k++)
+    {
+        f.buf[(pos + k) & f.mask] = pattern(100 + k);
+    }
+    pos = (pos + 60) & f.mask;
+    TEST_CHECK_EQ(fifo__sync(&f, pos), 60);
+    TEST_CHECK_EQ(fifo__overflow(&f), 6);
+    // 未读数据已不完整, 全部丢弃, 从下一次写入开始
+    TEST_CHECK_EQ(fifo__read(&f, out, 64), 0);
+    TEST_CHECK_EQ(fifo__avaliable(&f), 0);
+    f.buf[pos] = 0x5a;
+    fifo__sync(&f, (pos + 1) & f.mask);
+    TEST_CHECK_EQ(fifo__read(&f, out, 64), 1);
+    TEST_CHECK_EQ(out[0], 0x5a);
+    fifo__deinit(&f);
+}
+
+/*=======单生产者/单消费者=================================================*/
+#define SPSC_BYTES  (8 * 1024 * 1024)
+
+static fifo_t spsc;
+static volatile int spsc_errors;
+
+static void *spsc_producer(void *arg)
+{
+    uint8_t chunk[97];
+    uint32_t wr = 0;
+    int k, len, n;
+
+    while(wr < SPSC_BYTES)
+    {
+        len = 1 + (wr * 7) % sizeof(chunk);
+        if(len > SPSC_BYTES - (int)wr)
+        {
+            len = SPSC_BYTES - wr;
+        }
+        for(k = 0; k < len; k++)
+        {
+            chunk[k] = pattern(wr + k);
+        }
+        // 满时只写入能放下的部分, 其余下一次重新写
+        n = fifo__write(&spsc, chunk, len);
+        wr += n;
+    }
+    return NULL;
+}
+
+static void test_spsc(void)
+{
+    pthread_t producer;
+    uint8_t *p;
+    uint32_t rd = 0;
+    int k, n;
+
+    fifo__init(&spsc, 1024);
+    pthread_create(&producer, NULL, spsc_producer, NULL);
+    while(rd < SPSC_BYTES)
+    {
+        // 交替使用拷贝读取和 peek
+        if(rd & 1)
+        {
+            uint8_t out[61];
+
+            n = fifo__read(&spsc, out, sizeof(out));
+            for(k = 0; k < n; k++)
+            {
+                spsc_errors += (out[k] != pattern(rd + k));
+            }
+        }
+        else
+        {
+            n = fifo__peek(&spsc, &p);
+            for(k = 0; k < n; k++)
+            {
+                spsc_errors += (p[k] != pattern(rd + k));
+            }
+            fifo__consume(&spsc, n);
+        }
+        rd += n;
+    }
+    pthread_join(producer, NULL);
+    TEST_CHECK_EQ(spsc_errors, 0);
+    TEST_CHECK_EQ(rd, SPSC_BYTES);
+    TEST_CHECK_EQ(fifo__avaliable(&spsc), 0);
+    fifo__deinit(&spsc);
+}
+
+/*=======之前的实现: 逐字节搬运, 满时覆盖最旧的数据==========================*/
+typedef struct
+{
+    uint8_t *buf;
+    int p_w;
+    int p_r;
+    int size;
+}legacy_fifo_t;
+
+#define LEGACY_AVALIABLE(fifo) ( (fifo->p_w >= fifo->p_r)?(fifo->p_w-fifo->p_r):(fifo->p_w + fifo->size - fifo->p_r) )
+#define LEGACY_PW_NEXT(fifo) {fifo->p_w++;if(fifo->p_w == fifo->size) fifo->p_w = 0;}
+#define LEGACY_PR_NEXT(fifo) {fifo->p_r++;if(fifo->p_r == fifo->size) fifo->p_r = 0;}
+
+static void legacy_write(legacy_fifo_t *fifo, const uint8_t *p_dat, int len)
+{
+    int i;
+
+    for(i = 0; i < len; i++)
+    {
+        LEGACY_PW_NEXT(fifo);
+        if(fifo->p_w == fifo->p_r)
+        {
+            LEGACY_PR_NEXT(fifo);
+        }
+        fifo->buf[fifo->p_w] = p_dat[i];
+    }
+}
+
+static int legacy_read(legacy_fifo_t *fifo, uint8_t *p_buf, int buf_size)
+{
+    int i, read_len, ava_len;
+
+    ava_len = LEGACY_AVALIABLE(fifo);
+    read_len = (buf_size <= ava_len) ? buf_size : ava_len;
+    for(i = 0; i < read_len; i++)
+    {
+        LEGACY_PR_NEXT(fifo);
+        p_buf[i] = fifo->buf[fifo->p_r];
+    }
+    return read_len;
+}
+
+static void bench(void)
+{
+    // 串口接收的典型块大小: 一次中断/DMA 事件的数据, 按 AT_RECV_SIZE 读出
+    const int total = 64 * 1024 * 1024, wr_chunk = 200, rd_chunk = 128;
+    static uint8_t in[256], out[256];
+    volatile uint32_t sink = 0;
+    legacy_fifo_t old;
+    fifo_t f;
+    double t0, t_new, t_old;
+    int done, k;
+
+    for(k = 0; k < (int)sizeof(in); k++)
+    {
+        in[k] = pattern(k);
+    }
+
+    fifo__init(&f, 4096);
+    t0 = test_now();
+    for(done = 0; done < total; done += wr_chunk)
+    {
+        fifo__write(&f, in, wr_chunk);
+        while(fifo__avaliable(&f) >= rd_chunk)
+        {
+            sink += fifo__read(&f, out, rd_chunk);
+        }
+    }
+    t_new = test_now() - t0;
+    fifo__deinit(&f);
+
+    old.buf = (uint8_t *)malloc(4096);
+    old.size = 4096;
+    old.p_w = old.p_r = 0;
+    t0 = test_now();
+    for(done = 0; done < total; done += wr_chunk)
+    {
+        legacy_write(&old, in, wr_chunk);
+        while(LEGACY_AVALIABLE((&old)) >= rd_chunk)
+        {
+            sink += legacy_read(&old, out, rd_chunk);
+        }
+    }
+    t_old = test_now() - t0;
+    free(old.buf);
+
+    printf("write %d / read %d bytes: memcpy ring %.0f MB/s, byte loop %.0f MB/s\n",
+           wr_chunk, rd_chunk, total / t_new / 1e6, total / t_old / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+    test_init();
+    test_wrap();
+    test_full();
+    test_spans();
+    test_sync();
+    test_spsc();
+    bench();
+
+    return TEST_DONE();
+}
@@ -0,0 +1,4 @@
+# 麦克风 PCM: 合成 PDM 的音量和频带能量, 缓冲满丢块, 计数回绕, 生产者线程下的整块丢失和音量发布
+TESTS += mic_pcm
+mic_pcm_SRC = test/mic_pcm/mic_pcm_test.cpp board/neutron/src/mic_pcm.c
+mic_pcm_ARGS = 200000
@@ -0,0 +1,401 @@
+/**
+ ******************************************************************************
+ * @file     : mic_pcm_test.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : 麦克风 PCM 环形缓冲和频带能量测试
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+/*
+  用2阶 sigma-delta 调制器产生 PDM 位流, sinc3 抽取64倍代替板上的 PDM 滤波库:
+      正弦波的 rms/peak 和频带能量, 静音, 缓冲满时丢新数据块, 计数回绕, flush
+  生产者线程模拟 DMA 中断: 数据只能整块丢失, 不会乱序或重复; 音量的 rms 与 peak 来自同一个窗口
+  参数: 线程测试的数据块数
+*/
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "mic_pcm.h"
+#include "host_test.h"
+
+#define PDM_RATE        (MIC_PCM_RATE * 64)
+
+/*=======合成的 PDM 输入====================================================*/
+typedef struct
+{
+    double i1, i2;
+    int y;
+    long t;                     // PDM 位序号
+} sigma_delta_t;
+
+static int sigma_delta_bit(sigma_delta_t *m, double x)
+{
+    m->i1 += x - m->y;
+    m->i2 += m->i1 - m->y;
+    m->y = (m->i2 >= 0) ? 1 : -1;
+    return m->y > 0;
+}
+
+// 一个数据块的正弦波 PDM, 高位先发送
+static void make_pdm(sigma_delta_t *m, uint16_t *pdm, double amplitude, double freq)
+{
+    for(int w = 0; w < MIC_PDM_HALF_WORDS; w++)
+    {
+        uint16_t v = 0;
+
+        for(int b = 15; b >= 0; b--)
+        {
+            v |= sigma_delta_bit(m, amplitude * sin(2 * M_PI * freq * m->t++ / PDM_RATE)) << b;
+        }
+        pdm[w] = v;
+    }
+}
+
+typedef struct
+{
+    long long integrator[3];
+    long long comb[3];
+} sinc3_t;
+
+// sinc3 抽取64倍, 增益 64^3
+static void sinc3_decimate(void *arg, uint16_t *pdm, int16_t *pcm)
+{
+    sinc3_t *s = (sinc3_t *)arg;
+    int n = 0;
+
+    for(int w = 0; w < MIC_PDM_HALF_WORDS; w++)
+    {
+        for(int b = 15; b >= 0; b--)
+        {
+            s->integrator[0] += ((pdm[w] >> b) & 1) ? 1 : -1;
+            s->integrator[1] += s->integrator[0];
+            s->integrator[2] += s->integrator[1];
+            if(((w * 16 + 15 - b) & 63) == 63)
+            {
+                long long y = s->integrator[2];
+                double v;
+
+                for(int k = 0; k < 3; k++)
+                {
+                    long long d = y - s->comb[k];
+                    s->comb[k] = y;
+                    y = d;
+                }
+                v = y / 262144.0 * 32767;
+                pcm[n++] = (int16_t)((v > 32767) ? 32767 : ((v < -32768) ? -32768 : v));
+            }
+        }
+    }
+}
+
+// 样本为递增的序号
+static void sequence_decimate(void *arg, uint16_t *pdm, int16_t *pcm)
+{
+    uint32_t *n = (uint32_t *)arg;
+
+    for(int i = 0; i < MIC_PCM_BLOCK_SAMPLES; i++)
+    {
+        pcm[i] = (int16_t)(*n)++;
+    }
+}
+
+static mic_pcm_ring_t ring;
+static int16_t pcm_out[200 * MIC_PCM_BLOCK_SAMPLES];
+
+// 输入 blocks 个数据块的正弦波, 每块之后分两次读出, 返回读出的样本数
+static int run_tone(double amplitude, double freq, int blocks, bool read)
+{
+    sigma_delta_t m;
+    sinc3_t filter;
+    uint16_t pdm[MIC_PDM_HALF_WORDS];
+    int n = 0;
+
+    memset(&m, 0, sizeof(m));
+    memset(&filter, 0, sizeof(filter));
+    mic_pcm_init(&ring);
+    for(int i = 0; i < blocks; i++)
+    {
+        make_pdm(&m, pdm, amplitude, freq);
+        mic_pcm_input(&ring, pdm, sinc3_decimate, &filter);
+        if(read)
+        {
+            n += mic_pcm_read(&ring, pcm_out + n, 7);
+            n += mic_pcm_read(&ring, pcm_out + n, 100);
+        }
+    }
+    return n;
+}
+
+/*=======测试===============================================================*/
+static void test_tone(void)
+{
+    // -6dBFS 1.5kHz: rms 和 peak, 能量在 1k-2k 频带, 各频带之和约为 rms^2
+    mic_pcm_level_t level;
+    float bands[MIC_PCM_BANDS], sum = 0;
+
+    TEST_CHECK_EQ(run_tone(0.5, 1500, 200, true), 200 * MIC_PCM_BLOCK_SAMPLES);
+    TEST_CHECK_EQ(mic_pcm_available(&ring), 0);
+    mic_pcm_get_level(&ring, &level);
+    printf("1.5kHz -6dBFS: rms %.4f peak %.4f\n", level.rms, level.peak);
+    TEST_CHECK(fabs(level.rms - 0.5 / sqrt(2)) < 0.02);
+    TEST_CHECK(fabs(level.peak - 0.5) < 0.03);
+
+    mic_pcm_band_energy(pcm_out + 1000, bands);
+    for(int b = 0; b < MIC_PCM_BANDS; b++)
+    {
+        sum += bands[b];
+    }
+    TEST_CHECK(bands[4] > 0.9 * sum);
+    TEST_CHECK(fabs(sum - level.rms * level.rms) < 0.005);
+
+    // 5kHz 在最高的 4k-8k 频带
+    run_tone(0.3, 5000, 100, true);
+    mic_pcm_band_energy(pcm_out + 500, bands);
+    sum = 0;
+    for(int b = 0; b < MIC_PCM_BANDS; b++)
+    {
+        sum += bands[b];
+    }
+    TEST_CHECK(bands[6] > 0.9 * sum);
+}
+
+static void test_band_energy(void)
+{
+    // 直接生成的满量程正弦波: 能量约为 0.5, 落在自己的频带
+    // 频带 0 只有频点 1, Hann 窗使它和直流互相泄漏, 不在这里检查
+    static int16_t pcm[MIC_PCM_FFT_SIZE];
+    float bands[MIC_PCM_BANDS];
+    int bad = 0;
+
+    for(int b = 1; b < MIC_PCM_BANDS; b++)
+    {
+        // 频点 1.5 * 2^b, 取整数频点避免泄漏
+        double bin = 3 << (b - 1);
+        float sum = 0;
+
+        for(int i = 0; i < MIC_PCM_FFT_SIZE; i++)
+        {
+            pcm[i] = (int16_t)floor(32767 * sin(2 * M_PI * bin * i / MIC_PCM_FFT_SIZE) + 0.5);
+        }
+        mic_pcm_band_energy(pcm, bands);
+        for(int k = 0; k < MIC_PCM_BANDS; k++)
+        {
+            sum += bands[k];
+        }
+        bad += (fabs(sum - 0.5) > 0.02) || (bands[b] < 0.7 * sum);
+    }
+    TEST_CHECK_EQ(bad, 0);
+
+    for(int i = 0; i < MIC_PCM_FFT_SIZE; i++)
+    {
+        pcm[i] = 10000;
+    }
+    // 直流只泄漏到频点 1
+    mic_pcm_band_energy(pcm, bands);
+    for(int b = 1; b < MIC_PCM_BANDS; b++)
+    {
+        bad += (bands[b] > 1e-6f);
+    }
+    TEST_CHECK_EQ(bad, 0);
+}
+
+static void test_overrun_flush(void)
+{
+    // 静音; 不读时缓冲满, 丢掉新的数据块
+    mic_pcm_level_t level;
+    int16_t x[5];
+
+    run_tone(0, 1000, 100, false);
+    mic_pcm_get_level(&ring, &level);
+    TEST_CHECK(level.rms < 0.01);
+    TEST_CHECK_EQ(mic_pcm_available(&ring), MIC_PCM_BLOCKS * MIC_PCM_BLOCK_SAMPLES);
+    TEST_CHECK_EQ(ring.overruns, 100 - MIC_PCM_BLOCKS);
+    TEST_CHECK_EQ(mic_pcm_read(&ring, x, 5), 5);
+    TEST_CHECK_EQ(mic_pcm_available(&ring), MIC_PCM_BLOCKS * MIC_PCM_BLOCK_SAMPLES - 5);
+    mic_pcm_flush(&ring);
+    TEST_CHECK_EQ(mic_pcm_available(&ring), 0);
+    TEST_CHECK_EQ(mic_pcm_read(&ring, x, 5), 0);
+
+    // 保留的是最早的数据块
+    uint32_t seq = 0;
+    uint16_t pdm[MIC_PDM_HALF_WORDS] = {0};
+    mic_pcm_init(&ring);
+    for(int i = 0; i < MIC_PCM_BLOCKS + 3; i++)
+    {
+        mic_pcm_input(&ring, pdm, sequence_decimate, &seq);
+    }
+    TEST_CHECK_EQ(mic_pcm_read(&ring, x, 1), 1);
+    TEST_CHECK_EQ(x[0], 0);
+    TEST_CHECK_EQ(ring.overruns, 3);
+}
+
+static void test_wrap(void)
+{
+    // head/tail 计数回绕
+    uint32_t seq = 0;
+    uint16_t pdm[MIC_PDM_HALF_WORDS] = {0};
+    int16_t block[MIC_PCM_BLOCK_SAMPLES];
+    int bad = 0;
+
+    mic_pcm_init(&ring);
+    ring.head = ring.tail = 0xFFFFFFF0u;
+    for(int i = 0; i < 40; i++)
+    {
+        mic_pcm_input(&ring, pdm, sequence_decimate, &seq);
+        bad += (mic_pcm_available(&ring) != MIC_PCM_BLOCK_SAMPLES);
+        bad += (mic_pcm_read(&ring, block, MIC_PCM_BLOCK_SAMPLES) != MIC_PCM_BLOCK_SAMPLES);
+        bad += (block[MIC_PCM_BLOCK_SAMPLES - 1] != (int16_t)(seq - 1));
+    }
+    TEST_CHECK_EQ(bad, 0);
+    TEST_CHECK_EQ(ring.overruns, 0);
+}
+
+/*=======生产者线程=========================================================*/
+static volatile int producer_done;
+static int producer_blocks;
+
+static void *sequence_producer(void *arg)
+{
+    uint32_t seq = 0;
+    uint16_t pdm[MIC_PDM_HALF_WORDS];
+
+    for(int i = 0; i < producer_blocks; i++)
+    {
+        mic_pcm_input(&ring, pdm, sequence_decimate, &seq);
+        if((i & 7) == 0)
+        {
+            sched_yield();
+        }
+    }
+    producer_done = 1;
+    return NULL;
+}
+
+// 每个音量窗口的样本都是 +-A, A 每个窗口不同, 所以同一窗口的 rms 等于 peak
+static void level_decimate(void *arg, uint16_t *pdm, int16_t *pcm)
+{
+    uint32_t *n = (uint32_t *)arg;
+    int16_t amplitude = 100 + (*n / MIC_PCM_LEVEL_BLOCKS) % 30000;
+
+    for(int i = 0; i < MIC_PCM_BLOCK_SAMPLES; i++)
+    {
+        pcm[i] = (i & 1) ? amplitude : -amplitude;
+    }
+    (*n)++;
+}
+
+static void *level_producer(void *arg)
+{
+    uint32_t n = 0;
+    uint16_t pdm[MIC_PDM_HALF_WORDS];
+
+    for(int i = 0; i < producer_blocks; i++)
+    {
+        mic_pcm_input(&ring, pdm, level_decimate, &n);
+        mic_pcm_flush(&ring);
+    }
+    producer_done = 1;
+    return NULL;
+}
+
+// 写到一半的音量过一段时间才完成
+static void *level_writer(void *arg)
+{
+    usleep(20000);
+    ring.level.rms = 0.25f;
+    ring.level.peak = 0.5f;
+    __sync_synchronize();
+    ring.level_seq++;
+    return NULL;
+}
+
+static void test_threads(int blocks)
+{
+    // 数据只能整块丢失, 读出的加上丢掉的等于写入的
+    pthread_t thread;
+    uint32_t expect = 0, got = 0;
+    int16_t buf[37];
+    int bad = 0, torn = 0;
+
+    producer_blocks = blocks;
+    producer_done = 0;
+    mic_pcm_init(&ring);
+    pthread_create(&thread, NULL, sequence_producer, NULL);
+    test_srand(1);
+    while(!producer_done || mic_pcm_available(&ring))
+    {
+        // 偶尔停一下让缓冲满
+        if((test_rand() & 4095) == 0)
+        {
+            usleep(20);
+        }
+        uint16_t n = mic_pcm_read(&ring, buf, sizeof(buf) / sizeof(buf[0]));
+
+        for(uint16_t i = 0; i < n; i++, got++, expect++)
+        {
+            if(buf[i] != (int16_t)expect)
+            {
+                bad += ((uint16_t)(buf[i] - (int16_t)expect) % MIC_PCM_BLOCK_SAMPLES) != 0;
+                expect += (uint16_t)(buf[i] - (int16_t)expect);
+            }
+        }
+    }
+    pthread_join(thread, NULL);
+    printf("%u samples read, %u blocks dropped\n", (unsigned)got, (unsigned)ring.overruns);
+    TEST_CHECK_EQ(bad, 0);
+    TEST_CHECK_EQ(got + ring.overruns * MIC_PCM_BLOCK_SAMPLES, (uint32_t)blocks * MIC_PCM_BLOCK_SAMPLES);
+
+    // 音量读取不会拿到两个窗口拼起来的值 (生产者同时清空数据, 消费者不读数据)
+    producer_done = 0;
+    mic_pcm_init(&ring);
+    pthread_create(&thread, NULL, level_producer, NULL);
+    while(!producer_done)
+    {
+        mic_pcm_level_t level;
+
+        mic_pcm_get_level(&ring, &level);
+        torn += (fabsf(level.rms - level.peak) > 1e-4f);
+    }
+    pthread_join(thread, NULL);
+    TEST_CHECK_EQ(torn, 0);
+
+    // 序号为奇数时等待写完
+    mic_pcm_level_t level;
+    mic_pcm_init(&ring);
+    ring.level_seq = 1;
+    ring.level.rms = 0.25f;
+    pthread_create(&thread, NULL, level_writer, NULL);
+    mic_pcm_get_level(&ring, &level);
+    pthread_join(thread, NULL);
+    TEST_CHECK(level.rms == 0.25f && level.peak == 0.5f);
+}
+
+int main(int argc, char *argv[])
+{
+    test_tone();
+    test_band_energy();
+    test_overrun_flush();
+    test_wrap();
+    test_threads((argc > 1) ? atoi(argv[1]) : 200000);
+
+    return TEST_DONE();
+}
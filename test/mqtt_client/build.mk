@@ -0,0 +1,8 @@
+# mqtt 客户端收包: 超长报文丢弃后的状态和应答, CONNACK 半包超时
+TESTS += mqtt_client
+mqtt_client_SRC = test/mqtt_client/mqtt_client_test.cpp \
+    board/neutron/src/lib_mqttclient.cpp board/neutron/src/lib_tcpclient.cpp \
+    board/neutron/src/wiring_print.cpp board/neutron/src/wiring_ipaddress.cpp \
+    board/neutron/src/wiring_string.cpp board/neutron/src/wiring_stream.cpp \
+    board/neutron/src/wiring_usbserial.cpp board/gcc/src/wiring_usbserial_hal.cpp \
+    board/gcc/src/cmsis_os.cpp
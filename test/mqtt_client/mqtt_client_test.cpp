@@ -0,0 +1,232 @@
+/**
+ ******************************************************************************
+ * @file     : mqtt_client_test.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : mqtt 客户端收包状态机测试
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+/*
+  TcpClient 的 hal 接口换成内存中的收发缓冲, 时间由测试推进
+  检查超出缓冲区的包丢弃后收包状态机回到包头, qos1/qos2 仍然应答,
+  以及 connect() 等待 CONNACK 时半包超时立即返回
+*/
+#include <string>
+
+#include "application.h"
+#include "lib_tcpclient_hal.h"
+#include "host_test.h"
+
+/*=======板级接口=========================================================*/
+static system_tick_t fake_ms = 100000;
+static std::string rx;      // 服务器 -> 设备
+static std::string tx;      // 设备 -> 服务器
+static bool link_up;
+
+system_tick_t millis(void) { return fake_ms; }
+void delay(unsigned long ms) { fake_ms += ms ? ms : 1; }
+u32 timerGetId(void) { return fake_ms; }
+bool timerIsEnd(u32 timerID, u32 time) { return (fake_ms - timerID) >= time; }
+
+unsigned char TcpClient_open_hal() { return 0; }
+int TcpClient_connect_hal(const char *host, uint16_t port,unsigned char handle) { link_up = true; return MO_SUCCESS; }
+unsigned char TcpClient_close_hal(unsigned char handle) { link_up = false; return 0; }
+void TcpClient_stop_hal(unsigned char handle) { link_up = false; }
+unsigned char TcpClient_connected_hal(unsigned char handle) { return link_up; }
+int TcpClient_available_hal(unsigned char handle) { return rx.size(); }
+int TcpClient_lost_hal(unsigned char handle) { return 0; }
+int mo_TcpClient_peek_hal(unsigned char *p_dat) { return 0; }
+
+int TcpClient_readn_hal(unsigned char *buff, int size,unsigned char tcp_handle)
+{
+    int n = size < (int)rx.size() ? size : rx.size();
+
+    memcpy(buff, rx.data(), n);
+    rx.erase(0, n);
+    return n;
+}
+
+int TcpClient_writen_hal(const unsigned char *p_dat,int len,unsigned char handle)
+{
+    tx.append((const char *)p_dat, len);
+    return len;
+}
+
+/*=======报文===============================================================*/
+static std::string remaining_length(uint32_t len)
+{
+    std::string s;
+
+    do
+    {
+        uint8_t d = len % 128;
+
+        len /= 128;
+        s += (char)(len ? (d | 128) : d);
+    }while(len);
+    return s;
+}
+
+static std::string publish(const std::string &topic, const std::string &payload, uint8_t qos, uint16_t msgId)
+{
+    std::string body;
+
+    body += (char)(topic.size() >> 8);
+    body += (char)(topic.size() & 0xff);
+    body += topic;
+    if(qos)
+    {
+        body += (char)(msgId >> 8);
+        body += (char)(msgId & 0xff);
+    }
+    body += payload;
+    return (char)(MQTTPUBLISH | (qos << 1)) + remaining_length(body.size()) + body;
+}
+
+static std::string ack(uint8_t type, uint16_t msgId)
+{
+    std::string s;
+
+    s += (char)type;
+    s += (char)2;
+    s += (char)(msgId >> 8);
+    s += (char)(msgId & 0xff);
+    return s;
+}
+
+static std::string got_topic, got_payload;
+static int got_count;
+
+static void on_publish(char *topic, uint8_t *payload, uint32_t length)
+{
+    got_topic = topic;
+    got_payload.assign((const char *)payload, length);
+    got_count++;
+}
+
+static uint8_t server_ip[4] = {127, 0, 0, 1};
+static TcpClient tcp;
+static MqttClientClass mqtt(server_ip, 1883, on_publish, tcp);
+
+static bool mqtt_connect(void)
+{
+    static const char connack[] = {0x20, 2, 0, 0};
+
+    tcp.stop();
+    rx.assign(connack, sizeof(connack));
+    tx.clear();
+    return mqtt.connect("test");
+}
+
+static void run_loop(int times)
+{
+    while(times--)
+    {
+        mqtt.loop();
+        fake_ms += 10;
+    }
+}
+
+/*=======测试===============================================================*/
+static void test_oversize_dropped(uint8_t qos, uint8_t ack_type)
+{
+    std::string big(MQTT_MAX_PACKET_SIZE * 3, 'x');
+    std::string expect_ack = ack(ack_type, 0x1234);
+
+    TEST_CHECK(mqtt_connect());
+    tx.clear();
+    got_count = 0;
+
+    // 放不下的消息之后紧跟一个正常的消息, 必须能正常收到
+    rx = publish("big", big, qos, 0x1234) + publish("small", "hello", 0, 0);
+    run_loop(5);
+    TEST_CHECK_EQ(got_count, 1);
+    TEST_CHECK(got_topic == "small");
+    TEST_CHECK(got_payload == "hello");
+    TEST_CHECK(mqtt.connected());
+    if(ack_type)
+    {
+        TEST_CHECK(tx == expect_ack);
+    }
+    else
+    {
+        TEST_CHECK(tx.empty());
+    }
+}
+
+static void test_oversize_long_topic(void)
+{
+    // 主题超过缓冲区时消息id也在缓冲区之外
+    std::string topic(MQTT_MAX_PACKET_SIZE + 10, 't');
+
+    TEST_CHECK(mqtt_connect());
+    tx.clear();
+    got_count = 0;
+    rx = publish(topic, "p", 1, 0xbeef) + publish("small", "x", 0, 0);
+    run_loop(5);
+    TEST_CHECK(tx == ack(MQTTPUBACK, 0xbeef));
+    TEST_CHECK_EQ(got_count, 1);
+}
+
+static void test_chunked_arrival(void)
+{
+    // 包数据分多次到达时状态保留到下次 loop()
+    std::string data = publish("big", std::string(1000, 'y'), 1, 7) + publish("a/b", "12345", 1, 8);
+    size_t pos;
+
+    TEST_CHECK(mqtt_connect());
+    tx.clear();
+    got_count = 0;
+    for(pos = 0; pos < data.size(); pos += 13)
+    {
+        rx += data.substr(pos, 13);
+        run_loop(1);
+    }
+    run_loop(2);
+    TEST_CHECK_EQ(got_count, 1);
+    TEST_CHECK(got_payload == "12345");
+    TEST_CHECK(tx == ack(MQTTPUBACK, 7) + ack(MQTTPUBACK, 8));
+}
+
+static void test_connect_half_connack(void)
+{
+    // CONNACK 只收到一半: 半包超时后 connect() 立即返回, 不等到 keepalive
+    system_tick_t start;
+
+    tcp.stop();
+    mqtt.setPacketTimeout(200);
+    rx = std::string(1, (char)0x20);
+    start = fake_ms;
+    TEST_CHECK(!mqtt.connect("test"));
+    TEST_CHECK(fake_ms - start < 1000);
+    TEST_CHECK(!link_up);
+    mqtt.setPacketTimeout(MQTT_PACKET_TIMEOUT);
+}
+
+int main(int argc, char *argv[])
+{
+    test_oversize_dropped(0, 0);
+    test_oversize_dropped(1, MQTTPUBACK);
+    test_oversize_dropped(2, MQTTPUBREC);
+    test_oversize_long_topic();
+    test_chunked_arrival();
+    test_connect_half_connack();
+
+    return TEST_DONE();
+}
@@ -0,0 +1,10 @@
+# mqtt 客户端 qos1/qos2 发送: qos位和消息id, DUP 重发, PUBREC/PUBREL/PUBCOMP, 重发表满, 不申请内存
+TESTS += mqtt_qos
+mqtt_qos_SRC = test/mqtt_qos/mqtt_qos_test.cpp \
+    board/neutron/src/lib_mqttclient.cpp board/neutron/src/lib_tcpclient.cpp \
+    board/neutron/src/wiring_print.cpp board/neutron/src/wiring_ipaddress.cpp \
+    board/neutron/src/wiring_string.cpp board/neutron/src/wiring_stream.cpp \
+    board/neutron/src/wiring_usbserial.cpp board/gcc/src/wiring_usbserial_hal.cpp \
+    board/gcc/src/cmsis_os.cpp
+mqtt_qos_LDFLAGS = -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=_Znwm,--wrap=_Znam
+mqtt_qos_ARGS = 70000
@@ -0,0 +1,464 @@
+/**
+ ******************************************************************************
+ * @file     : mqtt_qos_test.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : mqtt 客户端 qos1/qos2 发送和重发表测试
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+/*
+  TcpClient 的 hal 接口换成内存中的收发缓冲, 服务器的应答由测试给出, 时间由测试推进
+  检查 qos 位和消息id, 超过 MQTT_RETRY_INTERVAL 未确认时带 DUP 重发, 重发次数用完后丢弃,
+  qos2 的 PUBREC->PUBREL->PUBCOMP, 重发表满时拒绝, 重连后重发, 以及发送路径上不申请内存
+  参数: 消息id回绕测试的发送次数
+*/
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "application.h"
+#include "lib_tcpclient_hal.h"
+#include "host_test.h"
+
+/*=======内存申请计数 (链接时 --wrap)=========================================*/
+static bool alloc_watch;        // 只统计被测代码中的申请, 测试自己的 std::string 不算
+static int alloc_count;
+
+extern "C" void *__real_malloc(size_t size);
+extern "C" void *__real_calloc(size_t n, size_t size);
+extern "C" void *__real_realloc(void *p, size_t size);
+extern "C" void *__real__Znwm(size_t size);
+extern "C" void *__real__Znam(size_t size);
+
+extern "C" void *__wrap_malloc(size_t size) { alloc_count += alloc_watch; return __real_malloc(size); }
+extern "C" void *__wrap_calloc(size_t n, size_t size) { alloc_count += alloc_watch; return __real_calloc(n, size); }
+extern "C" void *__wrap_realloc(void *p, size_t size) { alloc_count += alloc_watch; return __real_realloc(p, size); }
+extern "C" void *__wrap__Znwm(size_t size) { alloc_count += alloc_watch; return __real__Znwm(size); }
+extern "C" void *__wrap__Znam(size_t size) { alloc_count += alloc_watch; return __real__Znam(size); }
+
+/*=======板级接口=========================================================*/
+static system_tick_t fake_ms = 100000;
+static std::string rx;      // 服务器 -> 设备
+static std::string tx;      // 设备 -> 服务器
+static bool link_up;
+
+system_tick_t millis(void) { return fake_ms; }
+void delay(unsigned long ms) { fake_ms += ms ? ms : 1; }
+u32 timerGetId(void) { return fake_ms; }
+bool timerIsEnd(u32 timerID, u32 time) { return (fake_ms - timerID) >= time; }
+
+unsigned char TcpClient_open_hal() { return 0; }
+int TcpClient_connect_hal(const char *host, uint16_t port,unsigned char handle) { link_up = true; return MO_SUCCESS; }
+unsigned char TcpClient_close_hal(unsigned char handle) { link_up = false; return 0; }
+void TcpClient_stop_hal(unsigned char handle) { link_up = false; }
+unsigned char TcpClient_connected_hal(unsigned char handle) { return link_up; }
+int TcpClient_available_hal(unsigned char handle) { return rx.size(); }
+int TcpClient_lost_hal(unsigned char handle) { return 0; }
+int mo_TcpClient_peek_hal(unsigned char *p_dat) { return 0; }
+
+int TcpClient_readn_hal(unsigned char *buff, int size,unsigned char tcp_handle)
+{
+    int n = size < (int)rx.size() ? size : rx.size();
+
+    memcpy(buff, rx.data(), n);
+    rx.erase(0, n);
+    return n;
+}
+
+int TcpClient_writen_hal(const unsigned char *p_dat,int len,unsigned char handle)
+{
+    tx.append((const char *)p_dat, len);
+    return len;
+}
+
+/*=======报文===============================================================*/
+typedef struct
+{
+    uint8_t header;
+    std::string topic;
+    uint16_t msgId;
+    std::string payload;
+} packet_t;
+
+static std::string ack(uint8_t type, uint16_t msgId)
+{
+    std::string s;
+
+    s += (char)type;
+    s += (char)2;
+    s += (char)(msgId >> 8);
+    s += (char)(msgId & 0xff);
+    return s;
+}
+
+// 取出设备发出的全部报文, PINGREQ 直接应答
+static std::vector<packet_t> sent(void)
+{
+    std::vector<packet_t> out;
+    size_t pos = 0;
+
+    while(pos < tx.size())
+    {
+        packet_t p;
+        uint32_t len = 0, multiplier = 1;
+        uint8_t d;
+
+        p.header = tx[pos++];
+        do
+        {
+            d = tx[pos++];
+            len += (d & 127) * multiplier;
+            multiplier *= 128;
+        }while(d & 128);
+
+        std::string body = tx.substr(pos, len);
+        pos += len;
+        p.msgId = 0;
+        if((p.header & 0xf0) == MQTTPINGREQ)
+        {
+            rx += std::string("\xd0\x00", 2);
+            continue;
+        }
+        if((p.header & 0xf0) == MQTTPUBLISH)
+        {
+            uint16_t tl = ((uint8_t)body[0] << 8) | (uint8_t)body[1];
+
+            p.topic = body.substr(2, tl);
+            body.erase(0, 2 + tl);
+            if(!(p.header & 0x06))
+            {
+                p.payload = body;
+                out.push_back(p);
+                continue;
+            }
+        }
+        if(body.size() >= 2)
+        {
+            p.msgId = ((uint8_t)body[0] << 8) | (uint8_t)body[1];
+            p.payload = body.substr(2);
+        }
+        out.push_back(p);
+    }
+    tx.clear();
+    return out;
+}
+
+static void on_publish(char *topic, uint8_t *payload, uint32_t length)
+{
+}
+
+static uint8_t server_ip[4] = {127, 0, 0, 1};
+static TcpClient tcp;
+static MqttClientClass mqtt(server_ip, 1883, on_publish, tcp);
+
+static bool mqtt_connect(void)
+{
+    static const char connack[] = {0x20, 2, 0, 0};
+
+    tcp.stop();
+    rx.assign(connack, sizeof(connack));
+    tx.clear();
+    if(!mqtt.connect("test"))
+    {
+        return false;
+    }
+    tx.clear();
+    return true;
+}
+
+// 推进 ms 毫秒, 每 10ms 调用一次 loop()
+static void run_for(system_tick_t ms)
+{
+    system_tick_t end = fake_ms + ms;
+
+    alloc_watch = true;
+    while((int32_t)(fake_ms - end) < 0)
+    {
+        mqtt.loop();
+        fake_ms += 10;
+    }
+    mqtt.loop();
+    alloc_watch = false;
+}
+
+static uint8_t publish(const char *topic, const char *payload, uint8_t qos, uint8_t retained)
+{
+    uint8_t rc;
+
+    alloc_watch = true;
+    rc = mqtt.publish(topic, (uint8_t *)payload, strlen(payload), qos, retained);
+    alloc_watch = false;
+    return rc;
+}
+
+/*=======测试===============================================================*/
+static void test_qos1(void)
+{
+    // qos 位, 消息id, PUBACK 之后释放; 未知id的 PUBACK 不影响重发表
+    std::vector<packet_t> p;
+
+    TEST_CHECK(mqtt_connect());
+    TEST_CHECK(publish("a/b", "hello", 1, 0));
+    TEST_CHECK(publish("a/c", "world", 1, 1));
+    p = sent();
+    TEST_CHECK_EQ(p.size(), 2);
+    TEST_CHECK_EQ(p[0].header, MQTTPUBLISH | MQTTQOS1);
+    TEST_CHECK_EQ(p[1].header, MQTTPUBLISH | MQTTQOS1 | 1);
+    TEST_CHECK(p[0].topic == "a/b" && p[0].payload == "hello");
+    TEST_CHECK(p[0].msgId != 0 && p[1].msgId != 0 && p[0].msgId != p[1].msgId);
+    TEST_CHECK_EQ(mqtt.inflightCount(), 2);
+
+    rx = ack(MQTTPUBACK, p[0].msgId + 100) + ack(MQTTPUBACK, p[1].msgId);
+    run_for(20);
+    TEST_CHECK_EQ(mqtt.inflightCount(), 1);
+    rx = ack(MQTTPUBACK, p[0].msgId);
+    run_for(20);
+    TEST_CHECK_EQ(mqtt.inflightCount(), 0);
+    TEST_CHECK_EQ(mqtt.sessionStats()->acked, 2);
+    TEST_CHECK(sent().empty());
+
+    // qos0 没有消息id, 不进重发表
+    TEST_CHECK(publish("a/d", "x", 0, 0));
+    p = sent();
+    TEST_CHECK(p.size() == 1 && p[0].header == MQTTPUBLISH && p[0].payload == "x");
+    TEST_CHECK_EQ(mqtt.inflightCount(), 0);
+}
+
+static void test_retransmit(void)
+{
+    // 超过 MQTT_RETRY_INTERVAL 未确认时带 DUP 原样重发, 重发 MQTT_MAX_RETRIES 次后丢弃
+    std::vector<packet_t> p, r;
+    int resent = 0, bad = 0;
+
+    TEST_CHECK(mqtt_connect());
+    TEST_CHECK(publish("r/1", "again", 1, 1));
+    p = sent();
+    TEST_CHECK_EQ(p.size(), 1);
+
+    run_for(MQTT_RETRY_INTERVAL - 100);
+    TEST_CHECK(sent().empty());
+    for(int i = 0; i < MQTT_MAX_RETRIES; i++)
+    {
+        run_for(MQTT_RETRY_INTERVAL);
+        r = sent();
+        resent += r.size();
+        for(size_t k = 0; k < r.size(); k++)
+        {
+            bad += (r[k].header != (p[0].header | MQTTDUP)) || (r[k].msgId != p[0].msgId) ||
+                   (r[k].topic != p[0].topic) || (r[k].payload != p[0].payload);
+        }
+    }
+    TEST_CHECK_EQ(resent, MQTT_MAX_RETRIES);
+    TEST_CHECK_EQ(bad, 0);
+    TEST_CHECK_EQ(mqtt.sessionStats()->retransmitted, MQTT_MAX_RETRIES);
+    TEST_CHECK_EQ(mqtt.inflightCount(), 1);
+
+    run_for(MQTT_RETRY_INTERVAL);
+    TEST_CHECK(sent().empty());
+    TEST_CHECK_EQ(mqtt.inflightCount(), 0);
+    TEST_CHECK_EQ(mqtt.sessionStats()->dropped, 1);
+
+    // 重发之后收到确认不再重发
+    TEST_CHECK(publish("r/2", "once", 1, 0));
+    p = sent();
+    run_for(MQTT_RETRY_INTERVAL + 100);
+    TEST_CHECK_EQ(sent().size(), 1);
+    rx = ack(MQTTPUBACK, p[0].msgId);
+    run_for(MQTT_RETRY_INTERVAL * 2);
+    TEST_CHECK(sent().empty());
+    TEST_CHECK_EQ(mqtt.inflightCount(), 0);
+}
+
+static void test_qos2(void)
+{
+    // PUBREC 之后回 PUBREL, 等 PUBCOMP; PUBREL 超时重发, 重复的 PUBREC 也回 PUBREL
+    std::vector<packet_t> p, r;
+
+    TEST_CHECK(mqtt_connect());
+    TEST_CHECK(publish("q/2", "exactly", 2, 0));
+    p = sent();
+    TEST_CHECK(p.size() == 1 && p[0].header == (MQTTPUBLISH | MQTTQOS2) && p[0].msgId != 0);
+
+    // qos2 的消息不接受 PUBACK
+    rx = ack(MQTTPUBACK, p[0].msgId);
+    run_for(20);
+    TEST_CHECK_EQ(mqtt.inflightCount(), 1);
+
+    rx = ack(MQTTPUBREC, p[0].msgId);
+    run_for(20);
+    r = sent();
+    TEST_CHECK(r.size() == 1 && r[0].header == (MQTTPUBREL | MQTTQOS1) && r[0].msgId == p[0].msgId);
+
+    // PUBREL 之后不再重发 PUBLISH, 只重发 PUBREL
+    run_for(MQTT_RETRY_INTERVAL + 100);
+    r = sent();
+    TEST_CHECK(r.size() == 1 && r[0].header == (MQTTPUBREL | MQTTQOS1) && r[0].msgId == p[0].msgId);
+
+    rx = ack(MQTTPUBREC, p[0].msgId);
+    run_for(20);
+    r = sent();
+    TEST_CHECK(r.size() == 1 && r[0].header == (MQTTPUBREL | MQTTQOS1));
+    TEST_CHECK_EQ(mqtt.inflightCount(), 1);
+
+    rx = ack(MQTTPUBCOMP, p[0].msgId);
+    run_for(20);
+    TEST_CHECK_EQ(mqtt.inflightCount(), 0);
+    TEST_CHECK_EQ(mqtt.sessionStats()->acked, 1);
+    run_for(MQTT_RETRY_INTERVAL * 2);
+    TEST_CHECK(sent().empty());
+
+    // 收到的 qos2 消息: PUBREL 回 PUBCOMP
+    rx = ack(MQTTPUBREL | MQTTQOS1, 0x4321);
+    run_for(20);
+    TEST_CHECK(tx == ack(MQTTPUBCOMP, 0x4321));
+    tx.clear();
+}
+
+static void test_table_full(void)
+{
+    // 重发表满时 qos1/qos2 拒绝且不发送, qos0 不受影响; 释放一个之后可以再发, 消息id不重复
+    std::vector<packet_t> p;
+    uint16_t ids[MQTT_MAX_INFLIGHT];
+    int dup = 0;
+
+    TEST_CHECK(mqtt_connect());
+    for(int i = 0; i < MQTT_MAX_INFLIGHT; i++)
+    {
+        TEST_CHECK(publish("f", "n", 1 + (i & 1), 0));
+    }
+    p = sent();
+    TEST_CHECK_EQ(p.size(), MQTT_MAX_INFLIGHT);
+    for(int i = 0; i < MQTT_MAX_INFLIGHT; i++)
+    {
+        ids[i] = p[i].msgId;
+    }
+    TEST_CHECK(!publish("f", "full", 1, 0));
+    TEST_CHECK(!publish("f", "full", 2, 0));
+    TEST_CHECK(sent().empty());
+    TEST_CHECK_EQ(mqtt.sessionStats()->rejected, 2);
+    TEST_CHECK(publish("f", "qos0", 0, 0));
+    TEST_CHECK_EQ(sent().size(), 1);
+
+    rx = ack(MQTTPUBACK, ids[0]);
+    run_for(20);
+    TEST_CHECK(publish("f", "more", 1, 0));
+    p = sent();
+    TEST_CHECK_EQ(p.size(), 1);
+    for(int i = 1; i < MQTT_MAX_INFLIGHT; i++)
+    {
+        dup += (p[0].msgId == ids[i]);
+    }
+    TEST_CHECK_EQ(dup, 0);
+    TEST_CHECK_EQ(mqtt.inflightCount(), MQTT_MAX_INFLIGHT);
+
+    // 放不进缓冲区的消息被拒绝, 不占用重发表
+    std::string big(MQTT_MAX_PACKET_SIZE, 'b');
+    rx = ack(MQTTPUBACK, p[0].msgId);
+    run_for(20);
+    TEST_CHECK(!publish("f", big.c_str(), 1, 0));
+    TEST_CHECK_EQ(mqtt.inflightCount(), MQTT_MAX_INFLIGHT - 1);
+    TEST_CHECK(sent().empty());
+}
+
+static void test_reconnect(void)
+{
+    // 重连之后未确认的消息在 CONNACK 之后立即带 DUP 重发
+    std::vector<packet_t> p, r;
+
+    TEST_CHECK(mqtt_connect());
+    TEST_CHECK_EQ(mqtt.inflightCount(), MQTT_MAX_INFLIGHT - 1);
+    p = sent();
+    link_up = false;
+    run_for(6000);       // TcpClient 每 5s 查询一次连接状态
+    TEST_CHECK(!mqtt.connected());
+    TEST_CHECK(mqtt_connect());
+    run_for(20);
+    r = sent();
+    TEST_CHECK_EQ(r.size(), MQTT_MAX_INFLIGHT - 1);
+    for(size_t i = 0; i < r.size(); i++)
+    {
+        TEST_CHECK(r[i].header & MQTTDUP);
+        rx += ack(((r[i].header & 0x06) == MQTTQOS1) ? MQTTPUBACK : MQTTPUBREC, r[i].msgId);
+    }
+    run_for(20);
+    for(packet_t &x : sent())
+    {
+        rx += ack(MQTTPUBCOMP, x.msgId);
+    }
+    run_for(20);
+    TEST_CHECK_EQ(mqtt.inflightCount(), 0);
+}
+
+static void test_msgid_wrap(int count)
+{
+    // 一个消息一直不确认, 其他消息的id回绕时跳过 0 和这个id
+    std::vector<packet_t> p;
+    uint16_t held;
+    int bad = 0;
+
+    TEST_CHECK(mqtt_connect());
+    TEST_CHECK(publish("w", "held", 2, 0));
+    p = sent();
+    TEST_CHECK_EQ(p.size(), 1);
+    if(p.empty())
+    {
+        return;
+    }
+    held = p[0].msgId;
+    for(int i = 0; i < count; i++)
+    {
+        if(!publish("w", "x", 1, 0))
+        {
+            bad++;
+            continue;
+        }
+        p = sent();
+        bad += (p.size() != 1) || (p[0].msgId == 0) || (p[0].msgId == held);
+        rx = ack(MQTTPUBACK, p[0].msgId);
+        run_for(0);
+    }
+    TEST_CHECK_EQ(bad, 0);
+    TEST_CHECK_EQ(mqtt.inflightCount(), 1);
+    rx = ack(MQTTPUBREC, held);
+    run_for(20);
+    sent();
+    rx = ack(MQTTPUBCOMP, held);
+    run_for(20);
+    TEST_CHECK_EQ(mqtt.inflightCount(), 0);
+}
+
+int main(int argc, char *argv[])
+{
+    int count = (argc > 1) ? atoi(argv[1]) : 70000;
+
+    TEST_CHECK(mqtt_connect());
+    alloc_count = 0;
+
+    test_qos1();
+    test_retransmit();
+    test_qos2();
+    test_table_full();
+    test_reconnect();
+    test_msgid_wrap(count);
+
+    // 以上 publish() 和 loop() 中的发送, 应答和重发都不申请内存
+    TEST_CHECK_EQ(alloc_count, 0);
+
+    return TEST_DONE();
+}
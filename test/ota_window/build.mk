@@ -0,0 +1,5 @@
+# 滑动窗口固件传输: 发送方与接收方对接, 丢包 重复 乱序 损坏, 最终镜像和CRC32, 拒绝 超时 写入失败
+TESTS += ota_window
+ota_window_SRC = test/ota_window/ota_window_test.cpp platform/MCU/shared/ota/src/lib_ota_window.c \
+    platform/MCU/shared/crc/src/lib_crc.c
+ota_window_ARGS = 300
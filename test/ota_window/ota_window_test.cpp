@@ -0,0 +1,379 @@
+/**
+ ******************************************************************************
+ * @file     : ota_window_test.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : 滑动窗口固件传输测试
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+/*
+  发送方(esp8266 at_ex_command.c 的发送定时器)和接收方(bootloader ESP8266_Firmware_Window)
+  在模拟时间(ms)中对接: 数据帧和确认各自可以丢失, 重复, 乱序(额外延迟), 损坏(任意一位翻转),
+  数据帧按随机大小分段交给接收方. 结束时检查接收方写入的镜像和CRC32与原固件一致
+  参数: 随机链路的测试次数
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "lib_ota_window.h"
+#include "lib_crc.h"
+#include "host_test.h"
+
+typedef std::vector<uint8_t> bytes_t;
+
+//链路参数, 概率以 1/1000 为单位
+typedef struct
+{
+    uint32_t drop;
+    uint32_t duplicate;
+    uint32_t reorder;
+    uint32_t corrupt;
+    uint32_t ack_drop;
+    uint32_t ack_reorder;
+}link_t;
+
+typedef struct
+{
+    ota_sender_t tx;
+    ota_receiver_t rx;
+    bytes_t image;              //原固件, 整包
+    bytes_t flash;              //接收方写入的结果
+    bytes_t packet;             //接收方包缓冲
+    uint32_t packet_size;
+    uint32_t writes;
+    int32_t write_fail;         //写入该包时失败, -1 不失败
+    int dead;                   //发送方不发送任何数据
+    int reject;                 //发送方回复 ERROR
+    link_t link;
+    uint32_t now;
+    std::multimap<uint32_t, bytes_t> frames;        //到达时间 -> 数据帧
+    std::multimap<uint32_t, std::string> acks;      //到达时间 -> 确认
+    uint32_t sent;
+    uint32_t lost;
+}sim_t;
+
+static int chance(uint32_t permille)
+{
+    return (test_rand() % 1000) < permille;
+}
+
+static uint32_t delay(uint32_t reorder)
+{
+    // 固定 2ms 的延迟, 乱序的帧额外延迟 1~50ms
+    return 2 + (chance(reorder) ? 1 + test_rand() % 50 : 0);
+}
+
+/*=======接收方回调===========================================================*/
+static int sim_write(void *arg, uint32_t index, const uint8_t *data, uint32_t len)
+{
+    sim_t *sim = (sim_t *)arg;
+
+    if((int32_t)index == sim->write_fail)
+    {
+        return -1;
+    }
+    memcpy(&sim->flash[index * sim->packet_size], data, len);
+    sim->writes++;
+    return 0;
+}
+
+static void sim_send(void *arg, const char *data, uint32_t len)
+{
+    sim_t *sim = (sim_t *)arg;
+
+    if(chance(sim->link.ack_drop))
+    {
+        return;
+    }
+    sim->acks.insert(std::make_pair(sim->now + delay(sim->link.ack_reorder), std::string(data, len)));
+}
+
+/*=======发送方===============================================================*/
+// at_getfileall_send: 帧头+数据+CRC32+\r\n
+static void sim_send_frame(sim_t *sim, uint32_t index)
+{
+    char head[48];
+    const uint8_t *data = &sim->image[index * sim->packet_size];
+    uint32_t crc = ota_window_crc(index, data, sim->packet_size);
+    uint32_t n = ota_window_frame_head(head, sim->tx.packet_count, index, sim->packet_size + OTA_WINDOW_CRC_SIZE);
+    bytes_t frame(head, head + n);
+
+    frame.insert(frame.end(), data, data + sim->packet_size);
+    for(int i = 0; i < 4; i++)
+    {
+        frame.push_back((uint8_t)(crc >> (8 * i)));
+    }
+    frame.push_back('\r');
+    frame.push_back('\n');
+
+    sim->sent++;
+    if(chance(sim->link.drop))
+    {
+        sim->lost++;
+        return;
+    }
+    if(chance(sim->link.corrupt))
+    {
+        frame[test_rand() % frame.size()] ^= 1 << (test_rand() % 8);
+    }
+    sim->frames.insert(std::make_pair(sim->now + delay(sim->link.reorder), frame));
+    if(chance(sim->link.duplicate))
+    {
+        sim->frames.insert(std::make_pair(sim->now + delay(sim->link.reorder), frame));
+    }
+}
+
+// at_setupCmdFileAck
+static void sim_ack(sim_t *sim, const std::string &ack)
+{
+    int base, nack;
+
+    TEST_CHECK(ack.compare(0, strlen(OTA_WINDOW_ACK), OTA_WINDOW_ACK) == 0);
+    TEST_CHECK(ack.size() > 2 && ack.compare(ack.size() - 2, 2, "\r\n") == 0);
+    if(sscanf(ack.c_str() + strlen(OTA_WINDOW_ACK), "%d,%d", &base, &nack) == 2)
+    {
+        ota_sender_ack(&sim->tx, base, nack, sim->now);
+    }
+}
+
+/*
+  运行到接收方结束, 之后再运行到发送方结束(完成或者没有确认超时)
+  返回接收方状态
+*/
+static ota_rx_status_t run(sim_t *sim, uint32_t packet_size, uint32_t packet_count, uint32_t window)
+{
+    uint32_t next_send = 1, limit;
+    int sending = 1;
+    ota_rx_status_t status;
+
+    sim->packet_size = packet_size;
+    sim->image.resize(packet_size * packet_count);
+    for(uint32_t i = 0; i < sim->image.size(); i++)
+    {
+        sim->image[i] = (uint8_t)test_rand();
+    }
+    sim->flash.assign(sim->image.size(), 0xFF);
+    sim->packet.assign(packet_size + OTA_WINDOW_CRC_SIZE, 0);
+    sim->writes = sim->sent = sim->lost = 0;
+    sim->now = 0;
+    sim->frames.clear();
+    sim->acks.clear();
+
+    ota_receiver_init(&sim->rx, &sim->packet[0], packet_size, packet_count, window, sim_write, sim_send, sim, sim->now);
+    ota_sender_init(&sim->tx, packet_count, window, sim->now);
+    if(sim->reject)
+    {
+        sim->frames.insert(std::make_pair(2u, bytes_t((const uint8_t *)"\r\nERROR\r\n", (const uint8_t *)"\r\nERROR\r\n" + 9)));
+        sending = 0;
+    }
+
+    status = sim->rx.status;
+    limit = 10 * 60 * 1000;
+    for(sim->now = 1; sim->now < limit; sim->now++)
+    {
+        // 确认到达发送方, 发送定时器 1ms 后继续
+        while(!sim->acks.empty() && (sim->acks.begin()->first <= sim->now))
+        {
+            if(sending)
+            {
+                sim_ack(sim, sim->acks.begin()->second);
+                next_send = sim->now + 1;
+            }
+            sim->acks.erase(sim->acks.begin());
+        }
+        if(sending && !sim->dead && (sim->now >= next_send))
+        {
+            if(ota_sender_done(&sim->tx) || ota_sender_expired(&sim->tx, sim->now))
+            {
+                sending = 0;
+            }
+            else
+            {
+                int32_t index = ota_sender_next(&sim->tx);
+                if(index >= 0)
+                {
+                    TEST_CHECK(index < (int32_t)packet_count);
+                    sim_send_frame(sim, index);
+                    next_send = sim->now + 1;
+                }
+                else
+                {
+                    next_send = sim->now + 5;
+                }
+            }
+        }
+
+        // 数据帧分段到达接收方
+        while((OTA_RX_RUNNING == status) && !sim->frames.empty() && (sim->frames.begin()->first <= sim->now))
+        {
+            const bytes_t &frame = sim->frames.begin()->second;
+            for(uint32_t pos = 0; (pos < frame.size()) && (OTA_RX_RUNNING == status);)
+            {
+                uint32_t n = 1 + test_rand() % 64;
+                if(n > frame.size() - pos)
+                {
+                    n = frame.size() - pos;
+                }
+                status = ota_receiver_input(&sim->rx, &frame[pos], n, sim->now);
+                pos += n;
+            }
+            sim->frames.erase(sim->frames.begin());
+        }
+        if(OTA_RX_RUNNING == status)
+        {
+            status = ota_receiver_poll(&sim->rx, sim->now);
+        }
+        if((OTA_RX_RUNNING != status) && (!sending || sim->dead) && sim->acks.empty())
+        {
+            break;
+        }
+    }
+    TEST_CHECK(sim->now < limit);
+    return status;
+}
+
+static void check_image(sim_t *sim)
+{
+    TEST_CHECK_EQ(sim->writes, sim->tx.packet_count);
+    TEST_CHECK(sim->flash == sim->image);
+    TEST_CHECK_EQ(crc32_update(CRC32_INIT, &sim->flash[0], sim->flash.size()),
+                  crc32_update(CRC32_INIT, &sim->image[0], sim->image.size()));
+}
+
+static void sim_reset(sim_t *sim)
+{
+    memset(&sim->link, 0, sizeof(sim->link));
+    sim->write_fail = -1;
+    sim->dead = 0;
+    sim->reject = 0;
+}
+
+/*=======测试===============================================================*/
+static void test_clean(void)
+{
+    // 无损链路: 每包只发一次, 没有重发请求和超时, 发送方也完成
+    sim_t sim;
+
+    test_srand(18);
+    sim_reset(&sim);
+    TEST_CHECK_EQ(run(&sim, 1024, 200, 8), OTA_RX_DONE);
+    check_image(&sim);
+    TEST_CHECK_EQ(sim.sent, 200);
+    TEST_CHECK_EQ(sim.rx.nacks, 0);
+    TEST_CHECK_EQ(sim.rx.timeouts, 0);
+    TEST_CHECK_EQ(sim.rx.duplicates, 0);
+    TEST_CHECK(ota_sender_done(&sim.tx));
+
+    // 窗口为1即停等; 只有一个包
+    TEST_CHECK_EQ(run(&sim, 256, 20, 1), OTA_RX_DONE);
+    check_image(&sim);
+    TEST_CHECK_EQ(run(&sim, 4, 1, 32), OTA_RX_DONE);
+    check_image(&sim);
+}
+
+static void test_lossy(int count)
+{
+    // 随机的链路损伤, 包大小, 个数和窗口
+    sim_t sim;
+    uint32_t sent = 0, lost = 0, nacks = 0, timeouts = 0, crc_errors = 0, duplicates = 0;
+    int done = 0;
+
+    test_srand(19);
+    for(int i = 0; i < count; i++)
+    {
+        sim_reset(&sim);
+        sim.link.drop = test_rand() % 200;
+        sim.link.duplicate = test_rand() % 200;
+        sim.link.reorder = test_rand() % 300;
+        sim.link.corrupt = test_rand() % 200;
+        sim.link.ack_drop = test_rand() % 300;
+        sim.link.ack_reorder = test_rand() % 300;
+        uint32_t packet_size = 4 * (1 + test_rand() % 256);
+        uint32_t packet_count = 1 + test_rand() % 150;
+        uint32_t window = 1 + test_rand() % OTA_WINDOW_MAX;
+
+        ota_rx_status_t status = run(&sim, packet_size, packet_count, window);
+        TEST_CHECK_EQ(status, OTA_RX_DONE);
+        if(OTA_RX_DONE != status)
+        {
+            printf("run %d: size %u count %u window %u, base %u\n", i, (unsigned)packet_size,
+                   (unsigned)packet_count, (unsigned)window, (unsigned)sim.rx.base);
+            continue;
+        }
+        check_image(&sim);
+        done++;
+        sent += sim.sent;
+        lost += sim.lost;
+        nacks += sim.rx.nacks;
+        timeouts += sim.rx.timeouts;
+        crc_errors += sim.rx.crc_errors;
+        duplicates += sim.rx.duplicates;
+    }
+    TEST_CHECK_EQ(done, count);
+    TEST_CHECK(lost > 0);
+    TEST_CHECK(crc_errors > 0);
+    TEST_CHECK(duplicates > 0);
+    printf("%d transfers: %u frames sent, %u lost, %u crc errors, %u duplicates, %u nacks, %u timeouts\n",
+           count, (unsigned)sent, (unsigned)lost, (unsigned)crc_errors, (unsigned)duplicates,
+           (unsigned)nacks, (unsigned)timeouts);
+}
+
+static void test_errors(void)
+{
+    sim_t sim;
+
+    test_srand(20);
+
+    // 发送方不支持 AT+GETFILEALL
+    sim_reset(&sim);
+    sim.reject = 1;
+    TEST_CHECK_EQ(run(&sim, 256, 10, 8), OTA_RX_REJECTED);
+    TEST_CHECK_EQ(sim.writes, 0);
+
+    // 没有任何数据: 连续超时 OTA_WINDOW_RETRIES 次后放弃
+    sim_reset(&sim);
+    sim.dead = 1;
+    TEST_CHECK_EQ(run(&sim, 256, 10, 8), OTA_RX_TIMEOUT);
+    TEST_CHECK_EQ(sim.rx.timeouts, OTA_WINDOW_RETRIES + 1);
+    TEST_CHECK(sim.now >= (OTA_WINDOW_RETRIES + 1) * OTA_WINDOW_TIMEOUT);
+
+    // 所有帧都损坏: 连续CRC错误后放弃, 不写入
+    sim_reset(&sim);
+    sim.link.corrupt = 1000;
+    TEST_CHECK_EQ(run(&sim, 256, 50, 8), OTA_RX_TIMEOUT);
+    TEST_CHECK_EQ(sim.writes, 0);
+
+    // 写入失败
+    sim_reset(&sim);
+    sim.write_fail = 7;
+    TEST_CHECK_EQ(run(&sim, 256, 10, 8), OTA_RX_WRITE_ERROR);
+    TEST_CHECK(sim.writes < 10);
+}
+
+int main(int argc, char *argv[])
+{
+    test_clean();
+    test_lossy((argc > 1) ? atoi(argv[1]) : 300);
+    test_errors();
+    return TEST_DONE();
+}
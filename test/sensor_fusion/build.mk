@@ -0,0 +1,3 @@
+# 姿态融合: 回放生成的 IMU 日志与参考姿态比较 (运动/静止漂移/陀螺仪零偏), 欧拉角, 去重力加速度
+TESTS += sensor_fusion
+sensor_fusion_SRC = test/sensor_fusion/sensor_fusion_test.cpp board/neutron/src/sensor_fusion.c
@@ -0,0 +1,314 @@
+/**
+ ******************************************************************************
+ * @file     : sensor_fusion_test.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : 姿态融合回放测试
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+/*
+  按已知的角速度积分出参考姿态, 生成 100Hz 的 IMU 日志 (16g/2000dps 量化, 噪声, 陀螺仪零偏, 磁力计硬磁偏移),
+  回放给 Madgwick 和 Mahony, 比较输出的姿态与参考姿态:
+      运动中 9轴误差和倾角误差, 6轴倾角误差 (航向不可观测)
+      静止 600s 的 9轴误差, 6轴航向漂移
+      陀螺仪零偏下的 9轴误差
+  另外检查欧拉角, 静止时的去重力加速度, 没有重力参考时的陀螺仪积分
+*/
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+
+#include "sensor_fusion.h"
+#include "host_test.h"
+
+#define LOG_ODR         100.0
+#define ACCEL_LSB       2048.0      // 16g
+#define GYRO_LSB        16.4        // 2000dps
+#define MAG_LSB         300.0
+#define DEG             (M_PI / 180)
+
+typedef struct
+{
+    double w, x, y, z;
+} quat_t;
+
+typedef struct
+{
+    int16_t accel[3];
+    int16_t gyro[3];
+    int16_t mag[3];
+    quat_t ref;                 // 这个样本时刻的参考姿态
+} log_entry_t;
+
+typedef std::vector<log_entry_t> imu_log_t;
+
+static const float mag_hard_iron[3] = {40, -25, 10};
+
+static quat_t quat_mul(quat_t a, quat_t b)
+{
+    quat_t r = {a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+                a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+                a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+                a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w};
+    return r;
+}
+
+static quat_t quat_normalize(quat_t a)
+{
+    double n = sqrt(a.w * a.w + a.x * a.x + a.y * a.y + a.z * a.z);
+    quat_t r = {a.w / n, a.x / n, a.y / n, a.z / n};
+    return r;
+}
+
+// 地面坐标系的向量在传感器坐标系中的表示: q* v q
+static void earth_to_body(quat_t q, const double e[3], double b[3])
+{
+    quat_t v = {0, e[0], e[1], e[2]}, c = {q.w, -q.x, -q.y, -q.z};
+    quat_t r = quat_mul(quat_mul(c, v), q);
+
+    b[0] = r.x;
+    b[1] = r.y;
+    b[2] = r.z;
+}
+
+static double gauss(void)
+{
+    double u = (test_rand() + 1.0) / 4294967297.0, v = (test_rand() + 1.0) / 4294967297.0;
+
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static int16_t quantize(double v)
+{
+    v = floor(v + 0.5);
+    return (int16_t)((v > 32767) ? 32767 : ((v < -32768) ? -32768 : v));
+}
+
+// 两个姿态之间的转角, 度
+static double angle_error(quat_t ref, const float q[4])
+{
+    double d = fabs(ref.w * q[0] + ref.x * q[1] + ref.y * q[2] + ref.z * q[3]);
+
+    return 2 * acos((d > 1) ? 1 : d) / DEG;
+}
+
+// 重力方向的误差, 度
+static double tilt_error(quat_t ref, const fusion_t *fusion)
+{
+    const double up[3] = {0, 0, 1};
+    double g[3], d;
+
+    earth_to_body(ref, up, g);
+    d = g[0] * fusion->gravity[0] + g[1] * fusion->gravity[1] + g[2] * fusion->gravity[2];
+    return acos((d > 1) ? 1 : d) / DEG;
+}
+
+static void make_log(imu_log_t &log, double seconds, bool moving, double bias_dps, uint32_t seed)
+{
+    const double dt = 1 / LOG_ODR;
+    const double mag_earth[3] = {cos(50 * DEG), 0, -sin(50 * DEG)};    // 磁倾角 50 度
+    const double bias[3] = {bias_dps, -bias_dps * 0.5, bias_dps * 0.7};
+    quat_t q = quat_normalize((quat_t){cos(0.3), sin(0.3) * 0.6, 0, sin(0.3) * 0.8});
+    int n = (int)(seconds * LOG_ODR);
+
+    test_srand(seed);
+    log.resize(n);
+    for(int i = 0; i < n; i++)
+    {
+        double t = i * dt, w[3] = {0, 0, 0}, a[3], m[3];
+        const double up[3] = {0, 0, 1};
+        log_entry_t &e = log[i];
+
+        if(moving)
+        {
+            w[0] = 1.2 * sin(0.7 * t);
+            w[1] = 0.8 * sin(0.45 * t + 1);
+            w[2] = 1.5 * cos(0.3 * t);
+        }
+        // 陀螺仪样本为上一个样本到这个样本之间的角速度, 参考姿态积分 q' = 0.5 q w, 细分步长
+        for(int k = 0; i > 0 && k < 10; k++)
+        {
+            quat_t wq = {0, w[0], w[1], w[2]}, d = quat_mul(q, wq);
+            double h = dt / 10;
+
+            q.w += 0.5 * d.w * h;
+            q.x += 0.5 * d.x * h;
+            q.y += 0.5 * d.y * h;
+            q.z += 0.5 * d.z * h;
+            q = quat_normalize(q);
+        }
+        earth_to_body(q, up, a);
+        earth_to_body(q, mag_earth, m);
+        for(int k = 0; k < 3; k++)
+        {
+            e.accel[k] = quantize(a[k] * ACCEL_LSB + gauss() * 4);
+            e.gyro[k] = quantize((w[k] / DEG + bias[k]) * GYRO_LSB + gauss() * 2);
+            e.mag[k] = quantize(m[k] * MAG_LSB + mag_hard_iron[k] + gauss() * 3);
+        }
+        e.ref = q;
+    }
+}
+
+typedef struct
+{
+    double max_error;           // settle 之后与参考姿态的最大误差
+    double max_tilt;            // settle 之后重力方向的最大误差
+    double drift;               // 结束时相对第一个输出的转角 (静止的 6轴日志即航向漂移)
+} replay_result_t;
+
+static replay_result_t replay(const imu_log_t &log, fusion_algorithm_t algorithm, bool use_mag, double settle,
+                              bool gyro_only = false, double seconds = 1e9)
+{
+    static fusion_t fusion;
+    fusion_calibration_t cal = {{0, 0, 0}, {0, 0, 0}, {mag_hard_iron[0], mag_hard_iron[1], mag_hard_iron[2]}, {1, 1, 1}};
+    replay_result_t r = {0, 0, 0};
+    float first[4];
+
+    fusion_init(&fusion, algorithm, LOG_ODR, 16.0f, 2000.0f);
+    fusion_set_calibration(&fusion, &cal);
+    if(gyro_only)
+    {
+        fusion.beta = 0;        // 不用加速度计和磁力计校正
+        fusion.kp = 0;
+        fusion.ki = 0;
+    }
+    for(size_t i = 0; i < log.size() && i / LOG_ODR < seconds; i++)
+    {
+        fusion_update(&fusion, log[i].accel, log[i].gyro, use_mag ? log[i].mag : NULL);
+        if(i == 0 && gyro_only)
+        {
+            // 初始姿态取参考值, 只看积分误差
+            fusion.q[0] = log[0].ref.w;
+            fusion.q[1] = log[0].ref.x;
+            fusion.q[2] = log[0].ref.y;
+            fusion.q[3] = log[0].ref.z;
+        }
+        if(i == 0)
+        {
+            fusion_get_quaternion(&fusion, first);
+        }
+        if(i / LOG_ODR >= settle)
+        {
+            r.max_error = fmax(r.max_error, angle_error(log[i].ref, fusion.q));
+            r.max_tilt = fmax(r.max_tilt, tilt_error(log[i].ref, &fusion));
+        }
+    }
+    quat_t start = {first[0], first[1], first[2], first[3]};
+    r.drift = angle_error(start, fusion.q);
+    return r;
+}
+
+static imu_log_t move_log, still_log, bias_log;
+
+static void test_replay(void)
+{
+    static const char *names[] = {"madgwick", "mahony"};
+
+    make_log(move_log, 120, true, 0.0, 24);
+    make_log(still_log, 600, false, 0.0, 25);
+    make_log(bias_log, 120, true, 0.3, 26);
+    for(int algorithm = FUSION_MADGWICK; algorithm <= FUSION_MAHONY; algorithm++)
+    {
+        fusion_algorithm_t a = (fusion_algorithm_t)algorithm;
+        replay_result_t r;
+
+        r = replay(move_log, a, true, 5);
+        printf("%s 9-axis moving: max error %.2f deg, tilt %.2f deg\n", names[algorithm], r.max_error, r.max_tilt);
+        TEST_CHECK(r.max_error < 3.0);
+        TEST_CHECK(r.max_tilt < 2.0);
+
+        r = replay(move_log, a, false, 5);
+        printf("%s 6-axis moving: max tilt %.2f deg\n", names[algorithm], r.max_tilt);
+        TEST_CHECK(r.max_tilt < 2.0);
+
+        r = replay(still_log, a, true, 2);
+        printf("%s 9-axis still 600s: max error %.2f deg\n", names[algorithm], r.max_error);
+        TEST_CHECK(r.max_error < 1.0);
+
+        r = replay(still_log, a, false, 0);
+        printf("%s 6-axis still 600s: heading drift %.2f deg, tilt %.2f deg\n", names[algorithm], r.drift, r.max_tilt);
+        TEST_CHECK(r.drift < 1.0);
+        TEST_CHECK(r.max_tilt < 0.5);
+
+        // 从参考姿态开始只积分陀螺仪, 短时间内跟住参考姿态
+        r = replay(move_log, a, true, 0, true, 20);
+        printf("%s gyro only 20s: max error %.2f deg\n", names[algorithm], r.max_error);
+        TEST_CHECK(r.max_error < 1.0);
+
+        r = replay(bias_log, a, true, 10);
+        printf("%s 9-axis 0.3dps bias: max error %.2f deg\n", names[algorithm], r.max_error);
+        TEST_CHECK(r.max_error < 4.0);
+    }
+}
+
+static void test_euler_linear(void)
+{
+    // 静止倾斜: 欧拉角与重力方向一致, 去重力加速度接近0
+    static fusion_t fusion;
+    const int16_t gyro[3] = {0, 0, 0};
+    const double roll = 30 * DEG, pitch = 20 * DEG;
+    int16_t accel[3] = {quantize(-sin(pitch) * ACCEL_LSB), quantize(cos(pitch) * sin(roll) * ACCEL_LSB),
+                        quantize(cos(pitch) * cos(roll) * ACCEL_LSB)};
+    float euler[3], linear[3], q[4];
+
+    fusion_init(&fusion, FUSION_MADGWICK, LOG_ODR, 16.0f, 2000.0f);
+    for(int i = 0; i < 500; i++)
+    {
+        fusion_update(&fusion, accel, gyro, NULL);
+    }
+    fusion_get_euler(&fusion, euler);
+    fusion_get_linear_accel(&fusion, linear);
+    fusion_get_quaternion(&fusion, q);
+    TEST_CHECK(fabs(euler[0] - 30) < 0.1);
+    TEST_CHECK(fabs(euler[1] - 20) < 0.1);
+    TEST_CHECK(fabs(euler[2]) < 0.1);
+    TEST_CHECK(fabs(linear[0]) < 0.005 && fabs(linear[1]) < 0.005 && fabs(linear[2]) < 0.005);
+    TEST_CHECK(fabs(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3] - 1) < 1e-5);
+    TEST_CHECK_EQ(fusion.updates, 500);
+
+    // 加上 0.5g 的 x 方向加速度
+    accel[0] += quantize(0.5 * ACCEL_LSB);
+    fusion_update(&fusion, accel, gyro, NULL);
+    fusion_get_linear_accel(&fusion, linear);
+    TEST_CHECK(fabs(linear[0] - 0.5) < 0.02);
+
+    // 复位之后重新从重力得到初始姿态
+    fusion_reset(&fusion);
+    TEST_CHECK_EQ(fusion.updates, 0);
+
+    // 没有重力参考(自由落体)时只积分陀螺仪: 绕 z 轴 90dps 转 1s
+    const int16_t level[3] = {0, 0, (int16_t)ACCEL_LSB}, zero[3] = {0, 0, 0};
+    const int16_t yaw_rate[3] = {0, 0, quantize(90 * GYRO_LSB)};
+    fusion_update(&fusion, level, gyro, NULL);
+    for(int i = 0; i < LOG_ODR; i++)
+    {
+        fusion_update(&fusion, zero, yaw_rate, NULL);
+    }
+    fusion_get_euler(&fusion, euler);
+    TEST_CHECK(fabs(euler[2] - 90) < 0.5);
+    TEST_CHECK(fabs(euler[0]) < 0.1 && fabs(euler[1]) < 0.1);
+}
+
+int main(void)
+{
+    test_replay();
+    test_euler_linear();
+
+    return TEST_DONE();
+}
@@ -0,0 +1,9 @@
+# 系统参数区: 日志追加保存, 重新加载一致, 任意时刻掉电不丢参数, EEPROM 副本, 旧格式的基础记录
+TESTS += system_params
+system_params_SRC = test/system_params/system_params_test.cpp board/neutron/src/system_params.cpp \
+    board/gcc/src/wiring_flash_memory.cpp platform/MCU/shared/crc/src/lib_crc.c \
+    board/neutron/src/wiring_eeprom.cpp board/gcc/src/wiring_eeprom_hal.cpp \
+    board/gcc/src/cmsis_os.cpp board/neutron/src/wiring_print.cpp \
+    board/neutron/src/wiring_ipaddress.cpp board/neutron/src/wiring_string.cpp \
+    board/neutron/src/wiring_usbserial.cpp board/gcc/src/wiring_usbserial_hal.cpp
+system_params_ARGS = 4000
@@ -0,0 +1,313 @@
+/**
+ ******************************************************************************
+ * @file     : system_params_test.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : 系统参数区日志保存测试和掉电测试
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+/*
+  使用 gcc 板的参数区模拟 (wiring_flash_memory.cpp): 只能把1写成0, 统计写入/擦除次数, 可以模拟掉电
+  参数副本所在的 EEPROM 使用 gcc 板的页模拟 (wiring_eeprom_hal.cpp), 同样可以模拟掉电
+  参数区镜像保存在临时文件中; 重启 = EEPROM_Init 后重新 loadSystemParams
+  参数: 掉电测试的次数
+*/
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "application.h"
+#include "system_params.h"
+#include "wiring_flash_memory.h"
+#include "host_test.h"
+
+void SystemArgumentPowerLoss(int32_t n);
+void EEPROM_FlashPowerLoss(int32_t n);
+
+#define FLAGS_SIZE      sizeof(system_flags_t)
+#define PARAMS_SIZE     sizeof(system_params_t)
+
+static uint32_t erases(void)
+{
+    uint32_t p, e;
+
+    SystemArgumentStatistics(&p, &e);
+    return e;
+}
+
+static uint32_t programs(void)
+{
+    uint32_t p, e;
+
+    SystemArgumentStatistics(&p, &e);
+    return p;
+}
+
+static bool same(const system_params_t *a, const system_params_t *b)
+{
+    return memcmp(a, b, PARAMS_SIZE) == 0;
+}
+
+// 重启: EEPROM 重新从flash建立镜像, 参数重新加载
+static void reboot(system_params_t *p)
+{
+    EEPROM_Init();
+    loadSystemParams(p);
+}
+
+// initSystemParams 的结果
+static void defaults(system_params_t *p)
+{
+    memset(p, 0, PARAMS_SIZE);
+    p->system_flags.header = 0x5aa5f66f;
+    p->config_flag = 1;
+    p->system_flags.crc = crcSum((const uint8_t *)&p->system_flags, FLAGS_SIZE - 1);
+    p->crc = crcSum((const uint8_t *)&p->version, PARAMS_SIZE - FLAGS_SIZE - 1);
+}
+
+/*
+  随机修改: 多数只改几个字节, 少数改 system_flags 或大段内容
+  返回 true 时这次保存必须擦除重写
+*/
+static bool mutate(system_params_t *p)
+{
+    uint8_t *b = (uint8_t *)p;
+    uint32_t r = test_rand();
+    int n;
+
+    if(r % 50 == 0)
+    {
+        p->system_flags.boot_flag = (uint8_t)test_rand();
+        return true;
+    }
+    n = (r % 40 == 1) ? 300 + test_rand() % 300 : 1 + (r >> 8) % 12;
+    while(n--)
+    {
+        // system_flags 之后, 最后的 crc 之前
+        b[FLAGS_SIZE + test_rand() % (PARAMS_SIZE - FLAGS_SIZE - 1)] = (uint8_t)test_rand();
+    }
+    return (r % 40 == 1);
+}
+
+/*=======测试===============================================================*/
+static void test_blank(void)
+{
+    // 空参数区加载为初始参数
+    system_params_t p, d;
+
+    loadSystemParams(&p);
+    defaults(&d);
+    TEST_CHECK(same(&p, &d));
+}
+
+static void test_saves(void)
+{
+    // 随机保存与重新加载一致; 大多数保存只追加日志, 不擦除
+    system_params_t now, loaded;
+    uint32_t erase_start = erases(), program_start = programs();
+    int bad = 0, saves = 5000, rewrites = 0;
+
+    test_srand(16);
+    loadSystemParams(&now);
+    for(int i = 0; i < saves; i++)
+    {
+        rewrites += mutate(&now);
+        saveSystemParams(&now);
+        if(i % 7 == 0)
+        {
+            loadSystemParams(&loaded);
+            bad += !same(&now, &loaded);
+        }
+    }
+    loadSystemParams(&loaded);
+    bad += !same(&now, &loaded);
+    TEST_CHECK_EQ(bad, 0);
+    printf("%d saves (%d change system_flags or too much): %u erases, %u half words\n", saves, rewrites,
+           (unsigned)(erases() - erase_start), (unsigned)(programs() - program_start));
+    // 其余的擦除只在日志区写满时
+    TEST_CHECK(erases() - erase_start >= (uint32_t)rewrites);
+    TEST_CHECK(erases() - erase_start - rewrites < (uint32_t)saves / 200);
+
+    // 只有小改变时日志区写满才擦除, 写满之后继续正常保存
+    erase_start = erases();
+    for(int i = 0; i < 4000; i++)
+    {
+        now.sv_port = i;
+        saveSystemParams(&now);
+    }
+    loadSystemParams(&loaded);
+    TEST_CHECK(same(&now, &loaded));
+    TEST_CHECK(erases() - erase_start >= 1);
+    TEST_CHECK(erases() - erase_start <= 2);
+
+    // 没有改变的保存不写入
+    program_start = programs();
+    saveSystemParams(&now);
+    TEST_CHECK_EQ(programs() - program_start, 0);
+
+    // system_flags 改变时重写基础记录, 旧 bootloader 直接读到 boot_flag
+    erase_start = erases();
+    now.system_flags.boot_flag = 4;
+    saveSystemParams(&now);
+    TEST_CHECK_EQ(erases() - erase_start, 1);
+    SystemReadArgument(SYSTEM_ARGUMENT_ADDRESS, (uint16_t *)&loaded, PARAMS_SIZE / 2);
+    TEST_CHECK(same(&now, &loaded));
+}
+
+static void test_power_cut(int count)
+{
+    // 保存过程中任意时刻掉电: 加载得到完整的旧参数或新参数, 擦除重写时掉电也不回到初始参数
+    // 掉电时刻在写副本时(之后参数区的操作全部不生效), 或在写参数区时
+    system_params_t old, now, loaded, d;
+    int torn = 0, fallback = 0, kept_old = 0, rewrites = 0;
+
+    defaults(&d);
+    test_srand(17);
+    reboot(&old);
+    for(int i = 0; i < count; i++)
+    {
+        memcpy(&now, &old, PARAMS_SIZE);
+        mutate(&now);
+
+        uint32_t erase_start = erases();
+        if(test_rand() % 4 == 0)
+        {
+            EEPROM_FlashPowerLoss(test_rand() % 700);
+            SystemArgumentPowerLoss(0);
+        }
+        else
+        {
+            SystemArgumentPowerLoss(test_rand() % 700);
+        }
+        saveSystemParams(&now);
+        EEPROM_FlashPowerLoss(-1);
+        SystemArgumentPowerLoss(-1);
+        rewrites += (erases() != erase_start);
+
+        reboot(&loaded);
+        if(same(&loaded, &now))
+        {
+        }
+        else if(same(&loaded, &old))
+        {
+            kept_old++;
+        }
+        else if(same(&loaded, &d))
+        {
+            fallback++;
+        }
+        else
+        {
+            torn++;
+        }
+        memcpy(&old, &loaded, PARAMS_SIZE);
+    }
+    printf("%d power cuts (%d while rewriting): %d kept the old params, %d fell back to defaults\n",
+           count, rewrites, kept_old, fallback);
+    TEST_CHECK_EQ(torn, 0);
+    TEST_CHECK_EQ(fallback, 0);
+    TEST_CHECK(kept_old > 0);
+    TEST_CHECK(rewrites > 0);
+
+    // 掉电之后继续正常保存
+    mutate(&old);
+    saveSystemParams(&old);
+    reboot(&loaded);
+    TEST_CHECK(same(&old, &loaded));
+}
+
+static void test_backup(void)
+{
+    // 擦除重写前写入 EEPROM 副本; 基础记录损坏时从副本恢复并重写参数区
+    system_params_t p, loaded;
+    uint16_t crc;
+
+    reboot(&p);
+    strcpy(p.device_id, "backup");
+    p.system_flags.boot_flag = 1;
+    saveSystemParams(&p);
+    EEPROM.get(PARAMS_BACKUP_ADDRESS, loaded);
+    TEST_CHECK(same(&p, &loaded));
+
+    // 之后的日志不写副本
+    strcpy(p.access_token, "token");
+    saveSystemParams(&p);
+    EEPROM.get(PARAMS_BACKUP_ADDRESS, loaded);
+    TEST_CHECK(!same(&p, &loaded));
+
+    // 擦除之后掉电: 参数区为空, 使用副本
+    p.system_flags.boot_flag = 0;
+    EEPROM_FlashPowerLoss(-1);
+    SystemArgumentPowerLoss(1);
+    saveSystemParams(&p);
+    SystemArgumentPowerLoss(-1);
+    SystemReadArgument(SYSTEM_ARGUMENT_ADDRESS, (uint16_t *)&loaded, PARAMS_SIZE / 2);
+    TEST_CHECK_EQ(loaded.system_flags.header, 0xFFFFFFFF);
+    reboot(&loaded);
+    TEST_CHECK(same(&p, &loaded));
+    SystemReadArgument(SYSTEM_ARGUMENT_ADDRESS, (uint16_t *)&loaded, PARAMS_SIZE / 2);
+    TEST_CHECK(same(&p, &loaded));
+
+    // 副本和基础记录都损坏时回到初始参数
+    crc = 0;
+    EEPROM_WriteBlock(PARAMS_BACKUP_ADDRESS + PARAMS_SIZE, (const uint8_t *)&crc, 2);
+    SystemWriteArgument(SYSTEM_ARGUMENT_ADDRESS, (uint16_t *)&p, 8);
+    reboot(&loaded);
+    defaults(&p);
+    TEST_CHECK(same(&p, &loaded));
+}
+
+static void test_legacy_base(void)
+{
+    // 没有封记的旧基础记录按 crcSum 接受, 之后的日志写在其上
+    system_params_t p, loaded;
+
+    defaults(&p);
+    strcpy(p.device_id, "legacy");
+    p.crc = crcSum((const uint8_t *)&p.version, PARAMS_SIZE - FLAGS_SIZE - 1);
+    SystemWriteArgument(SYSTEM_ARGUMENT_ADDRESS, (uint16_t *)&p, PARAMS_SIZE / 2);
+
+    reboot(&loaded);
+    TEST_CHECK(same(&p, &loaded));
+
+    uint32_t erase_start = erases();
+    strcpy(p.access_token, "token");
+    saveSystemParams(&p);
+    TEST_CHECK_EQ(erases() - erase_start, 0);
+    reboot(&loaded);
+    TEST_CHECK(same(&p, &loaded));
+}
+
+int main(int argc, char *argv[])
+{
+    char file[64];
+
+    // 参数区镜像不能使用默认的 intorobot_params.bin
+    snprintf(file, sizeof(file), "/tmp/system_params_test_%d.bin", (int)getpid());
+    unlink(file);
+    setenv("INTOROBOT_FLASH_FILE", file, 1);
+
+    test_blank();
+    test_saves();
+    test_power_cut((argc > 1) ? atoi(argv[1]) : 4000);
+    test_backup();
+    test_legacy_base();
+
+    unlink(file);
+    return TEST_DONE();
+}
@@ -0,0 +1,6 @@
+# 串口循环DMA接收: 读写位置, 绕圈覆盖的检测和重新同步
+TESTS += uart_dma
+uart_dma_SRC = test/uart_dma/uart_dma_test.cpp board/neutron/src/lib_fifo.cpp \
+    board/gcc/src/cmsis_os.cpp board/neutron/src/wiring_print.cpp \
+    board/neutron/src/wiring_ipaddress.cpp board/neutron/src/wiring_string.cpp \
+    board/neutron/src/wiring_usbserial.cpp board/gcc/src/wiring_usbserial_hal.cpp
@@ -0,0 +1,263 @@
+/**
+ ******************************************************************************
+ * @file     : uart_dma_test.cpp
+ * @author   : robot
+ * @version  : V1.0.0
+ * @date     : 2016-05-20
+ * @brief    : 串口循环DMA接收读写位置模型测试
+ ******************************************************************************
+  Copyright (c) 2013-2014 IntoRobot Team.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+/*
+  neutron 串口1接收的主机模型:
+  生产者按循环DMA逐字节写入 fifo 缓冲, 在半满/全满/空闲中断时 fifo__sync 提交写位置
+  (与 uart1_dma_rx_update 相同); 消费者按过滤任务的方式 peek -> 检查溢出 -> 解析 -> 检查溢出 -> consume
+  fifo 的写位置就是数据流中的绝对位置, 消费者按位置检查每个字节:
+  没有报告溢出时读到的数据必须与数据流完全一致, 数据被覆盖时必须报告溢出
+*/
+#include <stdlib.h>
+
+#include "application.h"
+#include "lib_fifo.h"
+#include "host_test.h"
+
+#define RX_SIZE     4096        // 与 mo_uart1_init 相同
+#define RECV_SIZE   128         // AT_RECV_SIZE
+
+static uint8_t stream_byte(uint32_t i)
+{
+    return (uint8_t)(i * 167 + (i >> 9) + (i >> 17));
+}
+
+/*=======生产者: 循环DMA=====================================================*/
+static fifo_t rx;
+static uint32_t dma_pos;        // DMA 写位置 (RX_SIZE-NDTR)
+static uint32_t dma_total;      // DMA 写入的总长度
+static int syncs;
+
+static void dma_rx_update(void)
+{
+    fifo__sync(&rx, dma_pos);
+    syncs++;
+}
+
+// 一段连续数据, 结束时空闲中断
+static void dma_burst(int len)
+{
+    while(len--)
+    {
+        rx.buf[dma_pos] = stream_byte(dma_total++);
+        dma_pos = (dma_pos + 1) & (RX_SIZE - 1);
+        if((dma_pos == RX_SIZE / 2) || (dma_pos == 0))
+        {
+            dma_rx_update();        // 半满/全满中断
+        }
+    }
+    dma_rx_update();                // 空闲中断
+}
+
+/*=======消费者: 过滤任务==================================================*/
+static uint32_t reported;       // 已报告的溢出长度 (mo_uart1_overrun)
+static uint32_t delivered;      // 交给解析器并确认无误的数据
+static uint32_t overruns;       // 报告溢出的次数
+static int undetected;          // 数据错误但没有报告溢出
+
+static int uart_overrun(void)
+{
+    int len = (int)(fifo__overflow(&rx) - reported);
+
+    reported = fifo__overflow(&rx);
+    return len;
+}
+
+/*
+  处理一次 peek 的数据; during_parse 在解析过程中再写入 DMA 数据
+*/
+static void filter_step(int during_parse)
+{
+    uint8_t *p;
+    uint32_t pos = rx.p_r;
+    int len, k, bad = 0;
+
+    len = fifo__peek(&rx, &p);
+    if(len > RECV_SIZE)
+    {
+        len = RECV_SIZE;
+    }
+    if(uart_overrun() > 0)
+    {
+        overruns++;
+        pos = rx.p_r;               // 读取时已重新同步
+    }
+    if(during_parse)
+    {
+        dma_burst(during_parse);
+    }
+
+    for(k = 0; k < len; k++)
+    {
+        bad += (p[k] != stream_byte(pos + k));
+    }
+    if(uart_overrun() > 0)
+    {
+        overruns++;
+    }
+    else if(bad)
+    {
+        undetected++;
+    }
+    else
+    {
+        delivered += len;
+    }
+    fifo__consume(&rx, len);
+}
+
+static void drain(void)
+{
+    while(fifo__avaliable(&rx) > 0)
+    {
+        filter_step(0);
+    }
+}
+
+static void reset(void)
+{
+    if(rx.buf == NULL)
+    {
+        fifo__init(&rx, RX_SIZE);
+    }
+    rx.p_w = rx.p_r = 0;
+    rx.overflow = 0;
+    dma_pos = dma_total = 0;
+    reported = delivered = overruns = 0;
+    undetected = syncs = 0;
+}
+
+/*=======测试===============================================================*/
+static void test_no_lap(void)
+{
+    // 消费者在一圈之内读完: 不丢数据, 顺序一致, 跨越缓冲末尾
+    int i;
+
+    reset();
+    test_srand(3);
+    for(i = 0; i < 2000; i++)
+    {
+        dma_burst(1 + test_rand() % 1500);
+        drain();
+    }
+    TEST_CHECK_EQ(overruns, 0);
+    TEST_CHECK_EQ(undetected, 0);
+    TEST_CHECK_EQ(delivered, dma_total);
+}
+
+static void test_partial_stall(void)
+{
+    // 消费者停顿期间写入不到一圈(但超过半个缓冲, 跨越半满和全满中断)
+    reset();
+    dma_burst(3000);
+    filter_step(0);
+    dma_burst(RX_SIZE - 3000 + RECV_SIZE - 1);
+    drain();
+    TEST_CHECK_EQ(overruns, 0);
+    TEST_CHECK_EQ(delivered, dma_total);
+}
+
+static void test_lap_before_peek(void)
+{
+    // 停顿期间 DMA 绕了一圈覆盖未读数据: 报告溢出, 丢弃全部未读(包括覆盖之后收到的), 之后的数据正常
+    uint32_t before;
+
+    reset();
+    dma_burst(1000);
+    filter_step(0);
+    before = delivered;
+    dma_burst(RX_SIZE);             // 覆盖了尚未读取的数据
+    dma_burst(500);
+    filter_step(0);
+    TEST_CHECK_EQ(overruns, 1);
+    TEST_CHECK_EQ(fifo__avaliable(&rx), 0);
+
+    drain();
+    dma_burst(2000);
+    drain();
+    TEST_CHECK_EQ(overruns, 1);
+    TEST_CHECK_EQ(undetected, 0);
+    TEST_CHECK_EQ(delivered - before, 2000);
+}
+
+static void test_lap_during_parse(void)
+{
+    // 解析过程中 DMA 覆盖了正在解析的数据: 解析后检查必须报告溢出
+    int i;
+
+    reset();
+    test_srand(5);
+    for(i = 0; i < 500; i++)
+    {
+        dma_burst(1 + test_rand() % 200);
+        filter_step((test_rand() % 4 == 0) ? RX_SIZE - 50 + test_rand() % 300 : 0);
+    }
+    drain();
+    TEST_CHECK(overruns > 0);
+    TEST_CHECK_EQ(undetected, 0);
+    TEST_CHECK_EQ(fifo__avaliable(&rx), 0);
+}
+
+static void test_random(void)
+{
+    // 随机写入和随机停顿: 每个错误的字节都伴随溢出报告, 没有溢出时不丢数据
+    int i;
+
+    reset();
+    test_srand(11);
+    for(i = 0; i < 20000; i++)
+    {
+        uint32_t r = test_rand();
+
+        if(r % 3)
+        {
+            dma_burst(1 + (r >> 8) % 700);
+        }
+        else
+        {
+            filter_step(((r >> 4) % 50 == 0) ? (r >> 8) % (2 * RX_SIZE) : 0);
+        }
+        if(i % 100 == 0)
+        {
+            // 读完之后不能还有未报告的溢出
+            drain();
+            TEST_CHECK_EQ(uart_overrun(), 0);
+        }
+    }
+    drain();
+    TEST_CHECK_EQ(undetected, 0);
+    TEST_CHECK(delivered <= dma_total);
+    TEST_CHECK((overruns > 0) || (delivered == dma_total));
+}
+
+int main(int argc, char *argv[])
+{
+    test_no_lap();
+    test_partial_stall();
+    test_lap_before_peek();
+    test_lap_during_parse();
+    test_random();
+
+    return TEST_DONE();
+}